@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+char *names[] = {"ing", "string", "ring", "string", "", "g"};
+
+void print_twice(char *s) {
+    printf("%s %s\n", s, "string");
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 0; i < 6; i++) {
+        printf("[%s]\n", names[i]);
+    }
+    print_twice("ring");
+    print_twice("st");
+    printf("%s|%s|%s\n", "tail", "ail", "il");
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+
+// deep enough to overflow the wasm call stack if each tail call adds a frame
+
+int is_odd(int n);
+
+int is_even(int n) {
+    if (n == 0) {
+        return 1;
+    }
+    return is_odd(n - 1);
+}
+
+int is_odd(int n) {
+    if (n == 0) {
+        return 0;
+    }
+    return is_even(n - 1);
+}
+
+// a state machine that counts the runs of digits in a number, one digit per state transition
+
+int in_run(long n, int prev_digit, int runs);
+
+int between_runs(long n, int runs) {
+    if (n == 0) {
+        return runs;
+    }
+    return in_run(n / 10, n % 10, runs + 1);
+}
+
+int in_run(long n, int prev_digit, int runs) {
+    if (n == 0) {
+        return runs;
+    }
+    if (n % 10 == prev_digit) {
+        return in_run(n / 10, prev_digit, runs);
+    }
+    return between_runs(n, runs);
+}
+
+int main(int argc, char *argv[]) {
+    int n = 100000;
+    printf("is_even(%d) = %d\n", n, is_even(n));
+    printf("is_odd(%d) = %d\n", n + 1, is_odd(n + 1));
+    printf("is_even(%d) = %d\n", n + 1, is_even(n + 1));
+
+    long number = 1122233334444455L;
+    printf("runs in %ld: %d\n", number, between_runs(number, 0));
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <stdio.h>
+
+struct point {
+    int x;
+    int y;
+};
+
+unsigned char squares[16] = {0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100, 121, 144, 169, 196, 225};
+short deltas[] = {-3, -2, -1, 0, 1, 2, 3};
+long big = 1234567890123;
+double ratio = 2.5;
+float half = 0.5f;
+char *greeting = "hello";
+struct point origin = {3, -4};
+struct point path[3] = {{1, 2}, {3, 4}, {5, 6}};
+int counts[8];
+int *count_ptr = &counts[2];
+int total = 10 * 4 + 2;
+
+int main(int argc, char *argv[]) {
+    int sum = 0;
+    for (int i = 0; i < 16; i++) {
+        sum += squares[i];
+    }
+    printf("sum of squares: %d\n", sum);
+
+    for (int i = 0; i < 7; i++) {
+        printf("%d ", deltas[i]);
+    }
+    printf("\n");
+
+    printf("big: %ld, ratio * 10: %d, half * 10: %d\n", big, (int) (ratio * 10), (int) (half * 10));
+    printf("greeting: %s\n", greeting);
+    printf("origin: %d %d\n", origin.x, origin.y);
+    for (int i = 0; i < 3; i++) {
+        printf("path[%d]: %d %d\n", i, path[i].x, path[i].y);
+    }
+
+    *count_ptr = 7;
+    counts[5] = total;
+    for (int i = 0; i < 8; i++) {
+        printf("%d ", counts[i]);
+    }
+    printf("\n");
+
+    for (int i = 1; i < argc; i++) {
+        printf("arg %d: %s\n", i, argv[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+#include <stdio.h>
+
+struct pair {
+    char tag;
+    int value;
+};
+
+char global_c = 'g';
+long global_l = 1234567890123;
+short global_s = 7;
+double global_d = 2.5;
+
+int is_aligned(void *p, unsigned int alignment) {
+    return (unsigned int) p % alignment == 0;
+}
+
+long sum_down(char c, long n) {
+    short s = (short) n;
+    double d = (double) n;
+    char buf[3];
+    buf[0] = c;
+    long l = n * 3;
+    if (!is_aligned(&d, sizeof(double)) || !is_aligned(&l, sizeof(long))
+        || !is_aligned(&s, sizeof(short))) {
+        printf("misaligned local at depth %ld\n", n);
+    }
+    if (n == 0) {
+        return buf[0];
+    }
+    return l + s + (long) d + sum_down(c, n - 1);
+}
+
+int main(int argc, char *argv[]) {
+    char c = 'a';
+    long l = 100;
+    char c2 = 'b';
+    double d = 1.5;
+    short s = 3;
+    int i = 42;
+    struct pair p;
+    p.tag = 'p';
+    p.value = 9;
+
+    printf("locals: %d %d %d %d %d %d\n", is_aligned(&c, 1), is_aligned(&l, 8), is_aligned(&c2, 1),
+           is_aligned(&d, 8), is_aligned(&s, 2), is_aligned(&i, 4));
+    printf("struct: %d\n", is_aligned(&p, 4));
+    printf("globals: %d %d %d %d\n", is_aligned(&global_c, 1), is_aligned(&global_l, 8),
+           is_aligned(&global_s, 2), is_aligned(&global_d, 8));
+    printf("values: %c %ld %c %d %d %d %c %d\n", c, l, c2, (int) (d * 2), s, i, p.tag, p.value);
+    printf("global values: %c %ld %d %d\n", global_c, global_l, global_s, (int) (global_d * 2));
+    printf("sum: %ld\n", sum_down(c, 5));
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+
+char next_char(char c) {
+    return c + 1;
+}
+
+long widen(int n) {
+    return n;
+}
+
+int narrow(long n) {
+    return n;
+}
+
+double average(double a, float b, int c) {
+    return (a + b + c) / 3;
+}
+
+unsigned char wrap_around(unsigned char c) {
+    return c + 10;
+}
+
+void increment(int *p) {
+    *p = *p + 1;
+}
+
+int increment_param(int n) {
+    // taking the address of a param means it has to be stored in the stack frame
+    increment(&n);
+    return n;
+}
+
+int sum_to(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return sum_to(n - 1, acc + n);
+}
+
+int print_and_return(int n) {
+    // tail call to a variadic function
+    return printf("n = %d\n", n);
+}
+
+int main(int argc, char *argv[]) {
+    long big = 3000000000;
+    float f = 5;
+    f = f / 2;
+    // variadic args aren't promoted, so widen narrow return values before printing them
+    int c = next_char('a');
+    printf("%d\n", c);
+    printf("%ld\n", widen(-5));
+    printf("%d\n", narrow(big));
+    // the runtime printf doesn't format floats like libc does, so print as an int
+    printf("%d\n", (int)(average(1.5, f, 6) * 100));
+    int wrapped = wrap_around(250);
+    printf("%d\n", wrapped);
+    printf("%d\n", increment_param(41));
+    printf("%d\n", sum_to(100, 0));
+    print_and_return(7);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+
+enum Op { PUSH, ADD, SUB, MUL, DUP, SWAP, PRINT, JUMP_IF_NOT_ZERO, HALT };
+
+// a small stack machine, with the switch inside the dispatch loop
+void run(int *program) {
+    int stack[16];
+    int sp = 0;
+    int pc = 0;
+    while (1) {
+        int op = program[pc];
+        pc++;
+        switch (op) {
+            case PUSH:
+                stack[sp] = program[pc];
+                sp++;
+                pc++;
+                break;
+            case ADD:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] + stack[sp];
+                break;
+            case SUB:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] - stack[sp];
+                break;
+            case MUL:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] * stack[sp];
+                break;
+            case DUP:
+                stack[sp] = stack[sp - 1];
+                sp++;
+                break;
+            case SWAP: {
+                int temp = stack[sp - 1];
+                stack[sp - 1] = stack[sp - 2];
+                stack[sp - 2] = temp;
+                break;
+            }
+            case PRINT:
+                sp--;
+                printf("%d\n", stack[sp]);
+                break;
+            case JUMP_IF_NOT_ZERO:
+                sp--;
+                if (stack[sp] != 0) {
+                    pc = program[pc];
+                } else {
+                    pc++;
+                }
+                break;
+            case HALT:
+                return;
+            default:
+                printf("unknown op %d\n", op);
+                return;
+        }
+    }
+}
+
+// cases that don't start at zero, with gaps, fallthrough and a shared default
+int classify(int n) {
+    switch (n) {
+        case -2:
+            return 1;
+        case -1:
+        case 0:
+            return 2;
+        case 2:
+            n = n * 10;
+        case 3:
+            return n + 3;
+        case 5:
+        default:
+            return 0;
+    }
+}
+
+// too sparse for a jump table
+int sparse(int n) {
+    switch (n) {
+        case 1:
+            return 10;
+        case 100:
+            return 20;
+        case 1000:
+            return 30;
+        case 10000:
+            return 40;
+        default:
+            return 50;
+    }
+}
+
+int count_vowels(char *s) {
+    int count = 0;
+    for (int i = 0; s[i] != 0; i++) {
+        switch (s[i]) {
+            case 'a':
+            case 'e':
+            case 'i':
+            case 'o':
+            case 'u':
+                count++;
+                break;
+        }
+    }
+    return count;
+}
+
+int main(int argc, char *argv[]) {
+    // count down from 5, then do some arithmetic
+    int program[] = {
+        PUSH, 5,
+        // loop start (pc = 2)
+        DUP, PRINT, PUSH, 1, SUB, DUP, JUMP_IF_NOT_ZERO, 2,
+        PUSH, 6, PUSH, 7, MUL, PRINT,
+        PUSH, 1, PUSH, 3, SWAP, SUB, PRINT,
+        HALT
+    };
+    run(program);
+    int bad_program[] = {PUSH, 1, PRINT, 42};
+    run(bad_program);
+
+    for (int i = -4; i < 8; i++) {
+        printf("classify(%d) = %d\n", i, classify(i));
+    }
+    printf("%d %d %d\n", sparse(100), sparse(10000), sparse(7));
+    printf("%d\n", count_vowels("the quick brown fox jumps over the lazy dog"));
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+
+// count the words, numbers and other symbols in a string. The gotos jump between
+// the states from several places, so the relooper has to dispatch on the label
+// variable to get to the right state
+void scan(char *s) {
+    int words = 0;
+    int numbers = 0;
+    int others = 0;
+    int i = 0;
+    char c;
+
+start:
+    c = s[i];
+    if (c == '\0') goto done;
+    if (c >= 'a' && c <= 'z') goto in_word;
+    if (c >= '0' && c <= '9') goto in_number;
+    if (c == ' ') goto space;
+    goto other;
+
+in_word:
+    i++;
+    c = s[i];
+    if (c >= 'a' && c <= 'z') goto in_word;
+    words++;
+    if (c >= '0' && c <= '9') goto in_number;
+    if (c == ' ') goto space;
+    if (c == '\0') goto done;
+    goto other;
+
+in_number:
+    i++;
+    c = s[i];
+    if (c >= '0' && c <= '9') goto in_number;
+    numbers++;
+    if (c >= 'a' && c <= 'z') goto in_word;
+    if (c == ' ') goto space;
+    if (c == '\0') goto done;
+    goto other;
+
+space:
+    i++;
+    goto start;
+
+other:
+    others++;
+    i++;
+    c = s[i];
+    if (c >= 'a' && c <= 'z') goto in_word;
+    if (c >= '0' && c <= '9') goto in_number;
+    goto start;
+
+done:
+    printf("%d words, %d numbers, %d others\n", words, numbers, others);
+}
+
+int main() {
+    scan("hello world");
+    scan("abc123def 45 + 6 = xyz!!");
+    scan("  ");
+    scan("a1b2c3 ?x? 99 bottles");
+    scan("");
+    return 0;
+}
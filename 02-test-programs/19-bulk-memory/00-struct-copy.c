@@ -0,0 +1,66 @@
+#include <stdio.h>
+
+struct Point {
+    int x;
+    int y;
+    long z;
+    char tag;
+};
+
+// small enough to copy with a few loads and stores
+struct Pair {
+    char a;
+    char b;
+};
+
+int sum(struct Point p) {
+    // modifying the param mustn't change the caller's copy
+    p.x = 100;
+    return p.x + p.y + (int)p.z + p.tag;
+}
+
+struct Point make_point(int n) {
+    struct Point p;
+    p.x = n;
+    p.y = n * 2;
+    p.z = n * 3;
+    p.tag = 'a';
+    return p;
+}
+
+int count_down(struct Point p, int n) {
+    if (n == 0) return sum(p);
+    p.y = p.y + 1;
+    return count_down(p, n - 1);
+}
+
+int main() {
+    struct Point a;
+    a.x = 1;
+    a.y = 2;
+    a.z = 3;
+    a.tag = 'q';
+
+    struct Point b;
+    b = a;
+    b.x = 7;
+    printf("%d %d %d %d\n", a.x, b.x, b.y, (int)b.z);
+    printf("%d %d\n", sum(b), b.x);
+
+    struct Point c = make_point(5);
+    printf("%d %d %d %d\n", c.x, c.y, (int)c.z, (int)c.tag);
+
+    struct Point *ptr = &c;
+    struct Point d = *ptr;
+    *ptr = a;
+    printf("%d %d %d\n", d.x, ptr->x, c.y);
+
+    printf("%d\n", count_down(a, 3));
+
+    struct Pair p1;
+    p1.a = 3;
+    p1.b = 30;
+    struct Pair p2 = p1;
+    printf("%d %d\n", (int)p2.a, (int)p2.b);
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+
+struct Config {
+    int width;
+    int height;
+    long flags;
+    int depth;
+    int extra;
+};
+
+// leave garbage on the stack where the next function's frame will be
+int dirty_stack(int seed) {
+    int garbage[128];
+    int total = 0;
+    for (int i = 0; i < 128; i++) {
+        garbage[i] = seed * i + 7;
+        total += garbage[i];
+    }
+    return total;
+}
+
+int partial_initialisers() {
+    int big[64] = {1, 2, 3};
+    int small[3] = {9};
+    char name[32] = "hi";
+    struct Config config = {640, 480};
+
+    int total = 0;
+    for (int i = 0; i < 64; i++) {
+        total += big[i];
+    }
+    printf("%d %d %d %d\n", total, big[2], big[3], big[63]);
+    printf("%d %d %d\n", small[0], small[1], small[2]);
+    printf("%s %d %d\n", name, (int)name[2], (int)name[31]);
+    printf("%d %d %d %d %d\n", config.width, config.height, (int)config.flags, config.depth,
+           config.extra);
+    return total;
+}
+
+int main() {
+    dirty_stack(3);
+    partial_initialisers();
+    dirty_stack(5);
+    partial_initialisers();
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <stdio.h>
+
+double average(double a, float b, int c) {
+    return (a + b + c) / 3;
+}
+
+int main() {
+    // constant on every path through the branch
+    int x = 10;
+    int y;
+    if (x > 5) {
+        y = x * 2;
+    } else {
+        y = x - 1;
+    }
+    printf("%d\n", y);
+
+    // constant as a different type to the expression it's used in
+    unsigned char c = 250;
+    int wide = c + 10;
+    unsigned char narrow = c + 10;
+    printf("%d %d\n", wide, (int)narrow);
+
+    // not constant after the loop
+    int i = 0;
+    int total = 0;
+    while (i < 5) {
+        total = total + i;
+        i++;
+    }
+    printf("%d %d\n", i, total);
+
+    // vars whose address is taken can be changed through pointers
+    int z = 1;
+    int *p = &z;
+    *p = 42;
+    printf("%d\n", z);
+
+    // the same expression, with one of its operands reassigned in between
+    int a = i * total;
+    int b = i * total;
+    i = 7;
+    int d = i * total;
+    printf("%d %d %d\n", a, b, d);
+
+    // division by zero isn't folded
+    int zero = 0;
+    if (zero) {
+        printf("%d\n", 1 / zero);
+    }
+
+    float f = 5;
+    f = f / 2;
+    printf("%d\n", (int)(average(1.5, f, 6) * 100));
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+
+struct point {
+    int x;
+    int y;
+};
+
+int sum_backwards(int *values, int n) {
+    int total = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        total += values[i];
+    }
+    return total;
+}
+
+int main() {
+    // the row offset is invariant in the inner loop, and the index goes up by one each time
+    int grid[20];
+    int width = 5;
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < width; col++) {
+            grid[row * width + col] = row * 10 + col;
+        }
+    }
+    long total = 0;
+    for (int i = 0; i < 20; i++) {
+        total += grid[i];
+    }
+    printf("%d %d\n", grid[19], (int)total);
+
+    // stepping by more than one, and stepping down
+    int evens = 0;
+    for (int i = 0; i < 20; i += 2) {
+        evens += grid[i];
+    }
+    printf("%d %d\n", evens, sum_backwards(grid, 20));
+
+    // the loop counter is still needed after the loop
+    int j = 0;
+    while (j * 3 < 40) {
+        j++;
+    }
+    printf("%d\n", j);
+
+    // a loop that never runs
+    int count = 0;
+    for (int i = 0; i < count; i++) {
+        grid[i * 4] = 0;
+    }
+    printf("%d\n", grid[0]);
+
+    // a var declared inside the loop has its address taken on every iteration
+    int sums[3];
+    for (int i = 0; i < 3; i++) {
+        struct point p;
+        p.x = i;
+        p.y = i * i;
+        int *y = &p.y;
+        sums[i] = p.x + *y;
+    }
+    printf("%d %d %d\n", sums[0], sums[1], sums[2]);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+
+// char and short arithmetic is done in int, and only wrapped when it's stored
+void rot13(char *str) {
+    for (int i = 0; str[i] != '\0'; i++) {
+        char c = str[i];
+        if (c >= 'a' && c <= 'z') {
+            str[i] = (char)((c - 'a' + 13) % 26 + 'a');
+        } else if (c >= 'A' && c <= 'Z') {
+            str[i] = (char)((c - 'A' + 13) % 26 + 'A');
+        }
+    }
+}
+
+int checksum(unsigned char *bytes, int n) {
+    unsigned short sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum = sum * 31 + bytes[i];
+    }
+    return sum;
+}
+
+int main() {
+    char str[] = "Hello, World!";
+    rot13(str);
+    printf("%s\n", str);
+    rot13(str);
+    printf("%s\n", str);
+
+    unsigned char bytes[] = {200, 100, 250, 7, 255};
+    printf("%d\n", checksum(bytes, 5));
+
+    // promotions that keep the value
+    char c = -100;
+    short s = c;
+    int i = s;
+    unsigned char uc = 200;
+    short s2 = uc;
+    unsigned short us = uc;
+    unsigned int u = us;
+    printf("%d %d %d %d %u\n", s, i, s2, us, u);
+
+    // truncations in the middle of a chain change the value
+    int big = 300;
+    char narrowed = big;
+    int widened = narrowed;
+    unsigned char unarrowed = big;
+    short swidened = unarrowed;
+    printf("%d %d\n", widened, swidened);
+
+    // truncations after a wider conversion
+    short minus = -2;
+    unsigned int uminus = minus;
+    unsigned char low = uminus;
+    char back = (char)(int)c;
+    printf("%u %d %d\n", uminus, low, back);
+
+    // char arithmetic that overflows
+    char x = 120;
+    x = x + 10;
+    unsigned char y = 250;
+    y = y + 10;
+    printf("%d %d\n", x, y);
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+
+int counter = 0;
+
+int fibonacci(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fibonacci(n - 1) + fibonacci(n - 2);
+}
+
+unsigned int gcd(unsigned int a, unsigned int b) {
+    while (b != 0) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+char to_upper(char c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 'A';
+    }
+    return c;
+}
+
+double power(double x, int n) {
+    double result = 1;
+    for (int i = 0; i < n; i++) {
+        result *= x;
+    }
+    return result;
+}
+
+// too many steps to evaluate at compile time
+long slow_sum(long n) {
+    long total = 0;
+    for (long i = 0; i < n; i++) {
+        total += i % 7;
+    }
+    return total;
+}
+
+// has a side effect, so it's always called at runtime
+int count(int n) {
+    counter += n;
+    return counter;
+}
+
+// traps at runtime if called with 0
+int divide(int a, int b) {
+    return a / b;
+}
+
+int main() {
+    printf("%d %d\n", fibonacci(10), fibonacci(25));
+    printf("%u\n", gcd(1071, 462));
+    printf("%c%c%c\n", to_upper('a'), to_upper('Z'), to_upper('!'));
+    printf("%d\n", (int)(power(1.5, 3) * 1000));
+    printf("%ld\n", slow_sum(1000000));
+    count(3);
+    int total = count(4);
+    printf("%d %d\n", total, counter);
+    printf("%d\n", divide(17, 5));
+
+    int n = 12;
+    printf("%d\n", fibonacci(n));
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+
+char to_upper(char c) {
+    if (c >= 'a' && c <= 'z') {
+        return c - 32;
+    }
+    return c;
+}
+
+// the int result has to be wrapped to the char return type
+char add_chars(char a, char b) {
+    return a + b;
+}
+
+int clamp(int x, int low, int high) {
+    if (x < low) {
+        return low;
+    }
+    if (x > high) {
+        return high;
+    }
+    return x;
+}
+
+void swap(int *a, int *b) {
+    int temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+void count_call(int *calls) {
+    (*calls)++;
+}
+
+// takes the address of its own local, which needs a separate var in each copy
+int double_through_pointer(int x) {
+    int local = x;
+    int *p = &local;
+    *p = *p * 2;
+    return local;
+}
+
+long widen(int x) {
+    return x;
+}
+
+int main() {
+    char s[12] = "hello world";
+    for (int i = 0; s[i] != 0; i++) {
+        s[i] = to_upper(s[i]);
+    }
+    printf("%s\n", s);
+
+    printf("%d\n", (int)add_chars(100, 100));
+    printf("%d %d %d\n", clamp(-5, 0, 10), clamp(5, 0, 10), clamp(50, 0, 10));
+
+    int a = 1;
+    int b = 2;
+    swap(&a, &b);
+    printf("%d %d\n", a, b);
+
+    int calls = 0;
+    for (int i = 0; i < 3; i++) {
+        count_call(&calls);
+    }
+    // the return value isn't used
+    clamp(1, 2, 3);
+    printf("%d\n", calls);
+
+    int total = 0;
+    for (int i = 1; i <= 4; i++) {
+        total += double_through_pointer(i);
+    }
+    printf("%d\n", total);
+
+    long big = widen(-7) * 1000000000;
+    printf("%ld\n", big);
+
+    return 0;
+}
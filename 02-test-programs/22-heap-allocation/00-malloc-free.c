@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+struct node {
+    int value;
+    struct node *next;
+};
+
+struct node *push(struct node *list, int value) {
+    struct node *new_node = malloc(sizeof(struct node));
+    new_node->value = value;
+    new_node->next = list;
+    return new_node;
+}
+
+int sum_and_free(struct node *list) {
+    int sum = 0;
+    while (list != NULL) {
+        struct node *next = list->next;
+        sum += list->value;
+        free(list);
+        list = next;
+    }
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    // small blocks, which are reused from the free list the second time round
+    for (int round = 0; round < 2; round++) {
+        struct node *list = NULL;
+        for (int i = 1; i <= 100; i++) {
+            list = push(list, i);
+        }
+        printf("list sum: %d\n", sum_and_free(list));
+    }
+
+    // a block bigger than the initial memory, so memory has to grow
+    int count = 100000;
+    int *numbers = malloc(count * sizeof(int));
+    if (numbers == NULL) {
+        printf("allocation failed\n");
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        numbers[i] = i % 7;
+    }
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += numbers[i];
+    }
+    printf("array total: %d\n", total);
+
+    // blocks of different sizes don't overlap
+    char *a = malloc(3);
+    char *b = malloc(30);
+    char *c = malloc(300);
+    for (int i = 0; i < 3; i++) {
+        a[i] = 'a';
+    }
+    for (int i = 0; i < 30; i++) {
+        b[i] = 'b';
+    }
+    for (int i = 0; i < 300; i++) {
+        c[i] = 'c';
+    }
+    printf("%c %c %c\n", a[2], b[29], c[299]);
+    free(a);
+    free(b);
+    free(c);
+    free(numbers);
+
+    // freeing NULL does nothing
+    free(NULL);
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#include <stdio.h>
+
+// each call has its own array in the stack frame, so deep recursion needs far more stack
+// than the compiler estimates, and the memory has to grow
+int sum_digits_to(int n) {
+    int digits[8];
+    int count = 0;
+    int x = n;
+    while (x > 0) {
+        digits[count] = x % 10;
+        count++;
+        x = x / 10;
+    }
+    int digit_sum = 0;
+    for (int i = 0; i < count; i++) {
+        digit_sum += digits[i];
+    }
+    if (n == 0) {
+        return 0;
+    }
+    return digit_sum + sum_digits_to(n - 1);
+}
+
+int main(int argc, char *argv[]) {
+    printf("%d\n", sum_digits_to(20000));
+    return 0;
+}
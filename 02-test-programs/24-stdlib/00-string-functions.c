@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_strtol(char *str, int base) {
+    char *endptr = NULL;
+    long value = strtol(str, &endptr, base);
+    int offset = endptr - str;
+    printf("strtol(\"%s\", %d): %ld, endptr offset %d\n", str, base, value, offset);
+}
+
+void test_strstr(char *haystack, char *needle) {
+    char *found = strstr(haystack, needle);
+    if (found == NULL) {
+        printf("strstr(\"%s\", \"%s\"): NULL\n", haystack, needle);
+    } else {
+        int offset = found - haystack;
+        printf("strstr(\"%s\", \"%s\"): offset %d\n", haystack, needle, offset);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    test_strtol("  42", 10);
+    test_strtol("-17xyz", 10);
+    test_strtol("+99", 10);
+    test_strtol("ff", 16);
+    test_strtol("0x1A", 16);
+    test_strtol("0x1A", 0);
+    test_strtol("0755", 0);
+    test_strtol("101102", 2);
+    test_strtol("zz", 36);
+    test_strtol("0x", 16);
+    test_strtol("abc", 10);
+    test_strtol("", 10);
+
+    unsigned long big = strtoul("4000000000", NULL, 10);
+    printf("strtoul: %lu\n", big);
+
+    test_strstr("hello world", "world");
+    test_strstr("hello world", "o");
+    test_strstr("hello world", "");
+    test_strstr("hello world", "worlds");
+    test_strstr("aaab", "aab");
+
+    printf("strlen: %d %d\n", strlen(""), strlen("hello"));
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <string.h>
+
+char buffer[80];
+char copy[80];
+
+void print_buffer(char *buf, int n) {
+    for (int i = 0; i < n; i++) {
+        printf("%c", buf[i] == '\0' ? '.' : buf[i]);
+    }
+    printf("\n");
+}
+
+void test_strlen(int start) {
+    for (int len = 0; len < 40; len += 7) {
+        memset(buffer, 'a', sizeof(buffer));
+        buffer[start + len] = '\0';
+        int result = strlen(buffer + start);
+        printf("strlen from %d, length %d: %d\n", start, len, result);
+    }
+}
+
+void test_memchr(int start, int n, char c) {
+    char *found = memchr(buffer + start, c, n);
+    if (found == NULL) {
+        printf("memchr from %d, %d bytes, '%c': NULL\n", start, n, c);
+    } else {
+        int offset = found - buffer;
+        printf("memchr from %d, %d bytes, '%c': offset %d\n", start, n, c, offset);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    for (int start = 0; start < 17; start += 3) {
+        test_strlen(start);
+    }
+
+    for (int i = 0; i < 80; i++) {
+        buffer[i] = 'a' + i % 26;
+    }
+    test_memchr(0, 80, 'a');
+    test_memchr(1, 80 - 1, 'a');
+    test_memchr(3, 40, 'z');
+    test_memchr(5, 16, 'u');
+    test_memchr(5, 15, 'u');
+    test_memchr(0, 0, 'a');
+    test_memchr(40, 33, 'x');
+    test_memchr(2, 20, '?');
+
+    for (int n = 0; n < 40; n += 5) {
+        memset(copy, '\0', sizeof(copy));
+        char *result = memcpy(copy + 3, buffer + n, n);
+        int offset = result - copy;
+        printf("memcpy %d bytes, returned offset %d: ", n, offset);
+        print_buffer(copy, 48);
+    }
+
+    for (int n = 0; n < 40; n += 6) {
+        memset(copy, '-', sizeof(copy));
+        char *result = memset(copy + n % 7, 'x' + n % 3, n);
+        int offset = result - copy;
+        printf("memset %d bytes, returned offset %d: ", n, offset);
+        print_buffer(copy, 48);
+    }
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+#include <stdio.h>
+
+#define DEBUG 0
+
+int clamp(int x) {
+    if (x < 0) {
+        return 0;
+    }
+    if (x > 100) {
+        return 100;
+    }
+    return x;
+    // never reached
+    printf("unreachable\n");
+    return -1;
+}
+
+// gotos to gotos
+int count_down(int n) {
+    int steps = 0;
+start:
+    if (n <= 0) {
+        goto done;
+    }
+    n--;
+    steps++;
+    goto next;
+next:
+    goto start;
+done:
+    goto finish;
+finish:
+    return steps;
+}
+
+int first_even(int *values, int n) {
+    for (int i = 0; i < n; i++) {
+        if (values[i] % 2 == 0) {
+            return values[i];
+        } else {
+            continue;
+        }
+    }
+    return -1;
+}
+
+int main() {
+    // constant conditions
+    if (DEBUG) {
+        printf("debugging\n");
+    }
+    while (0) {
+        printf("never\n");
+    }
+    do {
+        printf("once\n");
+    } while (0);
+    if (1) {
+        printf("always\n");
+    } else {
+        printf("never\n");
+    }
+
+    printf("%d %d %d\n", clamp(-5), clamp(50), clamp(500));
+    printf("%d\n", count_down(7));
+
+    int values[] = {3, 5, 8, 9};
+    printf("%d\n", first_even(values, 4));
+    printf("%d\n", first_even(values, 2));
+
+    // a loop that only exits with a break
+    int i = 0;
+    while (1) {
+        i += 3;
+        if (i > 10) {
+            break;
+        }
+    }
+    printf("%d\n", i);
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREAD_COUNT 4
+
+#ifdef __GNUC__
+// gcc doesn't have this compiler's threads.h, so the expected output comes from the same API
+// built on pthreads
+#include <pthread.h>
+
+void *thread_main(void *arg);
+
+pthread_t native_threads[THREAD_COUNT];
+int native_thread_count = 0;
+
+int thread_create(void *arg) {
+    if (native_thread_count == THREAD_COUNT ||
+        pthread_create(&native_threads[native_thread_count], NULL, thread_main, arg) != 0) {
+        return -1;
+    }
+    return native_thread_count++;
+}
+
+void *thread_join(int thread) {
+    void *result;
+    pthread_join(native_threads[thread], &result);
+    return result;
+}
+#else
+#include <threads.h>
+#endif
+
+struct job {
+    int id;
+    int count;
+    long sum;
+};
+
+// each thread fills its own heap block, so the allocator is used by all the threads at once
+void *thread_main(void *arg) {
+    struct job *job = arg;
+    long sum = 0;
+    for (int round = 0; round < 10; round++) {
+        int *numbers = malloc(job->count * sizeof(int));
+        for (int i = 0; i < job->count; i++) {
+            numbers[i] = job->id * 1000 + i;
+        }
+        for (int i = 0; i < job->count; i++) {
+            sum += numbers[i];
+        }
+        free(numbers);
+    }
+    job->sum = sum;
+    return job;
+}
+
+int main(int argc, char *argv[]) {
+    struct job jobs[THREAD_COUNT];
+    int threads[THREAD_COUNT];
+
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        jobs[i].id = i + 1;
+        jobs[i].count = 100 * (i + 1);
+        jobs[i].sum = 0;
+        threads[i] = thread_create(&jobs[i]);
+        if (threads[i] == -1) {
+            printf("couldn't create thread %d\n", i);
+            return 1;
+        }
+    }
+
+    // the main thread allocates while the others are running too
+    char *message = malloc(32);
+    for (int i = 0; i < 31; i++) {
+        message[i] = 'a' + i % 26;
+    }
+    message[31] = '\0';
+
+    long total = 0;
+    for (int i = 0; i < THREAD_COUNT; i++) {
+        struct job *finished = thread_join(threads[i]);
+        if (finished != &jobs[i]) {
+            printf("thread %d returned the wrong job\n", i);
+            return 1;
+        }
+        printf("job %d: sum %ld\n", finished->id, finished->sum);
+        total += finished->sum;
+    }
+    printf("total: %ld\n", total);
+    printf("%s\n", message);
+    free(message);
+
+    return 0;
+}
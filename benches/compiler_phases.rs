@@ -0,0 +1,286 @@
+//! Benchmarks of each phase of the compiler on its own, over the test programs and over
+//! generated inputs that stress how the compiler scales: a file with thousands of
+//! functions, deeply nested loops, and a switch with thousands of cases.
+//!
+//! Run with `cargo bench`, or `cargo bench -- <filter>` to only run the benchmarks whose
+//! names contain the filter, eg. `cargo bench -- reloop/` or `cargo bench -- many-functions`.
+
+use std::env;
+use std::fmt::Write;
+use std::fs;
+use std::hint::black_box;
+use std::path::{Path, PathBuf};
+use std::time::{Duration, Instant};
+
+use c_to_wasm_compiler::benchmarking::{self, BenchmarkConfig, Ir, Module};
+
+const TEST_PROGRAMS_DIR: &str = "02-test-programs";
+/// Each benchmark is repeated until it has run for at least this long...
+const TARGET_MEASUREMENT_TIME: Duration = Duration::from_secs(1);
+/// ...and at least this many times
+const MIN_SAMPLES: usize = 5;
+const MAX_SAMPLES: usize = 1000;
+
+struct Input {
+    name: String,
+    source: String,
+}
+
+fn main() {
+    // cargo passes --bench, and any arguments after -- are passed on as they are
+    let filter = env::args().skip(1).find(|arg| !arg.starts_with("--"));
+    let config = BenchmarkConfig::new();
+
+    let mut inputs = test_program_inputs();
+    inputs.push(Input {
+        name: "many-functions-10000".to_owned(),
+        source: many_functions(10_000),
+    });
+    inputs.push(Input {
+        name: "nested-loops-64".to_owned(),
+        source: nested_loops(64),
+    });
+    inputs.push(Input {
+        name: "huge-switch-5000".to_owned(),
+        source: huge_switch(5_000),
+    });
+
+    println!(
+        "{:<56}{:>12}{:>12}{:>12}{:>9}",
+        "benchmark", "median", "min", "max", "samples"
+    );
+    for input in &inputs {
+        if let Err(e) = bench_input(input, &config, filter.as_deref()) {
+            println!("skipping {}: {e}", input.name);
+        }
+    }
+}
+
+/// Benchmarks every phase on one input. Each phase is given the output of the previous
+/// phases, which is regenerated outside the timed part when the phase consumes it.
+fn bench_input(
+    input: &Input,
+    config: &BenchmarkConfig,
+    filter: Option<&str>,
+) -> Result<(), String> {
+    // check the whole pipeline works on this input before timing any of it
+    let module = compile(&input.source, config)?;
+
+    let benchmark = |phase: &str| {
+        let name = format!("{phase}/{}", input.name);
+        match filter {
+            Some(filter) if !name.contains(filter) => None,
+            _ => Some(name),
+        }
+    };
+    let optimised_ir = || {
+        let mut ir = to_ir(&input.source).unwrap();
+        benchmarking::optimise_ir(&mut ir, config).unwrap();
+        ir
+    };
+
+    if let Some(name) = benchmark("lex") {
+        bench(&name, || (), |()| benchmarking::lex(&input.source));
+    }
+    if let Some(name) = benchmark("parse") {
+        bench(
+            &name,
+            || input.source.to_owned(),
+            |source| benchmarking::parse(source).unwrap(),
+        );
+    }
+    if let Some(name) = benchmark("convert_to_ir") {
+        bench(
+            &name,
+            || benchmarking::parse(input.source.to_owned()).unwrap(),
+            |ast| benchmarking::convert_to_ir(ast).unwrap(),
+        );
+    }
+    if let Some(name) = benchmark("optimise_ir") {
+        bench(
+            &name,
+            || to_ir(&input.source).unwrap(),
+            |mut ir| {
+                benchmarking::optimise_ir(&mut ir, config).unwrap();
+                ir
+            },
+        );
+    }
+    if let Some(name) = benchmark("reloop") {
+        bench(&name, optimised_ir, benchmarking::reloop);
+    }
+    if let Some(name) = benchmark("allocate_local_vars") {
+        bench(
+            &name,
+            || benchmarking::reloop(optimised_ir()),
+            |relooped| benchmarking::allocate_local_vars(relooped, config).unwrap(),
+        );
+    }
+    if let Some(name) = benchmark("generate_target_code") {
+        bench(
+            &name,
+            || benchmarking::reloop(optimised_ir()),
+            |relooped| benchmarking::generate_target_code(relooped, config).unwrap(),
+        );
+    }
+    if let Some(name) = benchmark("to_bytes") {
+        bench(&name, || (), |()| benchmarking::to_bytes(&module));
+    }
+    Ok(())
+}
+
+fn to_ir(source: &str) -> Result<Ir, String> {
+    let ast = benchmarking::parse(source.to_owned()).map_err(|e| e.to_string())?;
+    benchmarking::convert_to_ir(ast).map_err(|e| e.to_string())
+}
+
+fn compile(source: &str, config: &BenchmarkConfig) -> Result<Module, String> {
+    let mut ir = to_ir(source)?;
+    benchmarking::optimise_ir(&mut ir, config).map_err(|e| e.to_string())?;
+    let relooped = benchmarking::reloop(ir);
+    benchmarking::generate_target_code(relooped, config).map_err(|e| e.to_string())
+}
+
+/// Times routine, giving it a fresh input from setup each time. Neither setup nor dropping
+/// the routine's output is timed.
+fn bench<S, T>(name: &str, mut setup: impl FnMut() -> S, mut routine: impl FnMut(S) -> T) {
+    // warm up
+    black_box(routine(setup()));
+
+    let mut samples = Vec::new();
+    let mut total = Duration::ZERO;
+    while samples.len() < MAX_SAMPLES
+        && (samples.len() < MIN_SAMPLES || total < TARGET_MEASUREMENT_TIME)
+    {
+        let input = setup();
+        let start = Instant::now();
+        let output = black_box(routine(black_box(input)));
+        let elapsed = start.elapsed();
+        drop(output);
+        samples.push(elapsed);
+        total += elapsed;
+    }
+
+    samples.sort();
+    println!(
+        "{:<56}{:>12}{:>12}{:>12}{:>9}",
+        name,
+        format_duration(samples[samples.len() / 2]),
+        format_duration(samples[0]),
+        format_duration(samples[samples.len() - 1]),
+        samples.len()
+    );
+}
+
+fn format_duration(duration: Duration) -> String {
+    let nanos = duration.as_nanos();
+    if nanos < 1_000 {
+        format!("{nanos} ns")
+    } else if nanos < 1_000_000 {
+        format!("{:.2} us", nanos as f64 / 1e3)
+    } else if nanos < 1_000_000_000 {
+        format!("{:.2} ms", nanos as f64 / 1e6)
+    } else {
+        format!("{:.2} s", nanos as f64 / 1e9)
+    }
+}
+
+/// Every C file in the test programs, preprocessed once up front
+fn test_program_inputs() -> Vec<Input> {
+    let mut filepaths = Vec::new();
+    find_c_files(Path::new(TEST_PROGRAMS_DIR), &mut filepaths);
+    filepaths.sort();
+
+    let mut inputs = Vec::new();
+    for filepath in filepaths {
+        let name = filepath
+            .strip_prefix(TEST_PROGRAMS_DIR)
+            .unwrap()
+            .to_string_lossy()
+            .into_owned();
+        match benchmarking::preprocess(&filepath) {
+            Ok(source) => inputs.push(Input { name, source }),
+            Err(e) => println!("skipping {name}: {e}"),
+        }
+    }
+    inputs
+}
+
+fn find_c_files(dir: &Path, filepaths: &mut Vec<PathBuf>) {
+    let entries = match fs::read_dir(dir) {
+        Ok(entries) => entries,
+        Err(_) => return,
+    };
+    for entry in entries.flatten() {
+        let path = entry.path();
+        if path.is_dir() {
+            find_c_files(&path, filepaths);
+        } else if path.extension().map_or(false, |extension| extension == "c") {
+            filepaths.push(path);
+        }
+    }
+}
+
+/// A chain of functions that each call the previous one, so none are unreachable
+fn many_functions(count: usize) -> String {
+    let mut source = String::new();
+    source.push_str("int f0(int x) {\n  return x;\n}\n");
+    for i in 1..count {
+        writeln!(
+            source,
+            "int f{i}(int x) {{\n  int y = x * {i};\n  if (y > 100) {{\n    return y - x;\n  }}\n  \
+             return y + f{}(x);\n}}",
+            i - 1
+        )
+        .unwrap();
+    }
+    writeln!(
+        source,
+        "int main(int argc, char *argv[]) {{\n  return f{}(argc) % 256;\n}}",
+        count - 1
+    )
+    .unwrap();
+    source
+}
+
+fn nested_loops(depth: usize) -> String {
+    let mut source = String::from("int main(int argc, char *argv[]) {\n  int sum = 0;\n");
+    for i in 0..depth {
+        writeln!(
+            source,
+            "{:indent$}for (int i{i} = 0; i{i} < argc + 1; i{i}++) {{",
+            "",
+            indent = 2 * (i + 1)
+        )
+        .unwrap();
+    }
+    let indices: Vec<String> = (0..depth).map(|i| format!("i{i}")).collect();
+    writeln!(
+        source,
+        "{:indent$}sum += {};",
+        "",
+        indices.join(" + "),
+        indent = 2 * (depth + 1)
+    )
+    .unwrap();
+    for i in (0..depth).rev() {
+        writeln!(source, "{:indent$}}}", "", indent = 2 * (i + 1)).unwrap();
+    }
+    source.push_str("  return sum % 256;\n}\n");
+    source
+}
+
+fn huge_switch(cases: usize) -> String {
+    let mut source =
+        String::from("int main(int argc, char *argv[]) {\n  int r;\n  switch (argc) {\n");
+    for i in 0..cases {
+        writeln!(
+            source,
+            "    case {i}:\n      r = {};\n      break;",
+            (i * 7) % 256
+        )
+        .unwrap();
+    }
+    source.push_str("    default:\n      r = 0;\n  }\n  return r;\n}\n");
+    source
+}
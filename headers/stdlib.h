@@ -5,8 +5,82 @@
 
 #define EXIT_SUCCESS 0
 
+typedef int size_t;
+
 long strtol(const char *str, char **endptr, int base);
 
 unsigned long strtoul(const char *str, char **endptr, int base);
 
+void *malloc(size_t size);
+
+void free(void *ptr);
+
+// Values too big for an unsigned long wrap around, rather than saturating and setting errno
+unsigned long strtoul(const char *str, char **endptr, int base) {
+    const char *s = str;
+    while (*s == ' ' || (*s >= '\t' && *s <= '\r')) {
+        s++;
+    }
+
+    int negative = 0;
+    if (*s == '-') {
+        negative = 1;
+        s++;
+    } else if (*s == '+') {
+        s++;
+    }
+
+    int has_hex_prefix = 0;
+    if ((base == 0 || base == 16) && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        has_hex_prefix = 1;
+        base = 16;
+        s = s + 2;
+    } else if (base == 0 && s[0] == '0') {
+        base = 8;
+    } else if (base == 0) {
+        base = 10;
+    }
+
+    const char *digits_start = s;
+    unsigned long result = 0;
+    while (1) {
+        int digit;
+        if (*s >= '0' && *s <= '9') {
+            digit = *s - '0';
+        } else if (*s >= 'a' && *s <= 'z') {
+            digit = *s - 'a' + 10;
+        } else if (*s >= 'A' && *s <= 'Z') {
+            digit = *s - 'A' + 10;
+        } else {
+            break;
+        }
+        if (digit >= base) {
+            break;
+        }
+        result = result * base + digit;
+        s++;
+    }
+
+    if (endptr != NULL) {
+        if (s != digits_start) {
+            *endptr = (char *) s;
+        } else if (has_hex_prefix) {
+            // "0x" without any hex digits after it is just the 0
+            *endptr = (char *) (digits_start - 1);
+        } else {
+            // no number was read
+            *endptr = (char *) str;
+        }
+    }
+
+    if (negative) {
+        return -result;
+    }
+    return result;
+}
+
+long strtol(const char *str, char **endptr, int base) {
+    return (long) strtoul(str, endptr, base);
+}
+
 #endif
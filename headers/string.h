@@ -5,8 +5,28 @@
 
 typedef int size_t;
 
+// strlen, memchr, memcpy and memset are generated by the compiler, to process 16 bytes at a time
 size_t strlen(const char *s);
+void *memchr(const void *s, int c, size_t n);
+void *memcpy(void *dest, const void *src, size_t n);
+void *memset(void *s, int c, size_t n);
 
 char *strstr(const char *, const char *);
 
+char *strstr(const char *haystack, const char *needle) {
+    while (1) {
+        int i = 0;
+        while (needle[i] != '\0' && haystack[i] == needle[i]) {
+            i++;
+        }
+        if (needle[i] == '\0') {
+            return (char *) haystack;
+        }
+        if (*haystack == '\0') {
+            return NULL;
+        }
+        haystack++;
+    }
+}
+
 #endif
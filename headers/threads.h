@@ -0,0 +1,15 @@
+#ifndef _THREADS_H
+#define _THREADS_H
+
+// Only available when compiled with --threads. Each new thread runs thread_main(arg), which
+// the program defines, and has to be joined by the thread that created it.
+
+// Returns the new thread's id, or -1 if too many threads are running
+int thread_create(void *arg);
+
+// Waits for the thread to finish, and returns what its thread_main() returned
+void *thread_join(int thread);
+
+void *thread_main(void *arg);
+
+#endif
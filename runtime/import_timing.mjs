@@ -0,0 +1,18 @@
+import {performance} from "perf_hooks";
+
+// wrap each import so the time spent in it is added to import_timing
+export const time_imports = (functions, import_timing) => {
+    const timed_functions = {};
+    for (const [name, f] of Object.entries(functions)) {
+        timed_functions[name] = (...args) => {
+            const start = performance.now();
+            try {
+                return f(...args);
+            } finally {
+                import_timing.ms += performance.now() - start;
+                import_timing.calls += 1;
+            }
+        };
+    }
+    return timed_functions;
+};
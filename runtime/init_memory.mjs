@@ -1,4 +1,4 @@
-import {PTR_SIZE} from "./memory_constants.mjs";
+import {PTR_SIZE, STACK_FRAME_ALIGNMENT} from "./memory_constants.mjs";
 import {read_stack_ptr, store_ptr, store_stack_ptr} from "./memory_operations.mjs";
 
 // put the program arguments into wasm memory
@@ -28,7 +28,27 @@ export const put_args_into_memory = (args, wasm_memory) => {
         stack_ptr += 1;
     }
 
+    // keep the stack ptr aligned for main()'s stack frame
+    stack_ptr = Math.ceil(stack_ptr / STACK_FRAME_ALIGNMENT) * STACK_FRAME_ALIGNMENT;
     store_stack_ptr(stack_ptr, memory);
 
     return {argc, argv};
 }
+
+// the initial and maximum number of pages of memory the module needs, and whether it's shared
+// between threads, from its custom section, as a descriptor for new WebAssembly.Memory
+export const read_memory_limits = (wasm_module) => {
+    const sections = WebAssembly.Module.customSections(wasm_module, "memory_limits");
+    if (sections.length === 0) {
+        return {initial: 1};
+    }
+    const [initial, maximum, shared] = new TextDecoder().decode(sections[0]).split(" ");
+    const memory_limits = {initial: parseInt(initial, 10)};
+    if (maximum !== undefined) {
+        memory_limits.maximum = parseInt(maximum, 10);
+    }
+    if (shared === "shared") {
+        memory_limits.shared = true;
+    }
+    return memory_limits;
+};
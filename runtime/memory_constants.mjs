@@ -10,9 +10,7 @@ export const SIZE_T_SIZE = I32_SIZE;
 export const FRAME_PTR_ADDR = 0;
 export const TEMP_FRAME_PTR_ADDR = FRAME_PTR_ADDR + PTR_SIZE;
 export const STACK_PTR_ADDR = TEMP_FRAME_PTR_ADDR + PTR_SIZE;
-
-export const MAX_I16 = 65_536n;
-export const MAX_I32 = 4_294_967_296n;
-export const MAX_I64 = 18_446_744_073_709_551_616n;
+// the stack ptr is kept a multiple of this, so each stack frame starts aligned
+export const STACK_FRAME_ALIGNMENT = 8;
 
 export const NULL = 0;
\ No newline at end of file
@@ -1,14 +1,35 @@
 import {FRAME_PTR_ADDR, PTR_SIZE, STACK_PTR_ADDR} from "./memory_constants.mjs";
 
+// if the module keeps the frame ptr and stack ptr in wasm globals, these are the
+// exported globals. Otherwise null, and the pointers are stored in memory
+let stack_ptr_globals = null;
+
+// call once the module is instantiated, with its exports
+export function init_stack_ptr_globals(exports) {
+  if (exports.frame_ptr instanceof WebAssembly.Global && exports.stack_ptr instanceof WebAssembly.Global) {
+    stack_ptr_globals = {frame_ptr: exports.frame_ptr, stack_ptr: exports.stack_ptr};
+  }
+}
+
 export function read_frame_ptr(memory) {
+  if (stack_ptr_globals !== null) {
+    return stack_ptr_globals.frame_ptr.value;
+  }
   return read_ptr(FRAME_PTR_ADDR, memory);
 }
 
 export function read_stack_ptr(memory) {
+  if (stack_ptr_globals !== null) {
+    return stack_ptr_globals.stack_ptr.value;
+  }
   return read_ptr(STACK_PTR_ADDR, memory);
 }
 
 export function store_stack_ptr(stack_ptr, memory) {
+  if (stack_ptr_globals !== null) {
+    stack_ptr_globals.stack_ptr.value = stack_ptr;
+    return;
+  }
   store_ptr(STACK_PTR_ADDR, stack_ptr, memory);
 }
 
@@ -44,33 +65,3 @@ export function store_int(addr, byte_size, value, memory) {
         memory[addr + i] = Number((value >> BigInt(8 * i)) & 0xffn);
     }
 }
-
-export function read_double(addr, memory) {
-    const buffer = new ArrayBuffer(8);
-    const bytes = new Uint8Array(buffer);
-    for (let i = 0; i < 8; i++) {
-        const byte = memory[addr + i];
-        bytes[i] = byte;
-    }
-    // interpret the bytes as a double
-    const floatArray = new Float64Array(buffer);
-    const value = floatArray[0];
-    return value;
-}
-
-export function read_string(addr, memory) {
-    // read a null-terminated string starting at addr from memory
-    const next_char = () => {
-        const byte = memory[addr];
-        addr++;
-        return String.fromCharCode(byte);
-    }
-
-    let str = "";
-  let c = next_char();
-  while (c !== "\0") {
-    str += c;
-    c = next_char();
-  }
-  return str;
-}
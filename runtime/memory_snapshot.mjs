@@ -0,0 +1,49 @@
+// A snapshot of an instance's memory and mutable globals, taken after it's instantiated, so
+// the data segments are already in memory, but before main() runs. Restoring it puts the
+// instance back how it started, so main() can run again without instantiating the module
+// again.
+
+// the mutable globals are the exported ones, such as the frame ptr, stack ptr and top of the
+// heap. Setting a constant global throws, which is how they're told apart
+const find_mutable_globals = (exports) => {
+    const globals = [];
+    for (const value of Object.values(exports)) {
+        if (!(value instanceof WebAssembly.Global)) {
+            continue;
+        }
+        try {
+            value.value = value.value;
+        } catch (err) {
+            if (err instanceof TypeError) {
+                continue;
+            }
+            throw err;
+        }
+        globals.push({global: value, value: value.value});
+    }
+    return globals;
+};
+
+export const take_snapshot = (wasm_memory, exports) => {
+    const memory = new Uint8Array(wasm_memory.buffer);
+    // memory starts zeroed, so only the bytes up to the last non-zero one need copying back
+    let end = memory.length;
+    while (end > 0 && memory[end - 1] === 0) {
+        end--;
+    }
+    return {
+        bytes: memory.slice(0, end),
+        globals: find_mutable_globals(exports),
+    };
+};
+
+// memory can't shrink, so if the last run grew it, everything after the snapshot's bytes is
+// zeroed, like freshly grown memory
+export const restore_snapshot = (snapshot, wasm_memory) => {
+    const memory = new Uint8Array(wasm_memory.buffer);
+    memory.set(snapshot.bytes);
+    memory.fill(0, snapshot.bytes.length);
+    for (const {global, value} of snapshot.globals) {
+        global.value = value;
+    }
+};
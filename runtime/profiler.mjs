@@ -1,5 +1,6 @@
-import {read_stack_ptr} from "./memory_operations.mjs";
-import {appendFileSync} from "fs";
+import {PTR_SIZE} from "./memory_constants.mjs";
+import {appendFileSync, writeFileSync} from "fs";
+import {performance} from "perf_hooks";
 import {basename, dirname, join} from "path";
 import {fileURLToPath} from "url";
 
@@ -18,17 +19,174 @@ export function init_stack_ptr_log_file(source_filepath) {
     return join(get_log_dir_path(), log_name);
 }
 
-export function log_stack_ptr(wasm_memory, log_file_path) {
+// the module writes each new stack ptr value to a buffer in its memory, and calls this when
+// the buffer is full. get_exports is called then, because the imports have to be created
+// before the module is instantiated
+export function flush_stack_ptr_log(wasm_memory, log_file_path, get_exports) {
     return () => {
-        const memory = new Uint8Array(wasm_memory.buffer);
-        const stack_ptr = read_stack_ptr(memory);
+        write_stack_ptr_log(wasm_memory, log_file_path, get_exports());
+    }
+}
+
+// append the samples in the buffer to the log file. Call this when the program exits, to
+// write out the samples since the buffer was last full
+export function write_stack_ptr_log(wasm_memory, log_file_path, exports) {
+    // the buffer is only there if the module was compiled with stack ptr logging
+    if (!(exports.stack_ptr_log_start instanceof WebAssembly.Global)) {
+        return;
+    }
+    const start = exports.stack_ptr_log_start.value;
+    const end = exports.stack_ptr_log_next.value;
+    if (end <= start) {
+        return;
+    }
+    const memory = new DataView(wasm_memory.buffer);
+    const lines = [];
+    for (let addr = start; addr < end; addr += PTR_SIZE) {
+        lines.push(memory.getUint32(addr, true));
+    }
+
+    try {
+        appendFileSync(log_file_path, lines.join("\n") + "\n");
+    } catch (err) {
+        console.log(`Error logging stack pointer: ${err}`);
+    }
+}
+
+// the caller and callee of each call counter, from the module's custom section, or null if
+// the module wasn't compiled with call profiling
+export function read_call_edges(wasm_module) {
+    const sections = WebAssembly.Module.customSections(wasm_module, "call_profile");
+    if (sections.length === 0) {
+        return null;
+    }
+    return new TextDecoder().decode(sections[0])
+        .split("\n")
+        .filter(line => line.length > 0)
+        .map(line => {
+            const [caller, callee] = line.split(" ");
+            return {caller: caller, callee: callee};
+        });
+}
+
+// the module calls enter just before each call, with the call edge in a global, and exit
+// just after it returns. Time is only added to a function when its outermost active call
+// returns, so recursive calls aren't counted twice
+export function init_call_timing(call_edges, get_exports) {
+    const inclusive_ms = new Map();
+    const active_calls = new Map();
+    const call_stack = [];
+    return {
+        inclusive_ms: inclusive_ms,
+        call_profile_enter: () => {
+            const callee = call_edges[get_exports().call_profile_edge.value].callee;
+            call_stack.push({callee: callee, start: performance.now()});
+            active_calls.set(callee, (active_calls.get(callee) ?? 0) + 1);
+        },
+        call_profile_exit: () => {
+            const {callee, start} = call_stack.pop();
+            const active = active_calls.get(callee) - 1;
+            active_calls.set(callee, active);
+            if (active === 0) {
+                inclusive_ms.set(callee, (inclusive_ms.get(callee) ?? 0) + performance.now() - start);
+            }
+        },
+    };
+}
+
+export function init_call_profile_file(source_filepath) {
+    const log_name = `${basename(source_filepath)}.${Date.now()}.callprof`;
+    return join(get_log_dir_path(), log_name);
+}
+
+// write a flat profile of the calls to each function, and the call graph
+export function write_call_profile(wasm_memory, log_file_path, call_edges, exports, inclusive_ms) {
+    if (call_edges === null) {
+        return;
+    }
+    const memory = new DataView(wasm_memory.buffer);
+    const counts_start = exports.call_profile_counts.value;
+    const edge_counts = call_edges.map((edge, i) => ({
+        ...edge,
+        count: memory.getBigUint64(counts_start + i * 8, true),
+    }));
 
-        const data = `${stack_ptr}\n`;
+    const fun_calls = new Map();
+    for (const {callee, count} of edge_counts) {
+        fun_calls.set(callee, (fun_calls.get(callee) ?? 0n) + count);
+    }
+    const flat_profile = [...fun_calls.entries()]
+        .filter(([, calls]) => calls > 0n)
+        .sort(([, a], [, b]) => (a < b) - (a > b));
 
-        try {
-            appendFileSync(log_file_path, data);
-        } catch (err) {
-            console.log(`Error logging stack pointer: ${err}`);
+    const lines = ["flat profile:", "calls\tinclusive ms\tfunction"];
+    for (const [fun, calls] of flat_profile) {
+        const ms = inclusive_ms === null ? "-" : (inclusive_ms.get(fun) ?? 0).toFixed(3);
+        lines.push(`${calls}\t${ms}\t${fun}`);
+    }
+    lines.push("", "call graph:");
+    for (const {caller, callee, count} of edge_counts) {
+        if (count > 0n) {
+            lines.push(`${caller} -> ${callee}: ${count}`);
         }
     }
+
+    try {
+        writeFileSync(log_file_path, lines.join("\n") + "\n");
+    } catch (err) {
+        console.log(`Error writing call profile: ${err}`);
+    }
+}
+
+// the name and number of block counters of each function, from the module's custom section,
+// or null if the module wasn't compiled with block counting
+export function read_block_functions(wasm_module) {
+    const sections = WebAssembly.Module.customSections(wasm_module, "block_profile");
+    if (sections.length === 0) {
+        return null;
+    }
+    return new TextDecoder().decode(sections[0])
+        .split("\n")
+        .filter(line => line.length > 0)
+        .map(line => {
+            const [name, label_count] = line.split(" ");
+            return {name: name, label_count: parseInt(label_count, 10)};
+        });
+}
+
+export function init_profile_data_file(source_filepath) {
+    const log_name = `${basename(source_filepath)}.${Date.now()}.profdata`;
+    return join(get_log_dir_path(), log_name);
+}
+
+// write the call and block counts in the format that the compiler's --pgo option reads
+export function write_profile_data(wasm_memory, log_file_path, call_edges, block_functions, exports) {
+    if (call_edges === null && block_functions === null) {
+        return;
+    }
+    const memory = new DataView(wasm_memory.buffer);
+    const lines = ["# profile data for --pgo"];
+
+    if (call_edges !== null) {
+        const counts_start = exports.call_profile_counts.value;
+        call_edges.forEach(({caller, callee}, i) => {
+            lines.push(`call ${caller} ${callee} ${memory.getBigUint64(counts_start + i * 8, true)}`);
+        });
+    }
+    if (block_functions !== null) {
+        let addr = exports.block_profile_counts.value;
+        for (const {name, label_count} of block_functions) {
+            const counts = [];
+            for (let i = 0; i < label_count; i++, addr += 8) {
+                counts.push(memory.getBigUint64(addr, true));
+            }
+            lines.push(`blocks ${name} ${counts.join(" ")}`);
+        }
+    }
+
+    try {
+        writeFileSync(log_file_path, lines.join("\n") + "\n");
+    } catch (err) {
+        console.log(`Error writing profile data: ${err}`);
+    }
 }
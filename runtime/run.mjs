@@ -1,56 +1,270 @@
 #!/usr/bin/env node
 //
-// usage: run.mjs <wasm_filename> [args...]
+// usage: run.mjs [--iterations <n>] [--timing <json_filename>] [--args-file <filename>]
+//               [--workers <n>] <wasm_filename> [args...]
 //
-import {readFileSync} from "fs";
-import {printf} from "./stdlib/stdio.mjs";
-import {put_args_into_memory} from "./init_memory.mjs";
-import {strtol, strtoul} from "./stdlib/stdlib.mjs";
-import {strlen, strstr} from "./stdlib/string.mjs";
-import {init_stack_ptr_log_file, log_stack_ptr} from "./profiler.mjs";
-
-
-const run = async (filename, args) => {
-    const buffer = readFileSync(filename);
+// --iterations runs main() n times, each in a fresh instance of the module
+// --timing writes how long each run of main() took, and how much of that was spent in the
+//          JS imports, to a JSON file
+// --args-file runs main() once for each line of the file, with the line's space-separated
+//             args instead of the command line's. The module is only compiled once, so
+//             this avoids paying for compilation on every run
+// --workers runs the runs across n worker threads instead. Each worker instantiates the
+//           module once, and resets its memory and globals from a snapshot between runs,
+//           so this avoids paying for instantiation too. The output of each run is still
+//           written out in order. It can't be used with profiled modules
+//
+// The wasm filename can be - to read the module from stdin, in which case it's compiled
+// while it's being read.
+//
+import {readFileSync, writeFileSync} from "fs";
+import {performance} from "perf_hooks";
+import {Readable} from "stream";
+import {Worker} from "worker_threads";
+import {flush_stdout, printf} from "./stdlib/stdio.mjs";
+import {have_threads_failed, init_thread_state, thread_imports} from "./stdlib/threads.mjs";
+import {put_args_into_memory, read_memory_limits} from "./init_memory.mjs";
+import {
+    flush_stack_ptr_log,
+    init_call_profile_file,
+    init_call_timing,
+    init_profile_data_file,
+    init_stack_ptr_log_file,
+    read_block_functions,
+    read_call_edges,
+    write_call_profile,
+    write_profile_data,
+    write_stack_ptr_log
+} from "./profiler.mjs";
+import {init_stack_ptr_globals} from "./memory_operations.mjs";
+import {time_imports} from "./import_timing.mjs";
 
-    const stack_ptr_log_path = init_stack_ptr_log_file(filename);
 
-    let memory = new WebAssembly.Memory({initial: 1});
+const run_once = (wasm_module, memory_limits, log_paths, profiled_code, args, import_timing) => {
+    const {call_edges, block_functions} = profiled_code;
+    let memory = new WebAssembly.Memory(memory_limits);
+    let instance = null;
+    const call_timing = init_call_timing(call_edges, () => instance.exports);
+    const thread_state = init_thread_state(wasm_module);
 
     // functions that will be passed in to wasm
+    let stdlib = {
+        printf: printf(memory),
+        flush_stack_ptr_log: flush_stack_ptr_log(memory, log_paths.stack_ptr_log, () => instance.exports),
+        ...thread_imports(wasm_module, memory, thread_state),
+    };
+    if (import_timing !== null) {
+        stdlib = time_imports(stdlib, import_timing);
+    }
+    // the call profiler's imports aren't timed, they're only there when profiling anyway
+    stdlib.call_profile_enter = call_timing.call_profile_enter;
+    stdlib.call_profile_exit = call_timing.call_profile_exit;
     const imports = {
         runtime: {
             memory: memory,
         },
-        stdlib: {
-            printf: printf(memory),
-            strtol: strtol(memory),
-            strtoul: strtoul(memory),
-            strlen: strlen(memory),
-            strstr: strstr(memory),
-            log_stack_ptr: log_stack_ptr(memory, stack_ptr_log_path)
-        },
+        stdlib: stdlib,
     };
 
-    const module = await WebAssembly.instantiate(buffer, imports);
+    instance = new WebAssembly.Instance(wasm_module, imports);
 
     // get exports from module
-    const main = module.instance.exports.main;
+    const main = instance.exports.main;
+
+    // read the frame ptr and stack ptr from exported globals, if the module uses them
+    init_stack_ptr_globals(instance.exports);
 
     // put the arguments into wasm memory
     const {argc, argv} = put_args_into_memory(args, memory);
 
-    // run the program
-    const exit_code = main(argc, argv);
+    // run the program, and write out whatever it printed that's still buffered, even if it
+    // traps. Writing the buffer out counts as time spent in the imports
+    const start = performance.now();
+    let exit_code;
+    try {
+        exit_code = main(argc, argv);
+    } finally {
+        const flush_start = performance.now();
+        flush_stdout();
+        if (import_timing !== null) {
+            import_timing.ms += performance.now() - flush_start;
+        }
+    }
+    const main_ms = performance.now() - start;
+    // a thread that trapped fails the run, like main() trapping does
+    if (exit_code === 0 && have_threads_failed(thread_state)) {
+        exit_code = 1;
+    }
+
+    // write out the stack ptr samples since the log buffer was last full
+    write_stack_ptr_log(memory, log_paths.stack_ptr_log, instance.exports);
+    // the times are only there if the module called the timing imports
+    const inclusive_ms = call_timing.inclusive_ms.size > 0 ? call_timing.inclusive_ms : null;
+    write_call_profile(memory, log_paths.call_profile, call_edges, instance.exports, inclusive_ms);
+    write_profile_data(memory, log_paths.profile_data, call_edges, block_functions, instance.exports);
+    return {exit_code: exit_code, main_ms: main_ms};
+};
+
+// compile the module from the file, or from stdin as it's streamed in
+const compile_module = (filename) => {
+    if (filename === "-") {
+        const response = new Response(Readable.toWeb(process.stdin), {
+            headers: {"content-type": "application/wasm"},
+        });
+        return WebAssembly.compileStreaming(response);
+    }
+    return WebAssembly.compile(readFileSync(filename));
+};
+
+// run each job's args in a pool of workers, writing out the output of each run in the order
+// of the jobs as soon as it and the runs before it have finished. Resolves to the results
+// in the same order
+const run_in_workers = (wasm_module, memory_limits, jobs, worker_count, record_timing) =>
+    new Promise((resolve, reject) => {
+        const results = new Array(jobs.length);
+        let next_job_i = 0;
+        let next_output_i = 0;
+        if (jobs.length === 0) {
+            resolve(results);
+            return;
+        }
+
+        const start_next_job = (worker) => {
+            if (next_job_i < jobs.length) {
+                worker.postMessage({run_i: next_job_i, args: jobs[next_job_i]});
+                next_job_i++;
+            } else {
+                worker.terminate();
+            }
+        };
+        const worker_data = {wasm_module: wasm_module, memory_limits: memory_limits, record_timing: record_timing};
+        for (let i = 0; i < Math.min(worker_count, jobs.length); i++) {
+            const worker = new Worker(new URL("./worker.mjs", import.meta.url), {workerData: worker_data});
+            worker.on("message", (result) => {
+                results[result.run_i] = result;
+                while (next_output_i < jobs.length && results[next_output_i] !== undefined) {
+                    const {output, error} = results[next_output_i];
+                    process.stdout.write(output);
+                    if (error !== null) {
+                        process.stderr.write(`${error}\n`);
+                    }
+                    next_output_i++;
+                }
+                if (next_output_i === jobs.length) {
+                    resolve(results);
+                }
+                start_next_job(worker);
+            });
+            worker.on("error", reject);
+            start_next_job(worker);
+        }
+    });
+
+// the profilers write their logs from the instance after each run, which the workers don't do
+const is_profiled = (wasm_module, profiled_code) =>
+    profiled_code.call_edges !== null
+    || profiled_code.block_functions !== null
+    || WebAssembly.Module.exports(wasm_module).some(({name}) => name === "stack_ptr_log_start");
+
+const run = async (filename, arg_lists, iterations, timing_filename, worker_count) => {
+    const log_paths = {
+        stack_ptr_log: init_stack_ptr_log_file(filename),
+        call_profile: init_call_profile_file(filename),
+        profile_data: init_profile_data_file(filename),
+    };
+
+    const compile_start = performance.now();
+    const wasm_module = await compile_module(filename);
+    const compile_ms = performance.now() - compile_start;
+    const memory_limits = read_memory_limits(wasm_module);
+    const profiled_code = {
+        call_edges: read_call_edges(wasm_module),
+        block_functions: read_block_functions(wasm_module),
+    };
+
+    // the exit code is the first failing run's, or 0 if they all succeed
+    const runs = [];
+    let exit_code = 0;
+    if (worker_count !== null) {
+        if (is_profiled(wasm_module, profiled_code)) {
+            console.log("--workers can't run profiled modules");
+            return 1;
+        }
+        const jobs = arg_lists.flatMap((args) => Array(iterations).fill(args));
+        const results = await run_in_workers(
+            wasm_module, memory_limits, jobs, worker_count, timing_filename !== null);
+        for (const result of results) {
+            if (exit_code === 0) {
+                exit_code = result.exit_code;
+            }
+            runs.push({
+                main_ms: result.main_ms,
+                import_ms: result.import_ms,
+                module_ms: result.main_ms - result.import_ms,
+                import_calls: result.import_calls,
+            });
+        }
+    } else {
+        for (const args of arg_lists) {
+            for (let i = 0; i < iterations; i++) {
+                const import_timing = timing_filename === null ? null : {ms: 0, calls: 0};
+                const result = run_once(
+                    wasm_module, memory_limits, log_paths, profiled_code, args, import_timing);
+                if (exit_code === 0) {
+                    exit_code = result.exit_code;
+                }
+                const main_ms = result.main_ms;
+                if (import_timing !== null) {
+                    runs.push({
+                        main_ms: main_ms,
+                        import_ms: import_timing.ms,
+                        module_ms: main_ms - import_timing.ms,
+                        import_calls: import_timing.calls,
+                    });
+                }
+            }
+        }
+    }
+
+    if (timing_filename !== null) {
+        writeFileSync(timing_filename, JSON.stringify({compile_ms: compile_ms, runs: runs}));
+    }
     return exit_code;
 };
 
 // parse node cli arguments
-const args = process.argv.slice(2); // first 2 args: ['node', '<filename>']
+let args = process.argv.slice(2); // first 2 args: ['node', '<filename>']
+let iterations = 1;
+let timing_filename = null;
+let args_filename = null;
+let worker_count = null;
+while (args.length > 0 && args[0].startsWith("--")) {
+    const option = args.shift();
+    if (option === "--iterations") {
+        iterations = parseInt(args.shift(), 10);
+    } else if (option === "--timing") {
+        timing_filename = args.shift();
+    } else if (option === "--args-file") {
+        args_filename = args.shift();
+    } else if (option === "--workers") {
+        worker_count = parseInt(args.shift(), 10);
+    } else {
+        console.log(`Unknown option ${option}`);
+        process.exit(1);
+    }
+}
 if (args.length < 1) {
     console.log("Please specify file to run");
 } else {
     const filename = args[0];
-    const exit_code = await run(filename, args);
+    // the program's args start with the wasm filename, like argv[0]
+    let arg_lists = [args];
+    if (args_filename !== null) {
+        arg_lists = readFileSync(args_filename, "utf8")
+            .split("\n")
+            .filter((line) => line.trim() !== "")
+            .map((line) => [filename, ...line.trim().split(/\s+/)]);
+    }
+    const exit_code = await run(filename, arg_lists, iterations, timing_filename, worker_count);
     process.exit(exit_code);
 }
@@ -6,121 +6,138 @@ import {
     I8_SIZE,
     PTR_SIZE,
 } from "../memory_constants.mjs";
-import {
-    read_frame_ptr,
-    read_ptr,
-    read_int,
-    store_int,
-    read_string,
-    read_double,
-} from "../memory_operations.mjs";
-import {signed_to_unsigned_i16, signed_to_unsigned_i32, signed_to_unsigned_i64} from "../number_operations.mjs";
+import {read_frame_ptr} from "../memory_operations.mjs";
+
+// stdout is buffered, and written out when the buffer is full, when the program exits, and
+// after each newline if stdout is a terminal, like C's stdout
+const STDOUT_BUFFER_SIZE = 65536;
+const NEWLINE = 0x0a;
+const stdout_buffer = new Uint8Array(STDOUT_BUFFER_SIZE);
+let stdout_buffer_len = 0;
+const line_buffered = process.stdout.isTTY === true;
+// where the buffer is written out to, which a worker replaces to collect each run's output
+let write_stdout = (bytes) => process.stdout.write(bytes);
+
+export function set_stdout_writer(writer) {
+    write_stdout = writer;
+}
+
+// write out everything in the stdout buffer
+export function flush_stdout() {
+    if (stdout_buffer_len > 0) {
+        // copy the bytes, because the buffer is reused before the write might finish
+        write_stdout(stdout_buffer.slice(0, stdout_buffer_len));
+        stdout_buffer_len = 0;
+    }
+}
 
-// print a null-terminated string from memory to console
+function write_byte(byte) {
+    if (stdout_buffer_len === STDOUT_BUFFER_SIZE) {
+        flush_stdout();
+    }
+    stdout_buffer[stdout_buffer_len++] = byte;
+}
+
+// numbers and error messages are ASCII, so each char is a byte
+function write_ascii(str) {
+    for (let i = 0; i < str.length; i++) {
+        write_byte(str.charCodeAt(i));
+    }
+}
+
+// print a null-terminated string from memory to stdout
 // int printf(const char *format, ...);
 export function printf(wasm_memory) {
     return () => {
+        // the memory can grow between calls, which replaces its buffer
         const memory = new Uint8Array(wasm_memory.buffer);
+        const view = new DataView(wasm_memory.buffer);
         // load param: addr of format str
         const fp = read_frame_ptr(memory);
-        let format_str_ptr = read_ptr(fp + PTR_SIZE + I32_SIZE, memory);
+        let format_str_ptr = view.getUint32(fp + PTR_SIZE + I32_SIZE, true);
         let vararg_ptr = fp + PTR_SIZE + I32_SIZE + PTR_SIZE;
 
-        const next_char = () => {
-            const byte = memory[format_str_ptr];
-            format_str_ptr++;
-            return String.fromCharCode(byte);
-        };
-
-        const next_vararg_int = (byte_size) => {
-            const value = read_int(vararg_ptr, byte_size, memory);
-            vararg_ptr += byte_size;
-            return value;
-        };
+        const write_number = (value) => write_ascii(`${value}`);
+        const invalid_specifier = () => write_ascii("Error: invalid format specifier to printf\n");
 
-        const next_vararg_double = () => {
-            const value = read_double(vararg_ptr, memory);
-            vararg_ptr += F64_SIZE;
-            return value;
-        }
-
-        const next_vararg_ptr = () => {
-            return next_vararg_int(PTR_SIZE);
-        }
-
-        let str = "";
-        let c = next_char();
-        while (c !== "\0") {
+        let c = memory[format_str_ptr++];
+        while (c !== 0) {
             // handle format args
-            if (c === "%") {
-                c = next_char();
-                if (c !== "%") {
-                    // read next vararg
-                    let value;
-                    switch (c) {
+            if (c === 0x25 /* % */) {
+                c = memory[format_str_ptr++];
+                if (c !== 0x25 /* % */) {
+                    switch (String.fromCharCode(c)) {
                         case "i":
                         case "d":
                             // int
-                            value = next_vararg_int(I32_SIZE);
+                            write_number(view.getInt32(vararg_ptr, true));
+                            vararg_ptr += I32_SIZE;
                             break;
                         case "u":
                             // unsigned int
-                            value = next_vararg_int(I32_SIZE);
-                            value = signed_to_unsigned_i32(value);
+                            write_number(view.getUint32(vararg_ptr, true));
+                            vararg_ptr += I32_SIZE;
                             break;
                         case "h":
                             // short
-                            c = next_char();
-                            if (c != "i" && c != "d" && c != "u") {
-                                console.log("Error: invalid format specifier to printf");
-                            }
-                            value = next_vararg_int(I16_SIZE);
-                            if (c === "u") {
-                                value = signed_to_unsigned_i16(value);
+                            c = memory[format_str_ptr++];
+                            if (c === 0x75 /* u */) {
+                                write_number(view.getUint16(vararg_ptr, true));
+                            } else {
+                                if (c !== 0x69 /* i */ && c !== 0x64 /* d */) {
+                                    invalid_specifier();
+                                }
+                                write_number(view.getInt16(vararg_ptr, true));
                             }
+                            vararg_ptr += I16_SIZE;
                             break;
                         case "l":
                             // long
-                            c = next_char();
-                            if (c != "i" && c != "d" && c != "u") {
-                                console.log("Error: invalid format specifier to printf");
-                            }
-                            value = next_vararg_int(I64_SIZE);
-                            if (c === "u") {
-                                value = signed_to_unsigned_i64(value);
+                            c = memory[format_str_ptr++];
+                            if (c === 0x75 /* u */) {
+                                write_number(view.getBigUint64(vararg_ptr, true));
+                            } else {
+                                if (c !== 0x69 /* i */ && c !== 0x64 /* d */) {
+                                    invalid_specifier();
+                                }
+                                write_number(view.getBigInt64(vararg_ptr, true));
                             }
+                            vararg_ptr += I64_SIZE;
                             break;
                         case "f":
                             // double
-                            value = next_vararg_double();
+                            write_number(view.getFloat64(vararg_ptr, true));
+                            vararg_ptr += F64_SIZE;
                             break;
                         case "c":
                             // char
-                            value = next_vararg_int(I8_SIZE);
-                            value = String.fromCharCode(value);
+                            write_byte(memory[vararg_ptr]);
+                            vararg_ptr += I8_SIZE;
                             break;
                         case "s":
-                            // string
-                            const str_ptr = next_vararg_ptr();
-                            value = read_string(str_ptr, memory);
+                            // string, copied straight from memory
+                            let str_ptr = view.getUint32(vararg_ptr, true);
+                            vararg_ptr += PTR_SIZE;
+                            while (memory[str_ptr] !== 0) {
+                                write_byte(memory[str_ptr++]);
+                            }
                             break;
                         default:
-                            console.log("Error: invalid format specifier to printf");
+                            invalid_specifier();
                             break;
                     }
-
-                    str += `${value}`;
-                    c = next_char();
+                    c = memory[format_str_ptr++];
                     continue;
                 }
             }
-            str += c;
-            c = next_char();
+            write_byte(c);
+            if (c === NEWLINE && line_buffered) {
+                flush_stdout();
+            }
+            c = memory[format_str_ptr++];
         }
 
-        process.stdout.write(str); // only works in node.js, use console.log otherwise, but that prints newline
-
         // write return value
-        store_int(fp + PTR_SIZE, I32_SIZE, 0n, memory);
+        view.setInt32(fp + PTR_SIZE, 0, true);
     };
 }
@@ -0,0 +1,120 @@
+import {Worker} from "worker_threads";
+import {I32_SIZE, PTR_SIZE} from "../memory_constants.mjs";
+import {read_frame_ptr} from "../memory_operations.mjs";
+
+// The threads of a module compiled with --threads. Each thread is a worker running
+// thread_main(arg) in its own instance of the module, which shares the memory, on one of
+// the stacks that the compiler laid out for the threads.
+//
+// The threads' state is in a shared array of i32s, which every thread's imports use:
+//
+// ------------------------------------------------------------------------------
+// | failed | stack 0 state | stack 0 result | ... | stack n state | stack n result |
+// ------------------------------------------------------------------------------
+//
+// failed is set if any thread traps. Each stack is free, or used by a running thread, or by
+// a finished thread whose result is waiting to be joined.
+const FAILED_INDEX = 0;
+const SLOT_SIZE = 2;
+const SLOT_FREE = 0;
+const SLOT_RUNNING = 1;
+const SLOT_FINISHED = 2;
+
+// where the threads' stacks are, from the module's custom section, or null if the module
+// wasn't compiled with --threads
+export const read_thread_stacks = (wasm_module) => {
+    const sections = WebAssembly.Module.customSections(wasm_module, "threads");
+    if (sections.length === 0) {
+        return null;
+    }
+    const [start, size, count] = new TextDecoder().decode(sections[0])
+        .split(" ")
+        .map(n => parseInt(n, 10));
+    return {start: start, size: size, count: count};
+};
+
+// the state of the threads for one run of the program, or null if it can't have threads
+export const init_thread_state = (wasm_module) => {
+    const stacks = read_thread_stacks(wasm_module);
+    if (stacks === null) {
+        return null;
+    }
+    const slots = new Int32Array(new SharedArrayBuffer((1 + stacks.count * SLOT_SIZE) * I32_SIZE));
+    return {stacks: stacks, slots: slots};
+};
+
+export const have_threads_failed = (thread_state) =>
+    thread_state !== null && Atomics.load(thread_state.slots, FAILED_INDEX) !== 0;
+
+const get_slot_index = (thread) => 1 + thread * SLOT_SIZE;
+
+// called in a thread's worker once thread_main() has returned, or trapped
+export const finish_thread = (thread_state, thread, result, failed) => {
+    const slots = thread_state.slots;
+    const slot_index = get_slot_index(thread);
+    if (failed) {
+        Atomics.store(slots, FAILED_INDEX, 1);
+    }
+    Atomics.store(slots, slot_index + 1, result);
+    Atomics.store(slots, slot_index, SLOT_FINISHED);
+    Atomics.notify(slots, slot_index);
+};
+
+// the imports for starting threads and waiting for them, in the main thread or any other
+export const thread_imports = (wasm_module, wasm_memory, thread_state) => ({
+    // int thread_create(void *arg)
+    //
+    // Returns the new thread's id, or -1 if all the stacks are in use. A thread's worker is
+    // stopped when the thread that created it finishes, so it has to be joined by then.
+    thread_create: () => {
+        const view = new DataView(wasm_memory.buffer);
+        const fp = read_frame_ptr(new Uint8Array(wasm_memory.buffer));
+        const arg = view.getUint32(fp + PTR_SIZE + I32_SIZE, true);
+
+        let thread = -1;
+        const stack_count = thread_state === null ? 0 : thread_state.stacks.count;
+        for (let i = 0; i < stack_count; i++) {
+            const slot_index = get_slot_index(i);
+            if (Atomics.compareExchange(thread_state.slots, slot_index, SLOT_FREE, SLOT_RUNNING) === SLOT_FREE) {
+                thread = i;
+                break;
+            }
+        }
+        if (thread !== -1) {
+            new Worker(new URL("../thread_worker.mjs", import.meta.url), {
+                workerData: {
+                    wasm_module: wasm_module,
+                    memory: wasm_memory,
+                    thread_state: thread_state,
+                    thread: thread,
+                    arg: arg,
+                },
+            });
+        }
+        view.setInt32(fp + PTR_SIZE, thread, true);
+    },
+
+    // void *thread_join(int thread)
+    //
+    // Waits for the thread to finish, frees its stack, and returns what thread_main()
+    // returned, or NULL if it isn't a running or finished thread
+    thread_join: () => {
+        const view = new DataView(wasm_memory.buffer);
+        const fp = read_frame_ptr(new Uint8Array(wasm_memory.buffer));
+        const thread = view.getInt32(fp + PTR_SIZE + PTR_SIZE, true);
+
+        let result = 0;
+        if (thread_state !== null && thread >= 0 && thread < thread_state.stacks.count) {
+            const slots = thread_state.slots;
+            const slot_index = get_slot_index(thread);
+            while (Atomics.load(slots, slot_index) === SLOT_RUNNING) {
+                Atomics.wait(slots, slot_index, SLOT_RUNNING);
+            }
+            if (Atomics.load(slots, slot_index) === SLOT_FINISHED) {
+                result = Atomics.load(slots, slot_index + 1);
+                Atomics.store(slots, slot_index, SLOT_FREE);
+            }
+        }
+        view.setUint32(fp + PTR_SIZE, result, true);
+    },
+});
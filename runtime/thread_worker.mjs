@@ -0,0 +1,39 @@
+// A worker thread for a module compiled with --threads, which runs thread_main(arg) on one
+// of the threads' stacks, in its own instance of the module sharing the memory. It's started
+// by the thread_create import, with workerData {wasm_module, memory, thread_state, thread, arg}.
+//
+import {workerData} from "worker_threads";
+import {writeSync} from "fs";
+import {flush_stdout, printf, set_stdout_writer} from "./stdlib/stdio.mjs";
+import {finish_thread, thread_imports} from "./stdlib/threads.mjs";
+import {init_stack_ptr_globals} from "./memory_operations.mjs";
+
+const {wasm_module, memory, thread_state, thread, arg} = workerData;
+
+// the main thread can be blocked waiting to join this one, so it can't pass on the output
+set_stdout_writer((bytes) => writeSync(1, bytes));
+
+const stdlib = {
+    printf: printf(memory),
+    ...thread_imports(wasm_module, memory, thread_state),
+};
+const instance = new WebAssembly.Instance(wasm_module, {runtime: {memory: memory}, stdlib: stdlib});
+init_stack_ptr_globals(instance.exports);
+
+// the thread's stack is the only one it can use
+const stack_start = thread_state.stacks.start + thread * thread_state.stacks.size;
+instance.exports.frame_ptr.value = stack_start;
+instance.exports.stack_ptr.value = stack_start;
+instance.exports.stack_limit.value = stack_start + thread_state.stacks.size;
+
+let result = 0;
+let failed = false;
+try {
+    result = instance.exports.thread_main(arg);
+} catch (err) {
+    failed = true;
+    writeSync(2, `${err.stack ?? err}\n`);
+} finally {
+    flush_stdout();
+    finish_thread(thread_state, thread, result, failed);
+}
@@ -0,0 +1,75 @@
+// A worker thread for run.mjs's --workers option. It instantiates the module once, and runs
+// main() for each set of args it's sent, restoring the memory and globals from a snapshot
+// between runs instead of instantiating the module again.
+//
+// workerData is {wasm_module, memory_limits, record_timing}. Each message is {run_i, args},
+// and the reply is {run_i, output, error, exit_code, main_ms, import_ms, import_calls}, where
+// output is everything the run wrote to stdout and error is the trap message, or null.
+//
+import {parentPort, workerData} from "worker_threads";
+import {performance} from "perf_hooks";
+import {flush_stdout, printf, set_stdout_writer} from "./stdlib/stdio.mjs";
+import {have_threads_failed, init_thread_state, thread_imports} from "./stdlib/threads.mjs";
+import {put_args_into_memory} from "./init_memory.mjs";
+import {init_stack_ptr_globals} from "./memory_operations.mjs";
+import {time_imports} from "./import_timing.mjs";
+import {restore_snapshot, take_snapshot} from "./memory_snapshot.mjs";
+
+const {wasm_module, memory_limits, record_timing} = workerData;
+
+let output = [];
+set_stdout_writer((bytes) => output.push(bytes));
+
+const memory = new WebAssembly.Memory(memory_limits);
+const import_timing = {ms: 0, calls: 0};
+// every thread is joined by the end of a run, so the threads' state carries over to the next
+const thread_state = init_thread_state(wasm_module);
+let stdlib = {printf: printf(memory), ...thread_imports(wasm_module, memory, thread_state)};
+if (record_timing) {
+    stdlib = time_imports(stdlib, import_timing);
+}
+const instance = new WebAssembly.Instance(wasm_module, {runtime: {memory: memory}, stdlib: stdlib});
+const main = instance.exports.main;
+init_stack_ptr_globals(instance.exports);
+const snapshot = take_snapshot(memory, instance.exports);
+let is_first_run = true;
+
+parentPort.on("message", ({run_i, args}) => {
+    if (!is_first_run) {
+        restore_snapshot(snapshot, memory);
+    }
+    is_first_run = false;
+    import_timing.ms = 0;
+    import_timing.calls = 0;
+
+    const {argc, argv} = put_args_into_memory(args, memory);
+
+    // a trap fails the run, like an uncaught exception does when running it in the main thread
+    const start = performance.now();
+    let exit_code = 1;
+    let error = null;
+    try {
+        exit_code = main(argc, argv);
+    } catch (err) {
+        error = `${err}`;
+    } finally {
+        const flush_start = performance.now();
+        flush_stdout();
+        import_timing.ms += performance.now() - flush_start;
+    }
+    const main_ms = performance.now() - start;
+    if (exit_code === 0 && have_threads_failed(thread_state)) {
+        exit_code = 1;
+    }
+
+    parentPort.postMessage({
+        run_i: run_i,
+        output: Buffer.concat(output),
+        error: error,
+        exit_code: exit_code,
+        main_ms: main_ms,
+        import_ms: import_timing.ms,
+        import_calls: import_timing.calls,
+    });
+    output = [];
+});
@@ -1,19 +1,25 @@
 mod backend_error;
+mod calling_convention;
 mod dataflow_analysis;
 mod float_encoding;
+mod heap_allocator;
 mod import_export_names;
 mod initialise_memory;
 mod integer_encoding;
+mod library_kernels;
 mod memory_constants;
 mod memory_operations;
+mod peephole_optimisation;
 mod profiler;
 mod stack_allocation;
 mod stack_frame_operations;
+mod static_initialisers;
 pub mod target_code_generation;
 mod target_code_generation_context;
+mod threads;
 mod to_bytes;
 mod vector_encoding;
 mod wasm_indices;
 mod wasm_instructions;
-mod wasm_module;
+pub mod wasm_module;
 mod wasm_types;
@@ -5,6 +5,8 @@ use std::fmt::Formatter;
 #[derive(Debug)]
 pub enum BackendError {
     NoMainFunctionDefined,
+    ThreadsNotEnabled,
+    InvalidThreadMainFunction,
 }
 
 #[allow(unreachable_patterns)]
@@ -14,6 +16,18 @@ impl fmt::Display for BackendError {
             BackendError::NoMainFunctionDefined => {
                 write!(f, "Program must define a \"main\" function")
             }
+            BackendError::ThreadsNotEnabled => {
+                write!(
+                    f,
+                    "Program uses threads, so it must be compiled with --threads"
+                )
+            }
+            BackendError::InvalidThreadMainFunction => {
+                write!(
+                    f,
+                    "\"thread_main\" must be defined as void *thread_main(void *arg)"
+                )
+            }
             e => write!(f, "Backend error: {e:?}"),
         }
     }
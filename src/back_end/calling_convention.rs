@@ -0,0 +1,187 @@
+use crate::back_end::memory_operations::{load_src, truncate_to_narrow_type};
+use crate::back_end::stack_allocation::local_promotion::get_local_num_type;
+use crate::back_end::target_code_generation_context::{FunctionContext, ModuleContext};
+use crate::back_end::wasm_instructions::WasmInstruction;
+use crate::back_end::wasm_module::types_section::WasmFunctionType;
+use crate::back_end::wasm_types::{NumType, ValType};
+use crate::middle_end::instructions::Src;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::IrType;
+
+/// How a function receives its params and returns its result
+#[derive(Debug, Clone, PartialEq)]
+pub enum CallingConvention {
+    /// Params and return value are stored in the callee's stack frame, and the function
+    /// has the empty wasm type
+    StackFrame,
+    /// Params are passed as wasm params, and the return value as the wasm result.
+    /// The callee's stack frame only holds the previous frame ptr and its local vars
+    Native,
+}
+
+/// The wasm type of a function that uses the native calling convention, or None if the
+/// function has to use the stack frame calling convention.
+///
+/// Only functions whose params and return value are all scalars can be called natively.
+/// Variadic functions keep their params in memory, so they can be read without
+/// knowing how many there are.
+pub fn get_native_function_type(fun_type: &IrType) -> Option<WasmFunctionType> {
+    let (return_type, param_types, is_variadic) = match fun_type {
+        IrType::Function(return_type, param_types, is_variadic) => {
+            (&**return_type, param_types, is_variadic)
+        }
+        _ => unreachable!(),
+    };
+
+    if *is_variadic {
+        return None;
+    }
+
+    let mut wasm_param_types = Vec::new();
+    for param_type in param_types {
+        wasm_param_types.push(ValType::NumType(get_local_num_type(param_type)?));
+    }
+
+    let wasm_result_types = match return_type {
+        IrType::Void => Vec::new(),
+        _ => vec![ValType::NumType(get_local_num_type(return_type)?)],
+    };
+
+    Some(WasmFunctionType {
+        param_types: wasm_param_types,
+        result_types: wasm_result_types,
+    })
+}
+
+/// Load a param or return value onto the wasm stack, converted to the type the function
+/// expects. When values are passed in the stack frame, this conversion happens implicitly
+/// because the callee loads the value with its own type.
+pub fn load_src_as_type(
+    src: Src,
+    dest_type: &IrType,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    match src {
+        Src::Var(var_id) => {
+            let var_type = prog_metadata.get_var_type(&var_id).unwrap();
+            load_src(
+                Src::Var(var_id),
+                var_type,
+                wasm_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
+            convert_scalar_value(&var_type, dest_type, wasm_instrs);
+        }
+        Src::Constant(_) => load_src(
+            src,
+            dest_type,
+            wasm_instrs,
+            function_context,
+            module_context,
+            prog_metadata,
+        ),
+        Src::StoreAddressVar(_) | Src::Fun(_) => {
+            unreachable!()
+        }
+    }
+}
+
+/// Convert the scalar value on top of the wasm stack from src_type to dest_type
+pub fn convert_scalar_value(
+    src_type: &IrType,
+    dest_type: &IrType,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
+    if src_type == dest_type {
+        return;
+    }
+
+    // the value of an array var is a pointer to the array
+    let src_num_type = match src_type {
+        IrType::ArrayOf(_, _) => NumType::I32,
+        _ => get_local_num_type(src_type).unwrap(),
+    };
+    let dest_num_type = get_local_num_type(dest_type).unwrap();
+
+    let is_src_signed = src_type.is_signed_integral();
+    let is_dest_signed = dest_type.is_signed_integral();
+
+    let convert_instr = match (src_num_type, &dest_num_type) {
+        (NumType::I32, NumType::I32)
+        | (NumType::I64, NumType::I64)
+        | (NumType::F32, NumType::F32)
+        | (NumType::F64, NumType::F64) => None,
+        (NumType::I32, NumType::I64) => Some(if is_src_signed {
+            WasmInstruction::I64ExtendI32S
+        } else {
+            WasmInstruction::I64ExtendI32U
+        }),
+        (NumType::I64, NumType::I32) => Some(WasmInstruction::I32WrapI64),
+        (NumType::I32, NumType::F32) => Some(if is_src_signed {
+            WasmInstruction::F32ConvertI32S
+        } else {
+            WasmInstruction::F32ConvertI32U
+        }),
+        (NumType::I32, NumType::F64) => Some(if is_src_signed {
+            WasmInstruction::F64ConvertI32S
+        } else {
+            WasmInstruction::F64ConvertI32U
+        }),
+        (NumType::I64, NumType::F32) => Some(if is_src_signed {
+            WasmInstruction::F32ConvertI64S
+        } else {
+            WasmInstruction::F32ConvertI64U
+        }),
+        (NumType::I64, NumType::F64) => Some(if is_src_signed {
+            WasmInstruction::F64ConvertI64S
+        } else {
+            WasmInstruction::F64ConvertI64U
+        }),
+        (NumType::F32, NumType::I32) => Some(if is_dest_signed {
+            WasmInstruction::I32TruncF32S
+        } else {
+            WasmInstruction::I32TruncF32U
+        }),
+        (NumType::F64, NumType::I32) => Some(if is_dest_signed {
+            WasmInstruction::I32TruncF64S
+        } else {
+            WasmInstruction::I32TruncF64U
+        }),
+        (NumType::F32, NumType::I64) => Some(if is_dest_signed {
+            WasmInstruction::I64TruncF32S
+        } else {
+            WasmInstruction::I64TruncF32U
+        }),
+        (NumType::F64, NumType::I64) => Some(if is_dest_signed {
+            WasmInstruction::I64TruncF64S
+        } else {
+            WasmInstruction::I64TruncF64U
+        }),
+        (NumType::F32, NumType::F64) => Some(WasmInstruction::F64PromoteF32),
+        (NumType::F64, NumType::F32) => Some(WasmInstruction::F32DemoteF64),
+    };
+
+    if let Some(convert_instr) = convert_instr {
+        wasm_instrs.push(convert_instr);
+    }
+
+    if dest_num_type == NumType::I32 {
+        truncate_to_narrow_type(dest_type, wasm_instrs);
+    }
+}
+
+/// The zero value of a scalar type, for functions that fall off the end without returning
+/// a value but still have to leave a wasm result on the stack
+pub fn load_zero_value(value_type: &IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
+    match get_local_num_type(value_type).unwrap() {
+        NumType::I32 => wasm_instrs.push(WasmInstruction::I32Const { n: 0 }),
+        NumType::I64 => wasm_instrs.push(WasmInstruction::I64Const { n: 0 }),
+        NumType::F32 => wasm_instrs.push(WasmInstruction::F32Const { z: 0.0 }),
+        NumType::F64 => wasm_instrs.push(WasmInstruction::F64Const { z: 0.0 }),
+    }
+}
@@ -2,4 +2,5 @@ pub mod clash_graph;
 pub mod dead_code_analysis;
 pub mod flowgraph;
 mod instruction_def_ref;
+pub mod live_intervals;
 pub mod live_variable_analysis;
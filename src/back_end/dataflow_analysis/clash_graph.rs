@@ -1,63 +1,145 @@
-use std::collections::{HashMap, HashSet};
+#[cfg(test)]
+#[path = "clash_graph_tests.rs"]
+mod clash_graph_tests;
+
+use std::collections::HashSet;
 use std::fmt;
 use std::fmt::Formatter;
 
 use crate::back_end::dataflow_analysis::flowgraph::{generate_flowgraph, Flowgraph};
 use crate::back_end::dataflow_analysis::live_variable_analysis::live_variable_analysis;
+use crate::data_structures::bit_set::BitSet;
+use crate::data_structures::id_map::IdMap;
 use crate::middle_end::ids::VarId;
 use crate::middle_end::instructions::Instruction;
 use crate::relooper::blocks::Block;
 
+/// Which vars are live at the same time, so can't share a stack location.
+///
+/// Vars are given dense indices, and the clashes are stored as a bit matrix with one row per
+/// var. That way a whole set of simultaneously live vars can be added to a row at once.
 #[derive(Clone)]
 pub struct ClashGraph {
-    pub clashes: HashMap<VarId, HashSet<VarId>>,
-    universal_clashes: HashSet<VarId>,
+    var_indices: IdMap<VarId, usize>,
+    vars: Vec<VarId>,
+    clashes: Vec<BitSet>,
+    // the number of clashes of each var with the vars that haven't been removed
+    clash_counts: Vec<usize>,
+    // vars that are live somewhere, and haven't been removed
+    vars_in_graph: BitSet,
+    universal_clashes: BitSet,
+}
+
+/// The union of the clashes of some vars, so that you can check whether a var clashes with
+/// any of them
+#[derive(Clone)]
+pub struct ClashSet {
+    vars: BitSet,
+    universal_clash: bool,
+}
+
+impl ClashSet {
+    pub fn contains(&self, var: &VarId, clash_graph: &ClashGraph) -> bool {
+        self.universal_clash
+            || match clash_graph.var_indices.get(var) {
+                Some(var_i) => self.vars.contains(*var_i),
+                None => false,
+            }
+    }
+
+    pub fn merge(&mut self, other: ClashSet) {
+        self.vars.union_with(&other.vars);
+        self.universal_clash |= other.universal_clash;
+    }
+}
+
+impl fmt::Display for ClashSet {
+    fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
+        write!(
+            f,
+            "{} clashes; universal clash: {}",
+            self.vars.len(),
+            self.universal_clash
+        )
+    }
 }
 
 impl ClashGraph {
-    fn new() -> Self {
+    fn new(vars: Vec<VarId>) -> Self {
+        let var_count = vars.len();
         ClashGraph {
-            clashes: HashMap::new(),
-            universal_clashes: HashSet::new(),
+            var_indices: vars
+                .iter()
+                .enumerate()
+                .map(|(var_i, var)| (var.to_owned(), var_i))
+                .collect(),
+            vars,
+            clashes: vec![BitSet::new(var_count); var_count],
+            clash_counts: vec![0; var_count],
+            vars_in_graph: BitSet::new(var_count),
+            universal_clashes: BitSet::new(var_count),
         }
     }
 
-    fn add_var(&mut self, var: VarId) {
-        if !self.clashes.contains_key(&var) {
-            self.clashes.insert(var, HashSet::new());
+    /// Make all the vars in the set clash with each other
+    fn add_simultaneously_live_vars(&mut self, live_vars: &BitSet) {
+        self.vars_in_graph.union_with(live_vars);
+        for var_i in live_vars.iter() {
+            self.clashes[var_i].union_with(live_vars);
         }
     }
 
-    pub fn remove_var(&mut self, var: &VarId) {
-        self.clashes.remove(var);
-        self.universal_clashes.remove(var);
-        for (var, clashes) in &mut self.clashes {
-            clashes.remove(var);
+    /// Once all the clashes are added, work out how many each var has
+    fn count_all_clashes(&mut self) {
+        for var_i in 0..self.vars.len() {
+            // a var doesn't clash with itself
+            self.clashes[var_i].remove(var_i);
+            self.clash_counts[var_i] = self.clashes[var_i].len();
         }
     }
 
-    fn add_clash(&mut self, var1: VarId, var2: VarId) {
-        self.add_var(var1.to_owned());
-        self.clashes.get_mut(&var1).unwrap().insert(var2.to_owned());
+    fn get_var_in_graph_index(&self, var: &VarId) -> Option<usize> {
+        match self.var_indices.get(var) {
+            Some(var_i) if self.vars_in_graph.contains(*var_i) => Some(*var_i),
+            _ => None,
+        }
+    }
 
-        self.add_var(var2.to_owned());
-        self.clashes.get_mut(&var2).unwrap().insert(var1);
+    pub fn remove_var(&mut self, var: &VarId) {
+        let var_i = match self.var_indices.get(var) {
+            Some(var_i) => *var_i,
+            None => return,
+        };
+        if self.vars_in_graph.contains(var_i) {
+            self.vars_in_graph.remove(var_i);
+            for other_var_i in self.clashes[var_i].iter() {
+                if self.vars_in_graph.contains(other_var_i) {
+                    self.clash_counts[other_var_i] -= 1;
+                }
+            }
+        }
+        self.universal_clashes.remove(var_i);
     }
 
-    fn add_universal_clash(&mut self, var: VarId) {
-        self.universal_clashes.insert(var);
+    fn add_universal_clash(&mut self, var: &VarId) {
+        if let Some(var_i) = self.var_indices.get(var) {
+            self.universal_clashes.insert(*var_i);
+        }
     }
 
     pub fn does_var_clash_universally(&self, var: &VarId) -> bool {
-        self.universal_clashes.contains(var)
+        match self.var_indices.get(var) {
+            Some(var_i) => self.universal_clashes.contains(*var_i),
+            None => false,
+        }
     }
 
     pub fn count_clashes(&self, var: &VarId) -> usize {
-        if self.universal_clashes.contains(var) {
+        if self.does_var_clash_universally(var) {
             return usize::MAX;
         }
-        match self.clashes.get(var) {
-            Some(clashes) => clashes.len(),
+        match self.get_var_in_graph_index(var) {
+            Some(var_i) => self.clash_counts[var_i],
             None => {
                 // if var isn't in clash graph, it has no clashes that we know about
                 0_usize
@@ -66,37 +148,46 @@ impl ClashGraph {
     }
 
     pub fn do_vars_clash(&self, var1: &VarId, var2: &VarId) -> bool {
-        if self.universal_clashes.contains(var1) || self.universal_clashes.contains(var2) {
+        if self.does_var_clash_universally(var1) || self.does_var_clash_universally(var2) {
             return true;
         }
         // the clash graph is symmetric, so we only need to check in one direction
-        match self.clashes.get(var1) {
-            None => {
-                // if var isn't in clash graph, we should assume it clashes for safety
+        match (
+            self.get_var_in_graph_index(var1),
+            self.get_var_in_graph_index(var2),
+        ) {
+            (Some(var1_i), Some(var2_i)) => self.clashes[var1_i].contains(var2_i),
+            _ => {
+                // if either var isn't in clash graph, we should assume they clash for safety
                 true
             }
-            Some(clashes) => clashes.contains(var2),
         }
     }
 
-    pub fn get_all_clashes(&self, var: &VarId) -> HashSet<VarId> {
-        self.clashes.get(var).unwrap_or(&HashSet::new()).to_owned()
+    pub fn get_all_clashes(&self, var: &VarId) -> ClashSet {
+        ClashSet {
+            vars: match self.get_var_in_graph_index(var) {
+                Some(var_i) => self.clashes[var_i].to_owned(),
+                None => BitSet::new(self.vars.len()),
+            },
+            universal_clash: self.does_var_clash_universally(var),
+        }
     }
 }
 
 impl fmt::Display for ClashGraph {
     fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
         writeln!(f, "Clash graph:")?;
-        for (var, clash_vars) in &self.clashes {
-            write!(f, "{var}: ")?;
-            for clash_var in clash_vars {
-                write!(f, "{clash_var}, ")?;
+        for var_i in self.vars_in_graph.iter() {
+            write!(f, "{}: ", self.vars[var_i])?;
+            for clash_var_i in self.clashes[var_i].iter() {
+                write!(f, "{}, ", self.vars[clash_var_i])?;
             }
             writeln!(f)?;
         }
         write!(f, "universal clashes: ")?;
-        for clash_var in &self.universal_clashes {
-            write!(f, "{clash_var}, ")?;
+        for clash_var_i in self.universal_clashes.iter() {
+            write!(f, "{}, ", self.vars[clash_var_i])?;
         }
         Ok(())
     }
@@ -106,27 +197,20 @@ pub fn generate_clash_graph(block: &Block) -> ClashGraph {
     let flowgraph = generate_flowgraph(block);
     let live_vars = live_variable_analysis(&flowgraph);
 
-    let mut clash_graph = ClashGraph::new();
+    let mut clash_graph = ClashGraph::new(live_vars.get_vars().to_vec());
 
-    for (_instr, simultaneously_live_vars) in live_vars {
-        if simultaneously_live_vars.len() < 2 {
-            // no clashes
-            for var in simultaneously_live_vars {
-                clash_graph.add_var(var.to_owned());
-            }
-            continue;
-        }
-
-        let mut simultaneously_live_vars_vec: Vec<&VarId> =
-            simultaneously_live_vars.iter().collect();
-
-        // iteratively pop one of the vars, and store its clash with all the other remaining vars
-        while let Some(var) = simultaneously_live_vars_vec.pop() {
-            for other_var in &simultaneously_live_vars_vec {
-                clash_graph.add_clash(var.to_owned(), (*other_var).to_owned());
+    for (block_i, flowgraph_block) in flowgraph.blocks.iter().enumerate() {
+        let mut prev_live_vars: Option<&BitSet> = None;
+        for instr_i in 0..flowgraph_block.instrs.len() {
+            let simultaneously_live_vars = live_vars.get_live_var_set(block_i, instr_i);
+            // consecutive instrs often have the same live vars, which would add the same clashes
+            if prev_live_vars != Some(simultaneously_live_vars) {
+                clash_graph.add_simultaneously_live_vars(simultaneously_live_vars);
             }
+            prev_live_vars = Some(simultaneously_live_vars);
         }
     }
+    clash_graph.count_all_clashes();
 
     // any var that we take address of should clash with everything else,
     // to ensure safety of analysis
@@ -139,9 +223,18 @@ fn insert_universal_clashes_for_address_taken_vars(
     clash_graph: &mut ClashGraph,
     flowgraph: &Flowgraph,
 ) {
-    for instr in flowgraph.instrs.values() {
+    for var in get_address_taken_vars(flowgraph) {
+        clash_graph.add_universal_clash(&var);
+    }
+}
+
+/// All the vars that are the src of an AddressOf instruction
+pub fn get_address_taken_vars(flowgraph: &Flowgraph) -> HashSet<VarId> {
+    let mut address_taken_vars = HashSet::new();
+    for instr in flowgraph.instrs() {
         if let Instruction::AddressOf(_, _, src) = instr {
-            clash_graph.add_universal_clash(src.unwrap_var().unwrap());
+            address_taken_vars.insert(src.unwrap_var().unwrap());
         }
     }
+    address_taken_vars
 }
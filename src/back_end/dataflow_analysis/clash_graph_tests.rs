@@ -0,0 +1,213 @@
+#[cfg(test)]
+mod clash_graph_tests {
+    use super::super::{generate_clash_graph, ClashGraph};
+    use crate::id::IdGenerator;
+    use crate::middle_end::ids::{InstructionId, LabelId, VarId};
+    use crate::middle_end::instructions::{Constant, Instruction, Src};
+    use crate::relooper::blocks::{Block, Label, LoopBlockId};
+
+    struct Ids {
+        instrs: IdGenerator<InstructionId>,
+        labels: IdGenerator<LabelId>,
+        vars: IdGenerator<VarId>,
+    }
+
+    impl Ids {
+        fn new() -> Self {
+            Ids {
+                instrs: IdGenerator::new(),
+                labels: IdGenerator::new(),
+                vars: IdGenerator::new(),
+            }
+        }
+
+        fn assign_const(&mut self, dest: &VarId, n: i128) -> Instruction {
+            Instruction::SimpleAssignment(
+                self.instrs.new_id(),
+                dest.to_owned(),
+                Src::Constant(Constant::Int(n)),
+            )
+        }
+
+        fn add(&mut self, dest: &VarId, left: &VarId, right: &VarId) -> Instruction {
+            Instruction::Add(
+                self.instrs.new_id(),
+                dest.to_owned(),
+                Src::Var(left.to_owned()),
+                Src::Var(right.to_owned()),
+            )
+        }
+
+        fn ret(&mut self, var: &VarId) -> Instruction {
+            Instruction::Ret(self.instrs.new_id(), Some(Src::Var(var.to_owned())))
+        }
+
+        fn simple(&mut self, instrs: Vec<Instruction>, next: Option<Block>) -> Block {
+            Block::Simple {
+                internal: Label {
+                    label: self.labels.new_id(),
+                    instrs,
+                },
+                next: next.map(Box::new),
+            }
+        }
+    }
+
+    fn assert_symmetric(clash_graph: &ClashGraph, vars: &[VarId]) {
+        for var1 in vars {
+            for var2 in vars {
+                assert_eq!(
+                    clash_graph.do_vars_clash(var1, var2),
+                    clash_graph.do_vars_clash(var2, var1),
+                    "{} and {}",
+                    var1,
+                    var2
+                );
+            }
+        }
+    }
+
+    #[test]
+    fn chain_of_vars_clashes_across_bit_matrix_words() {
+        // a = 0; v0 = 0; v1 = 1; v2 = v1 + v0; ...; r = v199 + v198; r = r + a; return r
+        //
+        // a has index 0 and each v_i has index i + 1, so consecutive v_i include the pairs of
+        // indices either side of each 64 bit word boundary
+        let mut ids = Ids::new();
+        let a = ids.vars.new_id();
+        let chain: Vec<VarId> = (0..200).map(|_| ids.vars.new_id()).collect();
+        let r = ids.vars.new_id();
+        let mut instrs = vec![
+            ids.assign_const(&a, 0),
+            ids.assign_const(&chain[0], 0),
+            ids.assign_const(&chain[1], 1),
+        ];
+        for i in 2..chain.len() {
+            instrs.push(ids.add(&chain[i], &chain[i - 1], &chain[i - 2]));
+        }
+        instrs.push(ids.add(&r, &chain[199], &chain[198]));
+        instrs.push(ids.add(&r, &r, &a));
+        instrs.push(ids.ret(&r));
+        let block = ids.simple(instrs, None);
+        let clash_graph = generate_clash_graph(&block);
+
+        let mut all_vars = vec![a.to_owned(), r.to_owned()];
+        all_vars.extend(chain.iter().cloned());
+        assert_symmetric(&clash_graph, &all_vars);
+
+        for (i, var1) in chain.iter().enumerate() {
+            assert!(clash_graph.do_vars_clash(var1, &a));
+            assert!(!clash_graph.do_vars_clash(var1, &r));
+            for (j, var2) in chain.iter().enumerate() {
+                let is_neighbour = i.abs_diff(j) == 1;
+                assert_eq!(
+                    clash_graph.do_vars_clash(var1, var2),
+                    is_neighbour,
+                    "v{} and v{}",
+                    i,
+                    j
+                );
+            }
+            let neighbour_count = if i == 0 || i == chain.len() - 1 { 1 } else { 2 };
+            assert_eq!(clash_graph.count_clashes(var1), neighbour_count + 1);
+        }
+        assert!(clash_graph.do_vars_clash(&r, &a));
+        assert_eq!(clash_graph.count_clashes(&a), chain.len() + 1);
+        assert_eq!(clash_graph.count_clashes(&r), 1);
+    }
+
+    #[test]
+    fn removing_var_updates_clash_counts_of_its_clashes() {
+        let mut ids = Ids::new();
+        let vars: Vec<VarId> = (0..130).map(|_| ids.vars.new_id()).collect();
+        let sum = ids.vars.new_id();
+        // all of vars are live at once, and sum is live alongside all but vars[0]
+        let mut instrs: Vec<Instruction> =
+            vars.iter().map(|var| ids.assign_const(var, 1)).collect();
+        instrs.push(ids.add(&sum, &vars[0], &vars[63]));
+        for var in &vars[1..] {
+            instrs.push(ids.add(&sum, &sum, var));
+        }
+        instrs.push(ids.ret(&sum));
+        let block = ids.simple(instrs, None);
+        let mut clash_graph = generate_clash_graph(&block);
+
+        assert_symmetric(&clash_graph, &vars);
+        assert!(!clash_graph.do_vars_clash(&vars[0], &sum));
+        assert_eq!(clash_graph.count_clashes(&vars[0]), vars.len() - 1);
+        assert_eq!(clash_graph.count_clashes(&vars[64]), vars.len());
+
+        clash_graph.remove_var(&vars[63]);
+        clash_graph.remove_var(&vars[127]);
+        assert_eq!(clash_graph.count_clashes(&vars[64]), vars.len() - 2);
+        assert_eq!(clash_graph.count_clashes(&vars[128]), vars.len() - 2);
+        assert_eq!(clash_graph.count_clashes(&vars[63]), 0);
+    }
+
+    #[test]
+    fn var_live_across_loop_back_edge_clashes_with_loop_vars() {
+        let mut ids = Ids::new();
+        let i = ids.vars.new_id();
+        let n = ids.vars.new_id();
+        let r = ids.vars.new_id();
+        let loop_id = IdGenerator::<LoopBlockId>::new().new_id();
+
+        // n = 10; i = 0;
+        // loop { if i == n { break } else { i = i + i; continue } }
+        // r = i + i; return r
+        let true_instrs = vec![Instruction::Break(ids.instrs.new_id(), loop_id.to_owned())];
+        let false_instrs = vec![
+            ids.add(&i, &i, &i),
+            Instruction::Continue(ids.instrs.new_id(), loop_id.to_owned()),
+        ];
+        let if_instr = Instruction::IfEqElse(
+            ids.instrs.new_id(),
+            Src::Var(i.to_owned()),
+            Src::Var(n.to_owned()),
+            true_instrs,
+            false_instrs,
+        );
+        let inner = ids.simple(vec![if_instr], None);
+        let next_instrs = vec![ids.add(&r, &i, &i), ids.ret(&r)];
+        let next = ids.simple(next_instrs, None);
+        let loop_block = Block::Loop {
+            id: loop_id,
+            inner: Box::new(inner),
+            next: Some(Box::new(next)),
+        };
+        let entry_instrs = vec![ids.assign_const(&n, 10), ids.assign_const(&i, 0)];
+        let block = ids.simple(entry_instrs, Some(loop_block));
+        let clash_graph = generate_clash_graph(&block);
+
+        let vars = [i.to_owned(), n.to_owned(), r.to_owned()];
+        assert_symmetric(&clash_graph, &vars);
+        assert!(clash_graph.do_vars_clash(&i, &n));
+        // n is dead once the loop is left
+        assert!(!clash_graph.do_vars_clash(&n, &r));
+        assert!(!clash_graph.do_vars_clash(&i, &r));
+    }
+
+    #[test]
+    fn address_taken_var_clashes_with_everything() {
+        let mut ids = Ids::new();
+        let x = ids.vars.new_id();
+        let ptr = ids.vars.new_id();
+        let y = ids.vars.new_id();
+        let instrs = vec![
+            ids.assign_const(&x, 1),
+            Instruction::AddressOf(ids.instrs.new_id(), ptr.to_owned(), Src::Var(x.to_owned())),
+            ids.assign_const(&y, 2),
+            ids.ret(&y),
+        ];
+        let block = ids.simple(instrs, None);
+        let clash_graph = generate_clash_graph(&block);
+
+        assert_symmetric(&clash_graph, &[x.to_owned(), ptr.to_owned(), y.to_owned()]);
+        assert!(clash_graph.does_var_clash_universally(&x));
+        assert!(clash_graph.do_vars_clash(&x, &y));
+        // ptr is never used, so it's never live, and could be anywhere
+        assert!(clash_graph.do_vars_clash(&ptr, &y));
+        assert!(clash_graph.do_vars_clash(&y, &ptr));
+        assert_eq!(clash_graph.count_clashes(&x), usize::MAX);
+    }
+}
@@ -1,189 +1,149 @@
-use std::collections::{HashMap, HashSet};
+#[cfg(test)]
+#[path = "flowgraph_tests.rs"]
+mod flowgraph_tests;
 
-use crate::middle_end::ids::InstructionId;
 use crate::middle_end::instructions::Instruction;
 use crate::relooper::blocks::Block;
 
+/// A straight line run of instrs, that is only entered at the first instr and only left
+/// after the last one
 #[derive(Debug)]
-pub struct Flowgraph {
-    pub instrs: HashMap<InstructionId, Instruction>,
-    // adjacency lists
-    pub successors: HashMap<InstructionId, HashSet<InstructionId>>,
-    pub predecessors: HashMap<InstructionId, HashSet<InstructionId>>,
-    pub entries: HashSet<InstructionId>,
-    pub exits: HashSet<InstructionId>,
+pub struct FlowgraphBlock<'a> {
+    pub instrs: Vec<&'a Instruction>,
+    // adjacency lists, as indices into the flowgraph's blocks
+    pub successors: Vec<usize>,
+    pub predecessors: Vec<usize>,
 }
 
-impl Flowgraph {
-    fn new() -> Self {
-        Flowgraph {
-            instrs: HashMap::new(),
-            successors: HashMap::new(),
-            predecessors: HashMap::new(),
-            entries: HashSet::new(),
-            exits: HashSet::new(),
-        }
-    }
+/// The flow of control between the instrs of a relooped function body. The instrs are
+/// borrowed from the relooper blocks, so the flowgraph has to be regenerated after the
+/// instrs are changed.
+#[derive(Debug)]
+pub struct Flowgraph<'a> {
+    pub blocks: Vec<FlowgraphBlock<'a>>,
+}
 
-    fn add_instr(&mut self, instr: Instruction) {
-        let instr_id = instr.get_instr_id();
-        self.instrs.insert(instr_id.to_owned(), instr);
-        // init adjacency lists
-        self.successors.insert(instr_id.to_owned(), HashSet::new());
-        self.predecessors.insert(instr_id, HashSet::new());
+impl<'a> Flowgraph<'a> {
+    fn new() -> Self {
+        Flowgraph { blocks: Vec::new() }
     }
 
-    fn add_successor(&mut self, instr_id: InstructionId, successor_id: InstructionId) {
-        // make successor_id a successor of instr_id
-        self.successors
-            .get_mut(&instr_id)
-            .unwrap()
-            .insert(successor_id.to_owned());
-        // make instr_id a predecessor of successor_id
-        self.predecessors
-            .get_mut(&successor_id)
-            .unwrap()
-            .insert(instr_id);
+    fn new_block(&mut self) -> usize {
+        self.blocks.push(FlowgraphBlock {
+            instrs: Vec::new(),
+            successors: Vec::new(),
+            predecessors: Vec::new(),
+        });
+        self.blocks.len() - 1
     }
 
-    pub fn remove_instr(&mut self, instr_id: &InstructionId) {
-        // if instr not in flowgraph, nothing to do
-        if !self.instrs.contains_key(instr_id) {
+    fn add_successor(&mut self, block_i: usize, successor_i: usize) {
+        if self.blocks[block_i].successors.contains(&successor_i) {
             return;
         }
-        let mut successors = self.successors.remove(instr_id).unwrap();
-        let mut predecessors = self.predecessors.remove(instr_id).unwrap();
-        // just in case
-        successors.remove(instr_id);
-        predecessors.remove(instr_id);
-
-        self.instrs.remove(instr_id);
-        self.successors.remove(instr_id);
-        self.predecessors.remove(instr_id);
+        // make successor_i a successor of block_i
+        self.blocks[block_i].successors.push(successor_i);
+        // make block_i a predecessor of successor_i
+        self.blocks[successor_i].predecessors.push(block_i);
+    }
 
-        for successor_id in self.successors.keys() {
-            self.predecessors
-                .insert(successor_id.to_owned(), predecessors.to_owned());
-        }
-        for predecessor_id in self.predecessors.keys() {
-            self.successors
-                .insert(predecessor_id.to_owned(), successors.to_owned());
+    fn add_successors(&mut self, block_is: &[usize], successor_is: &[usize]) {
+        for block_i in block_is {
+            for successor_i in successor_is {
+                self.add_successor(*block_i, *successor_i);
+            }
         }
+    }
 
-        if self.entries.contains(instr_id) {
-            self.entries.remove(instr_id);
-            self.entries.extend(successors);
-        }
-        if self.exits.contains(instr_id) {
-            self.exits.remove(instr_id);
-            self.exits.extend(predecessors);
-        }
+    /// Every instr in the flowgraph, including the ones nested inside if and br_table instrs
+    pub fn instrs(&self) -> impl Iterator<Item = &'a Instruction> + '_ {
+        self.blocks
+            .iter()
+            .flat_map(|block| block.instrs.iter().cloned())
     }
 }
 
-pub fn generate_flowgraph(relooper_block: &Block) -> Flowgraph {
-    let mut flowgraph = Flowgraph::new();
-
-    let (flowgraph_entries, flowgraph_exits, flowgraph_jump_exits) =
-        add_block_to_flowgraph_and_get_entries_and_exits(relooper_block, &mut flowgraph);
-
-    flowgraph.entries = flowgraph_entries;
-    flowgraph.exits = flowgraph_exits;
-    flowgraph.exits.extend(flowgraph_jump_exits);
+/// The flowgraph blocks that control enters a relooper block at, the blocks that fall
+/// through to whatever comes after it, and the blocks that jump out of it with a break,
+/// continue, endHandled or return
+struct FlowgraphEntriesAndExits {
+    entries: Vec<usize>,
+    exits: Vec<usize>,
+    jump_exits: Vec<usize>,
+}
 
+pub fn generate_flowgraph(relooper_block: &Block) -> Flowgraph<'_> {
+    let mut flowgraph = Flowgraph::new();
+    add_block_to_flowgraph(relooper_block, &mut flowgraph);
     flowgraph
 }
 
-fn add_block_to_flowgraph_and_get_entries_and_exits(
-    block: &Block,
-    flowgraph: &mut Flowgraph,
-) -> (
-    HashSet<InstructionId>,
-    HashSet<InstructionId>,
-    HashSet<InstructionId>,
-) {
+fn add_block_to_flowgraph<'a>(
+    block: &'a Block,
+    flowgraph: &mut Flowgraph<'a>,
+) -> FlowgraphEntriesAndExits {
     match block {
         Block::Simple { internal, next } => {
             if internal.instrs.is_empty() {
                 // shouldn't really ever be the case
                 if let Some(next) = next {
                     // just skip this block if it happens to have no instructions
-                    return add_block_to_flowgraph_and_get_entries_and_exits(next, flowgraph);
+                    return add_block_to_flowgraph(next, flowgraph);
                 }
-                return (HashSet::new(), HashSet::new(), HashSet::new());
+                return FlowgraphEntriesAndExits {
+                    entries: Vec::new(),
+                    exits: Vec::new(),
+                    jump_exits: Vec::new(),
+                };
             }
 
-            let (block_entry_instr, mut block_exit_instrs, mut jump_exit_instrs) =
-                add_instrs_to_flowgraph(&internal.instrs, flowgraph);
-
-            block_exit_instrs.extend(jump_exit_instrs.to_owned());
+            let mut internal_blocks = add_instrs_to_flowgraph(&internal.instrs, flowgraph);
+            let mut block_exits = internal_blocks.exits;
+            block_exits.extend(internal_blocks.jump_exits.to_owned());
 
-            let mut block_entry_instrs = HashSet::new();
-            // we've checked that instrs is non-empty, so we can unwrap safely
-            block_entry_instrs.insert(block_entry_instr.unwrap());
+            match next {
+                Some(next) => {
+                    let next_blocks = add_block_to_flowgraph(next, flowgraph);
+                    flowgraph.add_successors(&block_exits, &next_blocks.entries);
 
-            if let Some(next) = next {
-                let (successors, next_exit_instrs, next_jump_exit_instrs) =
-                    add_block_to_flowgraph_and_get_entries_and_exits(next, flowgraph);
-
-                jump_exit_instrs.extend(next_jump_exit_instrs);
-
-                for successor in successors {
-                    for end_of_block_instr in &block_exit_instrs {
-                        flowgraph
-                            .add_successor(end_of_block_instr.to_owned(), successor.to_owned());
+                    internal_blocks.jump_exits.extend(next_blocks.jump_exits);
+                    FlowgraphEntriesAndExits {
+                        entries: internal_blocks.entries,
+                        exits: next_blocks.exits,
+                        jump_exits: internal_blocks.jump_exits,
                     }
                 }
-
-                (block_entry_instrs, next_exit_instrs, jump_exit_instrs)
-            } else {
-                (block_entry_instrs, block_exit_instrs, jump_exit_instrs)
+                None => FlowgraphEntriesAndExits {
+                    entries: internal_blocks.entries,
+                    exits: block_exits,
+                    jump_exits: internal_blocks.jump_exits,
+                },
             }
         }
         Block::Loop { id: _, inner, next } => {
-            let (inner_entry_instrs, inner_exit_instrs, mut inner_jump_exit_instrs) =
-                add_block_to_flowgraph_and_get_entries_and_exits(inner, flowgraph);
+            let mut inner_blocks = add_block_to_flowgraph(inner, flowgraph);
 
             // make start of loop successor of end of loop
-            for start_of_loop_instr in &inner_entry_instrs {
-                for end_of_loop_instr in &inner_exit_instrs {
-                    flowgraph.add_successor(
-                        end_of_loop_instr.to_owned(),
-                        start_of_loop_instr.to_owned(),
-                    );
-                }
+            flowgraph.add_successors(&inner_blocks.exits, &inner_blocks.entries);
+            // might be a `continue` jumping back to the start of the loop
+            flowgraph.add_successors(&inner_blocks.jump_exits, &inner_blocks.entries);
 
-                // might be a `continue` jumping back to the start of the loop
-                for jump_exit_instr in &inner_jump_exit_instrs {
-                    flowgraph
-                        .add_successor(jump_exit_instr.to_owned(), start_of_loop_instr.to_owned());
-                }
-            }
-
-            if let Some(next) = next {
-                let (next_entry_instrs, next_exit_instrs, next_jump_exit_instrs) =
-                    add_block_to_flowgraph_and_get_entries_and_exits(next, flowgraph);
-
-                for successor in next_entry_instrs {
-                    for end_of_loop_instr in &inner_exit_instrs {
-                        flowgraph.add_successor(end_of_loop_instr.to_owned(), successor.to_owned());
-                    }
+            match next {
+                Some(next) => {
+                    let next_blocks = add_block_to_flowgraph(next, flowgraph);
 
+                    flowgraph.add_successors(&inner_blocks.exits, &next_blocks.entries);
                     // could be a `break` jump
-                    for jump_exit_instr in &inner_jump_exit_instrs {
-                        flowgraph.add_successor(jump_exit_instr.to_owned(), successor.to_owned());
+                    flowgraph.add_successors(&inner_blocks.jump_exits, &next_blocks.entries);
+
+                    inner_blocks.jump_exits.extend(next_blocks.jump_exits);
+                    FlowgraphEntriesAndExits {
+                        entries: inner_blocks.entries,
+                        exits: next_blocks.exits,
+                        jump_exits: inner_blocks.jump_exits,
                     }
                 }
-
-                inner_jump_exit_instrs.extend(next_jump_exit_instrs);
-
-                (inner_entry_instrs, next_exit_instrs, inner_jump_exit_instrs)
-            } else {
-                (
-                    inner_entry_instrs,
-                    inner_exit_instrs,
-                    inner_jump_exit_instrs,
-                )
+                None => inner_blocks,
             }
         }
         Block::Multiple {
@@ -193,99 +153,85 @@ fn add_block_to_flowgraph_and_get_entries_and_exits(
             next,
         } => {
             // combine entries and exits from all handled blocks
-            let mut entry_instrs = HashSet::new();
-            let mut all_handled_exit_instrs = HashSet::new();
-            let mut all_handled_jump_exit_instrs = HashSet::new();
-
-            let (pre_handled_entry, pre_handled_exits, _jump_exits) =
-                add_instrs_to_flowgraph(pre_handled_blocks_instrs, flowgraph);
-
-            if let Some(entry) = pre_handled_entry {
-                entry_instrs.insert(entry);
-            }
-
-            // let entry_instrs = pre_handled_blocks_instrs
-            //     .iter()
-            //     .map(|i| i.get_instr_id())
-            //     .collect::<HashSet<InstructionId>>();
+            let pre_handled_blocks = add_instrs_to_flowgraph(pre_handled_blocks_instrs, flowgraph);
+            let mut entries = pre_handled_blocks.entries;
+            let pre_handled_exits = pre_handled_blocks.exits;
+            let mut all_handled_exits = Vec::new();
+            let mut all_handled_jump_exits = Vec::new();
 
             for handled_block in handled_blocks {
-                let (handled_entry_instrs, handled_exit_instrs, handled_jump_exit_instrs) =
-                    add_block_to_flowgraph_and_get_entries_and_exits(handled_block, flowgraph);
+                let handled_blocks = add_block_to_flowgraph(handled_block, flowgraph);
 
                 if pre_handled_exits.is_empty() {
-                    entry_instrs.extend(handled_entry_instrs);
+                    entries.extend(handled_blocks.entries);
                 } else {
-                    for pre_handled in &pre_handled_exits {
-                        for handled_entry in &handled_entry_instrs {
-                            flowgraph
-                                .add_successor(pre_handled.to_owned(), handled_entry.to_owned());
-                        }
-                    }
+                    flowgraph.add_successors(&pre_handled_exits, &handled_blocks.entries);
                 }
 
-                all_handled_exit_instrs.extend(handled_exit_instrs);
-                all_handled_jump_exit_instrs.extend(handled_jump_exit_instrs);
+                all_handled_exits.extend(handled_blocks.exits);
+                all_handled_jump_exits.extend(handled_blocks.jump_exits);
             }
 
-            if let Some(next) = next {
-                let (next_entry_instrs, next_exit_instrs, next_jump_exit_instrs) =
-                    add_block_to_flowgraph_and_get_entries_and_exits(next, flowgraph);
+            match next {
+                Some(next) => {
+                    let next_blocks = add_block_to_flowgraph(next, flowgraph);
 
-                // could skip handled blocks and go straight to next block
-                if pre_handled_exits.is_empty() {
-                    entry_instrs.extend(next_entry_instrs.to_owned());
-                } else {
-                    for pre_handled in &pre_handled_exits {
-                        for next_entry in &next_entry_instrs {
-                            flowgraph.add_successor(pre_handled.to_owned(), next_entry.to_owned());
-                        }
-                    }
-                }
-
-                for successor in next_entry_instrs {
-                    for end_of_handled_instr in &all_handled_exit_instrs {
-                        flowgraph
-                            .add_successor(end_of_handled_instr.to_owned(), successor.to_owned());
+                    // could skip handled blocks and go straight to next block
+                    if pre_handled_exits.is_empty() {
+                        entries.extend(next_blocks.entries.to_owned());
+                    } else {
+                        flowgraph.add_successors(&pre_handled_exits, &next_blocks.entries);
                     }
 
+                    flowgraph.add_successors(&all_handled_exits, &next_blocks.entries);
                     // could be an `endHandled` jump
-                    for jump_exit_instr in &all_handled_jump_exit_instrs {
-                        flowgraph.add_successor(jump_exit_instr.to_owned(), successor.to_owned())
+                    flowgraph.add_successors(&all_handled_jump_exits, &next_blocks.entries);
+
+                    all_handled_jump_exits.extend(next_blocks.jump_exits);
+                    FlowgraphEntriesAndExits {
+                        entries,
+                        exits: next_blocks.exits,
+                        jump_exits: all_handled_jump_exits,
                     }
                 }
-
-                all_handled_jump_exit_instrs.extend(next_jump_exit_instrs);
-
-                (entry_instrs, next_exit_instrs, all_handled_jump_exit_instrs)
-            } else {
-                (
-                    entry_instrs,
-                    all_handled_exit_instrs,
-                    all_handled_jump_exit_instrs,
-                )
+                None => FlowgraphEntriesAndExits {
+                    entries,
+                    exits: all_handled_exits,
+                    jump_exits: all_handled_jump_exits,
+                },
             }
         }
     }
 }
 
-fn add_instrs_to_flowgraph(
-    instrs: &Vec<Instruction>,
-    flowgraph: &mut Flowgraph,
-) -> (
-    Option<InstructionId>, // can be None eg. if this is an empty else block
-    HashSet<InstructionId>,
-    HashSet<InstructionId>,
-) {
-    let mut entry_instr = None;
-    let mut exit_instrs = HashSet::new();
-    let mut jump_exit_instrs = HashSet::new();
-
-    let mut prev_instrs: HashSet<InstructionId> = HashSet::new();
-    for i in 0..instrs.len() {
-        let instr = instrs.get(i).unwrap();
-        let instr_id = instr.get_instr_id();
-        flowgraph.add_instr(instr.to_owned());
+/// Add a list of instrs to the flowgraph. Consecutive instrs go in the same flowgraph block,
+/// until an instr that branches or jumps out ends it. There's no entry if the list is empty,
+/// eg. if this is an empty else block.
+fn add_instrs_to_flowgraph<'a>(
+    instrs: &'a [Instruction],
+    flowgraph: &mut Flowgraph<'a>,
+) -> FlowgraphEntriesAndExits {
+    let mut entries = Vec::new();
+    let mut jump_exits = Vec::new();
+
+    // the block that the next instr is added to, if control can fall through into it
+    let mut current_block: Option<usize> = None;
+    // the blocks that control passes to the next instr from
+    let mut prev_blocks: Vec<usize> = Vec::new();
+
+    for (i, instr) in instrs.iter().enumerate() {
+        let block_i = match current_block {
+            Some(block_i) => block_i,
+            None => {
+                let block_i = flowgraph.new_block();
+                flowgraph.add_successors(&prev_blocks, &[block_i]);
+                if i == 0 {
+                    entries.push(block_i);
+                }
+                block_i
+            }
+        };
+        flowgraph.blocks[block_i].instrs.push(instr);
 
         match instr {
             Instruction::Break(..)
@@ -293,77 +239,56 @@ fn add_instrs_to_flowgraph(
             | Instruction::EndHandledBlock(..)
             | Instruction::Ret(..)
             | Instruction::TailCall(..) => {
-                // successive from previous instr
-                for prev_instr_id in &prev_instrs {
-                    flowgraph.add_successor(prev_instr_id.to_owned(), instr_id.to_owned());
-                }
                 // these instrs jump out of this block
-                jump_exit_instrs.insert(instr_id.to_owned());
+                jump_exits.push(block_i);
 
                 // next instr isn't a successor
-                prev_instrs.clear();
-
-                if i == 0 {
-                    entry_instr = Some(instr_id.to_owned());
-                }
-                if i == instrs.len() - 1 {
-                    exit_instrs.insert(instr_id.to_owned());
-                }
+                current_block = None;
+                prev_blocks = if i == instrs.len() - 1 {
+                    vec![block_i]
+                } else {
+                    Vec::new()
+                };
             }
             Instruction::Br(..) | Instruction::BrIfEq(..) | Instruction::BrIfNotEq(..) => {
                 unreachable!("Relooper algorithm removes all unstructured branch instrs")
             }
+            Instruction::BrTable(_, _, _, arms) => {
+                current_block = None;
+                prev_blocks = Vec::new();
+                for arm in arms {
+                    let arm_blocks = add_instrs_to_flowgraph(arm, flowgraph);
+                    flowgraph.add_successors(&[block_i], &arm_blocks.entries);
+                    prev_blocks.extend(arm_blocks.exits);
+                    jump_exits.extend(arm_blocks.jump_exits);
+                }
+            }
             Instruction::IfEqElse(_, _, _, instrs1, instrs2)
             | Instruction::IfNotEqElse(_, _, _, instrs1, instrs2) => {
-                // successive from previous instr
-                for prev_instr_id in &prev_instrs {
-                    flowgraph.add_successor(prev_instr_id.to_owned(), instr_id.to_owned());
-                }
-
-                let (instrs1_entry, instrs1_exits, instrs1_jump_exits) =
-                    add_instrs_to_flowgraph(instrs1, flowgraph);
-                let (instrs2_entry, instrs2_exits, instrs2_jump_exits) =
-                    add_instrs_to_flowgraph(instrs2, flowgraph);
-
-                if let Some(entry) = instrs1_entry {
-                    flowgraph.add_successor(instr_id.to_owned(), entry);
-                }
-                if let Some(entry) = instrs2_entry {
-                    flowgraph.add_successor(instr_id.to_owned(), entry);
-                }
-
-                prev_instrs.clear();
-                prev_instrs.extend(instrs1_exits.to_owned());
-                prev_instrs.extend(instrs2_exits.to_owned());
-
-                jump_exit_instrs.extend(instrs1_jump_exits);
-                jump_exit_instrs.extend(instrs2_jump_exits);
-
-                if i == 0 {
-                    entry_instr = Some(instr_id.to_owned());
-                }
-                if i == instrs.len() - 1 {
-                    exit_instrs.extend(instrs1_exits);
-                    exit_instrs.extend(instrs2_exits);
+                current_block = None;
+                prev_blocks = Vec::new();
+                for branch_instrs in [instrs1, instrs2] {
+                    let branch_blocks = add_instrs_to_flowgraph(branch_instrs, flowgraph);
+                    if branch_blocks.entries.is_empty() {
+                        // an empty branch goes straight to the next instr
+                        prev_blocks.push(block_i);
+                    }
+                    flowgraph.add_successors(&[block_i], &branch_blocks.entries);
+                    prev_blocks.extend(branch_blocks.exits);
+                    jump_exits.extend(branch_blocks.jump_exits);
                 }
             }
             _ => {
                 // all other instrs are successive
-                for prev_instr_id in &prev_instrs {
-                    flowgraph.add_successor(prev_instr_id.to_owned(), instr_id.to_owned());
-                }
-                prev_instrs.clear();
-                prev_instrs.insert(instr_id.to_owned());
-
-                if i == 0 {
-                    entry_instr = Some(instr_id.to_owned());
-                }
-                if i == instrs.len() - 1 {
-                    exit_instrs.insert(instr_id.to_owned());
-                }
+                current_block = Some(block_i);
+                prev_blocks = vec![block_i];
             }
         }
     }
 
-    (entry_instr, exit_instrs, jump_exit_instrs)
+    FlowgraphEntriesAndExits {
+        entries,
+        exits: prev_blocks,
+        jump_exits,
+    }
 }
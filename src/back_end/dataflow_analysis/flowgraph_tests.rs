@@ -0,0 +1,187 @@
+#[cfg(test)]
+mod flowgraph_tests {
+    use super::super::{generate_flowgraph, Flowgraph};
+    use crate::id::IdGenerator;
+    use crate::middle_end::ids::{InstructionId, LabelId, VarId};
+    use crate::middle_end::instructions::{Constant, Instruction, Src};
+    use crate::relooper::blocks::{Block, Label, LoopBlockId};
+
+    struct Ids {
+        instrs: IdGenerator<InstructionId>,
+        labels: IdGenerator<LabelId>,
+        loops: IdGenerator<LoopBlockId>,
+        var: VarId,
+    }
+
+    impl Ids {
+        fn new() -> Self {
+            Ids {
+                instrs: IdGenerator::new(),
+                labels: IdGenerator::new(),
+                loops: IdGenerator::new(),
+                var: IdGenerator::<VarId>::new().new_id(),
+            }
+        }
+
+        fn assign_var(&mut self, n: i128) -> Instruction {
+            Instruction::SimpleAssignment(
+                self.instrs.new_id(),
+                self.var.to_owned(),
+                Src::Constant(Constant::Int(n)),
+            )
+        }
+
+        fn if_var_is_zero(
+            &mut self,
+            true_instrs: Vec<Instruction>,
+            false_instrs: Vec<Instruction>,
+        ) -> Instruction {
+            Instruction::IfEqElse(
+                self.instrs.new_id(),
+                Src::Var(self.var.to_owned()),
+                Src::Constant(Constant::Int(0)),
+                true_instrs,
+                false_instrs,
+            )
+        }
+
+        fn break_(&mut self, loop_id: &LoopBlockId) -> Instruction {
+            Instruction::Break(self.instrs.new_id(), loop_id.to_owned())
+        }
+
+        fn continue_(&mut self, loop_id: &LoopBlockId) -> Instruction {
+            Instruction::Continue(self.instrs.new_id(), loop_id.to_owned())
+        }
+
+        fn ret(&mut self) -> Instruction {
+            Instruction::Ret(self.instrs.new_id(), None)
+        }
+
+        fn simple(&mut self, instrs: Vec<Instruction>, next: Option<Block>) -> Block {
+            Block::Simple {
+                internal: Label {
+                    label: self.labels.new_id(),
+                    instrs,
+                },
+                next: next.map(Box::new),
+            }
+        }
+    }
+
+    /// Check the successors of every block, and that the predecessors are exactly the
+    /// reverse of the successors
+    fn assert_edges(flowgraph: &Flowgraph, expected_successors: &[&[usize]]) {
+        let successors: Vec<Vec<usize>> = flowgraph
+            .blocks
+            .iter()
+            .map(|block| {
+                let mut successors = block.successors.to_owned();
+                successors.sort_unstable();
+                successors
+            })
+            .collect();
+        assert_eq!(successors, expected_successors);
+
+        for (block_i, block) in flowgraph.blocks.iter().enumerate() {
+            let mut predecessors = block.predecessors.to_owned();
+            predecessors.sort_unstable();
+            let expected_predecessors: Vec<usize> = (0..flowgraph.blocks.len())
+                .filter(|other_i| expected_successors[*other_i].contains(&block_i))
+                .collect();
+            assert_eq!(predecessors, expected_predecessors, "block {}", block_i);
+        }
+    }
+
+    fn block_instr_counts(flowgraph: &Flowgraph) -> Vec<usize> {
+        flowgraph
+            .blocks
+            .iter()
+            .map(|block| block.instrs.len())
+            .collect()
+    }
+
+    #[test]
+    fn straight_line_instrs_are_one_block() {
+        let mut ids = Ids::new();
+        let instrs = vec![ids.assign_var(1), ids.assign_var(2), ids.ret()];
+        let block = ids.simple(instrs, None);
+
+        let flowgraph = generate_flowgraph(&block);
+        assert_eq!(block_instr_counts(&flowgraph), vec![3]);
+        assert_edges(&flowgraph, &[&[]]);
+    }
+
+    #[test]
+    fn if_else_is_a_diamond() {
+        let mut ids = Ids::new();
+        let true_instrs = vec![ids.assign_var(1)];
+        let false_instrs = vec![ids.assign_var(2)];
+        let if_instr = ids.if_var_is_zero(true_instrs, false_instrs);
+        let instrs = vec![ids.assign_var(0), if_instr, ids.ret()];
+        let block = ids.simple(instrs, None);
+
+        // 0: assign, if; 1: true branch; 2: false branch; 3: ret
+        let flowgraph = generate_flowgraph(&block);
+        assert_eq!(block_instr_counts(&flowgraph), vec![2, 1, 1, 1]);
+        assert_edges(&flowgraph, &[&[1, 2], &[3], &[3], &[]]);
+    }
+
+    #[test]
+    fn empty_else_branch_falls_through() {
+        let mut ids = Ids::new();
+        let true_instrs = vec![ids.assign_var(1)];
+        let if_instr = ids.if_var_is_zero(true_instrs, vec![]);
+        let instrs = vec![ids.assign_var(0), if_instr, ids.ret()];
+        let block = ids.simple(instrs, None);
+
+        // 0: assign, if; 1: true branch; 2: ret
+        let flowgraph = generate_flowgraph(&block);
+        assert_eq!(block_instr_counts(&flowgraph), vec![2, 1, 1]);
+        assert_edges(&flowgraph, &[&[1, 2], &[2], &[]]);
+    }
+
+    #[test]
+    fn loop_has_back_edge_to_its_start() {
+        let mut ids = Ids::new();
+        let loop_id = ids.loops.new_id();
+        let loop_instrs = vec![ids.assign_var(1), ids.continue_(&loop_id)];
+        let inner = ids.simple(loop_instrs, None);
+        let ret_instrs = vec![ids.ret()];
+        let next = ids.simple(ret_instrs, None);
+        let block = Block::Loop {
+            id: loop_id,
+            inner: Box::new(inner),
+            next: Some(Box::new(next)),
+        };
+
+        // 0: loop body; 1: ret
+        let flowgraph = generate_flowgraph(&block);
+        assert_eq!(block_instr_counts(&flowgraph), vec![2, 1]);
+        assert_edges(&flowgraph, &[&[0, 1], &[]]);
+    }
+
+    #[test]
+    fn loop_with_diamond_body() {
+        let mut ids = Ids::new();
+        let loop_id = ids.loops.new_id();
+        let true_instrs = vec![ids.break_(&loop_id)];
+        let false_instrs = vec![ids.assign_var(1), ids.continue_(&loop_id)];
+        let if_instr = ids.if_var_is_zero(true_instrs, false_instrs);
+        let inner = ids.simple(vec![if_instr], None);
+        let ret_instrs = vec![ids.ret()];
+        let next = ids.simple(ret_instrs, None);
+        let loop_block = Block::Loop {
+            id: loop_id,
+            inner: Box::new(inner),
+            next: Some(Box::new(next)),
+        };
+        let entry_instrs = vec![ids.assign_var(0)];
+        let block = ids.simple(entry_instrs, Some(loop_block));
+
+        // 0: assign before the loop; 1: if; 2: break; 3: assign, continue; 4: ret.
+        // Jumps out of the loop body could go to either the start of the loop or after it.
+        let flowgraph = generate_flowgraph(&block);
+        assert_eq!(block_instr_counts(&flowgraph), vec![1, 1, 1, 2, 1]);
+        assert_edges(&flowgraph, &[&[1], &[2, 3], &[1, 4], &[1, 4], &[]]);
+    }
+}
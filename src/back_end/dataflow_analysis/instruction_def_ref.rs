@@ -90,6 +90,7 @@ pub fn ref_set(instr: &Instruction) -> HashSet<VarId> {
         | Instruction::LogicalNot(_, _, src)
         | Instruction::BrIfEq(_, _, src, _)
         | Instruction::BrIfNotEq(_, _, src, _)
+        | Instruction::BrTable(_, src, _, _)
         | Instruction::I8toI16(_, _, src)
         | Instruction::I8toU16(_, _, src)
         | Instruction::U8toI16(_, _, src)
@@ -133,7 +134,7 @@ pub fn ref_set(instr: &Instruction) -> HashSet<VarId> {
             Src::Constant(_) => {}
             Src::Fun(_) => {}
         },
-        Instruction::ReferenceVariable(_, var) => {
+        Instruction::ReferenceVariable(_, var) | Instruction::ZeroMemory(_, var, _) => {
             referenced_vars.insert(var.to_owned());
         }
         Instruction::StoreToAddress(_, src1, src2) => {
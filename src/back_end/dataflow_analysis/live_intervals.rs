@@ -0,0 +1,91 @@
+use crate::back_end::dataflow_analysis::clash_graph::get_address_taken_vars;
+use crate::back_end::dataflow_analysis::flowgraph::generate_flowgraph;
+use crate::back_end::dataflow_analysis::instruction_def_ref::def_set;
+use crate::back_end::dataflow_analysis::live_variable_analysis::live_variable_analysis;
+use crate::data_structures::id_map::IdMap;
+use crate::middle_end::ids::VarId;
+use crate::relooper::blocks::Block;
+
+/// The range of instrs that a var is live or defined in, numbering the instrs in the order of
+/// the flowgraph blocks. Both ends are inclusive.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct LiveInterval {
+    pub start: usize,
+    pub end: usize,
+}
+
+impl LiveInterval {
+    fn extend_to(&mut self, instr_i: usize) {
+        self.start = self.start.min(instr_i);
+        self.end = self.end.max(instr_i);
+    }
+}
+
+pub struct LiveIntervals {
+    intervals: IdMap<VarId, LiveInterval>,
+    // the interval covering every instr
+    whole_function: LiveInterval,
+}
+
+impl LiveIntervals {
+    /// Vars that don't appear in any instrs are treated as live everywhere, to be safe
+    pub fn get_interval(&self, var: &VarId) -> LiveInterval {
+        self.intervals
+            .get(var)
+            .unwrap_or(&self.whole_function)
+            .to_owned()
+    }
+}
+
+/// Find the live interval of every var. If two vars are live at the same time, that point is
+/// in both their intervals, so vars whose intervals don't overlap can share a location.
+///
+/// Vars whose address is taken could be accessed through a pointer at any point, so their
+/// interval is the whole function.
+pub fn find_live_intervals(block: &Block) -> LiveIntervals {
+    let flowgraph = generate_flowgraph(block);
+    let live_vars = live_variable_analysis(&flowgraph);
+    let vars = live_vars.get_vars();
+
+    let mut var_intervals: Vec<Option<LiveInterval>> = vec![None; vars.len()];
+    let mut extend_interval = |var_i: usize, instr_i: usize| match &mut var_intervals[var_i] {
+        Some(interval) => interval.extend_to(instr_i),
+        None => {
+            var_intervals[var_i] = Some(LiveInterval {
+                start: instr_i,
+                end: instr_i,
+            })
+        }
+    };
+    let mut instr_count = 0;
+    for (block_i, flowgraph_block) in flowgraph.blocks.iter().enumerate() {
+        for (instr_i, instr) in flowgraph_block.instrs.iter().enumerate() {
+            for var_i in live_vars.get_live_var_set(block_i, instr_i).iter() {
+                extend_interval(var_i, instr_count);
+            }
+            // a var that is defined but never used still gets written to
+            for def_var in def_set(instr) {
+                extend_interval(live_vars.get_var_index(&def_var).unwrap(), instr_count);
+            }
+            instr_count += 1;
+        }
+    }
+
+    let whole_function = LiveInterval {
+        start: 0,
+        end: instr_count,
+    };
+    let mut intervals: IdMap<VarId, LiveInterval> = vars
+        .iter()
+        .zip(var_intervals)
+        .filter_map(|(var, interval)| interval.map(|interval| (var.to_owned(), interval)))
+        .collect();
+    for var in get_address_taken_vars(&flowgraph) {
+        intervals.insert(var, whole_function.to_owned());
+    }
+
+    LiveIntervals {
+        intervals,
+        whole_function,
+    }
+}
@@ -1,50 +1,206 @@
-use std::collections::{HashMap, HashSet};
+#[cfg(test)]
+#[path = "live_variable_analysis_tests.rs"]
+mod live_variable_analysis_tests;
+
+use std::collections::VecDeque;
 
 use crate::back_end::dataflow_analysis::flowgraph::Flowgraph;
 use crate::back_end::dataflow_analysis::instruction_def_ref::{def_set, ref_set};
-use crate::middle_end::ids::{InstructionId, VarId};
+use crate::data_structures::bit_set::BitSet;
+use crate::data_structures::id_map::IdMap;
+use crate::middle_end::ids::VarId;
+
+/// For every instr, which vars are live at the start of it. Vars are given dense indices, so
+/// that the sets of live vars can be stored as bit sets. Instrs are indexed by their flowgraph
+/// block and their position in the block.
+pub struct LiveVariableMap {
+    var_indices: IdMap<VarId, usize>,
+    vars: Vec<VarId>,
+    live_vars: Vec<Vec<BitSet>>,
+    block_live_out: Vec<BitSet>,
+}
 
-pub type LiveVariableMap = HashMap<InstructionId, HashSet<VarId>>;
+impl LiveVariableMap {
+    /// Every var that is defined or used, in the order of their indices
+    pub fn get_vars(&self) -> &[VarId] {
+        &self.vars
+    }
+
+    /// The index of the var in the live var sets, if it's defined or used
+    pub fn get_var_index(&self, var: &VarId) -> Option<usize> {
+        self.var_indices.get(var).copied()
+    }
+
+    pub fn get_live_var_set(&self, block_i: usize, instr_i: usize) -> &BitSet {
+        &self.live_vars[block_i][instr_i]
+    }
+
+    pub fn get_live_vars(&self, block_i: usize, instr_i: usize) -> Vec<&VarId> {
+        self.live_vars[block_i][instr_i]
+            .iter()
+            .map(|var_i| &self.vars[var_i])
+            .collect()
+    }
+
+    /// Whether the var is live at any of the successors of the instr
+    pub fn is_var_live_after(&self, block_i: usize, instr_i: usize, var: &VarId) -> bool {
+        let var_i = match self.var_indices.get(var) {
+            Some(var_i) => *var_i,
+            None => return false,
+        };
+        match self.live_vars[block_i].get(instr_i + 1) {
+            Some(live) => live.contains(var_i),
+            None => self.block_live_out[block_i].contains(var_i),
+        }
+    }
+}
+
+/// The vars that are used in a flowgraph block before being defined, and the vars that are
+/// defined in it
+struct BlockUsesAndDefs {
+    uses: BitSet,
+    defs: BitSet,
+}
 
 pub fn live_variable_analysis(flowgraph: &Flowgraph) -> LiveVariableMap {
-    // for every instr, which vars are live at that point
-    let mut live: LiveVariableMap = LiveVariableMap::new();
-
-    let mut changes = true;
-    while changes {
-        changes = false;
-
-        for (instr_id, instr) in &flowgraph.instrs {
-            // U_{s in succ} live(s)
-            let mut out_live: HashSet<VarId> = HashSet::new();
-            for successor in flowgraph.successors.get(instr_id).unwrap() {
-                out_live.extend(live.get(successor).unwrap_or(&HashSet::new()).to_owned());
+    // the def and ref sets of each instr, only computed once
+    let mut var_indices: IdMap<VarId, usize> = IdMap::new();
+    let mut vars: Vec<VarId> = Vec::new();
+    let mut get_var_index = |var: VarId| -> usize {
+        *var_indices.get_or_insert_with(var.to_owned(), || {
+            vars.push(var);
+            vars.len() - 1
+        })
+    };
+    let mut instr_defs: Vec<Vec<Vec<usize>>> = Vec::new();
+    let mut instr_refs: Vec<Vec<Vec<usize>>> = Vec::new();
+    for block in &flowgraph.blocks {
+        let mut block_defs = Vec::new();
+        let mut block_refs = Vec::new();
+        for instr in &block.instrs {
+            block_defs.push(def_set(instr).into_iter().map(&mut get_var_index).collect());
+            block_refs.push(ref_set(instr).into_iter().map(&mut get_var_index).collect());
+        }
+        instr_defs.push(block_defs);
+        instr_refs.push(block_refs);
+    }
+    let var_count = vars.len();
+    let block_count = flowgraph.blocks.len();
+
+    let mut blocks_uses_and_defs: Vec<BlockUsesAndDefs> = Vec::new();
+    for (block_defs, block_refs) in instr_defs.iter().zip(&instr_refs) {
+        let mut uses_and_defs = BlockUsesAndDefs {
+            uses: BitSet::new(var_count),
+            defs: BitSet::new(var_count),
+        };
+        // work backwards so that a var used after being defined in the block isn't a use
+        for (defs, refs) in block_defs.iter().zip(block_refs).rev() {
+            for def_var in defs {
+                uses_and_defs.uses.remove(*def_var);
+                uses_and_defs.defs.insert(*def_var);
             }
+            for ref_var in refs {
+                uses_and_defs.uses.insert(*ref_var);
+            }
+        }
+        blocks_uses_and_defs.push(uses_and_defs);
+    }
+
+    // liveness flows backwards, so visit the blocks in reverse postorder of the reversed
+    // flowgraph, so that a block is usually visited after its successors
+    let block_order = reverse_postorder_of_reversed_graph(flowgraph);
+    let mut live_in: Vec<BitSet> = vec![BitSet::new(var_count); block_count];
+    let mut live_out: Vec<BitSet> = vec![BitSet::new(var_count); block_count];
+    let mut worklist: VecDeque<usize> = VecDeque::from(block_order);
+    let mut is_in_worklist = vec![true; block_count];
+
+    while let Some(block_i) = worklist.pop_front() {
+        is_in_worklist[block_i] = false;
+        let block = &flowgraph.blocks[block_i];
+        let uses_and_defs = &blocks_uses_and_defs[block_i];
+
+        // U_{s in succ} live_in(s)
+        let mut out_live = BitSet::new(var_count);
+        for successor in &block.successors {
+            out_live.union_with(&live_in[*successor]);
+        }
 
-            // \ def(n)
-            for def_var in def_set(instr) {
-                out_live.remove(&def_var);
+        // (live_out \ def(b)) U use(b)
+        let mut in_live = out_live.to_owned();
+        in_live.subtract(&uses_and_defs.defs);
+        in_live.union_with(&uses_and_defs.uses);
+        live_out[block_i] = out_live;
+
+        // live_in of a block can only grow, so it's changed if it has any new vars
+        if live_in[block_i].union_with(&in_live) {
+            for predecessor in &block.predecessors {
+                if !is_in_worklist[*predecessor] {
+                    is_in_worklist[*predecessor] = true;
+                    worklist.push_back(*predecessor);
+                }
             }
+        }
+    }
 
-            // U ref(n)
-            for ref_var in ref_set(instr) {
-                out_live.insert(ref_var);
+    // recompute the live vars at each instr within its block
+    let mut live_vars: Vec<Vec<BitSet>> = Vec::new();
+    for block_i in 0..block_count {
+        let mut live = live_out[block_i].to_owned();
+        let mut block_live_vars = Vec::new();
+        for (defs, refs) in instr_defs[block_i].iter().zip(&instr_refs[block_i]).rev() {
+            for def_var in defs {
+                live.remove(*def_var);
+            }
+            for ref_var in refs {
+                live.insert(*ref_var);
             }
+            block_live_vars.push(live.to_owned());
+        }
+        block_live_vars.reverse();
+        live_vars.push(block_live_vars);
+    }
 
-            let prev_live = live.insert(instr_id.to_owned(), out_live.to_owned());
+    LiveVariableMap {
+        var_indices,
+        vars,
+        live_vars,
+        block_live_out: live_out,
+    }
+}
 
-            match prev_live {
-                None => {
-                    changes = true;
-                }
-                Some(prev_live_vars) => {
-                    if prev_live_vars != out_live {
-                        changes = true
+/// Depth first search backwards along the edges, starting from the blocks with no successors.
+/// Blocks that can't reach an exit, such as those in an infinite loop, are added at the end.
+fn reverse_postorder_of_reversed_graph(flowgraph: &Flowgraph) -> Vec<usize> {
+    let blocks = &flowgraph.blocks;
+    let mut is_visited = vec![false; blocks.len()];
+    let mut postorder: Vec<usize> = Vec::new();
+
+    let exits = (0..blocks.len()).filter(|block_i| blocks[*block_i].successors.is_empty());
+    let others = (0..blocks.len()).filter(|block_i| !blocks[*block_i].successors.is_empty());
+    for root in exits.chain(others) {
+        if is_visited[root] {
+            continue;
+        }
+        is_visited[root] = true;
+        // stack of (block, index of the next predecessor to visit)
+        let mut stack: Vec<(usize, usize)> = vec![(root, 0)];
+        while let Some((block_i, next_predecessor)) = stack.last_mut() {
+            match blocks[*block_i].predecessors.get(*next_predecessor) {
+                Some(predecessor) => {
+                    *next_predecessor += 1;
+                    if !is_visited[*predecessor] {
+                        is_visited[*predecessor] = true;
+                        stack.push((*predecessor, 0));
                     }
                 }
+                None => {
+                    postorder.push(*block_i);
+                    stack.pop();
+                }
             }
         }
     }
 
-    live
+    postorder.reverse();
+    postorder
 }
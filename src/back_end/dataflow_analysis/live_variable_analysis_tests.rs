@@ -0,0 +1,217 @@
+#[cfg(test)]
+mod live_variable_analysis_tests {
+    use std::collections::HashSet;
+
+    use super::super::{live_variable_analysis, LiveVariableMap};
+    use crate::back_end::dataflow_analysis::flowgraph::generate_flowgraph;
+    use crate::id::IdGenerator;
+    use crate::middle_end::ids::{InstructionId, LabelId, VarId};
+    use crate::middle_end::instructions::{Constant, Instruction, Src};
+    use crate::relooper::blocks::{Block, Label, LoopBlockId};
+
+    struct Ids {
+        instrs: IdGenerator<InstructionId>,
+        labels: IdGenerator<LabelId>,
+        vars: IdGenerator<VarId>,
+    }
+
+    impl Ids {
+        fn new() -> Self {
+            Ids {
+                instrs: IdGenerator::new(),
+                labels: IdGenerator::new(),
+                vars: IdGenerator::new(),
+            }
+        }
+
+        fn assign_const(&mut self, dest: &VarId, n: i128) -> Instruction {
+            Instruction::SimpleAssignment(
+                self.instrs.new_id(),
+                dest.to_owned(),
+                Src::Constant(Constant::Int(n)),
+            )
+        }
+
+        fn add(&mut self, dest: &VarId, left: &VarId, right: &VarId) -> Instruction {
+            Instruction::Add(
+                self.instrs.new_id(),
+                dest.to_owned(),
+                Src::Var(left.to_owned()),
+                Src::Var(right.to_owned()),
+            )
+        }
+
+        fn if_eq(
+            &mut self,
+            left: &VarId,
+            right: &VarId,
+            true_instrs: Vec<Instruction>,
+            false_instrs: Vec<Instruction>,
+        ) -> Instruction {
+            Instruction::IfEqElse(
+                self.instrs.new_id(),
+                Src::Var(left.to_owned()),
+                Src::Var(right.to_owned()),
+                true_instrs,
+                false_instrs,
+            )
+        }
+
+        fn ret(&mut self, var: &VarId) -> Instruction {
+            Instruction::Ret(self.instrs.new_id(), Some(Src::Var(var.to_owned())))
+        }
+
+        fn simple(&mut self, instrs: Vec<Instruction>, next: Option<Block>) -> Block {
+            Block::Simple {
+                internal: Label {
+                    label: self.labels.new_id(),
+                    instrs,
+                },
+                next: next.map(Box::new),
+            }
+        }
+    }
+
+    fn assert_live_vars(
+        live_vars: &LiveVariableMap,
+        block_i: usize,
+        instr_i: usize,
+        expected: &[&VarId],
+    ) {
+        let live: HashSet<&VarId> = live_vars
+            .get_live_vars(block_i, instr_i)
+            .into_iter()
+            .collect();
+        let expected: HashSet<&VarId> = expected.iter().copied().collect();
+        assert_eq!(live, expected, "block {} instr {}", block_i, instr_i);
+    }
+
+    #[test]
+    fn var_is_live_between_def_and_last_use() {
+        let mut ids = Ids::new();
+        let x = ids.vars.new_id();
+        let y = ids.vars.new_id();
+        let instrs = vec![
+            ids.assign_const(&x, 1),
+            ids.add(&y, &x, &x),
+            ids.assign_const(&x, 2),
+            ids.ret(&y),
+        ];
+        let block = ids.simple(instrs, None);
+        let flowgraph = generate_flowgraph(&block);
+        let live_vars = live_variable_analysis(&flowgraph);
+
+        assert_live_vars(&live_vars, 0, 0, &[]);
+        assert_live_vars(&live_vars, 0, 1, &[&x]);
+        // x is redefined, but the new value is never used
+        assert_live_vars(&live_vars, 0, 2, &[&y]);
+        assert_live_vars(&live_vars, 0, 3, &[&y]);
+        assert!(!live_vars.is_var_live_after(0, 2, &x));
+        assert!(!live_vars.is_var_live_after(0, 3, &y));
+    }
+
+    #[test]
+    fn var_is_live_through_both_sides_of_diamond() {
+        let mut ids = Ids::new();
+        let x = ids.vars.new_id();
+        let y = ids.vars.new_id();
+        let z = ids.vars.new_id();
+        let true_instrs = vec![ids.assign_const(&y, 1)];
+        let false_instrs = vec![ids.assign_const(&y, 2)];
+        let if_instr = ids.if_eq(&x, &x, true_instrs, false_instrs);
+        let sum = ids.add(&x, &y, &z);
+        let ret = ids.ret(&x);
+        let instrs = vec![
+            ids.assign_const(&x, 0),
+            ids.assign_const(&z, 3),
+            if_instr,
+            sum,
+            ret,
+        ];
+        let block = ids.simple(instrs, None);
+
+        // 0: assign x, assign z, if; 1: true branch; 2: false branch; 3: add, ret
+        let flowgraph = generate_flowgraph(&block);
+        let live_vars = live_variable_analysis(&flowgraph);
+
+        assert_live_vars(&live_vars, 0, 0, &[]);
+        assert_live_vars(&live_vars, 0, 1, &[&x]);
+        // x is last used by the if, but z is used after the branches join
+        assert_live_vars(&live_vars, 0, 2, &[&x, &z]);
+        assert!(!live_vars.is_var_live_after(0, 2, &x));
+        assert!(live_vars.is_var_live_after(0, 2, &z));
+        for branch_block_i in [1, 2] {
+            assert_live_vars(&live_vars, branch_block_i, 0, &[&z]);
+            assert!(live_vars.is_var_live_after(branch_block_i, 0, &y));
+            assert!(live_vars.is_var_live_after(branch_block_i, 0, &z));
+        }
+        assert_live_vars(&live_vars, 3, 0, &[&y, &z]);
+        assert_live_vars(&live_vars, 3, 1, &[&x]);
+    }
+
+    #[test]
+    fn var_is_live_across_loop_back_edge() {
+        let mut ids = Ids::new();
+        let i = ids.vars.new_id();
+        let n = ids.vars.new_id();
+        let one = ids.vars.new_id();
+        let loop_id = IdGenerator::<LoopBlockId>::new().new_id();
+
+        // n = 10; i = 0; one = 1;
+        // loop { if i == n { break } else { i = i + one; continue } }
+        // return i
+        let true_instrs = vec![Instruction::Break(ids.instrs.new_id(), loop_id.to_owned())];
+        let false_instrs = vec![
+            ids.add(&i, &i, &one),
+            Instruction::Continue(ids.instrs.new_id(), loop_id.to_owned()),
+        ];
+        let if_instr = ids.if_eq(&i, &n, true_instrs, false_instrs);
+        let inner = ids.simple(vec![if_instr], None);
+        let ret_instrs = vec![ids.ret(&i)];
+        let next = ids.simple(ret_instrs, None);
+        let loop_block = Block::Loop {
+            id: loop_id,
+            inner: Box::new(inner),
+            next: Some(Box::new(next)),
+        };
+        let entry_instrs = vec![
+            ids.assign_const(&n, 10),
+            ids.assign_const(&i, 0),
+            ids.assign_const(&one, 1),
+        ];
+        let block = ids.simple(entry_instrs, Some(loop_block));
+
+        // 0: assignments; 1: if; 2: break; 3: add, continue; 4: ret
+        let flowgraph = generate_flowgraph(&block);
+        let live_vars = live_variable_analysis(&flowgraph);
+
+        assert_live_vars(&live_vars, 0, 0, &[]);
+        assert_live_vars(&live_vars, 0, 1, &[&n]);
+        assert_live_vars(&live_vars, 0, 2, &[&i, &n]);
+        assert_live_vars(&live_vars, 1, 0, &[&i, &n, &one]);
+        // n and one aren't used again in the body, but are still live on the way back round
+        assert_live_vars(&live_vars, 3, 1, &[&i, &n, &one]);
+        assert!(live_vars.is_var_live_after(3, 1, &n));
+        assert!(live_vars.is_var_live_after(3, 1, &one));
+        assert_live_vars(&live_vars, 4, 0, &[&i]);
+        assert!(!live_vars.is_var_live_after(4, 0, &i));
+    }
+
+    #[test]
+    fn vars_have_dense_indices() {
+        let mut ids = Ids::new();
+        let x = ids.vars.new_id();
+        let unused = ids.vars.new_id();
+        let y = ids.vars.new_id();
+        let instrs = vec![ids.assign_const(&x, 1), ids.add(&y, &x, &x), ids.ret(&y)];
+        let block = ids.simple(instrs, None);
+        let flowgraph = generate_flowgraph(&block);
+        let live_vars = live_variable_analysis(&flowgraph);
+
+        assert_eq!(live_vars.get_vars(), &[x.to_owned(), y.to_owned()]);
+        assert_eq!(live_vars.get_var_index(&x), Some(0));
+        assert_eq!(live_vars.get_var_index(&y), Some(1));
+        assert_eq!(live_vars.get_var_index(&unused), None);
+        assert!(!live_vars.is_var_live_after(0, 0, &unused));
+    }
+}
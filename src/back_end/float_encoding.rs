@@ -1,3 +1,8 @@
-pub fn encode_float(value: f64) -> Vec<u8> {
-    value.to_le_bytes().to_vec()
+pub fn write_float(value: f64, bytes: &mut Vec<u8>) {
+    bytes.extend_from_slice(&value.to_le_bytes());
+}
+
+/// f32 constants are encoded as 4 bytes, not 8
+pub fn write_f32(value: f32, bytes: &mut Vec<u8>) {
+    bytes.extend_from_slice(&value.to_le_bytes());
 }
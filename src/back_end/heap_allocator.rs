@@ -0,0 +1,482 @@
+use crate::back_end::calling_convention::get_native_function_type;
+use crate::back_end::memory_constants::{
+    HEAP_BLOCK_HEADER_SIZE, MAX_HEAP_SIZE_CLASS, MIN_HEAP_SIZE_CLASS, PTR_SIZE,
+};
+use crate::back_end::memory_operations::{grow_memory_to_fit, load_memory_end_addr};
+use crate::back_end::target_code_generation_context::{HeapAllocator, HeapTop, ModuleContext};
+use crate::back_end::threads::{acquire_lock, release_lock};
+use crate::back_end::wasm_indices::{LabelIdx, LocalIdx};
+use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmExpression, WasmInstruction};
+use crate::back_end::wasm_module::code_section::LocalDeclaration;
+use crate::back_end::wasm_module::exports_section::{ExportDescriptor, WasmExport};
+use crate::back_end::wasm_module::globals_section::WasmGlobal;
+use crate::back_end::wasm_module::module::WasmModule;
+use crate::back_end::wasm_module::types_section::WasmFunctionType;
+use crate::back_end::wasm_types::{GlobalType, NumType, ValType};
+use crate::middle_end::ids::FunId;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::program_config::program_constants::{
+    FREE_FUNCTION_NAME, HEAP_TOP_EXPORT_NAME, MALLOC_FUNCTION_NAME,
+};
+use crate::relooper::relooper::ReloopedFunction;
+
+// The heap starts at the end of the initial memory, above the stack, and grows upwards with
+// memory.grow. Every allocation is a block of a power of two bytes, starting with a header:
+//
+// 0-------4-----------8-------------------------------
+// | class | next free | payload...                    |
+// ----------------------------------------------------
+//
+// The header holds the block's size class, which is log2 of its size, so free() knows which
+// free list to put it back on. The next free block in the same class is only stored while
+// the block is free, so it overlaps the padding. Blocks are never split or merged, so a block
+// freed from one class can only be reused for an allocation in the same class.
+//
+// With threads, the top of the heap is kept in memory after the free lists, along with a
+// lock that malloc() and free() hold while they change the free lists or the top of the heap.
+
+/// The size of each free list head, which holds the address of the first free block in its
+/// size class, or 0 if the list is empty
+const FREE_LIST_HEAD_SIZE: u32 = PTR_SIZE;
+/// The offset of the next free block's address in a free block's header
+const NEXT_FREE_BLOCK_OFFSET: u32 = 4;
+
+/// Find the malloc() and free() declarations from stdlib.h. They're defined functions without
+/// a body, which the heap allocator generates the bodies of. They always use the native
+/// calling convention, even if native calls are disabled, because they're generated straight
+/// to wasm with their params in locals.
+pub fn find_heap_allocator_functions(
+    module_context: &mut ModuleContext,
+    defined_functions: &Vec<(FunId, ReloopedFunction)>,
+    prog_metadata: &ProgramMetadata,
+) {
+    let i32_type = ValType::NumType(NumType::I32);
+    let mut find_function = |name: &str, expected_type: WasmFunctionType| {
+        let fun_id = prog_metadata.function_ids.get(name)?;
+        let (_, function) = defined_functions
+            .iter()
+            .find(|(defined_fun_id, _)| defined_fun_id == fun_id)?;
+        // if the program defines its own function with the same name, that's used instead
+        if function.block.is_some()
+            || get_native_function_type(&function.type_info) != Some(expected_type)
+        {
+            return None;
+        }
+        module_context.native_call_fun_ids.insert(fun_id.to_owned());
+        Some(fun_id.to_owned())
+    };
+
+    // void *malloc(size_t size)
+    let malloc_fun_id = find_function(
+        MALLOC_FUNCTION_NAME,
+        WasmFunctionType {
+            param_types: vec![i32_type.to_owned()],
+            result_types: vec![i32_type.to_owned()],
+        },
+    );
+    // void free(void *ptr)
+    let free_fun_id = find_function(
+        FREE_FUNCTION_NAME,
+        WasmFunctionType {
+            param_types: vec![i32_type],
+            result_types: Vec::new(),
+        },
+    );
+
+    if malloc_fun_id.is_some() || free_fun_id.is_some() {
+        module_context.heap_allocator = Some(HeapAllocator {
+            malloc_fun_id,
+            free_fun_id,
+            free_lists_start_addr: 0,
+            heap_top: None,
+        });
+    }
+}
+
+/// Reserve the free list heads at start_addr, and the lock and the top of the heap after
+/// them if there are threads. Returns the address after them.
+pub fn initialise_heap_free_lists(module_context: &mut ModuleContext, start_addr: u32) -> u32 {
+    let has_threads = module_context.threads.is_some();
+    let heap_allocator = match &mut module_context.heap_allocator {
+        Some(heap_allocator) => heap_allocator,
+        None => return start_addr,
+    };
+    heap_allocator.free_lists_start_addr = start_addr;
+    let free_lists_end = get_free_lists_end(start_addr);
+    match has_threads {
+        true => free_lists_end + 2 * PTR_SIZE,
+        false => free_lists_end,
+    }
+}
+
+fn get_free_lists_end(free_lists_start_addr: u32) -> u32 {
+    let size_class_count = MAX_HEAP_SIZE_CLASS - MIN_HEAP_SIZE_CLASS + 1;
+    free_lists_start_addr + size_class_count * FREE_LIST_HEAD_SIZE
+}
+
+/// Create the global holding the top of the heap, which starts at heap_start_addr. It's
+/// exported so the JS runtime can reset the heap when it reuses an instance. With threads,
+/// the top of the heap is in memory after the lock instead, so every thread uses the same.
+pub fn initialise_heap_top(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    heap_start_addr: u32,
+) {
+    let has_threads = module_context.threads.is_some();
+    if let Some(heap_allocator) = &mut module_context.heap_allocator {
+        if has_threads {
+            let lock_addr = get_free_lists_end(heap_allocator.free_lists_start_addr);
+            heap_allocator.heap_top = Some(HeapTop::Shared {
+                addr: lock_addr + PTR_SIZE,
+                lock_addr,
+                heap_start_addr,
+            });
+            return;
+        }
+        let heap_top = wasm_module.insert_global(WasmGlobal {
+            global_type: GlobalType {
+                value_type: ValType::NumType(NumType::I32),
+                is_mutable: true,
+            },
+            init_expr: WasmExpression {
+                instrs: vec![WasmInstruction::I32Const {
+                    n: heap_start_addr as i32,
+                }],
+            },
+        });
+        wasm_module.exports_section.exports.push(WasmExport {
+            name: HEAP_TOP_EXPORT_NAME.to_owned(),
+            export_descriptor: ExportDescriptor::Global {
+                global_idx: heap_top.to_owned(),
+            },
+        });
+        heap_allocator.heap_top = Some(HeapTop::Global(heap_top));
+    }
+}
+
+/// Generate the body of malloc() or free(), if the function is one of the heap allocator's.
+/// Returns the body, the declarations of its locals, and the names of its locals.
+pub fn generate_heap_allocator_function(
+    fun_id: &FunId,
+    module_context: &ModuleContext,
+) -> Option<(
+    WasmExpression,
+    Vec<LocalDeclaration>,
+    Vec<(LocalIdx, String)>,
+)> {
+    let heap_allocator = module_context.heap_allocator.as_ref()?;
+    let heap_top = heap_allocator.heap_top.as_ref().unwrap();
+
+    let (mut instrs, local_names) = if heap_allocator.malloc_fun_id.as_ref() == Some(fun_id) {
+        (
+            generate_malloc(heap_allocator.free_lists_start_addr, heap_top),
+            vec!["size", "class", "block", "free_list", "new_heap_top"],
+        )
+    } else if heap_allocator.free_fun_id.as_ref() == Some(fun_id) {
+        (
+            generate_free(heap_allocator.free_lists_start_addr),
+            vec!["ptr", "block", "free_list"],
+        )
+    } else {
+        return None;
+    };
+
+    // malloc() leaves its result on the wasm stack while the lock is released
+    if let HeapTop::Shared { lock_addr, .. } = heap_top {
+        let mut locked_instrs = Vec::new();
+        acquire_lock(*lock_addr, &mut locked_instrs);
+        locked_instrs.append(&mut instrs);
+        release_lock(*lock_addr, &mut locked_instrs);
+        instrs = locked_instrs;
+    }
+
+    // all the locals are i32s, and the first one is the param
+    let local_declarations = vec![LocalDeclaration {
+        count: local_names.len() as u32 - 1,
+        value_type: ValType::NumType(NumType::I32),
+    }];
+    let local_names = local_names
+        .into_iter()
+        .enumerate()
+        .map(|(x, name)| (LocalIdx { x: x as u32 }, name.to_owned()))
+        .collect();
+
+    Some((WasmExpression { instrs }, local_declarations, local_names))
+}
+
+/// void *malloc(size_t size)
+///
+/// Takes the first block off the free list for the size class, or if it's empty, a new block
+/// from the top of the heap, growing the memory if the block doesn't fit. Returns NULL if the
+/// size is too big for the largest size class, or the memory can't grow any more.
+fn generate_malloc(free_lists_start_addr: u32, heap_top: &HeapTop) -> Vec<WasmInstruction> {
+    let size = || LocalIdx { x: 0 };
+    let class = || LocalIdx { x: 1 };
+    let block = || LocalIdx { x: 2 };
+    let free_list = || LocalIdx { x: 3 };
+    let new_heap_top = || LocalIdx { x: 4 };
+
+    let mut alloc_instrs = Vec::new();
+
+    // the size would overflow the largest size class
+    alloc_instrs.push(WasmInstruction::LocalGet { local_idx: size() });
+    alloc_instrs.push(WasmInstruction::I32Const {
+        n: ((1 << MAX_HEAP_SIZE_CLASS) - HEAP_BLOCK_HEADER_SIZE) as i32,
+    });
+    alloc_instrs.push(WasmInstruction::I32GtU);
+    alloc_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx { l: 0 },
+    });
+
+    // class = ceil(log2(size + header)), which is 32 - clz(size + header - 1). Setting the
+    // low bits rounds it up to the smallest class
+    alloc_instrs.push(WasmInstruction::I32Const { n: 32 });
+    alloc_instrs.push(WasmInstruction::LocalGet { local_idx: size() });
+    alloc_instrs.push(WasmInstruction::I32Const {
+        n: (HEAP_BLOCK_HEADER_SIZE - 1) as i32,
+    });
+    alloc_instrs.push(WasmInstruction::I32Add);
+    alloc_instrs.push(WasmInstruction::I32Const {
+        n: (1 << MIN_HEAP_SIZE_CLASS) - 1,
+    });
+    alloc_instrs.push(WasmInstruction::I32Or);
+    alloc_instrs.push(WasmInstruction::I32Clz);
+    alloc_instrs.push(WasmInstruction::I32Sub);
+    alloc_instrs.push(WasmInstruction::LocalSet { local_idx: class() });
+
+    load_free_list_addr(class(), free_lists_start_addr, &mut alloc_instrs);
+    alloc_instrs.push(WasmInstruction::LocalTee {
+        local_idx: free_list(),
+    });
+
+    // block = first free block in the class
+    alloc_instrs.push(WasmInstruction::I32Load {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+    alloc_instrs.push(WasmInstruction::LocalTee { local_idx: block() });
+
+    // if there's a free block, take it off the free list
+    let mut reuse_block_instrs = Vec::new();
+    reuse_block_instrs.push(WasmInstruction::LocalGet {
+        local_idx: free_list(),
+    });
+    reuse_block_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    reuse_block_instrs.push(WasmInstruction::I32Load {
+        mem_arg: MemArg::natural(PTR_SIZE, NEXT_FREE_BLOCK_OFFSET),
+    });
+    reuse_block_instrs.push(WasmInstruction::I32Store {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+
+    // otherwise, take a new block from the top of the heap
+    let mut new_block_instrs = Vec::new();
+    load_heap_top(heap_top, &mut new_block_instrs);
+    new_block_instrs.push(WasmInstruction::LocalTee { local_idx: block() });
+    new_block_instrs.push(WasmInstruction::I32Const { n: 1 });
+    new_block_instrs.push(WasmInstruction::LocalGet { local_idx: class() });
+    new_block_instrs.push(WasmInstruction::I32Shl);
+    new_block_instrs.push(WasmInstruction::I32Add);
+    new_block_instrs.push(WasmInstruction::LocalTee {
+        local_idx: new_heap_top(),
+    });
+    // the block would go past the end of the 32-bit address space
+    new_block_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    new_block_instrs.push(WasmInstruction::I32LtU);
+    new_block_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx { l: 1 },
+    });
+
+    // grow the memory by enough pages for the block
+    let mut grow_memory_instrs = Vec::new();
+    grow_memory_to_fit(
+        vec![WasmInstruction::LocalGet {
+            local_idx: new_heap_top(),
+        }],
+        &mut grow_memory_instrs,
+    );
+    grow_memory_instrs.push(WasmInstruction::I32Const { n: -1 });
+    grow_memory_instrs.push(WasmInstruction::I32Eq);
+    grow_memory_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx { l: 2 },
+    });
+
+    // if the block ends past the end of memory
+    new_block_instrs.push(WasmInstruction::LocalGet {
+        local_idx: new_heap_top(),
+    });
+    load_memory_end_addr(&mut new_block_instrs);
+    new_block_instrs.push(WasmInstruction::I32GtU);
+    new_block_instrs.push(WasmInstruction::IfElse {
+        blocktype: BlockType::None,
+        if_instrs: grow_memory_instrs,
+        else_instrs: Vec::new(),
+    });
+
+    store_heap_top(
+        heap_top,
+        WasmInstruction::LocalGet {
+            local_idx: new_heap_top(),
+        },
+        &mut new_block_instrs,
+    );
+    // store the size class in the block header
+    new_block_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    new_block_instrs.push(WasmInstruction::LocalGet { local_idx: class() });
+    new_block_instrs.push(WasmInstruction::I32Store {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+
+    alloc_instrs.push(WasmInstruction::IfElse {
+        blocktype: BlockType::None,
+        if_instrs: reuse_block_instrs,
+        else_instrs: new_block_instrs,
+    });
+
+    // return a pointer to the payload, after the header
+    alloc_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    alloc_instrs.push(WasmInstruction::I32Const {
+        n: HEAP_BLOCK_HEADER_SIZE as i32,
+    });
+    alloc_instrs.push(WasmInstruction::I32Add);
+    alloc_instrs.push(WasmInstruction::Br {
+        label_idx: LabelIdx { l: 1 },
+    });
+
+    // the allocation instructions branch out of the inner block if it fails, and NULL is
+    // the result. The result is left on the wasm stack rather than returned, so the lock
+    // can be released after it with threads
+    vec![WasmInstruction::Block {
+        blocktype: BlockType::ValType(ValType::NumType(NumType::I32)),
+        instrs: vec![
+            WasmInstruction::Block {
+                blocktype: BlockType::None,
+                instrs: alloc_instrs,
+            },
+            WasmInstruction::I32Const { n: 0 },
+        ],
+    }]
+}
+
+fn load_heap_top(heap_top: &HeapTop, wasm_instrs: &mut Vec<WasmInstruction>) {
+    match heap_top {
+        HeapTop::Global(global_idx) => wasm_instrs.push(WasmInstruction::GlobalGet {
+            global_idx: global_idx.to_owned(),
+        }),
+        HeapTop::Shared { addr, .. } => {
+            wasm_instrs.push(WasmInstruction::I32Const { n: *addr as i32 });
+            wasm_instrs.push(WasmInstruction::I32Load {
+                mem_arg: MemArg::natural(PTR_SIZE, 0),
+            });
+        }
+    }
+}
+
+fn store_heap_top(
+    heap_top: &HeapTop,
+    value_instr: WasmInstruction,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
+    match heap_top {
+        HeapTop::Global(global_idx) => {
+            wasm_instrs.push(value_instr);
+            wasm_instrs.push(WasmInstruction::GlobalSet {
+                global_idx: global_idx.to_owned(),
+            });
+        }
+        HeapTop::Shared { addr, .. } => {
+            wasm_instrs.push(WasmInstruction::I32Const { n: *addr as i32 });
+            wasm_instrs.push(value_instr);
+            wasm_instrs.push(WasmInstruction::I32Store {
+                mem_arg: MemArg::natural(PTR_SIZE, 0),
+            });
+        }
+    }
+}
+
+/// void free(void *ptr)
+///
+/// Pushes the block onto the front of the free list for its size class. Freeing NULL does
+/// nothing.
+fn generate_free(free_lists_start_addr: u32) -> Vec<WasmInstruction> {
+    let ptr = || LocalIdx { x: 0 };
+    let block = || LocalIdx { x: 1 };
+    let free_list = || LocalIdx { x: 2 };
+
+    let mut free_instrs = Vec::new();
+
+    free_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+    free_instrs.push(WasmInstruction::I32Eqz);
+    free_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx { l: 0 },
+    });
+
+    // the block starts at the header before the payload
+    free_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+    free_instrs.push(WasmInstruction::I32Const {
+        n: HEAP_BLOCK_HEADER_SIZE as i32,
+    });
+    free_instrs.push(WasmInstruction::I32Sub);
+    free_instrs.push(WasmInstruction::LocalSet { local_idx: block() });
+
+    // load the size class from the header. The free list local holds the class until it's
+    // replaced by the address of the class's free list
+    free_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    free_instrs.push(WasmInstruction::I32Load {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+    free_instrs.push(WasmInstruction::LocalSet {
+        local_idx: free_list(),
+    });
+    load_free_list_addr(free_list(), free_lists_start_addr, &mut free_instrs);
+    free_instrs.push(WasmInstruction::LocalSet {
+        local_idx: free_list(),
+    });
+
+    // the block's next free block is the current first free block
+    free_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    free_instrs.push(WasmInstruction::LocalGet {
+        local_idx: free_list(),
+    });
+    free_instrs.push(WasmInstruction::I32Load {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+    free_instrs.push(WasmInstruction::I32Store {
+        mem_arg: MemArg::natural(PTR_SIZE, NEXT_FREE_BLOCK_OFFSET),
+    });
+
+    // and the block becomes the first free block
+    free_instrs.push(WasmInstruction::LocalGet {
+        local_idx: free_list(),
+    });
+    free_instrs.push(WasmInstruction::LocalGet { local_idx: block() });
+    free_instrs.push(WasmInstruction::I32Store {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+
+    vec![WasmInstruction::Block {
+        blocktype: BlockType::None,
+        instrs: free_instrs,
+    }]
+}
+
+/// Load the address of the free list head for the size class in the local
+fn load_free_list_addr(
+    class: LocalIdx,
+    free_lists_start_addr: u32,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
+    // start addr + (class - min class) * head size
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx: class });
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: MIN_HEAP_SIZE_CLASS as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Sub);
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: FREE_LIST_HEAD_SIZE.trailing_zeros() as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Shl);
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: free_lists_start_addr as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Add);
+}
@@ -1,61 +1,184 @@
+use std::collections::HashMap;
+
 use log::info;
 
-use crate::back_end::memory_constants::{PTR_SIZE, STACK_PTR_ADDR};
-use crate::back_end::target_code_generation_context::ModuleContext;
+use crate::back_end::heap_allocator::{initialise_heap_free_lists, initialise_heap_top};
+use crate::back_end::memory_constants::{
+    PROFILE_COUNTER_SIZE, PTR_SIZE, STACK_FRAME_ALIGNMENT, STACK_PTR_ADDR, WASM_PAGE_SIZE,
+};
+use crate::back_end::profiler::{
+    initialise_block_counters, initialise_call_counters, initialise_stack_ptr_log_buffer,
+};
+use crate::back_end::stack_allocation::allocate_vars::VariableAllocationMap;
+use crate::back_end::static_initialisers::{
+    evaluate_static_initialisers, STATIC_ALLOCATION_ALIGNMENT,
+};
+use crate::back_end::target_code_generation_context::{ModuleContext, StackPtrGlobals};
+use crate::back_end::threads::{get_thread_stack_size, initialise_thread_stacks};
+use crate::back_end::wasm_indices::{DataIdx, WasmIdx};
 use crate::back_end::wasm_instructions::{WasmExpression, WasmInstruction};
+use crate::back_end::wasm_module::custom_section::CustomSection;
 use crate::back_end::wasm_module::data_section::DataSegment;
+use crate::back_end::wasm_module::exports_section::{ExportDescriptor, WasmExport};
+use crate::back_end::wasm_module::globals_section::WasmGlobal;
 use crate::back_end::wasm_module::imports_section::{ImportDescriptor, WasmImport};
 use crate::back_end::wasm_module::module::WasmModule;
-use crate::back_end::wasm_types::{Limits, MemoryType};
+use crate::back_end::wasm_types::{GlobalType, Limits, MemoryType, NumType, ValType};
+use crate::data_structures::id_map::IdMap;
+use crate::middle_end::ids::StringLiteralId;
 use crate::middle_end::ir::ProgramMetadata;
+use crate::program_config::memory_limits::MemoryLimits;
 use crate::program_config::program_constants::{
-    MEMORY_IMPORT_FIELD_NAME, MEMORY_IMPORT_MODULE_NAME,
+    FRAME_PTR_EXPORT_NAME, MEMORY_IMPORT_FIELD_NAME, MEMORY_IMPORT_MODULE_NAME,
+    MEMORY_LIMITS_SECTION_NAME, STACK_LIMIT_EXPORT_NAME, STACK_PTR_EXPORT_NAME,
 };
+use crate::relooper::blocks::Block;
 
+/// Lay out the static memory and initialise it with a data segment. Returns the addrs of the
+/// global vars.
 pub fn initialise_memory(
     wasm_module: &mut WasmModule,
     module_context: &mut ModuleContext,
     prog_metadata: &ProgramMetadata,
-) -> u32 {
-    // ----------------------------------------------------------
-    // | FP | temp FP | SP | String literals | ...stack frames...
-    // ----------------------------------------------------------
+    global_block: Option<&mut Block>,
+    max_stack_size_estimate: u32,
+    thread_stack_size_estimate: u32,
+    memory_limits: &MemoryLimits,
+) -> VariableAllocationMap {
+    // -----------------------------------------------------------------------------------------------------------------------------------------------------------
+    // | FP | temp FP | SP | String literals | (stack ptr log) | (call counters) | (block counters) | (heap free lists) | global vars | ...stack frames... | heap...
+    // -----------------------------------------------------------------------------------------------------------------------------------------------------------
+    // The initial memory has room for the stack size that the compiler estimates, and the heap
+    // starts at the end of it. If there's no heap, memory grows as the stack does. With
+    // threads, the threads' stacks are between the main stack and the heap.
     // initialise with placeholder values for frame ptr and stack ptr
     let mut data: Vec<u8> = vec![0x00; (3 * PTR_SIZE) as usize];
 
-    // store string literals in memory
-    for (string_literal_id, string) in &prog_metadata.string_literals {
-        // store the pointer to the string
-        let ptr_to_string = data.len();
-        info!(
-            "Storing string literal {:?} at addr {}",
-            string, ptr_to_string
+    store_string_literals(&mut data, module_context, prog_metadata);
+
+    // reserve the profiler's buffers after the string literals. They start zeroed, so they
+    // don't need to be in the data segment
+    let mut stack_ptr_value = data.len();
+    if module_context
+        .enabled_profiling
+        .is_stack_ptr_logging_enabled()
+    {
+        let buffer_start = stack_ptr_value.next_multiple_of(PTR_SIZE as usize);
+        stack_ptr_value =
+            initialise_stack_ptr_log_buffer(wasm_module, module_context, buffer_start as u32)
+                as usize;
+    }
+    // the call and block counters are i64s, so they're aligned to their size
+    if module_context.enabled_profiling.is_call_counting_enabled() {
+        let counters_start = stack_ptr_value.next_multiple_of(PROFILE_COUNTER_SIZE as usize);
+        stack_ptr_value = initialise_call_counters(
+            wasm_module,
+            module_context,
+            prog_metadata,
+            counters_start as u32,
+        ) as usize;
+    }
+    if module_context.enabled_profiling.is_block_counting_enabled() {
+        let counters_start = stack_ptr_value.next_multiple_of(PROFILE_COUNTER_SIZE as usize);
+        stack_ptr_value = initialise_block_counters(
+            wasm_module,
+            module_context,
+            prog_metadata,
+            counters_start as u32,
+        ) as usize;
+    }
+
+    if module_context.heap_allocator.is_some() {
+        let free_lists_start = stack_ptr_value.next_multiple_of(PTR_SIZE as usize);
+        stack_ptr_value =
+            initialise_heap_free_lists(module_context, free_lists_start as u32) as usize;
+    }
+
+    // the global vars are in static memory, initialised with as much of the global
+    // instructions as could be evaluated at compile time
+    let mut global_var_addrs = IdMap::new();
+    let mut globals_data_segment = None;
+    if let Some(global_block) = global_block {
+        let globals_start = stack_ptr_value.next_multiple_of(STATIC_ALLOCATION_ALIGNMENT as usize);
+        let (var_addrs, mut globals_data) = evaluate_static_initialisers(
+            global_block,
+            globals_start as u32,
+            module_context,
+            prog_metadata,
         );
-        module_context
-            .string_literal_id_to_ptr_map
-            .insert(string_literal_id.to_owned(), ptr_to_string as u32);
-        // insert the string
-        data.append(&mut string.as_bytes().to_vec());
-        // null terminate the string
-        data.push(0x00);
+        global_var_addrs = var_addrs;
+        stack_ptr_value = globals_start + globals_data.len();
+
+        // memory starts zeroed, so trailing zeros don't need to be in the data segment
+        let initialised_len = globals_data
+            .iter()
+            .rposition(|byte| *byte != 0x00)
+            .map_or(0, |last_byte| last_byte + 1);
+        globals_data.truncate(initialised_len);
+        if !globals_data.is_empty() {
+            // a separate segment, so the profiler's buffers between the string literals and
+            // the globals aren't stored in the module
+            globals_data_segment = Some((globals_start as u32, globals_data));
+        }
     }
 
+    // the stack frames are kept aligned from the first one
+    stack_ptr_value = stack_ptr_value.next_multiple_of(STACK_FRAME_ALIGNMENT as usize);
+
+    let mut stack_end = (stack_ptr_value as u64 + max_stack_size_estimate as u64)
+        .next_multiple_of(WASM_PAGE_SIZE as u64);
+    // with threads, the main stack can't grow into the threads' stacks after it
+    let main_stack_end = match module_context.threads {
+        Some(_) => {
+            let main_stack_end = (stack_ptr_value as u64
+                + get_thread_stack_size(max_stack_size_estimate) as u64)
+                .next_multiple_of(WASM_PAGE_SIZE as u64) as u32;
+            stack_end = initialise_thread_stacks(
+                wasm_module,
+                module_context,
+                main_stack_end,
+                thread_stack_size_estimate,
+            );
+            Some(main_stack_end)
+        }
+        None => None,
+    };
+    let initial_pages =
+        memory_limits.initial_pages((stack_end / WASM_PAGE_SIZE as u64).max(1) as u32);
+    // the end of a full 4 GiB memory doesn't fit in an i32, but no address is past it anyway
+    let initial_memory_end =
+        (initial_pages as u64 * WASM_PAGE_SIZE as u64).min(u32::MAX as u64) as u32;
+    info!(
+        "Estimated max stack size {} bytes, starting with {} pages of memory",
+        max_stack_size_estimate, initial_pages
+    );
+    initialise_stack_limit(
+        wasm_module,
+        module_context,
+        main_stack_end.unwrap_or(initial_memory_end),
+    );
+    initialise_heap_top(wasm_module, module_context, initial_memory_end);
+
     // set stack ptr to point at top of stack
-    let stack_ptr_value = data.len();
     info!("Setting stack ptr to {}", stack_ptr_value);
-    data[STACK_PTR_ADDR as usize] = (stack_ptr_value & 0xFF) as u8;
-    data[(STACK_PTR_ADDR + 1) as usize] = ((stack_ptr_value >> 8) & 0xFF) as u8;
-    data[(STACK_PTR_ADDR + 2) as usize] = ((stack_ptr_value >> 16) & 0xFF) as u8;
-    data[(STACK_PTR_ADDR + 3) as usize] = ((stack_ptr_value >> 24) & 0xFF) as u8;
-
-    // insert data segment to module
-    let data_segment = DataSegment::ActiveSegmentMemIndexZero {
-        offset_expr: WasmExpression {
-            instrs: vec![WasmInstruction::I32Const { n: 0 }],
-        },
-        data,
-    };
-    wasm_module.data_section.data_segments.push(data_segment);
+    if module_context
+        .enabled_optimisations
+        .is_global_stack_ptrs_enabled()
+    {
+        // the placeholders in memory are left unused
+        initialise_stack_ptr_globals(wasm_module, module_context, stack_ptr_value as u32);
+    } else {
+        data[STACK_PTR_ADDR as usize] = (stack_ptr_value & 0xFF) as u8;
+        data[(STACK_PTR_ADDR + 1) as usize] = ((stack_ptr_value >> 8) & 0xFF) as u8;
+        data[(STACK_PTR_ADDR + 2) as usize] = ((stack_ptr_value >> 16) & 0xFF) as u8;
+        data[(STACK_PTR_ADDR + 3) as usize] = ((stack_ptr_value >> 24) & 0xFF) as u8;
+    }
+
+    // insert data segments to module
+    insert_data_segment(wasm_module, module_context, 0, data);
+    if let Some((globals_start, globals_data)) = globals_data_segment {
+        insert_data_segment(wasm_module, module_context, globals_start, globals_data);
+    }
 
     // import memory from JS runtime
     let memory_import = WasmImport {
@@ -63,11 +186,194 @@ pub fn initialise_memory(
         field_name: MEMORY_IMPORT_FIELD_NAME.to_owned(),
         import_descriptor: ImportDescriptor::Mem {
             mem_type: MemoryType {
-                limits: Limits { min: 1, max: None },
+                limits: Limits {
+                    min: initial_pages,
+                    max: memory_limits.max_pages(),
+                },
+                is_shared: memory_limits.is_shared(),
             },
         },
     };
     wasm_module.imports_section.imports.push(memory_import);
 
-    stack_ptr_value as u32
+    // the JS runtime creates the memory, so it needs to know the limits
+    let mut limits_text = match memory_limits.max_pages() {
+        Some(max_pages) => format!("{initial_pages} {max_pages}"),
+        None => format!("{initial_pages}"),
+    };
+    if memory_limits.is_shared() {
+        limits_text.push_str(" shared");
+    }
+    wasm_module.custom_sections.push(CustomSection {
+        name: MEMORY_LIMITS_SECTION_NAME.to_owned(),
+        contents: limits_text.into_bytes(),
+    });
+
+    global_var_addrs
+}
+
+/// Insert a data segment that initialises the memory at addr. With threads, it's passive,
+/// and copied into memory when the main thread starts.
+fn insert_data_segment(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    addr: u32,
+    data: Vec<u8>,
+) {
+    let data_segments = &mut wasm_module.data_section.data_segments;
+    match &mut module_context.threads {
+        Some(threads) => {
+            let mut data_idx = DataIdx::initial_idx();
+            for _ in 0..data_segments.len() {
+                data_idx = data_idx.next_idx();
+            }
+            threads
+                .data_segments
+                .push((data_idx, addr, data.len() as u32));
+            data_segments.push(DataSegment::PassiveSegment { data });
+        }
+        None => data_segments.push(DataSegment::ActiveSegmentMemIndexZero {
+            offset_expr: WasmExpression {
+                instrs: vec![WasmInstruction::I32Const { n: addr as i32 }],
+            },
+            data,
+        }),
+    }
+}
+
+/// Append the string literals to data, in the order they first appear in the program, so the
+/// layout is the same on every compile. A literal that's the end of a longer one points into
+/// the longer one, rather than being stored again.
+fn store_string_literals(
+    data: &mut Vec<u8>,
+    module_context: &mut ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    // sorted by their reversed bytes, a literal is followed by the literals that end with
+    // it, so going backwards, each literal only needs comparing with the one before
+    let mut sorted_literals: Vec<_> = prog_metadata.string_literals.iter().collect();
+    sorted_literals.sort_by(|(_, a), (_, b)| a.bytes().rev().cmp(b.bytes().rev()));
+    let mut containing_literals = HashMap::new();
+    let mut prev_literal: Option<(&StringLiteralId, &String)> = None;
+    for (string_literal_id, string) in sorted_literals.into_iter().rev() {
+        if let Some((prev_id, prev_string)) = prev_literal {
+            if prev_string.ends_with(string.as_str()) {
+                // the literal before is either stored itself, or is the end of a stored one
+                let containing_literal = containing_literals
+                    .get(prev_id)
+                    .copied()
+                    .unwrap_or((prev_id, prev_string));
+                containing_literals.insert(string_literal_id, containing_literal);
+            }
+        }
+        prev_literal = Some((string_literal_id, string));
+    }
+
+    for (string_literal_id, string) in &prog_metadata.string_literals {
+        if containing_literals.contains_key(string_literal_id) {
+            continue;
+        }
+        let ptr_to_string = data.len() as u32;
+        info!(
+            "Storing string literal {:?} at addr {}",
+            string, ptr_to_string
+        );
+        module_context
+            .string_literal_id_to_ptr_map
+            .insert(string_literal_id.to_owned(), ptr_to_string);
+        data.extend_from_slice(string.as_bytes());
+        // null terminate the string
+        data.push(0x00);
+    }
+
+    for (string_literal_id, (containing_id, containing_string)) in containing_literals {
+        let containing_ptr = module_context.string_literal_id_to_ptr_map[containing_id];
+        let string_len = prog_metadata
+            .string_literals
+            .get(string_literal_id)
+            .unwrap()
+            .len();
+        let ptr_to_string = containing_ptr + (containing_string.len() - string_len) as u32;
+        module_context
+            .string_literal_id_to_ptr_map
+            .insert(string_literal_id.to_owned(), ptr_to_string);
+    }
+}
+
+/// Create the global holding the address the stack can grow up to without overflowing. It's
+/// the end of the initial memory, where the heap starts. With no heap, the stack can use all
+/// of the memory, so the limit is moved up when the stack grows the memory.
+///
+/// With threads, it's the end of the main stack, and it's exported so the JS runtime can set
+/// it to the end of each thread's stack.
+fn initialise_stack_limit(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    stack_limit: u32,
+) {
+    let has_threads = module_context.threads.is_some();
+    let global_idx = wasm_module.insert_global(WasmGlobal {
+        global_type: GlobalType {
+            value_type: ValType::NumType(NumType::I32),
+            is_mutable: module_context.heap_allocator.is_none() || has_threads,
+        },
+        init_expr: WasmExpression {
+            instrs: vec![WasmInstruction::I32Const {
+                n: stack_limit as i32,
+            }],
+        },
+    });
+    if has_threads {
+        wasm_module.exports_section.exports.push(WasmExport {
+            name: STACK_LIMIT_EXPORT_NAME.to_owned(),
+            export_descriptor: ExportDescriptor::Global {
+                global_idx: global_idx.to_owned(),
+            },
+        });
+    }
+    module_context.stack_limit = Some(global_idx);
+}
+
+/// Create mutable globals to hold the frame ptr, temp frame ptr and stack ptr, and export
+/// the frame ptr and stack ptr so the JS runtime can read them.
+fn initialise_stack_ptr_globals(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    stack_ptr_value: u32,
+) {
+    let mut new_ptr_global = |initial_value: u32| {
+        wasm_module.insert_global(WasmGlobal {
+            global_type: GlobalType {
+                value_type: ValType::NumType(NumType::I32),
+                is_mutable: true,
+            },
+            init_expr: WasmExpression {
+                instrs: vec![WasmInstruction::I32Const {
+                    n: initial_value as i32,
+                }],
+            },
+        })
+    };
+    let frame_ptr = new_ptr_global(0);
+    let temp_frame_ptr = new_ptr_global(0);
+    let stack_ptr = new_ptr_global(stack_ptr_value);
+
+    wasm_module.exports_section.exports.push(WasmExport {
+        name: FRAME_PTR_EXPORT_NAME.to_owned(),
+        export_descriptor: ExportDescriptor::Global {
+            global_idx: frame_ptr.to_owned(),
+        },
+    });
+    wasm_module.exports_section.exports.push(WasmExport {
+        name: STACK_PTR_EXPORT_NAME.to_owned(),
+        export_descriptor: ExportDescriptor::Global {
+            global_idx: stack_ptr.to_owned(),
+        },
+    });
+
+    module_context.stack_ptr_globals = Some(StackPtrGlobals {
+        frame_ptr,
+        temp_frame_ptr,
+        stack_ptr,
+    });
 }
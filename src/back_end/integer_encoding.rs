@@ -2,6 +2,115 @@
 #[path = "integer_encoding_tests.rs"]
 mod integer_encoding_tests;
 
+/// The most bytes that the LEB128 encoding of a 32 bit integer can take
+const MAX_32_BIT_BYTES: usize = 5;
+/// The most bytes that the LEB128 encoding of a 64 bit integer can take
+const MAX_64_BIT_BYTES: usize = 10;
+
+/// The LEB128 encoding of a fixed width integer, in a buffer that's big enough for any value
+/// of that width, so it can live on the stack
+pub struct FixedWidthEncoding<const N: usize> {
+    bytes: [u8; N],
+    len: usize,
+}
+
+impl<const N: usize> FixedWidthEncoding<N> {
+    pub fn as_slice(&self) -> &[u8] {
+        &self.bytes[..self.len]
+    }
+}
+
+pub const fn encode_u32(value: u32) -> FixedWidthEncoding<MAX_32_BIT_BYTES> {
+    encode_fixed_width_unsigned(value as u64)
+}
+
+pub const fn encode_i32(value: i32) -> FixedWidthEncoding<MAX_32_BIT_BYTES> {
+    encode_fixed_width_signed(value as i64)
+}
+
+pub const fn encode_i64(value: i64) -> FixedWidthEncoding<MAX_64_BIT_BYTES> {
+    encode_fixed_width_signed(value)
+}
+
+/// Append the unsigned LEB128 encoding of the value to the buffer
+pub fn write_u32(value: u32, bytes: &mut Vec<u8>) {
+    // most indices, lengths and opcodes fit in a single byte
+    if value < 0x80 {
+        bytes.push(value as u8);
+        return;
+    }
+    bytes.extend_from_slice(encode_u32(value).as_slice());
+}
+
+/// Append the signed LEB128 encoding of the value to the buffer
+pub fn write_i32(value: i32, bytes: &mut Vec<u8>) {
+    if (-64..64).contains(&value) {
+        bytes.push((value & 0b0111_1111) as u8);
+        return;
+    }
+    bytes.extend_from_slice(encode_i32(value).as_slice());
+}
+
+/// Append the signed LEB128 encoding of the value to the buffer
+pub fn write_i64(value: i64, bytes: &mut Vec<u8>) {
+    if (-64..64).contains(&value) {
+        bytes.push((value & 0b0111_1111) as u8);
+        return;
+    }
+    bytes.extend_from_slice(encode_i64(value).as_slice());
+}
+
+/// The same as encode_unsigned_int, but into a fixed size buffer. N must be big enough for
+/// the value's width.
+const fn encode_fixed_width_unsigned<const N: usize>(mut value: u64) -> FixedWidthEncoding<N> {
+    let mut bytes = [0; N];
+    let mut len = 0;
+
+    loop {
+        // take lowest 7 bits
+        let mut byte: u8 = (value & 0b0111_1111) as u8;
+        value >>= 7;
+        if value != 0 {
+            // add a 1 to the front of every byte except the last one (the MSB)
+            byte |= 0b1000_0000
+        }
+        bytes[len] = byte;
+        len += 1;
+        if value == 0 {
+            break;
+        }
+    }
+
+    FixedWidthEncoding { bytes, len }
+}
+
+/// The same as encode_signed_int, but into a fixed size buffer. N must be big enough for
+/// the value's width.
+const fn encode_fixed_width_signed<const N: usize>(mut value: i64) -> FixedWidthEncoding<N> {
+    let mut bytes = [0; N];
+    let mut len = 0;
+
+    let mut more_bits = true;
+
+    while more_bits {
+        // take lowest 7 bits
+        let mut byte: u8 = (value & 0b0111_1111) as u8;
+        value >>= 7;
+
+        // sign bit of the byte is the second-highest bit
+        let sign_bit = (byte >> 6) & 1;
+        if (value == 0 && sign_bit == 0) || (value == -1 && sign_bit == 1) {
+            more_bits = false;
+        } else {
+            byte |= 0b1000_0000
+        }
+        bytes[len] = byte;
+        len += 1;
+    }
+
+    FixedWidthEncoding { bytes, len }
+}
+
 pub fn encode_unsigned_int(mut value: u128) -> Vec<u8> {
     let mut bytes = Vec::new();
 
@@ -1,6 +1,9 @@
 #[cfg(test)]
 mod integer_encoding_tests {
-    use super::super::encode_unsigned_int;
+    use super::super::{
+        encode_i32, encode_i64, encode_signed_int, encode_u32, encode_unsigned_int, write_i32,
+        write_i64,
+    };
 
     #[test]
     fn unsigned_int() {
@@ -19,4 +22,42 @@ mod integer_encoding_tests {
         let result = encode_unsigned_int(81);
         assert_eq!(result, vec![0b0101_0001]);
     }
+
+    #[test]
+    fn signed_int_appends_to_buffer() {
+        let mut bytes = vec![0x41];
+        write_i32(-123456, &mut bytes);
+        assert_eq!(bytes, vec![0x41, 0xC0, 0xBB, 0x78]);
+    }
+
+    #[test]
+    fn fixed_width_matches_general_encoding() {
+        for value in [0, 1, 63, 64, 127, 128, 65000, u32::MAX] {
+            assert_eq!(
+                encode_u32(value).as_slice(),
+                encode_unsigned_int(value as u128)
+            );
+        }
+        for value in [0, -1, 63, 64, -64, -65, i32::MIN, i32::MAX] {
+            assert_eq!(
+                encode_i32(value).as_slice(),
+                encode_signed_int(value as i128)
+            );
+        }
+        for value in [0, -1, 1 << 40, i64::MIN, i64::MAX] {
+            assert_eq!(
+                encode_i64(value).as_slice(),
+                encode_signed_int(value as i128)
+            );
+        }
+    }
+
+    #[test]
+    fn single_byte_fast_path() {
+        for value in [-65, -64, -1, 0, 63, 64] {
+            let mut bytes = Vec::new();
+            write_i64(value, &mut bytes);
+            assert_eq!(bytes, encode_signed_int(value as i128));
+        }
+    }
 }
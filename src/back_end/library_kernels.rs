@@ -0,0 +1,530 @@
+use crate::back_end::calling_convention::get_native_function_type;
+use crate::back_end::target_code_generation_context::{LibraryKernel, ModuleContext};
+use crate::back_end::wasm_indices::{LabelIdx, LocalIdx};
+use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmExpression, WasmInstruction};
+use crate::back_end::wasm_module::code_section::LocalDeclaration;
+use crate::back_end::wasm_module::types_section::WasmFunctionType;
+use crate::back_end::wasm_types::{NumType, ValType, VecType};
+use crate::middle_end::ids::FunId;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::program_config::program_constants::{
+    MEMCHR_FUNCTION_NAME, MEMCPY_FUNCTION_NAME, MEMSET_FUNCTION_NAME, STRLEN_FUNCTION_NAME,
+};
+use crate::relooper::relooper::ReloopedFunction;
+
+/// The number of bytes in a v128
+const V128_BYTE_SIZE: i32 = 16;
+
+/// Find the strlen(), memchr(), memcpy() and memset() declarations from string.h. Like the
+/// heap allocator's functions, they're defined functions without a body, and always use the
+/// native calling convention because their bodies are generated straight to wasm.
+pub fn find_library_kernel_functions(
+    module_context: &mut ModuleContext,
+    defined_functions: &Vec<(FunId, ReloopedFunction)>,
+    prog_metadata: &ProgramMetadata,
+) {
+    let i32_type = || ValType::NumType(NumType::I32);
+    let kernels = [
+        // size_t strlen(const char *s)
+        (STRLEN_FUNCTION_NAME, LibraryKernel::Strlen, 1),
+        // void *memchr(const void *s, int c, size_t n)
+        (MEMCHR_FUNCTION_NAME, LibraryKernel::Memchr, 3),
+        // void *memcpy(void *dest, const void *src, size_t n)
+        (MEMCPY_FUNCTION_NAME, LibraryKernel::Memcpy, 3),
+        // void *memset(void *s, int c, size_t n)
+        (MEMSET_FUNCTION_NAME, LibraryKernel::Memset, 3),
+    ];
+
+    for (name, kernel, param_count) in kernels {
+        let fun_id = match prog_metadata.function_ids.get(name) {
+            Some(fun_id) => fun_id,
+            None => continue,
+        };
+        let function = match defined_functions
+            .iter()
+            .find(|(defined_fun_id, _)| defined_fun_id == fun_id)
+        {
+            Some((_, function)) => function,
+            None => continue,
+        };
+        let expected_type = WasmFunctionType {
+            param_types: vec![i32_type(); param_count],
+            result_types: vec![i32_type()],
+        };
+        // if the program defines its own function with the same name, that's used instead
+        if function.block.is_some()
+            || get_native_function_type(&function.type_info) != Some(expected_type)
+        {
+            continue;
+        }
+        module_context.native_call_fun_ids.insert(fun_id.to_owned());
+        module_context
+            .library_kernels
+            .insert(fun_id.to_owned(), kernel);
+    }
+}
+
+/// Generate the body of one of the library kernels, if the function is one of them.
+/// Returns the body, the declarations of its locals, and the names of its locals.
+pub fn generate_library_kernel_function(
+    fun_id: &FunId,
+    module_context: &ModuleContext,
+) -> Option<(
+    WasmExpression,
+    Vec<LocalDeclaration>,
+    Vec<(LocalIdx, String)>,
+)> {
+    let kernel = module_context.library_kernels.get(fun_id)?;
+    let simd = module_context.enabled_optimisations.is_simd_enabled();
+    let bulk_memory = module_context
+        .enabled_optimisations
+        .is_bulk_memory_enabled();
+
+    let i32_type = || ValType::NumType(NumType::I32);
+    let v128_type = || ValType::VecType(VecType::V128);
+    // the params come first, then the locals
+    let (instrs, params, locals) = match kernel {
+        LibraryKernel::Strlen => (generate_strlen(simd), vec!["s"], vec![("ptr", i32_type())]),
+        LibraryKernel::Memchr => (
+            generate_memchr(simd),
+            vec!["s", "c", "n"],
+            vec![("mask", i32_type()), ("needle", v128_type())],
+        ),
+        LibraryKernel::Memcpy => (
+            generate_memcpy(simd, bulk_memory),
+            vec!["dest", "src", "n"],
+            vec![("offset", i32_type())],
+        ),
+        LibraryKernel::Memset => (
+            generate_memset(simd, bulk_memory),
+            vec!["s", "c", "n"],
+            vec![("offset", i32_type()), ("fill", v128_type())],
+        ),
+    };
+
+    let local_declarations = locals
+        .iter()
+        .map(|(_, value_type)| LocalDeclaration {
+            count: 1,
+            value_type: value_type.to_owned(),
+        })
+        .collect();
+    let local_names = params
+        .into_iter()
+        .chain(locals.into_iter().map(|(name, _)| name))
+        .enumerate()
+        .map(|(x, name)| (LocalIdx { x: x as u32 }, name.to_owned()))
+        .collect();
+
+    Some((WasmExpression { instrs }, local_declarations, local_names))
+}
+
+/// size_t strlen(const char *s)
+///
+/// Checks a byte at a time until the pointer is 16-byte aligned, then checks 16 bytes at a
+/// time for a null terminator. An aligned load never crosses into another page, so it can't
+/// read past the end of memory even if it reads past the end of the string.
+fn generate_strlen(simd: bool) -> Vec<WasmInstruction> {
+    let s = || LocalIdx { x: 0 };
+    let ptr = || LocalIdx { x: 1 };
+
+    let mut wasm_instrs = Vec::new();
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx: s() });
+    wasm_instrs.push(WasmInstruction::LocalSet { local_idx: ptr() });
+
+    // check each byte, until the null terminator, or with SIMD, until the pointer is aligned
+    let mut byte_loop_instrs = Vec::new();
+    if simd {
+        byte_loop_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+        byte_loop_instrs.push(WasmInstruction::I32Const {
+            n: V128_BYTE_SIZE - 1,
+        });
+        byte_loop_instrs.push(WasmInstruction::I32And);
+        byte_loop_instrs.push(WasmInstruction::I32Eqz);
+        byte_loop_instrs.push(WasmInstruction::BrIf {
+            label_idx: LabelIdx { l: 1 },
+        });
+    }
+    byte_loop_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+    byte_loop_instrs.push(WasmInstruction::I32Load8U {
+        mem_arg: MemArg::zero(),
+    });
+    byte_loop_instrs.push(WasmInstruction::I32Eqz);
+    byte_loop_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx {
+            l: if simd { 2 } else { 1 },
+        },
+    });
+    increment_local(ptr(), 1, &mut byte_loop_instrs);
+    byte_loop_instrs.push(WasmInstruction::Br {
+        label_idx: LabelIdx { l: 0 },
+    });
+    let byte_loop = WasmInstruction::Loop {
+        blocktype: BlockType::None,
+        instrs: byte_loop_instrs,
+    };
+
+    let mut found_instrs = Vec::new();
+    if simd {
+        found_instrs.push(WasmInstruction::Block {
+            blocktype: BlockType::None,
+            instrs: vec![byte_loop],
+        });
+
+        // skip over the 16 bytes while none of them are zero
+        let mut vector_loop_instrs = Vec::new();
+        vector_loop_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+        vector_loop_instrs.push(WasmInstruction::V128Load {
+            mem_arg: MemArg {
+                align: 4,
+                offset: 0,
+            },
+        });
+        vector_loop_instrs.push(WasmInstruction::I8x16AllTrue);
+        let mut next_vector_instrs = Vec::new();
+        increment_local(ptr(), V128_BYTE_SIZE, &mut next_vector_instrs);
+        next_vector_instrs.push(WasmInstruction::Br {
+            label_idx: LabelIdx { l: 1 },
+        });
+        vector_loop_instrs.push(WasmInstruction::IfElse {
+            blocktype: BlockType::None,
+            if_instrs: next_vector_instrs,
+            else_instrs: Vec::new(),
+        });
+        found_instrs.push(WasmInstruction::Loop {
+            blocktype: BlockType::None,
+            instrs: vector_loop_instrs,
+        });
+
+        // the null terminator is the first zero byte in the 16
+        found_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+        found_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+        found_instrs.push(WasmInstruction::V128Load {
+            mem_arg: MemArg {
+                align: 4,
+                offset: 0,
+            },
+        });
+        found_instrs.push(WasmInstruction::I32Const { n: 0 });
+        found_instrs.push(WasmInstruction::I8x16Splat);
+        found_instrs.push(WasmInstruction::I8x16Eq);
+        found_instrs.push(WasmInstruction::I8x16Bitmask);
+        found_instrs.push(WasmInstruction::I32Ctz);
+        found_instrs.push(WasmInstruction::I32Add);
+        found_instrs.push(WasmInstruction::LocalSet { local_idx: ptr() });
+    } else {
+        found_instrs.push(byte_loop);
+    }
+
+    wasm_instrs.push(WasmInstruction::Block {
+        blocktype: BlockType::None,
+        instrs: found_instrs,
+    });
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx: ptr() });
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx: s() });
+    wasm_instrs.push(WasmInstruction::I32Sub);
+    wasm_instrs
+}
+
+/// void *memchr(const void *s, int c, size_t n)
+///
+/// Compares 16 bytes at a time with the byte being searched for, while there are at least
+/// 16 bytes left, then compares the rest a byte at a time. Returns NULL if it's not found.
+fn generate_memchr(simd: bool) -> Vec<WasmInstruction> {
+    let s = || LocalIdx { x: 0 };
+    let c = || LocalIdx { x: 1 };
+    let n = || LocalIdx { x: 2 };
+    let mask = || LocalIdx { x: 3 };
+    let needle = || LocalIdx { x: 4 };
+
+    let mut search_instrs = Vec::new();
+
+    if simd {
+        // the byte being searched for in every lane
+        search_instrs.push(WasmInstruction::LocalGet { local_idx: c() });
+        search_instrs.push(WasmInstruction::I8x16Splat);
+        search_instrs.push(WasmInstruction::LocalSet {
+            local_idx: needle(),
+        });
+
+        let mut vector_loop_instrs = Vec::new();
+        break_if_fewer_than_v128_bytes(n(), LabelIdx { l: 1 }, &mut vector_loop_instrs);
+        vector_loop_instrs.push(WasmInstruction::LocalGet { local_idx: s() });
+        vector_loop_instrs.push(WasmInstruction::V128Load {
+            mem_arg: MemArg::zero(),
+        });
+        vector_loop_instrs.push(WasmInstruction::LocalGet {
+            local_idx: needle(),
+        });
+        vector_loop_instrs.push(WasmInstruction::I8x16Eq);
+        vector_loop_instrs.push(WasmInstruction::I8x16Bitmask);
+        vector_loop_instrs.push(WasmInstruction::LocalTee { local_idx: mask() });
+        // return the address of the first matching lane
+        vector_loop_instrs.push(WasmInstruction::IfElse {
+            blocktype: BlockType::None,
+            if_instrs: vec![
+                WasmInstruction::LocalGet { local_idx: s() },
+                WasmInstruction::LocalGet { local_idx: mask() },
+                WasmInstruction::I32Ctz,
+                WasmInstruction::I32Add,
+                WasmInstruction::Return,
+            ],
+            else_instrs: Vec::new(),
+        });
+        increment_local(s(), V128_BYTE_SIZE, &mut vector_loop_instrs);
+        increment_local(n(), -V128_BYTE_SIZE, &mut vector_loop_instrs);
+        vector_loop_instrs.push(WasmInstruction::Br {
+            label_idx: LabelIdx { l: 0 },
+        });
+
+        search_instrs.push(WasmInstruction::Block {
+            blocktype: BlockType::None,
+            instrs: vec![WasmInstruction::Loop {
+                blocktype: BlockType::None,
+                instrs: vector_loop_instrs,
+            }],
+        });
+    }
+
+    let mut byte_loop_instrs = Vec::new();
+    byte_loop_instrs.push(WasmInstruction::LocalGet { local_idx: n() });
+    byte_loop_instrs.push(WasmInstruction::I32Eqz);
+    byte_loop_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx { l: 1 },
+    });
+    byte_loop_instrs.push(WasmInstruction::LocalGet { local_idx: s() });
+    byte_loop_instrs.push(WasmInstruction::I32Load8U {
+        mem_arg: MemArg::zero(),
+    });
+    // c is converted to an unsigned char
+    byte_loop_instrs.push(WasmInstruction::LocalGet { local_idx: c() });
+    byte_loop_instrs.push(WasmInstruction::I32Const { n: 0xff });
+    byte_loop_instrs.push(WasmInstruction::I32And);
+    byte_loop_instrs.push(WasmInstruction::I32Eq);
+    byte_loop_instrs.push(WasmInstruction::IfElse {
+        blocktype: BlockType::None,
+        if_instrs: vec![
+            WasmInstruction::LocalGet { local_idx: s() },
+            WasmInstruction::Return,
+        ],
+        else_instrs: Vec::new(),
+    });
+    increment_local(s(), 1, &mut byte_loop_instrs);
+    increment_local(n(), -1, &mut byte_loop_instrs);
+    byte_loop_instrs.push(WasmInstruction::Br {
+        label_idx: LabelIdx { l: 0 },
+    });
+    search_instrs.push(WasmInstruction::Loop {
+        blocktype: BlockType::None,
+        instrs: byte_loop_instrs,
+    });
+
+    // branching out of the search block means it wasn't found
+    vec![
+        WasmInstruction::Block {
+            blocktype: BlockType::None,
+            instrs: search_instrs,
+        },
+        WasmInstruction::I32Const { n: 0 },
+    ]
+}
+
+/// void *memcpy(void *dest, const void *src, size_t n)
+///
+/// A single memory.copy if bulk memory is enabled. Otherwise, copies 16 bytes at a time
+/// while there are at least 16 bytes left, then copies the rest a byte at a time.
+fn generate_memcpy(simd: bool, bulk_memory: bool) -> Vec<WasmInstruction> {
+    let dest = || LocalIdx { x: 0 };
+    let src = || LocalIdx { x: 1 };
+    let n = || LocalIdx { x: 2 };
+    let offset = || LocalIdx { x: 3 };
+
+    if bulk_memory {
+        return vec![
+            WasmInstruction::LocalGet { local_idx: dest() },
+            WasmInstruction::LocalGet { local_idx: src() },
+            WasmInstruction::LocalGet { local_idx: n() },
+            WasmInstruction::MemoryCopy,
+            WasmInstruction::LocalGet { local_idx: dest() },
+        ];
+    }
+
+    let load_addr = |base: LocalIdx| {
+        vec![
+            WasmInstruction::LocalGet { local_idx: base },
+            WasmInstruction::LocalGet {
+                local_idx: offset(),
+            },
+            WasmInstruction::I32Add,
+        ]
+    };
+    let mut copy_v128_instrs = load_addr(dest());
+    copy_v128_instrs.append(&mut load_addr(src()));
+    copy_v128_instrs.push(WasmInstruction::V128Load {
+        mem_arg: MemArg::zero(),
+    });
+    copy_v128_instrs.push(WasmInstruction::V128Store {
+        mem_arg: MemArg::zero(),
+    });
+    let mut copy_byte_instrs = load_addr(dest());
+    copy_byte_instrs.append(&mut load_addr(src()));
+    copy_byte_instrs.push(WasmInstruction::I32Load8U {
+        mem_arg: MemArg::zero(),
+    });
+    copy_byte_instrs.push(WasmInstruction::I32Store8 {
+        mem_arg: MemArg::zero(),
+    });
+
+    let mut wasm_instrs = generate_store_loops(
+        n(),
+        offset(),
+        simd.then_some(copy_v128_instrs),
+        copy_byte_instrs,
+    );
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx: dest() });
+    wasm_instrs
+}
+
+/// void *memset(void *s, int c, size_t n)
+///
+/// A single memory.fill if bulk memory is enabled. Otherwise, fills 16 bytes at a time
+/// while there are at least 16 bytes left, then fills the rest a byte at a time.
+fn generate_memset(simd: bool, bulk_memory: bool) -> Vec<WasmInstruction> {
+    let s = || LocalIdx { x: 0 };
+    let c = || LocalIdx { x: 1 };
+    let n = || LocalIdx { x: 2 };
+    let offset = || LocalIdx { x: 3 };
+    let fill = || LocalIdx { x: 4 };
+
+    if bulk_memory {
+        return vec![
+            WasmInstruction::LocalGet { local_idx: s() },
+            WasmInstruction::LocalGet { local_idx: c() },
+            WasmInstruction::LocalGet { local_idx: n() },
+            WasmInstruction::MemoryFill,
+            WasmInstruction::LocalGet { local_idx: s() },
+        ];
+    }
+
+    let load_addr = || {
+        vec![
+            WasmInstruction::LocalGet { local_idx: s() },
+            WasmInstruction::LocalGet {
+                local_idx: offset(),
+            },
+            WasmInstruction::I32Add,
+        ]
+    };
+    let mut fill_v128_instrs = load_addr();
+    fill_v128_instrs.push(WasmInstruction::LocalGet { local_idx: fill() });
+    fill_v128_instrs.push(WasmInstruction::V128Store {
+        mem_arg: MemArg::zero(),
+    });
+    let mut fill_byte_instrs = load_addr();
+    fill_byte_instrs.push(WasmInstruction::LocalGet { local_idx: c() });
+    fill_byte_instrs.push(WasmInstruction::I32Store8 {
+        mem_arg: MemArg::zero(),
+    });
+
+    let mut wasm_instrs = Vec::new();
+    if simd {
+        // the fill byte in every lane
+        wasm_instrs.push(WasmInstruction::LocalGet { local_idx: c() });
+        wasm_instrs.push(WasmInstruction::I8x16Splat);
+        wasm_instrs.push(WasmInstruction::LocalSet { local_idx: fill() });
+    }
+    wasm_instrs.append(&mut generate_store_loops(
+        n(),
+        offset(),
+        simd.then_some(fill_v128_instrs),
+        fill_byte_instrs,
+    ));
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx: s() });
+    wasm_instrs
+}
+
+/// Loop over the n bytes from offset 0, running the v128 instructions for every 16 bytes
+/// while there are at least 16 left, and then the byte instructions for each byte left
+fn generate_store_loops(
+    n: LocalIdx,
+    offset: LocalIdx,
+    v128_instrs: Option<Vec<WasmInstruction>>,
+    mut byte_instrs: Vec<WasmInstruction>,
+) -> Vec<WasmInstruction> {
+    // locals start at zero, so the offset doesn't need initialising
+    let mut wasm_instrs = Vec::new();
+
+    if let Some(mut v128_instrs) = v128_instrs {
+        let mut vector_loop_instrs = Vec::new();
+        // n - offset is the number of bytes left
+        vector_loop_instrs.push(WasmInstruction::LocalGet {
+            local_idx: n.to_owned(),
+        });
+        vector_loop_instrs.push(WasmInstruction::LocalGet {
+            local_idx: offset.to_owned(),
+        });
+        vector_loop_instrs.push(WasmInstruction::I32Sub);
+        vector_loop_instrs.push(WasmInstruction::I32Const { n: V128_BYTE_SIZE });
+        vector_loop_instrs.push(WasmInstruction::I32LtU);
+        vector_loop_instrs.push(WasmInstruction::BrIf {
+            label_idx: LabelIdx { l: 1 },
+        });
+        vector_loop_instrs.append(&mut v128_instrs);
+        increment_local(offset.to_owned(), V128_BYTE_SIZE, &mut vector_loop_instrs);
+        vector_loop_instrs.push(WasmInstruction::Br {
+            label_idx: LabelIdx { l: 0 },
+        });
+        wasm_instrs.push(WasmInstruction::Block {
+            blocktype: BlockType::None,
+            instrs: vec![WasmInstruction::Loop {
+                blocktype: BlockType::None,
+                instrs: vector_loop_instrs,
+            }],
+        });
+    }
+
+    let mut byte_loop_instrs = Vec::new();
+    byte_loop_instrs.push(WasmInstruction::LocalGet {
+        local_idx: offset.to_owned(),
+    });
+    byte_loop_instrs.push(WasmInstruction::LocalGet { local_idx: n });
+    byte_loop_instrs.push(WasmInstruction::I32GeU);
+    byte_loop_instrs.push(WasmInstruction::BrIf {
+        label_idx: LabelIdx { l: 1 },
+    });
+    byte_loop_instrs.append(&mut byte_instrs);
+    increment_local(offset, 1, &mut byte_loop_instrs);
+    byte_loop_instrs.push(WasmInstruction::Br {
+        label_idx: LabelIdx { l: 0 },
+    });
+    wasm_instrs.push(WasmInstruction::Block {
+        blocktype: BlockType::None,
+        instrs: vec![WasmInstruction::Loop {
+            blocktype: BlockType::None,
+            instrs: byte_loop_instrs,
+        }],
+    });
+
+    wasm_instrs
+}
+
+/// Exit the block if the local holds fewer than 16
+fn break_if_fewer_than_v128_bytes(
+    local_idx: LocalIdx,
+    label_idx: LabelIdx,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
+    wasm_instrs.push(WasmInstruction::LocalGet { local_idx });
+    wasm_instrs.push(WasmInstruction::I32Const { n: V128_BYTE_SIZE });
+    wasm_instrs.push(WasmInstruction::I32LtU);
+    wasm_instrs.push(WasmInstruction::BrIf { label_idx });
+}
+
+fn increment_local(local_idx: LocalIdx, n: i32, wasm_instrs: &mut Vec<WasmInstruction>) {
+    wasm_instrs.push(WasmInstruction::LocalGet {
+        local_idx: local_idx.to_owned(),
+    });
+    wasm_instrs.push(WasmInstruction::I32Const { n });
+    wasm_instrs.push(WasmInstruction::I32Add);
+    wasm_instrs.push(WasmInstruction::LocalSet { local_idx });
+}
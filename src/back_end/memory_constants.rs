@@ -6,3 +6,24 @@ pub const PTR_SIZE: u32 = 4;
 pub const FRAME_PTR_ADDR: u32 = 0;
 pub const TEMP_FRAME_PTR_ADDR: u32 = FRAME_PTR_ADDR + PTR_SIZE;
 pub const STACK_PTR_ADDR: u32 = TEMP_FRAME_PTR_ADDR + PTR_SIZE;
+
+/// The stack ptr is always kept a multiple of this, so the start of each stack frame is
+/// aligned for any scalar type, and vars in the frame can be aligned to their size
+pub const STACK_FRAME_ALIGNMENT: u32 = 8;
+
+/// The number of stack pointer samples the profiler buffers in memory before the JS
+/// runtime is called to write them out
+pub const STACK_PTR_LOG_BUFFER_SAMPLES: u32 = 1024;
+/// The size of each counter that the call and block profilers keep in memory
+pub const PROFILE_COUNTER_SIZE: u32 = 8;
+
+/// The size of a wasm page, the unit that memory is sized and grown in
+pub const WASM_PAGE_SIZE: u32 = 65536;
+
+/// The size of the header at the start of each heap block, which keeps the payload 8-byte
+/// aligned
+pub const HEAP_BLOCK_HEADER_SIZE: u32 = 8;
+/// Heap blocks are a power of two bytes. The smallest size class is 2^4 = 16 bytes including
+/// the header, and the largest is 2^30 bytes, so a block's end can't overflow an i32
+pub const MIN_HEAP_SIZE_CLASS: u32 = 4;
+pub const MAX_HEAP_SIZE_CLASS: u32 = 30;
@@ -1,7 +1,8 @@
 use log::debug;
 
+use crate::back_end::memory_constants::{PTR_SIZE, STACK_FRAME_ALIGNMENT, WASM_PAGE_SIZE};
 use crate::back_end::stack_frame_operations::load_frame_ptr;
-use crate::back_end::target_code_generation_context::FunctionContext;
+use crate::back_end::target_code_generation_context::{FunctionContext, ModuleContext};
 use crate::back_end::wasm_instructions::{MemArg, WasmInstruction};
 use crate::middle_end::ids::VarId;
 use crate::middle_end::instructions::{Constant, Src};
@@ -9,35 +10,35 @@ use crate::middle_end::ir::ProgramMetadata;
 use crate::middle_end::ir_types::IrType;
 
 /// Insert a load instruction of the correct type
-pub fn load(value_type: IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
+pub fn load(value_type: &IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
+    load_at_offset(value_type, 0, wasm_instrs);
+}
+
+/// Insert a load instruction of the correct type, that loads from offset bytes above the
+/// address on the stack. The address isn't known to be aligned, since structs and the
+/// params and return value in a stack frame are packed, so it's hinted as unaligned.
+pub fn load_at_offset(value_type: &IrType, offset: u32, wasm_instrs: &mut Vec<WasmInstruction>) {
+    load_with_mem_arg(value_type, MemArg::unaligned(offset), wasm_instrs);
+}
+
+/// Insert a load instruction of the correct type, with the given offset and alignment hint
+pub fn load_with_mem_arg(
+    value_type: &IrType,
+    mem_arg: MemArg,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
     match value_type {
-        IrType::I8 => wasm_instrs.push(WasmInstruction::I32Load8S {
-            mem_arg: MemArg::zero(),
-        }),
-
-        IrType::U8 => wasm_instrs.push(WasmInstruction::I32Load8U {
-            mem_arg: MemArg::zero(),
-        }),
-        IrType::I16 => wasm_instrs.push(WasmInstruction::I32Load16S {
-            mem_arg: MemArg::zero(),
-        }),
-        IrType::U16 => wasm_instrs.push(WasmInstruction::I32Load16U {
-            mem_arg: MemArg::zero(),
-        }),
+        IrType::I8 => wasm_instrs.push(WasmInstruction::I32Load8S { mem_arg }),
+
+        IrType::U8 => wasm_instrs.push(WasmInstruction::I32Load8U { mem_arg }),
+        IrType::I16 => wasm_instrs.push(WasmInstruction::I32Load16S { mem_arg }),
+        IrType::U16 => wasm_instrs.push(WasmInstruction::I32Load16U { mem_arg }),
         IrType::I32 | IrType::U32 | IrType::PointerTo(_) | IrType::ArrayOf(_, _) => {
-            wasm_instrs.push(WasmInstruction::I32Load {
-                mem_arg: MemArg::zero(),
-            });
+            wasm_instrs.push(WasmInstruction::I32Load { mem_arg });
         }
-        IrType::I64 | IrType::U64 => wasm_instrs.push(WasmInstruction::I64Load {
-            mem_arg: MemArg::zero(),
-        }),
-        IrType::F32 => wasm_instrs.push(WasmInstruction::F32Load {
-            mem_arg: MemArg::zero(),
-        }),
-        IrType::F64 => wasm_instrs.push(WasmInstruction::F64Load {
-            mem_arg: MemArg::zero(),
-        }),
+        IrType::I64 | IrType::U64 => wasm_instrs.push(WasmInstruction::I64Load { mem_arg }),
+        IrType::F32 => wasm_instrs.push(WasmInstruction::F32Load { mem_arg }),
+        IrType::F64 => wasm_instrs.push(WasmInstruction::F64Load { mem_arg }),
         _ => {
             unreachable!()
         }
@@ -45,31 +46,34 @@ pub fn load(value_type: IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
 }
 
 /// Insert a store instruction of the correct type
-pub fn store(value_type: IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
+pub fn store(value_type: &IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
+    store_at_offset(value_type, 0, wasm_instrs);
+}
+
+/// Insert a store instruction of the correct type, that stores to offset bytes above the
+/// address operand. It's hinted as unaligned, like in load_at_offset.
+pub fn store_at_offset(value_type: &IrType, offset: u32, wasm_instrs: &mut Vec<WasmInstruction>) {
+    store_with_mem_arg(value_type, MemArg::unaligned(offset), wasm_instrs);
+}
+
+/// Insert a store instruction of the correct type, with the given offset and alignment hint
+pub fn store_with_mem_arg(
+    value_type: &IrType,
+    mem_arg: MemArg,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
     match value_type {
-        IrType::I8 | IrType::U8 => wasm_instrs.push(WasmInstruction::I32Store8 {
-            mem_arg: MemArg::zero(),
-        }),
-        IrType::I16 | IrType::U16 => wasm_instrs.push(WasmInstruction::I32Store16 {
-            mem_arg: MemArg::zero(),
-        }),
+        IrType::I8 | IrType::U8 => wasm_instrs.push(WasmInstruction::I32Store8 { mem_arg }),
+        IrType::I16 | IrType::U16 => wasm_instrs.push(WasmInstruction::I32Store16 { mem_arg }),
         IrType::I32 | IrType::U32 | IrType::PointerTo(_) | IrType::ArrayOf(_, _) => {
             // if storing to an 'array' type, it's storing a pointer to the array
-            wasm_instrs.push(WasmInstruction::I32Store {
-                mem_arg: MemArg::zero(),
-            });
+            wasm_instrs.push(WasmInstruction::I32Store { mem_arg });
         }
         IrType::I64 | IrType::U64 => {
-            wasm_instrs.push(WasmInstruction::I64Store {
-                mem_arg: MemArg::zero(),
-            });
+            wasm_instrs.push(WasmInstruction::I64Store { mem_arg });
         }
-        IrType::F32 => wasm_instrs.push(WasmInstruction::F32Store {
-            mem_arg: MemArg::zero(),
-        }),
-        IrType::F64 => wasm_instrs.push(WasmInstruction::F64Store {
-            mem_arg: MemArg::zero(),
-        }),
+        IrType::F32 => wasm_instrs.push(WasmInstruction::F32Store { mem_arg }),
+        IrType::F64 => wasm_instrs.push(WasmInstruction::F64Store { mem_arg }),
         t => {
             debug!("store type: {}", t);
             unreachable!()
@@ -77,17 +81,78 @@ pub fn store(value_type: IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
     }
 }
 
+/// The MemArg for loading or storing a var of value_type, at offset bytes from the base
+/// address that load_var_base_address loaded. Frame slots and global vars are aligned to
+/// their size, except for the params and return value that are packed into a stack frame,
+/// so the hint is only natural if the var's address is a multiple of the access width.
+pub fn get_var_mem_arg(
+    var_id: &VarId,
+    value_type: &IrType,
+    offset: u32,
+    function_context: &FunctionContext,
+) -> MemArg {
+    let byte_size = scalar_access_byte_size(value_type);
+    let addr = match function_context.var_fp_offsets.get(var_id) {
+        // the frame ptr is a multiple of STACK_FRAME_ALIGNMENT, which is a multiple of the
+        // width of any access
+        Some(fp_offset) => *fp_offset,
+        None => function_context.global_var_addrs.get(var_id).unwrap() + offset,
+    };
+    if byte_size <= STACK_FRAME_ALIGNMENT && addr % byte_size == 0 {
+        MemArg::natural(byte_size, offset)
+    } else {
+        MemArg::unaligned(offset)
+    }
+}
+
+/// The number of bytes a load or store of the type accesses. Arrays are accessed as a
+/// pointer to the array. Other types aren't loaded or stored with a single instruction, so
+/// they get the smallest alignment hint.
+fn scalar_access_byte_size(value_type: &IrType) -> u32 {
+    match value_type {
+        IrType::I8 | IrType::U8 => 1,
+        IrType::I16 | IrType::U16 => 2,
+        IrType::I32 | IrType::U32 | IrType::F32 => 4,
+        IrType::PointerTo(_) | IrType::ArrayOf(_, _) => PTR_SIZE,
+        IrType::I64 | IrType::U64 | IrType::F64 => 8,
+        _ => 1,
+    }
+}
+
 /// load the memory address of the given variable onto the stack
 pub fn load_var_address(
     var_id: &VarId,
     wasm_instrs: &mut Vec<WasmInstruction>,
     function_context: &FunctionContext,
+    module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
 ) {
     if prog_metadata.is_var_the_null_dest(var_id) {
         return;
     }
 
+    let offset = load_var_base_address(var_id, wasm_instrs, function_context, module_context);
+    if offset != 0 {
+        wasm_instrs.push(WasmInstruction::I32Const { n: offset as i32 });
+        wasm_instrs.push(WasmInstruction::I32Add);
+    }
+}
+
+/// Load a base address onto the stack, and return the offset from it to the given variable.
+///
+/// Loads and stores can add the offset themselves, with the offset in their MemArg, which
+/// saves adding it to the frame ptr with separate instructions.
+pub fn load_var_base_address(
+    var_id: &VarId,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+) -> u32 {
+    if function_context.is_var_in_local(var_id) {
+        debug!("var_id: {}", var_id);
+        unreachable!("Vars promoted to wasm locals don't have a memory address")
+    }
+
     match function_context.var_fp_offsets.get(var_id) {
         None => {
             match function_context.global_var_addrs.get(var_id) {
@@ -100,16 +165,14 @@ pub fn load_var_address(
                     wasm_instrs.push(WasmInstruction::I32Const {
                         n: *global_addr as i32,
                     });
+                    0
                 }
             }
         }
         Some(fp_offset) => {
-            // load frame ptr and add variable offset
-            load_frame_ptr(wasm_instrs);
-            wasm_instrs.push(WasmInstruction::I32Const {
-                n: *fp_offset as i32,
-            });
-            wasm_instrs.push(WasmInstruction::I32Add);
+            // variable is at an offset from the frame ptr
+            load_frame_ptr(wasm_instrs, module_context);
+            *fp_offset
         }
     }
 }
@@ -119,17 +182,26 @@ pub fn load_var(
     var_id: VarId,
     wasm_instrs: &mut Vec<WasmInstruction>,
     function_context: &FunctionContext,
+    module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
 ) {
     if prog_metadata.is_var_the_null_dest(&var_id) {
         return;
     }
 
+    if let Some(local_idx) = function_context.var_local_idxs.get(&var_id) {
+        wasm_instrs.push(WasmInstruction::LocalGet {
+            local_idx: local_idx.to_owned(),
+        });
+        return;
+    }
+
     let var_type = prog_metadata.get_var_type(&var_id).unwrap();
 
-    load_var_address(&var_id, wasm_instrs, function_context, prog_metadata);
+    let offset = load_var_base_address(&var_id, wasm_instrs, function_context, module_context);
 
-    load(var_type, wasm_instrs);
+    let mem_arg = get_var_mem_arg(&var_id, var_type, offset, function_context);
+    load_with_mem_arg(var_type, mem_arg, wasm_instrs);
 }
 
 /// Insert instructions to store into the given variable
@@ -138,6 +210,7 @@ pub fn store_var(
     mut store_value_instrs: Vec<WasmInstruction>,
     wasm_instrs: &mut Vec<WasmInstruction>,
     function_context: &FunctionContext,
+    module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
 ) {
     // ignore stores to the null dest
@@ -145,19 +218,50 @@ pub fn store_var(
         return;
     }
 
+    if let Some(local_idx) = function_context.var_local_idxs.get(&var_id) {
+        wasm_instrs.append(&mut store_value_instrs);
+        // a narrow store to memory would truncate the value, so do the same here
+        truncate_to_narrow_type(prog_metadata.get_var_type(&var_id).unwrap(), wasm_instrs);
+        wasm_instrs.push(WasmInstruction::LocalSet {
+            local_idx: local_idx.to_owned(),
+        });
+        return;
+    }
+
     // address operand
-    load_var_address(&var_id, wasm_instrs, function_context, prog_metadata);
+    let offset = load_var_base_address(&var_id, wasm_instrs, function_context, module_context);
 
     // put the value to store onto the stack
     wasm_instrs.append(&mut store_value_instrs);
 
     // store
-    store(prog_metadata.get_var_type(&var_id).unwrap(), wasm_instrs);
+    let var_type = prog_metadata.get_var_type(&var_id).unwrap();
+    let mem_arg = get_var_mem_arg(&var_id, var_type, offset, function_context);
+    store_with_mem_arg(var_type, mem_arg, wasm_instrs);
+}
+
+/// Insert instructions to truncate the i32 on top of the stack to the given type, so that
+/// it has the same value as if it had been stored to and then loaded from memory.
+/// Does nothing for types that are already the full width of their wasm type.
+pub fn truncate_to_narrow_type(value_type: &IrType, wasm_instrs: &mut Vec<WasmInstruction>) {
+    match value_type {
+        IrType::I8 => wasm_instrs.push(WasmInstruction::I32Extend8S),
+        IrType::U8 => {
+            wasm_instrs.push(WasmInstruction::I32Const { n: 0xff });
+            wasm_instrs.push(WasmInstruction::I32And);
+        }
+        IrType::I16 => wasm_instrs.push(WasmInstruction::I32Extend16S),
+        IrType::U16 => {
+            wasm_instrs.push(WasmInstruction::I32Const { n: 0xffff });
+            wasm_instrs.push(WasmInstruction::I32And);
+        }
+        _ => {}
+    }
 }
 
 pub fn load_constant(
     constant: Constant,
-    constant_type: IrType,
+    constant_type: &IrType,
     wasm_instrs: &mut Vec<WasmInstruction>,
 ) {
     // let constant_type = constant.get_type(None);
@@ -202,16 +306,243 @@ pub fn load_constant(
 /// Param dest_type is optional for var loads, but required for constant loads.
 pub fn load_src(
     src: Src,
-    dest_type: IrType,
+    dest_type: &IrType,
     wasm_instrs: &mut Vec<WasmInstruction>,
     function_context: &FunctionContext,
+    module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
 ) {
     match src {
-        Src::Var(var_id) => load_var(var_id, wasm_instrs, function_context, prog_metadata),
+        Src::Var(var_id) => load_var(
+            var_id,
+            wasm_instrs,
+            function_context,
+            module_context,
+            prog_metadata,
+        ),
         Src::Constant(constant) => load_constant(constant, dest_type, wasm_instrs),
         Src::StoreAddressVar(_) | Src::Fun(_) => {
             unreachable!()
         }
     }
 }
+
+/// Copies and zero fills of at least this many bytes use the bulk memory instructions,
+/// instead of a load and store for every 8 bytes
+const MIN_BULK_MEMORY_BYTE_SIZE: u32 = 16;
+
+/// Insert instructions to copy byte_size bytes from the address that load_src_addr puts on
+/// the stack to the address that load_dest_addr puts on the stack.
+///
+/// Small copies (or all copies, if bulk memory is disabled) load and store each part of the
+/// memory separately, so the address instructions are inserted more than once.
+pub fn copy_memory(
+    load_dest_addr: impl Fn(&mut Vec<WasmInstruction>),
+    load_src_addr: impl Fn(&mut Vec<WasmInstruction>),
+    byte_size: u32,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    if is_bulk_memory_worth_it(byte_size, module_context) {
+        load_dest_addr(wasm_instrs);
+        load_src_addr(wasm_instrs);
+        wasm_instrs.push(WasmInstruction::I32Const {
+            n: byte_size as i32,
+        });
+        wasm_instrs.push(WasmInstruction::MemoryCopy);
+        return;
+    }
+
+    // structs are packed, so the block may be aligned to less than the access widths, and
+    // is hinted as unaligned
+    for (offset, width) in split_into_scalar_accesses(byte_size) {
+        let mem_arg = || MemArg::unaligned(offset);
+        load_dest_addr(wasm_instrs);
+        load_src_addr(wasm_instrs);
+        match width {
+            8 => {
+                wasm_instrs.push(WasmInstruction::I64Load { mem_arg: mem_arg() });
+                wasm_instrs.push(WasmInstruction::I64Store { mem_arg: mem_arg() });
+            }
+            4 => {
+                wasm_instrs.push(WasmInstruction::I32Load { mem_arg: mem_arg() });
+                wasm_instrs.push(WasmInstruction::I32Store { mem_arg: mem_arg() });
+            }
+            2 => {
+                wasm_instrs.push(WasmInstruction::I32Load16U { mem_arg: mem_arg() });
+                wasm_instrs.push(WasmInstruction::I32Store16 { mem_arg: mem_arg() });
+            }
+            1 => {
+                wasm_instrs.push(WasmInstruction::I32Load8U { mem_arg: mem_arg() });
+                wasm_instrs.push(WasmInstruction::I32Store8 { mem_arg: mem_arg() });
+            }
+            _ => unreachable!(),
+        }
+    }
+}
+
+/// Insert instructions to set byte_size bytes to zero, starting at the address that
+/// load_dest_addr puts on the stack
+pub fn zero_memory(
+    load_dest_addr: impl Fn(&mut Vec<WasmInstruction>),
+    byte_size: u32,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    if is_bulk_memory_worth_it(byte_size, module_context) {
+        load_dest_addr(wasm_instrs);
+        // value to fill with
+        wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
+        wasm_instrs.push(WasmInstruction::I32Const {
+            n: byte_size as i32,
+        });
+        wasm_instrs.push(WasmInstruction::MemoryFill);
+        return;
+    }
+
+    // hinted as unaligned, like in copy_memory
+    for (offset, width) in split_into_scalar_accesses(byte_size) {
+        let mem_arg = MemArg::unaligned(offset);
+        load_dest_addr(wasm_instrs);
+        match width {
+            8 => {
+                wasm_instrs.push(WasmInstruction::I64Const { n: 0 });
+                wasm_instrs.push(WasmInstruction::I64Store { mem_arg });
+            }
+            4 => {
+                wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
+                wasm_instrs.push(WasmInstruction::I32Store { mem_arg });
+            }
+            2 => {
+                wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
+                wasm_instrs.push(WasmInstruction::I32Store16 { mem_arg });
+            }
+            1 => {
+                wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
+                wasm_instrs.push(WasmInstruction::I32Store8 { mem_arg });
+            }
+            _ => unreachable!(),
+        }
+    }
+}
+
+fn is_bulk_memory_worth_it(byte_size: u32, module_context: &ModuleContext) -> bool {
+    module_context
+        .enabled_optimisations
+        .is_bulk_memory_enabled()
+        && byte_size >= MIN_BULK_MEMORY_BYTE_SIZE
+}
+
+/// Split a block of memory into the widest loads/stores that will cover it, as
+/// (offset, byte width) pairs
+fn split_into_scalar_accesses(byte_size: u32) -> Vec<(u32, u32)> {
+    let mut accesses = Vec::new();
+    let mut offset = 0;
+    for width in [8, 4, 2, 1] {
+        while byte_size - offset >= width {
+            accesses.push((offset, width));
+            offset += width;
+        }
+    }
+    accesses
+}
+
+/// Insert instructions to copy the value of a struct or union var to the address
+/// that load_dest_addr puts on the stack
+pub fn copy_aggregate_var_to_address(
+    var_id: &VarId,
+    load_dest_addr: impl Fn(&mut Vec<WasmInstruction>),
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    let byte_size = get_aggregate_byte_size(var_id, prog_metadata);
+    copy_memory(
+        load_dest_addr,
+        |instrs| {
+            load_var_address(
+                var_id,
+                instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            )
+        },
+        byte_size,
+        wasm_instrs,
+        module_context,
+    );
+}
+
+/// Insert instructions to copy the struct or union at the address that load_src_addr
+/// puts on the stack into a var
+pub fn copy_aggregate_from_address_to_var(
+    var_id: &VarId,
+    load_src_addr: impl Fn(&mut Vec<WasmInstruction>),
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    // ignore stores to the null dest
+    if prog_metadata.is_var_the_null_dest(var_id) {
+        return;
+    }
+
+    let byte_size = get_aggregate_byte_size(var_id, prog_metadata);
+    copy_memory(
+        |instrs| {
+            load_var_address(
+                var_id,
+                instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            )
+        },
+        load_src_addr,
+        byte_size,
+        wasm_instrs,
+        module_context,
+    );
+}
+
+fn get_aggregate_byte_size(var_id: &VarId, prog_metadata: &ProgramMetadata) -> u32 {
+    prog_metadata
+        .get_var_byte_size(var_id)
+        .unwrap()
+        .get_compile_time_value()
+        .unwrap() as u32
+}
+
+/// Grow the memory by enough pages that the end address left on the wasm stack by
+/// load_end_addr_instrs is inside it, which is ceil(end addr / page size) minus the current
+/// number of pages. Leaves the result of memory.grow on the stack, which is -1 if it failed.
+/// The end address must be past the end of the current memory.
+pub fn grow_memory_to_fit(
+    mut load_end_addr_instrs: Vec<WasmInstruction>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+) {
+    wasm_instrs.append(&mut load_end_addr_instrs);
+    wasm_instrs.push(WasmInstruction::I32Const { n: 1 });
+    wasm_instrs.push(WasmInstruction::I32Sub);
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: WASM_PAGE_SIZE.trailing_zeros() as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32ShrU);
+    wasm_instrs.push(WasmInstruction::I32Const { n: 1 });
+    wasm_instrs.push(WasmInstruction::I32Add);
+    wasm_instrs.push(WasmInstruction::MemorySize);
+    wasm_instrs.push(WasmInstruction::I32Sub);
+    wasm_instrs.push(WasmInstruction::MemoryGrow);
+}
+
+/// Load the address of the end of the memory onto the wasm stack
+pub fn load_memory_end_addr(wasm_instrs: &mut Vec<WasmInstruction>) {
+    wasm_instrs.push(WasmInstruction::MemorySize);
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: WASM_PAGE_SIZE.trailing_zeros() as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Shl);
+}
@@ -0,0 +1,367 @@
+#[cfg(test)]
+#[path = "peephole_optimisation_tests.rs"]
+mod peephole_optimisation_tests;
+
+use std::mem;
+
+use crate::back_end::wasm_instructions::{MemArg, WasmExpression, WasmInstruction};
+
+/// Simplify short sequences of wasm instructions, that the code generation creates because it
+/// converts each IR instruction separately.
+///
+/// Each instruction is pushed onto the optimised instructions in turn, and then the end of the
+/// optimised instructions is simplified as much as possible. None of the sequences contain
+/// control instructions, so they always run straight through. Nested blocks are optimised
+/// separately.
+pub fn optimise_wasm_expression(expression: &mut WasmExpression) {
+    expression.instrs = optimise_wasm_instrs(mem::take(&mut expression.instrs));
+}
+
+fn optimise_wasm_instrs(instrs: Vec<WasmInstruction>) -> Vec<WasmInstruction> {
+    let mut optimised_instrs = Vec::with_capacity(instrs.len());
+    for mut instr in instrs {
+        match &mut instr {
+            WasmInstruction::Block { instrs, .. } | WasmInstruction::Loop { instrs, .. } => {
+                *instrs = optimise_wasm_instrs(mem::take(instrs));
+            }
+            WasmInstruction::IfElse {
+                if_instrs,
+                else_instrs,
+                ..
+            } => {
+                *if_instrs = optimise_wasm_instrs(mem::take(if_instrs));
+                *else_instrs = optimise_wasm_instrs(mem::take(else_instrs));
+            }
+            _ => {}
+        }
+        optimised_instrs.push(instr);
+        while simplify_end_of_instrs(&mut optimised_instrs) {}
+    }
+    optimised_instrs
+}
+
+/// Returns true if the end of the instructions was changed
+fn simplify_end_of_instrs(instrs: &mut Vec<WasmInstruction>) -> bool {
+    remove_add_zero(instrs)
+        || remove_dropped_value(instrs)
+        || remove_self_assignment(instrs)
+        || replace_set_and_get_with_tee(instrs)
+        || fold_address_offset_into_load(instrs)
+        || fold_address_offset_into_store(instrs)
+        || forward_stored_value_to_load(instrs)
+        || merge_global_increments(instrs)
+}
+
+/// `i32.const 0` `i32.add` leaves the value underneath unchanged
+fn remove_add_zero(instrs: &mut Vec<WasmInstruction>) -> bool {
+    match instrs.as_slice() {
+        [.., WasmInstruction::I32Const { n: 0 }, WasmInstruction::I32Add]
+        | [.., WasmInstruction::I64Const { n: 0 }, WasmInstruction::I64Add] => {
+            instrs.truncate(instrs.len() - 2);
+            true
+        }
+        _ => false,
+    }
+}
+
+/// A value that is dropped straight away doesn't need to be loaded
+fn remove_dropped_value(instrs: &mut Vec<WasmInstruction>) -> bool {
+    match instrs.as_slice() {
+        [.., WasmInstruction::LocalTee { local_idx }, WasmInstruction::Drop] => {
+            let local_idx = local_idx.to_owned();
+            instrs.truncate(instrs.len() - 2);
+            instrs.push(WasmInstruction::LocalSet { local_idx });
+            true
+        }
+        [.., value, WasmInstruction::Drop] if clone_pure_value(value).is_some() => {
+            instrs.truncate(instrs.len() - 2);
+            true
+        }
+        _ => false,
+    }
+}
+
+/// Setting a variable to its own value does nothing
+fn remove_self_assignment(instrs: &mut Vec<WasmInstruction>) -> bool {
+    match instrs.as_slice() {
+        [.., WasmInstruction::LocalGet { local_idx: get_idx }, WasmInstruction::LocalSet { local_idx: set_idx }]
+            if get_idx == set_idx =>
+        {
+            instrs.truncate(instrs.len() - 2);
+            true
+        }
+        [.., WasmInstruction::GlobalGet {
+            global_idx: get_idx,
+        }, WasmInstruction::GlobalSet {
+            global_idx: set_idx,
+        }] if get_idx == set_idx => {
+            instrs.truncate(instrs.len() - 2);
+            true
+        }
+        _ => false,
+    }
+}
+
+/// Storing a value to a local and immediately loading it again is the same as `local.tee`
+fn replace_set_and_get_with_tee(instrs: &mut Vec<WasmInstruction>) -> bool {
+    match instrs.as_slice() {
+        [.., WasmInstruction::LocalSet { local_idx: set_idx }, WasmInstruction::LocalGet { local_idx: get_idx }]
+            if set_idx == get_idx =>
+        {
+            let local_idx = set_idx.to_owned();
+            instrs.truncate(instrs.len() - 2);
+            instrs.push(WasmInstruction::LocalTee { local_idx });
+            true
+        }
+        _ => false,
+    }
+}
+
+/// `i32.const n` `i32.add` before a load adds n to its address, which the load can do itself
+/// with its offset
+fn fold_address_offset_into_load(instrs: &mut Vec<WasmInstruction>) -> bool {
+    let n = match instrs.as_slice() {
+        [.., WasmInstruction::I32Const { n }, WasmInstruction::I32Add, load] if is_load(load) => {
+            n.to_owned()
+        }
+        _ => return false,
+    };
+    let mut load = instrs.pop().unwrap();
+    if !add_to_mem_arg_offset(&mut load, n) {
+        instrs.push(load);
+        return false;
+    }
+    instrs.truncate(instrs.len() - 2);
+    instrs.push(load);
+    true
+}
+
+/// The address of a store is underneath the value to store, so the address offset can only be
+/// folded into the store if the value is a single instruction
+fn fold_address_offset_into_store(instrs: &mut Vec<WasmInstruction>) -> bool {
+    let n = match instrs.as_slice() {
+        [.., WasmInstruction::I32Const { n }, WasmInstruction::I32Add, value, store]
+            if is_store(store) && clone_pure_value(value).is_some() =>
+        {
+            n.to_owned()
+        }
+        _ => return false,
+    };
+    let mut store = instrs.pop().unwrap();
+    if !add_to_mem_arg_offset(&mut store, n) {
+        instrs.push(store);
+        return false;
+    }
+    let value = instrs.pop().unwrap();
+    instrs.truncate(instrs.len() - 2);
+    instrs.push(value);
+    instrs.push(store);
+    true
+}
+
+/// Loading from the address that was just stored to gives the value that was stored, so if
+/// the value is a single instruction it can be used again instead of the load. This is how
+/// variables in the stack frame (and the frame pointer, when it is kept in memory) get
+/// reloaded straight after they are stored to.
+fn forward_stored_value_to_load(instrs: &mut Vec<WasmInstruction>) -> bool {
+    let value = match instrs.as_slice() {
+        [.., store_addr, value, store, load_addr, load]
+            if is_same_address(store_addr, load_addr) && is_reload_of_stored_value(store, load) =>
+        {
+            match clone_pure_value(value) {
+                Some(value) => value,
+                None => return false,
+            }
+        }
+        _ => return false,
+    };
+    instrs.truncate(instrs.len() - 2);
+    instrs.push(value);
+    true
+}
+
+/// Incrementing a global (the stack pointer) twice in a row can be done with one increment
+fn merge_global_increments(instrs: &mut Vec<WasmInstruction>) -> bool {
+    let (global_idx, increment) = match instrs.as_slice() {
+        [.., WasmInstruction::GlobalGet {
+            global_idx: get_idx1,
+        }, WasmInstruction::I32Const { n: n1 }, WasmInstruction::I32Add, WasmInstruction::GlobalSet {
+            global_idx: set_idx1,
+        }, WasmInstruction::GlobalGet {
+            global_idx: get_idx2,
+        }, WasmInstruction::I32Const { n: n2 }, WasmInstruction::I32Add, WasmInstruction::GlobalSet {
+            global_idx: set_idx2,
+        }] if get_idx1 == set_idx1 && set_idx1 == get_idx2 && get_idx2 == set_idx2 => {
+            (get_idx1.to_owned(), n1.wrapping_add(*n2))
+        }
+        _ => return false,
+    };
+    instrs.truncate(instrs.len() - 8);
+    if increment != 0 {
+        instrs.push(WasmInstruction::GlobalGet {
+            global_idx: global_idx.to_owned(),
+        });
+        instrs.push(WasmInstruction::I32Const { n: increment });
+        instrs.push(WasmInstruction::I32Add);
+        instrs.push(WasmInstruction::GlobalSet { global_idx });
+    }
+    true
+}
+
+/// A copy of the instruction, if it pushes a single value without popping anything or having
+/// any side effects
+fn clone_pure_value(instr: &WasmInstruction) -> Option<WasmInstruction> {
+    match instr {
+        WasmInstruction::LocalGet { local_idx } => Some(WasmInstruction::LocalGet {
+            local_idx: local_idx.to_owned(),
+        }),
+        WasmInstruction::GlobalGet { global_idx } => Some(WasmInstruction::GlobalGet {
+            global_idx: global_idx.to_owned(),
+        }),
+        WasmInstruction::I32Const { n } => Some(WasmInstruction::I32Const { n: *n }),
+        WasmInstruction::I64Const { n } => Some(WasmInstruction::I64Const { n: *n }),
+        WasmInstruction::F32Const { z } => Some(WasmInstruction::F32Const { z: *z }),
+        WasmInstruction::F64Const { z } => Some(WasmInstruction::F64Const { z: *z }),
+        _ => None,
+    }
+}
+
+/// Whether the two instructions always push the same address, as long as no locals or
+/// globals are set in between
+fn is_same_address(instr1: &WasmInstruction, instr2: &WasmInstruction) -> bool {
+    match (instr1, instr2) {
+        (
+            WasmInstruction::LocalGet { local_idx: idx1 },
+            WasmInstruction::LocalGet { local_idx: idx2 },
+        ) => idx1 == idx2,
+        (
+            WasmInstruction::GlobalGet { global_idx: idx1 },
+            WasmInstruction::GlobalGet { global_idx: idx2 },
+        ) => idx1 == idx2,
+        (WasmInstruction::I32Const { n: n1 }, WasmInstruction::I32Const { n: n2 }) => n1 == n2,
+        _ => false,
+    }
+}
+
+/// Whether the load reads back exactly the value written by the store, when they use the same
+/// address. Narrow stores truncate the value, so only full width loads and stores count.
+fn is_reload_of_stored_value(store: &WasmInstruction, load: &WasmInstruction) -> bool {
+    match (store, load) {
+        (
+            WasmInstruction::I32Store {
+                mem_arg: store_mem_arg,
+            },
+            WasmInstruction::I32Load {
+                mem_arg: load_mem_arg,
+            },
+        )
+        | (
+            WasmInstruction::I64Store {
+                mem_arg: store_mem_arg,
+            },
+            WasmInstruction::I64Load {
+                mem_arg: load_mem_arg,
+            },
+        )
+        | (
+            WasmInstruction::F32Store {
+                mem_arg: store_mem_arg,
+            },
+            WasmInstruction::F32Load {
+                mem_arg: load_mem_arg,
+            },
+        )
+        | (
+            WasmInstruction::F64Store {
+                mem_arg: store_mem_arg,
+            },
+            WasmInstruction::F64Load {
+                mem_arg: load_mem_arg,
+            },
+        ) => store_mem_arg.offset == load_mem_arg.offset,
+        _ => false,
+    }
+}
+
+/// Add n to the offset of a load or store. The offset is unsigned, so negative values can't be
+/// folded in. Returns false if the offset wasn't changed.
+fn add_to_mem_arg_offset(instr: &mut WasmInstruction, n: i32) -> bool {
+    let mem_arg = match get_mem_arg_mut(instr) {
+        Some(mem_arg) => mem_arg,
+        None => return false,
+    };
+    if n < 0 {
+        return false;
+    }
+    match mem_arg.offset.checked_add(n as u32) {
+        Some(offset) => {
+            mem_arg.offset = offset;
+            true
+        }
+        None => false,
+    }
+}
+
+fn is_load(instr: &WasmInstruction) -> bool {
+    matches!(
+        instr,
+        WasmInstruction::I32Load { .. }
+            | WasmInstruction::I64Load { .. }
+            | WasmInstruction::F32Load { .. }
+            | WasmInstruction::F64Load { .. }
+            | WasmInstruction::I32Load8S { .. }
+            | WasmInstruction::I32Load8U { .. }
+            | WasmInstruction::I32Load16S { .. }
+            | WasmInstruction::I32Load16U { .. }
+            | WasmInstruction::I64Load8S { .. }
+            | WasmInstruction::I64Load8U { .. }
+            | WasmInstruction::I64Load16S { .. }
+            | WasmInstruction::I64Load16U { .. }
+            | WasmInstruction::I64Load32S { .. }
+            | WasmInstruction::I64Load32U { .. }
+    )
+}
+
+fn is_store(instr: &WasmInstruction) -> bool {
+    matches!(
+        instr,
+        WasmInstruction::I32Store { .. }
+            | WasmInstruction::I64Store { .. }
+            | WasmInstruction::F32Store { .. }
+            | WasmInstruction::F64Store { .. }
+            | WasmInstruction::I32Store8 { .. }
+            | WasmInstruction::I32Store16 { .. }
+            | WasmInstruction::I64Store8 { .. }
+            | WasmInstruction::I64Store16 { .. }
+            | WasmInstruction::I64Store32 { .. }
+    )
+}
+
+fn get_mem_arg_mut(instr: &mut WasmInstruction) -> Option<&mut MemArg> {
+    match instr {
+        WasmInstruction::I32Load { mem_arg }
+        | WasmInstruction::I64Load { mem_arg }
+        | WasmInstruction::F32Load { mem_arg }
+        | WasmInstruction::F64Load { mem_arg }
+        | WasmInstruction::I32Load8S { mem_arg }
+        | WasmInstruction::I32Load8U { mem_arg }
+        | WasmInstruction::I32Load16S { mem_arg }
+        | WasmInstruction::I32Load16U { mem_arg }
+        | WasmInstruction::I64Load8S { mem_arg }
+        | WasmInstruction::I64Load8U { mem_arg }
+        | WasmInstruction::I64Load16S { mem_arg }
+        | WasmInstruction::I64Load16U { mem_arg }
+        | WasmInstruction::I64Load32S { mem_arg }
+        | WasmInstruction::I64Load32U { mem_arg }
+        | WasmInstruction::I32Store { mem_arg }
+        | WasmInstruction::I64Store { mem_arg }
+        | WasmInstruction::F32Store { mem_arg }
+        | WasmInstruction::F64Store { mem_arg }
+        | WasmInstruction::I32Store8 { mem_arg }
+        | WasmInstruction::I32Store16 { mem_arg }
+        | WasmInstruction::I64Store8 { mem_arg }
+        | WasmInstruction::I64Store16 { mem_arg }
+        | WasmInstruction::I64Store32 { mem_arg } => Some(mem_arg),
+        _ => None,
+    }
+}
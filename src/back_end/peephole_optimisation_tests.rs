@@ -0,0 +1,337 @@
+#[cfg(test)]
+mod peephole_optimisation_tests {
+    use super::super::optimise_wasm_instrs;
+    use crate::back_end::wasm_indices::{FuncIdx, GlobalIdx, LocalIdx, WasmIdx};
+    use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmInstruction};
+
+    fn local_get(x: u32) -> WasmInstruction {
+        WasmInstruction::LocalGet {
+            local_idx: LocalIdx { x },
+        }
+    }
+
+    fn local_set(x: u32) -> WasmInstruction {
+        WasmInstruction::LocalSet {
+            local_idx: LocalIdx { x },
+        }
+    }
+
+    fn local_tee(x: u32) -> WasmInstruction {
+        WasmInstruction::LocalTee {
+            local_idx: LocalIdx { x },
+        }
+    }
+
+    fn global_idx(x: u32) -> GlobalIdx {
+        let mut global_idx = GlobalIdx::initial_idx();
+        for _ in 0..x {
+            global_idx = global_idx.next_idx();
+        }
+        global_idx
+    }
+
+    fn global_get(x: u32) -> WasmInstruction {
+        WasmInstruction::GlobalGet {
+            global_idx: global_idx(x),
+        }
+    }
+
+    fn global_set(x: u32) -> WasmInstruction {
+        WasmInstruction::GlobalSet {
+            global_idx: global_idx(x),
+        }
+    }
+
+    fn i32_const(n: i32) -> WasmInstruction {
+        WasmInstruction::I32Const { n }
+    }
+
+    fn call() -> WasmInstruction {
+        WasmInstruction::Call {
+            func_idx: FuncIdx::initial_idx(),
+        }
+    }
+
+    fn mem_arg(offset: u32) -> MemArg {
+        MemArg::natural(4, offset)
+    }
+
+    fn i32_load(offset: u32) -> WasmInstruction {
+        WasmInstruction::I32Load {
+            mem_arg: mem_arg(offset),
+        }
+    }
+
+    fn i32_store(offset: u32) -> WasmInstruction {
+        WasmInstruction::I32Store {
+            mem_arg: mem_arg(offset),
+        }
+    }
+
+    /// WasmInstruction doesn't implement PartialEq, so the instructions are compared by
+    /// their debug output, which shows every field
+    fn assert_optimises_to(instrs: Vec<WasmInstruction>, expected: Vec<WasmInstruction>) {
+        let optimised = optimise_wasm_instrs(instrs);
+        assert_eq!(format!("{:?}", optimised), format!("{:?}", expected));
+    }
+
+    fn assert_unchanged(instrs: Vec<WasmInstruction>) {
+        let expected = format!("{:?}", instrs);
+        let optimised = optimise_wasm_instrs(instrs);
+        assert_eq!(format!("{:?}", optimised), expected);
+    }
+
+    #[test]
+    fn removes_add_zero() {
+        assert_optimises_to(
+            vec![local_get(0), i32_const(0), WasmInstruction::I32Add],
+            vec![local_get(0)],
+        );
+        assert_optimises_to(
+            vec![
+                local_get(0),
+                WasmInstruction::I64Const { n: 0 },
+                WasmInstruction::I64Add,
+            ],
+            vec![local_get(0)],
+        );
+        assert_unchanged(vec![local_get(0), i32_const(1), WasmInstruction::I32Add]);
+    }
+
+    #[test]
+    fn removes_dropped_value() {
+        assert_optimises_to(vec![local_get(0), WasmInstruction::Drop], vec![]);
+        assert_optimises_to(
+            vec![i32_const(1), local_tee(0), WasmInstruction::Drop],
+            vec![i32_const(1), local_set(0)],
+        );
+        // the call has side effects, so only its result can be dropped
+        assert_unchanged(vec![call(), WasmInstruction::Drop]);
+    }
+
+    #[test]
+    fn removes_self_assignment() {
+        assert_optimises_to(vec![local_get(1), local_set(1)], vec![]);
+        assert_optimises_to(vec![global_get(1), global_set(1)], vec![]);
+        assert_unchanged(vec![local_get(1), local_set(2)]);
+        assert_unchanged(vec![global_get(0), global_set(1)]);
+    }
+
+    #[test]
+    fn replaces_set_and_get_with_tee() {
+        assert_optimises_to(
+            vec![i32_const(5), local_set(0), local_get(0)],
+            vec![i32_const(5), local_tee(0)],
+        );
+        assert_unchanged(vec![i32_const(5), local_set(0), local_get(1)]);
+    }
+
+    #[test]
+    fn folds_address_offset_into_load() {
+        assert_optimises_to(
+            vec![
+                local_get(0),
+                i32_const(8),
+                WasmInstruction::I32Add,
+                i32_load(4),
+            ],
+            vec![local_get(0), i32_load(12)],
+        );
+    }
+
+    #[test]
+    fn does_not_fold_negative_or_overflowing_offset() {
+        // the offset is unsigned
+        assert_unchanged(vec![
+            local_get(0),
+            i32_const(-4),
+            WasmInstruction::I32Add,
+            i32_load(8),
+        ]);
+        assert_unchanged(vec![
+            local_get(0),
+            i32_const(8),
+            WasmInstruction::I32Add,
+            i32_load(u32::MAX - 4),
+        ]);
+        assert_unchanged(vec![
+            local_get(0),
+            i32_const(-4),
+            WasmInstruction::I32Add,
+            local_get(1),
+            i32_store(8),
+        ]);
+    }
+
+    #[test]
+    fn folds_address_offset_into_store() {
+        assert_optimises_to(
+            vec![
+                local_get(0),
+                i32_const(8),
+                WasmInstruction::I32Add,
+                local_get(1),
+                i32_store(0),
+            ],
+            vec![local_get(0), local_get(1), i32_store(8)],
+        );
+    }
+
+    #[test]
+    fn does_not_fold_address_offset_past_impure_value() {
+        // folding only moves the value if it's a single instruction without side effects
+        assert_unchanged(vec![
+            local_get(0),
+            i32_const(8),
+            WasmInstruction::I32Add,
+            call(),
+            i32_store(0),
+        ]);
+    }
+
+    #[test]
+    fn forwards_stored_value_to_load() {
+        assert_optimises_to(
+            vec![
+                local_get(0),
+                local_get(1),
+                i32_store(4),
+                local_get(0),
+                i32_load(4),
+            ],
+            vec![local_get(0), local_get(1), i32_store(4), local_get(1)],
+        );
+        assert_optimises_to(
+            vec![
+                i32_const(16),
+                WasmInstruction::F64Const { z: 1.5 },
+                WasmInstruction::F64Store {
+                    mem_arg: MemArg::natural(8, 0),
+                },
+                i32_const(16),
+                WasmInstruction::F64Load {
+                    mem_arg: MemArg::natural(8, 0),
+                },
+            ],
+            vec![
+                i32_const(16),
+                WasmInstruction::F64Const { z: 1.5 },
+                WasmInstruction::F64Store {
+                    mem_arg: MemArg::natural(8, 0),
+                },
+                WasmInstruction::F64Const { z: 1.5 },
+            ],
+        );
+    }
+
+    #[test]
+    fn does_not_forward_narrow_store_to_wider_load() {
+        // the store truncates the value to a byte
+        assert_unchanged(vec![
+            local_get(0),
+            local_get(1),
+            WasmInstruction::I32Store8 {
+                mem_arg: MemArg::natural(1, 0),
+            },
+            local_get(0),
+            i32_load(0),
+        ]);
+    }
+
+    #[test]
+    fn does_not_forward_impure_stored_value() {
+        assert_unchanged(vec![
+            local_get(0),
+            call(),
+            i32_store(0),
+            local_get(0),
+            i32_load(0),
+        ]);
+    }
+
+    #[test]
+    fn does_not_forward_to_load_of_different_address() {
+        assert_unchanged(vec![
+            local_get(0),
+            local_get(1),
+            i32_store(0),
+            local_get(0),
+            i32_load(4),
+        ]);
+        assert_unchanged(vec![
+            local_get(0),
+            local_get(1),
+            i32_store(0),
+            local_get(2),
+            i32_load(0),
+        ]);
+    }
+
+    #[test]
+    fn does_not_forward_past_intervening_store() {
+        // local 2 could hold the same address as local 0
+        assert_unchanged(vec![
+            local_get(0),
+            local_get(1),
+            i32_store(0),
+            local_get(2),
+            i32_const(5),
+            i32_store(0),
+            local_get(0),
+            i32_load(0),
+        ]);
+    }
+
+    #[test]
+    fn merges_global_increments() {
+        let increment = |n| {
+            vec![
+                global_get(0),
+                i32_const(n),
+                WasmInstruction::I32Add,
+                global_set(0),
+            ]
+        };
+        assert_optimises_to(
+            [increment(8), increment(4)].into_iter().flatten().collect(),
+            increment(12),
+        );
+        // increments that cancel out are removed
+        assert_optimises_to(
+            [increment(8), increment(-8)]
+                .into_iter()
+                .flatten()
+                .collect(),
+            vec![],
+        );
+        // different globals
+        assert_unchanged(
+            [
+                increment(8),
+                vec![
+                    global_get(1),
+                    i32_const(4),
+                    WasmInstruction::I32Add,
+                    global_set(1),
+                ],
+            ]
+            .into_iter()
+            .flatten()
+            .collect(),
+        );
+    }
+
+    #[test]
+    fn optimises_nested_blocks() {
+        assert_optimises_to(
+            vec![WasmInstruction::Block {
+                blocktype: BlockType::None,
+                instrs: vec![local_get(0), WasmInstruction::Drop],
+            }],
+            vec![WasmInstruction::Block {
+                blocktype: BlockType::None,
+                instrs: vec![],
+            }],
+        );
+    }
+}
@@ -1,7 +1,30 @@
-use crate::back_end::target_code_generation_context::ModuleContext;
-use crate::back_end::wasm_instructions::WasmInstruction;
+use std::collections::HashMap;
+use std::ops::Range;
+
+use crate::back_end::memory_constants::{
+    PROFILE_COUNTER_SIZE, PTR_SIZE, STACK_PTR_LOG_BUFFER_SAMPLES,
+};
+use crate::back_end::stack_frame_operations::load_stack_ptr;
+use crate::back_end::target_code_generation_context::{
+    BlockProfile, CallProfile, CallTiming, FunctionContext, ModuleContext, StackPtrLogBuffer,
+};
+use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmExpression, WasmInstruction};
+use crate::back_end::wasm_module::custom_section::CustomSection;
+use crate::back_end::wasm_module::exports_section::{ExportDescriptor, WasmExport};
+use crate::back_end::wasm_module::globals_section::WasmGlobal;
+use crate::back_end::wasm_module::module::WasmModule;
+use crate::back_end::wasm_types::{GlobalType, NumType, ValType};
+use crate::id::Id;
+use crate::middle_end::ids::{FunId, LabelId};
+use crate::middle_end::instructions::Instruction;
+use crate::middle_end::ir::ProgramMetadata;
 use crate::middle_end::ir_types::IrType;
-use crate::program_config::program_constants::LOG_STACK_PTR_IMPORT_NAME;
+use crate::program_config::program_constants::{
+    BLOCK_PROFILE_COUNTS_EXPORT_NAME, BLOCK_PROFILE_SECTION_NAME, CALL_PROFILE_COUNTS_EXPORT_NAME,
+    CALL_PROFILE_EDGE_EXPORT_NAME, CALL_PROFILE_ENTER_IMPORT_NAME, CALL_PROFILE_EXIT_IMPORT_NAME,
+    CALL_PROFILE_SECTION_NAME, FLUSH_STACK_PTR_LOG_IMPORT_NAME, STACK_PTR_LOG_NEXT_EXPORT_NAME,
+    STACK_PTR_LOG_START_EXPORT_NAME,
+};
 use crate::relooper::relooper::{ReloopedFunction, ReloopedProgram};
 
 pub fn initialise_profiler(module_context: &mut ModuleContext, prog: &mut ReloopedProgram) {
@@ -10,29 +33,161 @@ pub fn initialise_profiler(module_context: &mut ModuleContext, prog: &mut Reloop
         .enabled_profiling
         .is_stack_ptr_logging_enabled()
     {
-        // declare new fun for log fun
-        let log_stack_ptr_fun_id = prog
+        // declare the function that writes out the log buffer, and store its fun id
+        module_context.flush_stack_ptr_log_fun_id = Some(declare_imported_function(
+            prog,
+            FLUSH_STACK_PTR_LOG_IMPORT_NAME,
+        ));
+    }
+
+    // initialise call counting. The call edges are found before any functions that the
+    // profiler imports are declared, so calls to those aren't counted
+    if module_context.enabled_profiling.is_call_counting_enabled() {
+        let edges = get_call_edges(prog);
+        let edge_idxs = edges
+            .iter()
+            .enumerate()
+            .map(|(edge_idx, edge)| (edge.to_owned(), edge_idx as u32))
+            .collect();
+
+        let timing = if module_context.enabled_profiling.is_call_timing_enabled() {
+            Some(CallTiming {
+                enter_fun_id: declare_imported_function(prog, CALL_PROFILE_ENTER_IMPORT_NAME),
+                exit_fun_id: declare_imported_function(prog, CALL_PROFILE_EXIT_IMPORT_NAME),
+                current_edge: None,
+            })
+        } else {
+            None
+        };
+
+        module_context.call_profile = Some(CallProfile {
+            edges,
+            edge_idxs,
+            counts_start_addr: 0,
+            timing,
+        });
+    }
+
+    // initialise block counting, for the labels of every function the relooper numbered
+    if module_context.enabled_profiling.is_block_counting_enabled() {
+        let mut functions: Vec<(FunId, Range<u64>)> = prog
             .program_metadata
-            .new_fun_declaration(LOG_STACK_PTR_IMPORT_NAME.to_owned())
-            .unwrap();
+            .function_label_ranges
+            .iter()
+            .map(|(fun_id, label_range)| (fun_id.to_owned(), label_range.to_owned()))
+            .collect();
+        functions.sort_by_key(|(fun_id, _)| fun_id.as_u64());
 
-        // insert function stub to program
-        prog.program_blocks.functions.insert(
-            log_stack_ptr_fun_id.to_owned(),
-            ReloopedFunction {
-                block: None,
-                label_variable: None,
-                type_info: IrType::Function(Box::new(IrType::Void), Vec::new(), false),
-                param_var_mappings: Vec::new(),
-                body_is_defined: false,
-            },
-        );
+        let mut function_counters = HashMap::new();
+        let mut counter_count = 0;
+        for (fun_id, label_range) in &functions {
+            function_counters.insert(fun_id.to_owned(), (counter_count, label_range.to_owned()));
+            counter_count += (label_range.end - label_range.start) as u32;
+        }
+
+        module_context.block_profile = Some(BlockProfile {
+            functions,
+            function_counters,
+            counter_count,
+            counts_start_addr: 0,
+        });
+    }
+}
+
+/// Declares a function that the JS runtime provides for the profiler, and inserts a
+/// function stub for it into the program
+fn declare_imported_function(prog: &mut ReloopedProgram, name: &str) -> FunId {
+    let fun_id = prog
+        .program_metadata
+        .new_fun_declaration(name.to_owned())
+        .unwrap();
+
+    prog.program_blocks.functions.insert(
+        fun_id.to_owned(),
+        ReloopedFunction {
+            block: None,
+            label_variable: None,
+            type_info: IrType::Function(Box::new(IrType::Void), Vec::new(), false),
+            param_var_mappings: Vec::new(),
+            body_is_defined: false,
+        },
+    );
+    fun_id
+}
+
+/// Every (caller, callee) pair that has a call between them in the program, sorted so that
+/// the counters are in the same order every time the program is compiled
+fn get_call_edges(prog: &ReloopedProgram) -> Vec<(Option<FunId>, FunId)> {
+    let mut edges = Vec::new();
+    let mut add_edges_from = |caller: Option<FunId>, instr: &Instruction| match instr {
+        Instruction::Call(_, _, callee, _) | Instruction::TailCall(_, callee, _) => {
+            edges.push((caller, callee.to_owned()));
+        }
+        _ => {}
+    };
 
-        // store fun id in module context
-        module_context.log_stack_ptr_fun_id = Some(log_stack_ptr_fun_id);
+    if let Some(global_instrs) = &prog.program_blocks.global_instrs {
+        global_instrs.for_each_instr(&mut |instr| add_edges_from(None, instr));
     }
+    for (fun_id, function) in &prog.program_blocks.functions {
+        if let Some(block) = &function.block {
+            block.for_each_instr(&mut |instr| add_edges_from(Some(fun_id.to_owned()), instr));
+        }
+    }
+
+    edges.sort_by_key(|(caller, callee)| (caller.as_ref().map(Id::as_u64), callee.as_u64()));
+    edges.dedup();
+    edges
 }
 
+/// Reserves the stack pointer log buffer in memory at start_addr, and creates the globals
+/// that the JS runtime reads to find the samples in it. Returns the address after the buffer.
+pub fn initialise_stack_ptr_log_buffer(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    start_addr: u32,
+) -> u32 {
+    let end_addr = start_addr + STACK_PTR_LOG_BUFFER_SAMPLES * PTR_SIZE;
+
+    let mut new_ptr_global = |initial_value: u32, is_mutable: bool| {
+        wasm_module.insert_global(WasmGlobal {
+            global_type: GlobalType {
+                value_type: ValType::NumType(NumType::I32),
+                is_mutable,
+            },
+            init_expr: WasmExpression {
+                instrs: vec![WasmInstruction::I32Const {
+                    n: initial_value as i32,
+                }],
+            },
+        })
+    };
+    let start_ptr = new_ptr_global(start_addr, false);
+    let next_sample_ptr = new_ptr_global(start_addr, true);
+
+    wasm_module.exports_section.exports.push(WasmExport {
+        name: STACK_PTR_LOG_START_EXPORT_NAME.to_owned(),
+        export_descriptor: ExportDescriptor::Global {
+            global_idx: start_ptr,
+        },
+    });
+    wasm_module.exports_section.exports.push(WasmExport {
+        name: STACK_PTR_LOG_NEXT_EXPORT_NAME.to_owned(),
+        export_descriptor: ExportDescriptor::Global {
+            global_idx: next_sample_ptr.to_owned(),
+        },
+    });
+
+    module_context.stack_ptr_log_buffer = Some(StackPtrLogBuffer {
+        start_addr,
+        end_addr,
+        next_sample_ptr,
+    });
+    end_addr
+}
+
+/// Appends the current stack pointer to the log buffer. This is inline, and only calls out
+/// to the JS runtime when the buffer is full, so logging doesn't slow the program down much.
 pub fn log_stack_ptr(wasm_instrs: &mut Vec<WasmInstruction>, module_context: &ModuleContext) {
     // check if stack pointer logging is enabled
     if !module_context
@@ -41,13 +196,277 @@ pub fn log_stack_ptr(wasm_instrs: &mut Vec<WasmInstruction>, module_context: &Mo
     {
         return;
     }
-    if let Some(log_stack_ptr_fun_id) = &module_context.log_stack_ptr_fun_id {
-        let log_stack_ptr_func_idx = module_context
+    let (buffer, flush_fun_id) = match (
+        &module_context.stack_ptr_log_buffer,
+        &module_context.flush_stack_ptr_log_fun_id,
+    ) {
+        (Some(buffer), Some(flush_fun_id)) => (buffer, flush_fun_id),
+        _ => return,
+    };
+    let flush_func_idx = module_context
+        .fun_id_to_func_idx_map
+        .get(flush_fun_id)
+        .unwrap();
+
+    // store the stack ptr at the next sample
+    wasm_instrs.push(WasmInstruction::GlobalGet {
+        global_idx: buffer.next_sample_ptr.to_owned(),
+    });
+    load_stack_ptr(wasm_instrs, module_context);
+    wasm_instrs.push(WasmInstruction::I32Store {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+    // move on to the next sample
+    wasm_instrs.push(WasmInstruction::GlobalGet {
+        global_idx: buffer.next_sample_ptr.to_owned(),
+    });
+    wasm_instrs.push(WasmInstruction::I32Const { n: PTR_SIZE as i32 });
+    wasm_instrs.push(WasmInstruction::I32Add);
+    wasm_instrs.push(WasmInstruction::GlobalSet {
+        global_idx: buffer.next_sample_ptr.to_owned(),
+    });
+    // if the buffer is full, have the runtime write it out, and start filling it again
+    wasm_instrs.push(WasmInstruction::GlobalGet {
+        global_idx: buffer.next_sample_ptr.to_owned(),
+    });
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: buffer.end_addr as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Eq);
+    wasm_instrs.push(WasmInstruction::IfElse {
+        blocktype: BlockType::None,
+        if_instrs: vec![
+            WasmInstruction::Call {
+                func_idx: flush_func_idx.to_owned(),
+            },
+            WasmInstruction::I32Const {
+                n: buffer.start_addr as i32,
+            },
+            WasmInstruction::GlobalSet {
+                global_idx: buffer.next_sample_ptr.to_owned(),
+            },
+        ],
+        else_instrs: Vec::new(),
+    });
+}
+
+/// Reserves the call counters in memory at start_addr, creates the globals that the JS
+/// runtime reads to find them, and lists the call edges in a custom section. Returns the
+/// address after the counters.
+pub fn initialise_call_counters(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    prog_metadata: &ProgramMetadata,
+    start_addr: u32,
+) -> u32 {
+    let call_profile = match &mut module_context.call_profile {
+        Some(call_profile) => call_profile,
+        None => return start_addr,
+    };
+    call_profile.counts_start_addr = start_addr;
+    let end_addr = start_addr + call_profile.edges.len() as u32 * PROFILE_COUNTER_SIZE;
+
+    let mut new_i32_global = |initial_value: u32, is_mutable: bool, export_name: &str| {
+        let global_idx = wasm_module.insert_global(WasmGlobal {
+            global_type: GlobalType {
+                value_type: ValType::NumType(NumType::I32),
+                is_mutable,
+            },
+            init_expr: WasmExpression {
+                instrs: vec![WasmInstruction::I32Const {
+                    n: initial_value as i32,
+                }],
+            },
+        });
+        wasm_module.exports_section.exports.push(WasmExport {
+            name: export_name.to_owned(),
+            export_descriptor: ExportDescriptor::Global {
+                global_idx: global_idx.to_owned(),
+            },
+        });
+        global_idx
+    };
+    new_i32_global(start_addr, false, CALL_PROFILE_COUNTS_EXPORT_NAME);
+    if let Some(timing) = &mut call_profile.timing {
+        timing.current_edge = Some(new_i32_global(0, true, CALL_PROFILE_EDGE_EXPORT_NAME));
+    }
+
+    // one line per counter, with the names of the caller and callee
+    let fun_names = prog_metadata.get_function_names();
+    let mut contents = String::new();
+    for (caller, callee) in &call_profile.edges {
+        let caller_name = match caller {
+            Some(caller) => fun_names.get(caller).unwrap(),
+            None => "<global>",
+        };
+        contents.push_str(&format!(
+            "{} {}\n",
+            caller_name,
+            fun_names.get(callee).unwrap()
+        ));
+    }
+    wasm_module.custom_sections.push(CustomSection {
+        name: CALL_PROFILE_SECTION_NAME.to_owned(),
+        contents: contents.into_bytes(),
+    });
+
+    end_addr
+}
+
+/// Instruments a call that has just been converted, starting at call_instrs_start in
+/// wasm_instrs. The edge's counter is incremented right before the wasm call instruction,
+/// after the arguments have been set up. If calls are timed, the JS runtime is also called
+/// on either side of the call.
+pub fn profile_call(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    call_instrs_start: usize,
+    caller: &Option<FunId>,
+    callee: &FunId,
+    module_context: &ModuleContext,
+) {
+    let call_profile = match &module_context.call_profile {
+        Some(call_profile) => call_profile,
+        None => return,
+    };
+    let edge_idx = match call_profile
+        .edge_idxs
+        .get(&(caller.to_owned(), callee.to_owned()))
+    {
+        Some(edge_idx) => *edge_idx,
+        None => return,
+    };
+    let callee_func_idx = module_context.fun_id_to_func_idx_map.get(callee).unwrap();
+    let call_instr_idx = match wasm_instrs[call_instrs_start..].iter().position(
+        |instr| matches!(instr, WasmInstruction::Call { func_idx } | WasmInstruction::ReturnCall { func_idx } if func_idx == callee_func_idx),
+    ) {
+        Some(offset) => call_instrs_start + offset,
+        None => return,
+    };
+
+    let mut before_call = Vec::new();
+    increment_counter(
+        call_profile.counts_start_addr + edge_idx * PROFILE_COUNTER_SIZE,
+        &mut before_call,
+    );
+    let mut after_call = Vec::new();
+    if let Some(CallTiming {
+        enter_fun_id,
+        exit_fun_id,
+        current_edge: Some(current_edge),
+    }) = &call_profile.timing
+    {
+        before_call.push(WasmInstruction::I32Const { n: edge_idx as i32 });
+        before_call.push(WasmInstruction::GlobalSet {
+            global_idx: current_edge.to_owned(),
+        });
+        before_call.push(call_profiler_function(enter_fun_id, module_context));
+        after_call.push(call_profiler_function(exit_fun_id, module_context));
+    }
+
+    wasm_instrs.splice(call_instr_idx + 1..call_instr_idx + 1, after_call);
+    wasm_instrs.splice(call_instr_idx..call_instr_idx, before_call);
+}
+
+fn increment_counter(counter_addr: u32, wasm_instrs: &mut Vec<WasmInstruction>) {
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: counter_addr as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: counter_addr as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I64Load {
+        mem_arg: MemArg::natural(PROFILE_COUNTER_SIZE, 0),
+    });
+    wasm_instrs.push(WasmInstruction::I64Const { n: 1 });
+    wasm_instrs.push(WasmInstruction::I64Add);
+    wasm_instrs.push(WasmInstruction::I64Store {
+        mem_arg: MemArg::natural(PROFILE_COUNTER_SIZE, 0),
+    });
+}
+
+fn call_profiler_function(fun_id: &FunId, module_context: &ModuleContext) -> WasmInstruction {
+    WasmInstruction::Call {
+        func_idx: module_context
             .fun_id_to_func_idx_map
-            .get(log_stack_ptr_fun_id)
-            .unwrap();
-        wasm_instrs.push(WasmInstruction::Call {
-            func_idx: log_stack_ptr_func_idx.to_owned(),
-        })
+            .get(fun_id)
+            .unwrap()
+            .to_owned(),
     }
 }
+
+/// Reserves the block counters in memory at start_addr, creates the global that the JS
+/// runtime reads to find them, and lists how many counters each function has in a custom
+/// section. Returns the address after the counters.
+pub fn initialise_block_counters(
+    wasm_module: &mut WasmModule,
+    module_context: &mut ModuleContext,
+    prog_metadata: &ProgramMetadata,
+    start_addr: u32,
+) -> u32 {
+    let block_profile = match &mut module_context.block_profile {
+        Some(block_profile) => block_profile,
+        None => return start_addr,
+    };
+    block_profile.counts_start_addr = start_addr;
+    let end_addr = start_addr + block_profile.counter_count * PROFILE_COUNTER_SIZE;
+
+    let counts_start = wasm_module.insert_global(WasmGlobal {
+        global_type: GlobalType {
+            value_type: ValType::NumType(NumType::I32),
+            is_mutable: false,
+        },
+        init_expr: WasmExpression {
+            instrs: vec![WasmInstruction::I32Const {
+                n: start_addr as i32,
+            }],
+        },
+    });
+    wasm_module.exports_section.exports.push(WasmExport {
+        name: BLOCK_PROFILE_COUNTS_EXPORT_NAME.to_owned(),
+        export_descriptor: ExportDescriptor::Global {
+            global_idx: counts_start,
+        },
+    });
+
+    // one line per function, with its name and number of counters
+    let fun_names = prog_metadata.get_function_names();
+    let mut contents = String::new();
+    for (fun_id, label_range) in &block_profile.functions {
+        contents.push_str(&format!(
+            "{} {}\n",
+            fun_names.get(fun_id).unwrap(),
+            label_range.end - label_range.start
+        ));
+    }
+    wasm_module.custom_sections.push(CustomSection {
+        name: BLOCK_PROFILE_SECTION_NAME.to_owned(),
+        contents: contents.into_bytes(),
+    });
+
+    end_addr
+}
+
+/// Increments the counter for a label at the start of its block, if block counting is enabled
+pub fn count_block(
+    label: &LabelId,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+) {
+    let (block_profile, fun_id) = match (&module_context.block_profile, &function_context.fun_id) {
+        (Some(block_profile), Some(fun_id)) => (block_profile, fun_id),
+        _ => return,
+    };
+    let (first_counter_idx, label_range) = match block_profile.function_counters.get(fun_id) {
+        Some((first_counter_idx, label_range)) if label_range.contains(&label.as_u64()) => {
+            (*first_counter_idx, label_range)
+        }
+        _ => return,
+    };
+
+    let counter_idx = first_counter_idx + (label.as_u64() - label_range.start) as u32;
+    increment_counter(
+        block_profile.counts_start_addr + counter_idx * PROFILE_COUNTER_SIZE,
+        wasm_instrs,
+    );
+}
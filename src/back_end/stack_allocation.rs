@@ -2,7 +2,10 @@ pub mod allocate_vars;
 mod clash_interval_var_locations;
 mod get_vars_from_block;
 mod interval_tree_var_locations;
+mod linear_scan_allocation;
+pub mod local_promotion;
 mod naive_allocation;
 mod naive_var_locations;
 mod optimised_allocation;
+pub mod stack_size_estimate;
 mod var_locations;
@@ -1,30 +1,71 @@
-use std::collections::HashMap;
-
-use crate::back_end::memory_constants::PTR_SIZE;
+use crate::back_end::calling_convention::CallingConvention;
+use crate::back_end::memory_constants::{PTR_SIZE, STACK_FRAME_ALIGNMENT};
+use crate::back_end::memory_operations::store;
+use crate::back_end::stack_allocation::linear_scan_allocation::linear_scan_allocate_local_vars;
+use crate::back_end::stack_allocation::local_promotion::{
+    get_param_locals, promote_vars_to_locals, PromotedLocals,
+};
 use crate::back_end::stack_allocation::naive_allocation::{
     naive_allocate_global_vars, naive_allocate_local_vars,
 };
 use crate::back_end::stack_allocation::optimised_allocation::optimised_allocate_local_vars;
+use crate::back_end::stack_frame_operations::{
+    check_stack_overflow, increment_stack_ptr_by_known_offset, load_frame_ptr,
+};
 use crate::back_end::target_code_generation_context::ModuleContext;
+use crate::back_end::wasm_indices::{LocalIdx, WasmIdx};
 use crate::back_end::wasm_instructions::WasmInstruction;
+use crate::data_structures::id_map::IdMap;
 use crate::middle_end::ids::VarId;
 use crate::middle_end::ir::ProgramMetadata;
 use crate::middle_end::ir_types::{IrType, TypeSize};
 use crate::program_config::enabled_optimisations::EnabledOptimisations;
 use crate::relooper::blocks::Block;
 
-pub type VariableAllocationMap = HashMap<VarId, u32>;
+pub type VariableAllocationMap = IdMap<VarId, u32>;
 
 pub fn allocate_local_vars(
     block: &mut Block,
     wasm_instrs: &mut Vec<WasmInstruction>,
     fun_type: IrType,
     fun_param_var_mappings: Vec<VarId>,
+    calling_convention: &CallingConvention,
     module_context: &ModuleContext,
-    prog_metadata: &mut ProgramMetadata,
+    prog_metadata: &ProgramMetadata,
     enabled_optimisations: &EnabledOptimisations,
-) -> VariableAllocationMap {
-    let mut var_offsets: VariableAllocationMap = HashMap::new();
+) -> (VariableAllocationMap, PromotedLocals) {
+    match calling_convention {
+        CallingConvention::StackFrame => stack_frame_allocate_local_vars(
+            block,
+            wasm_instrs,
+            fun_type,
+            fun_param_var_mappings,
+            module_context,
+            prog_metadata,
+            enabled_optimisations,
+        ),
+        CallingConvention::Native => native_allocate_local_vars(
+            block,
+            wasm_instrs,
+            fun_type,
+            fun_param_var_mappings,
+            module_context,
+            prog_metadata,
+            enabled_optimisations,
+        ),
+    }
+}
+
+fn stack_frame_allocate_local_vars(
+    block: &mut Block,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    fun_type: IrType,
+    fun_param_var_mappings: Vec<VarId>,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+    enabled_optimisations: &EnabledOptimisations,
+) -> (VariableAllocationMap, PromotedLocals) {
+    let mut var_offsets: VariableAllocationMap = IdMap::new();
     let mut offset = PTR_SIZE;
 
     let (return_type, param_types) = match fun_type {
@@ -55,41 +96,190 @@ pub fn allocate_local_vars(
         offset += param_byte_size as u32;
     }
 
-    if enabled_optimisations.is_stack_allocation_optimisation_enabled() {
-        optimised_allocate_local_vars(
+    // keep scalar vars that never have their address taken in wasm locals
+    let promoted_locals = if enabled_optimisations.is_local_promotion_enabled() {
+        promote_vars_to_locals(
             block,
             &fun_param_var_mappings,
-            offset,
-            var_offsets,
-            wasm_instrs,
-            module_context,
+            LocalIdx::initial_idx(),
             prog_metadata,
         )
     } else {
-        naive_allocate_local_vars(
-            block,
-            &fun_param_var_mappings,
-            offset,
-            var_offsets,
+        PromotedLocals::none()
+    };
+
+    // neither params nor promoted vars need space allocating for them in the stack frame
+    let mut vars_not_to_allocate = fun_param_var_mappings;
+    vars_not_to_allocate.append(&mut promoted_locals.promoted_vars());
+
+    let var_offsets = allocate_frame_vars(
+        block,
+        &vars_not_to_allocate,
+        offset,
+        var_offsets,
+        wasm_instrs,
+        module_context,
+        prog_metadata,
+        enabled_optimisations,
+    );
+
+    (var_offsets, promoted_locals)
+}
+
+fn native_allocate_local_vars(
+    block: &mut Block,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    fun_type: IrType,
+    fun_param_var_mappings: Vec<VarId>,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+    enabled_optimisations: &EnabledOptimisations,
+) -> (VariableAllocationMap, PromotedLocals) {
+    // the stack frame only holds the previous frame ptr before the vars,
+    // because params and the return value are passed natively
+    let mut var_offsets: VariableAllocationMap = IdMap::new();
+    let mut offset = PTR_SIZE;
+
+    let param_types = match fun_type {
+        IrType::Function(_, param_types, _) => param_types,
+        _ => unreachable!(),
+    };
+
+    let (param_local_idxs, address_taken_params) = get_param_locals(block, &fun_param_var_mappings);
+
+    // params whose address is taken need a slot in the stack frame, which they're
+    // copied into from their local on entry to the function
+    let mut address_taken_params_byte_size = 0;
+    for (param_var, param_local_idx) in &address_taken_params {
+        let param_type = param_types.get(param_local_idx.x as usize).unwrap();
+        let param_byte_size = match param_type.get_byte_size(prog_metadata) {
+            TypeSize::CompileTime(size) => size,
+            TypeSize::Runtime(_) => {
+                unreachable!()
+            }
+        };
+        var_offsets.insert(param_var.to_owned(), offset);
+        offset += param_byte_size as u32;
+        address_taken_params_byte_size += param_byte_size as u32;
+    }
+    if address_taken_params_byte_size > 0 {
+        increment_stack_ptr_by_known_offset(
+            address_taken_params_byte_size,
             wasm_instrs,
             module_context,
+        );
+    }
+    for (param_var, param_local_idx) in &address_taken_params {
+        let param_type = param_types.get(param_local_idx.x as usize).unwrap();
+        // address operand
+        load_frame_ptr(wasm_instrs, module_context);
+        wasm_instrs.push(WasmInstruction::I32Const {
+            n: *var_offsets.get(param_var).unwrap() as i32,
+        });
+        wasm_instrs.push(WasmInstruction::I32Add);
+        // value to store
+        wasm_instrs.push(WasmInstruction::LocalGet {
+            local_idx: param_local_idx.to_owned(),
+        });
+        store(param_type, wasm_instrs);
+    }
+
+    // keep scalar vars that never have their address taken in wasm locals,
+    // after the locals used for params
+    let first_local_idx = LocalIdx {
+        x: fun_param_var_mappings.len() as u32,
+    };
+    let mut promoted_locals = if enabled_optimisations.is_local_promotion_enabled() {
+        promote_vars_to_locals(
+            block,
+            &fun_param_var_mappings,
+            first_local_idx,
             prog_metadata,
         )
-    }
+    } else {
+        PromotedLocals::none()
+    };
+
+    // neither params nor promoted vars need space allocating for them in the stack frame
+    let mut vars_not_to_allocate = fun_param_var_mappings;
+    vars_not_to_allocate.append(&mut promoted_locals.promoted_vars());
+
+    let var_offsets = allocate_frame_vars(
+        block,
+        &vars_not_to_allocate,
+        offset,
+        var_offsets,
+        wasm_instrs,
+        module_context,
+        prog_metadata,
+        enabled_optimisations,
+    );
+
+    promoted_locals.var_local_idxs.extend(param_local_idxs);
+
+    (var_offsets, promoted_locals)
 }
 
-pub fn allocate_global_vars(
-    block: &Block,
-    initial_top_of_stack_addr: u32,
+fn allocate_frame_vars(
+    block: &mut Block,
+    vars_not_to_allocate: &Vec<VarId>,
+    start_offset: u32,
+    var_offsets: VariableAllocationMap,
     wasm_instrs: &mut Vec<WasmInstruction>,
     module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
+    enabled_optimisations: &EnabledOptimisations,
 ) -> VariableAllocationMap {
-    naive_allocate_global_vars(
-        block,
-        initial_top_of_stack_addr,
+    // the frame starts aligned, so aligning the start of the vars lets the allocators align
+    // each var to its type by aligning its offset
+    let vars_start_offset = start_offset.next_multiple_of(STACK_FRAME_ALIGNMENT);
+    let (var_offsets, vars_byte_size) =
+        if !enabled_optimisations.is_stack_allocation_optimisation_enabled() {
+            naive_allocate_local_vars(
+                block,
+                vars_not_to_allocate,
+                vars_start_offset,
+                var_offsets,
+                prog_metadata,
+            )
+        } else if enabled_optimisations.is_linear_scan_allocation_enabled() {
+            linear_scan_allocate_local_vars(
+                block,
+                vars_not_to_allocate,
+                vars_start_offset,
+                var_offsets,
+                prog_metadata,
+            )
+        } else {
+            optimised_allocate_local_vars(
+                block,
+                vars_not_to_allocate,
+                vars_start_offset,
+                var_offsets,
+                prog_metadata,
+            )
+        };
+
+    // update stack pointer to after allocated vars, keeping it aligned for the next frame
+    let frame_end_offset =
+        (vars_start_offset + vars_byte_size).next_multiple_of(STACK_FRAME_ALIGNMENT);
+    increment_stack_ptr_by_known_offset(
+        frame_end_offset - start_offset,
         wasm_instrs,
         module_context,
-        prog_metadata,
-    )
+    );
+
+    // the stack frame is the last of the stack to be allocated when calling a function, so
+    // this is where deep recursion overflows the stack
+    check_stack_overflow(wasm_instrs, module_context);
+
+    var_offsets
+}
+
+pub fn allocate_global_vars(
+    block: &Block,
+    start_addr: u32,
+    prog_metadata: &ProgramMetadata,
+) -> (VariableAllocationMap, u32) {
+    naive_allocate_global_vars(block, start_addr, prog_metadata)
 }
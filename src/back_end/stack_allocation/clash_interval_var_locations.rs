@@ -1,7 +1,7 @@
 use std::cmp::Ordering;
 use std::collections::HashSet;
 
-use crate::back_end::dataflow_analysis::clash_graph::ClashGraph;
+use crate::back_end::dataflow_analysis::clash_graph::{ClashGraph, ClashSet};
 use crate::back_end::stack_allocation::var_locations::{VarLocation, VarLocations};
 use crate::middle_end::ids::VarId;
 
@@ -60,6 +60,7 @@ impl VarLocations for ClashIntervalVarLocations {
         &self,
         var: VarId,
         byte_size: u64,
+        alignment: u32,
         clash_graph: &ClashGraph,
     ) -> VarLocation {
         let mut lowest_possible_location = VarLocation {
@@ -90,7 +91,8 @@ impl VarLocations for ClashIntervalVarLocations {
                             // if so, move lowest_possible_location past the end of the interval it clashes with, and restart the while loop
                             if does_clash {
                                 // move lowest_possible_location
-                                lowest_possible_location.start = clash_interval.end + 1;
+                                lowest_possible_location.start =
+                                    (clash_interval.end + 1).next_multiple_of(alignment);
                                 continue 'outer;
                             }
                         }
@@ -109,7 +111,6 @@ impl VarLocations for ClashIntervalVarLocations {
             start: location.start,
             end: location.end_inclusive(),
             clashes: clash_graph.get_all_clashes(&location.var),
-            universal_clash: clash_graph.does_var_clash_universally(&location.var),
         };
         self.insert_clash_interval(clash_interval);
         self.locations.insert(location);
@@ -121,8 +122,7 @@ struct ClashInterval {
     start: u32,
     // inclusive
     end: u32,
-    clashes: HashSet<VarId>,
-    universal_clash: bool,
+    clashes: ClashSet,
 }
 
 impl ClashInterval {
@@ -135,14 +135,11 @@ impl ClashInterval {
     }
 
     fn does_var_clash(&self, var: &VarId, clash_graph: &ClashGraph) -> bool {
-        self.clashes.contains(var)
-            || self.universal_clash
-            || clash_graph.does_var_clash_universally(var)
+        self.clashes.contains(var, clash_graph) || clash_graph.does_var_clash_universally(var)
     }
 
     fn merge(&mut self, other: Self) {
-        self.clashes.extend(other.clashes);
-        self.universal_clash |= other.universal_clash;
+        self.clashes.merge(other.clashes);
     }
 }
 
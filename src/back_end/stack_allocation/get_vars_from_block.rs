@@ -1,15 +1,14 @@
 use std::collections::HashMap;
 
-use crate::middle_end::ids::VarId;
+use crate::middle_end::ids::{TypeId, VarId};
 use crate::middle_end::instructions::Instruction;
 use crate::middle_end::ir::ProgramMetadata;
-use crate::middle_end::ir_types::IrType;
 use crate::relooper::blocks::Block;
 
 pub fn get_vars_from_block(
     block: &Block,
     prog_metadata: &ProgramMetadata,
-) -> HashMap<VarId, IrType> {
+) -> HashMap<VarId, TypeId> {
     match block {
         Block::Simple { internal, next } => {
             let mut vars = get_vars_from_instrs(&internal.instrs, prog_metadata);
@@ -57,7 +56,7 @@ pub fn get_vars_from_block(
 fn get_vars_from_instrs(
     instrs: &Vec<Instruction>,
     prog_metadata: &ProgramMetadata,
-) -> HashMap<VarId, IrType> {
+) -> HashMap<VarId, TypeId> {
     let mut vars = HashMap::new();
 
     for instr in instrs {
@@ -65,6 +64,7 @@ fn get_vars_from_instrs(
             Instruction::SimpleAssignment(_, dest, _)
             | Instruction::LoadFromAddress(_, dest, _)
             | Instruction::StoreToAddress(_, dest, _)
+            | Instruction::ZeroMemory(_, dest, _)
             | Instruction::DeclareVariable(_, dest)
             | Instruction::AllocateVariable(_, dest, _)
             | Instruction::AddressOf(_, dest, _)
@@ -130,7 +130,7 @@ fn get_vars_from_instrs(
                 if prog_metadata.is_var_the_null_dest(dest) {
                     continue;
                 }
-                let dest_type = prog_metadata.get_var_type(dest).unwrap();
+                let dest_type = prog_metadata.get_var_type_id(dest).unwrap();
                 vars.insert(dest.to_owned(), dest_type);
                 // vars.push((dest.to_owned(), dest_type));
             }
@@ -150,6 +150,11 @@ fn get_vars_from_instrs(
                 vars.extend(get_vars_from_instrs(instrs1, prog_metadata));
                 vars.extend(get_vars_from_instrs(instrs2, prog_metadata));
             }
+            Instruction::BrTable(_, _, _, arms) => {
+                for arm in arms {
+                    vars.extend(get_vars_from_instrs(arm, prog_metadata));
+                }
+            }
         }
     }
 
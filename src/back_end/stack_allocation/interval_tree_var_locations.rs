@@ -4,37 +4,31 @@ use std::fmt::Formatter;
 
 use log::debug;
 
-use crate::back_end::dataflow_analysis::clash_graph::ClashGraph;
+use crate::back_end::dataflow_analysis::clash_graph::{ClashGraph, ClashSet};
 use crate::back_end::stack_allocation::var_locations::{VarLocation, VarLocations};
 use crate::data_structures::interval_tree::{Interval, IntervalTree, Mergeable};
 use crate::middle_end::ids::VarId;
 
 struct ClashList {
-    clashes: HashSet<VarId>,
-    universal_clash: bool,
+    clashes: ClashSet,
 }
 
 impl ClashList {
-    fn clashes_with(&self, var: &VarId) -> bool {
-        self.universal_clash || self.clashes.contains(var)
+    fn clashes_with(&self, var: &VarId, clash_graph: &ClashGraph) -> bool {
+        self.clashes.contains(var, clash_graph)
     }
 }
 
 impl Mergeable for ClashList {
     fn merge(&mut self, other: Self) {
-        self.clashes.extend(other.clashes);
-        debug!("data: {:?}", self.clashes);
-        self.universal_clash |= other.universal_clash;
+        self.clashes.merge(other.clashes);
+        debug!("data: {}", self.clashes);
     }
 }
 
 impl fmt::Display for ClashList {
     fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
-        write!(f, "clashes: ")?;
-        for var in &self.clashes {
-            write!(f, "{var}, ")?;
-        }
-        write!(f, "; universal clash: {}", self.universal_clash)
+        write!(f, "{}", self.clashes)
     }
 }
 
@@ -74,6 +68,7 @@ impl VarLocations for IntervalTreeVarLocations {
         &self,
         var: VarId,
         byte_size: u64,
+        alignment: u32,
         clash_graph: &ClashGraph,
     ) -> VarLocation {
         let mut lowest_possible_location = VarLocation {
@@ -91,12 +86,14 @@ impl VarLocations for IntervalTreeVarLocations {
                 .find_overlaps(&lowest_possible_location.to_owned().into())
             {
                 debug!("{lowest_possible_location} overlaps with {interval} ({clashes})");
-                if clashes.clashes_with(&var) || clash_graph.does_var_clash_universally(&var) {
+                if clashes.clashes_with(&var, clash_graph)
+                    || clash_graph.does_var_clash_universally(&var)
+                {
                     debug!("clashes");
                     is_valid_allocation = false;
                     // move the var we're allocating to the next addr past the var it clashes with
                     // interval.end is inclusive
-                    lowest_possible_location.start = interval.end + 1;
+                    lowest_possible_location.start = (interval.end + 1).next_multiple_of(alignment);
                     // restart checking against all existing allocations, now that we've moved where
                     // we're trying to allocate to
                     break;
@@ -113,7 +110,6 @@ impl VarLocations for IntervalTreeVarLocations {
 
         let clashes = ClashList {
             clashes: clash_graph.get_all_clashes(&location.var),
-            universal_clash: clash_graph.does_var_clash_universally(&location.var),
         };
 
         self.interval_tree.insert_or_merge(interval, clashes);
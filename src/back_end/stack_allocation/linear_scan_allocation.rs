@@ -0,0 +1,117 @@
+#[cfg(test)]
+#[path = "linear_scan_allocation_tests.rs"]
+mod linear_scan_allocation_tests;
+
+use std::cmp::Reverse;
+use std::collections::{BTreeMap, BinaryHeap, HashSet};
+
+use log::debug;
+
+use crate::back_end::dataflow_analysis::dead_code_analysis::remove_dead_vars;
+use crate::back_end::dataflow_analysis::live_intervals::{find_live_intervals, LiveInterval};
+use crate::back_end::stack_allocation::allocate_vars::VariableAllocationMap;
+use crate::back_end::stack_allocation::get_vars_from_block::get_vars_from_block;
+use crate::back_end::stack_allocation::optimised_allocation::calculate_var_offsets;
+use crate::back_end::stack_allocation::var_locations::VarLocation;
+use crate::id::Id;
+use crate::middle_end::ids::VarId;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::relooper::blocks::Block;
+
+/// Allocate the vars in the order their live intervals start. A var is put at the lowest
+/// location that doesn't overlap a var whose interval hasn't ended yet.
+///
+/// This doesn't build a clash graph, so it's quicker than optimised_allocate_local_vars for
+/// functions with lots of vars, but vars in loops are live for the whole loop so can't
+/// share locations with anything else in it. Returns the byte size of the vars.
+pub fn linear_scan_allocate_local_vars(
+    block: &mut Block,
+    vars_not_to_allocate: &Vec<VarId>,
+    start_offset: u32,
+    var_offsets: VariableAllocationMap,
+    prog_metadata: &ProgramMetadata,
+) -> (VariableAllocationMap, u32) {
+    remove_dead_vars(block, prog_metadata);
+
+    debug!("removed dead vars: {}", block);
+
+    let live_intervals = find_live_intervals(block);
+
+    // get all vars used in this block -- all the variables to allocate
+    let mut vars_to_allocate = get_vars_from_block(block, prog_metadata);
+    // remove param vars, cos we don't need to allocate them again,
+    // and vars that have been promoted to wasm locals
+    for var in vars_not_to_allocate {
+        vars_to_allocate.remove(var);
+    }
+    // don't allocate the null dest
+    if let Some(null_dest) = &prog_metadata.null_dest_var {
+        vars_to_allocate.remove(null_dest);
+    }
+
+    let mut vars_by_interval: Vec<(LiveInterval, VarId, u32, u32)> = vars_to_allocate
+        .into_iter()
+        .map(|(var, var_type)| {
+            let byte_size = prog_metadata
+                .get_type_byte_size(var_type)
+                .get_compile_time_value()
+                .unwrap();
+            let alignment = prog_metadata.get_type_alignment(var_type);
+            (
+                live_intervals.get_interval(&var),
+                var,
+                byte_size as u32,
+                alignment,
+            )
+        })
+        .collect();
+    // sort by var id for ties, so the output is deterministic
+    vars_by_interval.sort_by_key(|(interval, var, _, _)| (interval.start, var.as_u64()));
+
+    let var_locations = allocate_vars_in_interval_order(vars_by_interval);
+
+    calculate_var_offsets(var_locations, var_offsets, start_offset)
+}
+
+fn allocate_vars_in_interval_order(
+    vars_by_interval: Vec<(LiveInterval, VarId, u32, u32)>,
+) -> HashSet<VarLocation> {
+    let mut var_locations = HashSet::new();
+    // the locations of the vars whose intervals haven't ended yet, as start -> end (exclusive)
+    let mut active_locations: BTreeMap<u32, u32> = BTreeMap::new();
+    // the start of each active location, in the order their intervals end
+    let mut active_interval_ends: BinaryHeap<Reverse<(usize, u32)>> = BinaryHeap::new();
+
+    for (interval, var, byte_size, alignment) in vars_by_interval {
+        // free the locations of vars that are no longer live
+        while let Some(Reverse((end, location_start))) = active_interval_ends.peek() {
+            if *end >= interval.start {
+                break;
+            }
+            active_locations.remove(location_start);
+            active_interval_ends.pop();
+        }
+
+        // find the lowest aligned gap between active locations that the var fits in
+        let mut start = 0;
+        for (location_start, location_end) in &active_locations {
+            if start + byte_size <= *location_start {
+                break;
+            }
+            start = start.max(location_end.next_multiple_of(alignment));
+        }
+
+        debug!("allocating var {var} at {start}");
+        if byte_size > 0 {
+            active_locations.insert(start, start + byte_size);
+            active_interval_ends.push(Reverse((interval.end, start)));
+        }
+        var_locations.insert(VarLocation {
+            var,
+            start,
+            byte_size,
+        });
+    }
+
+    var_locations
+}
@@ -0,0 +1,164 @@
+#[cfg(test)]
+mod linear_scan_allocation_tests {
+    use std::collections::HashSet;
+
+    use super::super::allocate_vars_in_interval_order;
+    use crate::back_end::dataflow_analysis::live_intervals::LiveInterval;
+    use crate::back_end::stack_allocation::var_locations::VarLocation;
+    use crate::id::{Id, IdGenerator};
+    use crate::middle_end::ids::VarId;
+
+    /// A var's live interval, byte size and alignment
+    struct TestVar {
+        start: usize,
+        end: usize,
+        byte_size: u32,
+        alignment: u32,
+    }
+
+    fn var(start: usize, end: usize, byte_size: u32, alignment: u32) -> TestVar {
+        TestVar {
+            start,
+            end,
+            byte_size,
+            alignment,
+        }
+    }
+
+    /// Allocate the vars, and return the location of each var in the same order
+    fn allocate(vars: &[TestVar]) -> Vec<VarLocation> {
+        let mut var_ids = IdGenerator::<VarId>::new();
+        let mut vars_by_interval: Vec<(LiveInterval, VarId, u32, u32)> = vars
+            .iter()
+            .map(|test_var| {
+                (
+                    LiveInterval {
+                        start: test_var.start,
+                        end: test_var.end,
+                    },
+                    var_ids.new_id(),
+                    test_var.byte_size,
+                    test_var.alignment,
+                )
+            })
+            .collect();
+        // the allocator expects the vars in the order their intervals start
+        vars_by_interval.sort_by_key(|(interval, var, _, _)| (interval.start, var.as_u64()));
+
+        let var_locations: HashSet<VarLocation> = allocate_vars_in_interval_order(vars_by_interval);
+        let mut var_locations: Vec<VarLocation> = var_locations.into_iter().collect();
+        var_locations.sort_by_key(|location| location.var.as_u64());
+        assert_eq!(var_locations.len(), vars.len());
+        var_locations
+    }
+
+    /// Vars whose live intervals overlap never share any bytes, and every var is aligned
+    fn assert_valid_allocation(vars: &[TestVar], locations: &[VarLocation]) {
+        for (i, (var, location)) in vars.iter().zip(locations).enumerate() {
+            assert_eq!(location.byte_size, var.byte_size);
+            assert_eq!(
+                location.start % var.alignment,
+                0,
+                "var {i} at {} isn't aligned to {}",
+                location.start,
+                var.alignment
+            );
+            for (j, (other_var, other_location)) in vars.iter().zip(locations).enumerate() {
+                let intervals_overlap = var.start <= other_var.end && other_var.start <= var.end;
+                if i != j && intervals_overlap {
+                    assert!(
+                        !location.overlaps(other_location),
+                        "vars {i} and {j} are live at the same time, but are at {location} and {other_location}"
+                    );
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn overlapping_intervals_get_separate_slots() {
+        let vars = [var(0, 10, 4, 4), var(5, 15, 4, 4), var(10, 20, 4, 4)];
+        let locations = allocate(&vars);
+        assert_valid_allocation(&vars, &locations);
+        // the first and last vars are both live at instr 10
+        assert_eq!(
+            locations.iter().map(|l| l.start).collect::<Vec<_>>(),
+            vec![0, 4, 8]
+        );
+    }
+
+    #[test]
+    fn disjoint_intervals_reuse_a_slot() {
+        let vars = [var(0, 4, 4, 4), var(5, 9, 4, 4), var(10, 14, 4, 4)];
+        let locations = allocate(&vars);
+        assert_valid_allocation(&vars, &locations);
+        assert!(locations.iter().all(|location| location.start == 0));
+    }
+
+    #[test]
+    fn freed_slot_too_small_for_a_bigger_var_is_not_reused() {
+        // the i32's slot is free when the i64 is allocated, but the i64 doesn't fit in it
+        // before the still live char
+        let vars = [var(0, 4, 4, 4), var(0, 20, 1, 1), var(5, 10, 8, 8)];
+        let locations = allocate(&vars);
+        assert_valid_allocation(&vars, &locations);
+        assert_eq!(locations[1].start, 4);
+        assert_eq!(locations[2].start, 8);
+    }
+
+    #[test]
+    fn vars_are_aligned_after_narrower_vars() {
+        let vars = [
+            var(0, 10, 1, 1),
+            var(0, 10, 2, 2),
+            var(0, 10, 8, 8),
+            var(0, 10, 4, 4),
+        ];
+        let locations = allocate(&vars);
+        assert_valid_allocation(&vars, &locations);
+        assert_eq!(locations[2].start % 8, 0);
+    }
+
+    #[test]
+    fn freed_gap_between_live_vars_is_reused_if_it_fits() {
+        // var 1's slot is between two vars that are still live when var 3 is allocated
+        let vars = [
+            var(0, 20, 4, 4),
+            var(0, 5, 8, 8),
+            var(0, 20, 4, 4),
+            var(6, 20, 8, 8),
+            var(7, 20, 16, 8),
+        ];
+        let locations = allocate(&vars);
+        assert_valid_allocation(&vars, &locations);
+        assert_eq!(locations[3].start, locations[1].start);
+    }
+
+    #[test]
+    fn many_vars_never_share_live_slots() {
+        // a fixed pseudorandom sequence, so the test is deterministic
+        let mut seed: u64 = 12345;
+        let mut next = |bound: u64| {
+            seed = seed
+                .wrapping_mul(6364136223846793005)
+                .wrapping_add(1442695040888963407);
+            (seed >> 33) % bound
+        };
+        let vars: Vec<TestVar> = (0..300)
+            .map(|_| {
+                let start = next(200) as usize;
+                let end = start + next(40) as usize;
+                let (byte_size, alignment) = match next(5) {
+                    0 => (1, 1),
+                    1 => (2, 2),
+                    2 => (4, 4),
+                    3 => (8, 8),
+                    _ => (next(24) as u32 + 1, 8),
+                };
+                var(start, end, byte_size, alignment)
+            })
+            .collect();
+        let locations = allocate(&vars);
+        assert_valid_allocation(&vars, &locations);
+    }
+}
@@ -0,0 +1,145 @@
+use log::debug;
+
+use crate::back_end::dataflow_analysis::clash_graph::get_address_taken_vars;
+use crate::back_end::dataflow_analysis::flowgraph::generate_flowgraph;
+use crate::back_end::stack_allocation::get_vars_from_block::get_vars_from_block;
+use crate::back_end::wasm_indices::{LocalIdx, WasmIdx};
+use crate::back_end::wasm_module::code_section::LocalDeclaration;
+use crate::back_end::wasm_types::{NumType, ValType};
+use crate::data_structures::id_map::IdMap;
+use crate::id::Id;
+use crate::middle_end::ids::VarId;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::IrType;
+use crate::relooper::blocks::Block;
+
+pub type LocalVariableMap = IdMap<VarId, LocalIdx>;
+
+pub struct PromotedLocals {
+    pub var_local_idxs: LocalVariableMap,
+    pub local_declarations: Vec<LocalDeclaration>,
+}
+
+impl PromotedLocals {
+    pub fn none() -> Self {
+        PromotedLocals {
+            var_local_idxs: IdMap::new(),
+            local_declarations: Vec::new(),
+        }
+    }
+
+    /// All the vars that live in wasm locals, and so don't need a stack frame slot
+    pub fn promoted_vars(&self) -> Vec<VarId> {
+        self.var_local_idxs
+            .keys()
+            .map(|var| var.to_owned())
+            .collect()
+    }
+}
+
+/// Find all the vars in the function that can be kept in wasm locals instead of the
+/// stack frame, and assign each of them a local index.
+///
+/// A var can be promoted if it has a scalar type, is not a param (where params live
+/// depends on the calling convention), and its address is never taken.
+pub fn promote_vars_to_locals(
+    block: &Block,
+    param_vars: &Vec<VarId>,
+    first_local_idx: LocalIdx,
+    prog_metadata: &ProgramMetadata,
+) -> PromotedLocals {
+    let vars = get_vars_from_block(block, prog_metadata);
+
+    // vars whose address is taken must stay in memory
+    let flowgraph = generate_flowgraph(block);
+    let address_taken_vars = get_address_taken_vars(&flowgraph);
+
+    let mut promotable_vars: Vec<(VarId, NumType)> = Vec::new();
+    for (var, var_type) in vars {
+        if param_vars.contains(&var) || address_taken_vars.contains(&var) {
+            continue;
+        }
+        if let Some(num_type) = get_local_num_type(prog_metadata.get_type(var_type)) {
+            promotable_vars.push((var, num_type));
+        }
+    }
+
+    // group locals of the same type together, so each group only needs one local
+    // declaration. Sort by var id within groups so the output is deterministic
+    promotable_vars.sort_by_key(|(var, num_type)| (num_type.to_owned(), var.as_u64()));
+
+    let mut var_local_idxs = IdMap::new();
+    let mut local_declarations: Vec<LocalDeclaration> = Vec::new();
+    let mut local_idx = first_local_idx;
+
+    for (var, num_type) in promotable_vars {
+        debug!("promoting var {} to local {:?}", var, local_idx);
+        var_local_idxs.insert(var, local_idx.to_owned());
+        local_idx = local_idx.next_idx();
+
+        let value_type = ValType::NumType(num_type);
+        match local_declarations.last_mut() {
+            Some(declaration) if declaration.value_type == value_type => {
+                declaration.count += 1;
+            }
+            _ => local_declarations.push(LocalDeclaration {
+                count: 1,
+                value_type,
+            }),
+        }
+    }
+
+    PromotedLocals {
+        var_local_idxs,
+        local_declarations,
+    }
+}
+
+/// For functions that use the native calling convention, the params are passed in the first
+/// wasm locals. Returns the local index of each param that can stay in its local, and the
+/// params whose address is taken, which need copying into the stack frame on entry to the
+/// function.
+pub fn get_param_locals(
+    block: &Block,
+    param_vars: &Vec<VarId>,
+) -> (LocalVariableMap, Vec<(VarId, LocalIdx)>) {
+    let flowgraph = generate_flowgraph(block);
+    let address_taken_vars = get_address_taken_vars(&flowgraph);
+
+    let mut param_local_idxs = IdMap::new();
+    let mut address_taken_params = Vec::new();
+    let mut local_idx = LocalIdx::initial_idx();
+    for param_var in param_vars {
+        if address_taken_vars.contains(param_var) {
+            address_taken_params.push((param_var.to_owned(), local_idx.to_owned()));
+        } else {
+            param_local_idxs.insert(param_var.to_owned(), local_idx.to_owned());
+        }
+        local_idx = local_idx.next_idx();
+    }
+
+    (param_local_idxs, address_taken_params)
+}
+
+/// The wasm type of the local that a var of this type would be held in,
+/// or None if the type can't be held in a local
+pub fn get_local_num_type(var_type: &IrType) -> Option<NumType> {
+    match var_type {
+        IrType::I8
+        | IrType::U8
+        | IrType::I16
+        | IrType::U16
+        | IrType::I32
+        | IrType::U32
+        | IrType::PointerTo(_) => Some(NumType::I32),
+        IrType::I64 | IrType::U64 => Some(NumType::I64),
+        IrType::F32 => Some(NumType::F32),
+        IrType::F64 => Some(NumType::F64),
+        // aggregates (and arrays, which are stored inline) need to live in memory
+        IrType::Struct(_)
+        | IrType::Union(_)
+        | IrType::ArrayOf(_, _)
+        | IrType::Function(_, _, _)
+        | IrType::Void => None,
+    }
+}
@@ -1,37 +1,44 @@
-use std::collections::HashMap;
+use std::cmp::Reverse;
 
 use crate::back_end::stack_allocation::allocate_vars::VariableAllocationMap;
 use crate::back_end::stack_allocation::get_vars_from_block::get_vars_from_block;
-use crate::back_end::stack_frame_operations::increment_stack_ptr_by_known_offset;
-use crate::back_end::target_code_generation_context::ModuleContext;
-use crate::back_end::wasm_instructions::WasmInstruction;
+use crate::data_structures::id_map::IdMap;
+use crate::id::Id;
 use crate::middle_end::ids::VarId;
 use crate::middle_end::ir::ProgramMetadata;
 use crate::middle_end::ir_types::TypeSize;
 use crate::relooper::blocks::Block;
 
+/// Lay out the vars one after another from start_offset, each aligned to its type. Returns
+/// the byte size of the vars, including padding.
 pub fn naive_allocate_local_vars(
     block: &Block,
-    param_vars_not_to_allocate_again: &Vec<VarId>,
+    vars_not_to_allocate: &Vec<VarId>,
     start_offset: u32,
     mut var_offsets: VariableAllocationMap,
-    wasm_instrs: &mut Vec<WasmInstruction>,
-    module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
-) -> VariableAllocationMap {
+) -> (VariableAllocationMap, u32) {
     // get all vars used in this block -- all the variables to allocate
     let mut vars = get_vars_from_block(block, prog_metadata);
-    // remove param vars, cos we don't need to allocate them again
-    for param_var in param_vars_not_to_allocate_again {
-        vars.remove(param_var);
+    // remove param vars, cos we don't need to allocate them again,
+    // and vars that have been promoted to wasm locals
+    for var in vars_not_to_allocate {
+        vars.remove(var);
     }
 
-    let mut offset = 0;
+    // the most aligned vars first, so there's less padding between them
+    let mut vars: Vec<_> = vars
+        .into_iter()
+        .map(|(var_id, var_type)| (var_id, var_type, prog_metadata.get_type_alignment(var_type)))
+        .collect();
+    vars.sort_by_key(|(var_id, _, alignment)| (Reverse(*alignment), var_id.as_u64()));
+
+    let mut offset: u32 = 0;
 
     // calculate offset of each local variable
-    for (var_id, var_type) in vars {
-        let byte_size = match var_type.get_byte_size(prog_metadata) {
-            TypeSize::CompileTime(byte_size) => byte_size,
+    for (var_id, var_type, alignment) in vars {
+        let byte_size = match prog_metadata.get_type_byte_size(var_type) {
+            TypeSize::CompileTime(byte_size) => *byte_size,
             TypeSize::Runtime(_) => {
                 // we shouldn't be trying to allocate a variable with runtime-known byte size
                 // on the stack here. its space is allocated with the AllocateVariable instruction,
@@ -39,44 +46,43 @@ pub fn naive_allocate_local_vars(
                 unreachable!()
             }
         };
+        offset = offset.next_multiple_of(alignment);
         var_offsets.insert(var_id, start_offset + offset);
         offset += byte_size as u32;
     }
 
-    // update stack pointer to after allocated vars
-    increment_stack_ptr_by_known_offset(offset, wasm_instrs, module_context);
-
-    var_offsets
+    (var_offsets, offset)
 }
 
+/// Lay out the global vars one after another from start_addr, each aligned to its type.
+/// They're in static memory rather than on the stack, so this returns the end of them as well
+/// as their addrs.
 pub fn naive_allocate_global_vars(
     block: &Block,
-    initial_top_of_stack_addr: u32,
-    wasm_instrs: &mut Vec<WasmInstruction>,
-    module_context: &ModuleContext,
+    start_addr: u32,
     prog_metadata: &ProgramMetadata,
-) -> VariableAllocationMap {
-    let global_vars = get_vars_from_block(block, prog_metadata);
+) -> (VariableAllocationMap, u32) {
+    // in the order the vars were created, so the layout is the same on every compile
+    let mut global_vars: Vec<_> = get_vars_from_block(block, prog_metadata)
+        .into_iter()
+        .collect();
+    global_vars.sort_by_key(|(var_id, _)| var_id.as_u64());
 
-    let mut var_addrs = HashMap::new();
-    let mut addr = initial_top_of_stack_addr;
-    // how much to increment the stack pointer by when we've allocated all vars
-    let mut stack_ptr_increment = 0;
+    let mut var_addrs = IdMap::new();
+    let mut addr = start_addr;
 
     // calculate addr of each global var
     for (var_id, var_type) in global_vars {
-        let byte_size = match var_type.get_byte_size(prog_metadata) {
-            TypeSize::CompileTime(byte_size) => byte_size,
+        let byte_size = match prog_metadata.get_type_byte_size(var_type) {
+            TypeSize::CompileTime(byte_size) => *byte_size,
             TypeSize::Runtime(_) => {
                 unreachable!()
             }
         };
+        addr = addr.next_multiple_of(prog_metadata.get_type_alignment(var_type));
         var_addrs.insert(var_id, addr);
         addr += byte_size as u32;
-        stack_ptr_increment += byte_size as u32;
     }
 
-    increment_stack_ptr_by_known_offset(stack_ptr_increment, wasm_instrs, module_context);
-
-    var_addrs
+    (var_addrs, addr)
 }
@@ -8,26 +8,23 @@ use crate::back_end::stack_allocation::allocate_vars::VariableAllocationMap;
 use crate::back_end::stack_allocation::clash_interval_var_locations::ClashIntervalVarLocations;
 use crate::back_end::stack_allocation::get_vars_from_block::get_vars_from_block;
 use crate::back_end::stack_allocation::var_locations::{VarLocation, VarLocations};
-use crate::back_end::stack_frame_operations::increment_stack_ptr_by_known_offset;
-use crate::back_end::target_code_generation_context::ModuleContext;
-use crate::back_end::wasm_instructions::WasmInstruction;
-use crate::middle_end::ids::VarId;
+use crate::middle_end::ids::{TypeId, VarId};
 use crate::middle_end::ir::ProgramMetadata;
-use crate::middle_end::ir_types::IrType;
 use crate::relooper::blocks::Block;
 
-type VarAndByteSizePair = (VarId, u64);
-type VarAllocationStack = Vec<VarAndByteSizePair>;
+/// A var, its byte size, and its alignment
+type VarSizeAndAlignment = (VarId, u64, u32);
+type VarAllocationStack = Vec<VarSizeAndAlignment>;
 
+/// Allocate the vars so that vars which are never live at the same time can share locations.
+/// Returns the byte size of the vars.
 pub fn optimised_allocate_local_vars(
     block: &mut Block,
-    param_vars_not_to_allocate_again: &Vec<VarId>,
+    vars_not_to_allocate: &Vec<VarId>,
     start_offset: u32,
     var_offsets: VariableAllocationMap,
-    wasm_instrs: &mut Vec<WasmInstruction>,
-    module_context: &ModuleContext,
-    prog_metadata: &mut ProgramMetadata,
-) -> VariableAllocationMap {
+    prog_metadata: &ProgramMetadata,
+) -> (VariableAllocationMap, u32) {
     remove_dead_vars(block, prog_metadata);
 
     debug!("removed dead vars: {}", block);
@@ -38,9 +35,10 @@ pub fn optimised_allocate_local_vars(
 
     // get all vars used in this block -- all the variables to allocate
     let mut vars_to_allocate = get_vars_from_block(block, prog_metadata);
-    // remove param vars, cos we don't need to allocate them again
-    for param_var in param_vars_not_to_allocate_again {
-        vars_to_allocate.remove(param_var);
+    // remove param vars, cos we don't need to allocate them again,
+    // and vars that have been promoted to wasm locals
+    for var in vars_not_to_allocate {
+        vars_to_allocate.remove(var);
     }
 
     // pop vars from clash graph onto a stack
@@ -51,12 +49,13 @@ pub fn optimised_allocate_local_vars(
     while let Some(var_and_type) =
         pop_smallest_least_clashed_var(&mut vars_to_allocate, &mut temp_clash_graph, prog_metadata)
     {
-        // if we make it FIFO, we'll allocate vars with the least clashes first.
-        // Because we always allocate vars to the lowest possible addr given
-        // the constraints of the existing allocations, this will put vars
-        // with less clashes in lower addrs, so allow more overlap there
-        var_allocation_stack.insert(0, var_and_type);
+        var_allocation_stack.push(var_and_type);
     }
+    // if we make it FIFO, we'll allocate vars with the least clashes first.
+    // Because we always allocate vars to the lowest possible addr given
+    // the constraints of the existing allocations, this will put vars
+    // with less clashes in lower addrs, so allow more overlap there
+    var_allocation_stack.reverse();
 
     debug!("var allocation stack:");
     for var in &var_allocation_stack {
@@ -65,12 +64,7 @@ pub fn optimised_allocate_local_vars(
 
     let var_locations = allocate_vars_from_stack(var_allocation_stack, &clash_graph, prog_metadata);
 
-    let (var_offsets, total_offset) =
-        calculate_var_offsets(var_locations, var_offsets, start_offset);
-
-    increment_stack_ptr_by_known_offset(total_offset, wasm_instrs, module_context);
-
-    var_offsets
+    calculate_var_offsets(var_locations, var_offsets, start_offset)
 }
 
 /// Finds the var with the least number of clashes, breaking ties by the
@@ -78,18 +72,18 @@ pub fn optimised_allocate_local_vars(
 /// from the clash graph.
 /// If no vars are left, returns None.
 fn pop_smallest_least_clashed_var(
-    vars_left_to_allocate: &mut HashMap<VarId, IrType>,
+    vars_left_to_allocate: &mut HashMap<VarId, TypeId>,
     clash_graph: &mut ClashGraph,
     prog_metadata: &ProgramMetadata,
-) -> Option<VarAndByteSizePair> {
+) -> Option<VarSizeAndAlignment> {
     let mut min_var = None;
     let mut min_var_clash_count = 0;
     let mut min_var_byte_size = 0;
 
     for (var, var_type) in vars_left_to_allocate.iter() {
         let clash_count = clash_graph.count_clashes(var);
-        let byte_size = var_type
-            .get_byte_size(prog_metadata)
+        let byte_size = prog_metadata
+            .get_type_byte_size(*var_type)
             .get_compile_time_value()
             .unwrap();
 
@@ -103,12 +97,12 @@ fn pop_smallest_least_clashed_var(
         }
     }
 
-    if let Some(min_var) = &min_var {
-        vars_left_to_allocate.remove(min_var);
-        clash_graph.remove_var(min_var);
-    }
-
-    min_var.map(|min_var| (min_var, min_var_byte_size))
+    min_var.map(|min_var| {
+        let alignment = prog_metadata.get_type_alignment(vars_left_to_allocate[&min_var]);
+        vars_left_to_allocate.remove(&min_var);
+        clash_graph.remove_var(&min_var);
+        (min_var, min_var_byte_size, alignment)
+    })
 }
 
 fn allocate_vars_from_stack(
@@ -119,7 +113,7 @@ fn allocate_vars_from_stack(
     let mut var_locations = ClashIntervalVarLocations::new();
 
     // allocate vars in order of the stack
-    while let Some((var, byte_size)) = var_allocation_stack.pop() {
+    while let Some((var, byte_size, alignment)) = var_allocation_stack.pop() {
         // don't allocate the null dest
         if let Some(null_dest) = &prog_metadata.null_dest_var {
             if var == *null_dest {
@@ -129,8 +123,12 @@ fn allocate_vars_from_stack(
         debug!("allocating var {var}");
 
         // find the lowest addr where this var fits without clashing
-        let lowest_possible_location =
-            var_locations.find_lowest_non_clashing_location_for_var(var, byte_size, clash_graph);
+        let lowest_possible_location = var_locations.find_lowest_non_clashing_location_for_var(
+            var,
+            byte_size,
+            alignment,
+            clash_graph,
+        );
         // allocate the var in the location we found
         var_locations.insert(lowest_possible_location, &clash_graph);
     }
@@ -138,7 +136,7 @@ fn allocate_vars_from_stack(
     var_locations.into_hashset()
 }
 
-fn calculate_var_offsets(
+pub fn calculate_var_offsets(
     var_locations: HashSet<VarLocation>,
     mut var_offsets: VariableAllocationMap,
     start_offset: u32,
@@ -0,0 +1,117 @@
+use std::collections::{HashMap, HashSet};
+
+use crate::back_end::memory_constants::{PTR_SIZE, STACK_FRAME_ALIGNMENT};
+use crate::back_end::stack_allocation::get_vars_from_block::get_vars_from_block;
+use crate::middle_end::ids::FunId;
+use crate::middle_end::instructions::Instruction;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::{IrType, TypeSize};
+use crate::relooper::blocks::Block;
+use crate::relooper::relooper::ReloopedProgram;
+
+/// Estimate how many bytes of stack the program needs, from the deepest chain of calls from
+/// the function named entry_name, which is main(), or thread_main() for the threads' stacks.
+/// It's 0 if the program doesn't define that function. The global variables are in static memory, so they aren't counted. Each stack
+/// frame is taken to be as big as it could be, with a separate slot for every variable,
+/// because the allocators only work out the actual frame sizes while generating code.
+/// Recursive calls are only counted once, since their depth isn't known until the program
+/// runs, and neither is the space allocated for variables with a runtime size.
+pub fn estimate_max_stack_size(prog: &ReloopedProgram, entry_name: &str) -> u32 {
+    let prog_metadata = &prog.program_metadata;
+
+    let mut frame_sizes = HashMap::new();
+    let mut callees = HashMap::new();
+    for (fun_id, function) in &prog.program_blocks.functions {
+        let block = match &function.block {
+            Some(block) => block,
+            None => continue,
+        };
+        let mut frame_size = PTR_SIZE;
+        if let IrType::Function(return_type, param_types, _) = &function.type_info {
+            frame_size += get_compile_time_byte_size(return_type, prog_metadata);
+            for param_type in param_types {
+                frame_size += get_compile_time_byte_size(param_type, prog_metadata);
+            }
+        }
+        // the vars start aligned, and the frame is padded so the next one is aligned too
+        frame_size = frame_size.next_multiple_of(STACK_FRAME_ALIGNMENT);
+        frame_size += get_vars_byte_size(block, prog_metadata);
+        frame_size = frame_size.next_multiple_of(STACK_FRAME_ALIGNMENT);
+        frame_sizes.insert(fun_id.to_owned(), frame_size);
+
+        let mut function_callees = HashSet::new();
+        block.for_each_instr(&mut |instr| match instr {
+            Instruction::Call(_, _, callee, _) | Instruction::TailCall(_, callee, _) => {
+                function_callees.insert(callee.to_owned());
+            }
+            _ => {}
+        });
+        callees.insert(fun_id.to_owned(), function_callees);
+    }
+
+    match prog_metadata.function_ids.get(entry_name) {
+        Some(entry_fun_id) => get_max_call_chain_size(
+            entry_fun_id,
+            &frame_sizes,
+            &callees,
+            &mut HashSet::new(),
+            &mut HashMap::new(),
+        ),
+        None => 0,
+    }
+}
+
+/// The size of the function's stack frame, plus the largest stack size of the functions it
+/// calls. Functions already on the call chain are recursive calls, and aren't counted again.
+fn get_max_call_chain_size(
+    fun_id: &FunId,
+    frame_sizes: &HashMap<FunId, u32>,
+    callees: &HashMap<FunId, HashSet<FunId>>,
+    call_chain: &mut HashSet<FunId>,
+    call_chain_sizes: &mut HashMap<FunId, u32>,
+) -> u32 {
+    if let Some(size) = call_chain_sizes.get(fun_id) {
+        return *size;
+    }
+    // imported functions don't use the stack
+    let frame_size = match frame_sizes.get(fun_id) {
+        Some(frame_size) => *frame_size,
+        None => return 0,
+    };
+
+    call_chain.insert(fun_id.to_owned());
+    let mut max_callee_size = 0;
+    for callee in callees.get(fun_id).unwrap() {
+        if call_chain.contains(callee) {
+            continue;
+        }
+        let callee_size =
+            get_max_call_chain_size(callee, frame_sizes, callees, call_chain, call_chain_sizes);
+        max_callee_size = max_callee_size.max(callee_size);
+    }
+    call_chain.remove(fun_id);
+
+    let size = frame_size.saturating_add(max_callee_size);
+    call_chain_sizes.insert(fun_id.to_owned(), size);
+    size
+}
+
+fn get_vars_byte_size(block: &Block, prog_metadata: &ProgramMetadata) -> u32 {
+    let mut vars_byte_size: u32 = 0;
+    for (_, var_type) in get_vars_from_block(block, prog_metadata) {
+        if let TypeSize::CompileTime(byte_size) = prog_metadata.get_type_byte_size(var_type) {
+            // allowing for the padding to align the var
+            let padded_byte_size =
+                (*byte_size as u32).next_multiple_of(prog_metadata.get_type_alignment(var_type));
+            vars_byte_size = vars_byte_size.saturating_add(padded_byte_size);
+        }
+    }
+    vars_byte_size
+}
+
+fn get_compile_time_byte_size(ir_type: &IrType, prog_metadata: &ProgramMetadata) -> u32 {
+    match ir_type.get_byte_size(prog_metadata) {
+        TypeSize::CompileTime(byte_size) => byte_size as u32,
+        TypeSize::Runtime(_) => 0,
+    }
+}
@@ -45,11 +45,12 @@ pub trait VarLocations {
     fn into_hashset(self) -> HashSet<VarLocation>;
 
     /// Find the lowest valid location to allocate a new variable so that it doesn't clash
-    /// with any variables already allocated.
+    /// with any variables already allocated, and starts at a multiple of its alignment.
     fn find_lowest_non_clashing_location_for_var(
         &self,
         var: VarId,
         byte_size: u64,
+        alignment: u32,
         clash_graph: &ClashGraph,
     ) -> VarLocation;
 
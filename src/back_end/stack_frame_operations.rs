@@ -2,76 +2,141 @@ use std::collections::HashMap;
 
 use log::info;
 
+use crate::back_end::calling_convention::{convert_scalar_value, load_src_as_type};
 use crate::back_end::memory_constants::{
     FRAME_PTR_ADDR, PTR_SIZE, STACK_PTR_ADDR, TEMP_FRAME_PTR_ADDR,
 };
-use crate::back_end::memory_operations::{load, load_constant, load_var, store, store_var};
+use crate::back_end::memory_operations::{
+    copy_aggregate_from_address_to_var, copy_aggregate_var_to_address, copy_memory,
+    grow_memory_to_fit, load, load_at_offset, load_constant, load_memory_end_addr, load_var, store,
+    store_at_offset, store_var,
+};
 use crate::back_end::profiler::log_stack_ptr;
-use crate::back_end::target_code_generation_context::{FunctionContext, ModuleContext};
-use crate::back_end::wasm_instructions::{MemArg, WasmInstruction};
+use crate::back_end::target_code_generation_context::{
+    FunctionContext, ModuleContext, StackPtrGlobals,
+};
+use crate::back_end::wasm_indices::{FuncIdx, GlobalIdx};
+use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmInstruction};
 use crate::middle_end::instructions::{Dest, Src};
 use crate::middle_end::ir::ProgramMetadata;
 use crate::middle_end::ir_types::{IrType, TypeSize};
 
-pub fn load_frame_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: FRAME_PTR_ADDR as i32,
-    });
-    // load
-    wasm_instrs.push(WasmInstruction::I32Load {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+/// The pointers that make up the calling convention. Depending on the enabled optimisations,
+/// these are kept either at fixed addresses in memory, or in wasm globals.
+#[derive(Clone, Copy)]
+enum StackPtrRegister {
+    FramePtr,
+    TempFramePtr,
+    StackPtr,
 }
 
-fn load_temp_frame_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: TEMP_FRAME_PTR_ADDR as i32,
-    });
-    // load
-    wasm_instrs.push(WasmInstruction::I32Load {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+impl StackPtrRegister {
+    fn memory_addr(&self) -> u32 {
+        match self {
+            StackPtrRegister::FramePtr => FRAME_PTR_ADDR,
+            StackPtrRegister::TempFramePtr => TEMP_FRAME_PTR_ADDR,
+            StackPtrRegister::StackPtr => STACK_PTR_ADDR,
+        }
+    }
+
+    fn global_idx(&self, stack_ptr_globals: &StackPtrGlobals) -> GlobalIdx {
+        match self {
+            StackPtrRegister::FramePtr => stack_ptr_globals.frame_ptr.to_owned(),
+            StackPtrRegister::TempFramePtr => stack_ptr_globals.temp_frame_ptr.to_owned(),
+            StackPtrRegister::StackPtr => stack_ptr_globals.stack_ptr.to_owned(),
+        }
+    }
 }
 
-pub fn restore_previous_frame_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand for storing frame pointer
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: FRAME_PTR_ADDR as i32,
-    });
+/// Load the value of one of the stack pointers onto the wasm stack
+fn load_stack_ptr_register(
+    register: StackPtrRegister,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    match &module_context.stack_ptr_globals {
+        Some(stack_ptr_globals) => {
+            wasm_instrs.push(WasmInstruction::GlobalGet {
+                global_idx: register.global_idx(stack_ptr_globals),
+            });
+        }
+        None => {
+            // address operand
+            wasm_instrs.push(WasmInstruction::I32Const {
+                n: register.memory_addr() as i32,
+            });
+            // load
+            wasm_instrs.push(WasmInstruction::I32Load {
+                mem_arg: MemArg {
+                    align: 2,
+                    offset: 0,
+                },
+            });
+        }
+    }
+}
+
+/// Set one of the stack pointers to the value left on the wasm stack by store_value_instrs
+fn store_stack_ptr_register(
+    register: StackPtrRegister,
+    mut store_value_instrs: Vec<WasmInstruction>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    match &module_context.stack_ptr_globals {
+        Some(stack_ptr_globals) => {
+            wasm_instrs.append(&mut store_value_instrs);
+            wasm_instrs.push(WasmInstruction::GlobalSet {
+                global_idx: register.global_idx(stack_ptr_globals),
+            });
+        }
+        None => {
+            // address operand
+            wasm_instrs.push(WasmInstruction::I32Const {
+                n: register.memory_addr() as i32,
+            });
+            // value to store
+            wasm_instrs.append(&mut store_value_instrs);
+            // store
+            wasm_instrs.push(WasmInstruction::I32Store {
+                mem_arg: MemArg {
+                    align: 2,
+                    offset: 0,
+                },
+            });
+        }
+    }
+}
+
+pub fn load_frame_ptr(wasm_instrs: &mut Vec<WasmInstruction>, module_context: &ModuleContext) {
+    load_stack_ptr_register(StackPtrRegister::FramePtr, wasm_instrs, module_context);
+}
+
+fn load_temp_frame_ptr(wasm_instrs: &mut Vec<WasmInstruction>, module_context: &ModuleContext) {
+    load_stack_ptr_register(StackPtrRegister::TempFramePtr, wasm_instrs, module_context);
+}
+
+pub fn restore_previous_frame_ptr(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
     // load the previous frame ptr value (the value that the frame ptr currently points at)
-    load_frame_ptr(wasm_instrs);
-    wasm_instrs.push(WasmInstruction::I32Load {
-        mem_arg: MemArg::zero(),
+    let mut load_previous_frame_ptr_instrs = Vec::new();
+    load_frame_ptr(&mut load_previous_frame_ptr_instrs, module_context);
+    load_previous_frame_ptr_instrs.push(WasmInstruction::I32Load {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
     });
     // set the frame ptr
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::FramePtr,
+        load_previous_frame_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 }
 
-pub fn load_stack_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: STACK_PTR_ADDR as i32,
-    });
-    // load
-    wasm_instrs.push(WasmInstruction::I32Load {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+pub fn load_stack_ptr(wasm_instrs: &mut Vec<WasmInstruction>, module_context: &ModuleContext) {
+    load_stack_ptr_register(StackPtrRegister::StackPtr, wasm_instrs, module_context);
 }
 
 pub fn increment_stack_ptr_by_known_offset(
@@ -79,21 +144,18 @@ pub fn increment_stack_ptr_by_known_offset(
     wasm_instrs: &mut Vec<WasmInstruction>,
     module_context: &ModuleContext,
 ) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: STACK_PTR_ADDR as i32,
-    });
     // add offset to stack pointer
-    load_stack_ptr(wasm_instrs);
-    wasm_instrs.push(WasmInstruction::I32Const { n: offset as i32 });
-    wasm_instrs.push(WasmInstruction::I32Add);
+    let mut new_stack_ptr_instrs = Vec::new();
+    load_stack_ptr(&mut new_stack_ptr_instrs, module_context);
+    new_stack_ptr_instrs.push(WasmInstruction::I32Const { n: offset as i32 });
+    new_stack_ptr_instrs.push(WasmInstruction::I32Add);
     // store stack pointer
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::StackPtr,
+        new_stack_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 
     // log stack ptr every time we change it
     log_stack_ptr(wasm_instrs, module_context);
@@ -104,96 +166,140 @@ pub fn increment_stack_ptr_dynamic(
     wasm_instrs: &mut Vec<WasmInstruction>,
     module_context: &ModuleContext,
 ) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: STACK_PTR_ADDR as i32,
-    });
-
     // load stack pointer and byte size, and add them together
-    load_stack_ptr(wasm_instrs);
-    wasm_instrs.append(&mut load_byte_size_instrs);
-    wasm_instrs.push(WasmInstruction::I32Add);
+    let mut new_stack_ptr_instrs = Vec::new();
+    load_stack_ptr(&mut new_stack_ptr_instrs, module_context);
+    new_stack_ptr_instrs.append(&mut load_byte_size_instrs);
+    new_stack_ptr_instrs.push(WasmInstruction::I32Add);
 
     // store to stack pointer
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::StackPtr,
+        new_stack_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 
     // log stack ptr every time we change it
     log_stack_ptr(wasm_instrs, module_context);
+
+    // the byte size isn't known at compile time, so it might not fit in the stack
+    check_stack_overflow(wasm_instrs, module_context);
 }
 
-pub fn set_stack_ptr_to_frame_ptr(
+/// If the stack ptr has gone past the stack limit, grow the memory to fit the stack. The
+/// stack can only grow if it's at the end of memory, so if the program uses the heap, which
+/// starts where the stack ends, or has threads, whose stacks follow each other, a stack
+/// overflow traps instead of overwriting what's after it. It also traps if the memory can't
+/// grow any more.
+pub fn check_stack_overflow(
     wasm_instrs: &mut Vec<WasmInstruction>,
     module_context: &ModuleContext,
 ) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: STACK_PTR_ADDR as i32,
+    let stack_limit = match &module_context.stack_limit {
+        Some(stack_limit) => stack_limit.to_owned(),
+        None => return,
+    };
+
+    let mut overflow_instrs = Vec::new();
+    if module_context.heap_allocator.is_some() || module_context.threads.is_some() {
+        overflow_instrs.push(WasmInstruction::Unreachable);
+    } else {
+        let mut load_stack_ptr_instrs = Vec::new();
+        load_stack_ptr(&mut load_stack_ptr_instrs, module_context);
+        grow_memory_to_fit(load_stack_ptr_instrs, &mut overflow_instrs);
+        // memory.grow returns -1 if it fails
+        overflow_instrs.push(WasmInstruction::I32Const { n: -1 });
+        overflow_instrs.push(WasmInstruction::I32Eq);
+        overflow_instrs.push(WasmInstruction::IfElse {
+            blocktype: BlockType::None,
+            if_instrs: vec![WasmInstruction::Unreachable],
+            else_instrs: Vec::new(),
+        });
+        // the stack can use all of the memory it grew
+        load_memory_end_addr(&mut overflow_instrs);
+        overflow_instrs.push(WasmInstruction::GlobalSet {
+            global_idx: stack_limit.to_owned(),
+        });
+    }
+
+    load_stack_ptr(wasm_instrs, module_context);
+    wasm_instrs.push(WasmInstruction::GlobalGet {
+        global_idx: stack_limit,
+    });
+    wasm_instrs.push(WasmInstruction::I32GtU);
+    wasm_instrs.push(WasmInstruction::IfElse {
+        blocktype: BlockType::None,
+        if_instrs: overflow_instrs,
+        else_instrs: Vec::new(),
     });
+}
+
+pub fn set_stack_ptr_to_frame_ptr(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
     // load frame pointer value, to store in stack pointer
-    load_frame_ptr(wasm_instrs);
+    let mut load_frame_ptr_instrs = Vec::new();
+    load_frame_ptr(&mut load_frame_ptr_instrs, module_context);
     // store stack pointer
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::StackPtr,
+        load_frame_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 
     // log stack ptr every time we change it
     log_stack_ptr(wasm_instrs, module_context);
 }
 
-fn set_temp_frame_ptr_to_stack_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: TEMP_FRAME_PTR_ADDR as i32,
-    });
+fn set_temp_frame_ptr_to_stack_ptr(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
     // load stack pointer value, to store in temp frame pointer
-    load_stack_ptr(wasm_instrs);
+    let mut load_stack_ptr_instrs = Vec::new();
+    load_stack_ptr(&mut load_stack_ptr_instrs, module_context);
     // store temp frame pointer
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::TempFramePtr,
+        load_stack_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 }
 
-fn set_frame_ptr_to_temp_frame_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: FRAME_PTR_ADDR as i32,
-    });
-    // load stack pointer value, to store in temp frame pointer
-    load_temp_frame_ptr(wasm_instrs);
+fn set_frame_ptr_to_temp_frame_ptr(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    // load temp frame pointer value, to store in frame pointer
+    let mut load_temp_frame_ptr_instrs = Vec::new();
+    load_temp_frame_ptr(&mut load_temp_frame_ptr_instrs, module_context);
     // store frame pointer
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::FramePtr,
+        load_temp_frame_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 }
 
-pub fn set_frame_ptr_to_stack_ptr(wasm_instrs: &mut Vec<WasmInstruction>) {
-    // address operand
-    wasm_instrs.push(WasmInstruction::I32Const {
-        n: FRAME_PTR_ADDR as i32,
-    });
+pub fn set_frame_ptr_to_stack_ptr(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
     // load stack pointer value, to store in frame pointer
-    load_stack_ptr(wasm_instrs);
+    let mut load_stack_ptr_instrs = Vec::new();
+    load_stack_ptr(&mut load_stack_ptr_instrs, module_context);
     // store frame pointer
-    wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg {
-            align: 2,
-            offset: 0,
-        },
-    });
+    store_stack_ptr_register(
+        StackPtrRegister::FramePtr,
+        load_stack_ptr_instrs,
+        wasm_instrs,
+        module_context,
+    );
 }
 
 pub fn set_up_new_stack_frame(
@@ -220,16 +326,16 @@ pub fn set_up_new_stack_frame(
 
     // store frame pointer at start of the stack frame
     // address operand for storing frame ptr (current top of stack)
-    load_stack_ptr(wasm_instrs);
+    load_stack_ptr(wasm_instrs, module_context);
     // value to store: current value of frame ptr
-    load_frame_ptr(wasm_instrs);
+    load_frame_ptr(wasm_instrs, module_context);
     // store frame ptr to start of new stack frame
     wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg::zero(),
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
     });
 
     // save the address of the start of the new stack frame
-    set_temp_frame_ptr_to_stack_ptr(wasm_instrs);
+    set_temp_frame_ptr_to_stack_ptr(wasm_instrs, module_context);
 
     // increment stack pointer
     increment_stack_ptr_by_known_offset(PTR_SIZE, wasm_instrs, module_context);
@@ -255,12 +361,10 @@ pub fn set_up_new_stack_frame(
     for (param_index, param) in params.into_iter().enumerate() {
         match param {
             Src::Var(var_id) => {
-                // address operand for where to store param
-                load_stack_ptr(wasm_instrs);
-
                 let var_type = prog_metadata.get_var_type(&var_id).unwrap();
-                let var_byte_size = var_type
-                    .get_byte_size(prog_metadata)
+                let var_byte_size = prog_metadata
+                    .get_var_byte_size(&var_id)
+                    .unwrap()
                     .get_compile_time_value()
                     .unwrap();
 
@@ -269,11 +373,32 @@ pub fn set_up_new_stack_frame(
                     var_type, var_byte_size
                 );
 
-                // load var onto the wasm stack (value to store)
-                load_var(var_id, wasm_instrs, function_context, prog_metadata);
-
-                // store param
-                store(var_type, wasm_instrs);
+                if var_type.is_struct_or_union_type() {
+                    // copy the whole struct into the callee's stack frame
+                    copy_aggregate_var_to_address(
+                        &var_id,
+                        |instrs| load_stack_ptr(instrs, module_context),
+                        wasm_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+                } else {
+                    // address operand for where to store param
+                    load_stack_ptr(wasm_instrs, module_context);
+
+                    // load var onto the wasm stack (value to store)
+                    load_var(
+                        var_id,
+                        wasm_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+
+                    // store param
+                    store(var_type, wasm_instrs);
+                }
 
                 // advance the stack pointer
                 increment_stack_ptr_by_known_offset(
@@ -284,7 +409,7 @@ pub fn set_up_new_stack_frame(
             }
             Src::Constant(constant) => {
                 // address operand for where to store param
-                load_stack_ptr(wasm_instrs);
+                load_stack_ptr(wasm_instrs, module_context);
 
                 let param_type = if param_index >= param_types.len() {
                     constant.get_type_minimum_i32()
@@ -298,10 +423,10 @@ pub fn set_up_new_stack_frame(
                     .unwrap();
 
                 // value to store
-                load_constant(constant, param_type.to_owned(), wasm_instrs);
+                load_constant(constant, &param_type, wasm_instrs);
 
                 // store
-                store(param_type.to_owned(), wasm_instrs);
+                store(&param_type, wasm_instrs);
 
                 // advance the stack pointer
                 increment_stack_ptr_by_known_offset(
@@ -317,7 +442,7 @@ pub fn set_up_new_stack_frame(
     }
 
     // set the frame pointer to point at the new stack frame
-    set_frame_ptr_to_temp_frame_ptr(wasm_instrs);
+    set_frame_ptr_to_temp_frame_ptr(wasm_instrs, module_context);
 }
 
 pub fn pop_stack_frame(
@@ -332,18 +457,9 @@ pub fn pop_stack_frame(
     // restore the stack pointer value
     set_stack_ptr_to_frame_ptr(wasm_instrs, module_context);
     // restore the previous frame ptr value
-    restore_previous_frame_ptr(wasm_instrs);
+    restore_previous_frame_ptr(wasm_instrs, module_context);
 
     // store the result to dest
-    //
-    // return value is stored in the stack frame we're popping, after the previous frame ptr
-    // so, at stack ptr + PTR_SIZE
-    // address operand for loading return value
-    let mut store_value_instrs = Vec::new();
-    load_stack_ptr(&mut store_value_instrs);
-    store_value_instrs.push(WasmInstruction::I32Const { n: PTR_SIZE as i32 });
-    store_value_instrs.push(WasmInstruction::I32Add);
-
     let return_type = match callee_function_type {
         IrType::Function(return_type, _, _) => &**return_type,
         _ => unreachable!(),
@@ -352,20 +468,51 @@ pub fn pop_stack_frame(
         IrType::Void => {
             // if function returns void, don't load return value
         }
+        IrType::Struct(_) | IrType::Union(_) => {
+            // return value is stored in the stack frame we've popped, after the previous frame ptr
+            copy_aggregate_from_address_to_var(
+                &result_dest,
+                |instrs| {
+                    load_stack_ptr(instrs, module_context);
+                    instrs.push(WasmInstruction::I32Const { n: PTR_SIZE as i32 });
+                    instrs.push(WasmInstruction::I32Add);
+                },
+                wasm_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
+        }
         _ => {
-            load(return_type.to_owned(), &mut store_value_instrs);
+            let mut store_value_instrs = Vec::new();
+            load_popped_return_value(return_type, &mut store_value_instrs, module_context);
 
             store_var(
                 result_dest,
                 store_value_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
     }
 }
 
+/// Load the return value out of the stack frame that has just been popped
+fn load_popped_return_value(
+    return_type: &IrType,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    // return value is stored in the stack frame we've popped, after the previous frame ptr
+    // so, at stack ptr + PTR_SIZE
+    // address operand for loading return value
+    load_stack_ptr(wasm_instrs, module_context);
+
+    load_at_offset(return_type, PTR_SIZE, wasm_instrs);
+}
+
 pub fn overwrite_current_stack_frame_with_new_stack_frame(
     callee_function_type: &IrType,
     params: Vec<Src>,
@@ -386,35 +533,50 @@ pub fn overwrite_current_stack_frame_with_new_stack_frame(
     // use temp_fp to hold the stack ptr value, so we can offset from it while
     // constructing the new stack frame
     // todo make sure this is definitely after the space for all the new params
-    set_temp_frame_ptr_to_stack_ptr(wasm_instrs);
+    set_temp_frame_ptr_to_stack_ptr(wasm_instrs, module_context);
 
     let mut temp_stack_ptr_offset = 0;
     let mut param_var_stack_ptr_offsets = HashMap::new();
     for param_index in 0..params.len() {
         let param = params.get(param_index).unwrap();
         if let Src::Var(var_id) = param {
-            // offset from top of stack to store param
-            load_temp_frame_ptr(wasm_instrs);
-            wasm_instrs.push(WasmInstruction::I32Const {
-                n: temp_stack_ptr_offset as i32,
-            });
-            wasm_instrs.push(WasmInstruction::I32Add);
-
             let var_type = prog_metadata.get_var_type(var_id).unwrap();
-            let var_byte_size = var_type
-                .get_byte_size(prog_metadata)
+            let var_byte_size = prog_metadata
+                .get_var_byte_size(var_id)
+                .unwrap()
                 .get_compile_time_value()
                 .unwrap();
 
-            load_var(
-                var_id.to_owned(),
-                wasm_instrs,
-                function_context,
-                prog_metadata,
-            );
+            // offset from top of stack to store param
+            let load_temp_param_addr = |instrs: &mut Vec<WasmInstruction>| {
+                load_temp_frame_ptr(instrs, module_context);
+                instrs.push(WasmInstruction::I32Const {
+                    n: temp_stack_ptr_offset as i32,
+                });
+                instrs.push(WasmInstruction::I32Add);
+            };
 
             // store param in temp space at top of stack
-            store(var_type, wasm_instrs);
+            if var_type.is_struct_or_union_type() {
+                copy_aggregate_var_to_address(
+                    var_id,
+                    load_temp_param_addr,
+                    wasm_instrs,
+                    function_context,
+                    module_context,
+                    prog_metadata,
+                );
+            } else {
+                load_temp_param_addr(wasm_instrs);
+                load_var(
+                    var_id.to_owned(),
+                    wasm_instrs,
+                    function_context,
+                    module_context,
+                    prog_metadata,
+                );
+                store(var_type, wasm_instrs);
+            }
 
             param_var_stack_ptr_offsets.insert(var_id.to_owned(), temp_stack_ptr_offset);
 
@@ -441,27 +603,42 @@ pub fn overwrite_current_stack_frame_with_new_stack_frame(
         let param = params.get(param_index).unwrap();
         match param {
             Src::Var(var_id) => {
-                // address operand for where to store param
-                load_stack_ptr(wasm_instrs);
-
                 let var_type = prog_metadata.get_var_type(var_id).unwrap();
-                let var_byte_size = var_type
-                    .get_byte_size(prog_metadata)
+                let var_byte_size = prog_metadata
+                    .get_var_byte_size(var_id)
+                    .unwrap()
                     .get_compile_time_value()
                     .unwrap();
 
-                // load var from temp space we put it in earlier
-                load_temp_frame_ptr(wasm_instrs);
+                // address of the temp space we put the var in earlier
                 let temp_frame_ptr_offset = *param_var_stack_ptr_offsets.get(var_id).unwrap();
-                wasm_instrs.push(WasmInstruction::I32Const {
-                    n: temp_frame_ptr_offset as i32,
-                });
-                wasm_instrs.push(WasmInstruction::I32Add);
+                let load_temp_param_addr = |instrs: &mut Vec<WasmInstruction>| {
+                    load_temp_frame_ptr(instrs, module_context);
+                    instrs.push(WasmInstruction::I32Const {
+                        n: temp_frame_ptr_offset as i32,
+                    });
+                    instrs.push(WasmInstruction::I32Add);
+                };
 
-                load(var_type.to_owned(), wasm_instrs);
+                if var_type.is_struct_or_union_type() {
+                    copy_memory(
+                        |instrs| load_stack_ptr(instrs, module_context),
+                        load_temp_param_addr,
+                        var_byte_size as u32,
+                        wasm_instrs,
+                        module_context,
+                    );
+                } else {
+                    // address operand for where to store param
+                    load_stack_ptr(wasm_instrs, module_context);
 
-                // store param
-                store(var_type, wasm_instrs);
+                    // load var from temp space
+                    load_temp_param_addr(wasm_instrs);
+                    load(var_type, wasm_instrs);
+
+                    // store param
+                    store(var_type, wasm_instrs);
+                }
 
                 // advance stack ptr
                 increment_stack_ptr_by_known_offset(
@@ -472,7 +649,7 @@ pub fn overwrite_current_stack_frame_with_new_stack_frame(
             }
             Src::Constant(constant) => {
                 // address operand for where to store param
-                load_stack_ptr(wasm_instrs);
+                load_stack_ptr(wasm_instrs, module_context);
 
                 let param_type = if param_index >= param_types.len() {
                     constant.get_type_minimum_i32()
@@ -486,10 +663,10 @@ pub fn overwrite_current_stack_frame_with_new_stack_frame(
                     .unwrap();
 
                 // value to store
-                load_constant(constant.to_owned(), param_type.to_owned(), wasm_instrs);
+                load_constant(constant.to_owned(), &param_type, wasm_instrs);
 
                 // store
-                store(param_type.to_owned(), wasm_instrs);
+                store(&param_type, wasm_instrs);
 
                 // advance the stack pointer
                 increment_stack_ptr_by_known_offset(
@@ -504,3 +681,215 @@ pub fn overwrite_current_stack_frame_with_new_stack_frame(
         }
     }
 }
+
+/// Call a function that uses the native calling convention. The params are passed as wasm
+/// params, and the return value (if there is one) is left on top of the wasm stack.
+///
+/// The callee still gets a stack frame, for any of its vars that have to live in memory,
+/// but there's no space in it for params or the return value.
+pub fn call_native_function(
+    callee_function_type: &IrType,
+    callee_func_idx: FuncIdx,
+    params: Vec<Src>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    // ----------------------
+    // | previous frame ptr | <-- frame ptr
+    // | ------------------ |
+    // | | vars           | |
+    // | ------------------ |
+    // ---------------------- <-- stack ptr
+
+    // load the params onto the wasm stack, while the frame ptr still points at the caller's frame
+    load_native_params(
+        callee_function_type,
+        params,
+        wasm_instrs,
+        function_context,
+        module_context,
+        prog_metadata,
+    );
+
+    // store frame pointer at start of the new stack frame
+    load_stack_ptr(wasm_instrs, module_context);
+    load_frame_ptr(wasm_instrs, module_context);
+    wasm_instrs.push(WasmInstruction::I32Store {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+    // set the frame pointer to point at the new stack frame
+    set_frame_ptr_to_stack_ptr(wasm_instrs, module_context);
+    increment_stack_ptr_by_known_offset(PTR_SIZE, wasm_instrs, module_context);
+
+    wasm_instrs.push(WasmInstruction::Call {
+        func_idx: callee_func_idx,
+    });
+
+    // pop the callee's stack frame
+    set_stack_ptr_to_frame_ptr(wasm_instrs, module_context);
+    restore_previous_frame_ptr(wasm_instrs, module_context);
+}
+
+/// Tail call a function that uses the native calling convention, from a function that also
+/// uses the native calling convention. The callee reuses the current stack frame, and its
+/// return value is returned directly.
+pub fn native_tail_call_native_function(
+    callee_function_type: &IrType,
+    callee_func_idx: FuncIdx,
+    params: Vec<Src>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    // the params are all on the wasm stack before we start overwriting the current frame
+    load_native_params(
+        callee_function_type,
+        params,
+        wasm_instrs,
+        function_context,
+        module_context,
+        prog_metadata,
+    );
+
+    // leave frame ptr (and the previous frame ptr it points at) where it is,
+    // and discard the rest of the current frame
+    set_stack_ptr_to_frame_ptr(wasm_instrs, module_context);
+    increment_stack_ptr_by_known_offset(PTR_SIZE, wasm_instrs, module_context);
+
+    let callee_return_type = match callee_function_type {
+        IrType::Function(return_type, _, _) => &**return_type,
+        _ => unreachable!(),
+    };
+    let mut convert_instrs = Vec::new();
+    convert_scalar_value(
+        callee_return_type,
+        &function_context.return_type,
+        &mut convert_instrs,
+    );
+
+    // if the return value doesn't need converting, the functions have the same wasm result
+    // type, and the callee can replace this function on the wasm call stack
+    if convert_instrs.is_empty() && module_context.can_use_return_call() {
+        wasm_instrs.push(WasmInstruction::ReturnCall {
+            func_idx: callee_func_idx,
+        });
+        return;
+    }
+
+    wasm_instrs.push(WasmInstruction::Call {
+        func_idx: callee_func_idx,
+    });
+    wasm_instrs.append(&mut convert_instrs);
+    wasm_instrs.push(WasmInstruction::Return);
+}
+
+/// Tail call a function that uses the stack frame calling convention, from a function that
+/// uses the native calling convention. The frames can't be shared, so this is a normal
+/// call followed by returning its result.
+pub fn native_tail_call_stack_frame_function(
+    callee_function_type: &IrType,
+    callee_func_idx: FuncIdx,
+    params: Vec<Src>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    set_up_new_stack_frame(
+        callee_function_type,
+        params,
+        wasm_instrs,
+        function_context,
+        module_context,
+        prog_metadata,
+    );
+
+    wasm_instrs.push(WasmInstruction::Call {
+        func_idx: callee_func_idx,
+    });
+
+    set_stack_ptr_to_frame_ptr(wasm_instrs, module_context);
+    restore_previous_frame_ptr(wasm_instrs, module_context);
+
+    let callee_return_type = match callee_function_type {
+        IrType::Function(return_type, _, _) => &**return_type,
+        _ => unreachable!(),
+    };
+    load_popped_return_value(callee_return_type, wasm_instrs, module_context);
+    convert_scalar_value(
+        callee_return_type,
+        &function_context.return_type,
+        wasm_instrs,
+    );
+    wasm_instrs.push(WasmInstruction::Return);
+}
+
+/// Tail call a function that uses the native calling convention, from a function that uses
+/// the stack frame calling convention. The frames can't be shared, so this is a normal
+/// call, storing its result as this function's return value.
+pub fn stack_frame_tail_call_native_function(
+    callee_function_type: &IrType,
+    callee_func_idx: FuncIdx,
+    params: Vec<Src>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    // address of this function's return value in its stack frame is PTR_SIZE above this
+    load_frame_ptr(wasm_instrs, module_context);
+
+    call_native_function(
+        callee_function_type,
+        callee_func_idx,
+        params,
+        wasm_instrs,
+        function_context,
+        module_context,
+        prog_metadata,
+    );
+
+    let callee_return_type = match callee_function_type {
+        IrType::Function(return_type, _, _) => &**return_type,
+        _ => unreachable!(),
+    };
+    convert_scalar_value(
+        callee_return_type,
+        &function_context.return_type,
+        wasm_instrs,
+    );
+    store_at_offset(
+        &function_context.return_type.to_owned(),
+        PTR_SIZE,
+        wasm_instrs,
+    );
+    wasm_instrs.push(WasmInstruction::Return);
+}
+
+fn load_native_params(
+    callee_function_type: &IrType,
+    params: Vec<Src>,
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    function_context: &FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) {
+    let param_types = match callee_function_type {
+        IrType::Function(_, param_types, _) => param_types,
+        _ => unreachable!(),
+    };
+
+    for (param, param_type) in params.into_iter().zip(param_types) {
+        load_src_as_type(
+            param,
+            param_type,
+            wasm_instrs,
+            function_context,
+            module_context,
+            prog_metadata,
+        );
+    }
+}
@@ -0,0 +1,396 @@
+use log::info;
+
+use crate::back_end::stack_allocation::allocate_vars::{
+    allocate_global_vars, VariableAllocationMap,
+};
+use crate::back_end::target_code_generation_context::ModuleContext;
+use crate::middle_end::ids::VarId;
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::{IrType, TypeSize};
+use crate::relooper::blocks::Block;
+
+/// The global vars, and the arrays and structs that the global instructions allocate, are
+/// aligned to the largest scalar size
+pub const STATIC_ALLOCATION_ALIGNMENT: u32 = 8;
+
+/// Lay out the global vars from start_addr, and evaluate as much of the start of the global
+/// block as possible at compile time, into the initial bytes of the globals' memory. The
+/// arrays and structs allocated by the evaluated instructions are laid out after the vars.
+///
+/// The evaluated instructions are removed from the block, so the rest of it carries on at
+/// runtime from the memory that the returned bytes are loaded into. Returns the global var
+/// addrs, and the initial bytes of memory from start_addr.
+pub fn evaluate_static_initialisers(
+    global_block: &mut Block,
+    start_addr: u32,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) -> (VariableAllocationMap, Vec<u8>) {
+    let (var_addrs, vars_end_addr) = allocate_global_vars(global_block, start_addr, prog_metadata);
+    let mut memory = StaticMemory {
+        start_addr,
+        data: vec![0x00; (vars_end_addr - start_addr) as usize],
+        var_addrs: &var_addrs,
+        module_context,
+        prog_metadata,
+    };
+    let evaluated_all = evaluate_block(global_block, &mut memory);
+    info!(
+        "Evaluated {} global instructions at compile time into {} bytes",
+        if evaluated_all { "all" } else { "some" },
+        memory.data.len()
+    );
+    let data = memory.data;
+    (var_addrs, data)
+}
+
+/// Evaluate the instructions of the simple blocks at the start of the block, up to the
+/// first instruction that can't be evaluated. Returns whether the whole block was evaluated.
+fn evaluate_block(block: &mut Block, memory: &mut StaticMemory) -> bool {
+    match block {
+        Block::Simple { internal, next } => {
+            let mut evaluating = true;
+            internal.instrs.retain(|instr| {
+                // labels don't generate any code, and the block structure still needs them
+                if !evaluating || matches!(instr, Instruction::Label(..)) {
+                    return true;
+                }
+                evaluating = memory.evaluate_instr(instr).is_some();
+                !evaluating
+            });
+            match next {
+                Some(next) if evaluating => evaluate_block(next, memory),
+                _ => evaluating,
+            }
+        }
+        // control flow depends on values at runtime
+        Block::Loop { .. } | Block::Multiple { .. } => false,
+    }
+}
+
+/// A scalar value, as it is on the wasm stack
+#[derive(Debug, Clone, Copy)]
+enum Value {
+    Int(i128),
+    Float(f64),
+}
+
+/// The memory of the global vars, and of the arrays and structs that they point to
+struct StaticMemory<'a> {
+    start_addr: u32,
+    data: Vec<u8>,
+    var_addrs: &'a VariableAllocationMap,
+    module_context: &'a ModuleContext<'a>,
+    prog_metadata: &'a ProgramMetadata,
+}
+
+impl<'a> StaticMemory<'a> {
+    /// Apply the effect of the instruction to memory, the same as the code generated for it
+    /// would. Returns None, without changing memory, if the instruction can't be evaluated.
+    fn evaluate_instr(&mut self, instr: &Instruction) -> Option<()> {
+        match instr {
+            Instruction::DeclareVariable(..)
+            | Instruction::ReferenceVariable(..)
+            | Instruction::Br(..)
+            | Instruction::Nop(..) => Some(()),
+            Instruction::AllocateVariable(_, dest, Src::Constant(Constant::Int(byte_size))) => {
+                let addr = (self.start_addr + self.data.len() as u32)
+                    .next_multiple_of(STATIC_ALLOCATION_ALIGNMENT);
+                let end_addr = addr.checked_add(u32::try_from(*byte_size).ok()?)?;
+                let dest_addr = self.var_addr(dest)?;
+                self.data
+                    .resize((end_addr - self.start_addr) as usize, 0x00);
+                self.write_value(&pointer_type(), dest_addr, Value::Int(addr as i128))
+            }
+            Instruction::SimpleAssignment(_, dest, Src::Var(src_var))
+                if self.var_type(dest).is_struct_or_union_type() =>
+            {
+                let src_addr = self.var_addr(src_var)?;
+                let dest_addr = self.var_addr(dest)?;
+                self.copy_bytes(dest_addr, src_addr, self.byte_size(self.var_type(dest))?)
+            }
+            Instruction::SimpleAssignment(_, dest, src) => {
+                let dest_type = self.var_type(dest);
+                let value = self.load_src(src, dest_type)?;
+                self.store_var(dest, value)
+            }
+            Instruction::LoadFromAddress(_, dest, Src::Var(src_var)) => {
+                let dest_type = self.var_type(dest);
+                let src_addr = self.load_pointer(src_var)?;
+                let dest_addr = self.var_addr(dest)?;
+                if dest_type.is_struct_or_union_type() {
+                    return self.copy_bytes(dest_addr, src_addr, self.byte_size(dest_type)?);
+                }
+                let value = self.read_value(dest_type, src_addr)?;
+                self.write_value(dest_type, dest_addr, value)
+            }
+            Instruction::StoreToAddress(_, dest, src) => {
+                let dest_addr = self.load_pointer(dest)?;
+                let inner_dest_type = self.var_type(dest).dereference_pointer_type().ok()?;
+                if let Src::Var(src_var) = src {
+                    let src_type = self.var_type(src_var);
+                    if src_type.is_struct_or_union_type() {
+                        let src_addr = self.var_addr(src_var)?;
+                        return self.copy_bytes(dest_addr, src_addr, self.byte_size(src_type)?);
+                    }
+                }
+                let value = self.load_src(src, &inner_dest_type)?;
+                self.write_value(&inner_dest_type, dest_addr, value)
+            }
+            Instruction::ZeroMemory(_, dest, byte_size) => {
+                let dest_addr = self.load_pointer(dest)?;
+                let range = self.byte_range(dest_addr, u32::try_from(*byte_size).ok()?)?;
+                self.data[range].fill(0x00);
+                Some(())
+            }
+            Instruction::AddressOf(_, dest, Src::Var(src_var)) => {
+                let src_addr = self.var_addr(src_var)?;
+                self.store_var(dest, Value::Int(src_addr as i128))
+            }
+            Instruction::PointerToStringLiteral(_, dest, string_literal_id) => {
+                let ptr_value = self
+                    .module_context
+                    .string_literal_id_to_ptr_map
+                    .get(string_literal_id)?;
+                self.store_var(dest, Value::Int(*ptr_value as i128))
+            }
+            Instruction::Add(_, dest, left_src, right_src)
+            | Instruction::Sub(_, dest, left_src, right_src)
+            | Instruction::Mult(_, dest, left_src, right_src) => {
+                // float arithmetic is left to runtime, so it's rounded the same as usual
+                let dest_type = self.var_type(dest);
+                let (left, right) = match (
+                    self.load_src(left_src, dest_type)?,
+                    self.load_src(right_src, dest_type)?,
+                ) {
+                    (Value::Int(left), Value::Int(right)) => (left, right),
+                    _ => return None,
+                };
+                // the result is truncated to the width of dest when it's stored
+                let result = match instr {
+                    Instruction::Add(..) => left.wrapping_add(right),
+                    Instruction::Sub(..) => left.wrapping_sub(right),
+                    _ => left.wrapping_mul(right),
+                };
+                self.store_var(dest, Value::Int(result))
+            }
+            _ => {
+                let (dest, src, src_type) = get_conversion_operands(instr)?;
+                let value = self.load_src(src, &src_type)?;
+                let dest_type = self.var_type(dest);
+                let converted_value = match value {
+                    Value::Float(z) if is_integer_value_type(dest_type) => {
+                        // float to int conversions trap at runtime if the value is out of range
+                        let truncated = z.trunc();
+                        let (min, max) = get_integer_range(dest_type);
+                        if !(truncated >= min as f64 && truncated <= max as f64) {
+                            return None;
+                        }
+                        Value::Int(truncated as i128)
+                    }
+                    value => value,
+                };
+                self.store_var(dest, converted_value)
+            }
+        }
+    }
+
+    fn var_type(&self, var_id: &VarId) -> &'a IrType {
+        self.prog_metadata.get_var_type(var_id).unwrap()
+    }
+
+    fn var_addr(&self, var_id: &VarId) -> Option<u32> {
+        self.var_addrs.get(var_id).copied()
+    }
+
+    fn byte_size(&self, ir_type: &IrType) -> Option<u32> {
+        match ir_type.get_byte_size(self.prog_metadata) {
+            TypeSize::CompileTime(byte_size) => Some(byte_size as u32),
+            TypeSize::Runtime(_) => None,
+        }
+    }
+
+    /// The range of self.data for byte_size bytes from addr, if they're all in this memory
+    fn byte_range(&self, addr: u32, byte_size: u32) -> Option<std::ops::Range<usize>> {
+        let start = addr.checked_sub(self.start_addr)? as usize;
+        let end = start.checked_add(byte_size as usize)?;
+        if end > self.data.len() {
+            return None;
+        }
+        Some(start..end)
+    }
+
+    /// The value of src, loaded as src_type if it's a constant
+    fn load_src(&self, src: &Src, src_type: &IrType) -> Option<Value> {
+        match src {
+            Src::Var(var_id) => {
+                let var_type = self.var_type(var_id);
+                let value = self.read_value(var_type, self.var_addr(var_id)?)?;
+                // a var is loaded as its own type, and the instruction uses that value as
+                // src_type, so e.g. a u8 var used as an i32 keeps its zero extension
+                normalise_value(value, src_type)
+            }
+            Src::Constant(Constant::Int(n)) => normalise_value(Value::Int(*n), src_type),
+            Src::Constant(Constant::Float(z)) => normalise_value(Value::Float(*z), src_type),
+            Src::StoreAddressVar(_) | Src::Fun(_) => None,
+        }
+    }
+
+    /// The address that the pointer var holds
+    fn load_pointer(&self, var_id: &VarId) -> Option<u32> {
+        match self.load_src(&Src::Var(var_id.to_owned()), &pointer_type())? {
+            Value::Int(addr) => Some(addr as u32),
+            Value::Float(_) => None,
+        }
+    }
+
+    fn store_var(&mut self, var_id: &VarId, value: Value) -> Option<()> {
+        // stores to the null dest are ignored
+        if self.prog_metadata.is_var_the_null_dest(var_id) {
+            return Some(());
+        }
+        let var_addr = self.var_addr(var_id)?;
+        self.write_value(self.var_type(var_id), var_addr, value)
+    }
+
+    fn read_value(&self, value_type: &IrType, addr: u32) -> Option<Value> {
+        let range = self.byte_range(addr, self.byte_size(value_type)?)?;
+        let bytes = &self.data[range];
+        let value = match value_type {
+            IrType::I8 => Value::Int(bytes[0] as i8 as i128),
+            IrType::U8 => Value::Int(bytes[0] as i128),
+            IrType::I16 => Value::Int(i16::from_le_bytes(bytes.try_into().ok()?) as i128),
+            IrType::U16 => Value::Int(u16::from_le_bytes(bytes.try_into().ok()?) as i128),
+            IrType::I32 => Value::Int(i32::from_le_bytes(bytes.try_into().ok()?) as i128),
+            IrType::U32 | IrType::PointerTo(_) | IrType::ArrayOf(_, _) => {
+                Value::Int(u32::from_le_bytes(bytes.try_into().ok()?) as i128)
+            }
+            IrType::I64 => Value::Int(i64::from_le_bytes(bytes.try_into().ok()?) as i128),
+            IrType::U64 => Value::Int(u64::from_le_bytes(bytes.try_into().ok()?) as i128),
+            IrType::F32 => Value::Float(f32::from_le_bytes(bytes.try_into().ok()?) as f64),
+            IrType::F64 => Value::Float(f64::from_le_bytes(bytes.try_into().ok()?)),
+            _ => return None,
+        };
+        Some(value)
+    }
+
+    /// Store the value as value_type, truncating integers to its width, and converting
+    /// integers to floats
+    fn write_value(&mut self, value_type: &IrType, addr: u32, value: Value) -> Option<()> {
+        let bytes = match (value_type, value) {
+            (IrType::I8 | IrType::U8, Value::Int(n)) => vec![n as u8],
+            (IrType::I16 | IrType::U16, Value::Int(n)) => (n as u16).to_le_bytes().to_vec(),
+            (
+                IrType::I32 | IrType::U32 | IrType::PointerTo(_) | IrType::ArrayOf(_, _),
+                Value::Int(n),
+            ) => (n as u32).to_le_bytes().to_vec(),
+            (IrType::I64 | IrType::U64, Value::Int(n)) => (n as u64).to_le_bytes().to_vec(),
+            (IrType::F32, Value::Int(n)) => (n as f32).to_le_bytes().to_vec(),
+            (IrType::F32, Value::Float(z)) => (z as f32).to_le_bytes().to_vec(),
+            (IrType::F64, Value::Int(n)) => (n as f64).to_le_bytes().to_vec(),
+            (IrType::F64, Value::Float(z)) => z.to_le_bytes().to_vec(),
+            _ => return None,
+        };
+        let range = self.byte_range(addr, bytes.len() as u32)?;
+        self.data[range].copy_from_slice(&bytes);
+        Some(())
+    }
+
+    fn copy_bytes(&mut self, dest_addr: u32, src_addr: u32, byte_size: u32) -> Option<()> {
+        let src_range = self.byte_range(src_addr, byte_size)?;
+        let dest_range = self.byte_range(dest_addr, byte_size)?;
+        self.data.copy_within(src_range, dest_range.start);
+        Some(())
+    }
+}
+
+fn pointer_type() -> IrType {
+    IrType::PointerTo(Box::new(IrType::Void))
+}
+
+fn is_integer_value_type(ir_type: &IrType) -> bool {
+    ir_type.is_integral_type() || matches!(ir_type, IrType::PointerTo(_) | IrType::ArrayOf(..))
+}
+
+/// The smallest and largest values of an integer type
+fn get_integer_range(ir_type: &IrType) -> (i128, i128) {
+    match ir_type {
+        IrType::I8 => (i8::MIN as i128, i8::MAX as i128),
+        IrType::U8 => (0, u8::MAX as i128),
+        IrType::I16 => (i16::MIN as i128, i16::MAX as i128),
+        IrType::U16 => (0, u16::MAX as i128),
+        IrType::I32 => (i32::MIN as i128, i32::MAX as i128),
+        IrType::I64 => (i64::MIN as i128, i64::MAX as i128),
+        IrType::U64 => (0, u64::MAX as i128),
+        _ => (0, u32::MAX as i128),
+    }
+}
+
+/// Convert the value to how it would be on the wasm stack as value_type. Narrow integers
+/// are i32s on the wasm stack, so they're only wrapped to 32 bits, like wasm does.
+fn normalise_value(value: Value, value_type: &IrType) -> Option<Value> {
+    match (value_type, value) {
+        (IrType::I8 | IrType::I16 | IrType::I32, Value::Int(n)) => {
+            Some(Value::Int(n as i32 as i128))
+        }
+        (
+            IrType::U8 | IrType::U16 | IrType::U32 | IrType::PointerTo(_) | IrType::ArrayOf(_, _),
+            Value::Int(n),
+        ) => Some(Value::Int(n as u32 as i128)),
+        (IrType::I64, Value::Int(n)) => Some(Value::Int(n as i64 as i128)),
+        (IrType::U64, Value::Int(n)) => Some(Value::Int(n as u64 as i128)),
+        (IrType::F32, Value::Float(z)) => Some(Value::Float(z as f32 as f64)),
+        (IrType::F64, Value::Float(z)) => Some(Value::Float(z)),
+        _ => None,
+    }
+}
+
+/// The dest, src, and type that the src is loaded as, of a conversion instruction
+fn get_conversion_operands(instr: &Instruction) -> Option<(&VarId, &Src, IrType)> {
+    let (dest, src, src_type) = match instr {
+        Instruction::I8toI16(_, dest, src) | Instruction::I8toU16(_, dest, src) => {
+            (dest, src, IrType::I8)
+        }
+        Instruction::U8toI16(_, dest, src) | Instruction::U8toU16(_, dest, src) => {
+            (dest, src, IrType::U8)
+        }
+        Instruction::I16toI32(_, dest, src) | Instruction::I16toU32(_, dest, src) => {
+            (dest, src, IrType::I16)
+        }
+        Instruction::U16toI32(_, dest, src) | Instruction::U16toU32(_, dest, src) => {
+            (dest, src, IrType::U16)
+        }
+        Instruction::I32toU32(_, dest, src)
+        | Instruction::I32toU64(_, dest, src)
+        | Instruction::I32toI64(_, dest, src)
+        | Instruction::I32toF32(_, dest, src)
+        | Instruction::I32toF64(_, dest, src)
+        | Instruction::I32toI8(_, dest, src)
+        | Instruction::I32toU8(_, dest, src)
+        | Instruction::I32toPtr(_, dest, src) => (dest, src, IrType::I32),
+        Instruction::U32toU64(_, dest, src)
+        | Instruction::U32toI64(_, dest, src)
+        | Instruction::U32toF32(_, dest, src)
+        | Instruction::U32toF64(_, dest, src)
+        | Instruction::U32toI8(_, dest, src)
+        | Instruction::U32toU8(_, dest, src)
+        | Instruction::U32toPtr(_, dest, src) => (dest, src, IrType::U32),
+        Instruction::I64toU64(_, dest, src)
+        | Instruction::I64toF32(_, dest, src)
+        | Instruction::I64toF64(_, dest, src)
+        | Instruction::I64toI8(_, dest, src)
+        | Instruction::I64toU8(_, dest, src)
+        | Instruction::I64toI32(_, dest, src) => (dest, src, IrType::I64),
+        Instruction::U64toF32(_, dest, src)
+        | Instruction::U64toF64(_, dest, src)
+        | Instruction::U64toI8(_, dest, src)
+        | Instruction::U64toU8(_, dest, src)
+        | Instruction::U64toI32(_, dest, src) => (dest, src, IrType::U64),
+        Instruction::F32toF64(_, dest, src) => (dest, src, IrType::F32),
+        Instruction::F64toI32(_, dest, src) => (dest, src, IrType::F64),
+        Instruction::PtrToI32(_, dest, src) => (dest, src, pointer_type()),
+        _ => return None,
+    };
+    Some((dest, src, src_type))
+}
@@ -1,69 +1,108 @@
 use std::borrow::ToOwned;
 use std::collections::{HashMap, VecDeque};
+use std::mem;
+use std::sync::Mutex;
+use std::thread;
 
 use log::{debug, info};
 
 use crate::back_end::backend_error::BackendError;
+use crate::back_end::calling_convention::{
+    get_native_function_type, load_src_as_type, load_zero_value, CallingConvention,
+};
+use crate::back_end::heap_allocator::{
+    find_heap_allocator_functions, generate_heap_allocator_function,
+};
 use crate::back_end::initialise_memory::initialise_memory;
-use crate::back_end::memory_constants::PTR_SIZE;
+use crate::back_end::library_kernels::{
+    find_library_kernel_functions, generate_library_kernel_function,
+};
+use crate::back_end::memory_constants::{PTR_SIZE, STACK_FRAME_ALIGNMENT};
 use crate::back_end::memory_operations::{
-    load, load_constant, load_src, load_var, load_var_address, store, store_var,
+    copy_aggregate_from_address_to_var, copy_aggregate_var_to_address, get_var_mem_arg, load,
+    load_constant, load_src, load_var, load_var_address, load_var_base_address, store,
+    store_at_offset, store_var, store_with_mem_arg, zero_memory,
+};
+use crate::back_end::peephole_optimisation::optimise_wasm_expression;
+use crate::back_end::profiler::{count_block, initialise_profiler, profile_call};
+use crate::back_end::stack_allocation::allocate_vars::{
+    allocate_local_vars, VariableAllocationMap,
 };
-use crate::back_end::profiler::initialise_profiler;
-use crate::back_end::stack_allocation::allocate_vars::{allocate_global_vars, allocate_local_vars};
+use crate::back_end::stack_allocation::stack_size_estimate::estimate_max_stack_size;
 use crate::back_end::stack_frame_operations::{
-    increment_stack_ptr_by_known_offset, increment_stack_ptr_dynamic, load_frame_ptr,
-    load_stack_ptr, overwrite_current_stack_frame_with_new_stack_frame, pop_stack_frame,
-    set_frame_ptr_to_stack_ptr, set_up_new_stack_frame,
+    call_native_function, increment_stack_ptr_by_known_offset, increment_stack_ptr_dynamic,
+    load_frame_ptr, load_stack_ptr, native_tail_call_native_function,
+    native_tail_call_stack_frame_function, overwrite_current_stack_frame_with_new_stack_frame,
+    pop_stack_frame, set_frame_ptr_to_stack_ptr, set_up_new_stack_frame,
+    stack_frame_tail_call_native_function,
 };
 use crate::back_end::target_code_generation_context::{
     ControlFlowElement, FunctionContext, ModuleContext,
 };
+use crate::back_end::threads::{export_thread_main, initialise_shared_memory, initialise_threads};
 use crate::back_end::wasm_indices::{FuncIdx, LabelIdx, LocalIdx, TypeIdx};
 use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmExpression, WasmInstruction};
+use crate::back_end::wasm_module::code_section::LocalDeclaration;
 use crate::back_end::wasm_module::exports_section::{ExportDescriptor, WasmExport};
 use crate::back_end::wasm_module::module::WasmModule;
 use crate::back_end::wasm_module::types_section::WasmFunctionType;
 use crate::back_end::wasm_types::{NumType, ValType};
 use crate::id::Id;
 use crate::middle_end::ids::{FunId, LabelId};
-use crate::middle_end::instructions::{Instruction, Src};
+use crate::middle_end::instructions::{Constant, Instruction, Src};
 use crate::middle_end::ir::ProgramMetadata;
 use crate::middle_end::ir_types::IrType;
 use crate::program_config::enabled_optimisations::EnabledOptimisations;
 use crate::program_config::enabled_profiling::EnabledProfiling;
+use crate::program_config::memory_limits::MemoryLimits;
 use crate::program_config::program_constants::MAIN_FUNCTION_EXPORT_NAME;
 use crate::program_config::program_constants::{
-    get_imported_function_names, MAIN_FUNCTION_SOURCE_NAME,
+    get_imported_function_names, GLOBAL_INSTRS_FUNCTION_NAME, MAIN_FUNCTION_SOURCE_NAME,
+    THREAD_MAIN_FUNCTION_NAME,
 };
 use crate::relooper::blocks::{Block, MultipleBlockId};
+use crate::relooper::label_elimination::eliminate_labels;
 use crate::relooper::relooper::{ReloopedFunction, ReloopedProgram};
 
+/// Multiple blocks with at least this many entry labels dispatch to their handled blocks
+/// with a jump table, instead of comparing the label variable against each entry label
+const MIN_DISPATCH_BR_TABLE_LABELS: usize = 4;
+/// How many of the jump table entries must be entry labels as a percentage of the table
+/// length. The labels of a function are numbered consecutively, so this is only not met
+/// for multiple blocks whose entry labels are far apart in the function. Each table entry
+/// is only a byte, so a sparse table is still smaller than the comparisons it replaces
+const MIN_DISPATCH_BR_TABLE_DENSITY_PERCENT: u64 = 15;
+/// If the profile shows the first handled block is entered at least this percentage of the
+/// time, testing for it first is cheaper on average than a jump table
+const MIN_HOT_HANDLED_BLOCK_PERCENT: u64 = 90;
+
+/// The function bodies are generated on up to codegen_threads threads
 pub fn generate_target_code(
     mut prog: ReloopedProgram,
     enabled_optimisations: &EnabledOptimisations,
     enabled_profiling: &EnabledProfiling,
+    memory_limits: &MemoryLimits,
+    codegen_threads: usize,
 ) -> Result<WasmModule, BackendError> {
     let mut wasm_module = WasmModule::new();
-    let mut module_context = ModuleContext::new(enabled_profiling);
-
-    initialise_profiler(&mut module_context, &mut prog);
-
-    let (imported_functions, defined_functions) = separate_imported_and_defined_functions(
-        &prog.program_metadata,
-        prog.program_blocks.functions,
-    );
-
-    module_context.calculate_func_idxs(&imported_functions, &defined_functions);
-
-    let initial_top_of_stack_addr = initialise_memory(
+    let PreparedModule {
+        mut module_context,
+        imported_functions,
+        defined_functions,
+        global_block,
+        global_var_addrs,
+    } = prepare_module_context(
+        &mut prog,
         &mut wasm_module,
-        &mut module_context,
-        &prog.program_metadata,
-    );
+        enabled_optimisations,
+        enabled_profiling,
+        memory_limits,
+    )?;
 
     let mut func_idx_to_type_idx_map: HashMap<FuncIdx, TypeIdx> = HashMap::new();
     let mut func_idx_to_body_code_map: HashMap<FuncIdx, WasmExpression> = HashMap::new();
+    let mut func_idx_to_local_declarations_map: HashMap<FuncIdx, Vec<LocalDeclaration>> =
+        HashMap::new();
 
     //
     // global instrs
@@ -88,35 +127,22 @@ pub fn generate_target_code(
         global_wasm_function_type_idx,
     );
 
+    // with threads, the memory is initialised here rather than when the module is
+    // instantiated, so it's only done once, by the main thread
+    initialise_shared_memory(&mut global_wasm_instrs, &module_context);
+
     // initialise the frame pointer, and set previous frame ptr value to NULL
     // address operand
-    load_stack_ptr(&mut global_wasm_instrs);
+    load_stack_ptr(&mut global_wasm_instrs, &module_context);
     // value to store
     global_wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
     global_wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg::zero(),
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
     });
     // set frame ptr to start of this frame
-    set_frame_ptr_to_stack_ptr(&mut global_wasm_instrs);
-
-    let mut global_var_addrs = HashMap::new();
-    if let Some(global_block) = prog.program_blocks.global_instrs {
-        global_var_addrs = allocate_global_vars(
-            &global_block,
-            initial_top_of_stack_addr,
-            &mut global_wasm_instrs,
-            &module_context,
-            &prog.program_metadata,
-        );
-
-        // let var_offsets = allocate_local_vars(
-        //     &global_block,
-        //     &mut global_wasm_instrs,
-        //     Box::new(IrType::Function(Box::new(IrType::Void), Vec::new(), false)), // global instructions have a void function type, so don't allocate any space for a return value
-        //     Vec::new(),                                                            // no parameters
-        //     &prog.program_metadata,
-        // );
+    set_frame_ptr_to_stack_ptr(&mut global_wasm_instrs, &module_context);
 
+    if let Some(global_block) = global_block {
         let mut global_context = FunctionContext::global_context(global_var_addrs.to_owned());
 
         global_wasm_instrs.append(&mut convert_block_to_wasm(
@@ -130,16 +156,16 @@ pub fn generate_target_code(
     // call main() after global instructions -- set up its stack frame
     //
     // store frame ptr at start of stack frame
-    load_stack_ptr(&mut global_wasm_instrs);
+    load_stack_ptr(&mut global_wasm_instrs, &module_context);
     // value to store: current value of frame ptr
-    load_frame_ptr(&mut global_wasm_instrs);
+    load_frame_ptr(&mut global_wasm_instrs, &module_context);
     // store frame ptr
     global_wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg::zero(),
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
     });
 
     // set frame ptr to point at new stack frame
-    set_frame_ptr_to_stack_ptr(&mut global_wasm_instrs);
+    set_frame_ptr_to_stack_ptr(&mut global_wasm_instrs, &module_context);
 
     // increment stack ptr, also leaving space for i32 return value
     let i32_byte_size = IrType::I32
@@ -155,14 +181,14 @@ pub fn generate_target_code(
     // store params argc and argv in main()'s stack frame
     //
     // address operand for where to store argc param
-    load_stack_ptr(&mut global_wasm_instrs);
+    load_stack_ptr(&mut global_wasm_instrs, &module_context);
     // load argc
     global_wasm_instrs.push(WasmInstruction::LocalGet {
         local_idx: LocalIdx { x: 0 },
     });
     // store
     global_wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg::zero(),
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
     });
     // increment stack ptr
     increment_stack_ptr_by_known_offset(
@@ -172,14 +198,14 @@ pub fn generate_target_code(
     );
 
     // address operand for where to store argv param
-    load_stack_ptr(&mut global_wasm_instrs);
+    load_stack_ptr(&mut global_wasm_instrs, &module_context);
     // load argv
     global_wasm_instrs.push(WasmInstruction::LocalGet {
         local_idx: LocalIdx { x: 1 },
     });
     // store
     global_wasm_instrs.push(WasmInstruction::I32Store {
-        mem_arg: MemArg::zero(),
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
     });
     // increment stack ptr
     increment_stack_ptr_by_known_offset(
@@ -213,31 +239,35 @@ pub fn generate_target_code(
     //
     // address operand for loading return value: frame ptr is still pointing at main() stack frame,
     //     return value is just above previous frame ptr
-    load_frame_ptr(&mut global_wasm_instrs);
-    global_wasm_instrs.push(WasmInstruction::I32Const { n: PTR_SIZE as i32 });
-    global_wasm_instrs.push(WasmInstruction::I32Add);
+    load_frame_ptr(&mut global_wasm_instrs, &module_context);
     // load return value onto stack
     global_wasm_instrs.push(WasmInstruction::I32Load {
-        mem_arg: MemArg::zero(),
+        mem_arg: MemArg::natural(PTR_SIZE, PTR_SIZE),
     });
     // return from program
     global_wasm_instrs.push(WasmInstruction::Return);
 
-    func_idx_to_body_code_map.insert(
-        global_instrs_func_idx.to_owned(),
-        WasmExpression {
-            instrs: global_wasm_instrs,
-        },
-    );
+    let mut global_body_code = WasmExpression {
+        instrs: global_wasm_instrs,
+    };
+    if enabled_optimisations.is_peephole_optimisation_enabled() {
+        optimise_wasm_expression(&mut global_body_code);
+    }
+    func_idx_to_body_code_map.insert(global_instrs_func_idx.to_owned(), global_body_code);
 
     // export this function from wasm module
     let main_export = WasmExport {
         name: MAIN_FUNCTION_EXPORT_NAME.to_owned(),
         export_descriptor: ExportDescriptor::Func {
-            func_idx: global_instrs_func_idx,
+            func_idx: global_instrs_func_idx.to_owned(),
         },
     };
     wasm_module.exports_section.exports.push(main_export);
+    export_thread_main(&mut wasm_module, &module_context);
+    wasm_module.name_section.function_names.insert(
+        global_instrs_func_idx.to_owned(),
+        GLOBAL_INSTRS_FUNCTION_NAME.to_owned(),
+    );
 
     // end global instrs
 
@@ -248,56 +278,51 @@ pub fn generate_target_code(
     };
     let empty_type_idx = wasm_module.insert_type(empty_type);
 
-    for (fun_id, function) in defined_functions {
-        let wasm_func_idx = module_context.fun_id_to_func_idx_map.get(&fun_id).unwrap();
-
-        // all functions have empty type, because params/result are stored in stack frame
-        func_idx_to_type_idx_map.insert(wasm_func_idx.to_owned(), empty_type_idx.to_owned());
-
-        if let Some(mut block) = function.block {
-            let mut function_wasm_instrs = Vec::new();
+    for (fun_id, function) in &defined_functions {
+        let wasm_func_idx = module_context.fun_id_to_func_idx_map.get(fun_id).unwrap();
 
-            let var_offsets = allocate_local_vars(
-                &mut block,
-                &mut function_wasm_instrs,
-                function.type_info,
-                function.param_var_mappings,
-                &module_context,
-                &mut prog.program_metadata,
-                enabled_optimisations,
-            );
-
-            let mut function_context = FunctionContext::new(
-                var_offsets,
-                global_var_addrs.to_owned(),
-                function.label_variable.unwrap(),
-            );
+        let calling_convention = module_context.get_calling_convention(fun_id);
+        match calling_convention {
+            CallingConvention::StackFrame => {
+                // empty type, because params/result are stored in stack frame
+                func_idx_to_type_idx_map
+                    .insert(wasm_func_idx.to_owned(), empty_type_idx.to_owned());
+            }
+            CallingConvention::Native => {
+                let native_type = get_native_function_type(&function.type_info).unwrap();
+                let native_type_idx = wasm_module.insert_or_get_type(native_type);
+                func_idx_to_type_idx_map.insert(wasm_func_idx.to_owned(), native_type_idx);
+            }
+        }
+    }
 
-            function_wasm_instrs.append(&mut convert_block_to_wasm(
-                block,
-                &mut function_context,
-                &module_context,
-                &prog.program_metadata,
-            ));
+    // the null dest var is the only thing that generating a function body would add to the
+    // program metadata, so create it up front and let the function bodies share the metadata
+    prog.program_metadata.init_null_dest_var();
 
-            func_idx_to_body_code_map.insert(
-                wasm_func_idx.to_owned(),
-                WasmExpression {
-                    instrs: function_wasm_instrs,
-                },
-            );
-        } else {
-            // empty function body
-            func_idx_to_body_code_map.insert(
-                wasm_func_idx.to_owned(),
-                WasmExpression { instrs: Vec::new() },
-            );
-        }
+    for function_code in generate_function_bodies(
+        defined_functions,
+        &global_var_addrs,
+        &module_context,
+        &prog.program_metadata,
+        enabled_optimisations,
+        codegen_threads,
+    ) {
+        func_idx_to_body_code_map
+            .insert(function_code.func_idx.to_owned(), function_code.body_code);
+        func_idx_to_local_declarations_map.insert(
+            function_code.func_idx.to_owned(),
+            function_code.local_declarations,
+        );
+        wasm_module
+            .name_section
+            .insert_local_names(function_code.func_idx, function_code.local_names);
     }
 
     wasm_module.insert_defined_functions(
         func_idx_to_body_code_map,
         func_idx_to_type_idx_map,
+        func_idx_to_local_declarations_map,
         &module_context,
     );
 
@@ -319,9 +344,341 @@ pub fn generate_target_code(
         &module_context,
     );
 
+    // name the functions after their C names, for stack traces and profilers
+    for (fun_name, fun_id) in &prog.program_metadata.function_ids {
+        if let Some(func_idx) = module_context.fun_id_to_func_idx_map.get(fun_id) {
+            wasm_module
+                .name_section
+                .function_names
+                .insert(func_idx.to_owned(), fun_name.to_owned());
+        }
+    }
+
     Ok(wasm_module)
 }
 
+/// The module context, and the parts of the program that code is generated from, once the
+/// functions have been given their func idxs and calling conventions and the memory has
+/// been laid out
+struct PreparedModule<'a> {
+    module_context: ModuleContext<'a>,
+    imported_functions: Vec<(FunId, String, ReloopedFunction)>,
+    defined_functions: Vec<(FunId, ReloopedFunction)>,
+    global_block: Option<Block>,
+    global_var_addrs: VariableAllocationMap,
+}
+
+/// Everything before generating the function bodies, which generate_target_code and the
+/// stack allocation benchmark both do. The functions and global instrs are taken out of
+/// prog, leaving its program metadata.
+fn prepare_module_context<'a>(
+    prog: &mut ReloopedProgram,
+    wasm_module: &mut WasmModule,
+    enabled_optimisations: &'a EnabledOptimisations,
+    enabled_profiling: &'a EnabledProfiling,
+    memory_limits: &MemoryLimits,
+) -> Result<PreparedModule<'a>, BackendError> {
+    let mut module_context = ModuleContext::new(enabled_optimisations, enabled_profiling);
+
+    if enabled_optimisations.is_label_elimination_enabled() {
+        eliminate_labels(
+            &mut prog.program_blocks,
+            !enabled_profiling.is_block_counting_enabled(),
+        );
+    }
+    initialise_profiler(&mut module_context, prog);
+    let max_stack_size_estimate = estimate_max_stack_size(prog, MAIN_FUNCTION_SOURCE_NAME);
+    let thread_stack_size_estimate = estimate_max_stack_size(prog, THREAD_MAIN_FUNCTION_NAME);
+
+    let (imported_functions, defined_functions) = separate_imported_and_defined_functions(
+        &prog.program_metadata,
+        mem::take(&mut prog.program_blocks.functions),
+    );
+
+    module_context.calculate_func_idxs(&imported_functions, &defined_functions);
+    module_context.calculate_calling_conventions(
+        &defined_functions,
+        prog.program_metadata
+            .function_ids
+            .get(MAIN_FUNCTION_SOURCE_NAME),
+    );
+    find_heap_allocator_functions(
+        &mut module_context,
+        &defined_functions,
+        &prog.program_metadata,
+    );
+    find_library_kernel_functions(
+        &mut module_context,
+        &defined_functions,
+        &prog.program_metadata,
+    );
+    initialise_threads(
+        &mut module_context,
+        &imported_functions,
+        &defined_functions,
+        &prog.program_metadata,
+        memory_limits,
+    )?;
+
+    let mut global_block = prog.program_blocks.global_instrs.take();
+    let global_var_addrs = initialise_memory(
+        wasm_module,
+        &mut module_context,
+        &prog.program_metadata,
+        global_block.as_mut(),
+        max_stack_size_estimate,
+        thread_stack_size_estimate,
+        memory_limits,
+    );
+
+    Ok(PreparedModule {
+        module_context,
+        imported_functions,
+        defined_functions,
+        global_block,
+        global_var_addrs,
+    })
+}
+
+/// Only allocates the local variables of each defined function, with the same module
+/// context that generate_target_code would use, so that stack allocation can be benchmarked
+/// on its own. Returns the number of wasm instructions generated to set up the stack frames.
+pub fn allocate_all_local_vars(
+    mut prog: ReloopedProgram,
+    enabled_optimisations: &EnabledOptimisations,
+    enabled_profiling: &EnabledProfiling,
+    memory_limits: &MemoryLimits,
+) -> Result<usize, BackendError> {
+    let mut wasm_module = WasmModule::new();
+    let PreparedModule {
+        module_context,
+        defined_functions,
+        ..
+    } = prepare_module_context(
+        &mut prog,
+        &mut wasm_module,
+        enabled_optimisations,
+        enabled_profiling,
+        memory_limits,
+    )?;
+
+    let mut instr_count = 0;
+    for (fun_id, function) in defined_functions {
+        let mut block = match function.block {
+            Some(block) => block,
+            None => continue,
+        };
+        let mut wasm_instrs = Vec::new();
+        allocate_local_vars(
+            &mut block,
+            &mut wasm_instrs,
+            function.type_info,
+            function.param_var_mappings,
+            &module_context.get_calling_convention(&fun_id),
+            &module_context,
+            &prog.program_metadata,
+            enabled_optimisations,
+        );
+        instr_count += wasm_instrs.len();
+    }
+    Ok(instr_count)
+}
+
+/// The wasm code generated for a function body
+struct FunctionCode {
+    func_idx: FuncIdx,
+    body_code: WasmExpression,
+    local_declarations: Vec<LocalDeclaration>,
+    local_names: Vec<(LocalIdx, String)>,
+}
+
+/// Generate the function bodies on a pool of up to thread_count worker threads, which each
+/// take the next function that hasn't been generated yet. Each body only depends on its own
+/// function and on the module context and program metadata, which are only read, so the
+/// code generated is the same whichever thread generates it. The results are put back in
+/// func idx order when they're inserted into the module.
+fn generate_function_bodies(
+    defined_functions: Vec<(FunId, ReloopedFunction)>,
+    global_var_addrs: &VariableAllocationMap,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+    enabled_optimisations: &EnabledOptimisations,
+    thread_count: usize,
+) -> Vec<FunctionCode> {
+    let thread_count = thread_count.min(defined_functions.len());
+
+    if thread_count <= 1 {
+        return defined_functions
+            .into_iter()
+            .map(|(fun_id, function)| {
+                generate_function_body(
+                    fun_id,
+                    function,
+                    global_var_addrs,
+                    module_context,
+                    prog_metadata,
+                    enabled_optimisations,
+                )
+            })
+            .collect();
+    }
+
+    let remaining_functions = Mutex::new(defined_functions.into_iter());
+    thread::scope(|scope| {
+        let workers: Vec<_> = (0..thread_count)
+            .map(|_| {
+                scope.spawn(|| {
+                    let mut functions_code = Vec::new();
+                    loop {
+                        // release the lock before generating the function
+                        let next_function = remaining_functions.lock().unwrap().next();
+                        match next_function {
+                            Some((fun_id, function)) => {
+                                functions_code.push(generate_function_body(
+                                    fun_id,
+                                    function,
+                                    global_var_addrs,
+                                    module_context,
+                                    prog_metadata,
+                                    enabled_optimisations,
+                                ))
+                            }
+                            None => break,
+                        }
+                    }
+                    functions_code
+                })
+            })
+            .collect();
+
+        workers
+            .into_iter()
+            .flat_map(|worker| worker.join().unwrap())
+            .collect()
+    })
+}
+
+fn generate_function_body(
+    fun_id: FunId,
+    function: ReloopedFunction,
+    global_var_addrs: &VariableAllocationMap,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+    enabled_optimisations: &EnabledOptimisations,
+) -> FunctionCode {
+    let wasm_func_idx = module_context
+        .fun_id_to_func_idx_map
+        .get(&fun_id)
+        .unwrap()
+        .to_owned();
+
+    let mut block = match function.block {
+        Some(block) => block,
+        None => {
+            // malloc() and free() are generated by the heap allocator
+            if let Some((body_code, local_declarations, local_names)) =
+                generate_heap_allocator_function(&fun_id, module_context)
+            {
+                return FunctionCode {
+                    func_idx: wasm_func_idx,
+                    body_code,
+                    local_declarations,
+                    local_names,
+                };
+            }
+            // strlen(), memchr(), memcpy() and memset() are generated as library kernels
+            if let Some((body_code, local_declarations, local_names)) =
+                generate_library_kernel_function(&fun_id, module_context)
+            {
+                return FunctionCode {
+                    func_idx: wasm_func_idx,
+                    body_code,
+                    local_declarations,
+                    local_names,
+                };
+            }
+            // empty function body
+            return FunctionCode {
+                func_idx: wasm_func_idx,
+                body_code: WasmExpression { instrs: Vec::new() },
+                local_declarations: Vec::new(),
+                local_names: Vec::new(),
+            };
+        }
+    };
+
+    let calling_convention = module_context.get_calling_convention(&fun_id);
+    let mut function_wasm_instrs = Vec::new();
+
+    let return_type = match &function.type_info {
+        IrType::Function(return_type, _, _) => (**return_type).to_owned(),
+        _ => unreachable!(),
+    };
+
+    let (var_offsets, promoted_locals) = allocate_local_vars(
+        &mut block,
+        &mut function_wasm_instrs,
+        function.type_info,
+        function.param_var_mappings,
+        &calling_convention,
+        module_context,
+        prog_metadata,
+        enabled_optimisations,
+    );
+
+    let mut function_context = FunctionContext::new(
+        fun_id,
+        var_offsets,
+        promoted_locals.var_local_idxs,
+        global_var_addrs.to_owned(),
+        function.label_variable.unwrap(),
+        calling_convention,
+        return_type,
+    );
+
+    function_wasm_instrs.append(&mut convert_block_to_wasm(
+        block,
+        &mut function_context,
+        module_context,
+        prog_metadata,
+    ));
+
+    // if control reaches the end of the function without a return statement,
+    // there still has to be a result value on the wasm stack
+    if function_context.calling_convention == CallingConvention::Native
+        && function_context.return_type != IrType::Void
+    {
+        load_zero_value(&function_context.return_type, &mut function_wasm_instrs);
+    }
+
+    let mut body_code = WasmExpression {
+        instrs: function_wasm_instrs,
+    };
+    if enabled_optimisations.is_peephole_optimisation_enabled() {
+        optimise_wasm_expression(&mut body_code);
+    }
+
+    // temporary vars don't have a source name, so they're named the same as in the IR
+    let local_names = function_context
+        .var_local_idxs
+        .iter()
+        .map(|(var, local_idx)| {
+            let name = match prog_metadata.var_names.get(var) {
+                Some(name) => name.to_owned(),
+                None => var.to_string(),
+            };
+            (local_idx.to_owned(), name)
+        })
+        .collect();
+
+    FunctionCode {
+        func_idx: wasm_func_idx,
+        body_code,
+        local_declarations: promoted_locals.local_declarations,
+        local_names,
+    }
+}
+
 fn separate_imported_and_defined_functions(
     prog_metadata: &ProgramMetadata,
     functions: HashMap<FunId, ReloopedFunction>,
@@ -371,6 +728,12 @@ fn convert_block_to_wasm(
 
     match block {
         Block::Simple { internal, next } => {
+            count_block(
+                &internal.label,
+                &mut wasm_instrs,
+                function_context,
+                module_context,
+            );
             for instr in internal.instrs {
                 convert_ir_instr_to_wasm(
                     instr,
@@ -435,13 +798,36 @@ fn convert_block_to_wasm(
             handled_blocks,
             next,
         } => {
-            wasm_instrs.append(&mut convert_handled_blocks(
-                handled_blocks.into(),
-                id,
-                function_context,
-                module_context,
-                prog_metadata,
-            ));
+            let dispatch_br_table = if module_context
+                .enabled_optimisations
+                .is_dispatch_br_table_enabled()
+            {
+                get_dispatch_br_table(&handled_blocks, prog_metadata)
+            } else {
+                None
+            };
+            match dispatch_br_table {
+                Some((first_label, table)) => {
+                    wasm_instrs.push(convert_handled_blocks_with_br_table(
+                        handled_blocks,
+                        id,
+                        first_label,
+                        table,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    ));
+                }
+                None => {
+                    wasm_instrs.append(&mut convert_handled_blocks(
+                        handled_blocks.into(),
+                        id,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    ));
+                }
+            }
 
             match next {
                 None => {}
@@ -467,7 +853,42 @@ fn convert_ir_instr_to_wasm(
     module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
 ) {
+    // calls are instrumented once they've been converted, so that the profiler can put its
+    // instructions right next to the wasm call
+    let profiled_call = match &instr {
+        Instruction::Call(_, _, callee, _) | Instruction::TailCall(_, callee, _)
+            if module_context.call_profile.is_some() =>
+        {
+            Some((callee.to_owned(), wasm_instrs.len()))
+        }
+        _ => None,
+    };
+
     match instr {
+        Instruction::SimpleAssignment(_, dest, Src::Var(src_var))
+            if prog_metadata
+                .get_var_type(&dest)
+                .unwrap()
+                .is_struct_or_union_type() =>
+        {
+            // structs and unions don't fit on the wasm stack, so copy them in memory
+            copy_aggregate_from_address_to_var(
+                &dest,
+                |instrs| {
+                    load_var_address(
+                        &src_var,
+                        instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    )
+                },
+                wasm_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
+        }
         Instruction::SimpleAssignment(_, dest, src) => {
             // load src onto wasm stack
             let mut load_src_instrs = Vec::new();
@@ -477,6 +898,7 @@ fn convert_ir_instr_to_wasm(
                 dest_type,
                 &mut load_src_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -486,6 +908,32 @@ fn convert_ir_instr_to_wasm(
                 load_src_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
+                prog_metadata,
+            );
+        }
+        Instruction::LoadFromAddress(_, dest, src)
+            if prog_metadata
+                .get_var_type(&dest)
+                .unwrap()
+                .is_struct_or_union_type() =>
+        {
+            let dest_type = prog_metadata.get_var_type(&dest).unwrap();
+            copy_aggregate_from_address_to_var(
+                &dest,
+                |instrs| {
+                    load_src(
+                        src.to_owned(),
+                        dest_type,
+                        instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    )
+                },
+                wasm_instrs,
+                function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -495,9 +943,10 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut load_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -510,6 +959,30 @@ fn convert_ir_instr_to_wasm(
                 load_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
+                prog_metadata,
+            );
+        }
+        Instruction::StoreToAddress(_, dest, Src::Var(src_var))
+            if prog_metadata
+                .get_var_type(&src_var)
+                .unwrap()
+                .is_struct_or_union_type() =>
+        {
+            copy_aggregate_var_to_address(
+                &src_var,
+                |instrs| {
+                    load_var(
+                        dest.to_owned(),
+                        instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    )
+                },
+                wasm_instrs,
+                function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -519,18 +992,41 @@ fn convert_ir_instr_to_wasm(
             let inner_dest_type = dest_type.dereference_pointer_type().unwrap();
 
             // load the value of dest - the address operand
-            load_var(dest, wasm_instrs, function_context, prog_metadata);
+            load_var(
+                dest,
+                wasm_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
 
             // load the value to store
             load_src(
                 src,
-                inner_dest_type.to_owned(),
+                &inner_dest_type,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
-            store(inner_dest_type, wasm_instrs);
+            store(&inner_dest_type, wasm_instrs);
+        }
+        Instruction::ZeroMemory(_, dest, byte_size) => {
+            zero_memory(
+                |instrs| {
+                    load_var(
+                        dest.to_owned(),
+                        instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    )
+                },
+                byte_size as u32,
+                wasm_instrs,
+                module_context,
+            );
         }
         Instruction::DeclareVariable(..) | Instruction::ReferenceVariable(..) => {
             // no instructions to generate here
@@ -539,15 +1035,17 @@ fn convert_ir_instr_to_wasm(
             // allocate byte_size many bytes on the stack, and set dest to be a pointer to there
             //
             // store the current stack pointer to dest
-            load_var_address(&dest, wasm_instrs, function_context, prog_metadata);
+            let offset =
+                load_var_base_address(&dest, wasm_instrs, function_context, module_context);
 
             // let mut load_stack_ptr_instrs = Vec::new();
-            load_stack_ptr(wasm_instrs);
+            load_stack_ptr(wasm_instrs, module_context);
 
-            store(
-                IrType::PointerTo(Box::new(prog_metadata.get_var_type(&dest).unwrap())),
-                wasm_instrs,
-            );
+            let dest_ptr_type = IrType::PointerTo(Box::new(
+                prog_metadata.get_var_type(&dest).unwrap().to_owned(),
+            ));
+            let mem_arg = get_var_mem_arg(&dest, &dest_ptr_type, offset, function_context);
+            store_with_mem_arg(&dest_ptr_type, mem_arg, wasm_instrs);
 
             // store_var(
             //     dest,
@@ -559,14 +1057,32 @@ fn convert_ir_instr_to_wasm(
 
             let mut load_byte_size_instrs = Vec::new();
 
-            // load the number of bytes to allocate
-            load_src(
-                byte_size,
-                IrType::I32,
-                &mut load_byte_size_instrs,
-                function_context,
-                prog_metadata,
-            );
+            // load the number of bytes to allocate, rounded up so the stack ptr stays aligned
+            match byte_size {
+                Src::Constant(Constant::Int(n)) => {
+                    load_byte_size_instrs.push(WasmInstruction::I32Const {
+                        n: (n as u32).next_multiple_of(STACK_FRAME_ALIGNMENT) as i32,
+                    });
+                }
+                byte_size => {
+                    load_src(
+                        byte_size,
+                        &IrType::I32,
+                        &mut load_byte_size_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+                    load_byte_size_instrs.push(WasmInstruction::I32Const {
+                        n: (STACK_FRAME_ALIGNMENT - 1) as i32,
+                    });
+                    load_byte_size_instrs.push(WasmInstruction::I32Add);
+                    load_byte_size_instrs.push(WasmInstruction::I32Const {
+                        n: -(STACK_FRAME_ALIGNMENT as i32),
+                    });
+                    load_byte_size_instrs.push(WasmInstruction::I32And);
+                }
+            }
 
             // increment stack pointer
             increment_stack_ptr_dynamic(load_byte_size_instrs, wasm_instrs, module_context);
@@ -582,13 +1098,20 @@ fn convert_ir_instr_to_wasm(
             };
 
             let mut temp_instrs = Vec::new();
-            load_var_address(&src_var, &mut temp_instrs, function_context, prog_metadata);
+            load_var_address(
+                &src_var,
+                &mut temp_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
 
             store_var(
                 dest,
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -601,9 +1124,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -628,6 +1152,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -640,9 +1165,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -686,6 +1212,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -695,16 +1222,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -740,6 +1269,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -749,16 +1279,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -795,6 +1327,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -804,16 +1337,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -844,6 +1379,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -853,16 +1389,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -898,6 +1436,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -907,16 +1446,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -952,6 +1493,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -961,16 +1503,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1000,6 +1544,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1009,16 +1554,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1051,6 +1598,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1060,16 +1608,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1099,6 +1649,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1108,16 +1659,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1147,6 +1700,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1156,16 +1710,18 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1195,6 +1751,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1208,9 +1765,10 @@ fn convert_ir_instr_to_wasm(
             let dest_type = prog_metadata.get_var_type(&dest).unwrap();
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // test it left_src is zero
@@ -1249,9 +1807,10 @@ fn convert_ir_instr_to_wasm(
 
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // test it right_src is zero
@@ -1314,6 +1873,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1328,9 +1888,10 @@ fn convert_ir_instr_to_wasm(
 
             load_src(
                 left_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // test it left_src is zero
@@ -1369,9 +1930,10 @@ fn convert_ir_instr_to_wasm(
 
             load_src(
                 right_src,
-                dest_type.to_owned(),
+                dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // test it right_src is zero
@@ -1434,6 +1996,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1443,16 +2006,18 @@ fn convert_ir_instr_to_wasm(
             // load srcs onto wasm stack
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1491,6 +2056,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1500,16 +2066,18 @@ fn convert_ir_instr_to_wasm(
             // load srcs onto wasm stack
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1548,6 +2116,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1557,16 +2126,18 @@ fn convert_ir_instr_to_wasm(
             // load srcs onto wasm stack
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1605,6 +2176,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1614,16 +2186,18 @@ fn convert_ir_instr_to_wasm(
             // load srcs onto wasm stack
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1662,6 +2236,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1672,16 +2247,18 @@ fn convert_ir_instr_to_wasm(
             // load srcs onto wasm stack
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1718,6 +2295,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1727,16 +2305,18 @@ fn convert_ir_instr_to_wasm(
             // load srcs onto wasm stack
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
 
@@ -1773,11 +2353,54 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
+                prog_metadata,
+            );
+        }
+        Instruction::Call(_, dest, fun_id, params)
+            if module_context.get_calling_convention(&fun_id) == CallingConvention::Native =>
+        {
+            let callee_function_type = prog_metadata.get_fun_type(&fun_id).unwrap();
+
+            let mut call_instrs = Vec::new();
+            call_native_function(
+                callee_function_type,
+                module_context
+                    .fun_id_to_func_idx_map
+                    .get(&fun_id)
+                    .unwrap()
+                    .to_owned(),
+                params,
+                &mut call_instrs,
+                function_context,
+                module_context,
                 prog_metadata,
             );
+
+            match callee_function_type {
+                IrType::Function(return_type, _, _) if **return_type == IrType::Void => {
+                    wasm_instrs.append(&mut call_instrs);
+                }
+                _ if prog_metadata.is_var_the_null_dest(&dest) => {
+                    // the return value isn't used
+                    wasm_instrs.append(&mut call_instrs);
+                    wasm_instrs.push(WasmInstruction::Drop);
+                }
+                _ => {
+                    // the call leaves the return value on the wasm stack, to store to dest
+                    store_var(
+                        dest,
+                        call_instrs,
+                        wasm_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+                }
+            }
         }
         Instruction::Call(_, dest, fun_id, params) => {
-            let callee_function_type = prog_metadata.function_types.get(&fun_id).unwrap();
+            let callee_function_type = prog_metadata.get_fun_type(&fun_id).unwrap();
 
             set_up_new_stack_frame(
                 callee_function_type,
@@ -1806,8 +2429,46 @@ fn convert_ir_instr_to_wasm(
                 prog_metadata,
             );
         }
+        Instruction::TailCall(_, fun_id, params)
+            if function_context.calling_convention == CallingConvention::Native
+                || module_context.get_calling_convention(&fun_id) == CallingConvention::Native =>
+        {
+            let callee_function_type = prog_metadata.get_fun_type(&fun_id).unwrap();
+            let callee_func_idx = module_context
+                .fun_id_to_func_idx_map
+                .get(&fun_id)
+                .unwrap()
+                .to_owned();
+
+            // the current stack frame can only be reused if both functions use the same
+            // calling convention
+            let tail_call_function = match (
+                &function_context.calling_convention,
+                module_context.get_calling_convention(&fun_id),
+            ) {
+                (CallingConvention::Native, CallingConvention::Native) => {
+                    native_tail_call_native_function
+                }
+                (CallingConvention::Native, CallingConvention::StackFrame) => {
+                    native_tail_call_stack_frame_function
+                }
+                (CallingConvention::StackFrame, CallingConvention::Native) => {
+                    stack_frame_tail_call_native_function
+                }
+                (CallingConvention::StackFrame, CallingConvention::StackFrame) => unreachable!(),
+            };
+            tail_call_function(
+                callee_function_type,
+                callee_func_idx,
+                params,
+                wasm_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
+        }
         Instruction::TailCall(_, fun_id, params) => {
-            let callee_function_type = prog_metadata.function_types.get(&fun_id).unwrap();
+            let callee_function_type = prog_metadata.get_fun_type(&fun_id).unwrap();
 
             overwrite_current_stack_frame_with_new_stack_frame(
                 callee_function_type,
@@ -1818,13 +2479,64 @@ fn convert_ir_instr_to_wasm(
                 prog_metadata,
             );
 
-            wasm_instrs.push(WasmInstruction::Call {
-                func_idx: module_context
-                    .fun_id_to_func_idx_map
-                    .get(&fun_id)
-                    .unwrap()
-                    .to_owned(),
-            });
+            let func_idx = module_context
+                .fun_id_to_func_idx_map
+                .get(&fun_id)
+                .unwrap()
+                .to_owned();
+            // the callee uses this function's stack frame, and both have the empty wasm
+            // type, so the callee can replace this function on the wasm call stack too
+            if module_context.can_use_return_call() {
+                wasm_instrs.push(WasmInstruction::ReturnCall { func_idx });
+            } else {
+                wasm_instrs.push(WasmInstruction::Call { func_idx });
+                wasm_instrs.push(WasmInstruction::Return);
+            }
+        }
+        Instruction::Ret(_, return_value_src)
+            if function_context.calling_convention == CallingConvention::Native =>
+        {
+            // leave the return value on the wasm stack as the function's result
+            match return_value_src {
+                Some(return_value_src) => {
+                    let return_type = function_context.return_type.to_owned();
+                    load_src_as_type(
+                        return_value_src,
+                        &return_type,
+                        wasm_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+                }
+                None if function_context.return_type != IrType::Void => {
+                    // still have to return something, to match the function's wasm type
+                    load_zero_value(&function_context.return_type, wasm_instrs);
+                }
+                None => {}
+            }
+
+            wasm_instrs.push(WasmInstruction::Return);
+        }
+        Instruction::Ret(_, Some(Src::Var(return_var)))
+            if prog_metadata
+                .get_var_type(&return_var)
+                .unwrap()
+                .is_struct_or_union_type() =>
+        {
+            // copy return value into stack frame
+            copy_aggregate_var_to_address(
+                &return_var,
+                |instrs| {
+                    load_frame_ptr(instrs, module_context);
+                    instrs.push(WasmInstruction::I32Const { n: PTR_SIZE as i32 });
+                    instrs.push(WasmInstruction::I32Add);
+                },
+                wasm_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
 
             wasm_instrs.push(WasmInstruction::Return);
         }
@@ -1832,23 +2544,22 @@ fn convert_ir_instr_to_wasm(
             if let Some(return_value_src) = return_value_src {
                 // store return value into stack frame
                 //
-                // calculate address of return value in stack frame
-                load_frame_ptr(wasm_instrs);
-                wasm_instrs.push(WasmInstruction::I32Const { n: PTR_SIZE as i32 });
-                wasm_instrs.push(WasmInstruction::I32Add);
+                // the return value is PTR_SIZE above the frame ptr
+                load_frame_ptr(wasm_instrs, module_context);
 
                 let return_type = return_value_src.get_type(prog_metadata).unwrap();
 
                 // load return value to store in stack frame
                 load_src(
                     return_value_src,
-                    return_type.to_owned(),
+                    &return_type,
                     wasm_instrs,
                     function_context,
+                    module_context,
                     prog_metadata,
                 );
 
-                store(return_type, wasm_instrs);
+                store_at_offset(&return_type, PTR_SIZE, wasm_instrs);
             }
 
             wasm_instrs.push(WasmInstruction::Return);
@@ -1873,6 +2584,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1901,6 +2613,7 @@ fn convert_ir_instr_to_wasm(
                 dest_type,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             store_var(
@@ -1908,6 +2621,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1915,15 +2629,31 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             // load src as i64
             match src {
+                Src::Var(var_id) if function_context.is_var_in_local(&var_id) => {
+                    load_var(
+                        var_id,
+                        &mut temp_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+                    // extend i32 to an i64
+                    temp_instrs.push(WasmInstruction::I64ExtendI32S);
+                }
                 Src::Var(var_id) => {
-                    load_var_address(&var_id, &mut temp_instrs, function_context, prog_metadata);
+                    let offset = load_var_base_address(
+                        &var_id,
+                        &mut temp_instrs,
+                        function_context,
+                        module_context,
+                    );
                     // load i32 into an i64
                     temp_instrs.push(WasmInstruction::I64Load32S {
-                        mem_arg: MemArg::zero(),
+                        mem_arg: get_var_mem_arg(&var_id, &IrType::I32, offset, function_context),
                     });
                 }
                 Src::Constant(constant) => {
-                    load_constant(constant, IrType::I64, &mut temp_instrs);
+                    load_constant(constant, &IrType::I64, &mut temp_instrs);
                 }
                 Src::StoreAddressVar(_) | Src::Fun(_) => {
                     unreachable!()
@@ -1934,6 +2664,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1941,15 +2672,31 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             // load src as i64
             match src {
+                Src::Var(var_id) if function_context.is_var_in_local(&var_id) => {
+                    load_var(
+                        var_id,
+                        &mut temp_instrs,
+                        function_context,
+                        module_context,
+                        prog_metadata,
+                    );
+                    // extend u32 to an i64
+                    temp_instrs.push(WasmInstruction::I64ExtendI32U);
+                }
                 Src::Var(var_id) => {
-                    load_var_address(&var_id, &mut temp_instrs, function_context, prog_metadata);
+                    let offset = load_var_base_address(
+                        &var_id,
+                        &mut temp_instrs,
+                        function_context,
+                        module_context,
+                    );
                     // load u32 into an i64
                     temp_instrs.push(WasmInstruction::I64Load32U {
-                        mem_arg: MemArg::zero(),
+                        mem_arg: get_var_mem_arg(&var_id, &IrType::I32, offset, function_context),
                     });
                 }
                 Src::Constant(constant) => {
-                    load_constant(constant, IrType::I64, &mut temp_instrs);
+                    load_constant(constant, &IrType::I64, &mut temp_instrs);
                 }
                 Src::StoreAddressVar(_) | Src::Fun(_) => {
                     unreachable!()
@@ -1960,6 +2707,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1972,9 +2720,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::I64,
+                &IrType::I64,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert i64 to i32
@@ -1984,6 +2733,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -1991,9 +2741,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::U32,
+                &IrType::U32,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert u32 to f32
@@ -2003,6 +2754,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2010,9 +2762,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::I32,
+                &IrType::I32,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert i32 to f32
@@ -2022,6 +2775,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2029,9 +2783,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::U64,
+                &IrType::U64,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert u64 to f32
@@ -2041,6 +2796,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2048,9 +2804,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::I64,
+                &IrType::I64,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert i64 to f32
@@ -2060,6 +2817,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2067,9 +2825,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::U32,
+                &IrType::U32,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert u32 to f64
@@ -2079,6 +2838,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2086,9 +2846,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::I32,
+                &IrType::I32,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert i32 to f64
@@ -2098,6 +2859,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2105,9 +2867,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::U64,
+                &IrType::U64,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert u64 to f64
@@ -2117,6 +2880,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2124,9 +2888,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::I64,
+                &IrType::I64,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert i64 to f64
@@ -2136,6 +2901,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2143,9 +2909,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::F32,
+                &IrType::F32,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert f32 to f64
@@ -2155,6 +2922,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2162,9 +2930,10 @@ fn convert_ir_instr_to_wasm(
             let mut temp_instrs = Vec::new();
             load_src(
                 src,
-                IrType::F64,
+                &IrType::F64,
                 &mut temp_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // convert f64 to i32
@@ -2174,6 +2943,7 @@ fn convert_ir_instr_to_wasm(
                 temp_instrs,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
         }
@@ -2209,16 +2979,18 @@ fn convert_ir_instr_to_wasm(
             //todo check both left and right types, in case one is a constant and the other is a var with a type we know
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // test for equality
@@ -2288,16 +3060,18 @@ fn convert_ir_instr_to_wasm(
             //todo check both left and right types, in case one is a constant and the other is a var with a type we know
             load_src(
                 left_src,
-                src_type.to_owned(),
+                &src_type,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             load_src(
                 right_src,
-                src_type.to_owned(),
+                &src_type,
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // test for equality
@@ -2361,6 +3135,118 @@ fn convert_ir_instr_to_wasm(
 
             function_context.control_flow_stack.pop();
         }
+        Instruction::BrTable(_, index_src, table, arms) => {
+            let arm_count = arms.len() as u32;
+
+            let mut br_table_instrs = Vec::new();
+            load_src(
+                index_src,
+                &IrType::I32,
+                &mut br_table_instrs,
+                function_context,
+                module_context,
+                prog_metadata,
+            );
+            br_table_instrs.push(WasmInstruction::BrTable {
+                labels: table
+                    .into_iter()
+                    .map(|arm_idx| LabelIdx { l: arm_idx as u32 })
+                    .collect(),
+                // the default is the last arm
+                label_idx: LabelIdx { l: arm_count - 1 },
+            });
+
+            wasm_instrs.push(nest_jump_table_arms(
+                br_table_instrs,
+                arms,
+                ControlFlowElement::UnlabelledBlock,
+                function_context,
+                |arm, function_context| {
+                    let mut arm_instrs = Vec::new();
+                    for instr in arm {
+                        convert_ir_instr_to_wasm(
+                            instr,
+                            &mut arm_instrs,
+                            function_context,
+                            module_context,
+                            prog_metadata,
+                        );
+                    }
+                    arm_instrs
+                },
+            ));
+        }
+    }
+
+    if let Some((callee, call_instrs_start)) = profiled_call {
+        profile_call(
+            wasm_instrs,
+            call_instrs_start,
+            &function_context.fun_id,
+            &callee,
+            module_context,
+        );
+    }
+}
+
+/// Each arm of a jump table gets a block, nested inside each other with the br_table in the
+/// innermost one. Branching out of an arm's block runs that arm's instructions just after
+/// the block, and then breaks out of the whole jump table:
+///   block            (end of jump table)
+///     block          (arm n-1)
+///       ...
+///         block      (arm 0)
+///           br_table
+///         end
+///         arm 0; br to end
+///       ...
+///     end
+///     arm n-1
+///   end
+///
+/// br_table_instrs load the index and do the br_table, where label i is arm i and label n
+/// is the end of the jump table. end_control_flow_element is pushed for the outer block.
+fn nest_jump_table_arms<T>(
+    br_table_instrs: Vec<WasmInstruction>,
+    arms: Vec<T>,
+    end_control_flow_element: ControlFlowElement,
+    function_context: &mut FunctionContext,
+    mut convert_arm: impl FnMut(T, &mut FunctionContext) -> Vec<WasmInstruction>,
+) -> WasmInstruction {
+    let arm_count = arms.len() as u32;
+
+    // an arm's instructions are inside the blocks of all the arms after it,
+    // and the block for the end of the jump table
+    function_context
+        .control_flow_stack
+        .push(end_control_flow_element);
+    for _ in 1..arm_count {
+        function_context
+            .control_flow_stack
+            .push(ControlFlowElement::UnlabelledBlock);
+    }
+
+    let mut block_instrs = br_table_instrs;
+    for (arm_i, arm) in arms.into_iter().enumerate() {
+        let mut arm_block_instrs = vec![WasmInstruction::Block {
+            blocktype: BlockType::None,
+            instrs: block_instrs,
+        }];
+        arm_block_instrs.append(&mut convert_arm(arm, function_context));
+        // the last arm falls through to the end of the jump table
+        let end_depth = arm_count - 1 - arm_i as u32;
+        if end_depth > 0 {
+            arm_block_instrs.push(WasmInstruction::Br {
+                label_idx: LabelIdx { l: end_depth },
+            });
+        }
+        function_context.control_flow_stack.pop();
+        block_instrs = arm_block_instrs;
+    }
+
+    WasmInstruction::Block {
+        blocktype: BlockType::None,
+        instrs: block_instrs,
     }
 }
 
@@ -2387,6 +3273,7 @@ fn convert_handled_blocks(
         handled_block_entries,
         &mut instrs,
         function_context,
+        module_context,
         prog_metadata,
     );
 
@@ -2418,12 +3305,130 @@ fn convert_handled_blocks(
     instrs
 }
 
+/// Returns the first label value in the jump table and the handled block index for each
+/// label value from there, or None if the multiple block has too few entry labels, or they
+/// are too spread out, for a jump table to be worth it. It's also not worth it if the
+/// profile shows that nearly every time, it's the first handled block that runs.
+fn get_dispatch_br_table(
+    handled_blocks: &Vec<Block>,
+    prog_metadata: &ProgramMetadata,
+) -> Option<(u64, Vec<u32>)> {
+    let mut entry_label_blocks: Vec<(u64, u32)> = Vec::new();
+    let mut entry_counts: Vec<u64> = Vec::new();
+    for (block_i, handled_block) in handled_blocks.iter().enumerate() {
+        let mut entry_count = 0;
+        for label in handled_block.get_entry_labels() {
+            entry_label_blocks.push((label.as_u64(), block_i as u32));
+            entry_count += prog_metadata.label_counts.get(&label).copied().unwrap_or(0);
+        }
+        entry_counts.push(entry_count);
+    }
+    if handled_blocks.len() < 2 || entry_label_blocks.len() < MIN_DISPATCH_BR_TABLE_LABELS {
+        return None;
+    }
+    let total_entry_count: u64 = entry_counts.iter().sum();
+    if total_entry_count > 0
+        && entry_counts[0] * 100 >= total_entry_count * MIN_HOT_HANDLED_BLOCK_PERCENT
+    {
+        return None;
+    }
+
+    let first_label = entry_label_blocks
+        .iter()
+        .map(|(label, _)| *label)
+        .min()
+        .unwrap();
+    let last_label = entry_label_blocks
+        .iter()
+        .map(|(label, _)| *label)
+        .max()
+        .unwrap();
+    let table_len = last_label - first_label + 1;
+    if (entry_label_blocks.len() as u64) * 100 < table_len * MIN_DISPATCH_BR_TABLE_DENSITY_PERCENT {
+        return None;
+    }
+
+    // label values that aren't an entry to any of the handled blocks skip all of them
+    let default_idx = handled_blocks.len() as u32;
+    let mut table = vec![default_idx; table_len as usize];
+    for (label, block_i) in entry_label_blocks {
+        let entry = &mut table[(label - first_label) as usize];
+        // the handled blocks are tested in order, so the first one with the label wins
+        if *entry == default_idx {
+            *entry = block_i;
+        }
+    }
+    Some((first_label, table))
+}
+
+/// Dispatch to the handled block whose entry labels contain the value of the label variable,
+/// using the label value as an index into a jump table
+fn convert_handled_blocks_with_br_table(
+    handled_blocks: Vec<Block>,
+    multiple_block_id: MultipleBlockId,
+    first_label: u64,
+    table: Vec<u32>,
+    function_context: &mut FunctionContext,
+    module_context: &ModuleContext,
+    prog_metadata: &ProgramMetadata,
+) -> WasmInstruction {
+    let handled_block_count = handled_blocks.len() as u32;
+    debug!(
+        "dispatching to the {} handled blocks of {} with br_table",
+        handled_block_count, multiple_block_id
+    );
+
+    // index = label variable - first label in the table
+    let mut br_table_instrs = Vec::new();
+    load_var(
+        function_context.label_variable.to_owned(),
+        &mut br_table_instrs,
+        function_context,
+        module_context,
+        prog_metadata,
+    );
+    br_table_instrs.push(WasmInstruction::I64Const {
+        n: first_label as i64,
+    });
+    br_table_instrs.push(WasmInstruction::I64Sub);
+    // labels before the first label wrap around to large indices, which are out of range
+    br_table_instrs.push(WasmInstruction::I32WrapI64);
+    br_table_instrs.push(WasmInstruction::BrTable {
+        labels: table
+            .into_iter()
+            .map(|block_i| LabelIdx { l: block_i })
+            .collect(),
+        // the default skips all the handled blocks
+        label_idx: LabelIdx {
+            l: handled_block_count,
+        },
+    });
+
+    // breaking out of a handled block breaks out of the whole jump table, the same as
+    // breaking out of the if when the handled blocks are tested in turn
+    nest_jump_table_arms(
+        br_table_instrs,
+        handled_blocks,
+        ControlFlowElement::If(multiple_block_id),
+        function_context,
+        |handled_block, function_context| {
+            convert_block_to_wasm(
+                handled_block,
+                function_context,
+                module_context,
+                prog_metadata,
+            )
+        },
+    )
+}
+
 /// Inserts instructions to compare the label variable against some number of label values,
 /// leaving a single boolean value on the stack
 fn test_label_equality(
     labels: Vec<LabelId>,
     wasm_instrs: &mut Vec<WasmInstruction>,
     function_context: &FunctionContext,
+    module_context: &ModuleContext,
     prog_metadata: &ProgramMetadata,
 ) {
     assert!(!labels.is_empty());
@@ -2434,6 +3439,7 @@ fn test_label_equality(
             function_context.label_variable.to_owned(),
             wasm_instrs,
             function_context,
+            module_context,
             prog_metadata,
         );
         // label value to compare against
@@ -2450,6 +3456,7 @@ fn test_label_equality(
                 function_context.label_variable.to_owned(),
                 wasm_instrs,
                 function_context,
+                module_context,
                 prog_metadata,
             );
             // label value to compare against
@@ -2472,9 +3479,9 @@ fn get_src_type_preferably_from_var(
     prog_metadata: &ProgramMetadata,
 ) -> IrType {
     match left_src {
-        Src::Var(var_id) => prog_metadata.get_var_type(var_id).unwrap(),
+        Src::Var(var_id) => prog_metadata.get_var_type(var_id).unwrap().to_owned(),
         Src::Constant(_) => match right_src {
-            Src::Var(var_id) => prog_metadata.get_var_type(var_id).unwrap(),
+            Src::Var(var_id) => prog_metadata.get_var_type(var_id).unwrap().to_owned(),
             Src::Constant(constant) => constant.get_type(None),
             _ => unreachable!(),
         },
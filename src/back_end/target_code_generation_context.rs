@@ -1,8 +1,15 @@
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
+use std::ops::Range;
 
-use crate::back_end::wasm_indices::{FuncIdx, WasmIdx};
+use crate::back_end::calling_convention::{get_native_function_type, CallingConvention};
+use crate::back_end::stack_allocation::allocate_vars::VariableAllocationMap;
+use crate::back_end::stack_allocation::local_promotion::LocalVariableMap;
+use crate::back_end::wasm_indices::{DataIdx, FuncIdx, GlobalIdx, WasmIdx};
+use crate::data_structures::id_map::IdMap;
 use crate::id::Id;
 use crate::middle_end::ids::{FunId, StringLiteralId, VarId};
+use crate::middle_end::ir_types::IrType;
+use crate::program_config::enabled_optimisations::EnabledOptimisations;
 use crate::program_config::enabled_profiling::EnabledProfiling;
 use crate::relooper::blocks::{LoopBlockId, MultipleBlockId};
 use crate::relooper::relooper::ReloopedFunction;
@@ -13,20 +20,55 @@ pub struct ModuleContext<'a> {
     pub imported_func_idx_range: (FuncIdx, FuncIdx),
     pub defined_func_idx_range: (FuncIdx, FuncIdx),
     pub string_literal_id_to_ptr_map: HashMap<StringLiteralId, u32>,
+    pub enabled_optimisations: &'a EnabledOptimisations,
     pub enabled_profiling: &'a EnabledProfiling,
-    pub log_stack_ptr_fun_id: Option<FunId>,
+    pub flush_stack_ptr_log_fun_id: Option<FunId>,
+    /// The call counters and the runtime functions for timing calls, if call profiling is enabled
+    pub call_profile: Option<CallProfile>,
+    /// The counters for each label, if block counting is enabled
+    pub block_profile: Option<BlockProfile>,
+    /// Where stack pointer samples are buffered, if stack pointer logging is enabled
+    pub stack_ptr_log_buffer: Option<StackPtrLogBuffer>,
+    /// The heap allocator's functions and free lists, if the program uses malloc() or free()
+    pub heap_allocator: Option<HeapAllocator>,
+    /// The library functions whose bodies are generated as wasm kernels
+    pub library_kernels: HashMap<FunId, LibraryKernel>,
+    /// The global holding the address the stack pointer can go up to before the stack
+    /// overflows, once memory has been initialised
+    pub stack_limit: Option<GlobalIdx>,
+    /// If the frame ptr and stack ptr are kept in wasm globals, the indexes of those globals.
+    /// Otherwise, they're stored in memory.
+    pub stack_ptr_globals: Option<StackPtrGlobals>,
+    /// The functions that are called with the native calling convention.
+    /// All other functions use the stack frame calling convention
+    pub native_call_fun_ids: HashSet<FunId>,
+    /// The threads the program can run, if it's compiled with --threads
+    pub threads: Option<Threads>,
 }
 
 impl<'a> ModuleContext<'a> {
-    pub fn new(enabled_profiling: &'a EnabledProfiling) -> Self {
+    pub fn new(
+        enabled_optimisations: &'a EnabledOptimisations,
+        enabled_profiling: &'a EnabledProfiling,
+    ) -> Self {
         ModuleContext {
             fun_id_to_func_idx_map: HashMap::new(),
             // func_idx_to_fun_id_map: HashMap::new(),
             imported_func_idx_range: (FuncIdx::initial_idx(), FuncIdx::initial_idx()),
             defined_func_idx_range: (FuncIdx::initial_idx(), FuncIdx::initial_idx()),
             string_literal_id_to_ptr_map: HashMap::new(),
+            enabled_optimisations,
             enabled_profiling,
-            log_stack_ptr_fun_id: None,
+            flush_stack_ptr_log_fun_id: None,
+            call_profile: None,
+            block_profile: None,
+            stack_ptr_log_buffer: None,
+            heap_allocator: None,
+            library_kernels: HashMap::new(),
+            stack_limit: None,
+            stack_ptr_globals: None,
+            native_call_fun_ids: HashSet::new(),
+            threads: None,
         }
     }
 
@@ -60,6 +102,143 @@ impl<'a> ModuleContext<'a> {
         }
         self.defined_func_idx_range = (defined_funcs_start_idx, func_idx);
     }
+
+    /// Work out which defined functions can be called with the native calling convention.
+    /// Imported functions always use the stack frame calling convention, because the JS
+    /// runtime reads their params from memory, and so does main(), because it's called by
+    /// the global wrapper function.
+    pub fn calculate_calling_conventions(
+        &mut self,
+        defined_functions: &Vec<(FunId, ReloopedFunction)>,
+        main_fun_id: Option<&FunId>,
+    ) {
+        if !self.enabled_optimisations.is_native_calls_enabled() {
+            return;
+        }
+        for (fun_id, function) in defined_functions {
+            if Some(fun_id) == main_fun_id || function.block.is_none() {
+                continue;
+            }
+            if get_native_function_type(&function.type_info).is_some() {
+                self.native_call_fun_ids.insert(fun_id.to_owned());
+            }
+        }
+    }
+
+    pub fn get_calling_convention(&self, fun_id: &FunId) -> CallingConvention {
+        if self.native_call_fun_ids.contains(fun_id) {
+            CallingConvention::Native
+        } else {
+            CallingConvention::StackFrame
+        }
+    }
+
+    /// Whether tail calls can be compiled to return_call. Timing calls needs the runtime to be
+    /// called after the callee returns, so return_call isn't used then.
+    pub fn can_use_return_call(&self) -> bool {
+        self.enabled_optimisations.is_return_call_enabled()
+            && !matches!(&self.call_profile, Some(call_profile) if call_profile.timing.is_some())
+    }
+}
+
+/// A buffer in memory that each new stack pointer value is written to. When it's full, the
+/// JS runtime is called to write the samples out, and the next sample goes at the start
+/// again.
+pub struct StackPtrLogBuffer {
+    /// The address of the first sample
+    pub start_addr: u32,
+    /// The address after the last sample
+    pub end_addr: u32,
+    /// The global holding the address the next sample is written to
+    pub next_sample_ptr: GlobalIdx,
+}
+
+/// Where the calls between each pair of functions are counted. Each call edge has an i64
+/// counter in memory, which is incremented before every call from the caller to the callee.
+pub struct CallProfile {
+    /// The call edges, as (caller, callee), in the order of their counters. The caller is
+    /// None for calls from the global instructions
+    pub edges: Vec<(Option<FunId>, FunId)>,
+    pub edge_idxs: HashMap<(Option<FunId>, FunId), u32>,
+    /// The address of the first counter, once the counters have been put in memory
+    pub counts_start_addr: u32,
+    /// If calls are timed, the runtime functions to call when a function is entered and
+    /// returns, and the global that tells them which call edge it is
+    pub timing: Option<CallTiming>,
+}
+
+pub struct CallTiming {
+    pub enter_fun_id: FunId,
+    pub exit_fun_id: FunId,
+    pub current_edge: Option<GlobalIdx>,
+}
+
+/// Where the executions of each label are counted. Each function has an i64 counter for
+/// every label in its range of label ids, which is incremented at the start of the label's
+/// simple block.
+pub struct BlockProfile {
+    /// The functions in the order of their counters, with their ranges of label ids
+    pub functions: Vec<(FunId, Range<u64>)>,
+    /// The index of each function's first counter, and its range of label ids
+    pub function_counters: HashMap<FunId, (u32, Range<u64>)>,
+    pub counter_count: u32,
+    /// The address of the first counter, once the counters have been put in memory
+    pub counts_start_addr: u32,
+}
+
+/// The malloc() and free() functions that the heap allocator generates, and where its state
+/// is kept
+pub struct HeapAllocator {
+    pub malloc_fun_id: Option<FunId>,
+    pub free_fun_id: Option<FunId>,
+    /// The address of the head of the first size class's free list, once the free lists have
+    /// been put in memory
+    pub free_lists_start_addr: u32,
+    /// Where the address of the top of the heap is kept, which is where the next new block
+    /// starts
+    pub heap_top: Option<HeapTop>,
+}
+
+pub enum HeapTop {
+    Global(GlobalIdx),
+    /// With threads, the top of the heap is kept in the shared memory, next to a lock that
+    /// malloc() and free() hold while they use the heap. The global wrapper function stores
+    /// the heap start addr there before main() runs.
+    Shared {
+        addr: u32,
+        lock_addr: u32,
+        heap_start_addr: u32,
+    },
+}
+
+/// The threads that a program compiled with --threads can run. Each thread is a separate
+/// instance of the module, sharing the memory, that runs thread_main() on its own stack.
+pub struct Threads {
+    /// How many threads can run at once besides the main thread, which each have a stack
+    pub thread_count: u32,
+    /// thread_main(), if the program defines it
+    pub thread_main_fun_id: Option<FunId>,
+    /// The data segments, with the address and length of the memory they initialise. They're
+    /// passive, and only copied into memory by the global wrapper function before main() runs,
+    /// because active segments would be written again each time a thread's instance is
+    /// created.
+    pub data_segments: Vec<(DataIdx, u32, u32)>,
+}
+
+/// The string.h functions that are generated straight to wasm, so they can process 16 bytes
+/// at a time with SIMD instructions
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum LibraryKernel {
+    Strlen,
+    Memchr,
+    Memcpy,
+    Memset,
+}
+
+pub struct StackPtrGlobals {
+    pub frame_ptr: GlobalIdx,
+    pub temp_frame_ptr: GlobalIdx,
+    pub stack_ptr: GlobalIdx,
 }
 
 pub enum ControlFlowElement {
@@ -67,38 +246,60 @@ pub enum ControlFlowElement {
     Loop(LoopBlockId),
     If(MultipleBlockId),
     UnlabelledIf,
+    UnlabelledBlock,
 }
 
 pub struct FunctionContext {
-    pub var_fp_offsets: HashMap<VarId, u32>,
-    pub global_var_addrs: HashMap<VarId, u32>,
+    /// The function being generated, or None for the global instructions
+    pub fun_id: Option<FunId>,
+    pub var_fp_offsets: VariableAllocationMap,
+    pub var_local_idxs: LocalVariableMap,
+    pub global_var_addrs: VariableAllocationMap,
     pub label_variable: VarId,
     pub control_flow_stack: Vec<ControlFlowElement>,
+    pub calling_convention: CallingConvention,
+    pub return_type: IrType,
 }
 
 impl FunctionContext {
     pub fn new(
-        var_fp_offsets: HashMap<VarId, u32>,
-        global_var_addrs: HashMap<VarId, u32>,
+        fun_id: FunId,
+        var_fp_offsets: VariableAllocationMap,
+        var_local_idxs: LocalVariableMap,
+        global_var_addrs: VariableAllocationMap,
         label_variable: VarId,
+        calling_convention: CallingConvention,
+        return_type: IrType,
     ) -> Self {
         FunctionContext {
+            fun_id: Some(fun_id),
             var_fp_offsets,
+            var_local_idxs,
             global_var_addrs,
             label_variable,
             control_flow_stack: Vec::new(),
+            calling_convention,
+            return_type,
         }
     }
 
-    pub fn global_context(global_var_addrs: HashMap<VarId, u32>) -> Self {
+    pub fn global_context(global_var_addrs: VariableAllocationMap) -> Self {
         FunctionContext {
-            var_fp_offsets: HashMap::new(),
+            fun_id: None,
+            var_fp_offsets: IdMap::new(),
+            var_local_idxs: IdMap::new(),
             global_var_addrs,
             label_variable: VarId::initial_id(), // dummy var, because global instrs don't have any control flow
             control_flow_stack: Vec::new(),
+            calling_convention: CallingConvention::StackFrame,
+            return_type: IrType::Void,
         }
     }
 
+    pub fn is_var_in_local(&self, var_id: &VarId) -> bool {
+        self.var_local_idxs.contains_key(var_id)
+    }
+
     pub fn get_depth_of_block(&self, loop_block_id: &LoopBlockId) -> Option<u32> {
         if self.control_flow_stack.is_empty() {
             return None;
@@ -0,0 +1,210 @@
+#[cfg(test)]
+#[path = "threads_tests.rs"]
+mod threads_tests;
+
+use log::info;
+
+use crate::back_end::backend_error::BackendError;
+use crate::back_end::calling_convention::get_native_function_type;
+use crate::back_end::memory_constants::{PTR_SIZE, WASM_PAGE_SIZE};
+use crate::back_end::target_code_generation_context::{HeapTop, ModuleContext, Threads};
+use crate::back_end::wasm_indices::LabelIdx;
+use crate::back_end::wasm_instructions::{BlockType, MemArg, WasmInstruction};
+use crate::back_end::wasm_module::custom_section::CustomSection;
+use crate::back_end::wasm_module::exports_section::{ExportDescriptor, WasmExport};
+use crate::back_end::wasm_module::module::WasmModule;
+use crate::back_end::wasm_module::types_section::WasmFunctionType;
+use crate::back_end::wasm_types::{NumType, ValType};
+use crate::middle_end::ids::FunId;
+use crate::middle_end::ir::ProgramMetadata;
+use crate::program_config::memory_limits::MemoryLimits;
+use crate::program_config::program_constants::{
+    THREADS_SECTION_NAME, THREAD_CREATE_IMPORT_NAME, THREAD_JOIN_IMPORT_NAME,
+    THREAD_MAIN_FUNCTION_NAME,
+};
+use crate::relooper::relooper::ReloopedFunction;
+
+// With --threads, the memory is shared by the main thread and up to thread_count other
+// threads, which each run in their own instance of the module. The stack ptrs are in each
+// instance's globals, so each thread has its own, pointing into its own stack:
+//
+// ----------------------------------------------------------------------------------------
+// | static data | main() stack | thread 1 stack | ... | thread n stack | heap...
+// ----------------------------------------------------------------------------------------
+//
+// None of the stacks can grow, since they're not at the end of memory, so a stack overflow
+// traps. The JS runtime picks a free stack for each new thread, and sets its stack ptr and
+// stack limit globals before calling thread_main().
+
+/// The least stack each thread gets. The estimate doesn't count recursive calls or arrays
+/// with a runtime size, and the stacks can't grow, so there's some room for them.
+const MIN_THREAD_STACK_SIZE: u32 = WASM_PAGE_SIZE;
+
+/// Find thread_main() if the program is compiled with --threads. It's called by the JS
+/// runtime with the arg passed to thread_create(), so it always uses the native calling
+/// convention, like main() is called by the global wrapper function.
+pub fn initialise_threads(
+    module_context: &mut ModuleContext,
+    imported_functions: &[(FunId, String, ReloopedFunction)],
+    defined_functions: &[(FunId, ReloopedFunction)],
+    prog_metadata: &ProgramMetadata,
+    memory_limits: &MemoryLimits,
+) -> Result<(), BackendError> {
+    if !memory_limits.is_shared() {
+        let uses_threads = imported_functions.iter().any(|(_, name, _)| {
+            name == THREAD_CREATE_IMPORT_NAME || name == THREAD_JOIN_IMPORT_NAME
+        });
+        if uses_threads {
+            return Err(BackendError::ThreadsNotEnabled);
+        }
+        return Ok(());
+    }
+
+    let mut thread_main_fun_id = None;
+    if let Some(fun_id) = prog_metadata.function_ids.get(THREAD_MAIN_FUNCTION_NAME) {
+        if let Some((_, function)) = defined_functions
+            .iter()
+            .find(|(defined_fun_id, _)| defined_fun_id == fun_id)
+        {
+            // void *thread_main(void *arg)
+            let expected_type = WasmFunctionType {
+                param_types: vec![ValType::NumType(NumType::I32)],
+                result_types: vec![ValType::NumType(NumType::I32)],
+            };
+            if function.block.is_none()
+                || get_native_function_type(&function.type_info) != Some(expected_type)
+            {
+                return Err(BackendError::InvalidThreadMainFunction);
+            }
+            module_context.native_call_fun_ids.insert(fun_id.to_owned());
+            thread_main_fun_id = Some(fun_id.to_owned());
+        }
+    }
+
+    module_context.threads = Some(Threads {
+        thread_count: memory_limits.thread_count(),
+        thread_main_fun_id,
+        data_segments: Vec::new(),
+    });
+    Ok(())
+}
+
+/// Round a stack size up to whole pages, and to at least the minimum a thread's stack gets
+pub fn get_thread_stack_size(stack_size_estimate: u32) -> u32 {
+    stack_size_estimate
+        .max(MIN_THREAD_STACK_SIZE)
+        .next_multiple_of(WASM_PAGE_SIZE)
+}
+
+/// Lay out a stack for each thread from stacks_start, and record where they are in a custom
+/// section for the JS runtime. Returns the address after the last stack.
+pub fn initialise_thread_stacks(
+    wasm_module: &mut WasmModule,
+    module_context: &ModuleContext,
+    stacks_start: u32,
+    stack_size_estimate: u32,
+) -> u64 {
+    let threads = match &module_context.threads {
+        Some(threads) => threads,
+        None => return stacks_start as u64,
+    };
+    let stack_size = get_thread_stack_size(stack_size_estimate);
+    info!(
+        "Reserving {} thread stacks of {} bytes from addr {}",
+        threads.thread_count, stack_size, stacks_start
+    );
+    wasm_module.custom_sections.push(CustomSection {
+        name: THREADS_SECTION_NAME.to_owned(),
+        contents: format!("{} {} {}", stacks_start, stack_size, threads.thread_count).into_bytes(),
+    });
+    stacks_start as u64 + threads.thread_count as u64 * stack_size as u64
+}
+
+/// Copy the data segments into memory, and set the top of the heap to where the heap
+/// starts. This is done by the global wrapper function, which only the main thread calls,
+/// before anything else uses the memory.
+pub fn initialise_shared_memory(
+    wasm_instrs: &mut Vec<WasmInstruction>,
+    module_context: &ModuleContext,
+) {
+    let threads = match &module_context.threads {
+        Some(threads) => threads,
+        None => return,
+    };
+    for (data_idx, addr, len) in &threads.data_segments {
+        wasm_instrs.push(WasmInstruction::I32Const { n: *addr as i32 });
+        wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
+        wasm_instrs.push(WasmInstruction::I32Const { n: *len as i32 });
+        wasm_instrs.push(WasmInstruction::MemoryInit {
+            data_idx: data_idx.to_owned(),
+        });
+    }
+
+    if let Some(HeapTop::Shared {
+        addr,
+        heap_start_addr,
+        ..
+    }) = module_context
+        .heap_allocator
+        .as_ref()
+        .and_then(|heap_allocator| heap_allocator.heap_top.as_ref())
+    {
+        wasm_instrs.push(WasmInstruction::I32Const { n: *addr as i32 });
+        wasm_instrs.push(WasmInstruction::I32Const {
+            n: *heap_start_addr as i32,
+        });
+        wasm_instrs.push(WasmInstruction::I32Store {
+            mem_arg: MemArg::natural(PTR_SIZE, 0),
+        });
+    }
+}
+
+/// Export thread_main() for the JS runtime to call in each new thread
+pub fn export_thread_main(wasm_module: &mut WasmModule, module_context: &ModuleContext) {
+    let thread_main_fun_id = match &module_context.threads {
+        Some(Threads {
+            thread_main_fun_id: Some(thread_main_fun_id),
+            ..
+        }) => thread_main_fun_id,
+        _ => return,
+    };
+    wasm_module.exports_section.exports.push(WasmExport {
+        name: THREAD_MAIN_FUNCTION_NAME.to_owned(),
+        export_descriptor: ExportDescriptor::Func {
+            func_idx: module_context.fun_id_to_func_idx_map[thread_main_fun_id].to_owned(),
+        },
+    });
+}
+
+/// Spin until the lock at lock_addr is taken, by atomically changing it from 0 to 1. Only
+/// the heap allocator takes a lock, and it only holds it for a few instructions, so it isn't
+/// worth waiting with memory.atomic.wait.
+pub fn acquire_lock(lock_addr: u32, wasm_instrs: &mut Vec<WasmInstruction>) {
+    wasm_instrs.push(WasmInstruction::Loop {
+        blocktype: BlockType::None,
+        instrs: vec![
+            WasmInstruction::I32Const {
+                n: lock_addr as i32,
+            },
+            WasmInstruction::I32Const { n: 0 },
+            WasmInstruction::I32Const { n: 1 },
+            WasmInstruction::I32AtomicRmwCmpxchg {
+                mem_arg: MemArg::natural(PTR_SIZE, 0),
+            },
+            // the lock was already taken if it wasn't 0
+            WasmInstruction::BrIf {
+                label_idx: LabelIdx { l: 0 },
+            },
+        ],
+    });
+}
+
+pub fn release_lock(lock_addr: u32, wasm_instrs: &mut Vec<WasmInstruction>) {
+    wasm_instrs.push(WasmInstruction::I32Const {
+        n: lock_addr as i32,
+    });
+    wasm_instrs.push(WasmInstruction::I32Const { n: 0 });
+    wasm_instrs.push(WasmInstruction::I32AtomicStore {
+        mem_arg: MemArg::natural(PTR_SIZE, 0),
+    });
+}
@@ -0,0 +1,211 @@
+#[cfg(test)]
+mod threads_tests {
+    use clap::Parser as ClapParser;
+
+    use super::super::initialise_threads;
+    use crate::back_end::backend_error::BackendError;
+    use crate::back_end::target_code_generation_context::ModuleContext;
+    use crate::id::IdGenerator;
+    use crate::middle_end::ids::{FunId, InstructionId, LabelId};
+    use crate::middle_end::instructions::{Constant, Instruction, Src};
+    use crate::middle_end::ir::ProgramMetadata;
+    use crate::middle_end::ir_types::IrType;
+    use crate::program_config::enabled_optimisations::EnabledOptimisations;
+    use crate::program_config::enabled_profiling::EnabledProfiling;
+    use crate::program_config::memory_limits::MemoryLimits;
+    use crate::program_config::program_constants::{
+        THREAD_CREATE_IMPORT_NAME, THREAD_JOIN_IMPORT_NAME, THREAD_MAIN_FUNCTION_NAME,
+    };
+    use crate::relooper::blocks::{Block, Label};
+    use crate::relooper::relooper::ReloopedFunction;
+    use crate::CliConfig;
+
+    fn parse_cli_config(flags: &[&str]) -> CliConfig {
+        let args = ["c_to_wasm_compiler", "test.c"].iter().chain(flags);
+        CliConfig::parse_from(args)
+    }
+
+    fn void_ptr() -> IrType {
+        IrType::PointerTo(Box::new(IrType::Void))
+    }
+
+    fn function(type_info: IrType, is_defined: bool) -> ReloopedFunction {
+        let block = is_defined.then(|| Block::Simple {
+            internal: Label {
+                label: IdGenerator::<LabelId>::new().new_id(),
+                instrs: vec![Instruction::Ret(
+                    IdGenerator::<InstructionId>::new().new_id(),
+                    Some(Src::Constant(Constant::Int(0))),
+                )],
+            },
+            next: None,
+        });
+        ReloopedFunction {
+            block,
+            label_variable: None,
+            type_info,
+            param_var_mappings: Vec::new(),
+            body_is_defined: is_defined,
+        }
+    }
+
+    /// The functions of a program that imports thread_create() and thread_join(), and
+    /// defines a thread_main() of the given type
+    struct ThreadsProgram {
+        prog_metadata: ProgramMetadata,
+        imported_functions: Vec<(FunId, String, ReloopedFunction)>,
+        defined_functions: Vec<(FunId, ReloopedFunction)>,
+        thread_main_fun_id: FunId,
+    }
+
+    impl ThreadsProgram {
+        fn new(thread_main_type: IrType, is_thread_main_defined: bool) -> Self {
+            let mut prog_metadata = ProgramMetadata::new();
+            let thread_create_fun_id = prog_metadata
+                .new_fun_declaration(THREAD_CREATE_IMPORT_NAME.to_owned())
+                .unwrap();
+            let thread_join_fun_id = prog_metadata
+                .new_fun_declaration(THREAD_JOIN_IMPORT_NAME.to_owned())
+                .unwrap();
+            let thread_main_fun_id = prog_metadata
+                .new_fun_declaration(THREAD_MAIN_FUNCTION_NAME.to_owned())
+                .unwrap();
+            let imported_functions = vec![
+                (
+                    thread_create_fun_id,
+                    THREAD_CREATE_IMPORT_NAME.to_owned(),
+                    function(
+                        IrType::Function(Box::new(IrType::I32), vec![void_ptr()], false),
+                        false,
+                    ),
+                ),
+                (
+                    thread_join_fun_id,
+                    THREAD_JOIN_IMPORT_NAME.to_owned(),
+                    function(
+                        IrType::Function(Box::new(void_ptr()), vec![IrType::I32], false),
+                        false,
+                    ),
+                ),
+            ];
+            let defined_functions = vec![(
+                thread_main_fun_id.to_owned(),
+                function(thread_main_type, is_thread_main_defined),
+            )];
+            ThreadsProgram {
+                prog_metadata,
+                imported_functions,
+                defined_functions,
+                thread_main_fun_id,
+            }
+        }
+
+        fn valid() -> Self {
+            ThreadsProgram::new(
+                IrType::Function(Box::new(void_ptr()), vec![void_ptr()], false),
+                true,
+            )
+        }
+
+        fn initialise_threads(
+            &self,
+            module_context: &mut ModuleContext,
+            flags: &[&str],
+        ) -> Result<(), BackendError> {
+            let memory_limits = MemoryLimits::construct(&parse_cli_config(flags)).unwrap();
+            initialise_threads(
+                module_context,
+                &self.imported_functions,
+                &self.defined_functions,
+                &self.prog_metadata,
+                &memory_limits,
+            )
+        }
+    }
+
+    #[test]
+    fn threads_need_the_threads_flag() {
+        let cli_config = parse_cli_config(&[]);
+        let enabled_optimisations = EnabledOptimisations::construct(&cli_config);
+        let enabled_profiling = EnabledProfiling::construct(&cli_config);
+        let mut module_context = ModuleContext::new(&enabled_optimisations, &enabled_profiling);
+
+        let result = ThreadsProgram::valid().initialise_threads(&mut module_context, &[]);
+        assert!(matches!(result, Err(BackendError::ThreadsNotEnabled)));
+
+        // a program that doesn't use threads is fine without the flag
+        let mut program = ThreadsProgram::valid();
+        program.imported_functions.clear();
+        program
+            .initialise_threads(&mut module_context, &[])
+            .unwrap();
+        assert!(module_context.threads.is_none());
+    }
+
+    #[test]
+    fn finds_thread_main() {
+        let cli_config = parse_cli_config(&[]);
+        let enabled_optimisations = EnabledOptimisations::construct(&cli_config);
+        let enabled_profiling = EnabledProfiling::construct(&cli_config);
+        let mut module_context = ModuleContext::new(&enabled_optimisations, &enabled_profiling);
+
+        let program = ThreadsProgram::valid();
+        program
+            .initialise_threads(&mut module_context, &["--threads", "4"])
+            .unwrap();
+
+        let threads = module_context.threads.as_ref().unwrap();
+        assert_eq!(threads.thread_count, 4);
+        assert_eq!(
+            threads.thread_main_fun_id.as_ref(),
+            Some(&program.thread_main_fun_id)
+        );
+        // the JS runtime calls it directly
+        assert!(module_context
+            .native_call_fun_ids
+            .contains(&program.thread_main_fun_id));
+    }
+
+    #[test]
+    fn rejects_thread_main_with_the_wrong_signature() {
+        let cli_config = parse_cli_config(&[]);
+        let enabled_optimisations = EnabledOptimisations::construct(&cli_config);
+        let enabled_profiling = EnabledProfiling::construct(&cli_config);
+
+        let invalid_programs = [
+            // int thread_main(int a, int b)
+            ThreadsProgram::new(
+                IrType::Function(Box::new(IrType::I32), vec![IrType::I32, IrType::I32], false),
+                true,
+            ),
+            // void thread_main(void *arg)
+            ThreadsProgram::new(
+                IrType::Function(Box::new(IrType::Void), vec![void_ptr()], false),
+                true,
+            ),
+            // long thread_main(void *arg)
+            ThreadsProgram::new(
+                IrType::Function(Box::new(IrType::I64), vec![void_ptr()], false),
+                true,
+            ),
+            // void *thread_main(void *arg, ...)
+            ThreadsProgram::new(
+                IrType::Function(Box::new(void_ptr()), vec![void_ptr()], true),
+                true,
+            ),
+            // declared, but without a body
+            ThreadsProgram::new(
+                IrType::Function(Box::new(void_ptr()), vec![void_ptr()], false),
+                false,
+            ),
+        ];
+        for program in invalid_programs {
+            let mut module_context = ModuleContext::new(&enabled_optimisations, &enabled_profiling);
+            let result = program.initialise_threads(&mut module_context, &["--threads", "4"]);
+            assert!(matches!(
+                result,
+                Err(BackendError::InvalidThreadMainFunction)
+            ));
+        }
+    }
+}
@@ -1,3 +1,11 @@
 pub trait ToBytes {
-    fn to_bytes(&self) -> Vec<u8>;
+    /// Append the binary encoding to the end of the buffer. Everything in a module is written
+    /// into the same buffer, so encoding doesn't allocate a new Vec for every instruction.
+    fn write_bytes(&self, bytes: &mut Vec<u8>);
+
+    fn to_bytes(&self) -> Vec<u8> {
+        let mut bytes = Vec::new();
+        self.write_bytes(&mut bytes);
+        bytes
+    }
 }
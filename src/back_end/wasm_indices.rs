@@ -1,4 +1,4 @@
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::write_u32;
 use crate::back_end::to_bytes::ToBytes;
 
 pub trait WasmIdx {
@@ -42,8 +42,8 @@ impl WasmIdx for TypeIdx {
 }
 
 impl ToBytes for TypeIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -63,8 +63,8 @@ impl WasmIdx for TableIdx {
 }
 
 impl ToBytes for TableIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -84,8 +84,8 @@ impl WasmIdx for MemIdx {
 }
 
 impl ToBytes for MemIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -105,8 +105,8 @@ impl WasmIdx for ElemIdx {
 }
 
 impl ToBytes for ElemIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -126,12 +126,12 @@ impl WasmIdx for DataIdx {
 }
 
 impl ToBytes for DataIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
-#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash, PartialOrd, Ord)]
 pub struct FuncIdx {
     x: u32,
 }
@@ -147,8 +147,8 @@ impl WasmIdx for FuncIdx {
 }
 
 impl ToBytes for FuncIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -168,8 +168,8 @@ impl WasmIdx for LocalIdx {
 }
 
 impl ToBytes for LocalIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -189,8 +189,8 @@ impl WasmIdx for GlobalIdx {
 }
 
 impl ToBytes for GlobalIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.x as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.x, bytes);
     }
 }
 
@@ -210,7 +210,7 @@ pub struct LabelIdx {
 // }
 
 impl ToBytes for LabelIdx {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_unsigned_int(self.l as u128)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.l, bytes);
     }
 }
@@ -1,7 +1,7 @@
-use crate::back_end::float_encoding::encode_float;
-use crate::back_end::integer_encoding::{encode_signed_int, encode_unsigned_int};
+use crate::back_end::float_encoding::{write_f32, write_float};
+use crate::back_end::integer_encoding::{write_i32, write_i64, write_u32};
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_indices::{
     DataIdx, ElemIdx, FuncIdx, GlobalIdx, LabelIdx, LocalIdx, TableIdx, TypeIdx,
 };
@@ -13,14 +13,12 @@ pub struct WasmExpression {
 }
 
 impl ToBytes for WasmExpression {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = Vec::new();
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         for instr in &self.instrs {
-            bytes.append(&mut instr.to_bytes());
+            instr.write_bytes(bytes);
         }
         // instructions followed by explicit `end`
         bytes.push(0x0b);
-        bytes
     }
 }
 
@@ -32,13 +30,13 @@ pub enum BlockType {
 }
 
 impl ToBytes for BlockType {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
             BlockType::None => {
-                vec![0x40]
+                bytes.push(0x40);
             }
-            BlockType::ValType(val_type) => val_type.to_bytes(),
-            BlockType::TypeIndex(i) => encode_signed_int(*i as i128),
+            BlockType::ValType(val_type) => val_type.write_bytes(bytes),
+            BlockType::TypeIndex(i) => write_i32(*i, bytes),
         }
     }
 }
@@ -59,13 +57,27 @@ impl MemArg {
             offset: 0,
         }
     }
+
+    /// The alignment hint for an access of byte_size bytes to an address that's a multiple of
+    /// its size. The hint is stored as log2 of the alignment.
+    pub fn natural(byte_size: u32, offset: u32) -> Self {
+        MemArg {
+            align: byte_size.trailing_zeros(),
+            offset,
+        }
+    }
+
+    /// The alignment hint for an access to an address that might not be aligned, such as a
+    /// struct member or the target of a pointer
+    pub fn unaligned(offset: u32) -> Self {
+        MemArg { align: 0, offset }
+    }
 }
 
 impl ToBytes for MemArg {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = encode_unsigned_int(self.align as u128);
-        bytes.append(&mut encode_unsigned_int(self.offset as u128));
-        bytes
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.align, bytes);
+        write_u32(self.offset, bytes);
     }
 }
 
@@ -107,6 +119,14 @@ pub enum WasmInstruction {
         type_idx: TypeIdx,
         table_idx: TableIdx,
     },
+    // tail calls, from the tail call proposal
+    ReturnCall {
+        func_idx: FuncIdx,
+    },
+    ReturnCallIndirect {
+        type_idx: TypeIdx,
+        table_idx: TableIdx,
+    },
 
     // Reference instructions
     RefNull {
@@ -412,781 +432,854 @@ pub enum WasmInstruction {
     I64TruncSatF32U,
     I64TruncSatF64S,
     I64TruncSatF64U,
+
+    // Vector instructions
+    V128Load {
+        mem_arg: MemArg,
+    },
+    V128Store {
+        mem_arg: MemArg,
+    },
+    V128Const {
+        bytes: [u8; 16],
+    },
+    I8x16Splat,
+    I8x16Eq,
+    V128AnyTrue,
+    I8x16AllTrue,
+    I8x16Bitmask,
+
+    // Atomic memory instructions, from the threads proposal. The address must be aligned to
+    // the size of the access, or they trap, so the alignment hint must be natural
+    MemoryAtomicNotify {
+        mem_arg: MemArg,
+    },
+    MemoryAtomicWait32 {
+        mem_arg: MemArg,
+    },
+    AtomicFence,
+    I32AtomicLoad {
+        mem_arg: MemArg,
+    },
+    I32AtomicStore {
+        mem_arg: MemArg,
+    },
+    I32AtomicRmwAdd {
+        mem_arg: MemArg,
+    },
+    I32AtomicRmwSub {
+        mem_arg: MemArg,
+    },
+    I32AtomicRmwXchg {
+        mem_arg: MemArg,
+    },
+    I32AtomicRmwCmpxchg {
+        mem_arg: MemArg,
+    },
 }
 
 impl ToBytes for WasmInstruction {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
-            WasmInstruction::Unreachable => vec![0x00],
-            WasmInstruction::Nop => vec![0x01],
+            WasmInstruction::Unreachable => bytes.push(0x00),
+            WasmInstruction::Nop => bytes.push(0x01),
             WasmInstruction::Block { blocktype, instrs } => {
-                let mut bytes = vec![0x02];
-                bytes.append(&mut blocktype.to_bytes());
+                bytes.push(0x02);
+                blocktype.write_bytes(bytes);
                 for instr in instrs {
-                    bytes.append(&mut instr.to_bytes());
+                    instr.write_bytes(bytes);
                 }
                 bytes.push(0x0b);
-                bytes
             }
             WasmInstruction::Loop { blocktype, instrs } => {
-                let mut bytes = vec![0x03];
-                bytes.append(&mut blocktype.to_bytes());
+                bytes.push(0x03);
+                blocktype.write_bytes(bytes);
                 for instr in instrs {
-                    bytes.append(&mut instr.to_bytes());
+                    instr.write_bytes(bytes);
                 }
                 bytes.push(0x0b);
-                bytes
             }
             WasmInstruction::IfElse {
                 blocktype,
                 if_instrs,
                 else_instrs,
             } => {
-                let mut bytes = vec![0x04];
-                bytes.append(&mut blocktype.to_bytes());
+                bytes.push(0x04);
+                blocktype.write_bytes(bytes);
                 for instr in if_instrs {
-                    bytes.append(&mut instr.to_bytes());
+                    instr.write_bytes(bytes);
                 }
                 if !else_instrs.is_empty() {
                     bytes.push(0x05);
                     for instr in else_instrs {
-                        bytes.append(&mut instr.to_bytes());
+                        instr.write_bytes(bytes);
                     }
                 }
                 bytes.push(0x0b);
-                bytes
             }
             WasmInstruction::Br { label_idx } => {
-                let mut bytes = vec![0x0C];
-                bytes.append(&mut label_idx.to_bytes());
-                bytes
+                bytes.push(0x0C);
+                label_idx.write_bytes(bytes);
             }
             WasmInstruction::BrIf { label_idx } => {
-                let mut bytes = vec![0x0D];
-                bytes.append(&mut label_idx.to_bytes());
-                bytes
+                bytes.push(0x0D);
+                label_idx.write_bytes(bytes);
             }
             WasmInstruction::BrTable { labels, label_idx } => {
-                let mut bytes = vec![0x0E];
-                bytes.append(&mut encode_vector(labels));
-                bytes.append(&mut label_idx.to_bytes());
-                bytes
+                bytes.push(0x0E);
+                write_vector(labels, bytes);
+                label_idx.write_bytes(bytes);
             }
-            WasmInstruction::Return => vec![0x0F],
+            WasmInstruction::Return => bytes.push(0x0F),
             WasmInstruction::Call { func_idx } => {
-                let mut bytes = vec![0x10];
-                bytes.append(&mut func_idx.to_bytes());
-                bytes
+                bytes.push(0x10);
+                func_idx.write_bytes(bytes);
             }
             WasmInstruction::CallIndirect {
                 type_idx,
                 table_idx,
             } => {
-                let mut bytes = vec![0x11];
-                bytes.append(&mut type_idx.to_bytes());
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0x11);
+                type_idx.write_bytes(bytes);
+                table_idx.write_bytes(bytes);
+            }
+            WasmInstruction::ReturnCall { func_idx } => {
+                bytes.push(0x12);
+                func_idx.write_bytes(bytes);
+            }
+            WasmInstruction::ReturnCallIndirect {
+                type_idx,
+                table_idx,
+            } => {
+                bytes.push(0x13);
+                type_idx.write_bytes(bytes);
+                table_idx.write_bytes(bytes);
             }
             WasmInstruction::RefNull { ref_type } => {
-                let mut bytes = vec![0xD0];
-                bytes.append(&mut ref_type.to_bytes());
-                bytes
+                bytes.push(0xD0);
+                ref_type.write_bytes(bytes);
             }
-            WasmInstruction::RefIsNull => vec![0xD1],
+            WasmInstruction::RefIsNull => bytes.push(0xD1),
             WasmInstruction::RefFunc { func_idx } => {
-                let mut bytes = vec![0xD2];
-                bytes.append(&mut func_idx.to_bytes());
-                bytes
+                bytes.push(0xD2);
+                func_idx.write_bytes(bytes);
             }
-            WasmInstruction::Drop => vec![0x1A],
-            WasmInstruction::Select => vec![0x1B],
+            WasmInstruction::Drop => bytes.push(0x1A),
+            WasmInstruction::Select => bytes.push(0x1B),
             WasmInstruction::SelectTyped { types } => {
-                let mut bytes = vec![0x1C];
-                bytes.append(&mut encode_vector(types));
-                bytes
+                bytes.push(0x1C);
+                write_vector(types, bytes);
             }
             WasmInstruction::LocalGet { local_idx } => {
-                let mut bytes = vec![0x20];
-                bytes.append(&mut local_idx.to_bytes());
-                bytes
+                bytes.push(0x20);
+                local_idx.write_bytes(bytes);
             }
             WasmInstruction::LocalSet { local_idx } => {
-                let mut bytes = vec![0x21];
-                bytes.append(&mut local_idx.to_bytes());
-                bytes
+                bytes.push(0x21);
+                local_idx.write_bytes(bytes);
             }
             WasmInstruction::LocalTee { local_idx } => {
-                let mut bytes = vec![0x22];
-                bytes.append(&mut local_idx.to_bytes());
-                bytes
+                bytes.push(0x22);
+                local_idx.write_bytes(bytes);
             }
             WasmInstruction::GlobalGet { global_idx } => {
-                let mut bytes = vec![0x23];
-                bytes.append(&mut global_idx.to_bytes());
-                bytes
+                bytes.push(0x23);
+                global_idx.write_bytes(bytes);
             }
             WasmInstruction::GlobalSet { global_idx } => {
-                let mut bytes = vec![0x24];
-                bytes.append(&mut global_idx.to_bytes());
-                bytes
+                bytes.push(0x24);
+                global_idx.write_bytes(bytes);
             }
 
             WasmInstruction::TableGet { table_idx } => {
-                let mut bytes = vec![0x25];
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0x25);
+                table_idx.write_bytes(bytes);
             }
             WasmInstruction::TableSet { table_idx } => {
-                let mut bytes = vec![0x26];
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0x26);
+                table_idx.write_bytes(bytes);
             }
             WasmInstruction::TableInit {
                 elem_idx,
                 table_idx,
             } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(12));
-                bytes.append(&mut elem_idx.to_bytes());
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(12, bytes);
+                elem_idx.write_bytes(bytes);
+                table_idx.write_bytes(bytes);
             }
             WasmInstruction::ElemDrop { elem_idx } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(13));
-                bytes.append(&mut elem_idx.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(13, bytes);
+                elem_idx.write_bytes(bytes);
             }
             WasmInstruction::TableCopy {
                 table_idx1,
                 table_idx2,
             } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(14));
-                bytes.append(&mut table_idx1.to_bytes());
-                bytes.append(&mut table_idx2.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(14, bytes);
+                table_idx1.write_bytes(bytes);
+                table_idx2.write_bytes(bytes);
             }
             WasmInstruction::TableGrow { table_idx } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(15));
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(15, bytes);
+                table_idx.write_bytes(bytes);
             }
             WasmInstruction::TableSize { table_idx } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(16));
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(16, bytes);
+                table_idx.write_bytes(bytes);
             }
             WasmInstruction::TableFill { table_idx } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(17));
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(17, bytes);
+                table_idx.write_bytes(bytes);
             }
 
             WasmInstruction::I32Load { mem_arg } => {
-                let mut bytes = vec![0x28];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x28);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load { mem_arg } => {
-                let mut bytes = vec![0x29];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x29);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::F32Load { mem_arg } => {
-                let mut bytes = vec![0x2A];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x2A);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::F64Load { mem_arg } => {
-                let mut bytes = vec![0x2B];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x2B);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Load8S { mem_arg } => {
-                let mut bytes = vec![0x2C];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x2C);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Load8U { mem_arg } => {
-                let mut bytes = vec![0x2D];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x2D);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Load16S { mem_arg } => {
-                let mut bytes = vec![0x2E];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x2E);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Load16U { mem_arg } => {
-                let mut bytes = vec![0x2F];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x2F);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load8S { mem_arg } => {
-                let mut bytes = vec![0x30];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x30);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load8U { mem_arg } => {
-                let mut bytes = vec![0x31];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x31);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load16S { mem_arg } => {
-                let mut bytes = vec![0x32];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x32);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load16U { mem_arg } => {
-                let mut bytes = vec![0x33];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x33);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load32S { mem_arg } => {
-                let mut bytes = vec![0x34];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x34);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Load32U { mem_arg } => {
-                let mut bytes = vec![0x35];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x35);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Store { mem_arg } => {
-                let mut bytes = vec![0x36];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x36);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Store { mem_arg } => {
-                let mut bytes = vec![0x37];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x37);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::F32Store { mem_arg } => {
-                let mut bytes = vec![0x38];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x38);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::F64Store { mem_arg } => {
-                let mut bytes = vec![0x39];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x39);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Store8 { mem_arg } => {
-                let mut bytes = vec![0x3A];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x3A);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I32Store16 { mem_arg } => {
-                let mut bytes = vec![0x3B];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x3B);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Store8 { mem_arg } => {
-                let mut bytes = vec![0x3C];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x3C);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Store16 { mem_arg } => {
-                let mut bytes = vec![0x3D];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x3D);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::I64Store32 { mem_arg } => {
-                let mut bytes = vec![0x3E];
-                bytes.append(&mut mem_arg.to_bytes());
-                bytes
+                bytes.push(0x3E);
+                mem_arg.write_bytes(bytes);
             }
             WasmInstruction::MemorySize => {
-                vec![0x3F, 0x00]
+                bytes.extend([0x3F, 0x00]);
             }
             WasmInstruction::MemoryGrow => {
-                vec![0x40, 0x00]
+                bytes.extend([0x40, 0x00]);
             }
             WasmInstruction::MemoryInit { data_idx } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(8));
-                bytes.append(&mut data_idx.to_bytes());
+                bytes.push(0xFC);
+                write_u32(8, bytes);
+                data_idx.write_bytes(bytes);
                 bytes.push(0x00);
-                bytes
             }
             WasmInstruction::DataDrop { data_idx } => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(9));
-                bytes.append(&mut data_idx.to_bytes());
-                bytes
+                bytes.push(0xFC);
+                write_u32(9, bytes);
+                data_idx.write_bytes(bytes);
             }
             WasmInstruction::MemoryCopy => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(10));
+                bytes.push(0xFC);
+                write_u32(10, bytes);
                 bytes.push(0x00);
                 bytes.push(0x00);
-                bytes
             }
             WasmInstruction::MemoryFill => {
-                let mut bytes = vec![0xFC];
-                bytes.append(&mut encode_unsigned_int(11));
+                bytes.push(0xFC);
+                write_u32(11, bytes);
                 bytes.push(0x00);
-                bytes
             }
             WasmInstruction::I32Const { n } => {
-                let mut bytes = vec![0x41];
-                bytes.append(&mut encode_signed_int(*n as i128));
-                bytes
+                bytes.push(0x41);
+                write_i32(*n, bytes);
             }
             WasmInstruction::I64Const { n } => {
-                let mut bytes = vec![0x42];
-                bytes.append(&mut encode_signed_int(*n as i128));
-                bytes
+                bytes.push(0x42);
+                write_i64(*n, bytes);
             }
             WasmInstruction::F32Const { z } => {
-                let mut bytes = vec![0x43];
-                bytes.append(&mut encode_float(*z as f64));
-                bytes
+                bytes.push(0x43);
+                write_f32(*z, bytes);
             }
             WasmInstruction::F64Const { z } => {
-                let mut bytes = vec![0x44];
-                bytes.append(&mut encode_float(*z));
-                bytes
+                bytes.push(0x44);
+                write_float(*z, bytes);
             }
 
             WasmInstruction::I32Eqz => {
-                vec![0x45]
+                bytes.push(0x45);
             }
             WasmInstruction::I32Eq => {
-                vec![0x46]
+                bytes.push(0x46);
             }
             WasmInstruction::I32Ne => {
-                vec![0x47]
+                bytes.push(0x47);
             }
             WasmInstruction::I32LtS => {
-                vec![0x48]
+                bytes.push(0x48);
             }
             WasmInstruction::I32LtU => {
-                vec![0x49]
+                bytes.push(0x49);
             }
             WasmInstruction::I32GtS => {
-                vec![0x4A]
+                bytes.push(0x4A);
             }
             WasmInstruction::I32GtU => {
-                vec![0x4b]
+                bytes.push(0x4b);
             }
             WasmInstruction::I32LeS => {
-                vec![0x4c]
+                bytes.push(0x4c);
             }
             WasmInstruction::I32LeU => {
-                vec![0x4d]
+                bytes.push(0x4d);
             }
             WasmInstruction::I32GeS => {
-                vec![0x4e]
+                bytes.push(0x4e);
             }
             WasmInstruction::I32GeU => {
-                vec![0x4f]
+                bytes.push(0x4f);
             }
 
             WasmInstruction::I64Eqz => {
-                vec![0x50]
+                bytes.push(0x50);
             }
             WasmInstruction::I64Eq => {
-                vec![0x51]
+                bytes.push(0x51);
             }
             WasmInstruction::I64Ne => {
-                vec![0x52]
+                bytes.push(0x52);
             }
             WasmInstruction::I64LtS => {
-                vec![0x53]
+                bytes.push(0x53);
             }
             WasmInstruction::I64LtU => {
-                vec![0x54]
+                bytes.push(0x54);
             }
             WasmInstruction::I64GtS => {
-                vec![0x55]
+                bytes.push(0x55);
             }
             WasmInstruction::I64GtU => {
-                vec![0x56]
+                bytes.push(0x56);
             }
             WasmInstruction::I64LeS => {
-                vec![0x57]
+                bytes.push(0x57);
             }
             WasmInstruction::I64LeU => {
-                vec![0x58]
+                bytes.push(0x58);
             }
             WasmInstruction::I64GeS => {
-                vec![0x59]
+                bytes.push(0x59);
             }
             WasmInstruction::I64GeU => {
-                vec![0x5a]
+                bytes.push(0x5a);
             }
 
             WasmInstruction::F32Eq => {
-                vec![0x5b]
+                bytes.push(0x5b);
             }
             WasmInstruction::F32Ne => {
-                vec![0x5c]
+                bytes.push(0x5c);
             }
             WasmInstruction::F32Lt => {
-                vec![0x5d]
+                bytes.push(0x5d);
             }
             WasmInstruction::F32Gt => {
-                vec![0x5e]
+                bytes.push(0x5e);
             }
             WasmInstruction::F32Le => {
-                vec![0x5f]
+                bytes.push(0x5f);
             }
             WasmInstruction::F32Ge => {
-                vec![0x60]
+                bytes.push(0x60);
             }
 
             WasmInstruction::F64Eq => {
-                vec![0x61]
+                bytes.push(0x61);
             }
             WasmInstruction::F64Ne => {
-                vec![0x62]
+                bytes.push(0x62);
             }
             WasmInstruction::F64Lt => {
-                vec![0x63]
+                bytes.push(0x63);
             }
             WasmInstruction::F64Gt => {
-                vec![0x64]
+                bytes.push(0x64);
             }
             WasmInstruction::F64Le => {
-                vec![0x65]
+                bytes.push(0x65);
             }
             WasmInstruction::F64Ge => {
-                vec![0x66]
+                bytes.push(0x66);
             }
 
             WasmInstruction::I32Clz => {
-                vec![0x67]
+                bytes.push(0x67);
             }
             WasmInstruction::I32Ctz => {
-                vec![0x68]
+                bytes.push(0x68);
             }
             WasmInstruction::I32PopCnt => {
-                vec![0x69]
+                bytes.push(0x69);
             }
             WasmInstruction::I32Add => {
-                vec![0x6a]
+                bytes.push(0x6a);
             }
             WasmInstruction::I32Sub => {
-                vec![0x6b]
+                bytes.push(0x6b);
             }
             WasmInstruction::I32Mul => {
-                vec![0x6c]
+                bytes.push(0x6c);
             }
             WasmInstruction::I32DivS => {
-                vec![0x6d]
+                bytes.push(0x6d);
             }
             WasmInstruction::I32DivU => {
-                vec![0x6e]
+                bytes.push(0x6e);
             }
             WasmInstruction::I32RemS => {
-                vec![0x6f]
+                bytes.push(0x6f);
             }
             WasmInstruction::I32RemU => {
-                vec![0x70]
+                bytes.push(0x70);
             }
             WasmInstruction::I32And => {
-                vec![0x71]
+                bytes.push(0x71);
             }
             WasmInstruction::I32Or => {
-                vec![0x72]
+                bytes.push(0x72);
             }
             WasmInstruction::I32Xor => {
-                vec![0x73]
+                bytes.push(0x73);
             }
             WasmInstruction::I32Shl => {
-                vec![0x74]
+                bytes.push(0x74);
             }
             WasmInstruction::I32ShrS => {
-                vec![0x75]
+                bytes.push(0x75);
             }
             WasmInstruction::I32ShrU => {
-                vec![0x76]
+                bytes.push(0x76);
             }
             WasmInstruction::I32RotL => {
-                vec![0x77]
+                bytes.push(0x77);
             }
             WasmInstruction::I32RotR => {
-                vec![0x78]
+                bytes.push(0x78);
             }
 
             WasmInstruction::I64Clz => {
-                vec![0x79]
+                bytes.push(0x79);
             }
             WasmInstruction::I64Ctz => {
-                vec![0x7a]
+                bytes.push(0x7a);
             }
             WasmInstruction::I64PopCnt => {
-                vec![0x7b]
+                bytes.push(0x7b);
             }
             WasmInstruction::I64Add => {
-                vec![0x7c]
+                bytes.push(0x7c);
             }
             WasmInstruction::I64Sub => {
-                vec![0x7d]
+                bytes.push(0x7d);
             }
             WasmInstruction::I64Mul => {
-                vec![0x7e]
+                bytes.push(0x7e);
             }
             WasmInstruction::I64DivS => {
-                vec![0x7f]
+                bytes.push(0x7f);
             }
             WasmInstruction::I64DivU => {
-                vec![0x80]
+                bytes.push(0x80);
             }
             WasmInstruction::I64RemS => {
-                vec![0x81]
+                bytes.push(0x81);
             }
             WasmInstruction::I64RemU => {
-                vec![0x82]
+                bytes.push(0x82);
             }
             WasmInstruction::I64And => {
-                vec![0x83]
+                bytes.push(0x83);
             }
             WasmInstruction::I64Or => {
-                vec![0x84]
+                bytes.push(0x84);
             }
             WasmInstruction::I64Xor => {
-                vec![0x85]
+                bytes.push(0x85);
             }
             WasmInstruction::I64Shl => {
-                vec![0x86]
+                bytes.push(0x86);
             }
             WasmInstruction::I64ShrS => {
-                vec![0x87]
+                bytes.push(0x87);
             }
             WasmInstruction::I64ShrU => {
-                vec![0x88]
+                bytes.push(0x88);
             }
             WasmInstruction::I64RotL => {
-                vec![0x89]
+                bytes.push(0x89);
             }
             WasmInstruction::I64RotR => {
-                vec![0x8a]
+                bytes.push(0x8a);
             }
 
             WasmInstruction::F32Abs => {
-                vec![0x8b]
+                bytes.push(0x8b);
             }
             WasmInstruction::F32Neg => {
-                vec![0x8c]
+                bytes.push(0x8c);
             }
             WasmInstruction::F32Ceil => {
-                vec![0x8d]
+                bytes.push(0x8d);
             }
             WasmInstruction::F32Floor => {
-                vec![0x8e]
+                bytes.push(0x8e);
             }
             WasmInstruction::F32Trunc => {
-                vec![0x8f]
+                bytes.push(0x8f);
             }
             WasmInstruction::F32Nearest => {
-                vec![0x90]
+                bytes.push(0x90);
             }
             WasmInstruction::F32Sqrt => {
-                vec![0x91]
+                bytes.push(0x91);
             }
             WasmInstruction::F32Add => {
-                vec![0x92]
+                bytes.push(0x92);
             }
             WasmInstruction::F32Sub => {
-                vec![0x93]
+                bytes.push(0x93);
             }
             WasmInstruction::F32Mul => {
-                vec![0x94]
+                bytes.push(0x94);
             }
             WasmInstruction::F32Div => {
-                vec![0x95]
+                bytes.push(0x95);
             }
             WasmInstruction::F32Min => {
-                vec![0x96]
+                bytes.push(0x96);
             }
             WasmInstruction::F32Max => {
-                vec![0x97]
+                bytes.push(0x97);
             }
             WasmInstruction::F32CopySign => {
-                vec![0x98]
+                bytes.push(0x98);
             }
 
             WasmInstruction::F64Abs => {
-                vec![0x99]
+                bytes.push(0x99);
             }
             WasmInstruction::F64Neg => {
-                vec![0x9a]
+                bytes.push(0x9a);
             }
             WasmInstruction::F64Ceil => {
-                vec![0x9b]
+                bytes.push(0x9b);
             }
             WasmInstruction::F64Floor => {
-                vec![0x9c]
+                bytes.push(0x9c);
             }
             WasmInstruction::F64Trunc => {
-                vec![0x9d]
+                bytes.push(0x9d);
             }
             WasmInstruction::F64Nearest => {
-                vec![0x9e]
+                bytes.push(0x9e);
             }
             WasmInstruction::F64Sqrt => {
-                vec![0x9f]
+                bytes.push(0x9f);
             }
             WasmInstruction::F64Add => {
-                vec![0xa0]
+                bytes.push(0xa0);
             }
             WasmInstruction::F64Sub => {
-                vec![0xa1]
+                bytes.push(0xa1);
             }
             WasmInstruction::F64Mul => {
-                vec![0xa2]
+                bytes.push(0xa2);
             }
             WasmInstruction::F64Div => {
-                vec![0xa3]
+                bytes.push(0xa3);
             }
             WasmInstruction::F64Min => {
-                vec![0xa4]
+                bytes.push(0xa4);
             }
             WasmInstruction::F64Max => {
-                vec![0xa5]
+                bytes.push(0xa5);
             }
             WasmInstruction::F64CopySign => {
-                vec![0xa6]
+                bytes.push(0xa6);
             }
 
             WasmInstruction::I32WrapI64 => {
-                vec![0xa7]
+                bytes.push(0xa7);
             }
             WasmInstruction::I32TruncF32S => {
-                vec![0xa8]
+                bytes.push(0xa8);
             }
             WasmInstruction::I32TruncF32U => {
-                vec![0xa9]
+                bytes.push(0xa9);
             }
             WasmInstruction::I32TruncF64S => {
-                vec![0xaa]
+                bytes.push(0xaa);
             }
             WasmInstruction::I32TruncF64U => {
-                vec![0xab]
+                bytes.push(0xab);
             }
             WasmInstruction::I64ExtendI32S => {
-                vec![0xac]
+                bytes.push(0xac);
             }
             WasmInstruction::I64ExtendI32U => {
-                vec![0xad]
+                bytes.push(0xad);
             }
             WasmInstruction::I64TruncF32S => {
-                vec![0xae]
+                bytes.push(0xae);
             }
             WasmInstruction::I64TruncF32U => {
-                vec![0xaf]
+                bytes.push(0xaf);
             }
             WasmInstruction::I64TruncF64S => {
-                vec![0xb0]
+                bytes.push(0xb0);
             }
             WasmInstruction::I64TruncF64U => {
-                vec![0xb1]
+                bytes.push(0xb1);
             }
             WasmInstruction::F32ConvertI32S => {
-                vec![0xb2]
+                bytes.push(0xb2);
             }
             WasmInstruction::F32ConvertI32U => {
-                vec![0xb3]
+                bytes.push(0xb3);
             }
             WasmInstruction::F32ConvertI64S => {
-                vec![0xb4]
+                bytes.push(0xb4);
             }
             WasmInstruction::F32ConvertI64U => {
-                vec![0xb5]
+                bytes.push(0xb5);
             }
             WasmInstruction::F32DemoteF64 => {
-                vec![0xb6]
+                bytes.push(0xb6);
             }
             WasmInstruction::F64ConvertI32S => {
-                vec![0xb7]
+                bytes.push(0xb7);
             }
             WasmInstruction::F64ConvertI32U => {
-                vec![0xb8]
+                bytes.push(0xb8);
             }
             WasmInstruction::F64ConvertI64S => {
-                vec![0xb9]
+                bytes.push(0xb9);
             }
             WasmInstruction::F64ConvertI64U => {
-                vec![0xba]
+                bytes.push(0xba);
             }
             WasmInstruction::F64PromoteF32 => {
-                vec![0xbb]
+                bytes.push(0xbb);
             }
             WasmInstruction::I32ReinterpretF32 => {
-                vec![0xbc]
+                bytes.push(0xbc);
             }
             WasmInstruction::I64ReinterpretF64 => {
-                vec![0xbd]
+                bytes.push(0xbd);
             }
             WasmInstruction::F32ReinterpretI32 => {
-                vec![0xbe]
+                bytes.push(0xbe);
             }
             WasmInstruction::F64ReinterpretI64 => {
-                vec![0xbf]
+                bytes.push(0xbf);
             }
 
             WasmInstruction::I32Extend8S => {
-                vec![0xc0]
+                bytes.push(0xc0);
             }
             WasmInstruction::I32Extend16S => {
-                vec![0xc1]
+                bytes.push(0xc1);
             }
             WasmInstruction::I64Extend8S => {
-                vec![0xc2]
+                bytes.push(0xc2);
             }
             WasmInstruction::I64Extend16S => {
-                vec![0xc3]
+                bytes.push(0xc3);
             }
             WasmInstruction::I64Extend32S => {
-                vec![0xc4]
+                bytes.push(0xc4);
             }
 
             WasmInstruction::I32TruncSatF32S => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(0));
-                v
+                bytes.push(0xFC);
+                write_u32(0, bytes);
             }
             WasmInstruction::I32TruncSatF32U => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(1));
-                v
+                bytes.push(0xFC);
+                write_u32(1, bytes);
             }
             WasmInstruction::I32TruncSatF64S => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(2));
-                v
+                bytes.push(0xFC);
+                write_u32(2, bytes);
             }
             WasmInstruction::I32TruncSatF64U => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(3));
-                v
+                bytes.push(0xFC);
+                write_u32(3, bytes);
             }
             WasmInstruction::I64TruncSatF32S => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(4));
-                v
+                bytes.push(0xFC);
+                write_u32(4, bytes);
             }
             WasmInstruction::I64TruncSatF32U => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(5));
-                v
+                bytes.push(0xFC);
+                write_u32(5, bytes);
             }
             WasmInstruction::I64TruncSatF64S => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(6));
-                v
+                bytes.push(0xFC);
+                write_u32(6, bytes);
             }
             WasmInstruction::I64TruncSatF64U => {
-                let mut v = vec![0xFC];
-                v.append(&mut encode_unsigned_int(7));
-                v
+                bytes.push(0xFC);
+                write_u32(7, bytes);
+            }
+            WasmInstruction::V128Load { mem_arg } => {
+                bytes.push(0xFD);
+                write_u32(0, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::V128Store { mem_arg } => {
+                bytes.push(0xFD);
+                write_u32(11, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::V128Const { bytes: v128_bytes } => {
+                bytes.push(0xFD);
+                write_u32(12, bytes);
+                bytes.extend_from_slice(v128_bytes);
+            }
+            WasmInstruction::I8x16Splat => {
+                bytes.push(0xFD);
+                write_u32(15, bytes);
+            }
+            WasmInstruction::I8x16Eq => {
+                bytes.push(0xFD);
+                write_u32(35, bytes);
+            }
+            WasmInstruction::V128AnyTrue => {
+                bytes.push(0xFD);
+                write_u32(83, bytes);
+            }
+            WasmInstruction::I8x16AllTrue => {
+                bytes.push(0xFD);
+                write_u32(99, bytes);
+            }
+            WasmInstruction::I8x16Bitmask => {
+                bytes.push(0xFD);
+                write_u32(100, bytes);
+            }
+            WasmInstruction::MemoryAtomicNotify { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x00, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::MemoryAtomicWait32 { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x01, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::AtomicFence => {
+                bytes.push(0xFE);
+                write_u32(0x03, bytes);
+                bytes.push(0x00);
+            }
+            WasmInstruction::I32AtomicLoad { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x10, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::I32AtomicStore { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x17, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::I32AtomicRmwAdd { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x1E, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::I32AtomicRmwSub { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x25, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::I32AtomicRmwXchg { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x41, bytes);
+                mem_arg.write_bytes(bytes);
+            }
+            WasmInstruction::I32AtomicRmwCmpxchg { mem_arg } => {
+                bytes.push(0xFE);
+                write_u32(0x48, bytes);
+                mem_arg.write_bytes(bytes);
             }
         }
     }
@@ -1,4 +1,5 @@
 pub mod code_section;
+pub mod custom_section;
 pub mod data_section;
 pub mod element_section;
 pub mod exports_section;
@@ -7,6 +8,7 @@ pub mod globals_section;
 pub mod imports_section;
 pub mod memory_section;
 pub mod module;
+pub mod name_section;
 pub mod start_section;
 pub mod tables_section;
 pub mod types_section;
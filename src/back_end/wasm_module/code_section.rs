@@ -1,8 +1,8 @@
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::write_u32;
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_instructions::WasmExpression;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::{write_section, write_size_prefixed};
 use crate::back_end::wasm_types::ValType;
 
 pub struct CodeSection {
@@ -18,10 +18,10 @@ impl CodeSection {
 }
 
 impl ToBytes for CodeSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.function_bodies);
-
-        encode_section(0x0a, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x0a, bytes, |bytes| {
+            write_vector(&self.function_bodies, bytes)
+        });
     }
 }
 
@@ -31,16 +31,12 @@ pub struct WasmFunctionCode {
 }
 
 impl ToBytes for WasmFunctionCode {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut body_bytes = encode_vector(&self.local_declarations);
-        body_bytes.append(&mut self.function_body.to_bytes());
-
-        let mut bytes = Vec::new();
-        // function code size
-        bytes.append(&mut encode_unsigned_int(body_bytes.len() as u128));
-        bytes.append(&mut body_bytes);
-
-        bytes
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        // function code size, then the code
+        write_size_prefixed(bytes, |bytes| {
+            write_vector(&self.local_declarations, bytes);
+            self.function_body.write_bytes(bytes);
+        });
     }
 }
 
@@ -50,9 +46,8 @@ pub struct LocalDeclaration {
 }
 
 impl ToBytes for LocalDeclaration {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = encode_unsigned_int(self.count as u128);
-        bytes.append(&mut self.value_type.to_bytes());
-        bytes
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_u32(self.count, bytes);
+        self.value_type.write_bytes(bytes);
     }
 }
@@ -0,0 +1,20 @@
+use crate::back_end::integer_encoding::write_u32;
+use crate::back_end::to_bytes::ToBytes;
+use crate::back_end::wasm_module::module::write_section;
+
+/// A section of data that the wasm engine ignores, but that tools and the JS runtime can read
+pub struct CustomSection {
+    pub name: String,
+    pub contents: Vec<u8>,
+}
+
+impl ToBytes for CustomSection {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x00, bytes, |bytes| {
+            let name_bytes = self.name.as_bytes();
+            write_u32(name_bytes.len() as u32, bytes);
+            bytes.extend_from_slice(name_bytes);
+            bytes.extend_from_slice(&self.contents);
+        });
+    }
+}
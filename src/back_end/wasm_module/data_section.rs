@@ -1,9 +1,9 @@
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::write_u32;
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_indices::MemIdx;
 use crate::back_end::wasm_instructions::WasmExpression;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 
 pub struct DataSection {
     pub data_segments: Vec<DataSegment>,
@@ -15,13 +15,28 @@ impl DataSection {
             data_segments: Vec::new(),
         }
     }
+
+    /// Write the data count section, which comes before the code section. It's only needed
+    /// when the code initialises memory from the passive segments with memory.init, so the
+    /// segment indices can be validated before the data section is read.
+    pub fn write_data_count_bytes(&self, bytes: &mut Vec<u8>) {
+        let has_passive_segments = self
+            .data_segments
+            .iter()
+            .any(|segment| matches!(segment, DataSegment::PassiveSegment { .. }));
+        if has_passive_segments {
+            write_section(0x0c, bytes, |bytes| {
+                write_u32(self.data_segments.len() as u32, bytes)
+            });
+        }
+    }
 }
 
 impl ToBytes for DataSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.data_segments);
-
-        encode_section(0x0b, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x0b, bytes, |bytes| {
+            write_vector(&self.data_segments, bytes)
+        });
     }
 }
 
@@ -41,35 +56,32 @@ pub enum DataSegment {
 }
 
 impl ToBytes for DataSegment {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
             DataSegment::ActiveSegmentMemIndexZero { offset_expr, data } => {
-                let mut bytes = encode_unsigned_int(0);
-                bytes.append(&mut offset_expr.to_bytes());
+                write_u32(0, bytes);
+                offset_expr.write_bytes(bytes);
                 // data bytes as vector
-                bytes.append(&mut encode_unsigned_int(data.len() as u128));
-                bytes.append(&mut data.clone());
-                bytes
+                write_u32(data.len() as u32, bytes);
+                bytes.extend_from_slice(data);
             }
             DataSegment::PassiveSegment { data } => {
-                let mut bytes = encode_unsigned_int(1);
+                write_u32(1, bytes);
                 // data bytes as vector
-                bytes.append(&mut encode_unsigned_int(data.len() as u128));
-                bytes.append(&mut data.clone());
-                bytes
+                write_u32(data.len() as u32, bytes);
+                bytes.extend_from_slice(data);
             }
             DataSegment::ActiveSegmentExplicitMemIndex {
                 memory_idx,
                 offset_expr,
                 data,
             } => {
-                let mut bytes = encode_unsigned_int(2);
-                bytes.append(&mut memory_idx.to_bytes());
-                bytes.append(&mut offset_expr.to_bytes());
+                write_u32(2, bytes);
+                memory_idx.write_bytes(bytes);
+                offset_expr.write_bytes(bytes);
                 // data bytes as vector
-                bytes.append(&mut encode_unsigned_int(data.len() as u128));
-                bytes.append(&mut data.clone());
-                bytes
+                write_u32(data.len() as u32, bytes);
+                bytes.extend_from_slice(data);
             }
         }
     }
@@ -1,5 +1,5 @@
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 
 pub struct ElementSection {}
 
@@ -10,7 +10,7 @@ impl ElementSection {
 }
 
 impl ToBytes for ElementSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        encode_section(0x09, Vec::new())
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x09, bytes, |_| {});
     }
 }
@@ -1,8 +1,8 @@
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::write_u32;
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_indices::{FuncIdx, GlobalIdx, MemIdx, TableIdx};
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 
 pub struct ExportsSection {
     pub exports: Vec<WasmExport>,
@@ -17,10 +17,8 @@ impl ExportsSection {
 }
 
 impl ToBytes for ExportsSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.exports);
-
-        encode_section(0x07, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x07, bytes, |bytes| write_vector(&self.exports, bytes));
     }
 }
 
@@ -30,19 +28,15 @@ pub struct WasmExport {
 }
 
 impl ToBytes for WasmExport {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = Vec::new();
-
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         // export name
-        let mut name_bytes = self.name.as_bytes().to_vec();
+        let name_bytes = self.name.as_bytes();
         // string length
-        bytes.append(&mut encode_unsigned_int(name_bytes.len() as u128));
-        bytes.append(&mut name_bytes);
+        write_u32(name_bytes.len() as u32, bytes);
+        bytes.extend_from_slice(name_bytes);
 
         // export descriptor
-        bytes.append(&mut self.export_descriptor.to_bytes());
-
-        bytes
+        self.export_descriptor.write_bytes(bytes);
     }
 }
 
@@ -54,27 +48,23 @@ pub enum ExportDescriptor {
 }
 
 impl ToBytes for ExportDescriptor {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
             ExportDescriptor::Func { func_idx } => {
-                let mut bytes = vec![0x00];
-                bytes.append(&mut func_idx.to_bytes());
-                bytes
+                bytes.push(0x00);
+                func_idx.write_bytes(bytes);
             }
             ExportDescriptor::Table { table_idx } => {
-                let mut bytes = vec![0x01];
-                bytes.append(&mut table_idx.to_bytes());
-                bytes
+                bytes.push(0x01);
+                table_idx.write_bytes(bytes);
             }
             ExportDescriptor::Mem { mem_idx } => {
-                let mut bytes = vec![0x02];
-                bytes.append(&mut mem_idx.to_bytes());
-                bytes
+                bytes.push(0x02);
+                mem_idx.write_bytes(bytes);
             }
             ExportDescriptor::Global { global_idx } => {
-                let mut bytes = vec![0x03];
-                bytes.append(&mut global_idx.to_bytes());
-                bytes
+                bytes.push(0x03);
+                global_idx.write_bytes(bytes);
             }
         }
     }
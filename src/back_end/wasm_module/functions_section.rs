@@ -1,7 +1,7 @@
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_indices::TypeIdx;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 
 pub struct FunctionsSection {
     pub function_type_idxs: Vec<TypeIdx>,
@@ -16,9 +16,9 @@ impl FunctionsSection {
 }
 
 impl ToBytes for FunctionsSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.function_type_idxs);
-
-        encode_section(0x03, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x03, bytes, |bytes| {
+            write_vector(&self.function_type_idxs, bytes)
+        });
     }
 }
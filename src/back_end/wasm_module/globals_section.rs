@@ -1,11 +1,11 @@
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_instructions::WasmExpression;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 use crate::back_end::wasm_types::GlobalType;
 
 pub struct GlobalsSection {
-    globals: Vec<WasmGlobal>,
+    pub globals: Vec<WasmGlobal>,
 }
 
 impl GlobalsSection {
@@ -17,22 +17,19 @@ impl GlobalsSection {
 }
 
 impl ToBytes for GlobalsSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.globals);
-
-        encode_section(0x06, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x06, bytes, |bytes| write_vector(&self.globals, bytes));
     }
 }
 
 pub struct WasmGlobal {
-    global_type: GlobalType,
-    init_expr: WasmExpression,
+    pub global_type: GlobalType,
+    pub init_expr: WasmExpression,
 }
 
 impl ToBytes for WasmGlobal {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = self.global_type.to_bytes();
-        bytes.append(&mut self.init_expr.to_bytes());
-        bytes
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        self.global_type.write_bytes(bytes);
+        self.init_expr.write_bytes(bytes);
     }
 }
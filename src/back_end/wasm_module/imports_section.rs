@@ -1,8 +1,8 @@
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::write_u32;
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
+use crate::back_end::vector_encoding::write_vector;
 use crate::back_end::wasm_indices::TypeIdx;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 use crate::back_end::wasm_types::{GlobalType, MemoryType, TableType};
 
 pub struct ImportsSection {
@@ -18,10 +18,8 @@ impl ImportsSection {
 }
 
 impl ToBytes for ImportsSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.imports);
-
-        encode_section(0x02, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x02, bytes, |bytes| write_vector(&self.imports, bytes));
     }
 }
 
@@ -32,25 +30,21 @@ pub struct WasmImport {
 }
 
 impl ToBytes for WasmImport {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = Vec::new();
-
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         // module name
-        let mut module_name_bytes = self.module_name.as_bytes().to_vec();
+        let module_name_bytes = self.module_name.as_bytes();
         // string length
-        bytes.append(&mut encode_unsigned_int(module_name_bytes.len() as u128));
-        bytes.append(&mut module_name_bytes);
+        write_u32(module_name_bytes.len() as u32, bytes);
+        bytes.extend_from_slice(module_name_bytes);
 
         // field name
-        let mut field_name_bytes = self.field_name.as_bytes().to_vec();
+        let field_name_bytes = self.field_name.as_bytes();
         // string length
-        bytes.append(&mut encode_unsigned_int(field_name_bytes.len() as u128));
-        bytes.append(&mut field_name_bytes);
+        write_u32(field_name_bytes.len() as u32, bytes);
+        bytes.extend_from_slice(field_name_bytes);
 
         // import descriptor
-        bytes.append(&mut self.import_descriptor.to_bytes());
-
-        bytes
+        self.import_descriptor.write_bytes(bytes);
     }
 }
 
@@ -62,27 +56,23 @@ pub enum ImportDescriptor {
 }
 
 impl ToBytes for ImportDescriptor {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
             ImportDescriptor::Func { func_type_idx } => {
-                let mut bytes = vec![0x00];
-                bytes.append(&mut func_type_idx.to_bytes());
-                bytes
+                bytes.push(0x00);
+                func_type_idx.write_bytes(bytes);
             }
             ImportDescriptor::Table { table_type } => {
-                let mut bytes = vec![0x01];
-                bytes.append(&mut table_type.to_bytes());
-                bytes
+                bytes.push(0x01);
+                table_type.write_bytes(bytes);
             }
             ImportDescriptor::Mem { mem_type } => {
-                let mut bytes = vec![0x02];
-                bytes.append(&mut mem_type.to_bytes());
-                bytes
+                bytes.push(0x02);
+                mem_type.write_bytes(bytes);
             }
             ImportDescriptor::Global { global_type } => {
-                let mut bytes = vec![0x03];
-                bytes.append(&mut global_type.to_bytes());
-                bytes
+                bytes.push(0x03);
+                global_type.write_bytes(bytes);
             }
         }
     }
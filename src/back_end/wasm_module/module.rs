@@ -6,19 +6,21 @@ use std::path::Path;
 
 use log::info;
 
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::encode_u32;
 use crate::back_end::target_code_generation_context::ModuleContext;
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::wasm_indices::{FuncIdx, TypeIdx, WasmIdx, WasmIdxGenerator};
+use crate::back_end::wasm_indices::{FuncIdx, GlobalIdx, TypeIdx, WasmIdx, WasmIdxGenerator};
 use crate::back_end::wasm_instructions::WasmExpression;
-use crate::back_end::wasm_module::code_section::{CodeSection, WasmFunctionCode};
+use crate::back_end::wasm_module::code_section::{CodeSection, LocalDeclaration, WasmFunctionCode};
+use crate::back_end::wasm_module::custom_section::CustomSection;
 use crate::back_end::wasm_module::data_section::DataSection;
 use crate::back_end::wasm_module::element_section::ElementSection;
 use crate::back_end::wasm_module::exports_section::ExportsSection;
 use crate::back_end::wasm_module::functions_section::FunctionsSection;
-use crate::back_end::wasm_module::globals_section::GlobalsSection;
+use crate::back_end::wasm_module::globals_section::{GlobalsSection, WasmGlobal};
 use crate::back_end::wasm_module::imports_section::{ImportDescriptor, ImportsSection, WasmImport};
 use crate::back_end::wasm_module::memory_section::MemorySection;
+use crate::back_end::wasm_module::name_section::NameSection;
 use crate::back_end::wasm_module::start_section::StartSection;
 use crate::back_end::wasm_module::tables_section::TablesSection;
 use crate::back_end::wasm_module::types_section::{TypesSection, WasmFunctionType};
@@ -33,11 +35,15 @@ pub struct WasmModule {
     pub tables_section: TablesSection,
     pub memory_section: MemorySection,
     pub globals_section: GlobalsSection,
+    global_idx_generator: WasmIdxGenerator<GlobalIdx>,
     pub exports_section: ExportsSection,
     pub start_section: StartSection,
     pub element_section: ElementSection,
     pub code_section: CodeSection,
     pub data_section: DataSection,
+    pub name_section: NameSection,
+    /// Written after all the other sections
+    pub custom_sections: Vec<CustomSection>,
 }
 
 impl WasmModule {
@@ -50,11 +56,14 @@ impl WasmModule {
             tables_section: TablesSection::new(),
             memory_section: MemorySection::new(),
             globals_section: GlobalsSection::new(),
+            global_idx_generator: WasmIdxGenerator::new(),
             exports_section: ExportsSection::new(),
             start_section: StartSection::new(),
             element_section: ElementSection::new(),
             code_section: CodeSection::new(),
             data_section: DataSection::new(),
+            name_section: NameSection::new(),
+            custom_sections: Vec::new(),
         }
     }
 
@@ -63,10 +72,28 @@ impl WasmModule {
         self.type_idx_generator.new_idx()
     }
 
+    /// Insert a function type, unless an identical type is already in the module
+    pub fn insert_or_get_type(&mut self, function_type: WasmFunctionType) -> TypeIdx {
+        let mut type_idx = TypeIdx::initial_idx();
+        for existing_function_type in &self.types_section.function_types {
+            if *existing_function_type == function_type {
+                return type_idx;
+            }
+            type_idx = type_idx.next_idx();
+        }
+        self.insert_type(function_type)
+    }
+
+    pub fn insert_global(&mut self, global: WasmGlobal) -> GlobalIdx {
+        self.globals_section.globals.push(global);
+        self.global_idx_generator.new_idx()
+    }
+
     pub fn insert_defined_functions(
         &mut self,
         mut func_idx_to_body_code_map: HashMap<FuncIdx, WasmExpression>,
         mut func_idx_to_type_idx_map: HashMap<FuncIdx, TypeIdx>,
+        mut func_idx_to_local_declarations_map: HashMap<FuncIdx, Vec<LocalDeclaration>>,
         module_context: &ModuleContext,
     ) {
         let mut func_idx = module_context.defined_func_idx_range.0.to_owned();
@@ -81,10 +108,14 @@ impl WasmModule {
                 Some(type_idx) => {
                     info!("adding function {:?} to module", func_idx);
                     let body_code = func_idx_to_body_code_map.remove(&func_idx).unwrap();
+                    // functions without any wasm locals won't have an entry
+                    let local_declarations = func_idx_to_local_declarations_map
+                        .remove(&func_idx)
+                        .unwrap_or_default();
                     self.functions_section.function_type_idxs.push(type_idx);
 
                     let code_entry = WasmFunctionCode {
-                        local_declarations: Vec::new(),
+                        local_declarations,
                         function_body: body_code,
                     };
 
@@ -96,6 +127,7 @@ impl WasmModule {
         // because we remove each entry as we process it, the maps should be empty at the end
         assert!(func_idx_to_type_idx_map.is_empty());
         assert!(func_idx_to_body_code_map.is_empty());
+        assert!(func_idx_to_local_declarations_map.is_empty());
     }
 
     pub fn insert_imported_functions(
@@ -137,44 +169,71 @@ impl WasmModule {
         output.write_all(&self.to_bytes())?;
         Ok(())
     }
+
+    /// The binary encoding of the module
+    pub fn to_bytes(&self) -> Vec<u8> {
+        let mut bytes = Vec::new();
+        self.write_bytes(&mut bytes);
+        bytes
+    }
 }
 
 impl ToBytes for WasmModule {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         // WebAssembly magic number
-        let mut bytes = vec![0x00, 0x61, 0x73, 0x6d];
+        bytes.extend_from_slice(&[0x00, 0x61, 0x73, 0x6d]);
         // WebAssembly version
-        bytes.append(&mut vec![0x01, 0x00, 0x00, 0x00]);
-
-        bytes.append(&mut self.types_section.to_bytes());
-        bytes.append(&mut self.imports_section.to_bytes());
-        bytes.append(&mut self.functions_section.to_bytes());
-        bytes.append(&mut self.tables_section.to_bytes());
-        bytes.append(&mut self.memory_section.to_bytes());
-        bytes.append(&mut self.globals_section.to_bytes());
-        bytes.append(&mut self.exports_section.to_bytes());
-        bytes.append(&mut self.start_section.to_bytes());
-        bytes.append(&mut self.element_section.to_bytes());
-        bytes.append(&mut self.code_section.to_bytes());
-        bytes.append(&mut self.data_section.to_bytes());
-
-        bytes
+        bytes.extend_from_slice(&[0x01, 0x00, 0x00, 0x00]);
+
+        self.types_section.write_bytes(bytes);
+        self.imports_section.write_bytes(bytes);
+        self.functions_section.write_bytes(bytes);
+        self.tables_section.write_bytes(bytes);
+        self.memory_section.write_bytes(bytes);
+        self.globals_section.write_bytes(bytes);
+        self.exports_section.write_bytes(bytes);
+        self.start_section.write_bytes(bytes);
+        self.element_section.write_bytes(bytes);
+        self.data_section.write_data_count_bytes(bytes);
+        self.code_section.write_bytes(bytes);
+        self.data_section.write_bytes(bytes);
+        self.name_section.write_bytes(bytes);
+        for custom_section in &self.custom_sections {
+            custom_section.write_bytes(bytes);
+        }
     }
 }
 
-pub fn encode_section(section_code: u8, mut body: Vec<u8>) -> Vec<u8> {
-    let mut bytes = Vec::new();
+/// Write a section's code, size and body. The body is written straight after the section
+/// code, and then its size is inserted in front of it, once we know how long it is.
+pub fn write_section(section_code: u8, bytes: &mut Vec<u8>, write_body: impl FnOnce(&mut Vec<u8>)) {
+    let section_start = bytes.len();
+    // section code
+    bytes.push(section_code);
+    let body_start = bytes.len();
+    write_body(bytes);
 
     // don't need to output anything for empty section
-    if body.is_empty() {
-        return bytes;
+    if bytes.len() == body_start {
+        bytes.truncate(section_start);
+        return;
     }
 
-    // section code
-    bytes.push(section_code);
     // section size
-    bytes.append(&mut encode_unsigned_int(body.len() as u128));
-    // body
-    bytes.append(&mut body);
-    bytes
+    insert_size(bytes, body_start);
+}
+
+/// Write something that's encoded as its size in bytes followed by its contents
+pub fn write_size_prefixed(bytes: &mut Vec<u8>, write_contents: impl FnOnce(&mut Vec<u8>)) {
+    let contents_start = bytes.len();
+    write_contents(bytes);
+    insert_size(bytes, contents_start);
+}
+
+/// Insert the size of everything after `start` at `start`. This has to move the bytes after
+/// `start` along to make room, but that's cheaper than encoding them into their own Vec
+/// and then copying that
+pub fn insert_size(bytes: &mut Vec<u8>, start: usize) {
+    let size = encode_u32((bytes.len() - start) as u32);
+    bytes.splice(start..start, size.as_slice().iter().copied());
 }
@@ -0,0 +1,83 @@
+use std::collections::BTreeMap;
+
+use crate::back_end::integer_encoding::write_u32;
+use crate::back_end::to_bytes::ToBytes;
+use crate::back_end::wasm_indices::{FuncIdx, LocalIdx};
+use crate::back_end::wasm_module::module::{insert_size, write_section};
+
+const NAME_SECTION_NAME: &str = "name";
+const FUNCTION_NAMES_SUBSECTION_ID: u8 = 1;
+const LOCAL_NAMES_SUBSECTION_ID: u8 = 2;
+
+/// The custom section that gives the functions and locals their names from the C source, so
+/// stack traces and profilers don't just show wasm-function[N]. Name maps have to be in
+/// order of index, so they're kept sorted.
+pub struct NameSection {
+    pub function_names: BTreeMap<FuncIdx, String>,
+    pub local_names: BTreeMap<FuncIdx, Vec<(LocalIdx, String)>>,
+}
+
+impl NameSection {
+    pub fn new() -> Self {
+        NameSection {
+            function_names: BTreeMap::new(),
+            local_names: BTreeMap::new(),
+        }
+    }
+
+    /// Local names can be given in any order
+    pub fn insert_local_names(&mut self, func_idx: FuncIdx, mut names: Vec<(LocalIdx, String)>) {
+        if names.is_empty() {
+            return;
+        }
+        names.sort_by_key(|(local_idx, _)| local_idx.x);
+        self.local_names.insert(func_idx, names);
+    }
+}
+
+impl ToBytes for NameSection {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        if self.function_names.is_empty() && self.local_names.is_empty() {
+            return;
+        }
+        write_section(0x00, bytes, |bytes| {
+            write_name(NAME_SECTION_NAME, bytes);
+
+            if !self.function_names.is_empty() {
+                write_subsection(FUNCTION_NAMES_SUBSECTION_ID, bytes, |bytes| {
+                    write_u32(self.function_names.len() as u32, bytes);
+                    for (func_idx, name) in &self.function_names {
+                        func_idx.write_bytes(bytes);
+                        write_name(name, bytes);
+                    }
+                });
+            }
+
+            if !self.local_names.is_empty() {
+                write_subsection(LOCAL_NAMES_SUBSECTION_ID, bytes, |bytes| {
+                    write_u32(self.local_names.len() as u32, bytes);
+                    for (func_idx, names) in &self.local_names {
+                        func_idx.write_bytes(bytes);
+                        write_u32(names.len() as u32, bytes);
+                        for (local_idx, name) in names {
+                            local_idx.write_bytes(bytes);
+                            write_name(name, bytes);
+                        }
+                    }
+                });
+            }
+        });
+    }
+}
+
+fn write_subsection(subsection_id: u8, bytes: &mut Vec<u8>, write_body: impl FnOnce(&mut Vec<u8>)) {
+    bytes.push(subsection_id);
+    let body_start = bytes.len();
+    write_body(bytes);
+    insert_size(bytes, body_start);
+}
+
+fn write_name(name: &str, bytes: &mut Vec<u8>) {
+    write_u32(name.len() as u32, bytes);
+    bytes.extend_from_slice(name.as_bytes());
+}
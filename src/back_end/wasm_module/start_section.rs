@@ -1,6 +1,6 @@
 use crate::back_end::to_bytes::ToBytes;
 use crate::back_end::wasm_indices::FuncIdx;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::wasm_module::module::write_section;
 
 pub struct StartSection {
     pub start_func_idx: Option<FuncIdx>,
@@ -15,12 +15,11 @@ impl StartSection {
 }
 
 impl ToBytes for StartSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = match &self.start_func_idx {
-            None => Vec::new(),
-            Some(func_idx) => func_idx.to_bytes(),
-        };
-
-        encode_section(0x08, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x08, bytes, |bytes| {
+            if let Some(func_idx) = &self.start_func_idx {
+                func_idx.write_bytes(bytes);
+            }
+        });
     }
 }
@@ -1,6 +1,6 @@
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::vector_encoding::write_vector;
+use crate::back_end::wasm_module::module::write_section;
 use crate::back_end::wasm_types::TableType;
 
 pub struct TablesSection {
@@ -16,9 +16,7 @@ impl TablesSection {
 }
 
 impl ToBytes for TablesSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.table_types);
-
-        encode_section(0x04, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x04, bytes, |bytes| write_vector(&self.table_types, bytes));
     }
 }
@@ -1,6 +1,6 @@
 use crate::back_end::to_bytes::ToBytes;
-use crate::back_end::vector_encoding::encode_vector;
-use crate::back_end::wasm_module::module::encode_section;
+use crate::back_end::vector_encoding::write_vector;
+use crate::back_end::wasm_module::module::write_section;
 use crate::back_end::wasm_types::ValType;
 
 pub struct TypesSection {
@@ -16,31 +16,28 @@ impl TypesSection {
 }
 
 impl ToBytes for TypesSection {
-    fn to_bytes(&self) -> Vec<u8> {
-        let body_bytes = encode_vector(&self.function_types);
-
-        encode_section(0x01, body_bytes)
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        write_section(0x01, bytes, |bytes| {
+            write_vector(&self.function_types, bytes)
+        });
     }
 }
 
+#[derive(PartialEq)]
 pub struct WasmFunctionType {
     pub param_types: Vec<ValType>,
     pub result_types: Vec<ValType>,
 }
 
 impl ToBytes for WasmFunctionType {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = Vec::new();
-
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         // it's a function type
         bytes.push(0x60);
 
         // vector of parameter types
-        bytes.append(&mut encode_vector(&self.param_types));
+        write_vector(&self.param_types, bytes);
 
         // vector of result types
-        bytes.append(&mut encode_vector(&self.result_types));
-
-        bytes
+        write_vector(&self.result_types, bytes);
     }
 }
@@ -1,22 +1,24 @@
-use crate::back_end::integer_encoding::encode_unsigned_int;
+use crate::back_end::integer_encoding::write_u32;
 use crate::back_end::to_bytes::ToBytes;
 
-#[derive(Debug)]
+#[derive(Debug, Clone, PartialEq, Eq)]
 pub enum ValType {
     NumType(NumType),
+    VecType(VecType),
     RefType(RefType),
 }
 
 impl ToBytes for ValType {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
-            ValType::NumType(t) => t.to_bytes(),
-            ValType::RefType(t) => t.to_bytes(),
+            ValType::NumType(t) => t.write_bytes(bytes),
+            ValType::VecType(t) => t.write_bytes(bytes),
+            ValType::RefType(t) => t.write_bytes(bytes),
         }
     }
 }
 
-#[derive(Debug)]
+#[derive(Debug, Clone, PartialEq, Eq, PartialOrd, Ord)]
 pub enum NumType {
     I32,
     I64,
@@ -25,38 +27,54 @@ pub enum NumType {
 }
 
 impl ToBytes for NumType {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
             NumType::I32 => {
-                vec![0x7f]
+                bytes.push(0x7f);
             }
             NumType::I64 => {
-                vec![0x7e]
+                bytes.push(0x7e);
             }
             NumType::F32 => {
-                vec![0x7d]
+                bytes.push(0x7d);
             }
             NumType::F64 => {
-                vec![0x7c]
+                bytes.push(0x7c);
             }
         }
     }
 }
 
-#[derive(Debug)]
+/// The 128-bit vector type from the SIMD proposal
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum VecType {
+    V128,
+}
+
+impl ToBytes for VecType {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        match self {
+            VecType::V128 => {
+                bytes.push(0x7b);
+            }
+        }
+    }
+}
+
+#[derive(Debug, Clone, PartialEq, Eq)]
 pub enum RefType {
     FuncRef,
     ExternRef,
 }
 
 impl ToBytes for RefType {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self {
             RefType::FuncRef => {
-                vec![0x70]
+                bytes.push(0x70);
             }
             RefType::ExternRef => {
-                vec![0x6f]
+                bytes.push(0x6f);
             }
         }
     }
@@ -68,21 +86,29 @@ pub struct TableType {
 }
 
 impl ToBytes for TableType {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = self.element_ref_type.to_bytes();
-        bytes.append(&mut self.limits.to_bytes());
-        bytes
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        self.element_ref_type.write_bytes(bytes);
+        self.limits.write_bytes(bytes);
     }
 }
 
 pub struct MemoryType {
     /// Memory limits in units of page size
     pub limits: Limits,
+    /// Whether the memory can be shared between threads. Shared memory must have a maximum
+    pub is_shared: bool,
 }
 
 impl ToBytes for MemoryType {
-    fn to_bytes(&self) -> Vec<u8> {
-        self.limits.to_bytes()
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        match (self.is_shared, self.limits.max) {
+            (true, Some(max)) => {
+                bytes.push(0x03);
+                write_u32(self.limits.min, bytes);
+                write_u32(max, bytes);
+            }
+            _ => self.limits.write_bytes(bytes),
+        }
     }
 }
 
@@ -92,13 +118,12 @@ pub struct GlobalType {
 }
 
 impl ToBytes for GlobalType {
-    fn to_bytes(&self) -> Vec<u8> {
-        let mut bytes = self.value_type.to_bytes();
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
+        self.value_type.write_bytes(bytes);
         match self.is_mutable {
             false => bytes.push(0x00),
             true => bytes.push(0x01),
         }
-        bytes
     }
 }
 
@@ -108,18 +133,16 @@ pub struct Limits {
 }
 
 impl ToBytes for Limits {
-    fn to_bytes(&self) -> Vec<u8> {
+    fn write_bytes(&self, bytes: &mut Vec<u8>) {
         match self.max {
             None => {
-                let mut bytes = vec![0x00];
-                bytes.append(&mut encode_unsigned_int(self.min as u128));
-                bytes
+                bytes.push(0x00);
+                write_u32(self.min, bytes);
             }
             Some(max) => {
-                let mut bytes = vec![0x01];
-                bytes.append(&mut encode_unsigned_int(self.min as u128));
-                bytes.append(&mut encode_unsigned_int(max as u128));
-                bytes
+                bytes.push(0x01);
+                write_u32(self.min, bytes);
+                write_u32(max, bytes);
             }
         }
     }
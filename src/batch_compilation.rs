@@ -0,0 +1,144 @@
+#[cfg(test)]
+#[path = "batch_compilation_tests.rs"]
+mod batch_compilation_tests;
+
+use std::collections::HashMap;
+use std::error::Error;
+use std::fmt;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::Mutex;
+use std::thread;
+
+use log::{error, info};
+
+/// Compiles each of the input files to a .wasm file, on a pool of worker threads. Each
+/// output has the same name as its input, and is written to output_dir, or next to the
+/// input if there isn't one. Every file is attempted even if some fail. Nothing is compiled
+/// if two inputs would be written to the same output.
+///
+/// Everything the compiler caches between files, like the preprocessed standard headers,
+/// is shared by all the workers.
+pub fn compile_batch<F>(
+    inputs: &[PathBuf],
+    output_dir: Option<&Path>,
+    jobs: usize,
+    compile_file: F,
+) -> Result<(), BatchCompilationError>
+where
+    F: Fn(&Path, &Path) -> Result<(), Box<dyn Error>> + Sync,
+{
+    let outputs = get_output_paths(inputs, output_dir)?;
+    let jobs = jobs.clamp(1, inputs.len().max(1));
+    info!("Compiling {} files with {} workers", inputs.len(), jobs);
+
+    let next_input = AtomicUsize::new(0);
+    let failures: Mutex<Vec<(PathBuf, String)>> = Mutex::new(Vec::new());
+
+    thread::scope(|scope| {
+        for _ in 0..jobs {
+            scope.spawn(|| loop {
+                let input_index = next_input.fetch_add(1, Ordering::Relaxed);
+                let input = match inputs.get(input_index) {
+                    Some(input) => input,
+                    None => break,
+                };
+                let output = &outputs[input_index];
+                info!("Compiling {} to {}", input.display(), output.display());
+                // errors aren't Send, so keep their messages
+                if let Err(e) = compile_file(input, output) {
+                    error!("Compile error in {}: {e}", input.display());
+                    failures
+                        .lock()
+                        .unwrap()
+                        .push((input.to_owned(), e.to_string()));
+                }
+            });
+        }
+    });
+
+    let mut failures = failures.into_inner().unwrap();
+    if failures.is_empty() {
+        return Ok(());
+    }
+    failures.sort();
+    Err(BatchCompilationError::CompileFailures {
+        failures,
+        total: inputs.len(),
+    })
+}
+
+/// The output path of each input. The workers write their outputs at the same time, so two
+/// inputs with the same output, like a/x.c and b/x.c with an output dir, are an error.
+fn get_output_paths(
+    inputs: &[PathBuf],
+    output_dir: Option<&Path>,
+) -> Result<Vec<PathBuf>, BatchCompilationError> {
+    let mut output_inputs: HashMap<PathBuf, &PathBuf> = HashMap::new();
+    let mut outputs = Vec::new();
+    for input in inputs {
+        let output = output_path(input, output_dir);
+        if let Some(other_input) = output_inputs.insert(output.to_owned(), input) {
+            return Err(BatchCompilationError::DuplicateOutput {
+                output,
+                inputs: (other_input.to_owned(), input.to_owned()),
+            });
+        }
+        outputs.push(output);
+    }
+    Ok(outputs)
+}
+
+/// The output path for an input file in a batch: the input's name with a .wasm extension
+fn output_path(input: &Path, output_dir: Option<&Path>) -> PathBuf {
+    let output = input.with_extension("wasm");
+    match output_dir {
+        None => output,
+        Some(dir) => dir.join(output.file_name().unwrap()),
+    }
+}
+
+#[derive(Debug)]
+pub enum BatchCompilationError {
+    /// Two inputs would both be compiled to the output
+    DuplicateOutput {
+        output: PathBuf,
+        inputs: (PathBuf, PathBuf),
+    },
+    /// Each input that failed to compile, and its error message
+    CompileFailures {
+        failures: Vec<(PathBuf, String)>,
+        total: usize,
+    },
+}
+
+impl fmt::Display for BatchCompilationError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            BatchCompilationError::DuplicateOutput {
+                output,
+                inputs: (first, second),
+            } => write!(
+                f,
+                "{} and {} would both be compiled to {}",
+                first.display(),
+                second.display(),
+                output.display()
+            ),
+            BatchCompilationError::CompileFailures { failures, total } => {
+                write!(
+                    f,
+                    "{} of {} files failed to compile:",
+                    failures.len(),
+                    total
+                )?;
+                for (input, message) in failures {
+                    write!(f, "\n{}: {message}", input.display())?;
+                }
+                Ok(())
+            }
+        }
+    }
+}
+
+impl Error for BatchCompilationError {}
@@ -0,0 +1,99 @@
+#[cfg(test)]
+mod batch_compilation_tests {
+    use std::path::{Path, PathBuf};
+    use std::sync::Mutex;
+
+    use super::super::{compile_batch, output_path, BatchCompilationError};
+
+    #[test]
+    fn output_is_next_to_input_without_output_dir() {
+        assert_eq!(
+            output_path(Path::new("a/x.c"), None),
+            PathBuf::from("a/x.wasm")
+        );
+    }
+
+    #[test]
+    fn output_is_in_output_dir() {
+        assert_eq!(
+            output_path(Path::new("a/x.c"), Some(Path::new("out"))),
+            PathBuf::from("out/x.wasm")
+        );
+    }
+
+    #[test]
+    fn compiles_every_input_to_its_output() {
+        let inputs = vec![PathBuf::from("a/x.c"), PathBuf::from("b/y.c")];
+        let compiled = Mutex::new(Vec::new());
+        compile_batch(&inputs, Some(Path::new("out")), 2, |input, output| {
+            compiled
+                .lock()
+                .unwrap()
+                .push((input.to_owned(), output.to_owned()));
+            Ok(())
+        })
+        .unwrap();
+
+        let mut compiled = compiled.into_inner().unwrap();
+        compiled.sort();
+        assert_eq!(
+            compiled,
+            vec![
+                (PathBuf::from("a/x.c"), PathBuf::from("out/x.wasm")),
+                (PathBuf::from("b/y.c"), PathBuf::from("out/y.wasm")),
+            ]
+        );
+    }
+
+    #[test]
+    fn reports_every_failed_input() {
+        let inputs = vec![
+            PathBuf::from("x.c"),
+            PathBuf::from("y.c"),
+            PathBuf::from("z.c"),
+        ];
+        let result = compile_batch(&inputs, None, 2, |input, _| {
+            if input == Path::new("y.c") {
+                Ok(())
+            } else {
+                Err("failed".into())
+            }
+        });
+
+        match result {
+            Err(BatchCompilationError::CompileFailures { failures, total }) => {
+                assert_eq!(
+                    failures,
+                    vec![
+                        (PathBuf::from("x.c"), "failed".to_owned()),
+                        (PathBuf::from("z.c"), "failed".to_owned()),
+                    ]
+                );
+                assert_eq!(total, 3);
+            }
+            _ => panic!("expected compile failures"),
+        }
+    }
+
+    #[test]
+    fn inputs_with_the_same_output_are_an_error() {
+        let inputs = vec![PathBuf::from("a/x.c"), PathBuf::from("b/x.c")];
+        let compiled = Mutex::new(0);
+        let result = compile_batch(&inputs, Some(Path::new("out")), 2, |_, _| {
+            *compiled.lock().unwrap() += 1;
+            Ok(())
+        });
+
+        match result {
+            Err(BatchCompilationError::DuplicateOutput { output, inputs }) => {
+                assert_eq!(output, PathBuf::from("out/x.wasm"));
+                assert_eq!(inputs, (PathBuf::from("a/x.c"), PathBuf::from("b/x.c")));
+            }
+            _ => panic!("expected a duplicate output error"),
+        }
+        assert_eq!(*compiled.lock().unwrap(), 0);
+
+        // without an output dir they're next to their inputs, so they don't collide
+        compile_batch(&inputs, None, 2, |_, _| Ok(())).unwrap();
+    }
+}
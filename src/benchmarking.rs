@@ -0,0 +1,105 @@
+//! Each phase of the compiler on its own, for the benchmarks in benches/. None of this is
+//! used by the compiler itself.
+
+use std::error::Error;
+use std::path::Path;
+use std::thread;
+
+use clap::Parser as ClapParser;
+
+use crate::back_end::target_code_generation;
+use crate::back_end::wasm_module::module::WasmModule;
+use crate::front_end::ast::Program as AstProgram;
+use crate::front_end::lexer::Lexer;
+use crate::middle_end::ir::Program as IrProgram;
+use crate::program_config::enabled_optimisations::EnabledOptimisations;
+use crate::program_config::enabled_profiling::EnabledProfiling;
+use crate::program_config::memory_limits::MemoryLimits;
+use crate::relooper::relooper::ReloopedProgram;
+use crate::{front_end, middle_end, preprocessor, relooper, CliConfig};
+
+/// The program at the point between two phases
+pub struct Ast(AstProgram);
+pub struct Ir(IrProgram);
+pub struct Relooped(ReloopedProgram);
+pub struct Module(WasmModule);
+
+/// The compiler's default options, as if it was run with no flags
+pub struct BenchmarkConfig {
+    enabled_optimisations: EnabledOptimisations,
+    enabled_profiling: EnabledProfiling,
+    memory_limits: MemoryLimits,
+    /// A thread per CPU, like compiling a single file
+    codegen_threads: usize,
+}
+
+impl BenchmarkConfig {
+    pub fn new() -> Self {
+        let cli_config = CliConfig::parse_from(["c_to_wasm_compiler", "benchmark.c"]);
+        BenchmarkConfig {
+            enabled_optimisations: EnabledOptimisations::construct(&cli_config),
+            enabled_profiling: EnabledProfiling::construct(&cli_config),
+            memory_limits: MemoryLimits::construct(&cli_config).unwrap(),
+            codegen_threads: thread::available_parallelism().map_or(1, |n| n.get()),
+        }
+    }
+}
+
+pub fn preprocess(filepath: &Path) -> Result<String, Box<dyn Error>> {
+    Ok(preprocessor::preprocess(filepath, false)?)
+}
+
+/// Returns the number of tokens
+pub fn lex(source: &str) -> usize {
+    Lexer::new(source).count()
+}
+
+pub fn parse(source: String) -> Result<Ast, Box<dyn Error>> {
+    Ok(Ast(front_end::parser::parse(source)?))
+}
+
+pub fn convert_to_ir(ast: Ast) -> Result<Ir, Box<dyn Error>> {
+    Ok(Ir(middle_end::ast_to_ir::convert_to_ir(ast.0)?))
+}
+
+pub fn optimise_ir(ir: &mut Ir, config: &BenchmarkConfig) -> Result<(), Box<dyn Error>> {
+    middle_end::middle_end_optimiser::ir_optimiser::optimise_ir(
+        &mut ir.0,
+        &config.enabled_optimisations,
+    )?;
+    Ok(())
+}
+
+pub fn reloop(ir: Ir) -> Relooped {
+    Relooped(relooper::relooper::reloop(ir.0))
+}
+
+/// Returns the number of wasm instructions generated to set up the stack frames
+pub fn allocate_local_vars(
+    relooped: Relooped,
+    config: &BenchmarkConfig,
+) -> Result<usize, Box<dyn Error>> {
+    Ok(target_code_generation::allocate_all_local_vars(
+        relooped.0,
+        &config.enabled_optimisations,
+        &config.enabled_profiling,
+        &config.memory_limits,
+    )?)
+}
+
+pub fn generate_target_code(
+    relooped: Relooped,
+    config: &BenchmarkConfig,
+) -> Result<Module, Box<dyn Error>> {
+    Ok(Module(target_code_generation::generate_target_code(
+        relooped.0,
+        &config.enabled_optimisations,
+        &config.enabled_profiling,
+        &config.memory_limits,
+        config.codegen_threads,
+    )?))
+}
+
+pub fn to_bytes(module: &Module) -> Vec<u8> {
+    module.0.to_bytes()
+}
@@ -0,0 +1,139 @@
+#[cfg(test)]
+#[path = "compilation_cache_tests.rs"]
+mod compilation_cache_tests;
+
+use std::env;
+use std::fmt;
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+
+use lazy_static::lazy_static;
+use log::{debug, warn};
+
+use crate::program_config::enabled_optimisations::EnabledOptimisations;
+use crate::program_config::enabled_profiling::EnabledProfiling;
+use crate::program_config::memory_limits::MemoryLimits;
+use crate::program_config::profile_data::ProfileData;
+
+lazy_static! {
+    /// A hash of the compiler's own executable, so that cached modules aren't reused by a
+    /// different build of the compiler, which might generate different code
+    static ref COMPILER_HASH: u128 = match env::current_exe().and_then(fs::read) {
+        Ok(executable) => {
+            let mut hasher = Fnv128Hasher::new();
+            hasher.write(&executable);
+            hasher.finish()
+        }
+        Err(e) => {
+            warn!("Couldn't read the compiler executable to hash it: {e}");
+            0
+        }
+    };
+}
+
+/// The key of a compiled module in the cache. This is a hash of everything the module
+/// depends on: the preprocessed source, the enabled optimisations and profiling, the memory
+/// limits, the profile being optimised for, and the compiler itself.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct CacheKey(u128);
+
+impl CacheKey {
+    pub fn new(
+        preprocessed_source: &str,
+        enabled_optimisations: &EnabledOptimisations,
+        enabled_profiling: &EnabledProfiling,
+        memory_limits: &MemoryLimits,
+        profile: Option<&ProfileData>,
+    ) -> Self {
+        let mut hasher = Fnv128Hasher::new();
+        hasher.write(&COMPILER_HASH.to_le_bytes());
+        hasher.write(env!("CARGO_PKG_VERSION").as_bytes());
+        // the config is hashed by its debug representation, which lists every flag
+        hasher.write(format!("{enabled_optimisations:?}").as_bytes());
+        hasher.write(format!("{enabled_profiling:?}").as_bytes());
+        hasher.write(format!("{memory_limits:?}").as_bytes());
+        // the profile's counts are in sorted maps, so its debug representation is stable
+        hasher.write(format!("{profile:?}").as_bytes());
+        hasher.write(preprocessed_source.as_bytes());
+        CacheKey(hasher.finish())
+    }
+}
+
+impl fmt::Display for CacheKey {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "{:032x}", self.0)
+    }
+}
+
+/// An on-disk cache of compiled wasm modules, addressed by the hash of what they were
+/// compiled from. Entries are never invalidated, since a changed input has a different key.
+pub struct CompilationCache {
+    dir: PathBuf,
+}
+
+impl CompilationCache {
+    pub fn new(dir: &Path) -> io::Result<Self> {
+        fs::create_dir_all(dir)?;
+        Ok(CompilationCache {
+            dir: dir.to_owned(),
+        })
+    }
+
+    fn entry_path(&self, key: &CacheKey) -> PathBuf {
+        self.dir.join(format!("{key}.wasm"))
+    }
+
+    /// Get the cached module for the key, if there is one
+    pub fn get(&self, key: &CacheKey) -> Option<Vec<u8>> {
+        match fs::read(self.entry_path(key)) {
+            Ok(bytes) => {
+                debug!("Compilation cache hit: {key}");
+                Some(bytes)
+            }
+            Err(_) => {
+                debug!("Compilation cache miss: {key}");
+                None
+            }
+        }
+    }
+
+    pub fn insert(&self, key: &CacheKey, module: &[u8]) -> io::Result<()> {
+        // write to a temporary file and rename it into place, so that other processes
+        // using the same cache never see a partly written entry
+        let temp_path = self.dir.join(format!("{key}.{}.tmp", std::process::id()));
+        fs::write(&temp_path, module)?;
+        fs::rename(&temp_path, self.entry_path(key))
+    }
+}
+
+/// The 128-bit FNV-1a hash, which unlike the standard library's hashers is guaranteed to give
+/// the same result across compiler versions and runs, so it can be used for on-disk keys
+struct Fnv128Hasher {
+    state: u128,
+}
+
+impl Fnv128Hasher {
+    const OFFSET_BASIS: u128 = 0x6c62272e07bb014262b821756295c58d;
+    const PRIME: u128 = 0x0000000001000000000000000000013b;
+
+    fn new() -> Self {
+        Fnv128Hasher {
+            state: Self::OFFSET_BASIS,
+        }
+    }
+
+    fn write(&mut self, bytes: &[u8]) {
+        for byte in bytes {
+            self.state ^= *byte as u128;
+            self.state = self.state.wrapping_mul(Self::PRIME);
+        }
+        // separate consecutive writes, so that moving bytes between them changes the hash
+        self.state ^= bytes.len() as u128;
+        self.state = self.state.wrapping_mul(Self::PRIME);
+    }
+
+    fn finish(&self) -> u128 {
+        self.state
+    }
+}
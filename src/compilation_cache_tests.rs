@@ -0,0 +1,38 @@
+#[cfg(test)]
+mod compilation_cache_tests {
+    use std::env;
+    use std::fs;
+
+    use super::super::{CacheKey, CompilationCache, Fnv128Hasher};
+
+    #[test]
+    fn fnv_hash_matches_reference_value() {
+        // FNV-1a 128 of "a", before the length separator
+        let mut state = Fnv128Hasher::OFFSET_BASIS;
+        state ^= b'a' as u128;
+        state = state.wrapping_mul(Fnv128Hasher::PRIME);
+        assert_eq!(state, 0xd228cb696f1a8caf78912b704e4a8964);
+
+        let mut hasher = Fnv128Hasher::new();
+        hasher.write(b"ab");
+        let mut split_hasher = Fnv128Hasher::new();
+        split_hasher.write(b"a");
+        split_hasher.write(b"b");
+        assert_ne!(hasher.finish(), split_hasher.finish());
+    }
+
+    #[test]
+    fn stores_and_retrieves_modules() {
+        let dir = env::temp_dir().join(format!("compilation_cache_test_{}", std::process::id()));
+        let cache = CompilationCache::new(&dir).unwrap();
+        let key = CacheKey(1234);
+        let other_key = CacheKey(5678);
+
+        assert_eq!(cache.get(&key), None);
+        cache.insert(&key, &[0x00, 0x61, 0x73, 0x6d]).unwrap();
+        assert_eq!(cache.get(&key), Some(vec![0x00, 0x61, 0x73, 0x6d]));
+        assert_eq!(cache.get(&other_key), None);
+
+        fs::remove_dir_all(&dir).unwrap();
+    }
+}
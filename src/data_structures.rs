@@ -1 +1,3 @@
+pub mod bit_set;
+pub mod id_map;
 pub mod interval_tree;
@@ -0,0 +1,71 @@
+const WORD_BITS: usize = u64::BITS as usize;
+
+/// A fixed size set of small integers, stored as one bit per possible element
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct BitSet {
+    words: Vec<u64>,
+}
+
+impl BitSet {
+    /// An empty set that can hold the elements 0..capacity
+    pub fn new(capacity: usize) -> Self {
+        BitSet {
+            words: vec![0; (capacity + WORD_BITS - 1) / WORD_BITS],
+        }
+    }
+
+    pub fn insert(&mut self, i: usize) {
+        self.words[i / WORD_BITS] |= 1 << (i % WORD_BITS);
+    }
+
+    pub fn remove(&mut self, i: usize) {
+        self.words[i / WORD_BITS] &= !(1 << (i % WORD_BITS));
+    }
+
+    pub fn contains(&self, i: usize) -> bool {
+        match self.words.get(i / WORD_BITS) {
+            Some(word) => word & (1 << (i % WORD_BITS)) != 0,
+            None => false,
+        }
+    }
+
+    /// Add all the elements of the other set. Returns whether any new elements were added.
+    pub fn union_with(&mut self, other: &BitSet) -> bool {
+        let mut changed = false;
+        for (word, other_word) in self.words.iter_mut().zip(&other.words) {
+            let new_word = *word | other_word;
+            changed |= new_word != *word;
+            *word = new_word;
+        }
+        changed
+    }
+
+    /// Remove all the elements of the other set
+    pub fn subtract(&mut self, other: &BitSet) {
+        for (word, other_word) in self.words.iter_mut().zip(&other.words) {
+            *word &= !other_word;
+        }
+    }
+
+    pub fn len(&self) -> usize {
+        self.words
+            .iter()
+            .map(|word| word.count_ones() as usize)
+            .sum()
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = usize> + '_ {
+        self.words.iter().enumerate().flat_map(|(word_i, word)| {
+            let mut word = *word;
+            std::iter::from_fn(move || {
+                if word == 0 {
+                    return None;
+                }
+                let bit_i = word.trailing_zeros() as usize;
+                // clear the lowest set bit
+                word &= word - 1;
+                Some(word_i * WORD_BITS + bit_i)
+            })
+        })
+    }
+}
@@ -0,0 +1,183 @@
+#[cfg(test)]
+#[path = "id_map_tests.rs"]
+mod id_map_tests;
+
+use std::fmt;
+use std::fmt::Formatter;
+
+use crate::id::Id;
+
+/// A map keyed by ids, stored as a vector indexed by the ids' numbers, so lookups don't need
+/// any hashing. Ids are handed out in order by an IdGenerator, so the ids used in a map are
+/// usually close together. The vector only covers the range from the smallest id in the map
+/// to the largest one.
+#[derive(Clone)]
+pub struct IdMap<K: Id + Clone, V> {
+    /// The number of the id stored at index 0
+    first_id: u64,
+    entries: Vec<Option<(K, V)>>,
+    len: usize,
+}
+
+impl<K: Id + Clone, V> IdMap<K, V> {
+    pub fn new() -> Self {
+        IdMap {
+            first_id: 0,
+            entries: Vec::new(),
+            len: 0,
+        }
+    }
+
+    fn index_of(&self, key: &K) -> Option<usize> {
+        let id = key.as_u64();
+        if id < self.first_id {
+            return None;
+        }
+        let index = (id - self.first_id) as usize;
+        if index < self.entries.len() {
+            Some(index)
+        } else {
+            None
+        }
+    }
+
+    /// Insert a value, returning the value that was there before
+    pub fn insert(&mut self, key: K, value: V) -> Option<V> {
+        let id = key.as_u64();
+        if self.entries.is_empty() {
+            self.first_id = id;
+        } else if id < self.first_id {
+            // grow the vector downwards to fit the new id
+            let extra = (self.first_id - id) as usize;
+            self.entries.splice(0..0, (0..extra).map(|_| None));
+            self.first_id = id;
+        }
+        let index = (id - self.first_id) as usize;
+        if index >= self.entries.len() {
+            self.entries.resize_with(index + 1, || None);
+        }
+        let old = self.entries[index].replace((key, value));
+        match old {
+            Some((_, old_value)) => Some(old_value),
+            None => {
+                self.len += 1;
+                None
+            }
+        }
+    }
+
+    pub fn get(&self, key: &K) -> Option<&V> {
+        let index = self.index_of(key)?;
+        self.entries[index].as_ref().map(|(_, value)| value)
+    }
+
+    pub fn get_mut(&mut self, key: &K) -> Option<&mut V> {
+        let index = self.index_of(key)?;
+        self.entries[index].as_mut().map(|(_, value)| value)
+    }
+
+    /// Get the value for the key, inserting the result of make_value if there isn't one yet
+    pub fn get_or_insert_with(&mut self, key: K, make_value: impl FnOnce() -> V) -> &mut V {
+        if self.get(&key).is_none() {
+            self.insert(key.to_owned(), make_value());
+        }
+        self.get_mut(&key).unwrap()
+    }
+
+    pub fn contains_key(&self, key: &K) -> bool {
+        self.get(key).is_some()
+    }
+
+    pub fn remove(&mut self, key: &K) -> Option<V> {
+        let index = self.index_of(key)?;
+        let (_, value) = self.entries[index].take()?;
+        self.len -= 1;
+        Some(value)
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Iterate over the entries in order of their ids
+    pub fn iter(&self) -> Iter<'_, K, V> {
+        Iter {
+            entries: self.entries.iter(),
+        }
+    }
+
+    pub fn keys(&self) -> impl Iterator<Item = &K> {
+        self.iter().map(|(key, _)| key)
+    }
+
+    pub fn values(&self) -> impl Iterator<Item = &V> {
+        self.iter().map(|(_, value)| value)
+    }
+}
+
+pub struct Iter<'a, K, V> {
+    entries: std::slice::Iter<'a, Option<(K, V)>>,
+}
+
+impl<'a, K, V> Iterator for Iter<'a, K, V> {
+    type Item = (&'a K, &'a V);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        for entry in self.entries.by_ref() {
+            if let Some((key, value)) = entry {
+                return Some((key, value));
+            }
+        }
+        None
+    }
+}
+
+impl<'a, K: Id + Clone, V> IntoIterator for &'a IdMap<K, V> {
+    type Item = (&'a K, &'a V);
+    type IntoIter = Iter<'a, K, V>;
+
+    fn into_iter(self) -> Self::IntoIter {
+        self.iter()
+    }
+}
+
+impl<K: Id + Clone, V> Default for IdMap<K, V> {
+    fn default() -> Self {
+        IdMap::new()
+    }
+}
+
+impl<K: Id + Clone, V> FromIterator<(K, V)> for IdMap<K, V> {
+    fn from_iter<I: IntoIterator<Item = (K, V)>>(iter: I) -> Self {
+        let mut map = IdMap::new();
+        map.extend(iter);
+        map
+    }
+}
+
+impl<K: Id + Clone, V> Extend<(K, V)> for IdMap<K, V> {
+    fn extend<I: IntoIterator<Item = (K, V)>>(&mut self, iter: I) {
+        for (key, value) in iter {
+            self.insert(key, value);
+        }
+    }
+}
+
+impl<K: Id + Clone, V> IntoIterator for IdMap<K, V> {
+    type Item = (K, V);
+    type IntoIter = std::iter::Flatten<std::vec::IntoIter<Option<(K, V)>>>;
+
+    fn into_iter(self) -> Self::IntoIter {
+        self.entries.into_iter().flatten()
+    }
+}
+
+impl<K: Id + Clone + fmt::Debug, V: fmt::Debug> fmt::Debug for IdMap<K, V> {
+    fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
+        f.debug_map().entries(self.iter()).finish()
+    }
+}
@@ -0,0 +1,56 @@
+#[cfg(test)]
+mod id_map_tests {
+    use super::super::IdMap;
+    use crate::id::IdGenerator;
+    use crate::middle_end::ids::LabelId;
+
+    fn make_ids(count: usize) -> Vec<LabelId> {
+        let mut id_generator = IdGenerator::<LabelId>::new();
+        (0..count).map(|_| id_generator.new_id()).collect()
+    }
+
+    #[test]
+    fn inserts_and_removes_values() {
+        let ids = make_ids(10);
+        let mut map = IdMap::new();
+        assert_eq!(map.insert(ids[5].to_owned(), "five"), None);
+        assert_eq!(map.insert(ids[7].to_owned(), "seven"), None);
+        assert_eq!(map.insert(ids[5].to_owned(), "FIVE"), Some("five"));
+        assert_eq!(map.len(), 2);
+
+        assert_eq!(map.get(&ids[5]), Some(&"FIVE"));
+        assert_eq!(map.get(&ids[6]), None);
+        assert_eq!(map.get(&ids[9]), None);
+        assert!(!map.contains_key(&ids[0]));
+
+        assert_eq!(map.remove(&ids[7]), Some("seven"));
+        assert_eq!(map.remove(&ids[7]), None);
+        assert_eq!(map.len(), 1);
+    }
+
+    #[test]
+    fn grows_below_the_first_id() {
+        let ids = make_ids(10);
+        let mut map = IdMap::new();
+        map.insert(ids[8].to_owned(), 8);
+        map.insert(ids[3].to_owned(), 3);
+        map.insert(ids[5].to_owned(), 5);
+
+        assert_eq!(map.get(&ids[8]), Some(&8));
+        assert_eq!(map.get(&ids[3]), Some(&3));
+        assert_eq!(map.get(&ids[2]), None);
+        // iterates in id order
+        assert_eq!(map.values().copied().collect::<Vec<_>>(), vec![3, 5, 8]);
+    }
+
+    #[test]
+    fn gets_or_inserts_values() {
+        let ids = make_ids(3);
+        let mut map: IdMap<LabelId, Vec<u32>> = IdMap::new();
+        map.get_or_insert_with(ids[1].to_owned(), Vec::new).push(1);
+        map.get_or_insert_with(ids[1].to_owned(), Vec::new).push(2);
+
+        assert_eq!(map.get(&ids[1]), Some(&vec![1, 2]));
+        assert_eq!(map.len(), 1);
+    }
+}
@@ -1,18 +1,25 @@
-use std::collections::{HashMap, HashSet};
+#[cfg(test)]
+#[path = "interval_tree_tests.rs"]
+mod interval_tree_tests;
+
+use std::cmp::{max, Ordering};
 use std::fmt;
 use std::fmt::Formatter;
 
-use crate::fmt_indented::{FmtIndented, IndentLevel};
+use crate::fmt_indented::IndentLevel;
 
 type IntervalBound = u32;
 
+/// Index of a node in the tree's arena
+type NodeIdx = usize;
+
 /// Data stored in an interval tree should be 'mergeable'. If we try to insert data
 /// with an interval that already exists in the tree, the data will be merged
 pub trait Mergeable {
     fn merge(&mut self, other: Self);
 }
 
-#[derive(Clone, PartialEq, Eq, Hash)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub struct Interval {
     pub start: IntervalBound,
     pub end: IntervalBound,
@@ -22,124 +29,141 @@ impl Interval {
     fn overlaps(&self, other: &Interval) -> bool {
         self.start <= other.end && other.start <= self.end
     }
+
+    /// Intervals are ordered by start, then by end, so that every interval in the tree has a
+    /// distinct key
+    fn cmp_key(&self, other: &Interval) -> Ordering {
+        (self.start, self.end).cmp(&(other.start, other.end))
+    }
 }
 
+/// An AVL tree of intervals, where each node also stores the greatest end of any interval in
+/// its subtree. That lets a search skip subtrees that end before the interval it's looking
+/// for. The nodes are stored in a Vec, and refer to their children by index.
 pub struct IntervalTree<T: Mergeable> {
-    root: *mut Node<T>,
+    nodes: Vec<Node<T>>,
+    root: Option<NodeIdx>,
 }
 
 struct Node<T: Mergeable> {
-    // Null pointer = child is a leaf
-    left: *mut Node<T>,
-    right: *mut Node<T>,
-    parent: *mut Node<T>,
-    colour: NodeColour,
+    left: Option<NodeIdx>,
+    right: Option<NodeIdx>,
+    height: u32,
     interval: Interval,
     max: IntervalBound,
     data: T,
 }
 
-#[derive(Clone, PartialEq)]
-enum NodeColour {
-    Red,
-    Black,
-}
-
-impl<T: Mergeable> Node<T> {
-    fn new(colour: NodeColour, interval: Interval, max: u32, data: T) -> *mut Self {
-        Box::into_raw(Box::new(Self {
-            colour,
-            interval,
-            max,
-            data,
-            left: std::ptr::null_mut(),
-            right: std::ptr::null_mut(),
-            parent: std::ptr::null_mut(),
-        }))
-    }
-
-    fn key(&self) -> IntervalBound {
-        self.interval.start
-    }
-
-    /// Locally update the max value of this node
-    fn update_max(&mut self) {
-        self.max = self.interval.end;
-        unsafe {
-            if !self.left.is_null() {
-                self.max = std::cmp::max(self.max, (*self.left).max);
-            }
-            if !self.right.is_null() {
-                self.max = std::cmp::max(self.max, (*self.right).max);
-            }
-        }
-    }
-
-    fn merge_data(&mut self, data: T) {
-        self.data.merge(data);
-    }
-}
-
 impl<T: Mergeable> IntervalTree<T> {
     pub fn new() -> Self {
         Self {
-            root: std::ptr::null_mut(),
+            nodes: Vec::new(),
+            root: None,
         }
     }
 
     /// Insert data to the given interval in the tree. If the interval isn't in the tree, a new
     /// node is created. If the interval already exists, data is merged to the existing node.
     pub fn insert_or_merge(&mut self, interval: Interval, data: T) {
-        let mut y = std::ptr::null_mut();
+        // walk down the tree to find where the interval goes, recording the path so
+        // that each node on it can be rebalanced on the way back up
+        let mut path: Vec<(NodeIdx, Ordering)> = Vec::new();
         let mut x = self.root;
-
-        unsafe {
-            // walk down the tree until we get to a leaf, or we find a matching node
-            while !x.is_null() {
-                y = x;
-
-                if interval == (*x).interval {
-                    // merge new node with x
-                    (*x).merge_data(data);
+        while let Some(node_idx) = x {
+            let node = &self.nodes[node_idx];
+            match interval.cmp_key(&node.interval) {
+                Ordering::Equal => {
+                    self.nodes[node_idx].data.merge(data);
                     return;
                 }
-
-                // smaller keys or equal to the left, bigger keys to the right
-                if interval.start <= (*x).key() {
-                    x = (*x).left;
-                } else {
-                    x = (*x).right;
+                Ordering::Less => {
+                    path.push((node_idx, Ordering::Less));
+                    x = node.left;
+                }
+                Ordering::Greater => {
+                    path.push((node_idx, Ordering::Greater));
+                    x = node.right;
                 }
             }
+        }
+
+        let mut subtree = self.new_node(interval, data);
+        while let Some((node_idx, ordering)) = path.pop() {
+            match ordering {
+                Ordering::Less => self.nodes[node_idx].left = Some(subtree),
+                _ => self.nodes[node_idx].right = Some(subtree),
+            }
+            subtree = self.rebalance(node_idx);
+        }
+        self.root = Some(subtree);
+    }
 
-            let new_node = Node::new(NodeColour::Red, interval.to_owned(), interval.end, data);
+    /// All the intervals in the tree that overlap the given interval, with their data,
+    /// in order of start
+    pub fn find_overlaps(&self, interval: &Interval) -> Overlaps<'_, T> {
+        let mut overlaps = Overlaps {
+            tree: self,
+            interval: interval.to_owned(),
+            stack: Vec::new(),
+        };
+        overlaps.push_left_spine(self.root);
+        overlaps
+    }
 
-            // replace the leaf with the new node
-            (*new_node).parent = y;
+    fn new_node(&mut self, interval: Interval, data: T) -> NodeIdx {
+        self.nodes.push(Node {
+            left: None,
+            right: None,
+            height: 1,
+            interval,
+            max: interval.end,
+            data,
+        });
+        self.nodes.len() - 1
+    }
 
-            // check if the tree is empty (we didn't walk down it), and so
-            // set the new node as the root
-            // otherwise set the new node as the correct left/right child depending on its key
-            if y.is_null() {
-                self.root = new_node;
-            } else if (*new_node).key() <= (*y).key() {
-                (*y).left = new_node;
-            } else {
-                (*y).right = new_node;
-            }
+    fn height(&self, node: Option<NodeIdx>) -> u32 {
+        node.map(|node_idx| self.nodes[node_idx].height)
+            .unwrap_or(0)
+    }
 
-            self.insert_fixup(new_node);
-            self.insert_update_max(new_node);
+    /// Locally update the height and max value of this node from its children
+    fn update(&mut self, node_idx: NodeIdx) {
+        let left = self.nodes[node_idx].left;
+        let right = self.nodes[node_idx].right;
+        let mut node_max = self.nodes[node_idx].interval.end;
+        for child_idx in [left, right].into_iter().flatten() {
+            node_max = max(node_max, self.nodes[child_idx].max);
         }
+        self.nodes[node_idx].max = node_max;
+        self.nodes[node_idx].height = 1 + max(self.height(left), self.height(right));
     }
 
-    pub fn find_overlaps(&self, interval: &Interval) -> HashMap<&Interval, &T> {
-        let overlapping_nodes = self.find_overlapping_nodes_from(self.root, interval);
+    fn balance_factor(&self, node_idx: NodeIdx) -> i64 {
+        let node = &self.nodes[node_idx];
+        self.height(node.left) as i64 - self.height(node.right) as i64
+    }
 
-        overlapping_nodes
-            .iter()
-            .map(|&node| unsafe { (&(*node).interval, &(*node).data) })
-            .collect()
+    /// Restore the AVL invariant at a node whose subtrees differ in height by at most two.
+    /// Returns the node at the top of the rebalanced subtree.
+    fn rebalance(&mut self, node_idx: NodeIdx) -> NodeIdx {
+        self.update(node_idx);
+        let balance = self.balance_factor(node_idx);
+        if balance > 1 {
+            let left = self.nodes[node_idx].left.unwrap();
+            if self.balance_factor(left) < 0 {
+                self.nodes[node_idx].left = Some(self.left_rotate(left));
+            }
+            self.right_rotate(node_idx)
+        } else if balance < -1 {
+            let right = self.nodes[node_idx].right.unwrap();
+            if self.balance_factor(right) > 0 {
+                self.nodes[node_idx].right = Some(self.right_rotate(right));
+            }
+            self.left_rotate(node_idx)
+        } else {
+            node_idx
+        }
     }
 
     /// ```plaintext
@@ -150,48 +174,16 @@ impl<T: Mergeable> IntervalTree<T> {
     ///       b   c        a   b
     /// ```
     ///
-    /// Returns true if the rotation was completed successfully
-    fn left_rotate(&mut self, x: *mut Node<T>) -> bool {
-        unsafe {
-            // can't left-rotate if no right child
-            if (*x).right.is_null() {
-                return false;
-            }
-
-            // get X's right subtree
-            let y = (*x).right;
-
-            // make Y's left subtree into X's right subtree
-            (*x).right = (*y).left;
-            // point X's new right subtree upwards to X
-            if !(*x).right.is_null() {
-                (*(*x).right).parent = x;
-            }
-
-            // point Y upwards to X's parent
-            (*y).parent = (*x).parent;
-
-            // attach Y as the correct child of X's parent
-            if (*x).parent.is_null() {
-                self.root = y;
-            } else if x == (*(*x).parent).left {
-                (*(*x).parent).left = y;
-            } else {
-                (*(*x).parent).right = y;
-            }
-
-            // put X as Y's left subtree
-            (*y).left = x;
-            // point X upwards to Y
-            (*x).parent = y;
-
-            // update max values
-            // Y is now at the top of this subtree, so it's max will be X.max
-            (*y).max = (*x).max;
-            // X.max = MAX(X.left.max, X.right.max, X.max)
-            (*x).update_max();
-        }
-        true
+    /// Returns Y, the new top of the subtree
+    fn left_rotate(&mut self, x: NodeIdx) -> NodeIdx {
+        let y = self.nodes[x]
+            .right
+            .expect("Only left-rotate nodes with a right child");
+        self.nodes[x].right = self.nodes[y].left;
+        self.nodes[y].left = Some(x);
+        self.update(x);
+        self.update(y);
+        y
     }
 
     /// ```plaintext
@@ -202,169 +194,78 @@ impl<T: Mergeable> IntervalTree<T> {
     ///   a   b                b   c
     /// ```
     ///
-    /// Returns true if the rotation was completed successfully
-    fn right_rotate(&mut self, x: *mut Node<T>) {
-        unsafe {
-            // can't right-rotate if no left child
-            if (*x).left.is_null() {
-                return;
-            }
-
-            // get X's left subtree
-            let y = (*x).left;
-
-            // make Y's right subtree into X's left subtree
-            (*x).left = (*y).right;
-            // point X's new left subtree upwards to X
-            if !(*x).left.is_null() {
-                (*(*x).left).parent = x;
-            }
-
-            // point Y upwards to X's parent
-            (*y).parent = (*x).parent;
-
-            // attach Y as the correct child of X's parent
-            if (*x).parent.is_null() {
-                self.root = y;
-            } else if x == (*(*x).parent).left {
-                (*(*x).parent).left = y;
-            } else {
-                (*(*x).parent).right = y;
-            }
-
-            // put X as Y's right subtree
-            (*y).right = x;
-            // point X upwards to Y
-            (*x).parent = y;
-
-            // update max values
-            // Y is now at the top of this subtree, so it's max will be X.max
-            (*y).max = (*x).max;
-            // X.max = MAX(X.left.max, X.right.max, X.max)
-            (*x).update_max();
-        }
+    /// Returns Y, the new top of the subtree
+    fn right_rotate(&mut self, x: NodeIdx) -> NodeIdx {
+        let y = self.nodes[x]
+            .left
+            .expect("Only right-rotate nodes with a left child");
+        self.nodes[x].left = self.nodes[y].right;
+        self.nodes[y].right = Some(x);
+        self.update(x);
+        self.update(y);
+        y
     }
 
-    /// After inserting a new node, maintain the red-black tree invariants
-    fn insert_fixup(&mut self, mut node: *mut Node<T>) {
-        unsafe {
-            // the node we've inserted is red, so if parent is also red we need to fixup
-            while !(*node).parent.is_null() && (*(*node).parent).colour == NodeColour::Red {
-                // if parent is a left child
-                // (we've just checked that node.parent is red, therefore node.parent.parent must exist,
-                // cos the root node is always black
-                if (*node).parent == (*(*(*node).parent).parent).left {
-                    let y = (*(*(*node).parent).parent).right;
-                    if !y.is_null() && (*y).colour == NodeColour::Red {
-                        (*(*node).parent).colour = NodeColour::Black;
-                        (*y).colour = NodeColour::Black;
-                        (*(*(*node).parent).parent).colour = NodeColour::Red;
-                        node = (*(*node).parent).parent;
-                    } else {
-                        //      o            o
-                        //     /            /
-                        //    o     =>     o
-                        //     \          /
-                        //      o        o
-                        if node == (*(*node).parent).right {
-                            node = (*node).parent;
-                            self.left_rotate(node);
-                        }
-                        (*(*node).parent).colour = NodeColour::Black;
-                        (*(*(*node).parent).parent).colour = NodeColour::Red;
-                        self.right_rotate((*(*node).parent).parent);
-                    }
-                } else {
-                    // symmetric for if parent is a right child
-                    let y = (*(*(*node).parent).parent).left;
-                    if !y.is_null() && (*y).colour == NodeColour::Red {
-                        (*(*node).parent).colour = NodeColour::Black;
-                        (*y).colour = NodeColour::Black;
-                        (*(*(*node).parent).parent).colour = NodeColour::Red;
-                        node = (*(*node).parent).parent;
-                    } else {
-                        //    o          o
-                        //     \          \
-                        //      o   =>     o
-                        //     /            \
-                        //    o              o
-                        if node == (*(*node).parent).left {
-                            node = (*node).parent;
-                            self.right_rotate(node);
-                        }
-                        (*(*node).parent).colour = NodeColour::Black;
-                        (*(*(*node).parent).parent).colour = NodeColour::Red;
-                        self.left_rotate((*(*node).parent).parent);
-                    }
-                }
-            }
-            // the root should always be black
-            (*self.root).colour = NodeColour::Black;
-        }
-    }
-
-    /// Bubble up the new max value through the tree
-    fn insert_update_max(&mut self, mut node: *mut Node<T>) {
-        unsafe {
-            // while parent has a lower max than the node we inserted, update
-            // the parent's max
-            while !(*node).parent.is_null() && (*(*node).parent).max < (*node).max {
-                (*(*node).parent).max = (*node).max;
-                node = (*node).parent;
-            }
-        }
-    }
-
-    fn find_overlapping_nodes_from(
+    fn fmt_node(
         &self,
-        node: *mut Node<T>,
-        interval: &Interval,
-    ) -> HashSet<*mut Node<T>> {
-        let mut results = HashSet::new();
-
-        if node.is_null() {
-            return results;
-        }
-
-        unsafe {
-            if (*node).interval.overlaps(interval) {
-                results.insert(node);
-            }
-            // if (*node).left.is_null() || (*(*node).left).max < interval.start {
-            // no interval in the left subtree can overlap the search interval
-            // results.extend(self.find_overlapping_nodes_from((*node).right, interval));
-            // } else {
-            // otherwise there could be overlapping nodes in both subtrees
-
-            // with the current implementation, cos keys can be duplicate, the BST property can
-            // be violated by rotations, so we need to search the whole tree
-            results.extend(self.find_overlapping_nodes_from((*node).left, interval));
-            results.extend(self.find_overlapping_nodes_from((*node).right, interval));
-            // }
-        }
-
-        results
+        node: Option<NodeIdx>,
+        f: &mut Formatter<'_>,
+        indent_level: &mut IndentLevel,
+    ) -> fmt::Result {
+        indent_level.write(f)?;
+        let node = match node {
+            Some(node_idx) => &self.nodes[node_idx],
+            None => return writeln!(f, "NULL"),
+        };
+        writeln!(f, "{} (max = {})", node.interval, node.max)?;
+        indent_level.increment_marked();
+        self.fmt_node(node.left, f, indent_level)?;
+        self.fmt_node(node.right, f, indent_level)?;
+        indent_level.decrement();
+        Ok(())
     }
+}
 
-    /// Deallocate all the nodes from the given node downwards
-    fn deallocate_from(&mut self, node: *mut Node<T>) {
-        if node.is_null() {
-            return;
-        }
-        unsafe {
-            // deallocate both children before we can deallocate the node itself
-            self.deallocate_from((*node).left);
-            self.deallocate_from((*node).right);
+/// An in-order walk of the tree that only visits the subtrees that could contain an overlap
+pub struct Overlaps<'a, T: Mergeable> {
+    tree: &'a IntervalTree<T>,
+    interval: Interval,
+    // nodes whose left subtree has been visited, but not the node itself or its right subtree
+    stack: Vec<NodeIdx>,
+}
 
-            // cos the box now owns node, node will be deallocated
-            drop(Box::from_raw(node));
+impl<'a, T: Mergeable> Overlaps<'a, T> {
+    fn push_left_spine(&mut self, mut node: Option<NodeIdx>) {
+        while let Some(node_idx) = node {
+            let tree_node = &self.tree.nodes[node_idx];
+            // every interval in this subtree ends before the one we're looking for
+            if tree_node.max < self.interval.start {
+                return;
+            }
+            self.stack.push(node_idx);
+            node = tree_node.left;
         }
     }
 }
 
-impl<T: Mergeable> Drop for IntervalTree<T> {
-    fn drop(&mut self) {
-        self.deallocate_from(self.root);
+impl<'a, T: Mergeable> Iterator for Overlaps<'a, T> {
+    type Item = (&'a Interval, &'a T);
+
+    fn next(&mut self) -> Option<Self::Item> {
+        while let Some(node_idx) = self.stack.pop() {
+            let tree = self.tree;
+            let node = &tree.nodes[node_idx];
+            // this node and everything to the right of it start after the interval ends
+            if node.interval.start > self.interval.end {
+                self.stack.clear();
+                return None;
+            }
+            self.push_left_spine(node.right);
+            if node.interval.overlaps(&self.interval) {
+                return Some((&node.interval, &node.data));
+            }
+        }
+        None
     }
 }
 
@@ -374,38 +275,11 @@ impl fmt::Display for Interval {
     }
 }
 
-impl<T: Mergeable> FmtIndented for Node<T> {
-    fn fmt_indented(&self, f: &mut Formatter<'_>, indent_level: &mut IndentLevel) -> fmt::Result {
-        indent_level.write(f)?;
-        writeln!(f, "{} (max = {})", self.interval, self.max)?;
-        indent_level.increment_marked();
-        unsafe {
-            if !self.left.is_null() {
-                (*self.left).fmt_indented(f, indent_level)?;
-            } else {
-                indent_level.write(f)?;
-                writeln!(f, "NULL")?;
-            }
-            if !self.right.is_null() {
-                (*self.right).fmt_indented(f, indent_level)?;
-            } else {
-                indent_level.write(f)?;
-                writeln!(f, "NULL")?;
-            }
-        }
-        indent_level.decrement();
-        Ok(())
-    }
-}
-
 impl<T: Mergeable> fmt::Display for IntervalTree<T> {
     fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
-        unsafe {
-            if !self.root.is_null() {
-                (*self.root).fmt_indented(f, &mut IndentLevel::zero())
-            } else {
-                write!(f, "NULL")
-            }
+        match self.root {
+            Some(_) => self.fmt_node(self.root, f, &mut IndentLevel::zero()),
+            None => write!(f, "NULL"),
         }
     }
 }
@@ -0,0 +1,66 @@
+#[cfg(test)]
+mod interval_tree_tests {
+    use super::super::{Interval, IntervalTree, Mergeable};
+
+    impl Mergeable for Vec<u32> {
+        fn merge(&mut self, other: Self) {
+            self.extend(other);
+        }
+    }
+
+    fn interval(start: u32, end: u32) -> Interval {
+        Interval { start, end }
+    }
+
+    fn find_overlaps(tree: &IntervalTree<Vec<u32>>, start: u32, end: u32) -> Vec<(u32, u32)> {
+        tree.find_overlaps(&interval(start, end))
+            .map(|(interval, _)| (interval.start, interval.end))
+            .collect()
+    }
+
+    #[test]
+    fn finds_overlapping_intervals() {
+        let mut tree = IntervalTree::new();
+        tree.insert_or_merge(interval(0, 3), vec![0]);
+        tree.insert_or_merge(interval(4, 7), vec![1]);
+        tree.insert_or_merge(interval(2, 5), vec![2]);
+        tree.insert_or_merge(interval(10, 10), vec![3]);
+
+        assert_eq!(find_overlaps(&tree, 3, 4), vec![(0, 3), (2, 5), (4, 7)]);
+        assert_eq!(find_overlaps(&tree, 6, 9), vec![(4, 7)]);
+        assert_eq!(find_overlaps(&tree, 8, 9), vec![]);
+        assert_eq!(find_overlaps(&tree, 10, 20), vec![(10, 10)]);
+    }
+
+    #[test]
+    fn merges_data_of_equal_intervals() {
+        let mut tree = IntervalTree::new();
+        tree.insert_or_merge(interval(0, 3), vec![0]);
+        tree.insert_or_merge(interval(0, 7), vec![1]);
+        tree.insert_or_merge(interval(0, 3), vec![2]);
+
+        let overlaps: Vec<(Interval, Vec<u32>)> = tree
+            .find_overlaps(&interval(0, 0))
+            .map(|(interval, data)| (interval.to_owned(), data.to_owned()))
+            .collect();
+        assert_eq!(
+            overlaps,
+            vec![(interval(0, 3), vec![0, 2]), (interval(0, 7), vec![1])]
+        );
+    }
+
+    #[test]
+    fn stays_balanced_for_ascending_inserts() {
+        let mut tree = IntervalTree::new();
+        for i in 0..1000 {
+            tree.insert_or_merge(interval(i * 4, i * 4 + 3), vec![i]);
+        }
+
+        // an AVL tree with 1000 nodes is at most 1.44 * log2(1000) high
+        assert!(tree.height(tree.root) <= 14);
+        assert_eq!(
+            find_overlaps(&tree, 2001, 2004),
+            vec![(2000, 2003), (2004, 2007)]
+        );
+    }
+}
@@ -1,4 +1,4 @@
 pub mod ast;
 mod interpret_string;
-mod lexer;
+pub mod lexer;
 pub mod parser;
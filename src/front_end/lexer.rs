@@ -1,6 +1,7 @@
+use std::collections::HashSet;
 use std::error::Error;
+use std::fmt;
 use std::fmt::Formatter;
-use std::{fmt, iter::Peekable, str::CharIndices};
 
 use log::trace;
 
@@ -8,10 +9,14 @@ use crate::front_end::lexer::LexError::InvalidTypedefDeclaration;
 
 use super::ast;
 
+#[cfg(test)]
+#[path = "lexer_tests.rs"]
+mod lexer_tests;
+
 lalrpop_mod!(pub c_parser, "/front_end/c_parser.rs");
 
 #[derive(Debug, Clone, PartialEq)]
-pub enum Token {
+pub enum Token<'input> {
     Bang,
     Percent,
     Caret,
@@ -66,16 +71,16 @@ pub enum Token {
 
     Ellipsis,
 
-    DecimalConstant(String),
-    BinaryConstant(String),
-    OctalConstant(String),
-    HexConstant(String),
-    FloatingConstant(String),
-    StringLiteral(String),
-    CharConstant(String),
+    DecimalConstant(&'input str),
+    BinaryConstant(&'input str),
+    OctalConstant(&'input str),
+    HexConstant(&'input str),
+    FloatingConstant(&'input str),
+    StringLiteral(&'input str),
+    CharConstant(&'input str),
 
-    Identifier(String),
-    TypedefName(String),
+    Identifier(&'input str),
+    TypedefName(&'input str),
 
     Auto,
     Break,
@@ -112,7 +117,7 @@ pub enum Token {
     While,
 }
 
-impl fmt::Display for Token {
+impl fmt::Display for Token<'_> {
     fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
         match self {
             Token::Bang => write!(f, "Token [!]"),
@@ -213,19 +218,24 @@ type Spanned<Tok, Loc, Error> = Result<(Loc, Tok, Loc), Error>;
 
 type TypedefName = String;
 
+/// Lexes the source into tokens that borrow their text from the source, so identifiers and
+/// constants don't need to be copied.
 pub struct Lexer<'input> {
-    chars: Peekable<CharIndices<'input>>,
-    typedef_names: Vec<TypedefName>,
+    input: &'input str,
+    /// The byte offset of the next character to lex
+    position: usize,
+    typedef_names: HashSet<TypedefName>,
     inside_typedef_stmt: bool,
     typedef_stmt_nesting_depth: u32,
-    typedef_stmt_buffer: Vec<Spanned<Token, usize, LexError>>,
+    typedef_stmt_buffer: Vec<Spanned<Token<'input>, usize, LexError>>,
 }
 
 impl<'input> Lexer<'input> {
     pub fn new(input: &'input str) -> Self {
         Lexer {
-            chars: input.char_indices().peekable(),
-            typedef_names: vec![],
+            input,
+            position: 0,
+            typedef_names: HashSet::new(),
             inside_typedef_stmt: false,
             typedef_stmt_nesting_depth: 0,
             typedef_stmt_buffer: vec![],
@@ -234,101 +244,293 @@ impl<'input> Lexer<'input> {
 }
 
 impl<'input> Iterator for Lexer<'input> {
-    type Item = Spanned<Token, usize, LexError>;
+    type Item = Spanned<Token<'input>, usize, LexError>;
 
     fn next(&mut self) -> Option<Self::Item> {
-        let mut fsm = Fsm::new();
-        let mut start = None;
-        let mut end = None;
-        loop {
-            let (i, c) = match self.chars.peek() {
-                Some((i, c)) => (i, c),
-                // end of file
-                None => {
-                    return match fsm.state {
-                        // EOF
-                        State::Start => None,
-                        _ => match fsm.token {
-                            Some(t) => Some(Ok((start.unwrap(), t, end.unwrap() + 1))),
-                            None => Some(Err(LexError::InvalidEOF)),
-                        },
-                    };
+        let bytes = self.input.as_bytes();
+        while self.position < bytes.len() && bytes[self.position].is_ascii_whitespace() {
+            self.position += 1;
+        }
+        if self.position == bytes.len() {
+            // EOF
+            return None;
+        }
+
+        let start = self.position;
+        let token = match self.lex_token() {
+            Ok(t) => t,
+            Err(e) => return Some(Err(e)),
+        };
+        let end = self.position;
+        trace!("Lexed token: {:?}", token);
+
+        if token == Token::Typedef {
+            self.inside_typedef_stmt = true;
+        }
+        if self.inside_typedef_stmt {
+            self.typedef_stmt_buffer
+                .push(Ok((start, token.to_owned(), end)));
+            if token == Token::Semicolon && self.typedef_stmt_nesting_depth == 0 {
+                if let Err(e) = self.parse_typedef_name() {
+                    return Some(Err(e));
                 }
-            };
+                // reset from typedef statement
+                self.inside_typedef_stmt = false;
+            } else if token == Token::LeftCurly {
+                self.typedef_stmt_nesting_depth += 1;
+            } else if token == Token::RightCurly {
+                self.typedef_stmt_nesting_depth -= 1;
+            }
+        }
+        Some(Ok((start, token, end)))
+    }
+}
+
+impl<'input> Lexer<'input> {
+    fn peek_byte(&self, offset: usize) -> Option<u8> {
+        self.input.as_bytes().get(self.position + offset).copied()
+    }
 
-            if start.is_none() {
-                if c.is_whitespace() {
-                    self.chars.next();
-                    continue;
+    /// Lex the token starting at the current position, which isn't whitespace
+    fn lex_token(&mut self) -> Result<Token<'input>, LexError> {
+        let start = self.position;
+        let c = self.peek_byte(0).unwrap();
+        if c.is_ascii_alphabetic() || c == b'_' {
+            return Ok(self.lex_identifier());
+        }
+        if c.is_ascii_digit()
+            || (c == b'.' && self.peek_byte(1).map_or(false, |c| c.is_ascii_digit()))
+        {
+            return Ok(self.lex_number());
+        }
+        match c {
+            b'"' => return self.lex_string_literal(),
+            b'\'' => return self.lex_char_constant(),
+            b'.' if self.peek_byte(1) == Some(b'.') => {
+                if self.peek_byte(2) == Some(b'.') {
+                    self.position += 3;
+                    return Ok(Token::Ellipsis);
                 }
-                start = Some(i.to_owned());
+                return Err(LexError::InvalidToken(start, start + 2));
             }
-            end = Some(i.to_owned());
-            let current_token = fsm.token.to_owned();
-            let new_state = fsm.step(c.to_owned(), &self.typedef_names);
-            match new_state {
-                Some(f) => {
-                    self.chars.next();
-                    fsm = f;
+            _ => {}
+        }
+
+        let next = self.peek_byte(1);
+        let after_next = self.peek_byte(2);
+        // punctuators, longest match first
+        let (token, length) = match (c, next, after_next) {
+            (b'<', Some(b'<'), Some(b'=')) => (Token::LeftShiftEq, 3),
+            (b'>', Some(b'>'), Some(b'=')) => (Token::RightShiftEq, 3),
+            (b'+', Some(b'='), _) => (Token::PlusEq, 2),
+            (b'-', Some(b'='), _) => (Token::MinusEq, 2),
+            (b'*', Some(b'='), _) => (Token::AsteriskEq, 2),
+            (b'/', Some(b'='), _) => (Token::SlashEq, 2),
+            (b'%', Some(b'='), _) => (Token::PercentEq, 2),
+            (b'&', Some(b'='), _) => (Token::AmpersandEq, 2),
+            (b'^', Some(b'='), _) => (Token::CaretEq, 2),
+            (b'|', Some(b'='), _) => (Token::BarEq, 2),
+            (b'-', Some(b'>'), _) => (Token::Arrow, 2),
+            (b'+', Some(b'+'), _) => (Token::DoublePlus, 2),
+            (b'-', Some(b'-'), _) => (Token::DoubleMinus, 2),
+            (b'<', Some(b'<'), _) => (Token::LeftShift, 2),
+            (b'>', Some(b'>'), _) => (Token::RightShift, 2),
+            (b'<', Some(b'='), _) => (Token::LessThanEq, 2),
+            (b'>', Some(b'='), _) => (Token::GreaterThanEq, 2),
+            (b'=', Some(b'='), _) => (Token::DoubleEq, 2),
+            (b'!', Some(b'='), _) => (Token::BangEq, 2),
+            (b'&', Some(b'&'), _) => (Token::DoubleAmpersand, 2),
+            (b'|', Some(b'|'), _) => (Token::DoubleBar, 2),
+            (b'!', _, _) => (Token::Bang, 1),
+            (b'%', _, _) => (Token::Percent, 1),
+            (b'^', _, _) => (Token::Caret, 1),
+            (b'&', _, _) => (Token::Ampersand, 1),
+            (b'*', _, _) => (Token::Asterisk, 1),
+            (b'-', _, _) => (Token::Minus, 1),
+            (b'+', _, _) => (Token::Plus, 1),
+            (b'=', _, _) => (Token::Eq, 1),
+            (b'~', _, _) => (Token::Tilde, 1),
+            (b'|', _, _) => (Token::Bar, 1),
+            (b'.', _, _) => (Token::Dot, 1),
+            (b'<', _, _) => (Token::LessThan, 1),
+            (b'>', _, _) => (Token::GreaterThan, 1),
+            (b'/', _, _) => (Token::Slash, 1),
+            (b'?', _, _) => (Token::Question, 1),
+            (b'(', _, _) => (Token::LeftParen, 1),
+            (b')', _, _) => (Token::RightParen, 1),
+            (b'[', _, _) => (Token::LeftSquare, 1),
+            (b']', _, _) => (Token::RightSquare, 1),
+            (b'{', _, _) => (Token::LeftCurly, 1),
+            (b'}', _, _) => (Token::RightCurly, 1),
+            (b',', _, _) => (Token::Comma, 1),
+            (b';', _, _) => (Token::Semicolon, 1),
+            (b':', _, _) => (Token::Colon, 1),
+            _ => return Err(LexError::InvalidToken(start, start)),
+        };
+        self.position += length;
+        Ok(token)
+    }
+
+    fn lex_identifier(&mut self) -> Token<'input> {
+        let start = self.position;
+        while self.peek_byte(0).map_or(false, is_identifier_char) {
+            self.position += 1;
+        }
+        let name = &self.input[start..self.position];
+        // check if identifier name matches a keyword
+        if let Some(keyword) = parse_keyword(name) {
+            return keyword;
+        }
+        // check if identifier name matches a typedef name
+        if self.typedef_names.contains(name) {
+            return Token::TypedefName(name);
+        }
+        Token::Identifier(name)
+    }
+
+    /// Lex an integer or floating constant. Integers starting with 0 are octal, unless
+    /// they start with 0b or 0x.
+    fn lex_number(&mut self) -> Token<'input> {
+        let start = self.position;
+        let first = self.peek_byte(0).unwrap();
+        if first == b'0' {
+            match self.peek_byte(1) {
+                Some(b'b' | b'B') => {
+                    self.position += 2;
+                    self.skip_while(|c| c == b'0' || c == b'1');
+                    return Token::BinaryConstant(&self.input[start..self.position]);
+                }
+                Some(b'x' | b'X') => {
+                    self.position += 2;
+                    self.skip_while(|c| c.is_ascii_hexdigit());
+                    return Token::HexConstant(&self.input[start..self.position]);
                 }
-                // no next state, so take the token we got to
-                None => {
-                    return match current_token {
-                        Some(t @ Token::Typedef) => {
-                            trace!("Lexed token: {:?}", t);
-                            self.inside_typedef_stmt = true;
-                            self.typedef_stmt_buffer.push(Ok((
-                                start.unwrap(),
-                                t.to_owned(),
-                                end.unwrap(),
-                            )));
-                            Some(Ok((start.unwrap(), t, end.unwrap())))
+                _ => {}
+            }
+        }
+
+        let is_octal = first == b'0';
+        if is_octal {
+            self.skip_while(|c| (b'0'..=b'7').contains(&c));
+        } else {
+            self.skip_while(|c| c.is_ascii_digit());
+        }
+        let mut is_float = false;
+        if self.peek_byte(0) == Some(b'.') {
+            is_float = true;
+            self.position += 1;
+            self.skip_while(|c| c.is_ascii_digit());
+        }
+        if matches!(self.peek_byte(0), Some(b'e' | b'E')) {
+            is_float = true;
+            self.position += 1;
+            if matches!(self.peek_byte(0), Some(b'+' | b'-')) {
+                self.position += 1;
+            }
+            self.skip_while(|c| c.is_ascii_digit());
+        }
+
+        let constant = &self.input[start..self.position];
+        if is_float {
+            Token::FloatingConstant(constant)
+        } else if is_octal {
+            Token::OctalConstant(constant)
+        } else {
+            Token::DecimalConstant(constant)
+        }
+    }
+
+    fn skip_while(&mut self, predicate: impl Fn(u8) -> bool) {
+        while self.peek_byte(0).map_or(false, &predicate) {
+            self.position += 1;
+        }
+    }
+
+    /// Lex a string literal. The token is the contents of the literal, without the quotes
+    /// and with escape sequences left as they are.
+    fn lex_string_literal(&mut self) -> Result<Token<'input>, LexError> {
+        // skip the opening quote
+        self.position += 1;
+        let contents_start = self.position;
+        loop {
+            match self.peek_byte(0) {
+                None => return Err(LexError::InvalidEOF),
+                Some(b'\\') => self.position += 2,
+                Some(b'"') => break,
+                Some(_) => self.position += 1,
+            }
+        }
+        let contents = &self.input[contents_start..self.position];
+        self.position += 1;
+        Ok(Token::StringLiteral(contents))
+    }
+
+    /// Lex a char constant. The token is the contents of the constant, without the quotes
+    /// and with any escape sequence left as it is.
+    fn lex_char_constant(&mut self) -> Result<Token<'input>, LexError> {
+        let start = self.position;
+        // skip the opening quote
+        self.position += 1;
+        let contents_start = self.position;
+        let invalid = |position: usize| match position {
+            _ if position >= self.input.len() => LexError::InvalidEOF,
+            _ => LexError::InvalidToken(start, position),
+        };
+        match self.peek_byte(0) {
+            Some(b'\\') => {
+                self.position += 1;
+                match self.peek_byte(0) {
+                    Some(b'\'' | b'"' | b'?' | b'\\' | b'n' | b'r' | b't') => self.position += 1,
+                    Some(b'x') => {
+                        self.position += 1;
+                        let digits_start = self.position;
+                        self.skip_while(|c| c.is_ascii_hexdigit());
+                        if self.position == digits_start {
+                            return Err(invalid(self.position));
                         }
-                        Some(t) => {
-                            trace!("Lexed token: {:?}", t);
-                            if self.inside_typedef_stmt {
-                                self.typedef_stmt_buffer.push(Ok((
-                                    start.unwrap(),
-                                    t.to_owned(),
-                                    end.unwrap(),
-                                )));
-                                if t == Token::Semicolon && self.typedef_stmt_nesting_depth == 0 {
-                                    if let Err(e) = self.parse_typedef_name() {
-                                        return Some(Err(e));
-                                    }
-                                    // reset from typedef statement
-                                    self.inside_typedef_stmt = false;
-                                } else if t == Token::LeftCurly {
-                                    self.typedef_stmt_nesting_depth += 1;
-                                } else if t == Token::RightCurly {
-                                    self.typedef_stmt_nesting_depth -= 1;
-                                }
-                            }
-                            Some(Ok((start.unwrap(), t, end.unwrap())))
+                    }
+                    Some(c) if (b'0'..=b'7').contains(&c) => {
+                        // up to three octal digits
+                        let digits_end = self.position + 3;
+                        while self.position < digits_end
+                            && self
+                                .peek_byte(0)
+                                .map_or(false, |c| (b'0'..=b'7').contains(&c))
+                        {
+                            self.position += 1;
                         }
-                        None => Some(Err(LexError::InvalidToken(start.unwrap(), i.to_owned()))),
-                    };
+                    }
+                    _ => return Err(invalid(self.position)),
                 }
             }
+            // empty char constant isn't allowed
+            Some(b'\'') | None => return Err(invalid(self.position)),
+            Some(_) => {
+                let c = self.input[self.position..].chars().next().unwrap();
+                self.position += c.len_utf8();
+            }
+        }
+        if self.peek_byte(0) != Some(b'\'') {
+            return Err(invalid(self.position));
         }
+        let contents = &self.input[contents_start..self.position];
+        self.position += 1;
+        Ok(Token::CharConstant(contents))
     }
-}
 
-impl Lexer<'_> {
     fn parse_typedef_name(&mut self) -> Result<(), LexError> {
-        let result = c_parser::DeclarationParser::new().parse(self.typedef_stmt_buffer.to_vec());
+        let typedef_stmt = std::mem::take(&mut self.typedef_stmt_buffer);
+        let result = c_parser::DeclarationParser::new().parse(typedef_stmt);
         if let Ok(ast::Statement::Declaration(_, ds)) = result {
             if ds.len() == 1 {
                 if let Some(name) = ds[0].get_identifier_name() {
                     trace!("Found typedef identifier: {:?}", name);
-                    self.typedef_names.push(name);
+                    self.typedef_names.insert(name);
                     trace!("Typedef names so far: {:?}", self.typedef_names);
-                    self.typedef_stmt_buffer = vec![];
                     return Ok(());
                 }
             }
         }
-        self.typedef_stmt_buffer = vec![];
         Err(InvalidTypedefDeclaration)
     }
 }
@@ -354,859 +556,51 @@ impl fmt::Display for LexError {
 
 impl Error for LexError {}
 
-#[derive(Debug)]
-enum State {
-    Start,
-    Bang,
-    BangEq,
-    Ampersand,
-    AmpersandEq,
-    DoubleAmpersand,
-    Percent,
-    PercentEq,
-    Asterisk,
-    AsteriskEq,
-    Caret,
-    CaretEq,
-    Plus,
-    PlusEq,
-    DoublePlus,
-    Minus,
-    MinusEq,
-    DoubleMinus,
-    Arrow,
-    Eq,
-    DoubleEq,
-    Tilde,
-    Bar,
-    BarEq,
-    DoubleBar,
-    LessThan,
-    LessThanEq,
-    LeftShift,
-    LeftShiftEq,
-    GreaterThan,
-    GreaterThanEq,
-    RightShift,
-    RightShiftEq,
-    Slash,
-    SlashEq,
-    Question,
-    LeftParen,
-    RightParen,
-    LeftSquare,
-    RightSquare,
-    LeftCurly,
-    RightCurly,
-    Comma,
-    Semicolon,
-    Colon,
-    Identifier,
-    Keyword(String),
-    TypedefName,
-    Decimal,
-    Dot1,
-    Dot2,
-    Dot3,
-    Float1,
-    Float2,
-    Float3,
-    Float4,
-    Oct1,
-    Oct2,
-    Bin1,
-    Bin2,
-    Hex1,
-    Hex2,
-    String1,
-    String2,
-    String3,
-    String4,
-    Char1,
-    Char2,
-    Char3,
-    Char4,
-    Char5,
-    Char6,
-    Char7,
-    Char8,
-    Char9,
-    Char10,
-}
-
-#[derive(Debug)]
-struct Fsm {
-    state: State,
-    token: Option<Token>,
-}
-
-impl Fsm {
-    fn new() -> Self {
-        Fsm {
-            state: State::Start,
-            token: None,
-        }
-    }
-
-    fn step(self, input: char, typedef_names: &[String]) -> Option<Self> {
-        match self.state {
-            State::Start => match input {
-                '!' => Some(Fsm {
-                    state: State::Bang,
-                    token: Some(Token::Bang),
-                }),
-                '&' => Some(Fsm {
-                    state: State::Ampersand,
-                    token: Some(Token::Ampersand),
-                }),
-                '%' => Some(Fsm {
-                    state: State::Percent,
-                    token: Some(Token::Percent),
-                }),
-                '*' => Some(Fsm {
-                    state: State::Asterisk,
-                    token: Some(Token::Asterisk),
-                }),
-                '^' => Some(Fsm {
-                    state: State::Caret,
-                    token: Some(Token::Caret),
-                }),
-                '+' => Some(Fsm {
-                    state: State::Plus,
-                    token: Some(Token::Plus),
-                }),
-                '-' => Some(Fsm {
-                    state: State::Minus,
-                    token: Some(Token::Minus),
-                }),
-                '=' => Some(Fsm {
-                    state: State::Eq,
-                    token: Some(Token::Eq),
-                }),
-                '~' => Some(Fsm {
-                    state: State::Tilde,
-                    token: Some(Token::Tilde),
-                }),
-                '|' => Some(Fsm {
-                    state: State::Bar,
-                    token: Some(Token::Bar),
-                }),
-                '<' => Some(Fsm {
-                    state: State::LessThan,
-                    token: Some(Token::LessThan),
-                }),
-                '>' => Some(Fsm {
-                    state: State::GreaterThan,
-                    token: Some(Token::GreaterThan),
-                }),
-                '/' => Some(Fsm {
-                    state: State::Slash,
-                    token: Some(Token::Slash),
-                }),
-                '?' => Some(Fsm {
-                    state: State::Question,
-                    token: Some(Token::Question),
-                }),
-                '(' => Some(Fsm {
-                    state: State::LeftParen,
-                    token: Some(Token::LeftParen),
-                }),
-                ')' => Some(Fsm {
-                    state: State::RightParen,
-                    token: Some(Token::RightParen),
-                }),
-                '[' => Some(Fsm {
-                    state: State::LeftSquare,
-                    token: Some(Token::LeftSquare),
-                }),
-                ']' => Some(Fsm {
-                    state: State::RightSquare,
-                    token: Some(Token::RightSquare),
-                }),
-                '{' => Some(Fsm {
-                    state: State::LeftCurly,
-                    token: Some(Token::LeftCurly),
-                }),
-                '}' => Some(Fsm {
-                    state: State::RightCurly,
-                    token: Some(Token::RightCurly),
-                }),
-                ',' => Some(Fsm {
-                    state: State::Comma,
-                    token: Some(Token::Comma),
-                }),
-                ';' => Some(Fsm {
-                    state: State::Semicolon,
-                    token: Some(Token::Semicolon),
-                }),
-                ':' => Some(Fsm {
-                    state: State::Colon,
-                    token: Some(Token::Colon),
-                }),
-                '.' => Some(Fsm {
-                    state: State::Dot1,
-                    token: Some(Token::Dot),
-                }),
-                '"' => Some(Fsm {
-                    state: State::String1,
-                    token: None,
-                }),
-                '\'' => Some(Fsm {
-                    state: State::Char1,
-                    token: None,
-                }),
-                // identifiers only start with letters or underscore, not number
-                c if c.is_ascii_alphabetic() => Some(Fsm {
-                    state: State::Identifier,
-                    token: Some(Token::Identifier(c.to_string())),
-                }),
-                '_' => Some(Fsm {
-                    state: State::Identifier,
-                    token: Some(Token::Identifier("_".to_owned())),
-                }),
-                '0' => Some(Fsm {
-                    state: State::Oct1,
-                    token: Some(Token::OctalConstant("0".to_owned())),
-                }),
-                c if c.is_ascii_digit() => Some(Fsm {
-                    state: State::Decimal,
-                    token: Some(Token::DecimalConstant(c.to_string())),
-                }),
-                _ => None,
-            },
-            State::Bang => match input {
-                '=' => Some(Fsm {
-                    state: State::BangEq,
-                    token: Some(Token::BangEq),
-                }),
-                _ => None,
-            },
-            State::BangEq => None,
-            State::Ampersand => match input {
-                '=' => Some(Fsm {
-                    state: State::AmpersandEq,
-                    token: Some(Token::AmpersandEq),
-                }),
-                '&' => Some(Fsm {
-                    state: State::DoubleAmpersand,
-                    token: Some(Token::DoubleAmpersand),
-                }),
-                _ => None,
-            },
-            State::AmpersandEq => None,
-            State::DoubleAmpersand => None,
-            State::Percent => match input {
-                '=' => Some(Fsm {
-                    state: State::PercentEq,
-                    token: Some(Token::PercentEq),
-                }),
-                _ => None,
-            },
-            State::PercentEq => None,
-            State::Asterisk => match input {
-                '=' => Some(Fsm {
-                    state: State::AsteriskEq,
-                    token: Some(Token::AsteriskEq),
-                }),
-                _ => None,
-            },
-            State::AsteriskEq => None,
-            State::Caret => match input {
-                '=' => Some(Fsm {
-                    state: State::CaretEq,
-                    token: Some(Token::CaretEq),
-                }),
-                _ => None,
-            },
-            State::CaretEq => None,
-            State::Plus => match input {
-                '=' => Some(Fsm {
-                    state: State::PlusEq,
-                    token: Some(Token::PlusEq),
-                }),
-                '+' => Some(Fsm {
-                    state: State::DoublePlus,
-                    token: Some(Token::DoublePlus),
-                }),
-                _ => None,
-            },
-            State::PlusEq => None,
-            State::DoublePlus => None,
-            State::Minus => match input {
-                '=' => Some(Fsm {
-                    state: State::MinusEq,
-                    token: Some(Token::MinusEq),
-                }),
-                '-' => Some(Fsm {
-                    state: State::DoubleMinus,
-                    token: Some(Token::DoubleMinus),
-                }),
-                '>' => Some(Fsm {
-                    state: State::Arrow,
-                    token: Some(Token::Arrow),
-                }),
-                _ => None,
-            },
-            State::MinusEq => None,
-            State::DoubleMinus => None,
-            State::Arrow => None,
-            State::Eq => match input {
-                '=' => Some(Fsm {
-                    state: State::DoubleEq,
-                    token: Some(Token::DoubleEq),
-                }),
-                _ => None,
-            },
-            State::DoubleEq => None,
-            State::Tilde => None,
-            State::Bar => match input {
-                '=' => Some(Fsm {
-                    state: State::BarEq,
-                    token: Some(Token::BarEq),
-                }),
-                '|' => Some(Fsm {
-                    state: State::DoubleBar,
-                    token: Some(Token::DoubleBar),
-                }),
-                _ => None,
-            },
-            State::BarEq => None,
-            State::DoubleBar => None,
-            State::LessThan => match input {
-                '=' => Some(Fsm {
-                    state: State::LessThanEq,
-                    token: Some(Token::LessThanEq),
-                }),
-                '<' => Some(Fsm {
-                    state: State::LeftShift,
-                    token: Some(Token::LeftShift),
-                }),
-                _ => None,
-            },
-            State::LessThanEq => None,
-            State::LeftShift => match input {
-                '=' => Some(Fsm {
-                    state: State::LeftShiftEq,
-                    token: Some(Token::LeftShiftEq),
-                }),
-                _ => None,
-            },
-            State::LeftShiftEq => None,
-            State::GreaterThan => match input {
-                '=' => Some(Fsm {
-                    state: State::GreaterThanEq,
-                    token: Some(Token::GreaterThanEq),
-                }),
-                '>' => Some(Fsm {
-                    state: State::RightShift,
-                    token: Some(Token::RightShift),
-                }),
-                _ => None,
-            },
-            State::GreaterThanEq => None,
-            State::RightShift => match input {
-                '=' => Some(Fsm {
-                    state: State::RightShiftEq,
-                    token: Some(Token::RightShiftEq),
-                }),
-                _ => None,
-            },
-            State::RightShiftEq => None,
-            State::Slash => match input {
-                '=' => Some(Fsm {
-                    state: State::SlashEq,
-                    token: Some(Token::SlashEq),
-                }),
-                _ => None,
-            },
-            State::SlashEq => None,
-            State::Question => None,
-            State::LeftParen => None,
-            State::RightParen => None,
-            State::LeftSquare => None,
-            State::RightSquare => None,
-            State::LeftCurly => None,
-            State::RightCurly => None,
-            State::Comma => None,
-            State::Semicolon => None,
-            State::Colon => None,
-            State::Identifier => {
-                if !is_identifier_char(&input) {
-                    return None;
-                }
-                if let Some(Token::Identifier(mut name)) = self.token {
-                    name.push(input);
-                    return Some(lex_identifier(name, typedef_names));
-                }
-                // shouldn't ever get here because the Identifier state should
-                // always be paired with an Identifier token
-                None
-            }
-            State::Keyword(mut name) => {
-                if !is_identifier_char(&input) {
-                    return None;
-                }
-                name.push(input);
-                Some(lex_identifier(name, typedef_names))
-            }
-            State::TypedefName => {
-                if !is_identifier_char(&input) {
-                    return None;
-                }
-                if let Some(Token::TypedefName(mut name)) = self.token {
-                    name.push(input);
-                    return Some(lex_identifier(name, typedef_names));
-                }
-                // shouldn't ever get here because the Identifier state should
-                // always be paired with an Identifier token
-                None
-            }
-            State::Decimal => match input {
-                '.' => match self.token {
-                    Some(Token::DecimalConstant(mut s)) => {
-                        s.push('.');
-                        Some(Fsm {
-                            state: State::Float1,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                'e' | 'E' => match self.token {
-                    Some(Token::DecimalConstant(mut s)) => {
-                        s.push('e');
-                        Some(Fsm {
-                            state: State::Float2,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                c if c.is_ascii_digit() => match self.token {
-                    Some(Token::DecimalConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Decimal,
-                            token: Some(Token::DecimalConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Dot1 => match input {
-                c if c.is_ascii_digit() => {
-                    let s = format!(".{c}");
-                    Some(Fsm {
-                        state: State::Float1,
-                        token: Some(Token::FloatingConstant(s)),
-                    })
-                }
-                '.' => Some(Fsm {
-                    state: State::Dot2,
-                    token: None,
-                }),
-                _ => None,
-            },
-            State::Dot2 => match input {
-                '.' => Some(Fsm {
-                    state: State::Dot3,
-                    token: Some(Token::Ellipsis),
-                }),
-                _ => None,
-            },
-            State::Dot3 => None,
-            State::Float1 => match input {
-                'e' | 'E' => match self.token {
-                    Some(Token::FloatingConstant(mut s)) => {
-                        s.push('e');
-                        Some(Fsm {
-                            state: State::Float2,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                c if c.is_ascii_digit() => match self.token {
-                    Some(Token::FloatingConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Float1,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Float2 => match input {
-                c @ '+' | c @ '-' => match self.token {
-                    Some(Token::FloatingConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Float3,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                c if c.is_ascii_digit() => match self.token {
-                    Some(Token::FloatingConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Float4,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Float3 | State::Float4 => match input {
-                c if c.is_ascii_digit() => match self.token {
-                    Some(Token::FloatingConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Float4,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Oct1 => match input {
-                '.' => Some(Fsm {
-                    state: State::Float1,
-                    token: Some(Token::FloatingConstant("0.".to_owned())),
-                }),
-                'e' | 'E' => Some(Fsm {
-                    state: State::Float2,
-                    token: Some(Token::FloatingConstant("0e".to_owned())),
-                }),
-                'b' | 'B' => Some(Fsm {
-                    state: State::Bin1,
-                    token: Some(Token::BinaryConstant("0b".to_owned())),
-                }),
-                'x' | 'X' => Some(Fsm {
-                    state: State::Hex1,
-                    token: Some(Token::HexConstant("0x".to_owned())),
-                }),
-                c if c.is_digit(8) => {
-                    let s = format!("0{c}");
-                    Some(Fsm {
-                        state: State::Oct2,
-                        token: Some(Token::OctalConstant(s)),
-                    })
-                }
-                _ => None,
-            },
-            State::Oct2 => match input {
-                '.' => match self.token {
-                    Some(Token::OctalConstant(mut s)) => {
-                        s.push('.');
-                        Some(Fsm {
-                            state: State::Float1,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                'e' | 'E' => match self.token {
-                    Some(Token::OctalConstant(mut s)) => {
-                        s.push('e');
-                        Some(Fsm {
-                            state: State::Float2,
-                            token: Some(Token::FloatingConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                c if c.is_digit(8) => match self.token {
-                    Some(Token::OctalConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Oct2,
-                            token: Some(Token::OctalConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Bin1 | State::Bin2 => match input {
-                c if c.is_digit(2) => match self.token {
-                    Some(Token::BinaryConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Bin2,
-                            token: Some(Token::BinaryConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Hex1 | State::Hex2 => match input {
-                c if c.is_ascii_hexdigit() => match self.token {
-                    Some(Token::HexConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Hex2,
-                            token: Some(Token::HexConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::String1 => match input {
-                '\\' => Some(Fsm {
-                    state: State::String2,
-                    token: Some(Token::StringLiteral("\\".to_owned())),
-                }),
-                '"' => Some(Fsm {
-                    state: State::String4,
-                    token: Some(Token::StringLiteral("".to_owned())),
-                }),
-                c => Some(Fsm {
-                    state: State::String3,
-                    token: Some(Token::StringLiteral(c.to_string())),
-                }),
-            },
-            State::String2 => match self.token {
-                Some(Token::StringLiteral(mut s)) => {
-                    s.push(input);
-                    Some(Fsm {
-                        state: State::String3,
-                        token: Some(Token::StringLiteral(s)),
-                    })
-                }
-                _ => None,
-            },
-            State::String3 => match input {
-                '\\' => match self.token {
-                    Some(Token::StringLiteral(s)) => Some(Fsm {
-                        state: State::String2,
-                        token: Some(Token::StringLiteral(format!("{s}\\"))),
-                    }),
-                    _ => None,
-                },
-                '"' => match self.token {
-                    Some(Token::StringLiteral(s)) => Some(Fsm {
-                        state: State::String4,
-                        token: Some(Token::StringLiteral(s)),
-                    }),
-                    _ => None,
-                },
-                c => match self.token {
-                    Some(Token::StringLiteral(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::String3,
-                            token: Some(Token::StringLiteral(s)),
-                        })
-                    }
-                    _ => None,
-                },
-            },
-            State::String4 => None,
-            State::Char1 => match input {
-                '\\' => Some(Fsm {
-                    state: State::Char2,
-                    token: Some(Token::CharConstant("\\".to_owned())),
-                }),
-                // empty char constant isn't allowed
-                '\'' => None,
-                c => Some(Fsm {
-                    state: State::Char9,
-                    token: Some(Token::CharConstant(c.to_string())),
-                }),
-            },
-            State::Char2 => match input {
-                c @ '\'' | c @ '"' | c @ '?' | c @ '\\' | c @ 'n' | c @ 'r' | c @ 't' => {
-                    match self.token {
-                        Some(Token::CharConstant(mut s)) => {
-                            s.push(c);
-                            Some(Fsm {
-                                state: State::Char3,
-                                token: Some(Token::CharConstant(s)),
-                            })
-                        }
-                        _ => None,
-                    }
-                }
-                'x' => match self.token {
-                    Some(Token::CharConstant(mut s)) => {
-                        s.push('x');
-                        Some(Fsm {
-                            state: State::Char4,
-                            token: Some(Token::CharConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                c if c.is_digit(8) => match self.token {
-                    Some(Token::CharConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Char6,
-                            token: Some(Token::CharConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Char3 | State::Char8 | State::Char9 => match input {
-                '\'' => match self.token {
-                    Some(Token::CharConstant(s)) => Some(Fsm {
-                        state: State::Char10,
-                        token: Some(Token::CharConstant(s)),
-                    }),
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Char4 => match input {
-                c if c.is_ascii_hexdigit() => match self.token {
-                    Some(Token::CharConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Char5,
-                            token: Some(Token::CharConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Char5 => match input {
-                c if c.is_ascii_hexdigit() => match self.token {
-                    Some(Token::CharConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Char5,
-                            token: Some(Token::CharConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                '\'' => match self.token {
-                    Some(Token::CharConstant(s)) => Some(Fsm {
-                        state: State::Char10,
-                        token: Some(Token::CharConstant(s)),
-                    }),
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Char6 => match input {
-                c if c.is_digit(8) => match self.token {
-                    Some(Token::CharConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Char7,
-                            token: Some(Token::CharConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                '\'' => match self.token {
-                    Some(Token::CharConstant(s)) => Some(Fsm {
-                        state: State::Char10,
-                        token: Some(Token::CharConstant(s)),
-                    }),
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Char7 => match input {
-                c if c.is_digit(8) => match self.token {
-                    Some(Token::CharConstant(mut s)) => {
-                        s.push(c);
-                        Some(Fsm {
-                            state: State::Char8,
-                            token: Some(Token::CharConstant(s)),
-                        })
-                    }
-                    _ => None,
-                },
-                '\'' => match self.token {
-                    Some(Token::CharConstant(s)) => Some(Fsm {
-                        state: State::Char10,
-                        token: Some(Token::CharConstant(s)),
-                    }),
-                    _ => None,
-                },
-                _ => None,
-            },
-            State::Char10 => None,
-        }
-    }
-}
-
-fn is_identifier_char(c: &char) -> bool {
-    c.is_ascii_alphabetic() || c.is_ascii_digit() || c == &'_'
+fn is_identifier_char(c: u8) -> bool {
+    c.is_ascii_alphanumeric() || c == b'_'
 }
 
-fn lex_identifier(name: String, typedef_names: &[String]) -> Fsm {
-    // check if identifier name matches a keyword
-    if let Some(keyword) = parse_keyword(&name) {
-        return Fsm {
-            state: State::Keyword(name),
-            token: Some(keyword),
-        };
+fn parse_keyword(name: &str) -> Option<Token<'static>> {
+    // all the keywords are 2 to 8 lowercase letters, so most identifiers can be ruled out
+    // without comparing against any of them
+    let bytes = name.as_bytes();
+    if !(2..=8).contains(&bytes.len()) || !bytes[0].is_ascii_lowercase() {
+        return None;
     }
-    // check if identifier name matches a typedef name
-    if typedef_names.iter().any(|n| n == &name) {
-        return Fsm {
-            state: State::TypedefName,
-            token: Some(Token::TypedefName(name)),
-        };
-    }
-    // if no keyword or typedef name matches, keep lexing as an identifier
-    Fsm {
-        state: State::Identifier,
-        token: Some(Token::Identifier(name)),
-    }
-}
-
-fn parse_keyword(name: &str) -> Option<Token> {
-    match name {
-        "auto" => Some(Token::Auto),
-        "break" => Some(Token::Break),
-        "case" => Some(Token::Case),
-        "char" => Some(Token::Char),
-        "const" => Some(Token::Const),
-        "continue" => Some(Token::Continue),
-        "default" => Some(Token::Default),
-        "do" => Some(Token::Do),
-        "double" => Some(Token::Double),
-        "else" => Some(Token::Else),
-        "enum" => Some(Token::Enum),
-        "extern" => Some(Token::Extern),
-        "float" => Some(Token::Float),
-        "for" => Some(Token::For),
-        "goto" => Some(Token::Goto),
-        "if" => Some(Token::If),
-        "inline" => Some(Token::Inline),
-        "int" => Some(Token::Int),
-        "long" => Some(Token::Long),
-        "register" => Some(Token::Register),
-        "return" => Some(Token::Return),
-        "short" => Some(Token::Short),
-        "signed" => Some(Token::Signed),
-        "sizeof" => Some(Token::Sizeof),
-        "static" => Some(Token::Static),
-        "struct" => Some(Token::Struct),
-        "switch" => Some(Token::Switch),
-        "typedef" => Some(Token::Typedef),
-        "union" => Some(Token::Union),
-        "unsigned" => Some(Token::Unsigned),
-        "void" => Some(Token::Void),
-        "volatile" => Some(Token::Volatile),
-        "while" => Some(Token::While),
+    match bytes {
+        b"auto" => Some(Token::Auto),
+        b"break" => Some(Token::Break),
+        b"case" => Some(Token::Case),
+        b"char" => Some(Token::Char),
+        b"const" => Some(Token::Const),
+        b"continue" => Some(Token::Continue),
+        b"default" => Some(Token::Default),
+        b"do" => Some(Token::Do),
+        b"double" => Some(Token::Double),
+        b"else" => Some(Token::Else),
+        b"enum" => Some(Token::Enum),
+        b"extern" => Some(Token::Extern),
+        b"float" => Some(Token::Float),
+        b"for" => Some(Token::For),
+        b"goto" => Some(Token::Goto),
+        b"if" => Some(Token::If),
+        b"inline" => Some(Token::Inline),
+        b"int" => Some(Token::Int),
+        b"long" => Some(Token::Long),
+        b"register" => Some(Token::Register),
+        b"return" => Some(Token::Return),
+        b"short" => Some(Token::Short),
+        b"signed" => Some(Token::Signed),
+        b"sizeof" => Some(Token::Sizeof),
+        b"static" => Some(Token::Static),
+        b"struct" => Some(Token::Struct),
+        b"switch" => Some(Token::Switch),
+        b"typedef" => Some(Token::Typedef),
+        b"union" => Some(Token::Union),
+        b"unsigned" => Some(Token::Unsigned),
+        b"void" => Some(Token::Void),
+        b"volatile" => Some(Token::Volatile),
+        b"while" => Some(Token::While),
         _ => None,
     }
 }
@@ -0,0 +1,82 @@
+#[cfg(test)]
+mod lexer_tests {
+    use super::super::{LexError, Lexer, Token};
+
+    fn lex(source: &str) -> Vec<Token<'_>> {
+        Lexer::new(source).map(|result| result.unwrap().1).collect()
+    }
+
+    #[test]
+    fn lexes_keywords_identifiers_and_punctuators() {
+        assert_eq!(
+            lex("int x_1 = a->b <<= 2;"),
+            vec![
+                Token::Int,
+                Token::Identifier("x_1"),
+                Token::Eq,
+                Token::Identifier("a"),
+                Token::Arrow,
+                Token::Identifier("b"),
+                Token::LeftShiftEq,
+                Token::DecimalConstant("2"),
+                Token::Semicolon,
+            ]
+        );
+        assert_eq!(
+            lex("integer do double_"),
+            vec![
+                Token::Identifier("integer"),
+                Token::Do,
+                Token::Identifier("double_"),
+            ]
+        );
+    }
+
+    #[test]
+    fn lexes_constants() {
+        assert_eq!(
+            lex("0 017 42 0x1F 0b101 1.5e-3 .5 08 ..."),
+            vec![
+                Token::OctalConstant("0"),
+                Token::OctalConstant("017"),
+                Token::DecimalConstant("42"),
+                Token::HexConstant("0x1F"),
+                Token::BinaryConstant("0b101"),
+                Token::FloatingConstant("1.5e-3"),
+                Token::FloatingConstant(".5"),
+                Token::OctalConstant("0"),
+                Token::DecimalConstant("8"),
+                Token::Ellipsis,
+            ]
+        );
+    }
+
+    #[test]
+    fn lexes_string_and_char_contents_without_quotes() {
+        assert_eq!(
+            lex(r#""a \"b\"\n" 'c' '\n' '\x41' '\101'"#),
+            vec![
+                Token::StringLiteral(r#"a \"b\"\n"#),
+                Token::CharConstant("c"),
+                Token::CharConstant(r"\n"),
+                Token::CharConstant(r"\x41"),
+                Token::CharConstant(r"\101"),
+            ]
+        );
+    }
+
+    #[test]
+    fn reports_invalid_tokens() {
+        let mut lexer = Lexer::new("x @");
+        assert!(lexer.next().unwrap().is_ok());
+        assert_eq!(lexer.next().unwrap(), Err(LexError::InvalidToken(2, 2)));
+        assert_eq!(
+            Lexer::new("\"unterminated").next().unwrap(),
+            Err(LexError::InvalidEOF)
+        );
+        assert_eq!(
+            Lexer::new("''").next().unwrap(),
+            Err(LexError::InvalidToken(0, 1))
+        );
+    }
+}
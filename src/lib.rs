@@ -5,7 +5,9 @@
 extern crate lalrpop_util;
 
 use std::error::Error;
-use std::path::Path;
+use std::io::BufRead;
+use std::path::{Path, PathBuf};
+use std::{fs, io, thread};
 
 use clap::Parser as ClapParser;
 use log::{debug, info, trace};
@@ -15,28 +17,61 @@ use middle_end::ast_to_ir::convert_to_ir;
 use preprocessor::preprocess;
 use program_config::enabled_optimisations::EnabledOptimisations;
 use program_config::enabled_profiling::EnabledProfiling;
+use program_config::memory_limits::MemoryLimits;
+use program_config::profile_data::ProfileData;
 
 use crate::back_end::target_code_generation::generate_target_code;
+use crate::batch_compilation::compile_batch;
+use crate::compilation_cache::{CacheKey, CompilationCache};
 use crate::middle_end::middle_end_optimiser::ir_optimiser::optimise_ir;
+use crate::pass_timing::{enable_allocation_tracking, PassTimings, TimePassesFormat};
 use crate::relooper::relooper::reloop;
 
 mod back_end;
+mod batch_compilation;
+#[doc(hidden)]
+pub mod benchmarking;
+mod compilation_cache;
 mod data_structures;
 mod fmt_indented;
 mod front_end;
 mod id;
 mod middle_end;
+mod pass_timing;
 mod preprocessor;
 mod program_config;
 mod relooper;
 
 #[derive(ClapParser, Debug)]
 pub struct CliConfig {
-    /// The path to the input file to compile
-    filepath: String,
-    /// The path of the output file to generate
-    #[arg(short, long, default_value_t = ("module.wasm".to_owned()))]
-    output: String,
+    /// The paths to the input files to compile. With more than one, or with "-" to read the
+    /// paths from stdin one per line, each file is compiled to a .wasm file of the same name
+    #[arg(required = true)]
+    filepaths: Vec<String>,
+    /// The path of the output file to generate, when compiling a single file [default: module.wasm]
+    #[arg(short, long)]
+    output: Option<String>,
+    /// The directory to write the .wasm files to when compiling several files, instead of next to each input
+    #[arg(long)]
+    output_dir: Option<String>,
+    /// The number of files to compile in parallel when compiling several files [default: the number of CPUs]
+    #[arg(short, long)]
+    jobs: Option<usize>,
+    /// A directory to cache compiled modules in, keyed by a hash of the preprocessed source and the enabled options. Files that are unchanged since they were last compiled are copied from the cache instead of being compiled again
+    #[arg(long)]
+    cache_dir: Option<String>,
+    /// Report the wall time and peak heap allocation of each compiler phase, and the number of IR instructions before and after optimisation, to stderr. FORMAT is text (default) or json, which writes one line of JSON per file
+    #[arg(long, value_name = "FORMAT", num_args = 0..=1, require_equals = true, default_missing_value = "text")]
+    time_passes: Option<TimePassesFormat>,
+    /// The number of 64 KiB pages of memory the program starts with, if that's more than the static data and the estimated stack size need
+    #[arg(long, value_name = "PAGES")]
+    initial_memory: Option<u32>,
+    /// The most 64 KiB pages of memory the program can grow to, for its stack and heap [default: 65536, which is 4 GiB]
+    #[arg(long, value_name = "PAGES")]
+    max_memory: Option<u32>,
+    /// Compile for threads: the memory is shared, and there's a stack for each of up to N threads running thread_main() from threads.h at once, besides main(). Needs --opt-global-stack-ptrs, and can't be used with profiling
+    #[arg(long, value_name = "N")]
+    threads: Option<u32>,
 
     /// Enable tail-call optimisation (default)
     #[arg(long, group = "group_opt_tailcall")]
@@ -45,6 +80,13 @@ pub struct CliConfig {
     #[arg(long, group = "group_opt_tailcall")]
     noopt_tailcall: bool,
 
+    /// Enable compiling non-recursive tail calls to return_call, from the wasm tail call proposal (default)
+    #[arg(long, group = "group_opt_return_call")]
+    opt_return_call: bool,
+    /// Disable return_call, and compile non-recursive tail calls to a call followed by a return
+    #[arg(long, group = "group_opt_return_call")]
+    noopt_return_call: bool,
+
     /// Enable unreachable procedure elimination (default)
     #[arg(long, group = "group_opt_unreachable_procedure")]
     opt_unreachable_procedure: bool,
@@ -59,36 +101,307 @@ pub struct CliConfig {
     #[arg(long, group = "group_opt_stack_allocation")]
     noopt_stack_allocation: bool,
 
+    /// Enable allocating stack frame slots with a linear scan over live intervals, which is faster to compile but can use more stack
+    #[arg(long, group = "group_opt_linear_scan_allocation")]
+    opt_linear_scan_allocation: bool,
+    /// Disable linear scan allocation, and colour the clash graph to allocate stack frame slots (default)
+    #[arg(long, group = "group_opt_linear_scan_allocation")]
+    noopt_linear_scan_allocation: bool,
+
+    /// Enable promoting scalar variables to wasm locals (default)
+    #[arg(long, group = "group_opt_local_promotion")]
+    opt_local_promotion: bool,
+    /// Disable promoting scalar variables to wasm locals
+    #[arg(long, group = "group_opt_local_promotion")]
+    noopt_local_promotion: bool,
+
+    /// Enable keeping the frame and stack pointers in wasm globals (default)
+    #[arg(long, group = "group_opt_global_stack_ptrs")]
+    opt_global_stack_ptrs: bool,
+    /// Disable keeping the frame and stack pointers in wasm globals, and store them in memory
+    #[arg(long, group = "group_opt_global_stack_ptrs")]
+    noopt_global_stack_ptrs: bool,
+
+    /// Enable passing scalar params and return values as native wasm params and results (default)
+    #[arg(long, group = "group_opt_native_calls")]
+    opt_native_calls: bool,
+    /// Disable native wasm params and results, and pass all params and return values in the stack frame
+    #[arg(long, group = "group_opt_native_calls")]
+    noopt_native_calls: bool,
+
+    /// Enable compiling dense switch statements to jump tables (default)
+    #[arg(long, group = "group_opt_br_table")]
+    opt_br_table: bool,
+    /// Disable compiling dense switch statements to jump tables, and compare against each case in turn
+    #[arg(long, group = "group_opt_br_table")]
+    noopt_br_table: bool,
+
+    /// Enable dispatching to the blocks of a relooper multiple block with a jump table on the label variable (default)
+    #[arg(long, group = "group_opt_dispatch_br_table")]
+    opt_dispatch_br_table: bool,
+    /// Disable dispatching to the blocks of a relooper multiple block with a jump table, and compare the label variable against each block's entry labels in turn
+    #[arg(long, group = "group_opt_dispatch_br_table")]
+    noopt_dispatch_br_table: bool,
+
+    /// Enable removing the relooper's label variable assignments that no multiple block reads, and merging blocks that always run one after another (default)
+    #[arg(long, group = "group_opt_label_elimination")]
+    opt_label_elimination: bool,
+    /// Disable label elimination, and set the label variable on every branch between relooper blocks
+    #[arg(long, group = "group_opt_label_elimination")]
+    noopt_label_elimination: bool,
+
+    /// Enable copying and zeroing large blocks of memory with the bulk memory instructions (default)
+    #[arg(long, group = "group_opt_bulk_memory")]
+    opt_bulk_memory: bool,
+    /// Disable the bulk memory instructions, and copy and zero memory with a load and store for every 8 bytes
+    #[arg(long, group = "group_opt_bulk_memory")]
+    noopt_bulk_memory: bool,
+
+    /// Enable the 128-bit SIMD instructions in the strlen(), memchr(), memcpy() and memset() library functions (default)
+    #[arg(long, group = "group_opt_simd")]
+    opt_simd: bool,
+    /// Disable the SIMD instructions, and process one byte at a time in the library functions
+    #[arg(long, group = "group_opt_simd")]
+    noopt_simd: bool,
+
+    /// Enable constant propagation, copy propagation and common subexpression elimination on the IR (default)
+    #[arg(long, group = "group_opt_scalar")]
+    opt_scalar: bool,
+    /// Disable constant propagation, copy propagation and common subexpression elimination on the IR
+    #[arg(long, group = "group_opt_scalar")]
+    noopt_scalar: bool,
+
+    /// Enable folding constant branches, threading jumps to jumps and removing unreachable code on the IR (default)
+    #[arg(long, group = "group_opt_cfg_simplification")]
+    opt_cfg_simplification: bool,
+    /// Disable control flow simplification on the IR
+    #[arg(long, group = "group_opt_cfg_simplification")]
+    noopt_cfg_simplification: bool,
+
+    /// Enable evaluating calls to side-effect-free functions with constant arguments at compile time, as part of scalar optimisation (default)
+    #[arg(long, group = "group_opt_compile_time_eval")]
+    opt_compile_time_eval: bool,
+    /// Disable evaluating calls at compile time
+    #[arg(long, group = "group_opt_compile_time_eval")]
+    noopt_compile_time_eval: bool,
+
+    /// Enable inlining small leaf functions into their callers (default)
+    #[arg(long, group = "group_opt_inline")]
+    opt_inline: bool,
+    /// Disable inlining small leaf functions into their callers
+    #[arg(long, group = "group_opt_inline")]
+    noopt_inline: bool,
+
+    /// Enable loop-invariant code motion and strength reduction of induction variables (default)
+    #[arg(long, group = "group_opt_loop")]
+    opt_loop: bool,
+    /// Disable loop-invariant code motion and strength reduction of induction variables
+    #[arg(long, group = "group_opt_loop")]
+    noopt_loop: bool,
+
+    /// Enable peephole optimisation of the generated wasm instructions (default)
+    #[arg(long, group = "group_opt_peephole")]
+    opt_peephole: bool,
+    /// Disable peephole optimisation of the generated wasm instructions
+    #[arg(long, group = "group_opt_peephole")]
+    noopt_peephole: bool,
+
+    /// Preprocess in memory with the embedded preprocessor (default)
+    #[arg(long, group = "group_preprocessor")]
+    embedded_cpp: bool,
+    /// Preprocess by running the system's cpp in a separate process
+    #[arg(long, group = "group_preprocessor")]
+    external_cpp: bool,
+
     /// Enable stack usage profiling
     #[arg(long, group = "group_prof_stack")]
     prof_stack: bool,
     /// Disable stack usage profiling (default)
     #[arg(long, group = "group_prof_stack")]
     noprof_stack: bool,
+
+    /// Enable counting the calls between each pair of functions, which the runtime writes out as a flat profile and call graph
+    #[arg(long, group = "group_prof_calls")]
+    prof_calls: bool,
+    /// Disable counting calls (default)
+    #[arg(long, group = "group_prof_calls")]
+    noprof_calls: bool,
+
+    /// Enable timing each function, including the functions it calls, as well as counting calls. The runtime is called at every function call and return
+    #[arg(long, group = "group_prof_call_times")]
+    prof_call_times: bool,
+    /// Disable timing functions (default)
+    #[arg(long, group = "group_prof_call_times")]
+    noprof_call_times: bool,
+
+    /// Enable counting how many times each block of code runs, which the runtime writes out as profile data for --pgo
+    #[arg(long, group = "group_prof_blocks")]
+    prof_blocks: bool,
+    /// Disable counting blocks (default)
+    #[arg(long, group = "group_prof_blocks")]
+    noprof_blocks: bool,
+
+    /// Optimise for the hot paths in a .profdata file that the runtime wrote from a build with --prof-blocks and/or --prof-calls. The profiled build should be compiled with the same options, including --pgo if it was used
+    #[arg(long)]
+    pgo: Option<String>,
 }
 
 pub fn run(config: CliConfig) -> Result<(), Box<dyn Error>> {
     let enabled_optimisations = EnabledOptimisations::construct(&config);
     let enabled_profiling = EnabledProfiling::construct(&config);
+    let memory_limits = MemoryLimits::construct(&config)?;
     debug!("{:?}", enabled_optimisations);
     debug!("{:?}", enabled_profiling);
+    debug!("{:?}", memory_limits);
+
+    let cache = match &config.cache_dir {
+        None => None,
+        Some(dir) => Some(CompilationCache::new(Path::new(dir))?),
+    };
+
+    let is_batch = config.filepaths.len() > 1 || config.filepaths[0] == "-";
+    // function names in the profile are only meaningful for the program that was profiled
+    let profile = match &config.pgo {
+        None => None,
+        Some(_) if is_batch => {
+            return Err("--pgo can only be used with a single input file".into());
+        }
+        Some(path) => Some(ProfileData::read(Path::new(path))?),
+    };
+
+    let cpu_count = thread::available_parallelism().map_or(1, |n| n.get());
+    let jobs = config.jobs.unwrap_or(cpu_count);
+    // files compiled in parallel already use the CPUs, so each one generates its functions
+    // on a single thread rather than starting a thread per CPU of its own
+    let codegen_threads = if is_batch && jobs > 1 { 1 } else { cpu_count };
+    // the allocation counts are for the whole process, so they're only one file's while it's
+    // the only file being compiled
+    let measure_peak_alloc = !is_batch || jobs <= 1;
+    if config.time_passes.is_some() && measure_peak_alloc {
+        enable_allocation_tracking();
+    }
+
+    let compile = |filepath: &Path, output: &Path| {
+        let mut timings = PassTimings::new(filepath, measure_peak_alloc);
+        let result = compile_file(
+            filepath,
+            output,
+            config.external_cpp,
+            cache.as_ref(),
+            &enabled_optimisations,
+            &enabled_profiling,
+            &memory_limits,
+            profile.as_ref(),
+            codegen_threads,
+            &mut timings,
+        );
+        if let Some(format) = config.time_passes {
+            // a single write, so the reports of files compiled in parallel don't interleave
+            eprint!("{}", timings.report(format));
+        }
+        result
+    };
+
+    if !is_batch {
+        let output = config.output.as_deref().unwrap_or("module.wasm");
+        return compile(Path::new(&config.filepaths[0]), Path::new(output));
+    }
+
+    if config.output.is_some() {
+        return Err(
+            "--output can only be used with a single input file, use --output-dir instead".into(),
+        );
+    }
+    let inputs = read_batch_inputs(&config.filepaths)?;
+    compile_batch(
+        &inputs,
+        config.output_dir.as_deref().map(Path::new),
+        jobs,
+        compile,
+    )?;
+    Ok(())
+}
+
+/// The input files of a batch. A path of "-" reads more paths from stdin, one per line.
+fn read_batch_inputs(filepaths: &[String]) -> io::Result<Vec<PathBuf>> {
+    let mut inputs = Vec::new();
+    for filepath in filepaths {
+        if filepath != "-" {
+            inputs.push(PathBuf::from(filepath));
+            continue;
+        }
+        for line in io::stdin().lock().lines() {
+            let line = line?;
+            let line = line.trim();
+            if !line.is_empty() {
+                inputs.push(PathBuf::from(line));
+            }
+        }
+    }
+    Ok(inputs)
+}
 
+fn compile_file(
+    filepath: &Path,
+    output: &Path,
+    use_external_cpp: bool,
+    cache: Option<&CompilationCache>,
+    enabled_optimisations: &EnabledOptimisations,
+    enabled_profiling: &EnabledProfiling,
+    memory_limits: &MemoryLimits,
+    profile: Option<&ProfileData>,
+    codegen_threads: usize,
+    timings: &mut PassTimings,
+) -> Result<(), Box<dyn Error>> {
     // Run C preprocessor
-    let source = preprocess(Path::new(&config.filepath))?;
+    let source = timings.time("preprocess", || preprocess(filepath, use_external_cpp))?;
+    // Reuse the module from the last time this source was compiled, if it's cached
+    let cache_key = CacheKey::new(
+        &source,
+        enabled_optimisations,
+        enabled_profiling,
+        memory_limits,
+        profile,
+    );
+    if let Some(cache) = cache {
+        if let Some(module) = timings.time("cache lookup", || cache.get(&cache_key)) {
+            timings.cache_hit = true;
+            timings.module_bytes = Some(module.len());
+            timings.time("write", || fs::write(output, module))?;
+            return Ok(());
+        }
+    }
     // Generate AST
-    let ast = parse(source)?;
+    let ast = timings.time("parse", || parse(source))?;
     // Convert AST to three-address code IR
-    let mut ir = convert_to_ir(ast)?;
+    let mut ir = timings.time("convert to IR", || convert_to_ir(ast))?;
+    ir.program_metadata.profile = profile.cloned();
+    timings.ir_instrs_before_optimisation = Some(ir.program_instructions.instruction_count());
     trace!("Non-optimised IR: {}", ir);
     // Run optimisations on the IR
-    optimise_ir(&mut ir, &enabled_optimisations)?;
+    timings.time("optimise IR", || {
+        optimise_ir(&mut ir, enabled_optimisations)
+    })?;
+    timings.ir_instrs_after_optimisation = Some(ir.program_instructions.instruction_count());
     info!("Optimised IR: {}", ir);
     // Run the Relooper algorithm
-    let relooped_ir = reloop(ir);
+    let relooped_ir = timings.time("reloop", || reloop(ir));
     // Generate target wasm code
-    let wasm_module =
-        generate_target_code(relooped_ir, &enabled_optimisations, &enabled_profiling)?;
+    let wasm_module = timings.time("generate code", || {
+        generate_target_code(
+            relooped_ir,
+            enabled_optimisations,
+            enabled_profiling,
+            memory_limits,
+            codegen_threads,
+        )
+    })?;
     // write binary to file
-    wasm_module.write_to_file(Path::new(&config.output))?;
+    let module = timings.time("encode module", || wasm_module.to_bytes());
+    timings.module_bytes = Some(module.len());
+    timings.time("write", || fs::write(output, &module))?;
+    if let Some(cache) = cache {
+        cache.insert(&cache_key, &module)?;
+    }
     Ok(())
 }
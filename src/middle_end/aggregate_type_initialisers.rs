@@ -1,5 +1,5 @@
 use crate::front_end::ast::{Constant as AstConstant, Expression, Initialiser};
-use crate::middle_end::ast_to_ir::convert_expression_to_ir;
+use crate::middle_end::ast_to_ir::convert_expression_into;
 use crate::middle_end::context::Context;
 use crate::middle_end::ids::{ValueType, VarId};
 use crate::middle_end::instructions::{Constant, Instruction, Src};
@@ -42,10 +42,12 @@ pub fn array_initialiser(
         TypeSize::CompileTime(size) => size,
         TypeSize::Runtime(_) => return Err(MiddleEndError::UndefinedArraySize),
     };
-    // check that the array length matches the number of initialisers
-    if array_size as usize != initialiser_list.len() {
+    // there can be fewer initialisers than array members, in which case the rest of the
+    // members are set to zero
+    if initialiser_list.len() > array_size as usize {
         return Err(MiddleEndError::MismatchedArrayInitialiserLength);
     }
+    let uninitialised_member_count = array_size - initialiser_list.len() as u64;
 
     for array_member_initialiser in initialiser_list {
         match array_member_initialiser {
@@ -53,8 +55,7 @@ pub fn array_initialiser(
                 if array_member_type.is_aggregate_type() {
                     return Err(MiddleEndError::AssignNonAggregateValueToAggregateType);
                 }
-                let (mut expr_instrs, mut expr_var) = convert_expression_to_ir(e, prog, context)?;
-                instrs.append(&mut expr_instrs);
+                let mut expr_var = convert_expression_into(e, prog, context, &mut instrs)?;
 
                 // check type of the expression and convert if necessary
                 let expr_var_type = expr_var.get_type(&prog.program_metadata)?;
@@ -123,6 +124,15 @@ pub fn array_initialiser(
         ));
     }
 
+    if uninitialised_member_count > 0 {
+        // member_ptr_var now points to the first member without an initialiser
+        instrs.push(Instruction::ZeroMemory(
+            prog.new_instr_id(),
+            member_ptr_var,
+            uninitialised_member_count * array_member_byte_size,
+        ));
+    }
+
     Ok(instrs)
 }
 
@@ -137,12 +147,13 @@ pub fn struct_initialiser(
 
     let struct_type = dest_type_info.unwrap_struct_type(prog)?;
 
-    // check that the number of initialisers matches the number of struct members
-    if struct_type.member_count() != initialiser_list.len() {
+    // there can be fewer initialisers than struct members, in which case the rest of the
+    // members are set to zero
+    if initialiser_list.len() > struct_type.member_count() {
         return Err(MiddleEndError::MismatchedArrayInitialiserLength);
     }
 
-    for member_index in 0..struct_type.member_count() {
+    for member_index in 0..initialiser_list.len() {
         let mut member_initialiser = initialiser_list.get(member_index).unwrap().to_owned();
         let member_type = struct_type.get_member_type_by_index(member_index)?;
         let member_byte_offset = struct_type.get_member_byte_offset_by_index(member_index)?;
@@ -195,8 +206,7 @@ pub fn struct_initialiser(
                     return Err(MiddleEndError::AssignNonAggregateValueToAggregateType);
                 }
 
-                let (mut expr_instrs, mut expr_var) = convert_expression_to_ir(e, prog, context)?;
-                instrs.append(&mut expr_instrs);
+                let mut expr_var = convert_expression_into(e, prog, context, &mut instrs)?;
 
                 // check type of the expression and convert if necessary
                 let expr_var_type = expr_var.get_type(&prog.program_metadata)?;
@@ -258,6 +268,38 @@ pub fn struct_initialiser(
         }
     }
 
+    if initialiser_list.len() < struct_type.member_count() {
+        let first_uninitialised_byte_offset =
+            struct_type.get_member_byte_offset_by_index(initialiser_list.len())?;
+        let struct_byte_size = match dest_type_info.get_byte_size(&prog.program_metadata) {
+            TypeSize::CompileTime(size) => size,
+            TypeSize::Runtime(_) => unreachable!(),
+        };
+
+        // zero from the first member without an initialiser to the end of the struct
+        let zero_ptr_var = prog.new_var(ValueType::LValue);
+        prog.add_var_type(
+            zero_ptr_var.to_owned(),
+            IrType::PointerTo(Box::new(IrType::U8)),
+        )?;
+        instrs.push(Instruction::AddressOf(
+            prog.new_instr_id(),
+            zero_ptr_var.to_owned(),
+            Src::Var(dest),
+        ));
+        instrs.push(Instruction::Add(
+            prog.new_instr_id(),
+            zero_ptr_var.to_owned(),
+            Src::Var(zero_ptr_var.to_owned()),
+            Src::Constant(Constant::Int(first_uninitialised_byte_offset as i128)),
+        ));
+        instrs.push(Instruction::ZeroMemory(
+            prog.new_instr_id(),
+            zero_ptr_var,
+            struct_byte_size - first_uninitialised_byte_offset,
+        ));
+    }
+
     Ok(instrs)
 }
 
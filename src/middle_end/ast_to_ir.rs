@@ -8,9 +8,10 @@ use crate::front_end::ast::{
 use crate::middle_end::aggregate_type_initialisers::{
     array_initialiser, convert_string_literal_to_init_list_of_chars_ast, struct_initialiser,
 };
+use crate::middle_end::compile_time_eval::eval_integral_constant_expression;
 use crate::middle_end::context::{Context, IdentifierResolveResult, LoopContext, SwitchContext};
 use crate::middle_end::get_ast_type_info::get_type_info;
-use crate::middle_end::ids::{ValueType, VarId};
+use crate::middle_end::ids::{LabelId, ValueType, VarId};
 use crate::middle_end::instructions::Instruction;
 use crate::middle_end::instructions::{Constant, Src};
 use crate::middle_end::ir::{Function, Program};
@@ -31,6 +32,7 @@ pub fn convert_to_ir(ast: AstProgram) -> Result<Program, MiddleEndError> {
             Err(e) => return Err(e),
         }
     }
+    prog.program_metadata.var_names = context.var_names;
     Ok(prog)
 }
 
@@ -40,19 +42,21 @@ fn convert_statement_to_ir(
     context: &mut Context,
 ) -> Result<Vec<Instruction>, MiddleEndError> {
     let mut instrs: Vec<Instruction> = Vec::new();
+    // statements directly in a switch body get added to the current case block. Statements
+    // nested inside them are part of their parent statement, so this only persists one level deep
+    let this_stmt_directly_in_switch_body = context.directly_in_switch_body;
+    context.directly_in_switch_body = false;
     match stmt {
         Statement::Block(stmts) => {
             context.push_scope();
             for s in stmts {
+                context.directly_in_switch_body = this_stmt_directly_in_switch_body;
                 instrs.append(&mut convert_statement_to_ir(s, prog, context)?);
             }
             context.pop_scope();
         }
         Statement::Goto(x) => {
-            let label = match prog.resolve_identifier_to_label(&x.0) {
-                Some(label) => label.to_owned(),
-                None => prog.new_identifier_label(x.0),
-            };
+            let label = get_identifier_label(x.0, prog, context);
             instrs.push(Instruction::Br(prog.new_instr_id(), label));
         }
         Statement::Continue => match context.get_continue_label() {
@@ -76,8 +80,7 @@ fn convert_statement_to_ir(
                 instrs.push(Instruction::Ret(prog.new_instr_id(), None));
             }
             Some(expr) => {
-                let (mut expr_instrs, expr_var) = convert_expression_to_ir(expr, prog, context)?;
-                instrs.append(&mut expr_instrs);
+                let expr_var = convert_expression_into(expr, prog, context, &mut instrs)?;
                 instrs.push(Instruction::Ret(prog.new_instr_id(), Some(expr_var)));
             }
         },
@@ -94,8 +97,7 @@ fn convert_statement_to_ir(
                 loop_end_label.to_owned(),
             ));
             // while condition
-            let (mut cond_instrs, cond_var) = convert_expression_to_ir(cond, prog, context)?;
-            instrs.append(&mut cond_instrs);
+            let cond_var = convert_expression_into(cond, prog, context, &mut instrs)?;
             // jump out of loop if condition false
             instrs.push(Instruction::BrIfEq(
                 prog.new_instr_id(),
@@ -129,8 +131,7 @@ fn convert_statement_to_ir(
             // continue label
             instrs.push(Instruction::Label(prog.new_instr_id(), loop_continue_label));
             // loop condition
-            let (mut cond_instrs, cond_var) = convert_expression_to_ir(cond, prog, context)?;
-            instrs.append(&mut cond_instrs);
+            let cond_var = convert_expression_into(cond, prog, context, &mut instrs)?;
             // jump back to start of loop if condition true
 
             instrs.push(Instruction::BrIfNotEq(
@@ -152,8 +153,7 @@ fn convert_statement_to_ir(
                 None => {}
                 Some(e_or_d) => match e_or_d {
                     ExpressionOrDeclaration::Expression(e) => {
-                        let (mut expr_instrs, _) = convert_expression_to_ir(e, prog, context)?;
-                        instrs.append(&mut expr_instrs);
+                        convert_expression_into(e, prog, context, &mut instrs)?;
                     }
                     ExpressionOrDeclaration::Declaration(d) => {
                         instrs.append(&mut convert_statement_to_ir(*d, prog, context)?);
@@ -183,8 +183,7 @@ fn convert_statement_to_ir(
                     Src::Var(temp)
                 }
                 Some(e) => {
-                    let (mut expr_instrs, expr_var) = convert_expression_to_ir(e, prog, context)?;
-                    instrs.append(&mut expr_instrs);
+                    let expr_var = convert_expression_into(e, prog, context, &mut instrs)?;
                     expr_var
                 }
             };
@@ -202,8 +201,7 @@ fn convert_statement_to_ir(
             match end {
                 None => {}
                 Some(e) => {
-                    let (mut expr_instrs, _) = convert_expression_to_ir(e, prog, context)?;
-                    instrs.append(&mut expr_instrs);
+                    convert_expression_into(e, prog, context, &mut instrs)?;
                 }
             }
             // loop back to condition
@@ -214,8 +212,7 @@ fn convert_statement_to_ir(
         }
         Statement::If(cond, body) => {
             // if statement condition
-            let (mut cond_instrs, cond_var) = convert_expression_to_ir(cond, prog, context)?;
-            instrs.append(&mut cond_instrs);
+            let cond_var = convert_expression_into(cond, prog, context, &mut instrs)?;
             // if condition is false, jump to after body
             let if_end_label = prog.new_label();
             instrs.push(Instruction::BrIfEq(
@@ -230,8 +227,7 @@ fn convert_statement_to_ir(
             instrs.push(Instruction::Label(prog.new_instr_id(), if_end_label));
         }
         Statement::IfElse(cond, true_body, false_body) => {
-            let (mut cond_instrs, cond_var) = convert_expression_to_ir(cond, prog, context)?;
-            instrs.append(&mut cond_instrs);
+            let cond_var = convert_expression_into(cond, prog, context, &mut instrs)?;
             // if condition is false, jump to else body
             let else_label = prog.new_label();
             instrs.push(Instruction::BrIfEq(
@@ -255,9 +251,7 @@ fn convert_statement_to_ir(
         }
         Statement::Switch(switch_expr, body) => {
             let switch_end_label = prog.new_label();
-            let (mut expr_instrs, switch_src) =
-                convert_expression_to_ir(switch_expr, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            let switch_src = convert_expression_into(switch_expr, prog, context, &mut instrs)?;
             let switch_var = match switch_src {
                 Src::Var(var) => var,
                 Src::Constant(c) => {
@@ -275,6 +269,7 @@ fn convert_statement_to_ir(
             context.push_switch(SwitchContext::new(switch_end_label.to_owned(), switch_var));
             // convert switch body - ignore the return, because the instrs will
             // be stored into the SwitchContext, and we'll get them from there after
+            context.directly_in_switch_body = true;
             convert_statement_to_ir(*body, prog, context)?;
 
             let mut switch_context = context.pop_switch()?;
@@ -307,7 +302,8 @@ fn convert_statement_to_ir(
         Statement::Labelled(stmt) => {
             match stmt {
                 LabelledStatement::Named(Identifier(label_name), stmt) => {
-                    let label = prog.new_identifier_label(label_name);
+                    // the label might already exist, if there's a goto to it earlier in the function
+                    let label = get_identifier_label(label_name, prog, context);
                     instrs.push(Instruction::Label(prog.new_instr_id(), label));
                     instrs.append(&mut convert_statement_to_ir(*stmt, prog, context)?);
                 }
@@ -316,8 +312,16 @@ fn convert_statement_to_ir(
                     if !context.is_in_switch_context() {
                         return Err(MiddleEndError::CaseOutsideSwitchContext);
                     }
+                    // case labels are constant expressions, so try to evaluate them now so
+                    // they can be compared against directly
                     let (mut condition_instrs, expr_var) =
-                        convert_expression_to_ir(expr, prog, context)?;
+                        match eval_integral_constant_expression(expr.to_owned()) {
+                            Ok(case_value) => {
+                                (Vec::new(), Src::Constant(Constant::Int(case_value)))
+                            }
+                            // eg. enum constants, which the compile time evaluation doesn't resolve
+                            Err(_) => convert_expression_to_ir(expr, prog, context)?,
+                        };
                     let case_body_label = prog.new_label();
                     // check if case condition matches the switch expression
                     // if so, jump to the corresponding block
@@ -334,6 +338,7 @@ fn convert_statement_to_ir(
                     )?;
                     // start of case body - the result of this will be automatically pushed to
                     // the case block we just created, because we're in a switch context
+                    context.directly_in_switch_body = true;
                     convert_statement_to_ir(*stmt, prog, context)?;
                     return Ok(instrs);
                 }
@@ -347,14 +352,14 @@ fn convert_statement_to_ir(
                         Vec::new(),
                         &mut prog.program_metadata,
                     )?;
+                    context.directly_in_switch_body = true;
                     convert_statement_to_ir(*stmt, prog, context)?;
                     return Ok(instrs);
                 }
             }
         }
         Statement::Expr(e) => {
-            let (mut expr_instrs, _) = convert_expression_to_ir(e, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            convert_expression_into(e, prog, context, &mut instrs)?;
         }
         Statement::Declaration(sq, declarators) => {
             let mut is_initial_declarator = true;
@@ -409,11 +414,12 @@ fn convert_statement_to_ir(
                                                 Src::Constant(Constant::Int(size as i128))
                                             }
                                             TypeSize::Runtime(size_expr) => {
-                                                let (mut size_expr_instrs, size_var) =
-                                                    convert_expression_to_ir(
-                                                        size_expr, prog, context,
-                                                    )?;
-                                                instrs.append(&mut size_expr_instrs);
+                                                let size_var = convert_expression_into(
+                                                    size_expr,
+                                                    prog,
+                                                    context,
+                                                    &mut instrs,
+                                                )?;
                                                 size_var
                                             }
                                         };
@@ -477,9 +483,8 @@ fn convert_statement_to_ir(
                             Some(name) => {
                                 match init_expr {
                                     Initialiser::Expr(e) => {
-                                        let (mut expr_instrs, expr_var) =
-                                            convert_expression_to_ir(e, prog, context)?;
-                                        instrs.append(&mut expr_instrs);
+                                        let expr_var =
+                                            convert_expression_into(e, prog, context, &mut instrs)?;
                                         let mut src = match expr_var {
                                             Src::Var(var) => Src::Var(var),
                                             Src::Constant(c) => Src::Constant(c),
@@ -554,11 +559,12 @@ fn convert_statement_to_ir(
                                                     Src::Constant(Constant::Int(size as i128))
                                                 }
                                                 TypeSize::Runtime(size_expr) => {
-                                                    let (mut size_expr_instrs, size_var) =
-                                                        convert_expression_to_ir(
-                                                            size_expr, prog, context,
-                                                        )?;
-                                                    instrs.append(&mut size_expr_instrs);
+                                                    let size_var = convert_expression_into(
+                                                        size_expr,
+                                                        prog,
+                                                        context,
+                                                        &mut instrs,
+                                                    )?;
                                                     size_var
                                                 }
                                             };
@@ -597,11 +603,12 @@ fn convert_statement_to_ir(
                                                     Src::Constant(Constant::Int(size as i128))
                                                 }
                                                 TypeSize::Runtime(size_expr) => {
-                                                    let (mut size_expr_instrs, size_var) =
-                                                        convert_expression_to_ir(
-                                                            size_expr, prog, context,
-                                                        )?;
-                                                    instrs.append(&mut size_expr_instrs);
+                                                    let size_var = convert_expression_into(
+                                                        size_expr,
+                                                        prog,
+                                                        context,
+                                                        &mut instrs,
+                                                    )?;
                                                     size_var
                                                 }
                                             };
@@ -661,6 +668,7 @@ fn convert_statement_to_ir(
                 Some(n) => n,
             };
             context.push_scope();
+            context.clear_function_labels();
             // for each parameter, store which var it maps to
             let mut param_var_mappings: Vec<VarId> = Vec::new();
             // put parameter names into scope
@@ -691,7 +699,7 @@ fn convert_statement_to_ir(
         Statement::Empty => {}
     }
 
-    if context.is_in_switch_context() {
+    if this_stmt_directly_in_switch_body {
         context.push_instrs_to_switch_case_block(instrs)?;
         return Ok(Vec::new());
     }
@@ -699,6 +707,19 @@ fn convert_statement_to_ir(
     Ok(instrs)
 }
 
+/// Get the label for a named label in the current function, creating it if this is the
+/// first time it's referenced
+fn get_identifier_label(name: String, prog: &mut Program, context: &mut Context) -> LabelId {
+    match context.resolve_identifier_to_label(&name) {
+        Some(label) => label.to_owned(),
+        None => {
+            let label = prog.new_identifier_label(name.to_owned());
+            context.add_function_label(name, label.to_owned());
+            label
+        }
+    }
+}
+
 /// returns the list of instructions generated, and the name of the temp variable
 /// the result is assigned to
 pub fn convert_expression_to_ir(
@@ -707,6 +728,19 @@ pub fn convert_expression_to_ir(
     context: &mut Context,
 ) -> Result<(Vec<Instruction>, Src), MiddleEndError> {
     let mut instrs: Vec<Instruction> = Vec::new();
+    let src = convert_expression_into(src_expr, prog, context, &mut instrs)?;
+    Ok((instrs, src))
+}
+
+/// Appends the instructions generated for the expression to instrs, and returns the temp
+/// variable the result is assigned to. Subexpressions are converted straight into the same
+/// list, rather than each building its own list to be appended.
+pub fn convert_expression_into(
+    src_expr: Expression,
+    prog: &mut Program,
+    context: &mut Context,
+    instrs: &mut Vec<Instruction>,
+) -> Result<Src, MiddleEndError> {
     // this flag should only ever persist one level deep
     let this_expr_directly_on_lhs_of_assignment = context.directly_on_lhs_of_assignment;
     context.directly_on_lhs_of_assignment = false;
@@ -714,20 +748,20 @@ pub fn convert_expression_to_ir(
         Expression::Identifier(Identifier(name)) => {
             if context.in_function_name_expr {
                 let fun = context.resolve_identifier_to_fun(&name)?;
-                Ok((instrs, Src::Fun(fun)))
+                Ok(Src::Fun(fun))
             } else {
                 match context.resolve_identifier_to_var_or_const(&name)? {
-                    IdentifierResolveResult::Var(var) => Ok((instrs, Src::Var(var))),
+                    IdentifierResolveResult::Var(var) => Ok(Src::Var(var)),
                     IdentifierResolveResult::EnumConst(c) => {
-                        Ok((instrs, Src::Constant(Constant::Int(c as i128))))
+                        Ok(Src::Constant(Constant::Int(c as i128)))
                     }
                 }
             }
         }
         Expression::Constant(c) => match c {
-            ast::Constant::Int(i) => Ok((instrs, Src::Constant(Constant::Int(i as i128)))),
-            ast::Constant::Float(f) => Ok((instrs, Src::Constant(Constant::Float(f)))),
-            ast::Constant::Char(ch) => Ok((instrs, Src::Constant(Constant::Int(ch as i128)))),
+            ast::Constant::Int(i) => Ok(Src::Constant(Constant::Int(i as i128))),
+            ast::Constant::Float(f) => Ok(Src::Constant(Constant::Float(f))),
+            ast::Constant::Char(ch) => Ok(Src::Constant(Constant::Int(ch as i128))),
         },
         Expression::StringLiteral(s) => {
             let string_id = prog.new_string_literal(s);
@@ -739,13 +773,11 @@ pub fn convert_expression_to_ir(
             ));
             // dest has char * type
             prog.add_var_type(dest.to_owned(), IrType::PointerTo(Box::new(IrType::I8)))?;
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::Index(arr, index) => {
-            let (mut arr_instrs, arr_var) = convert_expression_to_ir(*arr, prog, context)?;
-            instrs.append(&mut arr_instrs);
-            let (mut index_instrs, index_var) = convert_expression_to_ir(*index, prog, context)?;
-            instrs.append(&mut index_instrs);
+            let arr_var = convert_expression_into(*arr, prog, context, instrs)?;
+            let index_var = convert_expression_into(*index, prog, context, instrs)?;
 
             // unary conversion
             let (mut unary_convert_arr_instrs, arr_var) = unary_convert(arr_var, prog)?;
@@ -790,9 +822,8 @@ pub fn convert_expression_to_ir(
             let byte_size_var = match element_byte_size {
                 TypeSize::CompileTime(byte_size) => Src::Constant(Constant::Int(byte_size as i128)),
                 TypeSize::Runtime(byte_size_expr) => {
-                    let (mut byte_size_instrs, byte_size_var) =
-                        convert_expression_to_ir(byte_size_expr, prog, context)?;
-                    instrs.append(&mut byte_size_instrs);
+                    let byte_size_var =
+                        convert_expression_into(byte_size_expr, prog, context, instrs)?;
                     byte_size_var
                 }
             };
@@ -821,7 +852,7 @@ pub fn convert_expression_to_ir(
             ));
             if this_expr_directly_on_lhs_of_assignment {
                 // store to array index
-                Ok((instrs, Src::StoreAddressVar(ptr)))
+                Ok(Src::StoreAddressVar(ptr))
             } else {
                 // read from array index
                 let dest = prog.new_var(ValueType::LValue);
@@ -831,13 +862,12 @@ pub fn convert_expression_to_ir(
                     dest.to_owned(),
                     Src::Var(ptr),
                 ));
-                Ok((instrs, Src::Var(dest)))
+                Ok(Src::Var(dest))
             }
         }
         Expression::FunctionCall(fun, params) => {
             context.in_function_name_expr = true;
-            let (mut fun_instrs, fun_var) = convert_expression_to_ir(*fun, prog, context)?;
-            instrs.append(&mut fun_instrs);
+            let fun_var = convert_expression_into(*fun, prog, context, instrs)?;
             context.in_function_name_expr = false;
 
             // unary conversion
@@ -849,9 +879,8 @@ pub fn convert_expression_to_ir(
 
             let mut param_srcs: Vec<Src> = Vec::new();
             for param in params {
-                let (mut param_instrs, param_var) = convert_expression_to_ir(param, prog, context)?;
+                let param_var = convert_expression_into(param, prog, context, instrs)?;
                 // todo function parameter passing type conversions
-                instrs.append(&mut param_instrs);
                 param_srcs.push(param_var);
             }
             let dest = prog.new_var(ValueType::RValue);
@@ -862,11 +891,10 @@ pub fn convert_expression_to_ir(
                 fun_id,
                 param_srcs,
             ));
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::DirectMemberSelection(obj, Identifier(member_name)) => {
-            let (mut obj_instrs, obj_var) = convert_expression_to_ir(*obj, prog, context)?;
-            instrs.append(&mut obj_instrs);
+            let obj_var = convert_expression_into(*obj, prog, context, instrs)?;
             let obj_var_type = obj_var.get_type(&prog.program_metadata)?;
             obj_var_type.require_struct_or_union_type()?;
 
@@ -903,7 +931,7 @@ pub fn convert_expression_to_ir(
 
                     if this_expr_directly_on_lhs_of_assignment {
                         // store to struct member
-                        Ok((instrs, Src::StoreAddressVar(ptr)))
+                        Ok(Src::StoreAddressVar(ptr))
                     } else {
                         // load from struct member
                         let dest = prog.new_var(ValueType::LValue);
@@ -914,7 +942,7 @@ pub fn convert_expression_to_ir(
                             dest.to_owned(),
                             Src::Var(ptr),
                         ));
-                        Ok((instrs, Src::Var(dest)))
+                        Ok(Src::Var(dest))
                     }
                 }
                 IrType::Union(union_id) => {
@@ -923,7 +951,7 @@ pub fn convert_expression_to_ir(
 
                     if this_expr_directly_on_lhs_of_assignment {
                         // store to union
-                        Ok((instrs, Src::StoreAddressVar(obj_ptr)))
+                        Ok(Src::StoreAddressVar(obj_ptr))
                     } else {
                         // load from union
                         let dest = prog.new_var(ValueType::LValue);
@@ -934,15 +962,14 @@ pub fn convert_expression_to_ir(
                             dest.to_owned(),
                             Src::Var(obj_ptr),
                         ));
-                        Ok((instrs, Src::Var(dest)))
+                        Ok(Src::Var(dest))
                     }
                 }
                 _ => unreachable!(),
             }
         }
         Expression::IndirectMemberSelection(obj, Identifier(member_name)) => {
-            let (mut obj_instrs, obj_var) = convert_expression_to_ir(*obj, prog, context)?;
-            instrs.append(&mut obj_instrs);
+            let obj_var = convert_expression_into(*obj, prog, context, instrs)?;
             let obj_var_type = obj_var.get_type(&prog.program_metadata)?;
             obj_var_type.require_pointer_type()?;
             let inner_type = obj_var_type.dereference_pointer_type()?;
@@ -968,7 +995,7 @@ pub fn convert_expression_to_ir(
 
                     if this_expr_directly_on_lhs_of_assignment {
                         // store to struct member
-                        Ok((instrs, Src::StoreAddressVar(ptr)))
+                        Ok(Src::StoreAddressVar(ptr))
                     } else {
                         // load from struct member
                         let dest = prog.new_var(ValueType::LValue);
@@ -979,7 +1006,7 @@ pub fn convert_expression_to_ir(
                             dest.to_owned(),
                             Src::Var(ptr),
                         ));
-                        Ok((instrs, Src::Var(dest)))
+                        Ok(Src::Var(dest))
                     }
                 }
                 IrType::Union(union_id) => {
@@ -988,7 +1015,7 @@ pub fn convert_expression_to_ir(
 
                     if this_expr_directly_on_lhs_of_assignment {
                         // store to union
-                        Ok((instrs, Src::StoreAddressVar(obj_var.unwrap_var()?)))
+                        Ok(Src::StoreAddressVar(obj_var.unwrap_var()?))
                     } else {
                         // load from union
                         let dest = prog.new_var(ValueType::LValue);
@@ -999,7 +1026,7 @@ pub fn convert_expression_to_ir(
                             dest.to_owned(),
                             obj_var,
                         ));
-                        Ok((instrs, Src::Var(dest)))
+                        Ok(Src::Var(dest))
                     }
                 }
                 _ => unreachable!(),
@@ -1007,9 +1034,8 @@ pub fn convert_expression_to_ir(
         }
         Expression::PostfixIncrement(expr) => {
             context.directly_on_lhs_of_assignment = true;
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             context.directly_on_lhs_of_assignment = false;
-            instrs.append(&mut expr_instrs);
             let dest = prog.new_var(ValueType::RValue);
             // propagate the type of dest: same as src
             let (mut unary_convert_instrs, expr_var) = unary_convert(expr_var, prog)?;
@@ -1081,13 +1107,12 @@ pub fn convert_expression_to_ir(
                 }
                 _ => return Err(MiddleEndError::InvalidLValue),
             }
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::PostfixDecrement(expr) => {
             context.directly_on_lhs_of_assignment = true;
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             context.directly_on_lhs_of_assignment = false;
-            instrs.append(&mut expr_instrs);
             let dest = prog.new_var(ValueType::RValue);
             // propagate the type of dest: same as src
             let (mut unary_convert_instrs, expr_var) = unary_convert(expr_var, prog)?;
@@ -1159,13 +1184,12 @@ pub fn convert_expression_to_ir(
                 }
                 _ => return Err(MiddleEndError::InvalidLValue),
             }
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::PrefixIncrement(expr) => {
             context.directly_on_lhs_of_assignment = true;
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             context.directly_on_lhs_of_assignment = false;
-            instrs.append(&mut expr_instrs);
             // make sure the result is an rvalue
             let dest = prog.new_var(ValueType::RValue);
             // expr_var is the variable returned, after incrementing
@@ -1242,13 +1266,12 @@ pub fn convert_expression_to_ir(
                 }
                 _ => return Err(MiddleEndError::InvalidLValue),
             }
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::PrefixDecrement(expr) => {
             context.directly_on_lhs_of_assignment = true;
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             context.directly_on_lhs_of_assignment = false;
-            instrs.append(&mut expr_instrs);
             // make sure the result is an rvalue
             let dest = prog.new_var(ValueType::RValue);
             // expr_var is the variable returned, after decrementing
@@ -1325,11 +1348,10 @@ pub fn convert_expression_to_ir(
                 }
                 _ => return Err(MiddleEndError::InvalidLValue),
             }
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::UnaryOp(UnaryOperator::AddressOf, expr) => {
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             let expr_var_type = expr_var.get_type(&prog.program_metadata)?;
             let dest = prog.new_var(ValueType::RValue);
             instrs.push(Instruction::AddressOf(
@@ -1339,11 +1361,10 @@ pub fn convert_expression_to_ir(
             ));
             // store type of dest
             prog.add_var_type(dest.to_owned(), IrType::PointerTo(Box::new(expr_var_type)))?;
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::UnaryOp(UnaryOperator::Dereference, expr) => {
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             let expr_var_type = expr_var.get_type(&prog.program_metadata)?;
             if this_expr_directly_on_lhs_of_assignment {
                 // store to memory address
@@ -1351,7 +1372,7 @@ pub fn convert_expression_to_ir(
                     IrType::PointerTo(_) => {
                         // prog.add_var_type(dest.to_owned(), expr_var_type)?;
                         match expr_var {
-                            Src::Var(expr_var) => Ok((instrs, Src::StoreAddressVar(expr_var))),
+                            Src::Var(expr_var) => Ok(Src::StoreAddressVar(expr_var)),
                             _ => Err(MiddleEndError::AttemptToStoreToNonVariable),
                         }
                     }
@@ -1373,12 +1394,11 @@ pub fn convert_expression_to_ir(
                     }
                     _ => return Err(MiddleEndError::DereferenceNonPointerType(expr_var_type)),
                 }
-                Ok((instrs, Src::Var(dest)))
+                Ok(Src::Var(dest))
             }
         }
         Expression::UnaryOp(op, expr) => {
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             // unary convert type if necessary
             let (mut unary_convert_instrs, expr_var) = unary_convert(expr_var, prog)?;
             instrs.append(&mut unary_convert_instrs);
@@ -1389,7 +1409,7 @@ pub fn convert_expression_to_ir(
                 //     instrs.push(Instruction::AddressOf(dest.to_owned(), expr_var));
                 //     // store type of dest
                 //     prog.add_var_type(dest.to_owned(), Box::new(IrType::PointerTo(expr_var_type)))?;
-                //     Ok((instrs, Src::Var(dest)))
+                //     Ok(Src::Var(dest))
                 // }
                 // UnaryOperator::Dereference => {
                 //     if this_expr_directly_on_lhs_of_assignment {
@@ -1399,7 +1419,7 @@ pub fn convert_expression_to_ir(
                 //                 // prog.add_var_type(dest.to_owned(), expr_var_type)?;
                 //                 match expr_var {
                 //                     Src::Var(expr_var) => {
-                //                         Ok((instrs, Src::StoreAddressVar(expr_var)))
+                //                         Ok(Src::StoreAddressVar(expr_var))
                 //                     }
                 //                     _ => return Err(MiddleEndError::AttemptToStoreToNonVariable),
                 //                 }
@@ -1426,7 +1446,7 @@ pub fn convert_expression_to_ir(
                 //                 ))
                 //             }
                 //         }
-                //         Ok((instrs, Src::Var(dest)))
+                //         Ok(Src::Var(dest))
                 //     }
                 // }
                 UnaryOperator::Plus => {
@@ -1444,7 +1464,7 @@ pub fn convert_expression_to_ir(
                     }
                     // type of dest is same as type of src
                     prog.add_var_type(dest.to_owned(), expr_var_type)?;
-                    Ok((instrs, Src::Var(dest)))
+                    Ok(Src::Var(dest))
                 }
                 UnaryOperator::Minus => {
                     let dest = prog.new_var(ValueType::RValue);
@@ -1461,7 +1481,7 @@ pub fn convert_expression_to_ir(
                     }
                     let dest_type = expr_var_type.smallest_signed_equivalent()?;
                     prog.add_var_type(dest.to_owned(), dest_type)?;
-                    Ok((instrs, Src::Var(dest)))
+                    Ok(Src::Var(dest))
                 }
                 UnaryOperator::BitwiseNot => {
                     let dest = prog.new_var(ValueType::RValue);
@@ -1477,7 +1497,7 @@ pub fn convert_expression_to_ir(
                     }
                     // dest type is same as src
                     prog.add_var_type(dest.to_owned(), expr_var_type)?;
-                    Ok((instrs, Src::Var(dest)))
+                    Ok(Src::Var(dest))
                 }
                 UnaryOperator::LogicalNot => {
                     let dest = prog.new_var(ValueType::RValue);
@@ -1493,14 +1513,13 @@ pub fn convert_expression_to_ir(
                     }
                     // dest type is same as src
                     prog.add_var_type(dest.to_owned(), expr_var_type)?;
-                    Ok((instrs, Src::Var(dest)))
+                    Ok(Src::Var(dest))
                 }
                 _ => unreachable!("other cases handled separately"),
             }
         }
         Expression::SizeOfExpr(e) => {
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*e, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            let expr_var = convert_expression_into(*e, prog, context, instrs)?;
             let expr_var_type = expr_var.get_type(&prog.program_metadata)?;
 
             let type_size = if expr_var_type.is_array_type() {
@@ -1511,9 +1530,7 @@ pub fn convert_expression_to_ir(
             let size = match type_size {
                 TypeSize::CompileTime(size) => Src::Constant(Constant::Int(size as i128)),
                 TypeSize::Runtime(size_expr) => {
-                    let (mut size_expr_instrs, size_var) =
-                        convert_expression_to_ir(size_expr, prog, context)?;
-                    instrs.append(&mut size_expr_instrs);
+                    let size_var = convert_expression_into(size_expr, prog, context, instrs)?;
                     size_var
                 }
             };
@@ -1524,7 +1541,7 @@ pub fn convert_expression_to_ir(
                 dest.to_owned(),
                 size,
             ));
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::SizeOfType(t) => {
             let (type_info, _, _) = match get_type_info(&t.0, t.1, false, prog, context)? {
@@ -1539,9 +1556,7 @@ pub fn convert_expression_to_ir(
             let byte_size = match type_size {
                 TypeSize::CompileTime(size) => Src::Constant(Constant::Int(size as i128)),
                 TypeSize::Runtime(size_expr) => {
-                    let (mut size_expr_instrs, size_var) =
-                        convert_expression_to_ir(size_expr, prog, context)?;
-                    instrs.append(&mut size_expr_instrs);
+                    let size_var = convert_expression_into(size_expr, prog, context, instrs)?;
                     size_var
                 }
             };
@@ -1552,13 +1567,11 @@ pub fn convert_expression_to_ir(
                 dest.to_owned(),
                 byte_size,
             ));
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::BinaryOp(op, left, right) => {
-            let (mut left_instrs, left_var) = convert_expression_to_ir(*left, prog, context)?;
-            instrs.append(&mut left_instrs);
-            let (mut right_instrs, right_var) = convert_expression_to_ir(*right, prog, context)?;
-            instrs.append(&mut right_instrs);
+            let left_var = convert_expression_into(*left, prog, context, instrs)?;
+            let right_var = convert_expression_into(*right, prog, context, instrs)?;
             let dest = prog.new_var(ValueType::RValue);
             let left_var_type = left_var.get_type(&prog.program_metadata)?;
             let right_var_type = right_var.get_type(&prog.program_metadata)?;
@@ -1653,9 +1666,8 @@ pub fn convert_expression_to_ir(
                                 Src::Constant(Constant::Int(size as i128))
                             }
                             TypeSize::Runtime(size_expr) => {
-                                let (mut size_expr_instrs, size_var) =
-                                    convert_expression_to_ir(size_expr, prog, context)?;
-                                instrs.append(&mut size_expr_instrs);
+                                let size_var =
+                                    convert_expression_into(size_expr, prog, context, instrs)?;
                                 size_var
                             }
                         };
@@ -1708,9 +1720,8 @@ pub fn convert_expression_to_ir(
                                 Src::Constant(Constant::Int(size as i128))
                             }
                             TypeSize::Runtime(size_expr) => {
-                                let (mut size_expr_instrs, size_var) =
-                                    convert_expression_to_ir(size_expr, prog, context)?;
-                                instrs.append(&mut size_expr_instrs);
+                                let size_var =
+                                    convert_expression_into(size_expr, prog, context, instrs)?;
                                 size_var
                             }
                         };
@@ -1995,11 +2006,10 @@ pub fn convert_expression_to_ir(
                     ));
                 }
             }
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::Ternary(cond, true_expr, false_expr) => {
-            let (mut cond_instrs, cond_var) = convert_expression_to_ir(*cond, prog, context)?;
-            instrs.append(&mut cond_instrs);
+            let cond_var = convert_expression_into(*cond, prog, context, instrs)?;
             let dest = prog.new_var(ValueType::RValue);
             let false_label = prog.new_label();
             let end_label = prog.new_label();
@@ -2011,8 +2021,7 @@ pub fn convert_expression_to_ir(
                 false_label.to_owned(),
             ));
             // if condition true, fall through to the true instructions
-            let (mut true_instrs, true_var) = convert_expression_to_ir(*true_expr, prog, context)?;
-            instrs.append(&mut true_instrs);
+            let true_var = convert_expression_into(*true_expr, prog, context, instrs)?;
             // unary convert result of the expression
             let (mut unary_convert_true_instrs, mut true_var) = unary_convert(true_var, prog)?;
             instrs.append(&mut unary_convert_true_instrs);
@@ -2062,19 +2071,15 @@ pub fn convert_expression_to_ir(
             ));
             instrs.push(Instruction::Label(prog.new_instr_id(), end_label));
 
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::Assignment(dest_expr, src_expr) => {
-            let (mut src_expr_instrs, mut src_var) =
-                convert_expression_to_ir(*src_expr, prog, context)?;
-            instrs.append(&mut src_expr_instrs);
+            let mut src_var = convert_expression_into(*src_expr, prog, context, instrs)?;
             let src_var_type = src_var.get_type(&prog.program_metadata)?;
 
             context.directly_on_lhs_of_assignment = true;
-            let (mut dest_expr_instrs, dest_var) =
-                convert_expression_to_ir(*dest_expr, prog, context)?;
+            let dest_var = convert_expression_into(*dest_expr, prog, context, instrs)?;
             context.directly_on_lhs_of_assignment = false;
-            instrs.append(&mut dest_expr_instrs);
 
             // check that we're assigning to an lvalue
             if !dest_var.get_value_type().is_lvalue() {
@@ -2119,11 +2124,10 @@ pub fn convert_expression_to_ir(
                     src_var,
                 ));
             }
-            Ok((instrs, Src::Var(dest)))
+            Ok(Src::Var(dest))
         }
         Expression::Cast(cast_type_decl, expr) => {
-            let (mut expr_instrs, expr_var) = convert_expression_to_ir(*expr, prog, context)?;
-            instrs.append(&mut expr_instrs);
+            let expr_var = convert_expression_into(*expr, prog, context, instrs)?;
             // get type to cast into
             let (cast_type, _, _) =
                 match get_type_info(&cast_type_decl.0, cast_type_decl.1, false, prog, context)? {
@@ -2135,7 +2139,7 @@ pub fn convert_expression_to_ir(
             let (mut cast_instrs, dest) =
                 get_type_conversion_instrs(expr_var, expr_var_type, cast_type, prog)?;
             instrs.append(&mut cast_instrs);
-            Ok((instrs, dest))
+            Ok(dest)
         }
         Expression::ExpressionList(_, _) => {
             todo!("expression lists")
@@ -2,6 +2,7 @@ use std::collections::HashMap;
 
 use log::trace;
 
+use crate::data_structures::id_map::IdMap;
 use crate::middle_end::ids::{FunId, LabelId, StructId, UnionId, VarId};
 use crate::middle_end::instructions::Instruction;
 use crate::middle_end::ir::ProgramMetadata;
@@ -14,7 +15,12 @@ pub struct Context {
     scope_stack: Vec<Scope>,
     pub in_function_name_expr: bool,
     function_names: HashMap<String, FunId>,
+    /// Named labels in the current function, for goto statements
+    function_labels: HashMap<String, LabelId>,
     pub directly_on_lhs_of_assignment: bool,
+    pub directly_in_switch_body: bool,
+    /// The source name of every variable that has been declared, whatever scope it's in
+    pub var_names: IdMap<VarId, String>,
 }
 
 pub enum IdentifierResolveResult {
@@ -29,7 +35,10 @@ impl Context {
             scope_stack: vec![Scope::new()], // start with a global scope
             in_function_name_expr: false,
             function_names: HashMap::new(),
+            function_labels: HashMap::new(),
             directly_on_lhs_of_assignment: false,
+            directly_in_switch_body: false,
+            var_names: IdMap::new(),
         }
     }
 
@@ -217,6 +226,7 @@ impl Context {
         type_info: IrType,
     ) -> Result<(), MiddleEndError> {
         trace!("adding variable \"{}\" to scope", name);
+        self.var_names.insert(var.to_owned(), name.to_owned());
         match self.scope_stack.last_mut() {
             None => Err(MiddleEndError::ScopeError),
             Some(scope) => scope.add_var(name, var, type_info),
@@ -422,6 +432,20 @@ impl Context {
         }
     }
 
+    /// Label names are scoped to the function they're in, so forget the labels of the
+    /// previous function
+    pub fn clear_function_labels(&mut self) {
+        self.function_labels.clear();
+    }
+
+    pub fn add_function_label(&mut self, name: String, label: LabelId) {
+        self.function_labels.insert(name, label);
+    }
+
+    pub fn resolve_identifier_to_label(&self, name: &str) -> Option<&LabelId> {
+        self.function_labels.get(name)
+    }
+
     pub fn add_typedef(
         &mut self,
         typedef_name: String,
@@ -213,3 +213,27 @@ impl fmt::Display for UnionId {
         write!(f, "union{}", self.0)
     }
 }
+
+/// A type interned in the program metadata
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct TypeId(u64);
+
+impl Id for TypeId {
+    fn initial_id() -> Self {
+        TypeId(0)
+    }
+
+    fn next_id(&self) -> Self {
+        TypeId(self.0 + 1)
+    }
+
+    fn as_u64(&self) -> u64 {
+        self.0
+    }
+}
+
+impl fmt::Display for TypeId {
+    fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
+        write!(f, "t{}", self.0)
+    }
+}
@@ -7,7 +7,7 @@ use crate::middle_end::ir_types::IrType;
 use crate::middle_end::middle_end_error::MiddleEndError;
 use crate::relooper::blocks::{LoopBlockId, MultipleBlockId};
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq)]
 pub enum Constant {
     Int(i128),
     Float(f64),
@@ -76,9 +76,9 @@ pub enum Src {
 impl Src {
     pub fn get_type(&self, prog_metadata: &ProgramMetadata) -> Result<IrType, MiddleEndError> {
         match self {
-            Src::Var(var) | Src::StoreAddressVar(var) => prog_metadata.get_var_type(var),
+            Src::Var(var) | Src::StoreAddressVar(var) => prog_metadata.get_var_type(var).cloned(),
             Src::Constant(c) => Ok(c.get_type(None)),
-            Src::Fun(fun_id) => prog_metadata.get_fun_type(fun_id),
+            Src::Fun(fun_id) => prog_metadata.get_fun_type(fun_id).cloned(),
         }
     }
 
@@ -102,7 +102,7 @@ impl Src {
     pub fn get_function_return_type(&self, prog: &Program) -> Result<IrType, MiddleEndError> {
         match self {
             Src::Fun(fun_id) => match prog.get_fun_type(fun_id)? {
-                IrType::Function(ret_type, _, _) => Ok(*ret_type),
+                IrType::Function(ret_type, _, _) => Ok(ret_type.as_ref().to_owned()),
                 _ => Err(MiddleEndError::UnwrapNonFunctionType),
             },
             _ => Err(MiddleEndError::UnwrapNonFunctionType),
@@ -141,6 +141,8 @@ pub enum Instruction {
     LoadFromAddress(InstructionId, Dest, Src),
     // addr <- x
     StoreToAddress(InstructionId, Dest, Src),
+    // set n bytes starting at addr to zero
+    ZeroMemory(InstructionId, Dest, u64),
 
     DeclareVariable(InstructionId, Dest),
     AllocateVariable(InstructionId, Dest, Src),
@@ -184,6 +186,9 @@ pub enum Instruction {
     Br(InstructionId, LabelId),
     BrIfEq(InstructionId, Src, Src, LabelId),
     BrIfNotEq(InstructionId, Src, Src, LabelId),
+    // jump table: execute arm table[src], or the last arm (the default) if src is out of
+    // range. Before relooping, each arm is a single Br instruction
+    BrTable(InstructionId, Src, Vec<usize>, Vec<Vec<Instruction>>),
     PointerToStringLiteral(InstructionId, Dest, StringLiteralId),
 
     // char promotions
@@ -268,6 +273,7 @@ impl Instruction {
             Instruction::SimpleAssignment(id, _, _)
             | Instruction::LoadFromAddress(id, _, _)
             | Instruction::StoreToAddress(id, _, _)
+            | Instruction::ZeroMemory(id, _, _)
             | Instruction::DeclareVariable(id, _)
             | Instruction::AllocateVariable(id, _, _)
             | Instruction::ReferenceVariable(id, ..)
@@ -299,6 +305,7 @@ impl Instruction {
             | Instruction::Br(id, _)
             | Instruction::BrIfEq(id, _, _, _)
             | Instruction::BrIfNotEq(id, _, _, _)
+            | Instruction::BrTable(id, _, _, _)
             | Instruction::PointerToStringLiteral(id, _, _)
             | Instruction::I8toI16(id, _, _)
             | Instruction::I8toU16(id, _, _)
@@ -345,6 +352,91 @@ impl Instruction {
             | Instruction::IfNotEqElse(id, _, _, _, _) => id.to_owned(),
         }
     }
+
+    pub fn set_instr_id(&mut self, new_id: InstructionId) {
+        match self {
+            Instruction::SimpleAssignment(id, _, _)
+            | Instruction::LoadFromAddress(id, _, _)
+            | Instruction::StoreToAddress(id, _, _)
+            | Instruction::ZeroMemory(id, _, _)
+            | Instruction::DeclareVariable(id, _)
+            | Instruction::AllocateVariable(id, _, _)
+            | Instruction::ReferenceVariable(id, ..)
+            | Instruction::AddressOf(id, _, _)
+            | Instruction::BitwiseNot(id, _, _)
+            | Instruction::LogicalNot(id, _, _)
+            | Instruction::Mult(id, _, _, _)
+            | Instruction::Div(id, _, _, _)
+            | Instruction::Mod(id, _, _, _)
+            | Instruction::Add(id, _, _, _)
+            | Instruction::Sub(id, _, _, _)
+            | Instruction::LeftShift(id, _, _, _)
+            | Instruction::RightShift(id, _, _, _)
+            | Instruction::BitwiseAnd(id, _, _, _)
+            | Instruction::BitwiseOr(id, _, _, _)
+            | Instruction::BitwiseXor(id, _, _, _)
+            | Instruction::LogicalAnd(id, _, _, _)
+            | Instruction::LogicalOr(id, _, _, _)
+            | Instruction::LessThan(id, _, _, _)
+            | Instruction::GreaterThan(id, _, _, _)
+            | Instruction::LessThanEq(id, _, _, _)
+            | Instruction::GreaterThanEq(id, _, _, _)
+            | Instruction::Equal(id, _, _, _)
+            | Instruction::NotEqual(id, _, _, _)
+            | Instruction::Call(id, _, _, _)
+            | Instruction::TailCall(id, _, _)
+            | Instruction::Ret(id, _)
+            | Instruction::Label(id, _)
+            | Instruction::Br(id, _)
+            | Instruction::BrIfEq(id, _, _, _)
+            | Instruction::BrIfNotEq(id, _, _, _)
+            | Instruction::BrTable(id, _, _, _)
+            | Instruction::PointerToStringLiteral(id, _, _)
+            | Instruction::I8toI16(id, _, _)
+            | Instruction::I8toU16(id, _, _)
+            | Instruction::U8toI16(id, _, _)
+            | Instruction::U8toU16(id, _, _)
+            | Instruction::I16toI32(id, _, _)
+            | Instruction::U16toI32(id, _, _)
+            | Instruction::I16toU32(id, _, _)
+            | Instruction::U16toU32(id, _, _)
+            | Instruction::I32toU32(id, _, _)
+            | Instruction::I32toU64(id, _, _)
+            | Instruction::U32toU64(id, _, _)
+            | Instruction::I64toU64(id, _, _)
+            | Instruction::I32toI64(id, _, _)
+            | Instruction::U32toI64(id, _, _)
+            | Instruction::U32toF32(id, _, _)
+            | Instruction::I32toF32(id, _, _)
+            | Instruction::U64toF32(id, _, _)
+            | Instruction::I64toF32(id, _, _)
+            | Instruction::U32toF64(id, _, _)
+            | Instruction::I32toF64(id, _, _)
+            | Instruction::U64toF64(id, _, _)
+            | Instruction::I64toF64(id, _, _)
+            | Instruction::F32toF64(id, _, _)
+            | Instruction::F64toI32(id, _, _)
+            | Instruction::I32toI8(id, _, _)
+            | Instruction::U32toI8(id, _, _)
+            | Instruction::I64toI8(id, _, _)
+            | Instruction::U64toI8(id, _, _)
+            | Instruction::I32toU8(id, _, _)
+            | Instruction::U32toU8(id, _, _)
+            | Instruction::I64toU8(id, _, _)
+            | Instruction::U64toU8(id, _, _)
+            | Instruction::I64toI32(id, _, _)
+            | Instruction::U64toI32(id, _, _)
+            | Instruction::U32toPtr(id, _, _)
+            | Instruction::I32toPtr(id, _, _)
+            | Instruction::PtrToI32(id, _, _)
+            | Instruction::Nop(id)
+            | Instruction::Break(id, _)
+            | Instruction::Continue(id, _)
+            | Instruction::EndHandledBlock(id, _)
+            | Instruction::IfEqElse(id, _, _, _, _)
+            | Instruction::IfNotEqElse(id, _, _, _, _) => *id = new_id,
+        }
+    }
 }
 
 impl fmt::Display for Instruction {
@@ -362,6 +454,9 @@ impl fmt::Display for Instruction {
             Instruction::StoreToAddress(id, dest, src) => {
                 write!(f, "[{id}] *{dest} <- {src}")
             }
+            Instruction::ZeroMemory(id, dest, byte_size) => {
+                write!(f, "[{id}] zero {byte_size} bytes at {dest}")
+            }
             Instruction::AllocateVariable(id, dest, size) => {
                 write!(f, "[{id}] allocate {size} bytes for {dest}")
             }
@@ -465,6 +560,17 @@ impl fmt::Display for Instruction {
             Instruction::BrIfNotEq(id, left, right, label) => {
                 write!(f, "[{id}] if {left} != {right} goto {label}")
             }
+            Instruction::BrTable(id, src, table, arms) => {
+                write!(f, "[{id}] br_table {src} {table:?} ")?;
+                for (arm_i, arm) in arms.iter().enumerate() {
+                    write!(f, "{arm_i}: {{ ")?;
+                    for instr in arm {
+                        write!(f, "{instr}; ")?;
+                    }
+                    write!(f, "}} ")?;
+                }
+                write!(f, "")
+            }
             Instruction::PointerToStringLiteral(id, dest, string_id) => {
                 write!(f, "[{id}] {dest} = pointer to string literal {string_id}")
             }
@@ -564,12 +670,39 @@ pub fn remove_instr_from_instr_list(
                     return true;
                 }
             }
+            Instruction::BrTable(_, _, _, arms) => {
+                for arm in arms {
+                    if remove_instr_from_instr_list(instr_id, arm) {
+                        return true;
+                    }
+                }
+            }
             _ => {}
         }
     }
     false
 }
 
+/// Calls f on every instruction in the list, including the instructions nested inside others
+pub fn for_each_instr_in_list(instrs: &[Instruction], f: &mut impl FnMut(&Instruction)) {
+    for instr in instrs {
+        f(instr);
+        match instr {
+            Instruction::IfEqElse(_, _, _, instrs1, instrs2)
+            | Instruction::IfNotEqElse(_, _, _, instrs1, instrs2) => {
+                for_each_instr_in_list(instrs1, f);
+                for_each_instr_in_list(instrs2, f);
+            }
+            Instruction::BrTable(_, _, _, arms) => {
+                for arm in arms {
+                    for_each_instr_in_list(arm, f);
+                }
+            }
+            _ => {}
+        }
+    }
+}
+
 /// Returns true if the instruction was successfully found and replaced with
 /// the new instruction
 pub fn replace_instr_from_instr_list(
@@ -593,6 +726,13 @@ pub fn replace_instr_from_instr_list(
                     return true;
                 }
             }
+            Instruction::BrTable(_, _, _, arms) => {
+                for arm in arms {
+                    if replace_instr_from_instr_list(instr_id, new_instr.to_owned(), arm) {
+                        return true;
+                    }
+                }
+            }
             _ => {}
         }
     }
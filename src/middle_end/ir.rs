@@ -1,16 +1,20 @@
 use std::collections::HashMap;
 use std::fmt;
 use std::fmt::Formatter;
+use std::ops::Range;
+use std::sync::OnceLock;
 
 use log::{debug, trace};
 
-use crate::id::IdGenerator;
+use crate::data_structures::id_map::IdMap;
+use crate::id::{Id, IdGenerator};
 use crate::middle_end::ids::{
-    FunId, InstructionId, LabelId, StringLiteralId, StructId, UnionId, ValueType, VarId,
+    FunId, InstructionId, LabelId, StringLiteralId, StructId, TypeId, UnionId, ValueType, VarId,
 };
 use crate::middle_end::instructions::{Dest, Instruction};
-use crate::middle_end::ir_types::{IrType, StructType, UnionType};
+use crate::middle_end::ir_types::{IrType, StructType, TypeSize, UnionType};
 use crate::middle_end::middle_end_error::MiddleEndError;
+use crate::program_config::profile_data::ProfileData;
 use crate::program_config::program_constants::MAIN_FUNCTION_SOURCE_NAME;
 
 #[derive(Debug)]
@@ -88,10 +92,20 @@ impl ProgramInstructions {
         self.functions.insert(fun_id, fun);
     }
 
-    fn get_fun_type(&self, fun_id: &FunId) -> Result<IrType, MiddleEndError> {
+    /// The total number of instructions in the global instructions and all function bodies
+    pub fn instruction_count(&self) -> usize {
+        self.global_instrs.len()
+            + self
+                .functions
+                .values()
+                .map(|fun| fun.instrs.len())
+                .sum::<usize>()
+    }
+
+    fn get_fun_type(&self, fun_id: &FunId) -> Result<&IrType, MiddleEndError> {
         match self.functions.get(fun_id) {
             None => Err(MiddleEndError::FunctionNotFoundForId(fun_id.to_owned())),
-            Some(fun) => Ok(fun.type_info.to_owned()),
+            Some(fun) => Ok(&fun.type_info),
         }
     }
 }
@@ -111,6 +125,13 @@ impl fmt::Display for ProgramInstructions {
     }
 }
 
+/// A type stored in the program metadata, with its byte size once it's been worked out
+#[derive(Debug)]
+struct InternedType {
+    ir_type: IrType,
+    byte_size: OnceLock<TypeSize>,
+}
+
 #[derive(Debug)]
 pub struct ProgramMetadata {
     instr_id_generator: IdGenerator<InstructionId>,
@@ -120,16 +141,31 @@ pub struct ProgramMetadata {
     string_literal_id_generator: IdGenerator<StringLiteralId>,
     struct_id_generator: IdGenerator<StructId>,
     union_id_generator: IdGenerator<UnionId>,
+    type_id_generator: IdGenerator<TypeId>,
+    // every distinct type used by a var or function, indexed by type id
+    types: Vec<InternedType>,
+    type_ids: HashMap<IrType, TypeId>,
     pub label_ids: HashMap<String, LabelId>,
     pub function_ids: HashMap<String, FunId>,
-    pub function_types: HashMap<FunId, IrType>,
+    pub function_types: IdMap<FunId, TypeId>,
     pub function_param_var_mappings: HashMap<FunId, Vec<VarId>>,
-    pub string_literals: HashMap<StringLiteralId, String>,
-    pub var_types: HashMap<VarId, IrType>,
+    /// Each distinct string literal, which every occurrence of it points to
+    pub string_literals: IdMap<StringLiteralId, String>,
+    string_literal_ids: HashMap<String, StringLiteralId>,
+    pub var_types: IdMap<VarId, TypeId>,
+    /// The names of the vars declared in the source, for debugging info in the output
+    pub var_names: IdMap<VarId, String>,
     pub structs: HashMap<StructId, StructType>,
     pub unions: HashMap<UnionId, UnionType>,
     pub enum_member_values: HashMap<String, u64>,
     pub null_dest_var: Option<Dest>,
+    /// The execution counts to optimise for, when compiling with --pgo
+    pub profile: Option<ProfileData>,
+    /// The label ids of each function. The relooper renumbers a function's labels to be
+    /// consecutive, so a label is identified across compiles by its position in the range
+    pub function_label_ranges: HashMap<FunId, Range<u64>>,
+    /// How many times each label was executed in the profile, filled in by the relooper
+    pub label_counts: HashMap<LabelId, u64>,
 }
 
 impl ProgramMetadata {
@@ -142,16 +178,24 @@ impl ProgramMetadata {
             string_literal_id_generator: IdGenerator::new(),
             struct_id_generator: IdGenerator::new(),
             union_id_generator: IdGenerator::new(),
+            type_id_generator: IdGenerator::new(),
+            types: Vec::new(),
+            type_ids: HashMap::new(),
             label_ids: HashMap::new(),
             function_ids: HashMap::new(),
-            function_types: HashMap::new(),
+            function_types: IdMap::new(),
             function_param_var_mappings: HashMap::new(),
-            string_literals: HashMap::new(),
-            var_types: HashMap::new(),
+            string_literals: IdMap::new(),
+            string_literal_ids: HashMap::new(),
+            var_types: IdMap::new(),
+            var_names: IdMap::new(),
             structs: HashMap::new(),
             unions: HashMap::new(),
             enum_member_values: HashMap::new(),
             null_dest_var: None,
+            profile: None,
+            function_label_ranges: HashMap::new(),
+            label_counts: HashMap::new(),
         }
     }
 
@@ -181,26 +225,78 @@ impl ProgramMetadata {
         new_var
     }
 
+    /// Identical string literals share the same id, so they're only stored once
     pub fn new_string_literal(&mut self, s: String) -> StringLiteralId {
+        if let Some(string_id) = self.string_literal_ids.get(&s) {
+            return string_id.to_owned();
+        }
         let new_string_id = self.string_literal_id_generator.new_id();
+        self.string_literal_ids
+            .insert(s.to_owned(), new_string_id.to_owned());
         self.string_literals.insert(new_string_id.to_owned(), s);
         new_string_id
     }
 
     pub fn add_var_type(&mut self, var: VarId, var_type: IrType) -> Result<(), MiddleEndError> {
-        trace!("Setting type {} = {}", var, var_type);
+        let type_id = self.intern_type(var_type);
+        self.add_var_type_id(var, type_id)
+    }
+
+    /// Set the type of a var to a type that's already been interned, eg. to give a new var
+    /// the same type as an existing one
+    pub fn add_var_type_id(&mut self, var: VarId, type_id: TypeId) -> Result<(), MiddleEndError> {
+        trace!("Setting type {} = {}", var, self.get_type(type_id));
         if self.var_types.contains_key(&var) {
             return Err(MiddleEndError::RedeclaredVarType(var));
         }
-        self.var_types.insert(var, var_type);
+        self.var_types.insert(var, type_id);
         Ok(())
     }
 
-    pub fn get_var_type(&self, var: &VarId) -> Result<IrType, MiddleEndError> {
+    pub fn get_var_type(&self, var: &VarId) -> Result<&IrType, MiddleEndError> {
+        Ok(self.get_type(self.get_var_type_id(var)?))
+    }
+
+    pub fn get_var_type_id(&self, var: &VarId) -> Result<TypeId, MiddleEndError> {
         match self.var_types.get(var) {
             None => Err(MiddleEndError::TypeNotFound),
-            Some(t) => Ok(t.to_owned()),
+            Some(type_id) => Ok(*type_id),
+        }
+    }
+
+    pub fn get_var_byte_size(&self, var: &VarId) -> Result<&TypeSize, MiddleEndError> {
+        Ok(self.get_type_byte_size(self.get_var_type_id(var)?))
+    }
+
+    /// Get the id of a type, storing it if it's not been seen before. Types that are equal
+    /// share an id, so each distinct type is only stored once.
+    pub fn intern_type(&mut self, ir_type: IrType) -> TypeId {
+        if let Some(type_id) = self.type_ids.get(&ir_type) {
+            return *type_id;
         }
+        let type_id = self.type_id_generator.new_id();
+        self.types.push(InternedType {
+            ir_type: ir_type.to_owned(),
+            byte_size: OnceLock::new(),
+        });
+        self.type_ids.insert(ir_type, type_id);
+        type_id
+    }
+
+    pub fn get_type(&self, type_id: TypeId) -> &IrType {
+        &self.types[type_id.as_u64() as usize].ir_type
+    }
+
+    /// The byte size of the type, which is only worked out the first time it's needed
+    pub fn get_type_byte_size(&self, type_id: TypeId) -> &TypeSize {
+        let interned_type = &self.types[type_id.as_u64() as usize];
+        interned_type
+            .byte_size
+            .get_or_init(|| interned_type.ir_type.get_byte_size(self))
+    }
+
+    pub fn get_type_alignment(&self, type_id: TypeId) -> u32 {
+        self.get_type(type_id).get_alignment(self)
     }
 
     pub fn add_struct_type(&mut self, struct_type: StructType) -> Result<StructId, MiddleEndError> {
@@ -241,13 +337,26 @@ impl ProgramMetadata {
         }
     }
 
-    pub fn get_fun_type(&self, fun_id: &FunId) -> Result<IrType, MiddleEndError> {
+    pub fn get_fun_type(&self, fun_id: &FunId) -> Result<&IrType, MiddleEndError> {
         match self.function_types.get(fun_id) {
             None => Err(MiddleEndError::FunctionNotFoundForId(fun_id.to_owned())),
-            Some(fun_type) => Ok(fun_type.to_owned()),
+            Some(type_id) => Ok(self.get_type(*type_id)),
         }
     }
 
+    pub fn insert_fun_type(&mut self, fun_id: FunId, fun_type: IrType) {
+        let type_id = self.intern_type(fun_type);
+        self.function_types.insert(fun_id, type_id);
+    }
+
+    /// The source name of each function, by id
+    pub fn get_function_names(&self) -> HashMap<&FunId, &str> {
+        self.function_ids
+            .iter()
+            .map(|(name, fun_id)| (fun_id, name.as_str()))
+            .collect()
+    }
+
     pub fn get_main_fun_id(&self) -> Result<FunId, MiddleEndError> {
         match self.function_ids.get(MAIN_FUNCTION_SOURCE_NAME) {
             None => Err(MiddleEndError::NoMainFunctionDefined),
@@ -270,6 +379,10 @@ impl ProgramMetadata {
         }
     }
 
+    pub fn get_null_dest_var(&self) -> Option<Dest> {
+        self.null_dest_var.to_owned()
+    }
+
     pub fn is_var_the_null_dest(&self, dest: &Dest) -> bool {
         if let Some(null) = &self.null_dest_var {
             return null == dest;
@@ -292,7 +405,8 @@ impl fmt::Display for ProgramMetadata {
             write!(f, "\nFunction {fun_name} => {fun_id}")?;
         }
         write!(f, "\nVar types:")?;
-        for (var, type_info) in &self.var_types {
+        for (var, type_id) in &self.var_types {
+            let type_info = self.get_type(*type_id);
             write!(f, "\n  {} ({}): {}", var, var.get_value_type(), type_info)?;
         }
         write!(f, "\nLabel identifiers:")?;
@@ -336,10 +450,6 @@ impl Program {
         self.program_metadata.new_identifier_label(name)
     }
 
-    pub fn resolve_identifier_to_label(&self, name: &str) -> Option<&LabelId> {
-        self.program_metadata.label_ids.get(name)
-    }
-
     pub fn new_fun_declaration(
         &mut self,
         name: String,
@@ -347,8 +457,7 @@ impl Program {
     ) -> Result<FunId, MiddleEndError> {
         let fun_id = self.program_metadata.new_fun_declaration(name)?;
         self.program_metadata
-            .function_types
-            .insert(fun_id.to_owned(), fun.type_info.to_owned());
+            .insert_fun_type(fun_id.to_owned(), fun.type_info.to_owned());
         self.program_metadata
             .function_param_var_mappings
             .insert(fun_id.to_owned(), fun.param_var_mappings.to_vec());
@@ -358,7 +467,7 @@ impl Program {
     }
 
     pub fn new_fun_body(&mut self, name: String, fun: Function) -> Result<FunId, MiddleEndError> {
-        match self.program_metadata.function_ids.get(&name) {
+        match self.program_metadata.function_ids.get(&name).cloned() {
             None => self.new_fun_declaration(name, fun),
             Some(existing_fun_id) => {
                 // body definition of existing function declaration
@@ -366,14 +475,13 @@ impl Program {
                 let existing_fun = self
                     .program_instructions
                     .functions
-                    .get(existing_fun_id)
+                    .get(&existing_fun_id)
                     .unwrap();
                 if existing_fun.type_info != fun.type_info {
                     return Err(MiddleEndError::DuplicateFunctionDeclaration(name));
                 }
                 self.program_metadata
-                    .function_types
-                    .insert(existing_fun_id.to_owned(), fun.type_info.to_owned());
+                    .insert_fun_type(existing_fun_id.to_owned(), fun.type_info.to_owned());
                 self.program_metadata
                     .function_param_var_mappings
                     .insert(existing_fun_id.to_owned(), fun.param_var_mappings.to_vec());
@@ -384,7 +492,7 @@ impl Program {
         }
     }
 
-    pub fn get_fun_type(&self, fun_id: &FunId) -> Result<IrType, MiddleEndError> {
+    pub fn get_fun_type(&self, fun_id: &FunId) -> Result<&IrType, MiddleEndError> {
         self.program_instructions.get_fun_type(fun_id)
     }
 
@@ -400,10 +508,18 @@ impl Program {
         self.program_metadata.add_var_type(var, var_type)
     }
 
-    pub fn get_var_type(&self, var: &VarId) -> Result<IrType, MiddleEndError> {
+    pub fn get_var_type(&self, var: &VarId) -> Result<&IrType, MiddleEndError> {
         self.program_metadata.get_var_type(var)
     }
 
+    pub fn add_var_type_id(&mut self, var: VarId, type_id: TypeId) -> Result<(), MiddleEndError> {
+        self.program_metadata.add_var_type_id(var, type_id)
+    }
+
+    pub fn get_var_type_id(&self, var: &VarId) -> Result<TypeId, MiddleEndError> {
+        self.program_metadata.get_var_type_id(var)
+    }
+
     pub fn add_struct_type(&mut self, struct_type: StructType) -> Result<StructId, MiddleEndError> {
         self.program_metadata.add_struct_type(struct_type)
     }
@@ -1,6 +1,7 @@
 use std::collections::HashMap;
 use std::fmt;
 use std::fmt::Formatter;
+use std::hash::{Hash, Hasher};
 
 use crate::front_end::ast::{BinaryOperator, Constant, Expression, Initialiser};
 use crate::middle_end::ids::{StructId, UnionId};
@@ -60,6 +61,35 @@ pub enum IrType {
     Function(Box<IrType>, Vec<IrType>, bool),
 }
 
+// IrType can't derive Hash and Eq, because runtime array sizes hold an AST expression.
+// Runtime sizes only hash their discriminant, which is enough to keep the hash consistent
+// with PartialEq, so types can be interned in a HashMap.
+impl Eq for IrType {}
+
+impl Hash for IrType {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        std::mem::discriminant(self).hash(state);
+        match self {
+            IrType::Struct(struct_id) => struct_id.hash(state),
+            IrType::Union(union_id) => union_id.hash(state),
+            IrType::PointerTo(inner_type) => inner_type.hash(state),
+            IrType::ArrayOf(inner_type, size) => {
+                inner_type.hash(state);
+                match size {
+                    Some(TypeSize::CompileTime(count)) => count.hash(state),
+                    Some(TypeSize::Runtime(_)) | None => std::mem::discriminant(size).hash(state),
+                }
+            }
+            IrType::Function(return_type, param_types, is_variadic) => {
+                return_type.hash(state);
+                param_types.hash(state);
+                is_variadic.hash(state);
+            }
+            _ => {}
+        }
+    }
+}
+
 impl IrType {
     /// Get the size of this type in bytes, if known at compile time.
     /// For arrays, the size may not be known until runtime.
@@ -97,6 +127,37 @@ impl IrType {
         }
     }
 
+    /// Get the alignment of this type in bytes. Scalars are aligned to their size, and structs
+    /// and unions to the largest alignment of their members. Arrays are stored as a pointer.
+    pub fn get_alignment(&self, prog: &ProgramMetadata) -> u32 {
+        match &self {
+            IrType::I8 | IrType::U8 => 1,
+            IrType::I16 | IrType::U16 => 2,
+            IrType::I32 | IrType::U32 | IrType::F32 => 4,
+            IrType::I64 | IrType::U64 | IrType::F64 => 8,
+            IrType::Struct(struct_id) => prog
+                .get_struct_type(struct_id)
+                .unwrap()
+                .member_types
+                .values()
+                .map(|member_type| member_type.get_alignment(prog))
+                .max()
+                .unwrap_or(1),
+            IrType::Union(union_id) => prog
+                .get_union_type(union_id)
+                .unwrap()
+                .member_types
+                .values()
+                .map(|member_type| member_type.get_alignment(prog))
+                .max()
+                .unwrap_or(1),
+            IrType::Void => 1,
+            IrType::PointerTo(_) | IrType::ArrayOf(_, _) | IrType::Function(_, _, _) => {
+                POINTER_SIZE as u32
+            }
+        }
+    }
+
     pub fn get_pointer_object_byte_size(
         &self,
         prog: &ProgramMetadata,
@@ -1,4 +1,9 @@
+mod compile_time_evaluation;
+mod control_flow_simplification;
+mod function_inlining;
 pub mod ir_optimiser;
 mod remove_redundancy;
+mod scalar_optimisation;
+mod switch_to_br_table;
 mod tail_call_optimise;
 mod unreachable_procedure_elimination;
@@ -0,0 +1,349 @@
+use std::cell::RefCell;
+use std::collections::{HashMap, HashSet};
+
+use log::{debug, trace};
+
+use crate::middle_end::ids::{FunId, LabelId, VarId};
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::{Function, Program, ProgramMetadata};
+use crate::middle_end::ir_types::IrType;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::constant_folding::{
+    compare_srcs, fold_instr, normalise_constant,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::get_arm_label;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_dest, get_used_vars, is_pure_assignment,
+};
+
+/// The most instructions that evaluating one call can run, including the calls it makes.
+/// Calls that take longer than this, or never return, are left to run at runtime.
+const MAX_EVALUATION_STEPS: usize = 100_000;
+
+/// Calls nested deeper than this are left to run at runtime
+const MAX_CALL_DEPTH: usize = 200;
+
+/// A constant argument, with floats as their bits so that calls can be hashed
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+enum ArgValue {
+    Int(i128),
+    Float(u64),
+}
+
+/// A function that only computes its return value from its params, without any side
+/// effects, so a call to it can be replaced by its result
+struct PureFunction {
+    instrs: Vec<Instruction>,
+    param_vars: Vec<VarId>,
+    param_types: Vec<IrType>,
+    return_type: IrType,
+    label_positions: HashMap<LabelId, usize>,
+}
+
+/// The functions whose calls can be evaluated at compile time, and the results of the calls
+/// that have been evaluated so far
+pub struct PureFunctions {
+    functions: HashMap<FunId, PureFunction>,
+    /// None if the call couldn't be evaluated
+    results: RefCell<HashMap<(FunId, Vec<ArgValue>), Option<Constant>>>,
+}
+
+impl PureFunctions {
+    /// Find the functions that can be run at compile time: ones that only use their own
+    /// scalar local vars, and don't load or store through pointers. They can only call each
+    /// other, which is checked while evaluating them.
+    ///
+    /// The instructions of each function are copied as they are now, so the function bodies
+    /// can be optimised while calls to them are evaluated.
+    pub fn find(prog: &Program, global_vars: &HashSet<VarId>) -> Self {
+        let mut functions = HashMap::new();
+        for (fun_id, function) in &prog.program_instructions.functions {
+            if let Some(pure_function) =
+                get_pure_function(function, global_vars, &prog.program_metadata)
+            {
+                functions.insert(fun_id.to_owned(), pure_function);
+            }
+        }
+        debug!(
+            "functions that can be evaluated at compile time: {:?}",
+            functions.keys().collect::<Vec<_>>()
+        );
+
+        PureFunctions {
+            functions,
+            results: RefCell::new(HashMap::new()),
+        }
+    }
+
+    pub fn none() -> Self {
+        PureFunctions {
+            functions: HashMap::new(),
+            results: RefCell::new(HashMap::new()),
+        }
+    }
+
+    fn evaluate_call(
+        &self,
+        fun_id: &FunId,
+        args: &[Constant],
+        steps_left: &mut usize,
+        depth: usize,
+        prog_metadata: &ProgramMetadata,
+    ) -> Option<Constant> {
+        let key = (
+            fun_id.to_owned(),
+            args.iter()
+                .map(|arg| match arg {
+                    Constant::Int(n) => ArgValue::Int(*n),
+                    Constant::Float(z) => ArgValue::Float(z.to_bits()),
+                })
+                .collect::<Vec<_>>(),
+        );
+        if let Some(result) = self.results.borrow().get(&key) {
+            return result.to_owned();
+        }
+
+        let result = self.run_function(fun_id, args, steps_left, depth, prog_metadata);
+        self.results.borrow_mut().insert(key, result.to_owned());
+        result
+    }
+
+    /// Interpret the function's instructions with the given arguments. Returns None if
+    /// anything can't be evaluated, such as an instruction that would trap, a call to a
+    /// function that isn't pure, or running out of steps.
+    fn run_function(
+        &self,
+        fun_id: &FunId,
+        args: &[Constant],
+        steps_left: &mut usize,
+        depth: usize,
+        prog_metadata: &ProgramMetadata,
+    ) -> Option<Constant> {
+        let function = self.functions.get(fun_id)?;
+        if depth > MAX_CALL_DEPTH || args.len() != function.param_vars.len() {
+            return None;
+        }
+
+        // each arg is stored as the type of its param
+        let mut vars: HashMap<VarId, Constant> = HashMap::new();
+        for ((param_var, param_type), arg) in function
+            .param_vars
+            .iter()
+            .zip(&function.param_types)
+            .zip(args)
+        {
+            vars.insert(param_var.to_owned(), normalise_constant(arg, param_type)?);
+        }
+
+        let mut instr_i = 0;
+        loop {
+            *steps_left = steps_left.checked_sub(1)?;
+            let instr = function.instrs.get(instr_i)?;
+            instr_i += 1;
+
+            let get_value = |src: &Src| match src {
+                Src::Constant(constant) => Some(constant.to_owned()),
+                Src::Var(var) => vars.get(var).map(|value| value.to_owned()),
+                Src::StoreAddressVar(_) | Src::Fun(_) => None,
+            };
+            let branch_target = match instr {
+                Instruction::Label(..)
+                | Instruction::Nop(..)
+                | Instruction::DeclareVariable(..) => None,
+                Instruction::Br(_, label) => Some(label),
+                Instruction::BrIfEq(_, left, right, label) => {
+                    match compare_srcs(left, right, get_value, prog_metadata)?.is_eq() {
+                        true => Some(label),
+                        false => None,
+                    }
+                }
+                Instruction::BrIfNotEq(_, left, right, label) => {
+                    match compare_srcs(left, right, get_value, prog_metadata)?.is_ne() {
+                        true => Some(label),
+                        false => None,
+                    }
+                }
+                Instruction::BrTable(_, src, table, arms) => {
+                    let index = match get_value(src)? {
+                        // the index is an unsigned i32, so negative values are out of range
+                        Constant::Int(n) => n as i32 as u32 as usize,
+                        Constant::Float(_) => return None,
+                    };
+                    let arm_i = table.get(index).unwrap_or(&(arms.len() - 1)).to_owned();
+                    Some(get_arm_label(&arms[arm_i]))
+                }
+                Instruction::Ret(_, Some(src)) => {
+                    // the return value is loaded as the return type
+                    return normalise_constant(&get_value(src)?, &function.return_type);
+                }
+                Instruction::Call(_, dest, callee, arg_srcs) => {
+                    let call_args = arg_srcs.iter().map(get_value).collect::<Option<Vec<_>>>()?;
+                    let result = self.evaluate_call(
+                        callee,
+                        &call_args,
+                        steps_left,
+                        depth + 1,
+                        prog_metadata,
+                    )?;
+                    if !prog_metadata.is_var_the_null_dest(dest) {
+                        let dest_type = prog_metadata.get_var_type(dest).ok()?;
+                        vars.insert(dest.to_owned(), normalise_constant(&result, dest_type)?);
+                    }
+                    None
+                }
+                Instruction::TailCall(_, callee, arg_srcs) => {
+                    let call_args = arg_srcs.iter().map(get_value).collect::<Option<Vec<_>>>()?;
+                    let result = self.evaluate_call(
+                        callee,
+                        &call_args,
+                        steps_left,
+                        depth + 1,
+                        prog_metadata,
+                    )?;
+                    return normalise_constant(&result, &function.return_type);
+                }
+                instr if is_pure_assignment(instr) => {
+                    let value = fold_instr(instr, get_value, prog_metadata)?;
+                    vars.insert(get_dest(instr)?.to_owned(), value);
+                    None
+                }
+                _ => return None,
+            };
+
+            if let Some(label) = branch_target {
+                instr_i = function.label_positions[label];
+            }
+        }
+    }
+}
+
+/// Replace calls to pure functions whose arguments are all constant with the value the
+/// call returns, if it can be worked out within the step budget. The functions they call
+/// can then become unused, and removed by unreachable procedure elimination.
+///
+/// Returns true if any calls were replaced.
+pub fn evaluate_pure_calls(
+    instrs: &mut Vec<Instruction>,
+    pure_functions: &PureFunctions,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let mut changed = false;
+    for instr in instrs.iter_mut() {
+        let (dest, callee, arg_srcs) = match &*instr {
+            Instruction::Call(_, dest, callee, arg_srcs)
+                if pure_functions.functions.contains_key(callee) =>
+            {
+                (dest, callee, arg_srcs)
+            }
+            _ => continue,
+        };
+        let args = match arg_srcs
+            .iter()
+            .map(|src| match src {
+                Src::Constant(constant) => Some(constant.to_owned()),
+                _ => None,
+            })
+            .collect::<Option<Vec<_>>>()
+        {
+            Some(args) => args,
+            None => continue,
+        };
+
+        let mut steps_left = MAX_EVALUATION_STEPS;
+        let result =
+            match pure_functions.evaluate_call(callee, &args, &mut steps_left, 0, prog_metadata) {
+                Some(result) => result,
+                None => continue,
+            };
+
+        let new_instr = if prog_metadata.is_var_the_null_dest(dest) {
+            // the result isn't used, and the call doesn't do anything else
+            Instruction::Nop(instr.get_instr_id())
+        } else {
+            let dest_type = prog_metadata.get_var_type(dest).unwrap();
+            let value = match normalise_constant(&result, dest_type) {
+                Some(value) => value,
+                None => continue,
+            };
+            Instruction::SimpleAssignment(
+                instr.get_instr_id(),
+                dest.to_owned(),
+                Src::Constant(value),
+            )
+        };
+        trace!("evaluated {} at compile time as {}", instr, new_instr);
+        *instr = new_instr;
+        changed = true;
+    }
+
+    instrs.retain(|instr| !matches!(instr, Instruction::Nop(..)));
+    changed
+}
+
+fn get_pure_function(
+    function: &Function,
+    global_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> Option<PureFunction> {
+    if !function.body_is_defined {
+        return None;
+    }
+    let (return_type, param_types) = match &function.type_info {
+        IrType::Function(return_type, param_types, false)
+            if return_type.is_scalar_type()
+                && param_types
+                    .iter()
+                    .all(|param_type| param_type.is_scalar_type()) =>
+        {
+            (*return_type.to_owned(), param_types.to_owned())
+        }
+        _ => return None,
+    };
+
+    let is_local_scalar_var = |var: &VarId| {
+        prog_metadata.is_var_the_null_dest(var)
+            || (!global_vars.contains(var)
+                && prog_metadata
+                    .get_var_type(var)
+                    .map(|var_type| var_type.is_scalar_type())
+                    .unwrap_or(false))
+    };
+
+    let mut label_positions = HashMap::new();
+    for (i, instr) in function.instrs.iter().enumerate() {
+        let is_allowed = match instr {
+            Instruction::Label(_, label) => {
+                label_positions.insert(label.to_owned(), i);
+                true
+            }
+            Instruction::Nop(..)
+            | Instruction::DeclareVariable(..)
+            | Instruction::Br(..)
+            | Instruction::BrIfEq(..)
+            | Instruction::BrIfNotEq(..)
+            | Instruction::BrTable(..)
+            | Instruction::Ret(_, Some(_))
+            | Instruction::Call(..)
+            | Instruction::TailCall(..) => true,
+            // these use memory, which the function could share with the rest of the program
+            Instruction::LoadFromAddress(..)
+            | Instruction::AddressOf(..)
+            | Instruction::PointerToStringLiteral(..)
+            | Instruction::AllocateVariable(..) => false,
+            instr => is_pure_assignment(instr),
+        };
+        if !is_allowed
+            || !get_dest(instr).map_or(true, is_local_scalar_var)
+            || !get_used_vars(instr).into_iter().all(is_local_scalar_var)
+        {
+            return None;
+        }
+    }
+
+    Some(PureFunction {
+        instrs: function.instrs.to_owned(),
+        param_vars: function.param_var_mappings.to_owned(),
+        param_types,
+        return_type,
+        label_positions,
+    })
+}
@@ -0,0 +1,191 @@
+use std::collections::{HashMap, HashSet};
+
+use log::trace;
+
+use crate::middle_end::ids::LabelId;
+use crate::middle_end::instructions::{Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::constant_folding::compare_srcs;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::ControlFlowGraph;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::get_branch_labels_mut;
+
+/// Simplify the branches of a function body before it's relooped, so the relooper has fewer
+/// labels and branches to work through:
+///   - conditional branches that compare two constants always go the same way, so they
+///     become an unconditional branch or are removed
+///   - a branch to a label that's followed by an unconditional branch goes straight to
+///     where that branch goes
+///   - instructions that no path from the start of the function reaches are removed, such
+///     as the code after a return
+///   - branches to the instruction after them are removed, and a conditional branch over an
+///     unconditional branch is inverted to go where the unconditional branch goes
+///
+/// Each of these can make more opportunities for the others, so they're repeated until
+/// nothing changes. The labels left unused are removed afterwards with the other unused
+/// labels.
+pub fn simplify_control_flow(instrs: &mut Vec<Instruction>, prog_metadata: &ProgramMetadata) {
+    loop {
+        let mut changed = fold_constant_branches(instrs, prog_metadata);
+        changed |= thread_jumps(instrs);
+        changed |= remove_unreachable_instrs(instrs);
+        changed |= remove_branches_to_next_instr(instrs);
+        if !changed {
+            break;
+        }
+    }
+}
+
+fn fold_constant_branches(instrs: &mut Vec<Instruction>, prog_metadata: &ProgramMetadata) -> bool {
+    let get_constant = |src: &Src| match src {
+        Src::Constant(constant) => Some(constant.to_owned()),
+        _ => None,
+    };
+
+    let mut changed = false;
+    for instr in instrs.iter_mut() {
+        let is_taken = match instr {
+            Instruction::BrIfEq(_, left, right, _) => {
+                compare_srcs(left, right, get_constant, prog_metadata).map(|ord| ord.is_eq())
+            }
+            Instruction::BrIfNotEq(_, left, right, _) => {
+                compare_srcs(left, right, get_constant, prog_metadata).map(|ord| ord.is_ne())
+            }
+            _ => None,
+        };
+        let new_instr = match (is_taken, &*instr) {
+            (Some(true), Instruction::BrIfEq(id, _, _, label))
+            | (Some(true), Instruction::BrIfNotEq(id, _, _, label)) => {
+                Instruction::Br(id.to_owned(), label.to_owned())
+            }
+            (Some(false), _) => Instruction::Nop(instr.get_instr_id()),
+            _ => continue,
+        };
+        trace!("folding constant branch {} to {}", instr, new_instr);
+        *instr = new_instr;
+        changed = true;
+    }
+
+    instrs.retain(|instr| !matches!(instr, Instruction::Nop(..)));
+    changed
+}
+
+/// Replace branches to a label that's followed by an unconditional branch with a branch to
+/// the end of the chain of unconditional branches
+fn thread_jumps(instrs: &mut [Instruction]) -> bool {
+    // the label that each label is followed by an unconditional branch to
+    let mut jump_targets: HashMap<LabelId, LabelId> = HashMap::new();
+    for (i, instr) in instrs.iter().enumerate() {
+        if let Instruction::Label(_, label) = instr {
+            let next_instr = instrs[i + 1..]
+                .iter()
+                .find(|instr| !matches!(instr, Instruction::Label(..)));
+            if let Some(Instruction::Br(_, target)) = next_instr {
+                jump_targets.insert(label.to_owned(), target.to_owned());
+            }
+        }
+    }
+
+    let get_final_target = |label: &LabelId| {
+        let mut target = label;
+        // an infinite loop of branches never gets to the end of the chain
+        let mut visited = HashSet::from([label]);
+        while let Some(next_target) = jump_targets.get(target) {
+            if !visited.insert(next_target) {
+                break;
+            }
+            target = next_target;
+        }
+        target.to_owned()
+    };
+
+    let mut changed = false;
+    for instr in instrs.iter_mut() {
+        for label in get_branch_labels_mut(instr) {
+            let final_target = get_final_target(label);
+            if *label != final_target {
+                trace!("threading branch to {} through to {}", label, final_target);
+                *label = final_target;
+                changed = true;
+            }
+        }
+    }
+    changed
+}
+
+fn remove_unreachable_instrs(instrs: &mut Vec<Instruction>) -> bool {
+    let cfg = ControlFlowGraph::new(instrs);
+    let is_reachable = cfg.find_reachable_blocks();
+
+    let mut changed = false;
+    for (block, is_reachable) in cfg.blocks.iter().zip(is_reachable) {
+        if is_reachable {
+            continue;
+        }
+        trace!("removing unreachable instructions {:?}", block.instr_range);
+        for instr in &mut instrs[block.instr_range.to_owned()] {
+            *instr = Instruction::Nop(instr.get_instr_id());
+        }
+        changed = true;
+    }
+
+    instrs.retain(|instr| !matches!(instr, Instruction::Nop(..)));
+    changed
+}
+
+fn remove_branches_to_next_instr(instrs: &mut Vec<Instruction>) -> bool {
+    let mut changed = false;
+    for i in 0..instrs.len() {
+        match &instrs[i] {
+            Instruction::Br(_, label)
+            | Instruction::BrIfEq(_, _, _, label)
+            | Instruction::BrIfNotEq(_, _, _, label)
+                if is_label_next(instrs, i + 1, label) =>
+            {
+                // comparing the srcs doesn't have any side effects
+                trace!("removing branch to the next instruction {}", instrs[i]);
+                instrs[i] = Instruction::Nop(instrs[i].get_instr_id());
+                changed = true;
+            }
+            Instruction::BrIfEq(id, left, right, label)
+            | Instruction::BrIfNotEq(id, left, right, label)
+                if is_label_next(instrs, i + 2, label) =>
+            {
+                let target = match &instrs[i + 1] {
+                    Instruction::Br(_, target) => target.to_owned(),
+                    _ => continue,
+                };
+                let inverted_branch = match &instrs[i] {
+                    Instruction::BrIfEq(..) => Instruction::BrIfNotEq(
+                        id.to_owned(),
+                        left.to_owned(),
+                        right.to_owned(),
+                        target,
+                    ),
+                    _ => Instruction::BrIfEq(
+                        id.to_owned(),
+                        left.to_owned(),
+                        right.to_owned(),
+                        target,
+                    ),
+                };
+                trace!("inverting {} over the branch after it", instrs[i]);
+                instrs[i + 1] = Instruction::Nop(instrs[i + 1].get_instr_id());
+                instrs[i] = inverted_branch;
+                changed = true;
+            }
+            _ => {}
+        }
+    }
+
+    instrs.retain(|instr| !matches!(instr, Instruction::Nop(..)));
+    changed
+}
+
+/// Whether the label is one of the labels at instrs[start..], before any other instruction
+fn is_label_next(instrs: &[Instruction], start: usize, label: &LabelId) -> bool {
+    instrs
+        .iter()
+        .skip(start)
+        .take_while(|instr| matches!(instr, Instruction::Label(..)))
+        .any(|instr| matches!(instr, Instruction::Label(_, next_label) if next_label == label))
+}
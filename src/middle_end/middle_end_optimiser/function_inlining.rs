@@ -0,0 +1,355 @@
+use std::collections::{HashMap, HashSet};
+
+use log::debug;
+
+use crate::middle_end::ids::{FunId, LabelId, VarId};
+use crate::middle_end::instructions::{Dest, Instruction, Src};
+use crate::middle_end::ir::{Function, Program};
+use crate::middle_end::ir_types::IrType;
+use crate::middle_end::middle_end_error::MiddleEndError;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::get_global_vars;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_address_var_mut, get_branch_labels_mut, get_dest, get_dest_mut, get_srcs_mut, get_used_vars,
+};
+use crate::middle_end::type_conversions::get_type_conversion_instrs;
+
+/// Functions with more instructions than this aren't inlined, so that copying them into
+/// every caller doesn't grow the code too much
+const MAX_INLINED_FUNCTION_INSTRS: usize = 40;
+/// Larger functions are inlined where the profile shows the call is hot, which is worth
+/// the extra code size
+const MAX_HOT_INLINED_FUNCTION_INSTRS: usize = 160;
+/// A call is hot if at least this percentage of all the calls in the profile were made by
+/// the caller to the callee
+const MIN_HOT_CALL_PERCENT: u64 = 1;
+
+/// A function that can be copied into its callers
+struct InlinableFunction {
+    instrs: Vec<Instruction>,
+    param_vars: Vec<VarId>,
+    param_types: Vec<IrType>,
+    return_type: IrType,
+}
+
+/// Replace calls to small leaf functions with a copy of the function body, so the call
+/// doesn't have to set up and pop a stack frame. The vars and labels of each copy are
+/// renamed, so that they don't clash with the caller's or with other copies. Functions that
+/// aren't called any more are removed later by unreachable procedure elimination.
+pub fn inline_functions(prog: &mut Program) -> Result<(), MiddleEndError> {
+    let global_vars = get_global_vars(&prog.program_instructions.global_instrs);
+
+    let max_inlined_function_instrs = match &prog.program_metadata.profile {
+        Some(profile) if profile.has_call_counts() => MAX_HOT_INLINED_FUNCTION_INSTRS,
+        _ => MAX_INLINED_FUNCTION_INSTRS,
+    };
+    let fun_names: HashMap<FunId, String> = prog
+        .program_metadata
+        .get_function_names()
+        .into_iter()
+        .map(|(fun_id, name)| (fun_id.to_owned(), name.to_owned()))
+        .collect();
+
+    let mut inlinable_functions: HashMap<FunId, InlinableFunction> = HashMap::new();
+    for (fun_id, function) in &prog.program_instructions.functions {
+        if !is_inlinable(function, max_inlined_function_instrs) {
+            continue;
+        }
+        let (return_type, param_types) = match &function.type_info {
+            IrType::Function(return_type, param_types, _) => {
+                (*return_type.to_owned(), param_types.to_owned())
+            }
+            _ => unreachable!(),
+        };
+        inlinable_functions.insert(
+            fun_id.to_owned(),
+            InlinableFunction {
+                instrs: function.instrs.to_owned(),
+                param_vars: function.param_var_mappings.to_owned(),
+                param_types,
+                return_type,
+            },
+        );
+    }
+
+    let fun_ids: Vec<FunId> = prog
+        .program_instructions
+        .functions
+        .keys()
+        .cloned()
+        .collect();
+    for fun_id in fun_ids {
+        let instrs = std::mem::take(
+            &mut prog
+                .program_instructions
+                .functions
+                .get_mut(&fun_id)
+                .unwrap()
+                .instrs,
+        );
+
+        let mut new_instrs = Vec::new();
+        for instr in instrs {
+            let inlined_instrs = match &instr {
+                Instruction::Call(_, dest, callee_id, params) => {
+                    match inlinable_functions.get(callee_id).filter(|callee| {
+                        should_inline(&fun_id, callee_id, callee, &fun_names, prog)
+                    }) {
+                        Some(callee) => inline_call(dest, params, callee, &global_vars, prog)?.map(
+                            |inlined_instrs| {
+                                debug!("inlined {} into {}", callee_id, fun_id);
+                                inlined_instrs
+                            },
+                        ),
+                        None => None,
+                    }
+                }
+                _ => None,
+            };
+            match inlined_instrs {
+                Some(mut inlined_instrs) => new_instrs.append(&mut inlined_instrs),
+                None => new_instrs.push(instr),
+            }
+        }
+
+        prog.program_instructions
+            .functions
+            .get_mut(&fun_id)
+            .unwrap()
+            .instrs = new_instrs;
+    }
+
+    Ok(())
+}
+
+/// Small functions are always inlined. With a profile of the calls, larger functions are
+/// inlined into callers that call them often, and calls that never happened aren't inlined,
+/// to save the code size for where it matters.
+fn should_inline(
+    caller_id: &FunId,
+    callee_id: &FunId,
+    callee: &InlinableFunction,
+    fun_names: &HashMap<FunId, String>,
+    prog: &Program,
+) -> bool {
+    let profile = match &prog.program_metadata.profile {
+        Some(profile) if profile.has_call_counts() => profile,
+        _ => return callee.instrs.len() <= MAX_INLINED_FUNCTION_INSTRS,
+    };
+    let call_count = match (fun_names.get(caller_id), fun_names.get(callee_id)) {
+        (Some(caller_name), Some(callee_name)) => profile.call_count(caller_name, callee_name),
+        _ => None,
+    };
+    match call_count {
+        // the profiled build didn't have this call, eg. because it had inlined it
+        None => callee.instrs.len() <= MAX_INLINED_FUNCTION_INSTRS,
+        Some(0) => false,
+        Some(call_count) => {
+            callee.instrs.len() <= MAX_INLINED_FUNCTION_INSTRS
+                || call_count * 100 >= profile.total_call_count() * MIN_HOT_CALL_PERCENT
+        }
+    }
+}
+
+/// Only functions that don't call anything are inlined. Leaf functions can't be recursive,
+/// so inlining always terminates.
+fn is_inlinable(function: &Function, max_instrs: usize) -> bool {
+    let (return_type, param_types, is_variadic) = match &function.type_info {
+        IrType::Function(return_type, param_types, is_variadic) => {
+            (return_type, param_types, is_variadic)
+        }
+        _ => unreachable!(),
+    };
+
+    function.body_is_defined
+        && !is_variadic
+        && function.instrs.len() <= max_instrs
+        && param_types.len() == function.param_var_mappings.len()
+        && param_types.iter().all(|param_type| param_type.is_scalar_type())
+        && (**return_type == IrType::Void || return_type.is_scalar_type())
+        // a variable length array allocated in a loop of the caller would keep growing
+        // the caller's stack frame
+        && !function.instrs.iter().any(|instr| {
+            matches!(
+                instr,
+                Instruction::Call(..)
+                    | Instruction::TailCall(..)
+                    | Instruction::AllocateVariable(..)
+            )
+        })
+}
+
+/// Copy the body of the callee in place of a call to it. The params are assigned to copies of
+/// the callee's param vars, and each return assigns to the call's dest and jumps past the
+/// end of the body. Values are converted to the param and return types the same way the
+/// backend would convert them for a real call.
+///
+/// Returns None if the params or return value would need a conversion that isn't supported.
+fn inline_call(
+    call_dest: &Dest,
+    params: &[Src],
+    callee: &InlinableFunction,
+    global_vars: &HashSet<VarId>,
+    prog: &mut Program,
+) -> Result<Option<Vec<Instruction>>, MiddleEndError> {
+    if params.len() != callee.param_vars.len() {
+        return Ok(None);
+    }
+    for (param, param_type) in params.iter().zip(&callee.param_types) {
+        if let Src::Var(param_var) = param {
+            if !can_convert_inline(prog.get_var_type(param_var)?, param_type) {
+                return Ok(None);
+            }
+        }
+    }
+    let is_return_value_used = !prog.program_metadata.is_var_the_null_dest(call_dest);
+    if is_return_value_used
+        && !can_convert_inline(&callee.return_type, prog.get_var_type(call_dest)?)
+    {
+        return Ok(None);
+    }
+
+    // give every local var and label of the callee a new id
+    let mut renamed_vars: HashMap<VarId, VarId> = HashMap::new();
+    let mut callee_vars: Vec<&VarId> = callee.param_vars.iter().collect();
+    for instr in &callee.instrs {
+        callee_vars.extend(get_dest(instr));
+        callee_vars.extend(get_used_vars(instr));
+    }
+    for var in callee_vars {
+        if global_vars.contains(var) || renamed_vars.contains_key(var) {
+            continue;
+        }
+        let renamed_var = prog.new_var(var.get_value_type());
+        prog.add_var_type_id(renamed_var.to_owned(), prog.get_var_type_id(var)?)?;
+        renamed_vars.insert(var.to_owned(), renamed_var);
+    }
+    let mut renamed_labels: HashMap<LabelId, LabelId> = HashMap::new();
+    for instr in &callee.instrs {
+        if let Instruction::Label(_, label) = instr {
+            renamed_labels.insert(label.to_owned(), prog.new_label());
+        }
+    }
+    let end_label = prog.new_label();
+
+    let mut instrs = Vec::new();
+    for ((param, param_var), param_type) in params
+        .iter()
+        .zip(&callee.param_vars)
+        .zip(&callee.param_types)
+    {
+        let param = convert_inline(param.to_owned(), param_type, &mut instrs, prog)?;
+        instrs.push(Instruction::SimpleAssignment(
+            prog.new_instr_id(),
+            renamed_vars[param_var].to_owned(),
+            param,
+        ));
+    }
+
+    for callee_instr in &callee.instrs {
+        let mut instr = callee_instr.to_owned();
+        rename_vars(&mut instr, &renamed_vars);
+        rename_labels(&mut instr, &renamed_labels);
+        set_new_instr_ids(&mut instr, prog);
+
+        match instr {
+            Instruction::Ret(_, return_value) => {
+                if let (Some(return_value), true) = (return_value, is_return_value_used) {
+                    let return_value =
+                        convert_inline(return_value, &callee.return_type, &mut instrs, prog)?;
+                    let dest_type = prog.get_var_type(call_dest)?.to_owned();
+                    let return_value = convert_inline(return_value, &dest_type, &mut instrs, prog)?;
+                    instrs.push(Instruction::SimpleAssignment(
+                        prog.new_instr_id(),
+                        call_dest.to_owned(),
+                        return_value,
+                    ));
+                }
+                instrs.push(Instruction::Br(prog.new_instr_id(), end_label.to_owned()));
+            }
+            instr => instrs.push(instr),
+        }
+    }
+
+    // the last return doesn't need to jump, it can fall through to the end
+    if let Some(Instruction::Br(_, label)) = instrs.last() {
+        if *label == end_label {
+            instrs.pop();
+        }
+    }
+    instrs.push(Instruction::Label(prog.new_instr_id(), end_label));
+
+    Ok(Some(instrs))
+}
+
+fn can_convert_inline(src_type: &IrType, dest_type: &IrType) -> bool {
+    src_type == dest_type
+        || (src_type.is_arithmetic_type() && dest_type.is_arithmetic_type())
+        || (src_type.is_pointer_type() && dest_type.is_pointer_type())
+}
+
+/// Convert a var to the given type, adding any instructions needed to do it. Pointers are
+/// all represented the same way, so they don't need converting, and constants are loaded
+/// as the type of the var they're assigned to.
+fn convert_inline(
+    src: Src,
+    dest_type: &IrType,
+    instrs: &mut Vec<Instruction>,
+    prog: &mut Program,
+) -> Result<Src, MiddleEndError> {
+    let src_var = match &src {
+        Src::Var(src_var) => src_var,
+        _ => return Ok(src),
+    };
+    let src_type = prog.get_var_type(src_var)?.to_owned();
+    if src_type.is_pointer_type() {
+        return Ok(src);
+    }
+    let (mut convert_instrs, converted_src) =
+        get_type_conversion_instrs(src, src_type, dest_type.to_owned(), prog)?;
+    instrs.append(&mut convert_instrs);
+    Ok(converted_src)
+}
+
+fn rename_vars(instr: &mut Instruction, renamed_vars: &HashMap<VarId, VarId>) {
+    let rename = |var: &mut VarId| {
+        if let Some(renamed_var) = renamed_vars.get(var) {
+            *var = renamed_var.to_owned();
+        }
+    };
+    if let Some(dest) = get_dest_mut(instr) {
+        rename(dest);
+    }
+    for src in get_srcs_mut(instr) {
+        if let Src::Var(var) | Src::StoreAddressVar(var) = src {
+            rename(var);
+        }
+    }
+    if let Some(address_var) = get_address_var_mut(instr) {
+        rename(address_var);
+    }
+    if let Instruction::ReferenceVariable(_, var) = instr {
+        rename(var);
+    }
+}
+
+fn rename_labels(instr: &mut Instruction, renamed_labels: &HashMap<LabelId, LabelId>) {
+    let labels = match instr {
+        Instruction::Label(_, label) => vec![label],
+        instr => get_branch_labels_mut(instr),
+    };
+    for label in labels {
+        if let Some(renamed_label) = renamed_labels.get(label) {
+            *label = renamed_label.to_owned();
+        }
+    }
+}
+
+/// Instruction ids have to be unique, because the backend's dataflow analysis uses them
+fn set_new_instr_ids(instr: &mut Instruction, prog: &mut Program) {
+    instr.set_instr_id(prog.new_instr_id());
+    if let Instruction::BrTable(_, _, _, arms) = instr {
+        for arm_instr in arms.iter_mut().flatten() {
+            arm_instr.set_instr_id(prog.new_instr_id());
+        }
+    }
+}
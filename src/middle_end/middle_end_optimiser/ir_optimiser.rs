@@ -1,6 +1,13 @@
 use crate::middle_end::ir::Program;
 use crate::middle_end::middle_end_error::MiddleEndError;
+use crate::middle_end::middle_end_optimiser::compile_time_evaluation::PureFunctions;
+use crate::middle_end::middle_end_optimiser::control_flow_simplification::simplify_control_flow;
+use crate::middle_end::middle_end_optimiser::function_inlining::inline_functions;
 use crate::middle_end::middle_end_optimiser::remove_redundancy::remove_unused_labels;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::{
+    get_global_vars, optimise_scalars,
+};
+use crate::middle_end::middle_end_optimiser::switch_to_br_table::convert_switches_to_br_tables;
 use crate::middle_end::middle_end_optimiser::tail_call_optimise::tail_call_optimise;
 use crate::middle_end::middle_end_optimiser::unreachable_procedure_elimination::remove_unused_functions;
 use crate::EnabledOptimisations;
@@ -9,6 +16,17 @@ pub fn optimise_ir(
     prog: &mut Program,
     enabled_optimisations: &EnabledOptimisations,
 ) -> Result<(), MiddleEndError> {
+    if enabled_optimisations.is_function_inlining_enabled() {
+        inline_functions(prog)?;
+    }
+
+    let global_vars = get_global_vars(&prog.program_instructions.global_instrs);
+    let pure_functions = if enabled_optimisations.is_compile_time_evaluation_enabled() {
+        PureFunctions::find(prog, &global_vars)
+    } else {
+        PureFunctions::none()
+    };
+
     for (fun_id, function) in &mut prog.program_instructions.functions {
         if enabled_optimisations.is_tail_call_optimisation_enabled() {
             tail_call_optimise(
@@ -18,6 +36,22 @@ pub fn optimise_ir(
                 &mut prog.program_metadata,
             );
         }
+        if enabled_optimisations.is_scalar_optimisation_enabled() {
+            optimise_scalars(
+                &mut function.instrs,
+                fun_id,
+                &global_vars,
+                &pure_functions,
+                &mut prog.program_metadata,
+                enabled_optimisations,
+            );
+        }
+        if enabled_optimisations.is_br_table_enabled() {
+            convert_switches_to_br_tables(&mut function.instrs, &mut prog.program_metadata);
+        }
+        if enabled_optimisations.is_cfg_simplification_enabled() {
+            simplify_control_flow(&mut function.instrs, &prog.program_metadata);
+        }
         remove_unused_labels(&mut function.instrs)?;
     }
     remove_unused_labels(&mut prog.program_instructions.global_instrs)?;
@@ -27,6 +27,15 @@ pub fn remove_unused_labels(instrs: &mut Vec<Instruction>) -> Result<(), MiddleE
                 // found a usage of the label
                 labels.insert(label_id.to_owned(), true);
             }
+            Instruction::BrTable(_, _, _, arms) => {
+                for arm in arms {
+                    for arm_instr in arm {
+                        if let Instruction::Br(_, label_id) = arm_instr {
+                            labels.insert(label_id.to_owned(), true);
+                        }
+                    }
+                }
+            }
             _ => {}
         }
     }
@@ -0,0 +1,122 @@
+mod common_subexpression_elimination;
+pub mod constant_folding;
+mod constant_propagation;
+pub mod control_flow_graph;
+mod conversion_fusion;
+mod copy_propagation;
+mod dead_code_elimination;
+pub mod instruction_operands;
+mod loop_optimisation;
+
+use std::collections::HashSet;
+
+use log::debug;
+
+use crate::middle_end::ids::{FunId, VarId};
+use crate::middle_end::instructions::{Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::middle_end_optimiser::compile_time_evaluation::{
+    evaluate_pure_calls, PureFunctions,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::common_subexpression_elimination::eliminate_common_subexpressions;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::constant_propagation::propagate_constants;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::conversion_fusion::fuse_conversions;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::copy_propagation::propagate_copies;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::dead_code_elimination::eliminate_dead_code;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_dest, get_used_vars,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::loop_optimisation::optimise_loops;
+use crate::EnabledOptimisations;
+
+/// Each optimisation can create more opportunities for the others, so they're run in turn
+/// until nothing changes, up to this many times
+const MAX_SCALAR_OPTIMISATION_ROUNDS: usize = 10;
+
+/// Remove the redundant temporary vars and copies that the AST to IR conversion creates,
+/// with constant propagation, copy propagation, fusing chains of integer conversions, common
+/// subexpression elimination and dead code elimination. Loops also get their invariant
+/// instructions hoisted out and their induction vars strength reduced, and calls to pure
+/// functions with constant args are evaluated, if those are enabled.
+///
+/// These only reason about the tracked vars of the function: local vars of a scalar type whose
+/// address is never taken. Those can only be changed by instructions that assign to them, so
+/// calls and stores through pointers can be ignored.
+pub fn optimise_scalars(
+    instrs: &mut Vec<Instruction>,
+    fun_id: &FunId,
+    global_vars: &HashSet<VarId>,
+    pure_functions: &PureFunctions,
+    prog_metadata: &mut ProgramMetadata,
+    enabled_optimisations: &EnabledOptimisations,
+) {
+    let mut tracked_vars = get_tracked_vars(instrs, global_vars, prog_metadata);
+    let instr_count_before = instrs.len();
+
+    for _ in 0..MAX_SCALAR_OPTIMISATION_ROUNDS {
+        let mut changed = propagate_constants(instrs, &tracked_vars, prog_metadata);
+        changed |= propagate_copies(instrs, &tracked_vars, prog_metadata);
+        changed |= fuse_conversions(instrs, &tracked_vars, prog_metadata);
+        changed |= eliminate_common_subexpressions(instrs, &tracked_vars, prog_metadata);
+        changed |= evaluate_pure_calls(instrs, pure_functions, prog_metadata);
+        changed |= eliminate_dead_code(instrs, &tracked_vars);
+        if enabled_optimisations.is_loop_optimisation_enabled() {
+            changed |= optimise_loops(instrs, &mut tracked_vars, prog_metadata);
+        }
+        if !changed {
+            break;
+        }
+    }
+
+    debug!(
+        "scalar optimisations reduced {} from {} to {} instructions",
+        fun_id,
+        instr_count_before,
+        instrs.len()
+    );
+}
+
+/// All the vars that are declared or used in the global instructions
+pub fn get_global_vars(global_instrs: &[Instruction]) -> HashSet<VarId> {
+    let mut global_vars = HashSet::new();
+    for instr in global_instrs {
+        global_vars.extend(get_dest(instr).cloned());
+        global_vars.extend(get_used_vars(instr).into_iter().cloned());
+    }
+    global_vars
+}
+
+fn get_tracked_vars(
+    instrs: &[Instruction],
+    global_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> HashSet<VarId> {
+    let mut vars: HashSet<&VarId> = HashSet::new();
+    // vars that can change without being assigned to
+    let mut untrackable_vars: HashSet<&VarId> = HashSet::new();
+    for instr in instrs {
+        vars.extend(get_dest(instr));
+        vars.extend(get_used_vars(instr));
+
+        match instr {
+            Instruction::AddressOf(_, _, Src::Var(var))
+            | Instruction::AllocateVariable(_, var, _) => {
+                untrackable_vars.insert(var);
+            }
+            _ => {}
+        }
+    }
+
+    vars.into_iter()
+        .filter(|var| {
+            !global_vars.contains(var)
+                && !untrackable_vars.contains(var)
+                && !prog_metadata.is_var_the_null_dest(var)
+                && prog_metadata
+                    .get_var_type(var)
+                    .map(|var_type| var_type.is_scalar_type())
+                    .unwrap_or(false)
+        })
+        .cloned()
+        .collect()
+}
@@ -0,0 +1,216 @@
+use std::collections::HashSet;
+use std::mem::{discriminant, Discriminant};
+
+use log::trace;
+
+use crate::middle_end::ids::{StringLiteralId, VarId};
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::{
+    find_facts_at_block_starts, ControlFlowGraph, Facts,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_dest, get_srcs,
+};
+
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+enum Operand {
+    Var(VarId),
+    /// the address of a var, which stays the same even if the var is assigned to
+    AddressOf(VarId),
+    Int(i128),
+    /// the bits of a float constant, so that operands can be hashed
+    Float(u64),
+    StringLiteral(StringLiteralId),
+}
+
+/// The operation an instruction does and what it does it to, so instructions that compute
+/// the same value have the same expression
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+struct Expression {
+    operation: Discriminant<Instruction>,
+    operands: Vec<Operand>,
+    value_type: String,
+}
+
+/// For each expression whose value is held in a var, the var that holds it
+type AvailableExpressions = Facts<Expression, VarId>;
+
+/// Find instructions that compute a value that is already held in another var, because the
+/// same operation has been done to the same operands on every path to the instruction, and
+/// replace them with a copy of that var.
+///
+/// Returns true if any instructions were changed.
+pub fn eliminate_common_subexpressions(
+    instrs: &mut [Instruction],
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let cfg = ControlFlowGraph::new(instrs);
+
+    let available_expressions_at_block_starts = find_facts_at_block_starts(
+        instrs,
+        &cfg,
+        |instr, available_expressions| {
+            update_available_expressions(instr, available_expressions, tracked_vars, prog_metadata)
+        },
+        |block_i, _| cfg.blocks[block_i].successors.to_owned(),
+    );
+
+    let mut changed = false;
+    for (block, available_expressions) in
+        cfg.blocks.iter().zip(available_expressions_at_block_starts)
+    {
+        let mut available_expressions = match available_expressions {
+            Some(available_expressions) => available_expressions,
+            None => continue,
+        };
+
+        for instr in &mut instrs[block.instr_range.to_owned()] {
+            if let Some(expression) = get_expression(instr, tracked_vars, prog_metadata) {
+                let dest = get_dest(instr).unwrap();
+                if let Some(holding_var) = available_expressions.get(&expression) {
+                    if holding_var != dest {
+                        let new_instr = Instruction::SimpleAssignment(
+                            instr.get_instr_id(),
+                            dest.to_owned(),
+                            Src::Var(holding_var.to_owned()),
+                        );
+                        trace!("replacing {} with {}", instr, new_instr);
+                        *instr = new_instr;
+                        changed = true;
+                    }
+                }
+            }
+
+            update_available_expressions(
+                instr,
+                &mut available_expressions,
+                tracked_vars,
+                prog_metadata,
+            );
+        }
+    }
+
+    changed
+}
+
+fn update_available_expressions(
+    instr: &Instruction,
+    available_expressions: &mut AvailableExpressions,
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) {
+    let dest = match get_dest(instr) {
+        Some(dest) if tracked_vars.contains(dest) => dest,
+        _ => return,
+    };
+
+    // assigning to the var changes the value of any expressions that use it
+    available_expressions.retain(|expression, holding_var| {
+        holding_var != dest && !expression.operands.contains(&Operand::Var(dest.to_owned()))
+    });
+
+    if let Some(expression) = get_expression(instr, tracked_vars, prog_metadata) {
+        if !expression.operands.contains(&Operand::Var(dest.to_owned())) {
+            available_expressions
+                .entry(expression)
+                .or_insert(dest.to_owned());
+        }
+    }
+}
+
+/// The expression that the instruction computes, if it only depends on its operands.
+/// The operands have to be constants or tracked vars, so that any change to them can be seen.
+fn get_expression(
+    instr: &Instruction,
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> Option<Expression> {
+    let dest = get_dest(instr)?;
+    if !tracked_vars.contains(dest) {
+        return None;
+    }
+
+    let operands = match instr {
+        Instruction::AddressOf(_, _, Src::Var(var)) => vec![Operand::AddressOf(var.to_owned())],
+        Instruction::PointerToStringLiteral(_, _, string_literal_id) => {
+            vec![Operand::StringLiteral(string_literal_id.to_owned())]
+        }
+        Instruction::BitwiseNot(..)
+        | Instruction::LogicalNot(..)
+        | Instruction::Mult(..)
+        | Instruction::Div(..)
+        | Instruction::Mod(..)
+        | Instruction::Add(..)
+        | Instruction::Sub(..)
+        | Instruction::LeftShift(..)
+        | Instruction::RightShift(..)
+        | Instruction::BitwiseAnd(..)
+        | Instruction::BitwiseOr(..)
+        | Instruction::BitwiseXor(..)
+        | Instruction::LogicalAnd(..)
+        | Instruction::LogicalOr(..)
+        | Instruction::LessThan(..)
+        | Instruction::GreaterThan(..)
+        | Instruction::LessThanEq(..)
+        | Instruction::GreaterThanEq(..)
+        | Instruction::Equal(..)
+        | Instruction::NotEqual(..)
+        | Instruction::I8toI16(..)
+        | Instruction::I8toU16(..)
+        | Instruction::U8toI16(..)
+        | Instruction::U8toU16(..)
+        | Instruction::I16toI32(..)
+        | Instruction::U16toI32(..)
+        | Instruction::I16toU32(..)
+        | Instruction::U16toU32(..)
+        | Instruction::I32toU32(..)
+        | Instruction::I32toU64(..)
+        | Instruction::U32toU64(..)
+        | Instruction::I64toU64(..)
+        | Instruction::I32toI64(..)
+        | Instruction::U32toI64(..)
+        | Instruction::U32toF32(..)
+        | Instruction::I32toF32(..)
+        | Instruction::U64toF32(..)
+        | Instruction::I64toF32(..)
+        | Instruction::U32toF64(..)
+        | Instruction::I32toF64(..)
+        | Instruction::U64toF64(..)
+        | Instruction::I64toF64(..)
+        | Instruction::F32toF64(..)
+        | Instruction::F64toI32(..)
+        | Instruction::I32toI8(..)
+        | Instruction::U32toI8(..)
+        | Instruction::I64toI8(..)
+        | Instruction::U64toI8(..)
+        | Instruction::I32toU8(..)
+        | Instruction::U32toU8(..)
+        | Instruction::I64toU8(..)
+        | Instruction::U64toU8(..)
+        | Instruction::I64toI32(..)
+        | Instruction::U64toI32(..)
+        | Instruction::U32toPtr(..)
+        | Instruction::I32toPtr(..)
+        | Instruction::PtrToI32(..) => {
+            let mut operands = Vec::new();
+            for src in get_srcs(instr) {
+                operands.push(match src {
+                    Src::Var(var) if tracked_vars.contains(var) => Operand::Var(var.to_owned()),
+                    Src::Constant(Constant::Int(n)) => Operand::Int(n.to_owned()),
+                    Src::Constant(Constant::Float(z)) => Operand::Float(z.to_bits()),
+                    _ => return None,
+                });
+            }
+            operands
+        }
+        _ => return None,
+    };
+
+    Some(Expression {
+        operation: discriminant(instr),
+        operands,
+        value_type: prog_metadata.get_var_type(dest).unwrap().to_string(),
+    })
+}
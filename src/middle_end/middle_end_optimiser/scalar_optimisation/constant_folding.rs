@@ -0,0 +1,270 @@
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::IrType;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::get_dest;
+
+/// Convert a constant to the value it has when stored in a var of the given type, by
+/// wrapping integers to the width of the type and rounding floats to its precision.
+/// Returns None if the constant can't be stored in the type.
+pub fn normalise_constant(constant: &Constant, value_type: &IrType) -> Option<Constant> {
+    match (constant, value_type) {
+        (Constant::Int(n), _) => {
+            let (bits, is_signed) = get_integer_width(value_type)?;
+            Some(Constant::Int(wrap_integer(*n, bits, is_signed)))
+        }
+        // NaN isn't equal to itself, so it could never be known to be constant
+        (Constant::Float(z), _) if z.is_nan() => None,
+        (Constant::Float(z), IrType::F32) => Some(Constant::Float(*z as f32 as f64)),
+        (Constant::Float(z), IrType::F64) => Some(Constant::Float(*z)),
+        (Constant::Float(_), _) => None,
+    }
+}
+
+/// Bit width and signedness of integral and pointer types
+fn get_integer_width(value_type: &IrType) -> Option<(u32, bool)> {
+    match value_type {
+        IrType::I8 => Some((8, true)),
+        IrType::U8 => Some((8, false)),
+        IrType::I16 => Some((16, true)),
+        IrType::U16 => Some((16, false)),
+        IrType::I32 => Some((32, true)),
+        IrType::U32 | IrType::PointerTo(_) => Some((32, false)),
+        IrType::I64 => Some((64, true)),
+        IrType::U64 => Some((64, false)),
+        _ => None,
+    }
+}
+
+fn wrap_integer(n: i128, bits: u32, is_signed: bool) -> i128 {
+    let unused_bits = 128 - bits;
+    if is_signed {
+        (n << unused_bits) >> unused_bits
+    } else {
+        ((n as u128) << unused_bits >> unused_bits) as i128
+    }
+}
+
+/// Evaluate the instruction, given the values of the srcs it uses.
+///
+/// Returns the value assigned to the dest, or None if any of the srcs aren't constant,
+/// or the result can't be worked out at compile time (such as dividing by zero, which
+/// has to trap at runtime).
+pub fn fold_instr(
+    instr: &Instruction,
+    get_src_value: impl Fn(&Src) -> Option<Constant>,
+    prog_metadata: &ProgramMetadata,
+) -> Option<Constant> {
+    let dest_type = |dest| prog_metadata.get_var_type(dest).unwrap();
+
+    let result = match instr {
+        Instruction::SimpleAssignment(_, dest, src) => {
+            // the value is only kept if the src is loaded as the same type
+            if let Src::Var(src_var) = src {
+                if prog_metadata.get_var_type(src_var).unwrap() != dest_type(dest) {
+                    return None;
+                }
+            }
+            get_src_value(src)?
+        }
+        Instruction::BitwiseNot(_, _, src) => match get_src_value(src)? {
+            Constant::Int(n) => Constant::Int(!n),
+            Constant::Float(_) => return None,
+        },
+        Instruction::LogicalNot(_, _, src) => bool_constant(!is_true(&get_src_value(src)?)),
+        Instruction::Mult(_, dest, left, right)
+        | Instruction::Div(_, dest, left, right)
+        | Instruction::Mod(_, dest, left, right)
+        | Instruction::Add(_, dest, left, right)
+        | Instruction::Sub(_, dest, left, right)
+        | Instruction::LeftShift(_, dest, left, right)
+        | Instruction::RightShift(_, dest, left, right)
+        | Instruction::BitwiseAnd(_, dest, left, right)
+        | Instruction::BitwiseOr(_, dest, left, right)
+        | Instruction::BitwiseXor(_, dest, left, right) => {
+            // both srcs are loaded as the dest type
+            let dest_type = dest_type(dest);
+            let left = normalise_constant(&get_src_value(left)?, &dest_type)?;
+            let right = normalise_constant(&get_src_value(right)?, &dest_type)?;
+            match (left, right) {
+                (Constant::Int(l), Constant::Int(r)) => {
+                    Constant::Int(fold_integer_op(instr, l, r, &dest_type)?)
+                }
+                (Constant::Float(l), Constant::Float(r)) => {
+                    Constant::Float(fold_float_op(instr, l, r, &dest_type)?)
+                }
+                _ => return None,
+            }
+        }
+        Instruction::LogicalAnd(_, _, left, right) => {
+            bool_constant(is_true(&get_src_value(left)?) && is_true(&get_src_value(right)?))
+        }
+        Instruction::LogicalOr(_, _, left, right) => {
+            bool_constant(is_true(&get_src_value(left)?) || is_true(&get_src_value(right)?))
+        }
+        Instruction::LessThan(_, _, left, right)
+        | Instruction::GreaterThan(_, _, left, right)
+        | Instruction::LessThanEq(_, _, left, right)
+        | Instruction::GreaterThanEq(_, _, left, right)
+        | Instruction::Equal(_, _, left, right)
+        | Instruction::NotEqual(_, _, left, right) => {
+            let ordering = compare_srcs(left, right, &get_src_value, prog_metadata)?;
+            bool_constant(match instr {
+                Instruction::LessThan(..) => ordering.is_lt(),
+                Instruction::GreaterThan(..) => ordering.is_gt(),
+                Instruction::LessThanEq(..) => ordering.is_le(),
+                Instruction::GreaterThanEq(..) => ordering.is_ge(),
+                Instruction::Equal(..) => ordering.is_eq(),
+                Instruction::NotEqual(..) => ordering.is_ne(),
+                _ => unreachable!(),
+            })
+        }
+        // integer conversions keep the value, wrapped to the width of the dest
+        Instruction::I8toI16(_, _, src)
+        | Instruction::I8toU16(_, _, src)
+        | Instruction::U8toI16(_, _, src)
+        | Instruction::U8toU16(_, _, src)
+        | Instruction::I16toI32(_, _, src)
+        | Instruction::U16toI32(_, _, src)
+        | Instruction::I16toU32(_, _, src)
+        | Instruction::U16toU32(_, _, src)
+        | Instruction::I32toU32(_, _, src)
+        | Instruction::I32toU64(_, _, src)
+        | Instruction::U32toU64(_, _, src)
+        | Instruction::I64toU64(_, _, src)
+        | Instruction::I32toI64(_, _, src)
+        | Instruction::U32toI64(_, _, src)
+        | Instruction::I32toI8(_, _, src)
+        | Instruction::U32toI8(_, _, src)
+        | Instruction::I64toI8(_, _, src)
+        | Instruction::U64toI8(_, _, src)
+        | Instruction::I32toU8(_, _, src)
+        | Instruction::U32toU8(_, _, src)
+        | Instruction::I64toU8(_, _, src)
+        | Instruction::U64toU8(_, _, src)
+        | Instruction::I64toI32(_, _, src)
+        | Instruction::U64toI32(_, _, src)
+        | Instruction::U32toPtr(_, _, src)
+        | Instruction::I32toPtr(_, _, src)
+        | Instruction::PtrToI32(_, _, src) => match get_src_value(src)? {
+            Constant::Int(n) => Constant::Int(n),
+            Constant::Float(_) => return None,
+        },
+        Instruction::U32toF32(_, _, src)
+        | Instruction::I32toF32(_, _, src)
+        | Instruction::U64toF32(_, _, src)
+        | Instruction::I64toF32(_, _, src) => match get_src_value(src)? {
+            // convert straight to f32, to only round once
+            Constant::Int(n) => Constant::Float(n as f32 as f64),
+            Constant::Float(_) => return None,
+        },
+        Instruction::U32toF64(_, _, src)
+        | Instruction::I32toF64(_, _, src)
+        | Instruction::U64toF64(_, _, src)
+        | Instruction::I64toF64(_, _, src) => match get_src_value(src)? {
+            Constant::Int(n) => Constant::Float(n as f64),
+            Constant::Float(_) => return None,
+        },
+        Instruction::F32toF64(_, _, src) => match get_src_value(src)? {
+            Constant::Float(z) => Constant::Float(z),
+            Constant::Int(_) => return None,
+        },
+        Instruction::F64toI32(_, _, src) => match get_src_value(src)? {
+            // out of range conversions trap
+            Constant::Float(z) if z.trunc() >= i32::MIN as f64 && z.trunc() <= i32::MAX as f64 => {
+                Constant::Int(z.trunc() as i128)
+            }
+            _ => return None,
+        },
+        _ => return None,
+    };
+
+    normalise_constant(&result, &dest_type(get_dest(instr).unwrap()))
+}
+
+fn fold_integer_op(instr: &Instruction, l: i128, r: i128, value_type: &IrType) -> Option<i128> {
+    // shifts take the shift amount modulo the width of the wasm type
+    let shift_mask = match value_type {
+        IrType::I64 | IrType::U64 => 63,
+        _ => 31,
+    };
+    let result = match instr {
+        Instruction::Mult(..) => l.wrapping_mul(r),
+        Instruction::Div(..) => {
+            // dividing by zero, or the minimum value by -1, traps
+            if r == 0 || (r == -1 && value_type.is_signed_integral()) {
+                return None;
+            }
+            l / r
+        }
+        Instruction::Mod(..) => {
+            if r == 0 {
+                return None;
+            }
+            l % r
+        }
+        Instruction::Add(..) => l.wrapping_add(r),
+        Instruction::Sub(..) => l.wrapping_sub(r),
+        Instruction::LeftShift(..) => ((l as u128) << (r & shift_mask)) as i128,
+        Instruction::RightShift(..) => l >> (r & shift_mask),
+        Instruction::BitwiseAnd(..) => l & r,
+        Instruction::BitwiseOr(..) => l | r,
+        Instruction::BitwiseXor(..) => l ^ r,
+        _ => unreachable!(),
+    };
+    Some(result)
+}
+
+fn fold_float_op(instr: &Instruction, l: f64, r: f64, value_type: &IrType) -> Option<f64> {
+    let result = match value_type {
+        IrType::F32 => {
+            let (l, r) = (l as f32, r as f32);
+            (match instr {
+                Instruction::Mult(..) => l * r,
+                Instruction::Div(..) => l / r,
+                Instruction::Add(..) => l + r,
+                Instruction::Sub(..) => l - r,
+                _ => return None,
+            }) as f64
+        }
+        _ => match instr {
+            Instruction::Mult(..) => l * r,
+            Instruction::Div(..) => l / r,
+            Instruction::Add(..) => l + r,
+            Instruction::Sub(..) => l - r,
+            _ => return None,
+        },
+    };
+    Some(result)
+}
+
+/// Compare two srcs, both loaded as the type of whichever of them is a var
+pub fn compare_srcs(
+    left: &Src,
+    right: &Src,
+    get_src_value: impl Fn(&Src) -> Option<Constant>,
+    prog_metadata: &ProgramMetadata,
+) -> Option<std::cmp::Ordering> {
+    let src_type = match (left, right) {
+        (Src::Var(var), _) | (_, Src::Var(var)) => prog_metadata.get_var_type(var).unwrap(),
+        (Src::Constant(constant), _) => &constant.get_type(None),
+        _ => return None,
+    };
+    let left = normalise_constant(&get_src_value(left)?, &src_type)?;
+    let right = normalise_constant(&get_src_value(right)?, &src_type)?;
+    match (left, right) {
+        (Constant::Int(l), Constant::Int(r)) => Some(l.cmp(&r)),
+        (Constant::Float(l), Constant::Float(r)) => l.partial_cmp(&r),
+        _ => None,
+    }
+}
+
+fn is_true(constant: &Constant) -> bool {
+    match constant {
+        Constant::Int(n) => *n != 0,
+        Constant::Float(z) => *z != 0.,
+    }
+}
+
+fn bool_constant(b: bool) -> Constant {
+    Constant::Int(b as i128)
+}
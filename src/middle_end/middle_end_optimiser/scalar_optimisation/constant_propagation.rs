@@ -0,0 +1,259 @@
+use std::collections::HashSet;
+
+use log::trace;
+
+use crate::middle_end::ids::{LabelId, VarId};
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::constant_folding::{
+    compare_srcs, fold_instr,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::{
+    find_facts_at_block_starts, get_arm_label, ControlFlowGraph, Facts,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_dest, is_pure_assignment,
+};
+
+/// The vars that are known to hold a constant value
+type ConstantVars = Facts<VarId, Constant>;
+
+/// Which way a conditional branch goes, when its condition is constant
+enum KnownBranch {
+    Taken(LabelId),
+    NotTaken,
+}
+
+/// Find the vars that always hold the same constant value, and replace uses of them with the
+/// constant. Instructions whose srcs are all constant are evaluated at compile time.
+///
+/// A branch whose condition is constant only goes one way, so assignments on the path that
+/// isn't taken don't stop a var being constant. Paths that are never taken are removed.
+///
+/// Returns true if any instructions were changed.
+pub fn propagate_constants(
+    instrs: &mut Vec<Instruction>,
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let cfg = ControlFlowGraph::new(instrs);
+
+    let constant_vars_at_block_starts = find_facts_at_block_starts(
+        instrs,
+        &cfg,
+        |instr, constant_vars| {
+            update_constant_vars(instr, constant_vars, tracked_vars, prog_metadata)
+        },
+        |block_i, constant_vars| {
+            let block = &cfg.blocks[block_i];
+            let last_instr = &instrs[block.instr_range.end - 1];
+            match get_known_branch(last_instr, constant_vars, prog_metadata) {
+                None => block.successors.to_owned(),
+                Some(KnownBranch::Taken(label)) => vec![cfg.get_label_block(&label)],
+                Some(KnownBranch::NotTaken) => block
+                    .successors
+                    .iter()
+                    .map(|s| s.to_owned())
+                    .filter(|s| *s == block_i + 1)
+                    .collect(),
+            }
+        },
+    );
+
+    let mut changed = false;
+    for (block, constant_vars) in cfg.blocks.iter().zip(constant_vars_at_block_starts) {
+        let mut constant_vars = match constant_vars {
+            Some(constant_vars) => constant_vars,
+            None => {
+                trace!("removing unreachable instructions {:?}", block.instr_range);
+                for instr in &mut instrs[block.instr_range.to_owned()] {
+                    *instr = Instruction::Nop(instr.get_instr_id());
+                }
+                changed = true;
+                continue;
+            }
+        };
+
+        for instr in &mut instrs[block.instr_range.to_owned()] {
+            let new_instr = match get_known_branch(instr, &constant_vars, prog_metadata) {
+                Some(KnownBranch::Taken(label)) => {
+                    Some(Instruction::Br(instr.get_instr_id(), label))
+                }
+                Some(KnownBranch::NotTaken) => Some(Instruction::Nop(instr.get_instr_id())),
+                None => {
+                    match get_assigned_constant(instr, &constant_vars, tracked_vars, prog_metadata)
+                    {
+                        Some(value) if !is_constant_assignment(instr, &value) => {
+                            Some(Instruction::SimpleAssignment(
+                                instr.get_instr_id(),
+                                get_dest(instr).unwrap().to_owned(),
+                                Src::Constant(value),
+                            ))
+                        }
+                        _ => None,
+                    }
+                }
+            };
+
+            match new_instr {
+                Some(new_instr) => {
+                    trace!("replacing {} with {}", instr, new_instr);
+                    *instr = new_instr;
+                    changed = true;
+                }
+                None => {
+                    changed |= substitute_constant_srcs(instr, &constant_vars, prog_metadata);
+                }
+            }
+
+            update_constant_vars(instr, &mut constant_vars, tracked_vars, prog_metadata);
+        }
+    }
+
+    instrs.retain(|instr| !matches!(instr, Instruction::Nop(..)));
+    changed
+}
+
+fn get_src_value(src: &Src, constant_vars: &ConstantVars) -> Option<Constant> {
+    match src {
+        Src::Constant(constant) => Some(constant.to_owned()),
+        Src::Var(var) => constant_vars.get(var).map(|value| value.to_owned()),
+        Src::StoreAddressVar(_) | Src::Fun(_) => None,
+    }
+}
+
+/// The constant value that the instruction assigns to its dest, if it is always the same
+fn get_assigned_constant(
+    instr: &Instruction,
+    constant_vars: &ConstantVars,
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> Option<Constant> {
+    if !is_pure_assignment(instr) || !tracked_vars.contains(get_dest(instr)?) {
+        return None;
+    }
+    fold_instr(
+        instr,
+        |src| get_src_value(src, constant_vars),
+        prog_metadata,
+    )
+}
+
+fn update_constant_vars(
+    instr: &Instruction,
+    constant_vars: &mut ConstantVars,
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) {
+    let dest = match get_dest(instr) {
+        Some(dest) if tracked_vars.contains(dest) => dest.to_owned(),
+        _ => return,
+    };
+    match get_assigned_constant(instr, constant_vars, tracked_vars, prog_metadata) {
+        Some(value) => {
+            constant_vars.insert(dest, value);
+        }
+        None => {
+            constant_vars.remove(&dest);
+        }
+    }
+}
+
+fn is_constant_assignment(instr: &Instruction, value: &Constant) -> bool {
+    matches!(instr, Instruction::SimpleAssignment(_, _, Src::Constant(constant)) if constant == value)
+}
+
+fn get_known_branch(
+    instr: &Instruction,
+    constant_vars: &ConstantVars,
+    prog_metadata: &ProgramMetadata,
+) -> Option<KnownBranch> {
+    let get_value = |src: &Src| get_src_value(src, constant_vars);
+    match instr {
+        Instruction::BrIfEq(_, left, right, label) => {
+            match compare_srcs(left, right, get_value, prog_metadata)?.is_eq() {
+                true => Some(KnownBranch::Taken(label.to_owned())),
+                false => Some(KnownBranch::NotTaken),
+            }
+        }
+        Instruction::BrIfNotEq(_, left, right, label) => {
+            match compare_srcs(left, right, get_value, prog_metadata)?.is_ne() {
+                true => Some(KnownBranch::Taken(label.to_owned())),
+                false => Some(KnownBranch::NotTaken),
+            }
+        }
+        Instruction::BrTable(_, src, table, arms) => {
+            let index = match get_value(src)? {
+                // the index is an unsigned i32, so negative values are out of range
+                Constant::Int(n) => n as i32 as u32 as usize,
+                Constant::Float(_) => return None,
+            };
+            let arm_i = table.get(index).unwrap_or(&(arms.len() - 1)).to_owned();
+            Some(KnownBranch::Taken(get_arm_label(&arms[arm_i]).to_owned()))
+        }
+        _ => None,
+    }
+}
+
+/// Replace var srcs that are known to be constant with the constant, where the constant is
+/// loaded as the same type as the var would have been
+fn substitute_constant_srcs(
+    instr: &mut Instruction,
+    constant_vars: &ConstantVars,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let var_type = |var: &VarId| prog_metadata.get_var_type(var).unwrap();
+    let constant_value = |src: &Src| match src {
+        Src::Var(var) => constant_vars.get(var).map(|value| value.to_owned()),
+        _ => None,
+    };
+
+    let mut changed = false;
+    match instr {
+        // the srcs of these are loaded as the dest type
+        Instruction::Mult(_, dest, left, right)
+        | Instruction::Div(_, dest, left, right)
+        | Instruction::Mod(_, dest, left, right)
+        | Instruction::Add(_, dest, left, right)
+        | Instruction::Sub(_, dest, left, right)
+        | Instruction::LeftShift(_, dest, left, right)
+        | Instruction::RightShift(_, dest, left, right)
+        | Instruction::BitwiseAnd(_, dest, left, right)
+        | Instruction::BitwiseOr(_, dest, left, right)
+        | Instruction::BitwiseXor(_, dest, left, right)
+        | Instruction::LogicalAnd(_, dest, left, right)
+        | Instruction::LogicalOr(_, dest, left, right) => {
+            let dest_type = var_type(dest);
+            for src in [left, right] {
+                if let (Src::Var(var), Some(value)) = (&*src, constant_value(src)) {
+                    if var_type(var) == dest_type {
+                        *src = Src::Constant(value);
+                        changed = true;
+                    }
+                }
+            }
+        }
+        // the srcs of comparisons are loaded as the type of whichever src is a var, so one
+        // of them has to stay a var
+        Instruction::LessThan(_, _, left, right)
+        | Instruction::GreaterThan(_, _, left, right)
+        | Instruction::LessThanEq(_, _, left, right)
+        | Instruction::GreaterThanEq(_, _, left, right)
+        | Instruction::Equal(_, _, left, right)
+        | Instruction::NotEqual(_, _, left, right) => {
+            if let (Src::Var(left_var), Src::Var(right_var)) = (&*left, &*right) {
+                if var_type(left_var) == var_type(right_var) {
+                    if let Some(value) = constant_value(left) {
+                        *left = Src::Constant(value);
+                        changed = true;
+                    } else if let Some(value) = constant_value(right) {
+                        *right = Src::Constant(value);
+                        changed = true;
+                    }
+                }
+            }
+        }
+        _ => {}
+    }
+    changed
+}
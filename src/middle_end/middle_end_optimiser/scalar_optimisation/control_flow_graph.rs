@@ -0,0 +1,251 @@
+use std::collections::{HashMap, HashSet, VecDeque};
+use std::hash::Hash;
+use std::ops::Range;
+
+use crate::middle_end::ids::LabelId;
+use crate::middle_end::instructions::Instruction;
+
+/// A run of instructions that is only entered at the start and only left at the end
+pub struct BasicBlock {
+    pub instr_range: Range<usize>,
+    pub successors: Vec<usize>,
+    pub predecessors: Vec<usize>,
+}
+
+/// The basic blocks of a function body, indexed in the order they appear in the
+/// instructions. The first block is the entry point.
+pub struct ControlFlowGraph {
+    pub blocks: Vec<BasicBlock>,
+    label_blocks: HashMap<LabelId, usize>,
+}
+
+impl ControlFlowGraph {
+    pub fn new(instrs: &[Instruction]) -> Self {
+        // find where each block starts
+        let mut block_starts = vec![0];
+        for (i, instr) in instrs.iter().enumerate() {
+            match instr {
+                Instruction::Label(..) => block_starts.push(i),
+                instr if is_block_terminator(instr) => block_starts.push(i + 1),
+                _ => {}
+            }
+        }
+        block_starts.push(instrs.len());
+        block_starts.dedup();
+
+        let instr_ranges: Vec<Range<usize>> = block_starts
+            .windows(2)
+            .map(|window| window[0]..window[1])
+            .collect();
+
+        let mut label_blocks: HashMap<LabelId, usize> = HashMap::new();
+        for (block_i, instr_range) in instr_ranges.iter().enumerate() {
+            if let Some(Instruction::Label(_, label)) = instrs.get(instr_range.start) {
+                label_blocks.insert(label.to_owned(), block_i);
+            }
+        }
+
+        let mut blocks: Vec<BasicBlock> = Vec::new();
+        for (block_i, instr_range) in instr_ranges.iter().enumerate() {
+            let next_block = if block_i + 1 < instr_ranges.len() {
+                Some(block_i + 1)
+            } else {
+                None
+            };
+            let mut successors = match instrs.get(instr_range.end - 1) {
+                Some(Instruction::Br(_, label)) => vec![label_blocks[label]],
+                Some(Instruction::BrIfEq(_, _, _, label))
+                | Some(Instruction::BrIfNotEq(_, _, _, label)) => {
+                    let mut successors = vec![label_blocks[label]];
+                    successors.extend(next_block);
+                    successors
+                }
+                Some(Instruction::BrTable(_, _, _, arms)) => arms
+                    .iter()
+                    .map(|arm| label_blocks[get_arm_label(arm)])
+                    .collect(),
+                Some(Instruction::Ret(..)) | Some(Instruction::TailCall(..)) => Vec::new(),
+                _ => next_block.into_iter().collect(),
+            };
+            successors.sort();
+            successors.dedup();
+
+            blocks.push(BasicBlock {
+                instr_range: instr_range.to_owned(),
+                successors,
+                predecessors: Vec::new(),
+            });
+        }
+
+        for block_i in 0..blocks.len() {
+            for successor in blocks[block_i].successors.to_owned() {
+                blocks[successor].predecessors.push(block_i);
+            }
+        }
+
+        ControlFlowGraph {
+            blocks,
+            label_blocks,
+        }
+    }
+
+    pub fn get_label_block(&self, label: &LabelId) -> usize {
+        self.label_blocks[label]
+    }
+
+    /// For each block, whether there is a path to it from the entry
+    pub fn find_reachable_blocks(&self) -> Vec<bool> {
+        let block_count = self.blocks.len();
+        let mut is_reachable = vec![false; block_count];
+        let mut to_visit = vec![0];
+        while let Some(block_i) = to_visit.pop() {
+            if block_i < block_count && !is_reachable[block_i] {
+                is_reachable[block_i] = true;
+                to_visit.extend(self.blocks[block_i].successors.iter().cloned());
+            }
+        }
+        is_reachable
+    }
+
+    /// For each block, the blocks that are on every path from the entry to it, including
+    /// itself. Unreachable blocks have no dominators.
+    pub fn find_dominators(&self) -> Vec<HashSet<usize>> {
+        let block_count = self.blocks.len();
+        let is_reachable = self.find_reachable_blocks();
+        let reachable_blocks: HashSet<usize> = (0..block_count)
+            .filter(|block_i| is_reachable[*block_i])
+            .collect();
+
+        let mut dominators: Vec<HashSet<usize>> = (0..block_count)
+            .map(|block_i| match is_reachable[block_i] {
+                true => reachable_blocks.to_owned(),
+                false => HashSet::new(),
+            })
+            .collect();
+        if block_count == 0 {
+            return dominators;
+        }
+        dominators[0] = HashSet::from([0]);
+
+        let mut changed = true;
+        while changed {
+            changed = false;
+            for block_i in 1..block_count {
+                if !is_reachable[block_i] {
+                    continue;
+                }
+                let mut new_dominators = reachable_blocks.to_owned();
+                for predecessor in &self.blocks[block_i].predecessors {
+                    if is_reachable[*predecessor] {
+                        new_dominators.retain(|block| dominators[*predecessor].contains(block));
+                    }
+                }
+                new_dominators.insert(block_i);
+                if new_dominators != dominators[block_i] {
+                    dominators[block_i] = new_dominators;
+                    changed = true;
+                }
+            }
+        }
+
+        dominators
+    }
+}
+
+fn is_block_terminator(instr: &Instruction) -> bool {
+    matches!(
+        instr,
+        Instruction::Br(..)
+            | Instruction::BrIfEq(..)
+            | Instruction::BrIfNotEq(..)
+            | Instruction::BrTable(..)
+            | Instruction::Ret(..)
+            | Instruction::TailCall(..)
+    )
+}
+
+/// Before relooping, each arm of a br_table is a single branch
+pub fn get_arm_label(arm: &[Instruction]) -> &LabelId {
+    match arm {
+        [Instruction::Br(_, label)] => label,
+        _ => unreachable!(),
+    }
+}
+
+/// Facts about vars that are known to be true at a point in the program, such as
+/// "t1 is a copy of t2"
+pub type Facts<K, V> = HashMap<K, V>;
+
+/// Solve a forward dataflow problem where a fact holds at the start of a block only if it
+/// holds at the end of every predecessor that can branch to it. transfer updates the facts
+/// for the effect of one instruction, and get_successors gives the successors that the end
+/// of a block can branch to, given the facts that hold there.
+///
+/// Returns the facts at the start of each block, or None if the block is unreachable.
+pub fn find_facts_at_block_starts<K: Clone + Eq + Hash, V: Clone + PartialEq>(
+    instrs: &[Instruction],
+    cfg: &ControlFlowGraph,
+    transfer: impl Fn(&Instruction, &mut Facts<K, V>),
+    get_successors: impl Fn(usize, &Facts<K, V>) -> Vec<usize>,
+) -> Vec<Option<Facts<K, V>>> {
+    let block_count = cfg.blocks.len();
+    let mut facts_in: Vec<Option<Facts<K, V>>> = vec![None; block_count];
+    let mut facts_out: Vec<Option<Facts<K, V>>> = vec![None; block_count];
+    let mut executable_edges: HashSet<(usize, usize)> = HashSet::new();
+
+    if block_count == 0 {
+        return facts_in;
+    }
+
+    // nothing is known on entry to the function
+    facts_in[0] = Some(Facts::new());
+    let mut worklist: VecDeque<usize> = VecDeque::from([0]);
+    let mut is_in_worklist = vec![false; block_count];
+    is_in_worklist[0] = true;
+
+    while let Some(block_i) = worklist.pop_front() {
+        is_in_worklist[block_i] = false;
+        let mut facts = facts_in[block_i].to_owned().unwrap();
+        for instr in &instrs[cfg.blocks[block_i].instr_range.to_owned()] {
+            transfer(instr, &mut facts);
+        }
+
+        let successors = get_successors(block_i, &facts);
+        let is_out_unchanged = facts_out[block_i].as_ref() == Some(&facts);
+        facts_out[block_i] = Some(facts);
+
+        for successor in successors {
+            let is_new_edge = executable_edges.insert((block_i, successor));
+            if (is_out_unchanged && !is_new_edge) || successor == 0 {
+                continue;
+            }
+
+            // meet of the facts from all the executable edges into the successor
+            let mut successor_facts: Option<Facts<K, V>> = None;
+            for predecessor in &cfg.blocks[successor].predecessors {
+                if !executable_edges.contains(&(*predecessor, successor)) {
+                    continue;
+                }
+                let predecessor_facts = facts_out[*predecessor].as_ref().unwrap();
+                successor_facts = Some(match successor_facts {
+                    None => predecessor_facts.to_owned(),
+                    Some(mut successor_facts) => {
+                        successor_facts
+                            .retain(|key, value| predecessor_facts.get(key) == Some(value));
+                        successor_facts
+                    }
+                });
+            }
+
+            if facts_in[successor] != successor_facts {
+                facts_in[successor] = successor_facts;
+                if !is_in_worklist[successor] {
+                    is_in_worklist[successor] = true;
+                    worklist.push_back(successor);
+                }
+            }
+        }
+    }
+
+    facts_in
+}
@@ -0,0 +1,189 @@
+use std::collections::HashSet;
+
+use log::trace;
+
+use crate::middle_end::ids::VarId;
+use crate::middle_end::instructions::{Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::IrType;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::{
+    find_facts_at_block_starts, ControlFlowGraph, Facts,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::get_dest;
+
+/// For each var that was assigned a conversion of another var, the var it was converted from
+type ConvertedVars = Facts<VarId, VarId>;
+
+/// Fuse chains of integer conversions into a single conversion, such as the I8toI16 then
+/// I16toI32 that promoting a char to an int creates. All the integer types up to 32 bits
+/// wide are i32s in wasm, so each of these conversions is only a load of the src as its
+/// own type, and a store that wraps it to the width of the dest. Converting straight from
+/// the start of the chain does the same, as long as the value isn't changed by a narrower
+/// type in the middle. Conversions to the type that the value already has become copies.
+///
+/// This keeps char and short arithmetic in i32, with one extend when the operands are
+/// loaded and one wrap when the result is stored. The conversions left unused are removed
+/// by dead code elimination.
+///
+/// Returns true if any instructions were changed.
+pub fn fuse_conversions(
+    instrs: &mut [Instruction],
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let cfg = ControlFlowGraph::new(instrs);
+
+    let converted_vars_at_block_starts = find_facts_at_block_starts(
+        instrs,
+        &cfg,
+        |instr, converted_vars| update_converted_vars(instr, converted_vars, tracked_vars),
+        |block_i, _| cfg.blocks[block_i].successors.to_owned(),
+    );
+
+    let mut changed = false;
+    for (block, converted_vars) in cfg.blocks.iter().zip(converted_vars_at_block_starts) {
+        let mut converted_vars = match converted_vars {
+            Some(converted_vars) => converted_vars,
+            None => continue,
+        };
+
+        for instr in &mut instrs[block.instr_range.to_owned()] {
+            changed |= fuse_conversion(instr, &converted_vars, prog_metadata);
+            update_converted_vars(instr, &mut converted_vars, tracked_vars);
+        }
+    }
+
+    changed
+}
+
+/// Convert straight from the start of the chain of conversions that ends at instr, if the
+/// value is the same either way. Returns true if the instruction was changed.
+fn fuse_conversion(
+    instr: &mut Instruction,
+    converted_vars: &ConvertedVars,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let (dest, src) = match get_i32_conversion_operands_mut(instr) {
+        Some((dest, Src::Var(src))) => (dest.to_owned(), src),
+        _ => return false,
+    };
+    let dest_type = prog_metadata.get_var_type(&dest).unwrap();
+
+    let mut changed = false;
+    if let Some(original_var) = converted_vars.get(src) {
+        let src_type = prog_metadata.get_var_type(src).unwrap();
+        let original_type = prog_metadata.get_var_type(original_var).unwrap();
+        // the conversion in the middle either keeps the value, or only wraps away bits
+        // that the last conversion wraps away anyway
+        let is_fusable = match (
+            bit_width(original_type),
+            bit_width(src_type),
+            bit_width(dest_type),
+        ) {
+            (Some(original_width), Some(src_width), Some(dest_width)) => {
+                conversion_keeps_value(original_type, original_width, src_type, src_width)
+                    || src_width >= dest_width
+            }
+            _ => false,
+        };
+        if is_fusable {
+            trace!("fusing conversion of {} from {}", src, original_var);
+            *src = original_var.to_owned();
+            changed = true;
+        }
+    }
+
+    // converting to the type the value already has doesn't do anything
+    if prog_metadata.get_var_type(src).unwrap() == dest_type {
+        let src = Src::Var(src.to_owned());
+        *instr = Instruction::SimpleAssignment(instr.get_instr_id(), dest, src);
+        changed = true;
+    }
+    changed
+}
+
+fn update_converted_vars(
+    instr: &Instruction,
+    converted_vars: &mut ConvertedVars,
+    tracked_vars: &HashSet<VarId>,
+) {
+    let dest = match get_dest(instr) {
+        Some(dest) if tracked_vars.contains(dest) => dest,
+        _ => return,
+    };
+
+    // assigning to the var ends any conversions to or from it
+    converted_vars.retain(|converted, original| converted != dest && original != dest);
+
+    if let Some((_, Src::Var(src_var))) = get_i32_conversion_operands(instr) {
+        if src_var != dest && tracked_vars.contains(src_var) {
+            converted_vars.insert(dest.to_owned(), src_var.to_owned());
+        }
+    }
+}
+
+/// Whether converting from src_type to dest_type never changes the value, because every
+/// value of src_type is also a value of dest_type
+fn conversion_keeps_value(
+    src_type: &IrType,
+    src_width: u32,
+    dest_type: &IrType,
+    dest_width: u32,
+) -> bool {
+    if src_type.is_signed_integral() && dest_type.is_unsigned_integral() {
+        return false;
+    }
+    if src_type.is_unsigned_integral() && dest_type.is_signed_integral() {
+        return dest_width > src_width;
+    }
+    dest_width >= src_width
+}
+
+fn bit_width(ir_type: &IrType) -> Option<u32> {
+    match ir_type {
+        IrType::I8 | IrType::U8 => Some(8),
+        IrType::I16 | IrType::U16 => Some(16),
+        IrType::I32 | IrType::U32 => Some(32),
+        _ => None,
+    }
+}
+
+/// The dest and src of a conversion between integer types that are all i32s in wasm, which
+/// the back end generates as a load of the src and a store to the dest
+fn get_i32_conversion_operands(instr: &Instruction) -> Option<(&VarId, &Src)> {
+    match instr {
+        Instruction::I8toI16(_, dest, src)
+        | Instruction::I8toU16(_, dest, src)
+        | Instruction::U8toI16(_, dest, src)
+        | Instruction::U8toU16(_, dest, src)
+        | Instruction::I16toI32(_, dest, src)
+        | Instruction::U16toI32(_, dest, src)
+        | Instruction::I16toU32(_, dest, src)
+        | Instruction::U16toU32(_, dest, src)
+        | Instruction::I32toU32(_, dest, src)
+        | Instruction::I32toI8(_, dest, src)
+        | Instruction::U32toI8(_, dest, src)
+        | Instruction::I32toU8(_, dest, src)
+        | Instruction::U32toU8(_, dest, src) => Some((dest, src)),
+        _ => None,
+    }
+}
+
+fn get_i32_conversion_operands_mut(instr: &mut Instruction) -> Option<(&VarId, &mut Src)> {
+    match instr {
+        Instruction::I8toI16(_, dest, src)
+        | Instruction::I8toU16(_, dest, src)
+        | Instruction::U8toI16(_, dest, src)
+        | Instruction::U8toU16(_, dest, src)
+        | Instruction::I16toI32(_, dest, src)
+        | Instruction::U16toI32(_, dest, src)
+        | Instruction::I16toU32(_, dest, src)
+        | Instruction::U16toU32(_, dest, src)
+        | Instruction::I32toU32(_, dest, src)
+        | Instruction::I32toI8(_, dest, src)
+        | Instruction::U32toI8(_, dest, src)
+        | Instruction::I32toU8(_, dest, src)
+        | Instruction::U32toU8(_, dest, src) => Some((dest, src)),
+        _ => None,
+    }
+}
@@ -0,0 +1,91 @@
+use std::collections::HashSet;
+
+use log::trace;
+
+use crate::middle_end::ids::VarId;
+use crate::middle_end::instructions::{Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::{
+    find_facts_at_block_starts, ControlFlowGraph, Facts,
+};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_address_var_mut, get_dest, get_srcs_mut,
+};
+
+/// For each var that is known to be a copy of another var, the var it is a copy of
+type CopiedVars = Facts<VarId, VarId>;
+
+/// Replace uses of vars that were assigned a copy of another var with the original var,
+/// as long as neither var has been reassigned since the copy. The copies are then dead,
+/// and get removed by dead code elimination.
+///
+/// Returns true if any instructions were changed.
+pub fn propagate_copies(
+    instrs: &mut [Instruction],
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) -> bool {
+    let cfg = ControlFlowGraph::new(instrs);
+
+    let copied_vars_at_block_starts = find_facts_at_block_starts(
+        instrs,
+        &cfg,
+        |instr, copied_vars| update_copied_vars(instr, copied_vars, tracked_vars, prog_metadata),
+        |block_i, _| cfg.blocks[block_i].successors.to_owned(),
+    );
+
+    let mut changed = false;
+    for (block, copied_vars) in cfg.blocks.iter().zip(copied_vars_at_block_starts) {
+        let mut copied_vars = match copied_vars {
+            Some(copied_vars) => copied_vars,
+            None => continue,
+        };
+
+        for instr in &mut instrs[block.instr_range.to_owned()] {
+            for src in get_srcs_mut(instr) {
+                if let Src::Var(var) = src {
+                    if let Some(original_var) = copied_vars.get(var) {
+                        trace!("replacing copy {} with {}", var, original_var);
+                        *var = original_var.to_owned();
+                        changed = true;
+                    }
+                }
+            }
+            if let Some(address_var) = get_address_var_mut(instr) {
+                if let Some(original_var) = copied_vars.get(address_var) {
+                    *address_var = original_var.to_owned();
+                    changed = true;
+                }
+            }
+
+            update_copied_vars(instr, &mut copied_vars, tracked_vars, prog_metadata);
+        }
+    }
+
+    changed
+}
+
+fn update_copied_vars(
+    instr: &Instruction,
+    copied_vars: &mut CopiedVars,
+    tracked_vars: &HashSet<VarId>,
+    prog_metadata: &ProgramMetadata,
+) {
+    let dest = match get_dest(instr) {
+        Some(dest) if tracked_vars.contains(dest) => dest,
+        _ => return,
+    };
+
+    // assigning to the var ends any copies to or from it
+    copied_vars.retain(|copy, original| copy != dest && original != dest);
+
+    if let Instruction::SimpleAssignment(_, _, Src::Var(src_var)) = instr {
+        if src_var != dest
+            && tracked_vars.contains(src_var)
+            && prog_metadata.get_var_type(src_var).unwrap()
+                == prog_metadata.get_var_type(dest).unwrap()
+        {
+            copied_vars.insert(dest.to_owned(), src_var.to_owned());
+        }
+    }
+}
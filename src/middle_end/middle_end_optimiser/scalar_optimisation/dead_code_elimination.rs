@@ -0,0 +1,60 @@
+use std::collections::{HashMap, HashSet};
+
+use log::trace;
+
+use crate::middle_end::ids::VarId;
+use crate::middle_end::instructions::{Instruction, Src};
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_dest, get_used_vars, is_pure_assignment,
+};
+
+/// Remove assignments to tracked vars that are never used, and copies of a var to itself.
+/// Removing an assignment can make the vars it used dead too, so repeat until there are
+/// no more to remove.
+///
+/// Returns true if any instructions were removed.
+pub fn eliminate_dead_code(instrs: &mut Vec<Instruction>, tracked_vars: &HashSet<VarId>) -> bool {
+    let mut use_counts: HashMap<VarId, usize> = HashMap::new();
+    for instr in instrs.iter() {
+        for var in get_used_vars(instr) {
+            *use_counts.entry(var.to_owned()).or_insert(0) += 1;
+        }
+    }
+
+    let is_dead = |instr: &Instruction, use_counts: &HashMap<VarId, usize>| {
+        if let Instruction::SimpleAssignment(_, dest, Src::Var(src_var)) = instr {
+            if dest == src_var {
+                return true;
+            }
+        }
+        match get_dest(instr) {
+            Some(dest) if tracked_vars.contains(dest) && is_pure_assignment(instr) => {
+                use_counts.get(dest).unwrap_or(&0) == &0
+            }
+            _ => false,
+        }
+    };
+
+    let mut changed = false;
+    loop {
+        let mut removed_any = false;
+        for instr in instrs.iter_mut() {
+            if matches!(instr, Instruction::Nop(..)) || !is_dead(instr, &use_counts) {
+                continue;
+            }
+            trace!("removing dead instruction {}", instr);
+            for var in get_used_vars(instr) {
+                *use_counts.get_mut(var).unwrap() -= 1;
+            }
+            *instr = Instruction::Nop(instr.get_instr_id());
+            removed_any = true;
+        }
+        if !removed_any {
+            break;
+        }
+        changed = true;
+    }
+
+    instrs.retain(|instr| !matches!(instr, Instruction::Nop(..)));
+    changed
+}
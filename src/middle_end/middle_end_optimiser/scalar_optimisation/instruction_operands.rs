@@ -0,0 +1,426 @@
+use crate::middle_end::ids::{LabelId, VarId};
+use crate::middle_end::instructions::{Dest, Instruction, Src};
+
+/// The var that the instruction assigns to, if any
+pub fn get_dest(instr: &Instruction) -> Option<&Dest> {
+    match instr {
+        Instruction::SimpleAssignment(_, dest, _)
+        | Instruction::LoadFromAddress(_, dest, _)
+        | Instruction::DeclareVariable(_, dest)
+        | Instruction::AllocateVariable(_, dest, _)
+        | Instruction::AddressOf(_, dest, _)
+        | Instruction::BitwiseNot(_, dest, _)
+        | Instruction::LogicalNot(_, dest, _)
+        | Instruction::Mult(_, dest, _, _)
+        | Instruction::Div(_, dest, _, _)
+        | Instruction::Mod(_, dest, _, _)
+        | Instruction::Add(_, dest, _, _)
+        | Instruction::Sub(_, dest, _, _)
+        | Instruction::LeftShift(_, dest, _, _)
+        | Instruction::RightShift(_, dest, _, _)
+        | Instruction::BitwiseAnd(_, dest, _, _)
+        | Instruction::BitwiseOr(_, dest, _, _)
+        | Instruction::BitwiseXor(_, dest, _, _)
+        | Instruction::LogicalAnd(_, dest, _, _)
+        | Instruction::LogicalOr(_, dest, _, _)
+        | Instruction::LessThan(_, dest, _, _)
+        | Instruction::GreaterThan(_, dest, _, _)
+        | Instruction::LessThanEq(_, dest, _, _)
+        | Instruction::GreaterThanEq(_, dest, _, _)
+        | Instruction::Equal(_, dest, _, _)
+        | Instruction::NotEqual(_, dest, _, _)
+        | Instruction::Call(_, dest, _, _)
+        | Instruction::PointerToStringLiteral(_, dest, _)
+        | Instruction::I8toI16(_, dest, _)
+        | Instruction::I8toU16(_, dest, _)
+        | Instruction::U8toI16(_, dest, _)
+        | Instruction::U8toU16(_, dest, _)
+        | Instruction::I16toI32(_, dest, _)
+        | Instruction::U16toI32(_, dest, _)
+        | Instruction::I16toU32(_, dest, _)
+        | Instruction::U16toU32(_, dest, _)
+        | Instruction::I32toU32(_, dest, _)
+        | Instruction::I32toU64(_, dest, _)
+        | Instruction::U32toU64(_, dest, _)
+        | Instruction::I64toU64(_, dest, _)
+        | Instruction::I32toI64(_, dest, _)
+        | Instruction::U32toI64(_, dest, _)
+        | Instruction::U32toF32(_, dest, _)
+        | Instruction::I32toF32(_, dest, _)
+        | Instruction::U64toF32(_, dest, _)
+        | Instruction::I64toF32(_, dest, _)
+        | Instruction::U32toF64(_, dest, _)
+        | Instruction::I32toF64(_, dest, _)
+        | Instruction::U64toF64(_, dest, _)
+        | Instruction::I64toF64(_, dest, _)
+        | Instruction::F32toF64(_, dest, _)
+        | Instruction::F64toI32(_, dest, _)
+        | Instruction::I32toI8(_, dest, _)
+        | Instruction::U32toI8(_, dest, _)
+        | Instruction::I64toI8(_, dest, _)
+        | Instruction::U64toI8(_, dest, _)
+        | Instruction::I32toU8(_, dest, _)
+        | Instruction::U32toU8(_, dest, _)
+        | Instruction::I64toU8(_, dest, _)
+        | Instruction::U64toU8(_, dest, _)
+        | Instruction::I64toI32(_, dest, _)
+        | Instruction::U64toI32(_, dest, _)
+        | Instruction::U32toPtr(_, dest, _)
+        | Instruction::I32toPtr(_, dest, _)
+        | Instruction::PtrToI32(_, dest, _) => Some(dest),
+        Instruction::StoreToAddress(..)
+        | Instruction::ZeroMemory(..)
+        | Instruction::ReferenceVariable(..)
+        | Instruction::TailCall(..)
+        | Instruction::Ret(..)
+        | Instruction::Label(..)
+        | Instruction::Br(..)
+        | Instruction::BrIfEq(..)
+        | Instruction::BrIfNotEq(..)
+        | Instruction::BrTable(..)
+        | Instruction::Nop(..) => None,
+        Instruction::Break(..)
+        | Instruction::Continue(..)
+        | Instruction::EndHandledBlock(..)
+        | Instruction::IfEqElse(..)
+        | Instruction::IfNotEqElse(..) => {
+            unreachable!("relooper instructions aren't generated until after the IR is optimised")
+        }
+    }
+}
+
+/// Mutable access to the var that the instruction assigns to, if any
+pub fn get_dest_mut(instr: &mut Instruction) -> Option<&mut Dest> {
+    match instr {
+        Instruction::SimpleAssignment(_, dest, _)
+        | Instruction::LoadFromAddress(_, dest, _)
+        | Instruction::DeclareVariable(_, dest)
+        | Instruction::AllocateVariable(_, dest, _)
+        | Instruction::AddressOf(_, dest, _)
+        | Instruction::BitwiseNot(_, dest, _)
+        | Instruction::LogicalNot(_, dest, _)
+        | Instruction::Mult(_, dest, _, _)
+        | Instruction::Div(_, dest, _, _)
+        | Instruction::Mod(_, dest, _, _)
+        | Instruction::Add(_, dest, _, _)
+        | Instruction::Sub(_, dest, _, _)
+        | Instruction::LeftShift(_, dest, _, _)
+        | Instruction::RightShift(_, dest, _, _)
+        | Instruction::BitwiseAnd(_, dest, _, _)
+        | Instruction::BitwiseOr(_, dest, _, _)
+        | Instruction::BitwiseXor(_, dest, _, _)
+        | Instruction::LogicalAnd(_, dest, _, _)
+        | Instruction::LogicalOr(_, dest, _, _)
+        | Instruction::LessThan(_, dest, _, _)
+        | Instruction::GreaterThan(_, dest, _, _)
+        | Instruction::LessThanEq(_, dest, _, _)
+        | Instruction::GreaterThanEq(_, dest, _, _)
+        | Instruction::Equal(_, dest, _, _)
+        | Instruction::NotEqual(_, dest, _, _)
+        | Instruction::Call(_, dest, _, _)
+        | Instruction::PointerToStringLiteral(_, dest, _)
+        | Instruction::I8toI16(_, dest, _)
+        | Instruction::I8toU16(_, dest, _)
+        | Instruction::U8toI16(_, dest, _)
+        | Instruction::U8toU16(_, dest, _)
+        | Instruction::I16toI32(_, dest, _)
+        | Instruction::U16toI32(_, dest, _)
+        | Instruction::I16toU32(_, dest, _)
+        | Instruction::U16toU32(_, dest, _)
+        | Instruction::I32toU32(_, dest, _)
+        | Instruction::I32toU64(_, dest, _)
+        | Instruction::U32toU64(_, dest, _)
+        | Instruction::I64toU64(_, dest, _)
+        | Instruction::I32toI64(_, dest, _)
+        | Instruction::U32toI64(_, dest, _)
+        | Instruction::U32toF32(_, dest, _)
+        | Instruction::I32toF32(_, dest, _)
+        | Instruction::U64toF32(_, dest, _)
+        | Instruction::I64toF32(_, dest, _)
+        | Instruction::U32toF64(_, dest, _)
+        | Instruction::I32toF64(_, dest, _)
+        | Instruction::U64toF64(_, dest, _)
+        | Instruction::I64toF64(_, dest, _)
+        | Instruction::F32toF64(_, dest, _)
+        | Instruction::F64toI32(_, dest, _)
+        | Instruction::I32toI8(_, dest, _)
+        | Instruction::U32toI8(_, dest, _)
+        | Instruction::I64toI8(_, dest, _)
+        | Instruction::U64toI8(_, dest, _)
+        | Instruction::I32toU8(_, dest, _)
+        | Instruction::U32toU8(_, dest, _)
+        | Instruction::I64toU8(_, dest, _)
+        | Instruction::U64toU8(_, dest, _)
+        | Instruction::I64toI32(_, dest, _)
+        | Instruction::U64toI32(_, dest, _)
+        | Instruction::U32toPtr(_, dest, _)
+        | Instruction::I32toPtr(_, dest, _)
+        | Instruction::PtrToI32(_, dest, _) => Some(dest),
+        Instruction::StoreToAddress(..)
+        | Instruction::ZeroMemory(..)
+        | Instruction::ReferenceVariable(..)
+        | Instruction::TailCall(..)
+        | Instruction::Ret(..)
+        | Instruction::Label(..)
+        | Instruction::Br(..)
+        | Instruction::BrIfEq(..)
+        | Instruction::BrIfNotEq(..)
+        | Instruction::BrTable(..)
+        | Instruction::Nop(..) => None,
+        Instruction::Break(..)
+        | Instruction::Continue(..)
+        | Instruction::EndHandledBlock(..)
+        | Instruction::IfEqElse(..)
+        | Instruction::IfNotEqElse(..) => {
+            unreachable!("relooper instructions aren't generated until after the IR is optimised")
+        }
+    }
+}
+
+/// The srcs of the instruction, in the order they appear
+pub fn get_srcs(instr: &Instruction) -> Vec<&Src> {
+    match instr {
+        Instruction::SimpleAssignment(_, _, src)
+        | Instruction::LoadFromAddress(_, _, src)
+        | Instruction::StoreToAddress(_, _, src)
+        | Instruction::AllocateVariable(_, _, src)
+        | Instruction::AddressOf(_, _, src)
+        | Instruction::BitwiseNot(_, _, src)
+        | Instruction::LogicalNot(_, _, src)
+        | Instruction::BrTable(_, src, _, _)
+        | Instruction::I8toI16(_, _, src)
+        | Instruction::I8toU16(_, _, src)
+        | Instruction::U8toI16(_, _, src)
+        | Instruction::U8toU16(_, _, src)
+        | Instruction::I16toI32(_, _, src)
+        | Instruction::U16toI32(_, _, src)
+        | Instruction::I16toU32(_, _, src)
+        | Instruction::U16toU32(_, _, src)
+        | Instruction::I32toU32(_, _, src)
+        | Instruction::I32toU64(_, _, src)
+        | Instruction::U32toU64(_, _, src)
+        | Instruction::I64toU64(_, _, src)
+        | Instruction::I32toI64(_, _, src)
+        | Instruction::U32toI64(_, _, src)
+        | Instruction::U32toF32(_, _, src)
+        | Instruction::I32toF32(_, _, src)
+        | Instruction::U64toF32(_, _, src)
+        | Instruction::I64toF32(_, _, src)
+        | Instruction::U32toF64(_, _, src)
+        | Instruction::I32toF64(_, _, src)
+        | Instruction::U64toF64(_, _, src)
+        | Instruction::I64toF64(_, _, src)
+        | Instruction::F32toF64(_, _, src)
+        | Instruction::F64toI32(_, _, src)
+        | Instruction::I32toI8(_, _, src)
+        | Instruction::U32toI8(_, _, src)
+        | Instruction::I64toI8(_, _, src)
+        | Instruction::U64toI8(_, _, src)
+        | Instruction::I32toU8(_, _, src)
+        | Instruction::U32toU8(_, _, src)
+        | Instruction::I64toU8(_, _, src)
+        | Instruction::U64toU8(_, _, src)
+        | Instruction::I64toI32(_, _, src)
+        | Instruction::U64toI32(_, _, src)
+        | Instruction::U32toPtr(_, _, src)
+        | Instruction::I32toPtr(_, _, src)
+        | Instruction::PtrToI32(_, _, src) => vec![src],
+        Instruction::Mult(_, _, left, right)
+        | Instruction::Div(_, _, left, right)
+        | Instruction::Mod(_, _, left, right)
+        | Instruction::Add(_, _, left, right)
+        | Instruction::Sub(_, _, left, right)
+        | Instruction::LeftShift(_, _, left, right)
+        | Instruction::RightShift(_, _, left, right)
+        | Instruction::BitwiseAnd(_, _, left, right)
+        | Instruction::BitwiseOr(_, _, left, right)
+        | Instruction::BitwiseXor(_, _, left, right)
+        | Instruction::LogicalAnd(_, _, left, right)
+        | Instruction::LogicalOr(_, _, left, right)
+        | Instruction::LessThan(_, _, left, right)
+        | Instruction::GreaterThan(_, _, left, right)
+        | Instruction::LessThanEq(_, _, left, right)
+        | Instruction::GreaterThanEq(_, _, left, right)
+        | Instruction::Equal(_, _, left, right)
+        | Instruction::NotEqual(_, _, left, right)
+        | Instruction::BrIfEq(_, left, right, _)
+        | Instruction::BrIfNotEq(_, left, right, _) => vec![left, right],
+        Instruction::Call(_, _, _, params) | Instruction::TailCall(_, _, params) => {
+            params.iter().collect()
+        }
+        Instruction::Ret(_, src) => src.iter().collect(),
+        Instruction::DeclareVariable(..)
+        | Instruction::ZeroMemory(..)
+        | Instruction::ReferenceVariable(..)
+        | Instruction::PointerToStringLiteral(..)
+        | Instruction::Label(..)
+        | Instruction::Br(..)
+        | Instruction::Nop(..) => Vec::new(),
+        Instruction::Break(..)
+        | Instruction::Continue(..)
+        | Instruction::EndHandledBlock(..)
+        | Instruction::IfEqElse(..)
+        | Instruction::IfNotEqElse(..) => {
+            unreachable!("relooper instructions aren't generated until after the IR is optimised")
+        }
+    }
+}
+
+/// Mutable version of get_srcs
+pub fn get_srcs_mut(instr: &mut Instruction) -> Vec<&mut Src> {
+    match instr {
+        Instruction::SimpleAssignment(_, _, src)
+        | Instruction::LoadFromAddress(_, _, src)
+        | Instruction::StoreToAddress(_, _, src)
+        | Instruction::AllocateVariable(_, _, src)
+        | Instruction::AddressOf(_, _, src)
+        | Instruction::BitwiseNot(_, _, src)
+        | Instruction::LogicalNot(_, _, src)
+        | Instruction::BrTable(_, src, _, _)
+        | Instruction::I8toI16(_, _, src)
+        | Instruction::I8toU16(_, _, src)
+        | Instruction::U8toI16(_, _, src)
+        | Instruction::U8toU16(_, _, src)
+        | Instruction::I16toI32(_, _, src)
+        | Instruction::U16toI32(_, _, src)
+        | Instruction::I16toU32(_, _, src)
+        | Instruction::U16toU32(_, _, src)
+        | Instruction::I32toU32(_, _, src)
+        | Instruction::I32toU64(_, _, src)
+        | Instruction::U32toU64(_, _, src)
+        | Instruction::I64toU64(_, _, src)
+        | Instruction::I32toI64(_, _, src)
+        | Instruction::U32toI64(_, _, src)
+        | Instruction::U32toF32(_, _, src)
+        | Instruction::I32toF32(_, _, src)
+        | Instruction::U64toF32(_, _, src)
+        | Instruction::I64toF32(_, _, src)
+        | Instruction::U32toF64(_, _, src)
+        | Instruction::I32toF64(_, _, src)
+        | Instruction::U64toF64(_, _, src)
+        | Instruction::I64toF64(_, _, src)
+        | Instruction::F32toF64(_, _, src)
+        | Instruction::F64toI32(_, _, src)
+        | Instruction::I32toI8(_, _, src)
+        | Instruction::U32toI8(_, _, src)
+        | Instruction::I64toI8(_, _, src)
+        | Instruction::U64toI8(_, _, src)
+        | Instruction::I32toU8(_, _, src)
+        | Instruction::U32toU8(_, _, src)
+        | Instruction::I64toU8(_, _, src)
+        | Instruction::U64toU8(_, _, src)
+        | Instruction::I64toI32(_, _, src)
+        | Instruction::U64toI32(_, _, src)
+        | Instruction::U32toPtr(_, _, src)
+        | Instruction::I32toPtr(_, _, src)
+        | Instruction::PtrToI32(_, _, src) => vec![src],
+        Instruction::Mult(_, _, left, right)
+        | Instruction::Div(_, _, left, right)
+        | Instruction::Mod(_, _, left, right)
+        | Instruction::Add(_, _, left, right)
+        | Instruction::Sub(_, _, left, right)
+        | Instruction::LeftShift(_, _, left, right)
+        | Instruction::RightShift(_, _, left, right)
+        | Instruction::BitwiseAnd(_, _, left, right)
+        | Instruction::BitwiseOr(_, _, left, right)
+        | Instruction::BitwiseXor(_, _, left, right)
+        | Instruction::LogicalAnd(_, _, left, right)
+        | Instruction::LogicalOr(_, _, left, right)
+        | Instruction::LessThan(_, _, left, right)
+        | Instruction::GreaterThan(_, _, left, right)
+        | Instruction::LessThanEq(_, _, left, right)
+        | Instruction::GreaterThanEq(_, _, left, right)
+        | Instruction::Equal(_, _, left, right)
+        | Instruction::NotEqual(_, _, left, right)
+        | Instruction::BrIfEq(_, left, right, _)
+        | Instruction::BrIfNotEq(_, left, right, _) => vec![left, right],
+        Instruction::Call(_, _, _, params) | Instruction::TailCall(_, _, params) => {
+            params.iter_mut().collect()
+        }
+        Instruction::Ret(_, src) => src.iter_mut().collect(),
+        Instruction::DeclareVariable(..)
+        | Instruction::ZeroMemory(..)
+        | Instruction::ReferenceVariable(..)
+        | Instruction::PointerToStringLiteral(..)
+        | Instruction::Label(..)
+        | Instruction::Br(..)
+        | Instruction::Nop(..) => Vec::new(),
+        Instruction::Break(..)
+        | Instruction::Continue(..)
+        | Instruction::EndHandledBlock(..)
+        | Instruction::IfEqElse(..)
+        | Instruction::IfNotEqElse(..) => {
+            unreachable!("relooper instructions aren't generated until after the IR is optimised")
+        }
+    }
+}
+
+/// Pointer vars that the instruction writes through, which are used but aren't srcs
+pub fn get_address_var_mut(instr: &mut Instruction) -> Option<&mut VarId> {
+    match instr {
+        Instruction::StoreToAddress(_, dest, _) | Instruction::ZeroMemory(_, dest, _) => Some(dest),
+        _ => None,
+    }
+}
+
+/// Every var whose value the instruction reads
+pub fn get_used_vars(instr: &Instruction) -> Vec<&VarId> {
+    let mut used_vars: Vec<&VarId> = get_srcs(instr)
+        .into_iter()
+        .filter_map(|src| match src {
+            Src::Var(var) | Src::StoreAddressVar(var) => Some(var),
+            Src::Constant(_) | Src::Fun(_) => None,
+        })
+        .collect();
+    match instr {
+        Instruction::StoreToAddress(_, dest, _)
+        | Instruction::ZeroMemory(_, dest, _)
+        | Instruction::ReferenceVariable(_, dest) => used_vars.push(dest),
+        _ => {}
+    }
+    used_vars
+}
+
+/// Whether the instruction only computes a value for its dest, so it can be removed or
+/// replaced if that value is already known
+pub fn is_pure_assignment(instr: &Instruction) -> bool {
+    match instr {
+        Instruction::Call(..)
+        | Instruction::DeclareVariable(..)
+        | Instruction::AllocateVariable(..) => false,
+        _ => get_dest(instr).is_some(),
+    }
+}
+
+/// The labels that a branch instruction can jump to
+pub fn get_branch_labels(instr: &Instruction) -> Vec<&LabelId> {
+    match instr {
+        Instruction::Br(_, label)
+        | Instruction::BrIfEq(_, _, _, label)
+        | Instruction::BrIfNotEq(_, _, _, label) => vec![label],
+        Instruction::BrTable(_, _, _, arms) => arms
+            .iter()
+            .filter_map(|arm| match arm.as_slice() {
+                [Instruction::Br(_, label)] => Some(label),
+                _ => None,
+            })
+            .collect(),
+        _ => Vec::new(),
+    }
+}
+
+pub fn get_branch_labels_mut(instr: &mut Instruction) -> Vec<&mut LabelId> {
+    match instr {
+        Instruction::Br(_, label)
+        | Instruction::BrIfEq(_, _, _, label)
+        | Instruction::BrIfNotEq(_, _, _, label) => vec![label],
+        Instruction::BrTable(_, _, _, arms) => arms
+            .iter_mut()
+            .filter_map(|arm| match arm.as_mut_slice() {
+                [Instruction::Br(_, label)] => Some(label),
+                _ => None,
+            })
+            .collect(),
+        _ => Vec::new(),
+    }
+}
@@ -0,0 +1,698 @@
+use std::collections::{HashMap, HashSet};
+
+use log::trace;
+
+use crate::middle_end::ids::{ValueType, VarId};
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::IrType;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::constant_folding::normalise_constant;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::control_flow_graph::ControlFlowGraph;
+use crate::middle_end::middle_end_optimiser::scalar_optimisation::instruction_operands::{
+    get_branch_labels, get_branch_labels_mut, get_dest, get_used_vars, is_pure_assignment,
+};
+
+/// A header block and every block that can branch back to it without leaving the loop.
+/// The header dominates all the other blocks, so it's the only way into the loop.
+struct Loop {
+    header: usize,
+    blocks: HashSet<usize>,
+}
+
+/// A var that changes by the same constant amount once on each iteration of a loop
+struct InductionVar {
+    var: VarId,
+    /// the index of the instruction that adds the step to it
+    increment_i: usize,
+    step: i128,
+}
+
+/// The changes to make to the instructions of a function for one loop, indexed by the
+/// original positions of the instructions they apply to
+#[derive(Default)]
+struct LoopRewrite {
+    /// instructions to run once before entering the loop
+    preheader_instrs: Vec<Instruction>,
+    removed_instrs: HashSet<usize>,
+    replaced_instrs: HashMap<usize, Instruction>,
+    instrs_inserted_after: HashMap<usize, Vec<Instruction>>,
+}
+
+/// What is known about the instructions of a function, used to analyse one of its loops
+struct LoopContext<'a> {
+    instrs: &'a [Instruction],
+    cfg: &'a ControlFlowGraph,
+    dominators: &'a [HashSet<usize>],
+    block_of_instr: &'a [usize],
+    loop_: &'a Loop,
+    /// the indices of the instructions in the loop, in order
+    loop_instrs: Vec<usize>,
+    /// the indices of the instructions that assign to each var
+    assignments: &'a HashMap<VarId, Vec<usize>>,
+    /// the indices of the instructions that use each var
+    uses: &'a HashMap<VarId, Vec<usize>>,
+    tracked_vars: &'a HashSet<VarId>,
+}
+
+/// Improve the loops of a function:
+/// - instructions that compute the same value on every iteration are hoisted out of the
+///   loop, so they only run once before it's entered
+/// - multiplications of a var that goes up by a constant step each iteration, like the
+///   `i * size` of an array index, are replaced by a new var that goes up by `step * size`.
+///   The same is done for adding an invariant value to it, so that the address of `a[i]`
+///   becomes a pointer that's incremented on each iteration.
+/// - increments of vars whose value is never used any more are removed
+///
+/// Only tracked vars are reasoned about, because they can't be changed by anything else in
+/// the loop. New tracked vars are created for any values that are strength reduced.
+///
+/// Returns true if any loops were changed.
+pub fn optimise_loops(
+    instrs: &mut Vec<Instruction>,
+    tracked_vars: &mut HashSet<VarId>,
+    prog_metadata: &mut ProgramMetadata,
+) -> bool {
+    let mut changed = false;
+    // each change moves instructions, so the loops are found again after each one
+    while optimise_a_loop(instrs, tracked_vars, prog_metadata) {
+        changed = true;
+    }
+    changed
+}
+
+/// Make the first change that can be made to any loop, trying inner loops first so that
+/// invariants get hoisted as far out as they can go
+fn optimise_a_loop(
+    instrs: &mut Vec<Instruction>,
+    tracked_vars: &mut HashSet<VarId>,
+    prog_metadata: &mut ProgramMetadata,
+) -> bool {
+    let cfg = ControlFlowGraph::new(instrs);
+    let dominators = cfg.find_dominators();
+
+    let mut block_of_instr = vec![0; instrs.len()];
+    for (block_i, block) in cfg.blocks.iter().enumerate() {
+        for instr_i in block.instr_range.to_owned() {
+            block_of_instr[instr_i] = block_i;
+        }
+    }
+
+    let mut assignments: HashMap<VarId, Vec<usize>> = HashMap::new();
+    let mut uses: HashMap<VarId, Vec<usize>> = HashMap::new();
+    for (instr_i, instr) in instrs.iter().enumerate() {
+        if let Some(dest) = get_dest(instr) {
+            assignments
+                .entry(dest.to_owned())
+                .or_default()
+                .push(instr_i);
+        }
+        for var in get_used_vars(instr) {
+            uses.entry(var.to_owned()).or_default().push(instr_i);
+        }
+    }
+
+    for loop_ in find_loops(&cfg, &dominators) {
+        if !can_insert_preheader(instrs, &cfg, &loop_) {
+            continue;
+        }
+
+        let mut loop_instrs: Vec<usize> = loop_
+            .blocks
+            .iter()
+            .flat_map(|block_i| cfg.blocks[*block_i].instr_range.to_owned())
+            .collect();
+        loop_instrs.sort();
+
+        let ctx = LoopContext {
+            instrs,
+            cfg: &cfg,
+            dominators: &dominators,
+            block_of_instr: &block_of_instr,
+            loop_: &loop_,
+            loop_instrs,
+            assignments: &assignments,
+            uses: &uses,
+            tracked_vars,
+        };
+
+        let induction_vars = ctx.find_induction_vars(prog_metadata);
+        let rewrite = match ctx.hoist_invariant_instrs(prog_metadata) {
+            Some(rewrite) => Some(rewrite),
+            None => match ctx.find_strength_reductions(&induction_vars, prog_metadata) {
+                Some(reductions) => Some(reduce_strength(
+                    instrs,
+                    reductions,
+                    tracked_vars,
+                    prog_metadata,
+                )),
+                None => ctx.remove_dead_induction_vars(&induction_vars),
+            },
+        };
+
+        if let Some(rewrite) = rewrite {
+            apply_rewrite(
+                instrs,
+                rewrite,
+                &cfg,
+                &loop_,
+                &block_of_instr,
+                prog_metadata,
+            );
+            return true;
+        }
+    }
+
+    false
+}
+
+/// Find the natural loops from the back edges of the control flow graph, ordered so that
+/// inner loops come before the loops they're nested in. Back edges to the same header are
+/// merged into one loop.
+fn find_loops(cfg: &ControlFlowGraph, dominators: &[HashSet<usize>]) -> Vec<Loop> {
+    let mut loop_blocks: HashMap<usize, HashSet<usize>> = HashMap::new();
+    for (block_i, block) in cfg.blocks.iter().enumerate() {
+        for header in &block.successors {
+            if !dominators[block_i].contains(header) {
+                continue;
+            }
+            // the loop is every block that can reach the back edge without going through
+            // the header
+            let blocks = loop_blocks
+                .entry(*header)
+                .or_insert_with(|| HashSet::from([*header]));
+            let mut to_visit = vec![block_i];
+            while let Some(loop_block) = to_visit.pop() {
+                if !dominators[loop_block].is_empty() && blocks.insert(loop_block) {
+                    to_visit.extend(cfg.blocks[loop_block].predecessors.iter().cloned());
+                }
+            }
+        }
+    }
+
+    let mut loops: Vec<Loop> = loop_blocks
+        .into_iter()
+        .map(|(header, blocks)| Loop { header, blocks })
+        .collect();
+    loops.sort_by_key(|loop_| (loop_.blocks.len(), loop_.header));
+    loops
+}
+
+/// The preheader goes in front of the header's label. That can't be done if a block of the
+/// loop falls through into the header, because it would run the preheader too.
+fn can_insert_preheader(instrs: &[Instruction], cfg: &ControlFlowGraph, loop_: &Loop) -> bool {
+    let header_start = cfg.blocks[loop_.header].instr_range.start;
+    if !matches!(instrs.get(header_start), Some(Instruction::Label(..))) {
+        return false;
+    }
+    let previous_block = match loop_.header.checked_sub(1) {
+        Some(previous_block) => previous_block,
+        None => return true,
+    };
+    !(loop_.blocks.contains(&previous_block)
+        && cfg.blocks[previous_block]
+            .successors
+            .contains(&loop_.header))
+}
+
+impl<'a> LoopContext<'a> {
+    fn is_in_loop(&self, instr_i: usize) -> bool {
+        self.loop_.blocks.contains(&self.block_of_instr[instr_i])
+    }
+
+    /// Whether every path to the second instruction goes through the first
+    fn dominates(&self, instr_i: usize, other_instr_i: usize) -> bool {
+        let block = self.block_of_instr[instr_i];
+        let other_block = self.block_of_instr[other_instr_i];
+        match block == other_block {
+            true => instr_i < other_instr_i,
+            false => self.dominators[other_block].contains(&block),
+        }
+    }
+
+    fn get_assignments_in_loop(&self, var: &VarId) -> Vec<usize> {
+        self.assignments
+            .get(var)
+            .map(|assignments| {
+                assignments
+                    .iter()
+                    .cloned()
+                    .filter(|instr_i| self.is_in_loop(*instr_i))
+                    .collect()
+            })
+            .unwrap_or_default()
+    }
+
+    fn get_uses_in_loop(&self, var: &VarId) -> Vec<usize> {
+        self.uses
+            .get(var)
+            .map(|uses| {
+                uses.iter()
+                    .cloned()
+                    .filter(|instr_i| self.is_in_loop(*instr_i))
+                    .collect()
+            })
+            .unwrap_or_default()
+    }
+
+    /// A var has the same value on every iteration if nothing in the loop assigns to it,
+    /// apart from instructions that are being hoisted out
+    fn is_invariant_var(&self, var: &VarId, hoisted_instrs: &HashSet<usize>) -> bool {
+        self.tracked_vars.contains(var)
+            && self
+                .get_assignments_in_loop(var)
+                .iter()
+                .all(|instr_i| hoisted_instrs.contains(instr_i))
+    }
+
+    /// Whether the instruction can be moved to the preheader. It has to compute the same
+    /// value on every iteration, without any side effects or any chance of trapping, since
+    /// it'll be run even if the loop isn't. It also has to be the only assignment to its dest,
+    /// and come before every use of it, so that every use sees the value it computes.
+    fn is_hoistable_instr(
+        &self,
+        instr_i: usize,
+        hoisted_instrs: &HashSet<usize>,
+        prog_metadata: &ProgramMetadata,
+    ) -> bool {
+        let instr = &self.instrs[instr_i];
+        if !is_pure_assignment(instr)
+            || matches!(
+                instr,
+                Instruction::LoadFromAddress(..)
+                    | Instruction::Div(..)
+                    | Instruction::Mod(..)
+                    | Instruction::F64toI32(..)
+            )
+        {
+            return false;
+        }
+
+        let dest = get_dest(instr).unwrap();
+        if !self.tracked_vars.contains(dest) || self.assignments[dest].len() != 1 {
+            return false;
+        }
+        let is_before_every_use = self
+            .uses
+            .get(dest)
+            .map(|uses| uses.iter().all(|use_i| self.dominates(instr_i, *use_i)))
+            .unwrap_or(true);
+        if !is_before_every_use {
+            return false;
+        }
+
+        match instr {
+            // the address of a var doesn't change even if its value does, and neither does the
+            // pointer that an array decays to. The backend's liveness analysis only keeps a var
+            // alive from where it's assigned though, so the address can't be taken before that.
+            Instruction::AddressOf(_, _, Src::Var(var)) => {
+                self.get_assignments_in_loop(var).is_empty()
+            }
+            Instruction::SimpleAssignment(_, _, Src::Var(var))
+                if prog_metadata.get_var_type(var).unwrap().is_array_type() =>
+            {
+                self.get_assignments_in_loop(var).is_empty()
+            }
+            _ => get_used_vars(instr)
+                .into_iter()
+                .all(|var| self.is_invariant_var(var, hoisted_instrs)),
+        }
+    }
+
+    fn hoist_invariant_instrs(&self, prog_metadata: &ProgramMetadata) -> Option<LoopRewrite> {
+        // instructions are hoisted in the order they're found, so an instruction that
+        // depends on another hoisted one always comes after it
+        let mut hoisted_order: Vec<usize> = Vec::new();
+        let mut hoisted_instrs: HashSet<usize> = HashSet::new();
+        loop {
+            let mut found_any = false;
+            for instr_i in &self.loop_instrs {
+                if !hoisted_instrs.contains(instr_i)
+                    && self.is_hoistable_instr(*instr_i, &hoisted_instrs, prog_metadata)
+                {
+                    trace!("hoisting {} out of loop", self.instrs[*instr_i]);
+                    hoisted_order.push(*instr_i);
+                    hoisted_instrs.insert(*instr_i);
+                    found_any = true;
+                }
+            }
+            if !found_any {
+                break;
+            }
+        }
+
+        if hoisted_order.is_empty() {
+            return None;
+        }
+        Some(LoopRewrite {
+            preheader_instrs: hoisted_order
+                .iter()
+                .map(|instr_i| self.instrs[*instr_i].to_owned())
+                .collect(),
+            removed_instrs: hoisted_instrs,
+            ..Default::default()
+        })
+    }
+
+    /// Find the vars whose only assignment in the loop adds or subtracts a constant
+    fn find_induction_vars(&self, prog_metadata: &ProgramMetadata) -> Vec<InductionVar> {
+        let mut induction_vars = Vec::new();
+        for instr_i in &self.loop_instrs {
+            let (var, step) = match &self.instrs[*instr_i] {
+                Instruction::Add(_, dest, Src::Var(var), Src::Constant(Constant::Int(step)))
+                | Instruction::Add(_, dest, Src::Constant(Constant::Int(step)), Src::Var(var))
+                    if dest == var =>
+                {
+                    (var, *step)
+                }
+                Instruction::Sub(_, dest, Src::Var(var), Src::Constant(Constant::Int(step)))
+                    if dest == var =>
+                {
+                    (var, step.wrapping_neg())
+                }
+                _ => continue,
+            };
+            if self.tracked_vars.contains(var)
+                && self.get_assignments_in_loop(var).len() == 1
+                && is_word_type(&prog_metadata.get_var_type(var).unwrap())
+            {
+                induction_vars.push(InductionVar {
+                    var: var.to_owned(),
+                    increment_i: *instr_i,
+                    step,
+                });
+            }
+        }
+        induction_vars
+    }
+
+    /// Find instructions in the loop that compute a linear function of an induction var,
+    /// which can be replaced by a new induction var. Returns the index of each one, the
+    /// induction var it uses, and how much the new var has to change on each iteration.
+    fn find_strength_reductions<'b>(
+        &self,
+        induction_vars: &'b [InductionVar],
+        prog_metadata: &ProgramMetadata,
+    ) -> Option<Vec<(usize, &'b InductionVar, i128)>> {
+        let get_induction_var = |src: &Src| match src {
+            Src::Var(var) => induction_vars
+                .iter()
+                .find(|induction_var| &induction_var.var == var),
+            _ => None,
+        };
+        let is_invariant_src = |src: &Src| match src {
+            Src::Constant(Constant::Int(_)) => true,
+            Src::Var(var) => self.is_invariant_var(var, &HashSet::new()),
+            _ => false,
+        };
+
+        let mut reductions = Vec::new();
+        for instr_i in &self.loop_instrs {
+            let instr = &self.instrs[*instr_i];
+            let (induction_var, step, is_add) = match instr {
+                Instruction::Mult(_, _, src, Src::Constant(Constant::Int(n)))
+                | Instruction::Mult(_, _, Src::Constant(Constant::Int(n)), src) => {
+                    match get_induction_var(src) {
+                        Some(induction_var) => {
+                            (induction_var, induction_var.step.wrapping_mul(*n), false)
+                        }
+                        None => continue,
+                    }
+                }
+                Instruction::LeftShift(_, _, src, Src::Constant(Constant::Int(n)))
+                    if (0..64).contains(n) =>
+                {
+                    match get_induction_var(src) {
+                        Some(induction_var) => (
+                            induction_var,
+                            induction_var.step.wrapping_shl(*n as u32),
+                            false,
+                        ),
+                        None => continue,
+                    }
+                }
+                Instruction::Add(_, _, left_src, right_src) => {
+                    match (get_induction_var(left_src), get_induction_var(right_src)) {
+                        (Some(induction_var), None) if is_invariant_src(right_src) => {
+                            (induction_var, induction_var.step, true)
+                        }
+                        (None, Some(induction_var)) if is_invariant_src(left_src) => {
+                            (induction_var, induction_var.step, true)
+                        }
+                        _ => continue,
+                    }
+                }
+                Instruction::Sub(_, _, left_src, right_src) => match get_induction_var(left_src) {
+                    Some(induction_var) if is_invariant_src(right_src) => {
+                        (induction_var, induction_var.step, true)
+                    }
+                    _ => continue,
+                },
+                _ => continue,
+            };
+
+            let dest = get_dest(instr).unwrap();
+            if *instr_i == induction_var.increment_i
+                || !self.tracked_vars.contains(dest)
+                || self.get_assignments_in_loop(dest).len() != 1
+                || !can_reduce_between_types(
+                    &prog_metadata.get_var_type(dest).unwrap(),
+                    &prog_metadata.get_var_type(&induction_var.var).unwrap(),
+                )
+            {
+                continue;
+            }
+            // replacing an add with a new induction var saves nothing by itself, so it's only
+            // worth it if the result is multiplied, or if it lets the old var be removed
+            if is_add
+                && !self.is_multiplied_by_constant(dest)
+                && self
+                    .get_uses_in_loop(&induction_var.var)
+                    .iter()
+                    .any(|use_i| use_i != instr_i && *use_i != induction_var.increment_i)
+            {
+                continue;
+            }
+
+            let step = match normalise_constant(
+                &Constant::Int(step),
+                &prog_metadata.get_var_type(dest).unwrap(),
+            ) {
+                Some(Constant::Int(step)) => step,
+                _ => continue,
+            };
+            trace!("strength reducing {}", instr);
+            reductions.push((*instr_i, induction_var, step));
+        }
+
+        match reductions.is_empty() {
+            true => None,
+            false => Some(reductions),
+        }
+    }
+
+    /// Whether the var is multiplied or shifted by a constant in the loop
+    fn is_multiplied_by_constant(&self, var: &VarId) -> bool {
+        self.get_uses_in_loop(var)
+            .into_iter()
+            .any(|use_i| match &self.instrs[use_i] {
+                Instruction::Mult(_, _, Src::Var(src_var), Src::Constant(Constant::Int(_)))
+                | Instruction::Mult(_, _, Src::Constant(Constant::Int(_)), Src::Var(src_var))
+                | Instruction::LeftShift(
+                    _,
+                    _,
+                    Src::Var(src_var),
+                    Src::Constant(Constant::Int(_)),
+                ) => src_var == var,
+                _ => false,
+            })
+    }
+
+    /// Strength reduction leaves behind induction vars that are only used to increment
+    /// themselves, or to set up the new vars before the loop, so their increments can go
+    fn remove_dead_induction_vars(&self, induction_vars: &[InductionVar]) -> Option<LoopRewrite> {
+        let removed_instrs: HashSet<usize> = induction_vars
+            .iter()
+            .filter(|induction_var| {
+                !self.is_assigned_value_used(induction_var.increment_i, &induction_var.var)
+            })
+            .map(|induction_var| induction_var.increment_i)
+            .collect();
+
+        match removed_instrs.is_empty() {
+            true => None,
+            false => Some(LoopRewrite {
+                removed_instrs,
+                ..Default::default()
+            }),
+        }
+    }
+
+    /// Whether the value that an instruction assigns to a var is ever used by any other
+    /// instruction, by searching forwards from it until the var is assigned again
+    fn is_assigned_value_used(&self, instr_i: usize, var: &VarId) -> bool {
+        let mut visited_blocks: HashSet<usize> = HashSet::new();
+        let mut to_visit: Vec<(usize, usize)> = vec![(self.block_of_instr[instr_i], instr_i + 1)];
+        while let Some((block_i, start_i)) = to_visit.pop() {
+            let block = &self.cfg.blocks[block_i];
+            let mut is_reassigned = false;
+            for other_instr_i in start_i..block.instr_range.end {
+                let other_instr = &self.instrs[other_instr_i];
+                if other_instr_i != instr_i && get_used_vars(other_instr).contains(&var) {
+                    return true;
+                }
+                if get_dest(other_instr) == Some(var) {
+                    is_reassigned = true;
+                    break;
+                }
+            }
+            if is_reassigned {
+                continue;
+            }
+            for successor in &block.successors {
+                if visited_blocks.insert(*successor) {
+                    to_visit.push((*successor, self.cfg.blocks[*successor].instr_range.start));
+                }
+            }
+        }
+        false
+    }
+}
+
+/// Replace each instruction that computes a linear function of an induction var with a copy
+/// of a new var. The new var is set to the same function of the induction var before the
+/// loop, and changed by the given amount whenever the induction var is.
+fn reduce_strength(
+    instrs: &[Instruction],
+    reductions: Vec<(usize, &InductionVar, i128)>,
+    tracked_vars: &mut HashSet<VarId>,
+    prog_metadata: &mut ProgramMetadata,
+) -> LoopRewrite {
+    let mut rewrite = LoopRewrite::default();
+    for (instr_i, induction_var, step) in reductions {
+        let instr = &instrs[instr_i];
+        let dest = get_dest(instr).unwrap();
+        let new_var = prog_metadata.new_var(ValueType::RValue);
+        prog_metadata
+            .add_var_type_id(
+                new_var.to_owned(),
+                prog_metadata.get_var_type_id(dest).unwrap(),
+            )
+            .unwrap();
+        tracked_vars.insert(new_var.to_owned());
+
+        let preheader_instr_id = prog_metadata.new_instr_id();
+        rewrite.preheader_instrs.push(match instr.to_owned() {
+            Instruction::Mult(_, _, left_src, right_src) => {
+                Instruction::Mult(preheader_instr_id, new_var.to_owned(), left_src, right_src)
+            }
+            Instruction::LeftShift(_, _, left_src, right_src) => {
+                Instruction::LeftShift(preheader_instr_id, new_var.to_owned(), left_src, right_src)
+            }
+            Instruction::Add(_, _, left_src, right_src) => {
+                Instruction::Add(preheader_instr_id, new_var.to_owned(), left_src, right_src)
+            }
+            Instruction::Sub(_, _, left_src, right_src) => {
+                Instruction::Sub(preheader_instr_id, new_var.to_owned(), left_src, right_src)
+            }
+            _ => unreachable!(),
+        });
+        rewrite
+            .instrs_inserted_after
+            .entry(induction_var.increment_i)
+            .or_default()
+            .push(Instruction::Add(
+                prog_metadata.new_instr_id(),
+                new_var.to_owned(),
+                Src::Var(new_var.to_owned()),
+                Src::Constant(Constant::Int(step)),
+            ));
+        rewrite.replaced_instrs.insert(
+            instr_i,
+            Instruction::SimpleAssignment(instr.get_instr_id(), dest.to_owned(), Src::Var(new_var)),
+        );
+    }
+    rewrite
+}
+
+fn apply_rewrite(
+    instrs: &mut Vec<Instruction>,
+    mut rewrite: LoopRewrite,
+    cfg: &ControlFlowGraph,
+    loop_: &Loop,
+    block_of_instr: &[usize],
+    prog_metadata: &mut ProgramMetadata,
+) {
+    let header_start = cfg.blocks[loop_.header].instr_range.start;
+    let header_label = match &instrs[header_start] {
+        Instruction::Label(_, label) => label.to_owned(),
+        _ => unreachable!(),
+    };
+
+    // branches into the loop from outside have to go through the preheader, so it needs
+    // its own label if there are any
+    let is_header_branched_to_from_outside =
+        cfg.blocks[loop_.header]
+            .predecessors
+            .iter()
+            .any(|predecessor| {
+                !loop_.blocks.contains(predecessor)
+                    && get_branch_labels(&instrs[cfg.blocks[*predecessor].instr_range.end - 1])
+                        .contains(&&header_label)
+            });
+    let preheader_label =
+        match !rewrite.preheader_instrs.is_empty() && is_header_branched_to_from_outside {
+            true => Some(prog_metadata.new_label()),
+            false => None,
+        };
+
+    let old_instrs = std::mem::take(instrs);
+    for (instr_i, mut instr) in old_instrs.into_iter().enumerate() {
+        if instr_i == header_start {
+            if let Some(preheader_label) = &preheader_label {
+                instrs.push(Instruction::Label(
+                    prog_metadata.new_instr_id(),
+                    preheader_label.to_owned(),
+                ));
+            }
+            instrs.append(&mut rewrite.preheader_instrs);
+        }
+        if let Some(preheader_label) = &preheader_label {
+            if !loop_.blocks.contains(&block_of_instr[instr_i]) {
+                for label in get_branch_labels_mut(&mut instr) {
+                    if *label == header_label {
+                        *label = preheader_label.to_owned();
+                    }
+                }
+            }
+        }
+
+        if let Some(new_instr) = rewrite.replaced_instrs.remove(&instr_i) {
+            instrs.push(new_instr);
+        } else if !rewrite.removed_instrs.contains(&instr_i) {
+            instrs.push(instr);
+        }
+        if let Some(mut inserted_instrs) = rewrite.instrs_inserted_after.remove(&instr_i) {
+            instrs.append(&mut inserted_instrs);
+        }
+    }
+}
+
+/// Types that are at least as wide as a wasm i32, so arithmetic on them wraps the same way
+/// however it's split up
+fn is_word_type(value_type: &IrType) -> bool {
+    matches!(
+        value_type,
+        IrType::I32 | IrType::U32 | IrType::I64 | IrType::U64 | IrType::PointerTo(_)
+    )
+}
+
+fn is_32_bit_type(value_type: &IrType) -> bool {
+    matches!(value_type, IrType::I32 | IrType::U32 | IrType::PointerTo(_))
+}
+
+fn can_reduce_between_types(dest_type: &IrType, induction_var_type: &IrType) -> bool {
+    is_word_type(dest_type)
+        && is_word_type(induction_var_type)
+        && (dest_type == induction_var_type
+            || (is_32_bit_type(dest_type) && is_32_bit_type(induction_var_type)))
+}
@@ -0,0 +1,189 @@
+use std::collections::HashMap;
+
+use log::debug;
+
+use crate::middle_end::ids::{LabelId, ValueType, VarId};
+use crate::middle_end::instructions::{Constant, Instruction, Src};
+use crate::middle_end::ir::ProgramMetadata;
+use crate::middle_end::ir_types::IrType;
+
+/// Switches with fewer cases than this stay as a chain of comparisons, because the
+/// comparisons are as cheap as the jump table
+const MIN_BR_TABLE_CASES: usize = 4;
+/// How many of the jump table entries must be cases as a percentage of the table length,
+/// rather than gaps in the case values that go to the default
+const MIN_BR_TABLE_DENSITY_PERCENT: i64 = 40;
+
+/// A chain of comparisons of the same var against integer constants, followed by an
+/// unconditional branch. This is what a switch statement is converted to.
+struct CaseChain {
+    switch_var: VarId,
+    cases: Vec<(i128, LabelId)>,
+    default_label: LabelId,
+    instr_count: usize,
+}
+
+/// Replace the case comparisons of dense switch statements with a jump table, so the
+/// case is found in constant time instead of comparing against each case in turn
+pub fn convert_switches_to_br_tables(
+    instrs: &mut Vec<Instruction>,
+    prog_metadata: &mut ProgramMetadata,
+) {
+    let mut i = 0;
+    while i < instrs.len() {
+        let case_chain = match find_case_chain(instrs, i) {
+            None => {
+                i += 1;
+                continue;
+            }
+            Some(case_chain) => case_chain,
+        };
+
+        match create_br_table(&case_chain, prog_metadata) {
+            None => {
+                // not worth it, skip over the whole chain
+                i += case_chain.instr_count;
+            }
+            Some(br_table_instrs) => {
+                debug!(
+                    "converting switch on {} with {} cases to br_table",
+                    case_chain.switch_var,
+                    case_chain.cases.len()
+                );
+                let new_instr_count = br_table_instrs.len();
+                instrs.splice(i..i + case_chain.instr_count, br_table_instrs);
+                i += new_instr_count;
+            }
+        }
+    }
+}
+
+fn find_case_chain(instrs: &[Instruction], start: usize) -> Option<CaseChain> {
+    let switch_var = match instrs.get(start) {
+        Some(Instruction::BrIfEq(_, Src::Var(var), Src::Constant(Constant::Int(_)), _)) => var,
+        _ => return None,
+    };
+
+    let mut cases = Vec::new();
+    let mut i = start;
+    loop {
+        match instrs.get(i) {
+            Some(Instruction::BrIfEq(_, Src::Var(var), Src::Constant(Constant::Int(n)), label))
+                if var == switch_var =>
+            {
+                cases.push((n.to_owned(), label.to_owned()));
+            }
+            Some(Instruction::Br(_, default_label)) => {
+                return Some(CaseChain {
+                    switch_var: switch_var.to_owned(),
+                    cases,
+                    default_label: default_label.to_owned(),
+                    instr_count: i - start + 1,
+                });
+            }
+            _ => return None,
+        }
+        i += 1;
+    }
+}
+
+/// Returns the instructions to replace the case chain with, or None if the cases
+/// aren't dense enough for a jump table
+fn create_br_table(
+    case_chain: &CaseChain,
+    prog_metadata: &mut ProgramMetadata,
+) -> Option<Vec<Instruction>> {
+    if case_chain.cases.len() < MIN_BR_TABLE_CASES {
+        return None;
+    }
+
+    // br_table takes an i32 index. The comparisons load the constants as i32s, so use
+    // the same value here
+    match prog_metadata.get_var_type(&case_chain.switch_var).unwrap() {
+        IrType::I8 | IrType::U8 | IrType::I16 | IrType::U16 | IrType::I32 | IrType::U32 => {}
+        _ => return None,
+    }
+    let case_values: Vec<(i64, &LabelId)> = case_chain
+        .cases
+        .iter()
+        .map(|(n, label)| (*n as i32 as i64, label))
+        .collect();
+
+    let min_value = case_values.iter().map(|(n, _)| *n).min().unwrap();
+    let max_value = case_values.iter().map(|(n, _)| *n).max().unwrap();
+
+    let is_dense_enough =
+        |table_len: i64| case_values.len() as i64 * 100 >= table_len * MIN_BR_TABLE_DENSITY_PERCENT;
+
+    // if the cases start close to zero, pad the start of the table instead of having to
+    // subtract the minimum value to get the index
+    let table_start = if min_value > 0 && is_dense_enough(max_value + 1) {
+        0
+    } else {
+        min_value
+    };
+    let table_len = max_value - table_start + 1;
+    if !is_dense_enough(table_len) {
+        return None;
+    }
+
+    // one arm per distinct case label, with the default as the last arm
+    let mut arm_labels: Vec<LabelId> = Vec::new();
+    let mut label_arm_idxs: HashMap<&LabelId, usize> = HashMap::new();
+    for (_, label) in &case_values {
+        if *label != &case_chain.default_label && !label_arm_idxs.contains_key(label) {
+            label_arm_idxs.insert(label, arm_labels.len());
+            arm_labels.push(label.to_owned().to_owned());
+        }
+    }
+    let default_arm_idx = arm_labels.len();
+    arm_labels.push(case_chain.default_label.to_owned());
+
+    let mut table: Vec<Option<usize>> = vec![None; table_len as usize];
+    for (n, label) in &case_values {
+        let entry = table.get_mut((n - table_start) as usize).unwrap();
+        // if a value is repeated, the first case to compare against it is the one that matches
+        if entry.is_none() {
+            *entry = Some(
+                label_arm_idxs
+                    .get(label)
+                    .map(|arm_idx| arm_idx.to_owned())
+                    .unwrap_or(default_arm_idx),
+            );
+        }
+    }
+    let table: Vec<usize> = table
+        .into_iter()
+        .map(|entry| entry.unwrap_or(default_arm_idx))
+        .collect();
+
+    let arms: Vec<Vec<Instruction>> = arm_labels
+        .into_iter()
+        .map(|label| vec![Instruction::Br(prog_metadata.new_instr_id(), label)])
+        .collect();
+
+    let mut br_table_instrs = Vec::new();
+    let index_src = if table_start == 0 {
+        Src::Var(case_chain.switch_var.to_owned())
+    } else {
+        let index_var = prog_metadata.new_var(ValueType::RValue);
+        prog_metadata
+            .add_var_type(index_var.to_owned(), IrType::I32)
+            .unwrap();
+        br_table_instrs.push(Instruction::Sub(
+            prog_metadata.new_instr_id(),
+            index_var.to_owned(),
+            Src::Var(case_chain.switch_var.to_owned()),
+            Src::Constant(Constant::Int(table_start as i128)),
+        ));
+        Src::Var(index_var)
+    };
+    br_table_instrs.push(Instruction::BrTable(
+        prog_metadata.new_instr_id(),
+        index_src,
+        table,
+        arms,
+    ));
+
+    Some(br_table_instrs)
+}
@@ -8,6 +8,7 @@ use crate::middle_end::ids::FunId;
 use crate::middle_end::instructions::Instruction;
 use crate::middle_end::ir::Program;
 use crate::middle_end::middle_end_error::MiddleEndError;
+use crate::program_config::program_constants::THREAD_MAIN_FUNCTION_NAME;
 
 pub fn remove_unused_functions(prog: &mut Program) -> Result<(), MiddleEndError> {
     let call_graph = generate_call_graph(prog)?;
@@ -90,6 +91,14 @@ fn generate_call_graph(prog: &Program) -> Result<CallGraph, MiddleEndError> {
     // set main() as an entry
     let main_fun_id = prog.program_metadata.get_main_fun_id()?;
     call_graph.entries.insert(main_fun_id);
+    // so is thread_main(), which the runtime calls to start each thread
+    if let Some(thread_main_fun_id) = prog
+        .program_metadata
+        .function_ids
+        .get(THREAD_MAIN_FUNCTION_NAME)
+    {
+        call_graph.entries.insert(thread_main_fun_id.to_owned());
+    }
 
     Ok(call_graph)
 }
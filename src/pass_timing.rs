@@ -0,0 +1,293 @@
+#[cfg(test)]
+#[path = "pass_timing_tests.rs"]
+mod pass_timing_tests;
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::fmt::Write;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicBool, AtomicIsize, Ordering};
+use std::time::{Duration, Instant};
+
+use clap::ValueEnum;
+
+/// The system allocator, counting the bytes allocated so that the peak heap usage of each
+/// compiler phase can be reported. Nothing is counted until tracking is enabled.
+pub struct CountingAllocator;
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+static TRACKING_ENABLED: AtomicBool = AtomicBool::new(false);
+/// Bytes currently allocated, relative to when tracking was enabled. Memory allocated
+/// before then and freed afterwards makes this go down, so it's only meaningful as a
+/// difference between two points in time.
+static ALLOCATED: AtomicIsize = AtomicIsize::new(0);
+/// The highest value of ALLOCATED since the last phase started
+static PEAK_ALLOCATED: AtomicIsize = AtomicIsize::new(0);
+
+impl CountingAllocator {
+    fn record_alloc(size: usize) {
+        if TRACKING_ENABLED.load(Ordering::Relaxed) {
+            let allocated = ALLOCATED.fetch_add(size as isize, Ordering::Relaxed) + size as isize;
+            PEAK_ALLOCATED.fetch_max(allocated, Ordering::Relaxed);
+        }
+    }
+
+    fn record_dealloc(size: usize) {
+        if TRACKING_ENABLED.load(Ordering::Relaxed) {
+            ALLOCATED.fetch_sub(size as isize, Ordering::Relaxed);
+        }
+    }
+}
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        let ptr = System.alloc(layout);
+        if !ptr.is_null() {
+            CountingAllocator::record_alloc(layout.size());
+        }
+        ptr
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        let ptr = System.alloc_zeroed(layout);
+        if !ptr.is_null() {
+            CountingAllocator::record_alloc(layout.size());
+        }
+        ptr
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout);
+        CountingAllocator::record_dealloc(layout.size());
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        let new_ptr = System.realloc(ptr, layout, new_size);
+        if !new_ptr.is_null() {
+            CountingAllocator::record_dealloc(layout.size());
+            CountingAllocator::record_alloc(new_size);
+        }
+        new_ptr
+    }
+}
+
+/// Starts counting heap allocations. The counts are process-wide, so they only measure one
+/// file's phases while it's the only file being compiled.
+pub fn enable_allocation_tracking() {
+    TRACKING_ENABLED.store(true, Ordering::Relaxed);
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq, ValueEnum)]
+pub enum TimePassesFormat {
+    Text,
+    Json,
+}
+
+/// The wall time and peak heap usage of one compiler phase
+#[derive(Debug)]
+pub struct PassTiming {
+    pub name: &'static str,
+    pub wall_time: Duration,
+    /// The most heap memory allocated at once during the phase, over what was allocated
+    /// when it started, or None if it isn't measured
+    pub peak_alloc_bytes: Option<usize>,
+}
+
+/// Measurements of each phase of compiling one file
+#[derive(Debug)]
+pub struct PassTimings {
+    filepath: PathBuf,
+    /// Whether to measure the peak allocation of each phase. It can't be told apart from
+    /// the allocations of other files that are compiled at the same time.
+    measure_peak_alloc: bool,
+    passes: Vec<PassTiming>,
+    pub ir_instrs_before_optimisation: Option<usize>,
+    pub ir_instrs_after_optimisation: Option<usize>,
+    pub module_bytes: Option<usize>,
+    pub cache_hit: bool,
+}
+
+impl PassTimings {
+    pub fn new(filepath: &Path, measure_peak_alloc: bool) -> Self {
+        PassTimings {
+            filepath: filepath.to_owned(),
+            measure_peak_alloc,
+            passes: Vec::new(),
+            ir_instrs_before_optimisation: None,
+            ir_instrs_after_optimisation: None,
+            module_bytes: None,
+            cache_hit: false,
+        }
+    }
+
+    /// Runs one phase of the compiler, recording how long it took and how much memory it used
+    pub fn time<T>(&mut self, name: &'static str, phase: impl FnOnce() -> T) -> T {
+        let allocated_at_start = ALLOCATED.load(Ordering::Relaxed);
+        if self.measure_peak_alloc {
+            PEAK_ALLOCATED.store(allocated_at_start, Ordering::Relaxed);
+        }
+        let start = Instant::now();
+        let result = phase();
+        let wall_time = start.elapsed();
+        // nothing else resets the peak while the phase runs, so it's at least where it started
+        let peak_alloc_bytes = match self.measure_peak_alloc {
+            true => Some((PEAK_ALLOCATED.load(Ordering::Relaxed) - allocated_at_start) as usize),
+            false => None,
+        };
+        self.passes.push(PassTiming {
+            name,
+            wall_time,
+            peak_alloc_bytes,
+        });
+        result
+    }
+
+    pub fn passes(&self) -> &[PassTiming] {
+        &self.passes
+    }
+
+    pub fn total_wall_time(&self) -> Duration {
+        self.passes.iter().map(|pass| pass.wall_time).sum()
+    }
+
+    pub fn report(&self, format: TimePassesFormat) -> String {
+        match format {
+            TimePassesFormat::Text => self.to_text(),
+            TimePassesFormat::Json => self.to_json(),
+        }
+    }
+
+    fn to_text(&self) -> String {
+        let mut s = String::new();
+        writeln!(s, "Pass timings for {}:", self.filepath.display()).unwrap();
+        writeln!(
+            s,
+            "  {:<16}{:>14}{:>16}",
+            "phase", "wall time", "peak alloc"
+        )
+        .unwrap();
+        for pass in &self.passes {
+            writeln!(
+                s,
+                "  {:<16}{:>11.3} ms{:>16}",
+                pass.name,
+                pass.wall_time.as_secs_f64() * 1000.0,
+                pass.peak_alloc_bytes
+                    .map_or_else(|| "n/a".to_owned(), format_bytes)
+            )
+            .unwrap();
+        }
+        writeln!(
+            s,
+            "  {:<16}{:>11.3} ms",
+            "total",
+            self.total_wall_time().as_secs_f64() * 1000.0
+        )
+        .unwrap();
+        if !self.measure_peak_alloc {
+            writeln!(
+                s,
+                "  peak alloc isn't measured while files are compiled in parallel"
+            )
+            .unwrap();
+        }
+        if self.cache_hit {
+            writeln!(s, "  module copied from the cache").unwrap();
+        }
+        if let (Some(before), Some(after)) = (
+            self.ir_instrs_before_optimisation,
+            self.ir_instrs_after_optimisation,
+        ) {
+            writeln!(
+                s,
+                "  IR instructions: {before} before optimisation, {after} after"
+            )
+            .unwrap();
+        }
+        if let Some(module_bytes) = self.module_bytes {
+            writeln!(s, "  module size: {module_bytes} bytes").unwrap();
+        }
+        s
+    }
+
+    /// A single line of JSON, so that a batch's reports can be read as JSON Lines
+    fn to_json(&self) -> String {
+        let mut s = String::new();
+        write!(
+            s,
+            "{{\"file\":{}",
+            json_string(&self.filepath.to_string_lossy())
+        )
+        .unwrap();
+        write!(s, ",\"passes\":[").unwrap();
+        for (i, pass) in self.passes.iter().enumerate() {
+            if i > 0 {
+                s.push(',');
+            }
+            write!(
+                s,
+                "{{\"name\":{},\"wall_time_us\":{},\"peak_alloc_bytes\":{}}}",
+                json_string(pass.name),
+                pass.wall_time.as_micros(),
+                json_option(pass.peak_alloc_bytes)
+            )
+            .unwrap();
+        }
+        write!(
+            s,
+            "],\"total_wall_time_us\":{},\"cache_hit\":{}",
+            self.total_wall_time().as_micros(),
+            self.cache_hit
+        )
+        .unwrap();
+        write!(
+            s,
+            ",\"ir_instrs_before_optimisation\":{}",
+            json_option(self.ir_instrs_before_optimisation)
+        )
+        .unwrap();
+        write!(
+            s,
+            ",\"ir_instrs_after_optimisation\":{}",
+            json_option(self.ir_instrs_after_optimisation)
+        )
+        .unwrap();
+        write!(s, ",\"module_bytes\":{}}}", json_option(self.module_bytes)).unwrap();
+        s.push('\n');
+        s
+    }
+}
+
+fn format_bytes(bytes: usize) -> String {
+    if bytes < 1024 {
+        format!("{bytes} B")
+    } else if bytes < 1024 * 1024 {
+        format!("{:.1} KiB", bytes as f64 / 1024.0)
+    } else {
+        format!("{:.1} MiB", bytes as f64 / (1024.0 * 1024.0))
+    }
+}
+
+fn json_option(value: Option<usize>) -> String {
+    match value {
+        None => "null".to_owned(),
+        Some(value) => value.to_string(),
+    }
+}
+
+fn json_string(value: &str) -> String {
+    let mut s = String::with_capacity(value.len() + 2);
+    s.push('"');
+    for c in value.chars() {
+        match c {
+            '"' => s.push_str("\\\""),
+            '\\' => s.push_str("\\\\"),
+            '\n' => s.push_str("\\n"),
+            c if (c as u32) < 0x20 => write!(s, "\\u{:04x}", c as u32).unwrap(),
+            c => s.push(c),
+        }
+    }
+    s.push('"');
+    s
+}
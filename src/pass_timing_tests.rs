@@ -0,0 +1,59 @@
+#[cfg(test)]
+mod pass_timing_tests {
+    use std::path::Path;
+
+    use super::super::{enable_allocation_tracking, PassTimings, TimePassesFormat};
+
+    #[test]
+    fn records_each_phase_and_its_peak_allocation() {
+        enable_allocation_tracking();
+        let mut timings = PassTimings::new(Path::new("test.c"), true);
+        let length = timings.time("allocate", || vec![1u8; 1 << 20].len());
+        let result: Result<(), &str> = timings.time("fail", || Err("failed"));
+
+        assert_eq!(length, 1 << 20);
+        assert!(result.is_err());
+        let passes = timings.passes();
+        assert_eq!(passes.len(), 2);
+        assert_eq!(passes[0].name, "allocate");
+        // other tests allocate and free on other threads at the same time
+        let peak_alloc_bytes = passes[0].peak_alloc_bytes.unwrap();
+        assert!(peak_alloc_bytes >= 1 << 19, "peak was {}", peak_alloc_bytes);
+        assert_eq!(passes[1].name, "fail");
+    }
+
+    #[test]
+    fn reports_as_a_line_of_json() {
+        let mut timings = PassTimings::new(Path::new("dir/\"quoted\".c"), false);
+        timings.time("parse", || ());
+        timings.ir_instrs_before_optimisation = Some(120);
+        timings.ir_instrs_after_optimisation = Some(80);
+
+        let json = timings.report(TimePassesFormat::Json);
+        assert_eq!(json.lines().count(), 1);
+        assert!(
+            json.starts_with("{\"file\":\"dir/\\\"quoted\\\".c\",\"passes\":[{\"name\":\"parse\",")
+        );
+        assert!(json.contains("\"ir_instrs_before_optimisation\":120"));
+        assert!(json.contains("\"ir_instrs_after_optimisation\":80"));
+        assert!(json.ends_with("\"cache_hit\":false,\"ir_instrs_before_optimisation\":120,\"ir_instrs_after_optimisation\":80,\"module_bytes\":null}\n"));
+
+        let text = timings.report(TimePassesFormat::Text);
+        assert!(text.contains("IR instructions: 120 before optimisation, 80 after"));
+    }
+
+    #[test]
+    fn leaves_out_peak_allocation_when_not_measured() {
+        let mut timings = PassTimings::new(Path::new("test.c"), false);
+        timings.time("allocate", || vec![1u8; 1 << 20].len());
+        assert_eq!(timings.passes()[0].peak_alloc_bytes, None);
+
+        let json = timings.report(TimePassesFormat::Json);
+        assert!(json.contains("\"name\":\"allocate\","));
+        assert!(json.contains("\"peak_alloc_bytes\":null"));
+
+        let text = timings.report(TimePassesFormat::Text);
+        assert!(text.contains("n/a"));
+        assert!(text.contains("peak alloc isn't measured while files are compiled in parallel"));
+    }
+}
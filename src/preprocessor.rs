@@ -9,7 +9,23 @@ use lazy_static::lazy_static;
 use log::info;
 use regex::Regex;
 
-pub fn preprocess(filepath: &Path) -> Result<String, PreprocessorError> {
+use crate::preprocessor::embedded_preprocessor::preprocess_embedded;
+
+mod conditional_expression;
+mod embedded_preprocessor;
+mod macros;
+mod preprocessor_tokens;
+
+/// Preprocess the source file. By default this is done in memory by the embedded
+/// preprocessor; use_external_cpp runs the system's `cpp` in a separate process instead.
+pub fn preprocess(filepath: &Path, use_external_cpp: bool) -> Result<String, PreprocessorError> {
+    if !use_external_cpp {
+        info!("Running embedded preprocessor");
+        let processed_source = preprocess_embedded(filepath)?;
+        info!("Preprocessor output:\n{processed_source}");
+        return Ok(processed_source);
+    }
+
     info!("Running preprocessor");
 
     let (mut file_contents, includes) = remove_include_directives(filepath)?;
@@ -186,6 +202,13 @@ pub enum PreprocessorError {
     UnsupportedHeaderInclude(String),
     IoError(io::Error),
     CppError(Box<dyn Error>),
+    InvalidDirective(String),
+    UnmatchedConditionalDirective(String),
+    UnterminatedConditional,
+    InvalidConditionalExpression(String),
+    InvalidMacroInvocation(String),
+    IncludeDepthExceeded,
+    ErrorDirective(String),
 }
 
 impl fmt::Display for PreprocessorError {
@@ -203,6 +226,27 @@ impl fmt::Display for PreprocessorError {
             PreprocessorError::FileNotFound(n) => {
                 write!(f, "File not found: {n}")
             }
+            PreprocessorError::InvalidDirective(d) => {
+                write!(f, "Invalid preprocessor directive: {d}")
+            }
+            PreprocessorError::UnmatchedConditionalDirective(d) => {
+                write!(f, "{d} without a matching #if")
+            }
+            PreprocessorError::UnterminatedConditional => {
+                write!(f, "Unterminated #if at the end of the file")
+            }
+            PreprocessorError::InvalidConditionalExpression(e) => {
+                write!(f, "Invalid #if expression: {e}")
+            }
+            PreprocessorError::InvalidMacroInvocation(m) => {
+                write!(f, "Invalid arguments to macro {m}")
+            }
+            PreprocessorError::IncludeDepthExceeded => {
+                write!(f, "#include nested too deeply")
+            }
+            PreprocessorError::ErrorDirective(m) => {
+                write!(f, "#error {m}")
+            }
         }
     }
 }
@@ -0,0 +1,212 @@
+use crate::preprocessor::preprocessor_tokens::{PpToken, PpTokenKind};
+use crate::preprocessor::PreprocessorError;
+
+/// Evaluates the controlling expression of an #if or #elif directive. The tokens must
+/// already have had `defined` and macros replaced, and any identifiers left are treated as 0.
+pub fn evaluate_conditional_expression(tokens: &[PpToken]) -> Result<i64, PreprocessorError> {
+    let tokens: Vec<&PpToken> = tokens.iter().filter(|t| !t.is_whitespace()).collect();
+    if tokens.is_empty() {
+        return Err(invalid_expression(&tokens));
+    }
+    let mut evaluator = ExpressionEvaluator {
+        tokens: &tokens,
+        position: 0,
+    };
+    let value = evaluator.conditional()?;
+    if evaluator.position != tokens.len() {
+        return Err(invalid_expression(&tokens));
+    }
+    Ok(value)
+}
+
+fn invalid_expression(tokens: &[&PpToken]) -> PreprocessorError {
+    let expression: Vec<&str> = tokens.iter().map(|t| t.text.as_str()).collect();
+    PreprocessorError::InvalidConditionalExpression(expression.join(" "))
+}
+
+/// Binary operators from lowest to highest precedence
+const BINARY_OPERATOR_PRECEDENCE: [&[&str]; 10] = [
+    &["||"],
+    &["&&"],
+    &["|"],
+    &["^"],
+    &["&"],
+    &["==", "!="],
+    &["<", ">", "<=", ">="],
+    &["<<", ">>"],
+    &["+", "-"],
+    &["*", "/", "%"],
+];
+
+struct ExpressionEvaluator<'a> {
+    tokens: &'a [&'a PpToken],
+    position: usize,
+}
+
+impl<'a> ExpressionEvaluator<'a> {
+    fn peek(&self) -> Option<&'a PpToken> {
+        self.tokens.get(self.position).copied()
+    }
+
+    fn eat_punctuator(&mut self, punctuator: &str) -> bool {
+        match self.peek() {
+            Some(token) if token.is_punctuator(punctuator) => {
+                self.position += 1;
+                true
+            }
+            _ => false,
+        }
+    }
+
+    fn expect_punctuator(&mut self, punctuator: &str) -> Result<(), PreprocessorError> {
+        if self.eat_punctuator(punctuator) {
+            Ok(())
+        } else {
+            Err(invalid_expression(self.tokens))
+        }
+    }
+
+    fn conditional(&mut self) -> Result<i64, PreprocessorError> {
+        let condition = self.binary(0)?;
+        if !self.eat_punctuator("?") {
+            return Ok(condition);
+        }
+        let true_value = self.conditional()?;
+        self.expect_punctuator(":")?;
+        let false_value = self.conditional()?;
+        Ok(if condition != 0 {
+            true_value
+        } else {
+            false_value
+        })
+    }
+
+    fn binary(&mut self, precedence: usize) -> Result<i64, PreprocessorError> {
+        if precedence == BINARY_OPERATOR_PRECEDENCE.len() {
+            return self.unary();
+        }
+        let mut left = self.binary(precedence + 1)?;
+        loop {
+            let operator = match self.peek() {
+                Some(token)
+                    if token.kind == PpTokenKind::Punctuator
+                        && BINARY_OPERATOR_PRECEDENCE[precedence]
+                            .contains(&token.text.as_str()) =>
+                {
+                    token.text.as_str()
+                }
+                _ => return Ok(left),
+            };
+            self.position += 1;
+            let right = self.binary(precedence + 1)?;
+            left = match operator {
+                "||" => (left != 0 || right != 0) as i64,
+                "&&" => (left != 0 && right != 0) as i64,
+                "|" => left | right,
+                "^" => left ^ right,
+                "&" => left & right,
+                "==" => (left == right) as i64,
+                "!=" => (left != right) as i64,
+                "<" => (left < right) as i64,
+                ">" => (left > right) as i64,
+                "<=" => (left <= right) as i64,
+                ">=" => (left >= right) as i64,
+                "<<" => left.wrapping_shl(right as u32),
+                ">>" => left.wrapping_shr(right as u32),
+                "+" => left.wrapping_add(right),
+                "-" => left.wrapping_sub(right),
+                "*" => left.wrapping_mul(right),
+                "/" | "%" if right == 0 => {
+                    return Err(PreprocessorError::InvalidConditionalExpression(
+                        "division by zero".to_owned(),
+                    ))
+                }
+                "/" => left.wrapping_div(right),
+                "%" => left.wrapping_rem(right),
+                _ => unreachable!(),
+            };
+        }
+    }
+
+    fn unary(&mut self) -> Result<i64, PreprocessorError> {
+        if self.eat_punctuator("+") {
+            return self.unary();
+        }
+        if self.eat_punctuator("-") {
+            return Ok(self.unary()?.wrapping_neg());
+        }
+        if self.eat_punctuator("~") {
+            return Ok(!self.unary()?);
+        }
+        if self.eat_punctuator("!") {
+            return Ok((self.unary()? == 0) as i64);
+        }
+        if self.eat_punctuator("(") {
+            let value = self.conditional()?;
+            self.expect_punctuator(")")?;
+            return Ok(value);
+        }
+        let token = match self.peek() {
+            Some(token) => token,
+            None => return Err(invalid_expression(self.tokens)),
+        };
+        self.position += 1;
+        match token.kind {
+            PpTokenKind::Number => parse_integer(&token.text),
+            PpTokenKind::CharLiteral => parse_char(&token.text),
+            // identifiers that aren't macros evaluate to 0
+            PpTokenKind::Identifier => Ok(0),
+            _ => Err(invalid_expression(self.tokens)),
+        }
+    }
+}
+
+fn parse_integer(literal: &str) -> Result<i64, PreprocessorError> {
+    let digits = literal.trim_end_matches(['u', 'U', 'l', 'L']);
+    let (digits, radix) = if let Some(hex) = digits
+        .strip_prefix("0x")
+        .or_else(|| digits.strip_prefix("0X"))
+    {
+        (hex, 16)
+    } else if let Some(binary) = digits
+        .strip_prefix("0b")
+        .or_else(|| digits.strip_prefix("0B"))
+    {
+        (binary, 2)
+    } else if digits.len() > 1 && digits.starts_with('0') {
+        (&digits[1..], 8)
+    } else {
+        (digits, 10)
+    };
+    // unsigned values that don't fit in an i64 wrap around, like intmax_t arithmetic would
+    match u64::from_str_radix(digits, radix) {
+        Ok(value) => Ok(value as i64),
+        Err(_) => Err(PreprocessorError::InvalidConditionalExpression(
+            literal.to_owned(),
+        )),
+    }
+}
+
+fn parse_char(literal: &str) -> Result<i64, PreprocessorError> {
+    let invalid = || PreprocessorError::InvalidConditionalExpression(literal.to_owned());
+    let contents = literal
+        .strip_prefix('\'')
+        .and_then(|s| s.strip_suffix('\''))
+        .ok_or_else(invalid)?;
+    let mut chars = contents.chars();
+    let value = match chars.next().ok_or_else(invalid)? {
+        '\\' => match chars.next().ok_or_else(invalid)? {
+            'n' => '\n' as i64,
+            't' => '\t' as i64,
+            'r' => '\r' as i64,
+            '0' => 0,
+            'a' => 7,
+            'b' => 8,
+            'f' => 12,
+            'v' => 11,
+            c => c as i64,
+        },
+        c => c as i64,
+    };
+    Ok(value)
+}
@@ -0,0 +1,442 @@
+#[cfg(test)]
+#[path = "embedded_preprocessor_tests.rs"]
+mod embedded_preprocessor_tests;
+
+use std::collections::HashMap;
+use std::fs;
+use std::io::ErrorKind;
+use std::path::{Path, PathBuf};
+use std::sync::{Arc, Mutex};
+
+use lazy_static::lazy_static;
+
+use crate::preprocessor::conditional_expression::evaluate_conditional_expression;
+use crate::preprocessor::macros::{skip_whitespace, Macro, MacroTable};
+use crate::preprocessor::preprocessor_tokens::{
+    needs_separating_space, splice_lines_and_remove_comments, tokenise_line, PpToken, PpTokenKind,
+};
+use crate::preprocessor::PreprocessorError;
+
+/// The directory the standard library headers are in
+const STANDARD_HEADERS_DIR: &str = "headers";
+
+/// Limit on nested includes, so a header that includes itself without an include guard
+/// doesn't recurse forever
+const MAX_INCLUDE_DEPTH: usize = 200;
+
+/// The output of preprocessing a standard header, and what it depends on, so it can be
+/// reused by later includes of the header
+#[derive(Debug)]
+struct CachedHeader {
+    /// The definitions the header's output depends on, when it was included
+    dependencies: HashMap<String, Option<Arc<Macro>>>,
+    output: String,
+    /// The definition of each macro the header defined or undefined, after the header
+    macro_changes: Vec<(String, Option<Arc<Macro>>)>,
+}
+
+lazy_static! {
+    /// Standard headers that have already been preprocessed, shared between all the files
+    /// compiled by this process. A header can have several entries, e.g. one for its first
+    /// include and one for when its include guard is already defined.
+    static ref HEADER_CACHE: Mutex<HashMap<PathBuf, Vec<Arc<CachedHeader>>>> =
+        Mutex::new(HashMap::new());
+}
+
+/// Preprocesses the file in memory, without running `cpp`
+pub fn preprocess_embedded(filepath: &Path) -> Result<String, PreprocessorError> {
+    let source = match fs::read_to_string(filepath) {
+        Ok(source) => source,
+        Err(e) => {
+            return match e.kind() {
+                ErrorKind::NotFound => Err(PreprocessorError::FileNotFound(
+                    filepath.to_str().unwrap().to_owned(),
+                )),
+                _ => Err(PreprocessorError::IoError(e)),
+            }
+        }
+    };
+    let mut preprocessor = EmbeddedPreprocessor::new();
+    preprocessor.preprocess_source(&source, filepath.parent())?;
+    Ok(preprocessor.output)
+}
+
+/// Whether the tokens in a conditional group are being kept
+#[derive(Debug)]
+struct ConditionalGroup {
+    /// Whether the #if, #elif or #else group we're in is being kept
+    is_active: bool,
+    /// Whether any group of this conditional has been kept yet, or the whole conditional is
+    /// inside a group that isn't being kept
+    is_done: bool,
+    seen_else: bool,
+}
+
+pub struct EmbeddedPreprocessor {
+    macros: MacroTable,
+    output: String,
+    /// Text lines that haven't been macro-expanded yet. Lines are expanded together, so
+    /// macro invocations can span several lines.
+    pending_tokens: Vec<PpToken>,
+    include_depth: usize,
+}
+
+impl EmbeddedPreprocessor {
+    pub fn new() -> Self {
+        EmbeddedPreprocessor {
+            macros: MacroTable::new(),
+            output: String::new(),
+            pending_tokens: Vec::new(),
+            include_depth: 0,
+        }
+    }
+
+    /// Preprocess a source file, appending its output. Quoted includes are looked for in
+    /// source_dir before the standard headers.
+    pub fn preprocess_source(
+        &mut self,
+        source: &str,
+        source_dir: Option<&Path>,
+    ) -> Result<(), PreprocessorError> {
+        let source = splice_lines_and_remove_comments(source);
+        let mut conditionals: Vec<ConditionalGroup> = Vec::new();
+
+        for line in source.lines() {
+            let is_active = conditionals.last().map_or(true, |c| c.is_active);
+            let directive = match line.trim_start().strip_prefix('#') {
+                Some(directive) => directive,
+                None => {
+                    if is_active {
+                        self.pending_tokens.extend(tokenise_line(line));
+                        self.pending_tokens
+                            .push(PpToken::new(PpTokenKind::Newline, "\n".to_owned()));
+                    }
+                    continue;
+                }
+            };
+
+            self.flush_pending_tokens()?;
+            let tokens = tokenise_line(directive);
+            let name_index = skip_whitespace(&tokens, 0);
+            let name = match tokens.get(name_index) {
+                // the null directive
+                None => continue,
+                Some(token) => token.text.as_str(),
+            };
+            let rest = &tokens[name_index + 1..];
+
+            match name {
+                "if" | "ifdef" | "ifndef" => {
+                    let condition = if is_active {
+                        match name {
+                            "if" => self.evaluate_condition(rest)?,
+                            "ifdef" => self.macros.is_defined(&directive_identifier(rest)?),
+                            _ => !self.macros.is_defined(&directive_identifier(rest)?),
+                        }
+                    } else {
+                        false
+                    };
+                    conditionals.push(ConditionalGroup {
+                        is_active: condition,
+                        is_done: condition || !is_active,
+                        seen_else: false,
+                    });
+                }
+                "elif" => {
+                    let is_done = match conditionals.last() {
+                        Some(c) if !c.seen_else => c.is_done,
+                        _ => return Err(unmatched_directive(line)),
+                    };
+                    let condition = !is_done && self.evaluate_condition(rest)?;
+                    let conditional = conditionals.last_mut().unwrap();
+                    conditional.is_active = condition;
+                    conditional.is_done |= condition;
+                }
+                "else" => {
+                    let conditional = match conditionals.last_mut() {
+                        Some(c) if !c.seen_else => c,
+                        _ => return Err(unmatched_directive(line)),
+                    };
+                    conditional.is_active = !conditional.is_done;
+                    conditional.is_done = true;
+                    conditional.seen_else = true;
+                }
+                "endif" => {
+                    if conditionals.pop().is_none() {
+                        return Err(unmatched_directive(line));
+                    }
+                }
+                // everything else is skipped inside a group that isn't being kept
+                _ if !is_active => {}
+                "define" => {
+                    let (name, definition) = Macro::parse_definition(rest)?;
+                    self.macros.set(name, Some(Arc::new(definition)));
+                }
+                "undef" => {
+                    let name = directive_identifier(rest)?;
+                    self.macros.set(name, None);
+                }
+                "include" => {
+                    let (header_name, is_quoted) = self.parse_include(rest)?;
+                    self.include(&header_name, is_quoted, source_dir)?;
+                }
+                "error" => {
+                    let message: String = rest.iter().map(|t| t.text.as_str()).collect();
+                    return Err(PreprocessorError::ErrorDirective(message.trim().to_owned()));
+                }
+                // these don't affect the output
+                "pragma" | "line" | "warning" => {}
+                _ => return Err(PreprocessorError::InvalidDirective(line.trim().to_owned())),
+            }
+        }
+
+        if !conditionals.is_empty() {
+            return Err(PreprocessorError::UnterminatedConditional);
+        }
+        self.flush_pending_tokens()
+    }
+
+    /// Macro-expand the pending text lines and write them to the output
+    fn flush_pending_tokens(&mut self) -> Result<(), PreprocessorError> {
+        if self.pending_tokens.is_empty() {
+            return Ok(());
+        }
+        let tokens = std::mem::take(&mut self.pending_tokens);
+        for token in self.macros.expand(tokens)? {
+            self.write_token(&token);
+        }
+        Ok(())
+    }
+
+    fn write_token(&mut self, token: &PpToken) {
+        match token.kind {
+            PpTokenKind::Newline => {
+                // leave out blank lines
+                if !self.output.is_empty() && !self.output.ends_with('\n') {
+                    let trimmed_length = self.output.trim_end_matches(' ').len();
+                    self.output.truncate(trimmed_length);
+                    self.output.push('\n');
+                }
+            }
+            PpTokenKind::Whitespace => {
+                if !self.output.is_empty() && !self.output.ends_with([' ', '\n']) {
+                    self.output.push(' ');
+                }
+            }
+            _ => {
+                // tokens that end up next to each other after expansion mustn't join together
+                if let (Some(previous), Some(next)) =
+                    (self.output.chars().last(), token.text.chars().next())
+                {
+                    if needs_separating_space(previous, next) {
+                        self.output.push(' ');
+                    }
+                }
+                self.output.push_str(&token.text);
+            }
+        }
+    }
+
+    fn evaluate_condition(&mut self, tokens: &[PpToken]) -> Result<bool, PreprocessorError> {
+        // defined has to be replaced before macros are expanded, so its operand isn't
+        let mut replaced = Vec::with_capacity(tokens.len());
+        let mut i = 0;
+        while i < tokens.len() {
+            let token = &tokens[i];
+            if token.kind != PpTokenKind::Identifier || token.text != "defined" {
+                replaced.push(token.to_owned());
+                i += 1;
+                continue;
+            }
+            let mut operand_index = skip_whitespace(tokens, i + 1);
+            let has_brackets = tokens
+                .get(operand_index)
+                .map_or(false, |t| t.is_punctuator("("));
+            if has_brackets {
+                operand_index = skip_whitespace(tokens, operand_index + 1);
+            }
+            let operand = match tokens.get(operand_index) {
+                Some(t) if t.kind == PpTokenKind::Identifier => t.text.to_owned(),
+                _ => return Err(invalid_condition(tokens)),
+            };
+            i = operand_index + 1;
+            if has_brackets {
+                i = skip_whitespace(tokens, i);
+                if !tokens.get(i).map_or(false, |t| t.is_punctuator(")")) {
+                    return Err(invalid_condition(tokens));
+                }
+                i += 1;
+            }
+            let value = if self.macros.is_defined(&operand) {
+                "1"
+            } else {
+                "0"
+            };
+            replaced.push(PpToken::new(PpTokenKind::Number, value.to_owned()));
+        }
+        let expanded = self.macros.expand(replaced)?;
+        Ok(evaluate_conditional_expression(&expanded)? != 0)
+    }
+
+    /// Parse the header name from an #include directive, and whether it's in quotes rather
+    /// than angle brackets
+    fn parse_include(&mut self, tokens: &[PpToken]) -> Result<(String, bool), PreprocessorError> {
+        let tokens = if tokens.iter().any(|t| t.kind == PpTokenKind::Identifier) {
+            // the header name can come from a macro
+            self.macros.expand(tokens.to_vec())?
+        } else {
+            tokens.to_vec()
+        };
+        let start = skip_whitespace(&tokens, 0);
+        let invalid = || {
+            let directive: String = tokens.iter().map(|t| t.text.as_str()).collect();
+            PreprocessorError::InvalidDirective(format!("#include {}", directive.trim()))
+        };
+        match tokens.get(start) {
+            Some(token) if token.kind == PpTokenKind::StringLiteral => {
+                Ok((token.text.trim_matches('"').to_owned(), true))
+            }
+            Some(token) if token.is_punctuator("<") => {
+                let end = tokens
+                    .iter()
+                    .position(|t| t.is_punctuator(">"))
+                    .ok_or_else(invalid)?;
+                let name: String = tokens[start + 1..end]
+                    .iter()
+                    .map(|t| t.text.as_str())
+                    .collect();
+                Ok((name, false))
+            }
+            _ => Err(invalid()),
+        }
+    }
+
+    fn include(
+        &mut self,
+        header_name: &str,
+        is_quoted: bool,
+        source_dir: Option<&Path>,
+    ) -> Result<(), PreprocessorError> {
+        // headers start on a new line, so their output doesn't depend on what came before
+        if !self.output.is_empty() && !self.output.ends_with('\n') {
+            self.output.push('\n');
+        }
+
+        // quoted includes are the program's own headers, from the same directory
+        if is_quoted {
+            let path =
+                source_dir.map_or_else(|| PathBuf::from(header_name), |dir| dir.join(header_name));
+            if path.is_file() {
+                let source = read_header(&path)?;
+                let header_dir = path.parent().map(Path::to_path_buf);
+                return self.preprocess_header(&source, header_dir.as_deref());
+            }
+        }
+
+        let path = Path::new(STANDARD_HEADERS_DIR).join(header_name);
+        if self.try_use_cached_header(&path) {
+            return Ok(());
+        }
+        let source = read_header(&path)?;
+        self.macros.start_recording();
+        let output_start = self.output.len();
+        self.preprocess_header(&source, Some(Path::new(STANDARD_HEADERS_DIR)))?;
+        let recording = self.macros.finish_recording();
+
+        let macro_changes = recording
+            .changed_macros
+            .into_iter()
+            .map(|name| {
+                let definition = self.macros.peek(&name).cloned();
+                (name, definition)
+            })
+            .collect();
+        let cached_header = CachedHeader {
+            dependencies: recording.dependencies,
+            output: self.output[output_start..].to_owned(),
+            macro_changes,
+        };
+        HEADER_CACHE
+            .lock()
+            .unwrap()
+            .entry(path)
+            .or_default()
+            .push(Arc::new(cached_header));
+        Ok(())
+    }
+
+    fn preprocess_header(
+        &mut self,
+        source: &str,
+        header_dir: Option<&Path>,
+    ) -> Result<(), PreprocessorError> {
+        if self.include_depth == MAX_INCLUDE_DEPTH {
+            return Err(PreprocessorError::IncludeDepthExceeded);
+        }
+        self.include_depth += 1;
+        let result = self.preprocess_source(source, header_dir);
+        self.include_depth -= 1;
+        result
+    }
+
+    /// Reuse the output of an earlier include of a standard header, if it depended on the
+    /// same macro definitions as are defined now. Returns whether the header was found.
+    fn try_use_cached_header(&mut self, path: &Path) -> bool {
+        let cached_header = {
+            let cache = HEADER_CACHE.lock().unwrap();
+            let entries = match cache.get(path) {
+                None => return false,
+                Some(entries) => entries,
+            };
+            let matching_entry = entries.iter().find(|entry| {
+                entry
+                    .dependencies
+                    .iter()
+                    .all(|(name, definition)| self.macros.peek(name) == definition.as_ref())
+            });
+            match matching_entry {
+                None => return false,
+                Some(entry) => Arc::clone(entry),
+            }
+        };
+
+        // anything that's caching an outer header depends on the same macros as this one
+        for name in cached_header.dependencies.keys() {
+            self.macros.lookup(name);
+        }
+        self.output.push_str(&cached_header.output);
+        for (name, definition) in &cached_header.macro_changes {
+            self.macros.set(name.to_owned(), definition.to_owned());
+        }
+        true
+    }
+}
+
+fn read_header(path: &Path) -> Result<String, PreprocessorError> {
+    fs::read_to_string(path).map_err(|e| match e.kind() {
+        ErrorKind::NotFound => {
+            PreprocessorError::UnsupportedHeaderInclude(path.to_str().unwrap().to_owned())
+        }
+        _ => PreprocessorError::IoError(e),
+    })
+}
+
+/// Get the identifier a directive like #ifdef or #undef applies to
+fn directive_identifier(tokens: &[PpToken]) -> Result<String, PreprocessorError> {
+    match tokens.get(skip_whitespace(tokens, 0)) {
+        Some(token) if token.kind == PpTokenKind::Identifier => Ok(token.text.to_owned()),
+        _ => {
+            let directive: String = tokens.iter().map(|t| t.text.as_str()).collect();
+            Err(PreprocessorError::InvalidDirective(directive))
+        }
+    }
+}
+
+fn unmatched_directive(line: &str) -> PreprocessorError {
+    PreprocessorError::UnmatchedConditionalDirective(line.trim().to_owned())
+}
+
+fn invalid_condition(tokens: &[PpToken]) -> PreprocessorError {
+    let condition: String = tokens.iter().map(|t| t.text.as_str()).collect();
+    PreprocessorError::InvalidConditionalExpression(condition.trim().to_owned())
+}
@@ -0,0 +1,117 @@
+#[cfg(test)]
+mod embedded_preprocessor_tests {
+    use super::super::EmbeddedPreprocessor;
+    use crate::preprocessor::PreprocessorError;
+
+    fn preprocess(source: &str) -> Result<String, PreprocessorError> {
+        let mut preprocessor = EmbeddedPreprocessor::new();
+        preprocessor.preprocess_source(source, None)?;
+        Ok(preprocessor.output)
+    }
+
+    /// Compare ignoring whitespace, since that's all the preprocessor is free to change
+    fn assert_preprocesses_to(source: &str, expected: &str) {
+        let output = preprocess(source).unwrap();
+        let tokens: Vec<&str> = output.split_whitespace().collect();
+        let expected_tokens: Vec<&str> = expected.split_whitespace().collect();
+        assert_eq!(tokens, expected_tokens, "output was:\n{output}");
+    }
+
+    #[test]
+    fn expands_object_and_function_like_macros() {
+        assert_preprocesses_to(
+            "#define N 10\n\
+             #define MAX(a, b) ((a) > (b) ? (a) : (b))\n\
+             int x = MAX(N, 3);\n\
+             int MAX;\n",
+            "int x = ((10) > (3) ? (10) : (3)); int MAX;",
+        );
+    }
+
+    #[test]
+    fn doesnt_expand_macros_recursively() {
+        assert_preprocesses_to(
+            "#define foo foo + 1\n\
+             #define f(x) g(x)\n\
+             #define g(x) f(x) * 2\n\
+             int a = foo; int b = f(1);\n",
+            "int a = foo + 1; int b = f(1) * 2;",
+        );
+    }
+
+    #[test]
+    fn stringifies_and_pastes_args() {
+        assert_preprocesses_to(
+            "#define STR(x) #x\n\
+             #define CONCAT(a, b) a ## b\n\
+             char *s = STR(a  \"b\" c); int CONCAT(var, 1) = 0;\n",
+            "char *s = \"a \\\"b\\\" c\"; int var1 = 0;",
+        );
+    }
+
+    #[test]
+    fn doesnt_join_tokens_from_expansions() {
+        let output = preprocess("#define NEG -1\nint x = -NEG;\n").unwrap();
+        assert!(output.contains("- -1"), "output was:\n{output}");
+    }
+
+    #[test]
+    fn keeps_only_the_taken_conditional_groups() {
+        assert_preprocesses_to(
+            "#define A 2\n\
+             #if A > 3\n one\n\
+             #elif defined(A) && A == 2\n two\n\
+             #ifdef B\n three\n#else\n four\n#endif\n\
+             #else\n five\n\
+             #endif\n\
+             #if 0\n#error not reached\n#endif\n",
+            "two four",
+        );
+    }
+
+    #[test]
+    fn removes_comments_but_not_from_strings() {
+        assert_preprocesses_to(
+            "int a; // comment\n\
+             /* multi\n line */ int b;\n\
+             char *s = \"// not a comment\";\n",
+            "int a; int b; char *s = \"// not a comment\";",
+        );
+    }
+
+    #[test]
+    fn reports_errors() {
+        assert!(matches!(
+            preprocess("#if 1\nint x;\n"),
+            Err(PreprocessorError::UnterminatedConditional)
+        ));
+        assert!(matches!(
+            preprocess("#endif\n"),
+            Err(PreprocessorError::UnmatchedConditionalDirective(_))
+        ));
+        assert!(matches!(
+            preprocess("#error stop\n"),
+            Err(PreprocessorError::ErrorDirective(_))
+        ));
+    }
+
+    #[test]
+    fn reuses_cached_standard_headers() {
+        let source = "#include <stddef.h>\n#include <stddef.h>\nvoid *p = NULL;\n";
+        let first = preprocess(source).unwrap();
+        let second = preprocess(source).unwrap();
+        assert_eq!(first, second);
+        assert_eq!(first.matches("typedef int size_t;").count(), 1);
+        assert!(
+            first.contains("void *p = ((void*)0);"),
+            "output was:\n{first}"
+        );
+
+        // a different definition of a macro the header uses can't reuse the cached output
+        let redefined = preprocess("#define size_t long\n#include <stddef.h>\n").unwrap();
+        assert!(
+            redefined.contains("typedef int long;"),
+            "output was:\n{redefined}"
+        );
+    }
+}
@@ -0,0 +1,445 @@
+use std::collections::{HashMap, HashSet, VecDeque};
+use std::sync::Arc;
+
+use crate::preprocessor::preprocessor_tokens::{tokenise_line, PpToken, PpTokenKind};
+use crate::preprocessor::PreprocessorError;
+
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Macro {
+    Object {
+        body: Vec<PpToken>,
+    },
+    Function {
+        params: Vec<String>,
+        is_variadic: bool,
+        body: Vec<PpToken>,
+    },
+}
+
+impl Macro {
+    /// Parses the tokens after `#define`
+    pub fn parse_definition(tokens: &[PpToken]) -> Result<(String, Macro), PreprocessorError> {
+        let invalid = || {
+            let definition: String = tokens.iter().map(|t| t.text.as_str()).collect();
+            PreprocessorError::InvalidDirective(format!("#define{definition}"))
+        };
+        let mut i = skip_whitespace(tokens, 0);
+        let name = match tokens.get(i) {
+            Some(token) if token.kind == PpTokenKind::Identifier => token.text.to_owned(),
+            _ => return Err(invalid()),
+        };
+        i += 1;
+
+        // it's only a function-like macro if the bracket comes straight after the name
+        if !tokens.get(i).map_or(false, |t| t.is_punctuator("(")) {
+            return Ok((
+                name,
+                Macro::Object {
+                    body: normalise_body(&tokens[i..]),
+                },
+            ));
+        }
+        i += 1;
+
+        let mut params = Vec::new();
+        let mut is_variadic = false;
+        loop {
+            i = skip_whitespace(tokens, i);
+            match tokens.get(i) {
+                Some(token) if token.is_punctuator(")") && params.is_empty() => break,
+                Some(token) if token.is_punctuator("...") => {
+                    is_variadic = true;
+                    i = skip_whitespace(tokens, i + 1);
+                    if !tokens.get(i).map_or(false, |t| t.is_punctuator(")")) {
+                        return Err(invalid());
+                    }
+                    break;
+                }
+                Some(token) if token.kind == PpTokenKind::Identifier => {
+                    params.push(token.text.to_owned())
+                }
+                _ => return Err(invalid()),
+            }
+            i = skip_whitespace(tokens, i + 1);
+            match tokens.get(i) {
+                Some(token) if token.is_punctuator(",") => i += 1,
+                Some(token) if token.is_punctuator(")") => break,
+                _ => return Err(invalid()),
+            }
+        }
+        Ok((
+            name,
+            Macro::Function {
+                params,
+                is_variadic,
+                body: normalise_body(&tokens[i + 1..]),
+            },
+        ))
+    }
+}
+
+/// Trims whitespace from both ends of a macro body, and collapses the whitespace inside it
+fn normalise_body(tokens: &[PpToken]) -> Vec<PpToken> {
+    let mut body: Vec<PpToken> = Vec::new();
+    for token in tokens {
+        if token.is_whitespace() {
+            if body.last().map_or(false, |t| !t.is_whitespace()) {
+                body.push(PpToken::new(PpTokenKind::Whitespace, " ".to_owned()));
+            }
+        } else {
+            body.push(token.to_owned());
+        }
+    }
+    if body.last().map_or(false, |t| t.is_whitespace()) {
+        body.pop();
+    }
+    body
+}
+
+pub fn skip_whitespace(tokens: &[PpToken], mut i: usize) -> usize {
+    while tokens.get(i).map_or(false, |t| t.is_whitespace()) {
+        i += 1;
+    }
+    i
+}
+
+/// Records which macros a header depends on while it's being preprocessed, so the result
+/// can be reused when the header is included again with the same definitions of those macros.
+#[derive(Debug, Default)]
+pub struct MacroRecording {
+    /// The definition each macro had when the header was included, for the macros the
+    /// header looked up before changing them itself
+    pub dependencies: HashMap<String, Option<Arc<Macro>>>,
+    /// The macros the header defined or undefined
+    pub changed_macros: HashSet<String>,
+}
+
+/// The macros currently defined
+#[derive(Debug, Default)]
+pub struct MacroTable {
+    macros: HashMap<String, Arc<Macro>>,
+    /// Recordings for each header being cached, innermost last
+    recordings: Vec<MacroRecording>,
+}
+
+impl MacroTable {
+    pub fn new() -> Self {
+        MacroTable::default()
+    }
+
+    pub fn lookup(&mut self, name: &str) -> Option<Arc<Macro>> {
+        let definition = self.macros.get(name).cloned();
+        for recording in &mut self.recordings {
+            if !recording.changed_macros.contains(name)
+                && !recording.dependencies.contains_key(name)
+            {
+                recording
+                    .dependencies
+                    .insert(name.to_owned(), definition.to_owned());
+            }
+        }
+        definition
+    }
+
+    pub fn is_defined(&mut self, name: &str) -> bool {
+        self.lookup(name).is_some()
+    }
+
+    /// Get a macro's definition without recording it as a dependency
+    pub fn peek(&self, name: &str) -> Option<&Arc<Macro>> {
+        self.macros.get(name)
+    }
+
+    /// Define or undefine a macro
+    pub fn set(&mut self, name: String, definition: Option<Arc<Macro>>) {
+        for recording in &mut self.recordings {
+            recording.changed_macros.insert(name.to_owned());
+        }
+        match definition {
+            Some(definition) => self.macros.insert(name, definition),
+            None => self.macros.remove(&name),
+        };
+    }
+
+    pub fn start_recording(&mut self) {
+        self.recordings.push(MacroRecording::default());
+    }
+
+    pub fn finish_recording(&mut self) -> MacroRecording {
+        self.recordings.pop().unwrap()
+    }
+
+    /// Fully macro-expand a list of tokens, using Prosser's algorithm: each token carries
+    /// the set of macros it was expanded from, and those macros aren't expanded again when
+    /// the token is rescanned.
+    pub fn expand(&mut self, tokens: Vec<PpToken>) -> Result<Vec<PpToken>, PreprocessorError> {
+        let mut input: VecDeque<PpToken> = tokens.into();
+        let mut output = Vec::with_capacity(input.len());
+        while let Some(token) = input.pop_front() {
+            if token.kind != PpTokenKind::Identifier || token.is_hidden(&token.text) {
+                output.push(token);
+                continue;
+            }
+            let definition = match self.lookup(&token.text) {
+                None => {
+                    output.push(token);
+                    continue;
+                }
+                Some(definition) => definition,
+            };
+            let expansion = match definition.as_ref() {
+                Macro::Object { body } => {
+                    let hide_set = add_to_hide_set(token.hide_set.as_deref(), &token.text);
+                    with_hide_set(body.to_owned(), &hide_set)
+                }
+                Macro::Function {
+                    params,
+                    is_variadic,
+                    body,
+                } => {
+                    // a function-like macro's name is only an invocation if it's followed by
+                    // arguments
+                    let bracket_index = input.iter().position(|t| !t.is_whitespace());
+                    match bracket_index {
+                        Some(index) if input[index].is_punctuator("(") => {
+                            input.drain(..=index);
+                        }
+                        _ => {
+                            output.push(token);
+                            continue;
+                        }
+                    }
+                    let (args, closing_bracket) = collect_args(&mut input, &token.text)?;
+                    let args = match_args_to_params(args, params, *is_variadic, &token.text)?;
+                    let hide_set = intersect_hide_sets(
+                        token.hide_set.as_deref(),
+                        closing_bracket.hide_set.as_deref(),
+                    );
+                    let hide_set = add_to_hide_set(Some(&hide_set), &token.text);
+                    let substituted = self.substitute(body, params, *is_variadic, &args)?;
+                    with_hide_set(substituted, &hide_set)
+                }
+            };
+            // rescan the expansion along with the rest of the input
+            for token in expansion.into_iter().rev() {
+                input.push_front(token);
+            }
+        }
+        Ok(output)
+    }
+
+    /// Replace the params in a function-like macro's body with the args
+    fn substitute(
+        &mut self,
+        body: &[PpToken],
+        params: &[String],
+        is_variadic: bool,
+        args: &[Vec<PpToken>],
+    ) -> Result<Vec<PpToken>, PreprocessorError> {
+        let param_index = |token: &PpToken| {
+            if token.kind != PpTokenKind::Identifier {
+                return None;
+            }
+            if is_variadic && token.text == "__VA_ARGS__" {
+                return Some(params.len());
+            }
+            params.iter().position(|param| *param == token.text)
+        };
+
+        let mut output: Vec<PpToken> = Vec::new();
+        let mut i = 0;
+        while i < body.len() {
+            let token = &body[i];
+            let next_index = skip_whitespace(body, i + 1);
+
+            if token.is_punctuator("#") {
+                if let Some(param) = body.get(next_index).and_then(param_index) {
+                    output.push(stringify(&args[param]));
+                    i = next_index + 1;
+                    continue;
+                }
+            }
+
+            if token.is_punctuator("##") && next_index < body.len() {
+                let right: Vec<PpToken> = match param_index(&body[next_index]) {
+                    Some(param) => args[param].to_owned(),
+                    None => vec![body[next_index].to_owned()],
+                };
+                while output.last().map_or(false, |t| t.is_whitespace()) {
+                    output.pop();
+                }
+                let mut right = right.into_iter();
+                match (output.pop(), right.next()) {
+                    (Some(left), Some(first)) => output.extend(paste(&left, &first)),
+                    (left, first) => output.extend(left.into_iter().chain(first)),
+                }
+                output.extend(right);
+                i = next_index + 1;
+                continue;
+            }
+
+            if let Some(param) = param_index(token) {
+                // args next to a ## are pasted before they're expanded
+                let is_pasted = body
+                    .get(next_index)
+                    .map_or(false, |t| t.is_punctuator("##"));
+                if is_pasted {
+                    output.extend(args[param].iter().cloned());
+                } else {
+                    output.extend(self.expand(args[param].to_owned())?);
+                }
+                i += 1;
+                continue;
+            }
+
+            output.push(token.to_owned());
+            i += 1;
+        }
+        Ok(output)
+    }
+}
+
+/// Collect the args of a macro invocation, after the opening bracket. Returns the args,
+/// split at the top-level commas, and the closing bracket.
+fn collect_args(
+    input: &mut VecDeque<PpToken>,
+    macro_name: &str,
+) -> Result<(Vec<Vec<PpToken>>, PpToken), PreprocessorError> {
+    let mut args = vec![Vec::new()];
+    let mut depth = 0;
+    while let Some(token) = input.pop_front() {
+        if token.is_punctuator(")") && depth == 0 {
+            let args = args.into_iter().map(|arg| trim_whitespace(arg)).collect();
+            return Ok((args, token));
+        }
+        if token.is_punctuator("(") {
+            depth += 1;
+        } else if token.is_punctuator(")") {
+            depth -= 1;
+        } else if token.is_punctuator(",") && depth == 0 {
+            args.push(Vec::new());
+            continue;
+        }
+        args.last_mut().unwrap().push(token);
+    }
+    Err(PreprocessorError::InvalidMacroInvocation(
+        macro_name.to_owned(),
+    ))
+}
+
+fn match_args_to_params(
+    mut args: Vec<Vec<PpToken>>,
+    params: &[String],
+    is_variadic: bool,
+    macro_name: &str,
+) -> Result<Vec<Vec<PpToken>>, PreprocessorError> {
+    // F() passes one empty arg, which is no args if F has no params
+    if params.is_empty() && args.len() == 1 && args[0].is_empty() {
+        args.clear();
+    }
+    if is_variadic && args.len() > params.len() {
+        // the variadic args are passed as one arg, with the commas between them
+        let variadic_args = args.split_off(params.len());
+        let mut joined = Vec::new();
+        for (i, arg) in variadic_args.into_iter().enumerate() {
+            if i > 0 {
+                joined.push(PpToken::new(PpTokenKind::Punctuator, ",".to_owned()));
+            }
+            joined.extend(arg);
+        }
+        args.push(joined);
+    } else if is_variadic && args.len() == params.len() {
+        args.push(Vec::new());
+    }
+    let expected_args = params.len() + is_variadic as usize;
+    if args.len() != expected_args {
+        return Err(PreprocessorError::InvalidMacroInvocation(
+            macro_name.to_owned(),
+        ));
+    }
+    Ok(args)
+}
+
+fn trim_whitespace(mut tokens: Vec<PpToken>) -> Vec<PpToken> {
+    while tokens.last().map_or(false, |t| t.is_whitespace()) {
+        tokens.pop();
+    }
+    let start = skip_whitespace(&tokens, 0);
+    tokens.drain(..start);
+    tokens
+}
+
+/// Make a string literal from an arg, for the # operator
+fn stringify(arg: &[PpToken]) -> PpToken {
+    let mut text = String::from("\"");
+    for token in arg {
+        match token.kind {
+            PpTokenKind::Whitespace | PpTokenKind::Newline => {
+                if !text.ends_with(' ') {
+                    text.push(' ');
+                }
+            }
+            PpTokenKind::StringLiteral | PpTokenKind::CharLiteral => {
+                for c in token.text.chars() {
+                    if c == '"' || c == '\\' {
+                        text.push('\\');
+                    }
+                    text.push(c);
+                }
+            }
+            _ => text.push_str(&token.text),
+        }
+    }
+    text.push('"');
+    PpToken::new(PpTokenKind::StringLiteral, text)
+}
+
+/// Join two tokens into one, for the ## operator
+fn paste(left: &PpToken, right: &PpToken) -> Vec<PpToken> {
+    let text = format!("{}{}", left.text, right.text);
+    let mut tokens = tokenise_line(&text);
+    for token in &mut tokens {
+        token.hide_set = left.hide_set.to_owned();
+    }
+    tokens
+}
+
+fn add_to_hide_set(hide_set: Option<&Vec<String>>, macro_name: &str) -> Vec<String> {
+    let mut hide_set = hide_set.cloned().unwrap_or_default();
+    if !hide_set.iter().any(|name| name == macro_name) {
+        hide_set.push(macro_name.to_owned());
+    }
+    hide_set
+}
+
+fn intersect_hide_sets(left: Option<&Vec<String>>, right: Option<&Vec<String>>) -> Vec<String> {
+    match (left, right) {
+        (Some(left), Some(right)) => left
+            .iter()
+            .filter(|name| right.contains(name))
+            .cloned()
+            .collect(),
+        _ => Vec::new(),
+    }
+}
+
+/// Add the hide set to each of the tokens
+fn with_hide_set(mut tokens: Vec<PpToken>, hide_set: &[String]) -> Vec<PpToken> {
+    // tokens from the macro body don't have hide sets yet, so they can all share one
+    let shared = Arc::new(hide_set.to_vec());
+    for token in &mut tokens {
+        token.hide_set = Some(match &token.hide_set {
+            None => Arc::clone(&shared),
+            Some(existing) => {
+                let mut merged = existing.as_ref().to_owned();
+                for name in hide_set {
+                    if !merged.contains(name) {
+                        merged.push(name.to_owned());
+                    }
+                }
+                Arc::new(merged)
+            }
+        });
+    }
+    tokens
+}
@@ -0,0 +1,186 @@
+use std::sync::Arc;
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum PpTokenKind {
+    Identifier,
+    Number,
+    StringLiteral,
+    CharLiteral,
+    Punctuator,
+    Whitespace,
+    Newline,
+}
+
+/// A preprocessing token
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct PpToken {
+    pub kind: PpTokenKind,
+    pub text: String,
+    /// The macros that this token came from the expansion of, which mustn't be expanded
+    /// again when the token is rescanned
+    pub hide_set: Option<Arc<Vec<String>>>,
+}
+
+impl PpToken {
+    pub fn new(kind: PpTokenKind, text: String) -> Self {
+        PpToken {
+            kind,
+            text,
+            hide_set: None,
+        }
+    }
+
+    pub fn is_whitespace(&self) -> bool {
+        matches!(self.kind, PpTokenKind::Whitespace | PpTokenKind::Newline)
+    }
+
+    pub fn is_punctuator(&self, punctuator: &str) -> bool {
+        self.kind == PpTokenKind::Punctuator && self.text == punctuator
+    }
+
+    pub fn is_hidden(&self, macro_name: &str) -> bool {
+        match &self.hide_set {
+            None => false,
+            Some(hide_set) => hide_set.iter().any(|name| name == macro_name),
+        }
+    }
+}
+
+/// Punctuators longer than one character, longest first so the first match is the longest
+const MULTI_CHAR_PUNCTUATORS: [&str; 23] = [
+    ">>=", "<<=", "...", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||", "*=",
+    "/=", "%=", "+=", "-=", "&=", "^=", "|=", "##",
+];
+
+/// Joins lines ending in a backslash onto the next line, and replaces each comment with a
+/// single space. Comment markers inside string and char literals are left alone.
+pub fn splice_lines_and_remove_comments(source: &str) -> String {
+    let source = source.replace("\\\r\n", "").replace("\\\n", "");
+    let chars: Vec<char> = source.chars().collect();
+    let mut output = String::with_capacity(source.len());
+    let mut i = 0;
+    while i < chars.len() {
+        match chars[i] {
+            quote @ ('"' | '\'') => {
+                let end = find_end_of_literal(&chars, i, quote);
+                output.extend(&chars[i..end]);
+                i = end;
+            }
+            '/' if chars.get(i + 1) == Some(&'/') => {
+                // the newline at the end of the comment is kept
+                while i < chars.len() && chars[i] != '\n' {
+                    i += 1;
+                }
+                output.push(' ');
+            }
+            '/' if chars.get(i + 1) == Some(&'*') => {
+                i += 2;
+                while i < chars.len() && !(chars[i] == '*' && chars.get(i + 1) == Some(&'/')) {
+                    i += 1;
+                }
+                i += 2;
+                output.push(' ');
+            }
+            c => {
+                output.push(c);
+                i += 1;
+            }
+        }
+    }
+    output
+}
+
+/// Returns the index after the closing quote of the literal starting at start. An
+/// unterminated literal ends at the end of the line.
+fn find_end_of_literal(chars: &[char], start: usize, quote: char) -> usize {
+    let mut i = start + 1;
+    while i < chars.len() {
+        match chars[i] {
+            '\\' => i += 2,
+            '\n' => return i,
+            c if c == quote => return i + 1,
+            _ => i += 1,
+        }
+    }
+    chars.len()
+}
+
+/// Splits a line of source into preprocessing tokens. Runs of whitespace become a single
+/// whitespace token.
+pub fn tokenise_line(line: &str) -> Vec<PpToken> {
+    let chars: Vec<char> = line.chars().collect();
+    let mut tokens = Vec::new();
+    let mut i = 0;
+    while i < chars.len() {
+        let c = chars[i];
+        let start = i;
+        let kind = if c == '\n' {
+            i += 1;
+            PpTokenKind::Newline
+        } else if c.is_whitespace() {
+            while i < chars.len() && chars[i].is_whitespace() && chars[i] != '\n' {
+                i += 1;
+            }
+            tokens.push(PpToken::new(PpTokenKind::Whitespace, " ".to_owned()));
+            continue;
+        } else if is_identifier_start(c) {
+            while i < chars.len() && is_identifier_char(chars[i]) {
+                i += 1;
+            }
+            PpTokenKind::Identifier
+        } else if c.is_ascii_digit()
+            || (c == '.' && chars.get(i + 1).map_or(false, |c| c.is_ascii_digit()))
+        {
+            i += 1;
+            while i < chars.len() {
+                match chars[i] {
+                    // exponents can have a sign
+                    '+' | '-' if matches!(chars[i - 1], 'e' | 'E' | 'p' | 'P') => i += 1,
+                    c if is_identifier_char(c) || c == '.' => i += 1,
+                    _ => break,
+                }
+            }
+            PpTokenKind::Number
+        } else if c == '"' {
+            i = find_end_of_literal(&chars, i, '"');
+            PpTokenKind::StringLiteral
+        } else if c == '\'' {
+            i = find_end_of_literal(&chars, i, '\'');
+            PpTokenKind::CharLiteral
+        } else {
+            let rest: String = chars[i..chars.len().min(i + 3)].iter().collect();
+            let length = MULTI_CHAR_PUNCTUATORS
+                .iter()
+                .find(|punctuator| rest.starts_with(*punctuator))
+                .map_or(1, |punctuator| punctuator.len());
+            i += length;
+            PpTokenKind::Punctuator
+        };
+        tokens.push(PpToken::new(kind, chars[start..i].iter().collect()));
+    }
+    tokens
+}
+
+pub fn is_identifier_start(c: char) -> bool {
+    c.is_ascii_alphabetic() || c == '_'
+}
+
+pub fn is_identifier_char(c: char) -> bool {
+    c.is_ascii_alphanumeric() || c == '_'
+}
+
+/// Whether a space is needed between two tokens written next to each other, so they
+/// aren't read back as a different token
+pub fn needs_separating_space(previous: char, next: char) -> bool {
+    let mut joined = String::with_capacity(2);
+    joined.push(previous);
+    joined.push(next);
+    (is_identifier_char(previous) && is_identifier_char(next))
+        || (previous.is_ascii_digit() && next == '.')
+        || (previous == '.' && next.is_ascii_digit())
+        || joined == "//"
+        || joined == "/*"
+        || MULTI_CHAR_PUNCTUATORS
+            .iter()
+            .any(|punctuator| punctuator.starts_with(&joined))
+}
@@ -1,3 +1,5 @@
 pub mod enabled_optimisations;
 pub mod enabled_profiling;
+pub mod memory_limits;
+pub mod profile_data;
 pub mod program_constants;
@@ -3,16 +3,48 @@ use crate::CliConfig;
 #[derive(Debug)]
 pub struct EnabledOptimisations {
     tail_call: bool,
+    return_call: bool,
     unreachable_procedure: bool,
     stack_allocation: bool,
+    linear_scan_allocation: bool,
+    local_promotion: bool,
+    global_stack_ptrs: bool,
+    native_calls: bool,
+    br_table: bool,
+    dispatch_br_table: bool,
+    label_elimination: bool,
+    bulk_memory: bool,
+    simd: bool,
+    scalar_optimisation: bool,
+    cfg_simplification: bool,
+    compile_time_evaluation: bool,
+    loop_optimisation: bool,
+    function_inlining: bool,
+    peephole: bool,
 }
 
 impl EnabledOptimisations {
     fn defaults() -> Self {
         EnabledOptimisations {
             tail_call: true,
+            return_call: true,
             unreachable_procedure: true,
             stack_allocation: true,
+            linear_scan_allocation: false,
+            local_promotion: true,
+            global_stack_ptrs: true,
+            native_calls: true,
+            br_table: true,
+            dispatch_br_table: true,
+            label_elimination: true,
+            bulk_memory: true,
+            simd: true,
+            scalar_optimisation: true,
+            cfg_simplification: true,
+            compile_time_evaluation: true,
+            loop_optimisation: true,
+            function_inlining: true,
+            peephole: true,
         }
     }
 
@@ -26,6 +58,12 @@ impl EnabledOptimisations {
             enabled_optimisations.tail_call = false;
         }
 
+        if cli_config.opt_return_call {
+            enabled_optimisations.return_call = true;
+        } else if cli_config.noopt_return_call {
+            enabled_optimisations.return_call = false;
+        }
+
         if cli_config.opt_unreachable_procedure {
             enabled_optimisations.unreachable_procedure = true;
         } else if cli_config.noopt_unreachable_procedure {
@@ -38,6 +76,96 @@ impl EnabledOptimisations {
             enabled_optimisations.stack_allocation = false;
         }
 
+        if cli_config.opt_linear_scan_allocation {
+            enabled_optimisations.linear_scan_allocation = true;
+        } else if cli_config.noopt_linear_scan_allocation {
+            enabled_optimisations.linear_scan_allocation = false;
+        }
+
+        if cli_config.opt_local_promotion {
+            enabled_optimisations.local_promotion = true;
+        } else if cli_config.noopt_local_promotion {
+            enabled_optimisations.local_promotion = false;
+        }
+
+        if cli_config.opt_global_stack_ptrs {
+            enabled_optimisations.global_stack_ptrs = true;
+        } else if cli_config.noopt_global_stack_ptrs {
+            enabled_optimisations.global_stack_ptrs = false;
+        }
+
+        if cli_config.opt_native_calls {
+            enabled_optimisations.native_calls = true;
+        } else if cli_config.noopt_native_calls {
+            enabled_optimisations.native_calls = false;
+        }
+
+        if cli_config.opt_br_table {
+            enabled_optimisations.br_table = true;
+        } else if cli_config.noopt_br_table {
+            enabled_optimisations.br_table = false;
+        }
+
+        if cli_config.opt_dispatch_br_table {
+            enabled_optimisations.dispatch_br_table = true;
+        } else if cli_config.noopt_dispatch_br_table {
+            enabled_optimisations.dispatch_br_table = false;
+        }
+
+        if cli_config.opt_label_elimination {
+            enabled_optimisations.label_elimination = true;
+        } else if cli_config.noopt_label_elimination {
+            enabled_optimisations.label_elimination = false;
+        }
+
+        if cli_config.opt_bulk_memory {
+            enabled_optimisations.bulk_memory = true;
+        } else if cli_config.noopt_bulk_memory {
+            enabled_optimisations.bulk_memory = false;
+        }
+
+        if cli_config.opt_simd {
+            enabled_optimisations.simd = true;
+        } else if cli_config.noopt_simd {
+            enabled_optimisations.simd = false;
+        }
+
+        if cli_config.opt_scalar {
+            enabled_optimisations.scalar_optimisation = true;
+        } else if cli_config.noopt_scalar {
+            enabled_optimisations.scalar_optimisation = false;
+        }
+
+        if cli_config.opt_cfg_simplification {
+            enabled_optimisations.cfg_simplification = true;
+        } else if cli_config.noopt_cfg_simplification {
+            enabled_optimisations.cfg_simplification = false;
+        }
+
+        if cli_config.opt_compile_time_eval {
+            enabled_optimisations.compile_time_evaluation = true;
+        } else if cli_config.noopt_compile_time_eval {
+            enabled_optimisations.compile_time_evaluation = false;
+        }
+
+        if cli_config.opt_loop {
+            enabled_optimisations.loop_optimisation = true;
+        } else if cli_config.noopt_loop {
+            enabled_optimisations.loop_optimisation = false;
+        }
+
+        if cli_config.opt_inline {
+            enabled_optimisations.function_inlining = true;
+        } else if cli_config.noopt_inline {
+            enabled_optimisations.function_inlining = false;
+        }
+
+        if cli_config.opt_peephole {
+            enabled_optimisations.peephole = true;
+        } else if cli_config.noopt_peephole {
+            enabled_optimisations.peephole = false;
+        }
+
         enabled_optimisations
     }
 
@@ -45,6 +173,10 @@ impl EnabledOptimisations {
         self.tail_call
     }
 
+    pub fn is_return_call_enabled(&self) -> bool {
+        self.return_call
+    }
+
     pub fn is_unreachable_procedure_elimination_enabled(&self) -> bool {
         self.unreachable_procedure
     }
@@ -52,4 +184,64 @@ impl EnabledOptimisations {
     pub fn is_stack_allocation_optimisation_enabled(&self) -> bool {
         self.stack_allocation
     }
+
+    pub fn is_linear_scan_allocation_enabled(&self) -> bool {
+        self.linear_scan_allocation
+    }
+
+    pub fn is_local_promotion_enabled(&self) -> bool {
+        self.local_promotion
+    }
+
+    pub fn is_global_stack_ptrs_enabled(&self) -> bool {
+        self.global_stack_ptrs
+    }
+
+    pub fn is_native_calls_enabled(&self) -> bool {
+        self.native_calls
+    }
+
+    pub fn is_br_table_enabled(&self) -> bool {
+        self.br_table
+    }
+
+    pub fn is_dispatch_br_table_enabled(&self) -> bool {
+        self.dispatch_br_table
+    }
+
+    pub fn is_label_elimination_enabled(&self) -> bool {
+        self.label_elimination
+    }
+
+    pub fn is_bulk_memory_enabled(&self) -> bool {
+        self.bulk_memory
+    }
+
+    pub fn is_simd_enabled(&self) -> bool {
+        self.simd
+    }
+
+    pub fn is_scalar_optimisation_enabled(&self) -> bool {
+        self.scalar_optimisation
+    }
+
+    pub fn is_cfg_simplification_enabled(&self) -> bool {
+        self.cfg_simplification
+    }
+
+    pub fn is_compile_time_evaluation_enabled(&self) -> bool {
+        self.compile_time_evaluation
+    }
+
+    pub fn is_loop_optimisation_enabled(&self) -> bool {
+        self.loop_optimisation
+    }
+
+    pub fn is_function_inlining_enabled(&self) -> bool {
+        self.function_inlining
+    }
+
+    pub fn is_peephole_optimisation_enabled(&self) -> bool {
+        self.peephole
+    }
 }
@@ -3,12 +3,18 @@ use crate::CliConfig;
 #[derive(Debug)]
 pub struct EnabledProfiling {
     stack_ptr_logging: bool,
+    call_counting: bool,
+    call_timing: bool,
+    block_counting: bool,
 }
 
 impl EnabledProfiling {
     fn defaults() -> Self {
         EnabledProfiling {
             stack_ptr_logging: false,
+            call_counting: false,
+            call_timing: false,
+            block_counting: false,
         }
     }
 
@@ -22,10 +28,44 @@ impl EnabledProfiling {
             enabled_profiling.stack_ptr_logging = false;
         }
 
+        if cli_config.prof_calls {
+            enabled_profiling.call_counting = true;
+        } else if cli_config.noprof_calls {
+            enabled_profiling.call_counting = false;
+        }
+
+        if cli_config.prof_call_times {
+            enabled_profiling.call_timing = true;
+        } else if cli_config.noprof_call_times {
+            enabled_profiling.call_timing = false;
+        }
+        if cli_config.prof_blocks {
+            enabled_profiling.block_counting = true;
+        } else if cli_config.noprof_blocks {
+            enabled_profiling.block_counting = false;
+        }
+
+        // calls have to be counted to be timed
+        if enabled_profiling.call_timing {
+            enabled_profiling.call_counting = true;
+        }
+
         enabled_profiling
     }
 
     pub fn is_stack_ptr_logging_enabled(&self) -> bool {
         self.stack_ptr_logging
     }
+
+    pub fn is_call_counting_enabled(&self) -> bool {
+        self.call_counting
+    }
+
+    pub fn is_call_timing_enabled(&self) -> bool {
+        self.call_timing
+    }
+
+    pub fn is_block_counting_enabled(&self) -> bool {
+        self.block_counting
+    }
 }
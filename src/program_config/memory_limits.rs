@@ -0,0 +1,104 @@
+#[cfg(test)]
+#[path = "memory_limits_tests.rs"]
+mod memory_limits_tests;
+
+use crate::CliConfig;
+
+/// The most pages a 32-bit wasm memory can have, which is 4 GiB
+const MAX_WASM32_MEMORY_PAGES: u32 = 65536;
+
+/// The size limits of the program's memory, in 64 KiB wasm pages. The memory starts with
+/// enough pages for the static data and the stack size the compiler estimates, or more with
+/// --initial-memory, and grows as the stack and heap need it, up to --max-memory.
+///
+/// With --threads, the memory is shared between the threads, and has room for a stack for
+/// each of them.
+#[derive(Debug)]
+pub struct MemoryLimits {
+    min_initial_pages: u32,
+    max_pages: Option<u32>,
+    /// The number of threads besides the main thread, if the memory is shared
+    thread_count: Option<u32>,
+}
+
+impl MemoryLimits {
+    fn defaults() -> Self {
+        MemoryLimits {
+            min_initial_pages: 1,
+            max_pages: None,
+            thread_count: None,
+        }
+    }
+
+    pub fn construct(cli_config: &CliConfig) -> Result<Self, String> {
+        let mut memory_limits = MemoryLimits::defaults();
+
+        if let Some(initial_memory) = cli_config.initial_memory {
+            if initial_memory > MAX_WASM32_MEMORY_PAGES {
+                return Err(format!(
+                    "--initial-memory can be at most {MAX_WASM32_MEMORY_PAGES} pages"
+                ));
+            }
+            memory_limits.min_initial_pages = initial_memory.max(1);
+        }
+        if let Some(max_memory) = cli_config.max_memory {
+            if max_memory > MAX_WASM32_MEMORY_PAGES {
+                return Err(format!(
+                    "--max-memory can be at most {MAX_WASM32_MEMORY_PAGES} pages"
+                ));
+            }
+            if max_memory < memory_limits.min_initial_pages {
+                return Err("--max-memory can't be less than --initial-memory".to_owned());
+            }
+            memory_limits.max_pages = Some(max_memory);
+        }
+
+        if let Some(threads) = cli_config.threads {
+            // each thread keeps its own stack ptrs in its instance's globals
+            if cli_config.noopt_global_stack_ptrs {
+                return Err("--threads can't be used with --noopt-global-stack-ptrs".to_owned());
+            }
+            // the profilers keep their buffers and counters for a single thread
+            if cli_config.prof_stack
+                || cli_config.prof_calls
+                || cli_config.prof_call_times
+                || cli_config.prof_blocks
+            {
+                return Err("--threads can't be used with profiling".to_owned());
+            }
+            memory_limits.thread_count = Some(threads);
+        }
+
+        Ok(memory_limits)
+    }
+
+    /// The number of pages the memory starts with, given how many the program is estimated
+    /// to need. This is never more than the maximum, in which case the program has to fit
+    /// in less memory than estimated.
+    pub fn initial_pages(&self, required_pages: u32) -> u32 {
+        let initial_pages = required_pages.max(self.min_initial_pages);
+        match self.max_pages {
+            Some(max_pages) => initial_pages.min(max_pages),
+            None => initial_pages.min(MAX_WASM32_MEMORY_PAGES),
+        }
+    }
+
+    /// Shared memory must have a maximum, so it's as much as a 32-bit memory can have if
+    /// --max-memory isn't given
+    pub fn max_pages(&self) -> Option<u32> {
+        match (self.max_pages, self.thread_count) {
+            (None, Some(_)) => Some(MAX_WASM32_MEMORY_PAGES),
+            (max_pages, _) => max_pages,
+        }
+    }
+
+    pub fn is_shared(&self) -> bool {
+        self.thread_count.is_some()
+    }
+
+    /// The number of threads that can run at once besides the main thread, which each need
+    /// a stack
+    pub fn thread_count(&self) -> u32 {
+        self.thread_count.unwrap_or(0)
+    }
+}
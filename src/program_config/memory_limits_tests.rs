@@ -0,0 +1,56 @@
+#[cfg(test)]
+mod memory_limits_tests {
+    use clap::Parser as ClapParser;
+
+    use super::super::MemoryLimits;
+    use crate::CliConfig;
+
+    fn construct(flags: &[&str]) -> Result<MemoryLimits, String> {
+        let args = ["c_to_wasm_compiler", "test.c"].iter().chain(flags);
+        MemoryLimits::construct(&CliConfig::parse_from(args))
+    }
+
+    #[test]
+    fn starts_with_the_estimated_pages_within_the_limits() {
+        let memory_limits = construct(&[]).unwrap();
+        assert_eq!(memory_limits.initial_pages(0), 1);
+        assert_eq!(memory_limits.initial_pages(5), 5);
+        assert_eq!(memory_limits.max_pages(), None);
+
+        let memory_limits = construct(&["--initial-memory", "4", "--max-memory", "16"]).unwrap();
+        assert_eq!(memory_limits.initial_pages(2), 4);
+        assert_eq!(memory_limits.initial_pages(10), 10);
+        assert_eq!(memory_limits.initial_pages(20), 16);
+        assert_eq!(memory_limits.max_pages(), Some(16));
+    }
+
+    #[test]
+    fn rejects_invalid_limits() {
+        assert!(construct(&["--initial-memory", "8", "--max-memory", "4"]).is_err());
+        assert!(construct(&["--initial-memory", "65537"]).is_err());
+        assert!(construct(&["--max-memory", "65537"]).is_err());
+        assert!(construct(&["--max-memory", "65536"]).is_ok());
+    }
+
+    #[test]
+    fn shares_memory_with_a_maximum_for_threads() {
+        let memory_limits = construct(&[]).unwrap();
+        assert!(!memory_limits.is_shared());
+        assert_eq!(memory_limits.thread_count(), 0);
+
+        let memory_limits = construct(&["--threads", "4"]).unwrap();
+        assert!(memory_limits.is_shared());
+        assert_eq!(memory_limits.thread_count(), 4);
+        assert_eq!(memory_limits.max_pages(), Some(65536));
+
+        let memory_limits = construct(&["--threads", "4", "--max-memory", "64"]).unwrap();
+        assert_eq!(memory_limits.max_pages(), Some(64));
+    }
+
+    #[test]
+    fn rejects_threads_with_stack_ptrs_in_memory_or_profiling() {
+        assert!(construct(&["--threads", "2", "--noopt-global-stack-ptrs"]).is_err());
+        assert!(construct(&["--threads", "2", "--prof-calls"]).is_err());
+        assert!(construct(&["--threads", "2", "--opt-global-stack-ptrs"]).is_ok());
+    }
+}
@@ -0,0 +1,117 @@
+#[cfg(test)]
+#[path = "profile_data_tests.rs"]
+mod profile_data_tests;
+
+use std::collections::BTreeMap;
+use std::error::Error;
+use std::fmt;
+use std::fmt::Formatter;
+use std::fs;
+use std::io;
+use std::path::Path;
+
+/// Execution counts from running a build compiled with --prof-blocks and/or --prof-calls,
+/// which the runtime writes to `logs/<file>.<timestamp>.profdata`. A later compile reads
+/// them back with --pgo, to optimise for the paths that are actually hot.
+///
+/// Everything is identified by something that stays the same from one compile to the next:
+/// functions by their name, and labels by their position in the function once the relooper
+/// has renumbered them. The file is text, one count per line:
+///
+///   call <caller> <callee> <count>
+///   blocks <function> <count of label 0> <count of label 1> ...
+///
+/// Counts for the same thing on several lines are added together, so the profiles of several
+/// runs can be concatenated into one file.
+#[derive(Debug, Clone, Default)]
+pub struct ProfileData {
+    call_counts: BTreeMap<(String, String), u64>,
+    block_counts: BTreeMap<String, Vec<u64>>,
+}
+
+impl ProfileData {
+    pub fn read(path: &Path) -> Result<Self, ProfileDataError> {
+        let text = fs::read_to_string(path).map_err(ProfileDataError::Io)?;
+        Self::parse(&text)
+    }
+
+    pub fn parse(text: &str) -> Result<Self, ProfileDataError> {
+        let mut profile = ProfileData::default();
+        for (line_i, line) in text.lines().enumerate() {
+            let invalid_line = || ProfileDataError::InvalidLine(line_i + 1, line.to_owned());
+            let parse_count = |count: &str| count.parse::<u64>().map_err(|_| invalid_line());
+
+            let fields: Vec<&str> = line.split_whitespace().collect();
+            match fields.as_slice() {
+                [] => {}
+                [comment, ..] if comment.starts_with('#') => {}
+                ["call", caller, callee, count] => {
+                    *profile
+                        .call_counts
+                        .entry((caller.to_string(), callee.to_string()))
+                        .or_default() += parse_count(count)?;
+                }
+                ["blocks", function, counts @ ..] => {
+                    let counts = counts
+                        .iter()
+                        .map(|count| parse_count(count))
+                        .collect::<Result<Vec<_>, _>>()?;
+                    match profile.block_counts.get_mut(*function) {
+                        None => {
+                            profile.block_counts.insert(function.to_string(), counts);
+                        }
+                        Some(existing_counts) if existing_counts.len() == counts.len() => {
+                            for (existing_count, count) in existing_counts.iter_mut().zip(counts) {
+                                *existing_count += count;
+                            }
+                        }
+                        // the runs were of different builds of the function
+                        Some(_) => return Err(invalid_line()),
+                    }
+                }
+                _ => return Err(invalid_line()),
+            }
+        }
+        Ok(profile)
+    }
+
+    pub fn has_call_counts(&self) -> bool {
+        !self.call_counts.is_empty()
+    }
+
+    /// How many times the caller called the callee, or None if the profile doesn't have
+    /// that call, eg. because it was inlined in the profiled build
+    pub fn call_count(&self, caller: &str, callee: &str) -> Option<u64> {
+        self.call_counts
+            .get(&(caller.to_owned(), callee.to_owned()))
+            .copied()
+    }
+
+    pub fn total_call_count(&self) -> u64 {
+        self.call_counts.values().sum()
+    }
+
+    /// How many times each label of the function was executed, by position in the function
+    pub fn block_counts(&self, function: &str) -> Option<&Vec<u64>> {
+        self.block_counts.get(function)
+    }
+}
+
+#[derive(Debug)]
+pub enum ProfileDataError {
+    Io(io::Error),
+    InvalidLine(usize, String),
+}
+
+impl fmt::Display for ProfileDataError {
+    fn fmt(&self, f: &mut Formatter<'_>) -> fmt::Result {
+        match self {
+            ProfileDataError::Io(e) => write!(f, "Couldn't read profile data: {e}"),
+            ProfileDataError::InvalidLine(line_number, line) => {
+                write!(f, "Invalid profile data on line {line_number}: \"{line}\"")
+            }
+        }
+    }
+}
+
+impl Error for ProfileDataError {}
@@ -0,0 +1,46 @@
+#[cfg(test)]
+mod profile_data_tests {
+    use super::super::{ProfileData, ProfileDataError};
+
+    #[test]
+    fn adds_up_counts_from_several_runs() {
+        let profile = ProfileData::parse(
+            "# first run\n\
+             call <global> main 1\n\
+             call main fib 1\n\
+             blocks fib 3 2 1\n\
+             \n\
+             # second run\n\
+             call main fib 1\n\
+             call fib fib 20\n\
+             blocks fib 4 0 1\n",
+        )
+        .unwrap();
+
+        assert_eq!(profile.call_count("main", "fib"), Some(2));
+        assert_eq!(profile.call_count("fib", "fib"), Some(20));
+        assert_eq!(profile.call_count("fib", "main"), None);
+        assert_eq!(profile.total_call_count(), 23);
+        assert_eq!(profile.block_counts("fib"), Some(&vec![7, 2, 2]));
+        assert_eq!(profile.block_counts("main"), None);
+    }
+
+    #[test]
+    fn rejects_invalid_lines() {
+        for text in [
+            "call main fib\n",
+            "call main fib -1\n",
+            "blocks fib 1 x\n",
+            "blocks fib 1 2\nblocks fib 1\n",
+            "edge main fib 1\n",
+        ] {
+            assert!(
+                matches!(
+                    ProfileData::parse(text),
+                    Err(ProfileDataError::InvalidLine(..))
+                ),
+                "{text:?} should be invalid"
+            );
+        }
+    }
+}
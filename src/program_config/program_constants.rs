@@ -4,6 +4,9 @@ pub const MAIN_FUNCTION_SOURCE_NAME: &str = "main";
 /// runtime will call to run the program. Must match the name of the function called
 /// in `runtime/run.mjs`
 pub const MAIN_FUNCTION_EXPORT_NAME: &str = "main";
+/// The name given to the function for the global instructions in the Wasm module's name
+/// section. It's exported as `main`, but that would be confused with the C `main` function.
+pub const GLOBAL_INSTRS_FUNCTION_NAME: &str = "_start";
 
 /// The module name of the memory import to the Wasm module. Must match the corresponding
 // /// import in `runtime/run.mjs`.
@@ -12,17 +15,84 @@ pub const MEMORY_IMPORT_MODULE_NAME: &str = "runtime";
 /// import in `runtime/run.mjs`.
 pub const MEMORY_IMPORT_FIELD_NAME: &str = "memory";
 
-pub const LOG_STACK_PTR_IMPORT_NAME: &str = "log_stack_ptr";
+/// The name of the custom section holding the initial and maximum number of pages of memory,
+/// which the JS runtime creates the memory with. Must match the name read in
+/// `runtime/init_memory.mjs`.
+pub const MEMORY_LIMITS_SECTION_NAME: &str = "memory_limits";
+
+/// The export names of the frame pointer and stack pointer globals, when they're kept
+/// in wasm globals rather than in memory. Must match the names read in
+/// `runtime/memory_operations.mjs`.
+pub const FRAME_PTR_EXPORT_NAME: &str = "frame_ptr";
+pub const STACK_PTR_EXPORT_NAME: &str = "stack_ptr";
+
+/// The export name of the global holding the top of the heap, so the JS runtime can reset
+/// it along with the memory when it reuses an instance (see `runtime/memory_snapshot.mjs`)
+pub const HEAP_TOP_EXPORT_NAME: &str = "heap_top";
+
+/// The import that the JS runtime provides to write out the stack pointer log buffer when
+/// it's full. Must match the corresponding import in `runtime/run.mjs`.
+pub const FLUSH_STACK_PTR_LOG_IMPORT_NAME: &str = "flush_stack_ptr_log";
+/// The export names of the globals holding the start address of the stack pointer log
+/// buffer, and the address the next sample will be written to. Must match the names read
+/// in `runtime/profiler.mjs`.
+pub const STACK_PTR_LOG_START_EXPORT_NAME: &str = "stack_ptr_log_start";
+pub const STACK_PTR_LOG_NEXT_EXPORT_NAME: &str = "stack_ptr_log_next";
+
+/// The imports that the JS runtime provides to time calls, which are called just before
+/// and just after each call. Must match the corresponding imports in `runtime/run.mjs`.
+pub const CALL_PROFILE_ENTER_IMPORT_NAME: &str = "call_profile_enter";
+pub const CALL_PROFILE_EXIT_IMPORT_NAME: &str = "call_profile_exit";
+/// The export names of the globals holding the address of the call counters, and the index
+/// of the call edge being timed. Must match the names read in `runtime/profiler.mjs`.
+pub const CALL_PROFILE_COUNTS_EXPORT_NAME: &str = "call_profile_counts";
+pub const CALL_PROFILE_EDGE_EXPORT_NAME: &str = "call_profile_edge";
+/// The name of the custom section listing the caller and callee of each call counter. Must
+/// match the name read in `runtime/profiler.mjs`.
+pub const CALL_PROFILE_SECTION_NAME: &str = "call_profile";
+/// The export name of the global holding the address of the block counters, and the name of
+/// the custom section listing how many counters each function has. Must match the names read
+/// in `runtime/profiler.mjs`.
+pub const BLOCK_PROFILE_COUNTS_EXPORT_NAME: &str = "block_profile_counts";
+pub const BLOCK_PROFILE_SECTION_NAME: &str = "block_profile";
+
+/// The function declared in `headers/threads.h` that each thread runs, which is exported
+/// for the JS runtime to call. Must match the name called in `runtime/thread_worker.mjs`.
+pub const THREAD_MAIN_FUNCTION_NAME: &str = "thread_main";
+/// The imports that the JS runtime provides to start a thread and wait for it to finish.
+/// Must match the corresponding imports in `runtime/stdlib/threads.mjs`.
+pub const THREAD_CREATE_IMPORT_NAME: &str = "thread_create";
+pub const THREAD_JOIN_IMPORT_NAME: &str = "thread_join";
+/// With --threads, the export name of the global holding the address the stack can grow up
+/// to, which the JS runtime sets to the end of each thread's stack, and the name of the custom
+/// section giving where the threads' stacks are. Must match the names read in
+/// `runtime/stdlib/threads.mjs`.
+pub const STACK_LIMIT_EXPORT_NAME: &str = "stack_limit";
+pub const THREADS_SECTION_NAME: &str = "threads";
+
+/// The heap allocator functions declared in `headers/stdlib.h`, whose bodies are generated
+/// straight to wasm rather than imported from the JS runtime
+pub const MALLOC_FUNCTION_NAME: &str = "malloc";
+pub const FREE_FUNCTION_NAME: &str = "free";
+
+/// The library functions declared in `headers/string.h` whose bodies are generated as wasm
+/// kernels, using SIMD instructions if they're enabled
+pub const STRLEN_FUNCTION_NAME: &str = "strlen";
+pub const MEMCHR_FUNCTION_NAME: &str = "memchr";
+pub const MEMCPY_FUNCTION_NAME: &str = "memcpy";
+pub const MEMSET_FUNCTION_NAME: &str = "memset";
 
 /// A list of the standard library functions that I've implemented in the JavaScript
 /// runtime, that will get imported. Must match the corresponding import names in `runtime/run.mjs`.
+/// Only I/O is left to the runtime: the other library functions are defined in C in `headers/`,
+/// and compiled along with the program.
 pub fn get_imported_function_names() -> Vec<String> {
     vec![
         "printf".to_owned(),
-        "strtoul".to_owned(),
-        "strtol".to_owned(),
-        "strlen".to_owned(),
-        "strstr".to_owned(),
-        LOG_STACK_PTR_IMPORT_NAME.to_owned(),
+        FLUSH_STACK_PTR_LOG_IMPORT_NAME.to_owned(),
+        CALL_PROFILE_ENTER_IMPORT_NAME.to_owned(),
+        CALL_PROFILE_EXIT_IMPORT_NAME.to_owned(),
+        THREAD_CREATE_IMPORT_NAME.to_owned(),
+        THREAD_JOIN_IMPORT_NAME.to_owned(),
     ]
 }
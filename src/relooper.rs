@@ -1,3 +1,5 @@
 pub mod blocks;
+pub mod label_elimination;
+mod reachability;
 pub mod relooper;
 mod soupify;
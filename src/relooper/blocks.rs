@@ -5,7 +5,8 @@ use crate::fmt_indented::{FmtIndented, IndentLevel};
 use crate::id::Id;
 use crate::middle_end::ids::{InstructionId, LabelId};
 use crate::middle_end::instructions::{
-    remove_instr_from_instr_list, replace_instr_from_instr_list, Instruction,
+    for_each_instr_in_list, remove_instr_from_instr_list, replace_instr_from_instr_list,
+    Instruction,
 };
 
 /// A 'label' block. This is a list of instructions starting with a label
@@ -38,6 +39,17 @@ impl Label {
                         targets.push(label_id.to_owned());
                     }
                 }
+                Instruction::BrTable(_, _, _, arms) => {
+                    for arm in arms {
+                        for arm_instr in arm {
+                            if let Instruction::Br(_, label_id) = arm_instr {
+                                if !targets.contains(label_id) {
+                                    targets.push(label_id.to_owned());
+                                }
+                            }
+                        }
+                    }
+                }
                 _ => {}
             }
         }
@@ -193,6 +205,38 @@ impl Block {
             }
         }
     }
+
+    /// Calls f on every instruction in the block, and in the blocks nested in it and after it
+    pub fn for_each_instr(&self, f: &mut impl FnMut(&Instruction)) {
+        match self {
+            Block::Simple { internal, next } => {
+                for_each_instr_in_list(&internal.instrs, f);
+                if let Some(next) = next {
+                    next.for_each_instr(f);
+                }
+            }
+            Block::Loop { inner, next, .. } => {
+                inner.for_each_instr(f);
+                if let Some(next) = next {
+                    next.for_each_instr(f);
+                }
+            }
+            Block::Multiple {
+                pre_handled_blocks_instrs,
+                handled_blocks,
+                next,
+                ..
+            } => {
+                for_each_instr_in_list(pre_handled_blocks_instrs, f);
+                for handled in handled_blocks {
+                    handled.for_each_instr(f);
+                }
+                if let Some(next) = next {
+                    next.for_each_instr(f);
+                }
+            }
+        }
+    }
 }
 
 impl FmtIndented for Block {
@@ -298,7 +342,7 @@ impl fmt::Display for Block {
 }
 
 // loop and handled block ids, for break/continue/endHandled instrs
-#[derive(Debug, Clone, PartialEq)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
 pub struct LoopBlockId(u64);
 
 impl Id for LoopBlockId {
@@ -321,7 +365,7 @@ impl fmt::Display for LoopBlockId {
     }
 }
 
-#[derive(Debug, Clone, PartialEq)]
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
 pub struct MultipleBlockId(u64);
 
 impl Id for MultipleBlockId {
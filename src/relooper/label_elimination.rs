@@ -0,0 +1,339 @@
+#[cfg(test)]
+#[path = "label_elimination_tests.rs"]
+mod label_elimination_tests;
+
+use std::collections::HashMap;
+
+use crate::middle_end::ids::VarId;
+use crate::middle_end::instructions::{Instruction, Src};
+use crate::relooper::blocks::{Block, LoopBlockId, MultipleBlockId};
+use crate::relooper::relooper::ProgramBlocks;
+
+/// Remove the work the relooper leaves behind that the structure of the blocks makes
+/// unnecessary, in each function:
+///   - assignments to the label variable where the next block to run is always the same, so
+///     the label variable isn't read before it's assigned again. Only multiple blocks read
+///     the label variable, to dispatch to their handled blocks
+///   - breaks out of a handled block, and continues of a loop, that are the last thing in
+///     the block anyway
+///   - handled blocks that are left with nothing in them, which do the same as when none of
+///     the handled blocks match
+///   - simple blocks that always follow each other, which are merged into one
+///
+/// Removing handled blocks and merging simple blocks loses the block counts of the labels
+/// that aren't there any more, so that's only done if merge_blocks is set.
+pub fn eliminate_labels(program_blocks: &mut ProgramBlocks, merge_blocks: bool) {
+    for function in program_blocks.functions.values_mut() {
+        let label_variable = match &function.label_variable {
+            Some(label_variable) => label_variable,
+            None => continue,
+        };
+        if let Some(block) = function.block.take() {
+            function.block = Some(eliminate_labels_in_block(
+                block,
+                label_variable,
+                merge_blocks,
+            ));
+        }
+    }
+}
+
+fn eliminate_labels_in_block(
+    mut block: Block,
+    label_variable: &VarId,
+    merge_blocks: bool,
+) -> Block {
+    // removing a handled block can remove the whole multiple block, and then the label
+    // assignments before it aren't read any more
+    loop {
+        let mut context = LabelEliminationContext::new(label_variable, merge_blocks);
+        // the function returns at the end of its block, so nothing reads the label after it
+        block = context
+            .simplify_block(block, false, None)
+            .expect("the entry block of a function is never a multiple block");
+        if !context.made_changes {
+            break;
+        }
+    }
+    if merge_blocks {
+        merge_simple_blocks(&mut block);
+    }
+    block
+}
+
+/// The instruction that it's the same as to fall off the end of a block
+#[derive(Clone, PartialEq)]
+enum TailExit {
+    Continue(LoopBlockId),
+    EndHandledBlock(MultipleBlockId),
+}
+
+struct LabelEliminationContext<'a> {
+    label_variable: &'a VarId,
+    merge_blocks: bool,
+    /// Whether the label variable is read after breaking out of each loop, and after
+    /// continuing it
+    loop_break_reads_label: HashMap<LoopBlockId, bool>,
+    loop_continue_reads_label: HashMap<LoopBlockId, bool>,
+    /// Whether the label variable is read after the end of each multiple block
+    multiple_end_reads_label: HashMap<MultipleBlockId, bool>,
+    made_changes: bool,
+}
+
+impl<'a> LabelEliminationContext<'a> {
+    fn new(label_variable: &'a VarId, merge_blocks: bool) -> Self {
+        LabelEliminationContext {
+            label_variable,
+            merge_blocks,
+            loop_break_reads_label: HashMap::new(),
+            loop_continue_reads_label: HashMap::new(),
+            multiple_end_reads_label: HashMap::new(),
+            made_changes: false,
+        }
+    }
+
+    /// Simplify the block, where after_reads_label is whether the label variable is read
+    /// after control flow leaves the end of the block, and tail_exit is the instruction that
+    /// leaving the end of the block is the same as. Returns None if there's nothing left of
+    /// the block.
+    fn simplify_block(
+        &mut self,
+        block: Block,
+        after_reads_label: bool,
+        tail_exit: Option<TailExit>,
+    ) -> Option<Block> {
+        match block {
+            Block::Simple { mut internal, next } => {
+                let next = next.and_then(|next| {
+                    self.simplify_block(*next, after_reads_label, tail_exit.to_owned())
+                });
+                let next_reads_label = match &next {
+                    Some(next) => reads_label_on_entry(next),
+                    None => after_reads_label,
+                };
+                if next.is_none() {
+                    if let Some(tail_exit) = &tail_exit {
+                        if is_tail_exit(internal.instrs.last(), tail_exit) {
+                            internal.instrs.pop();
+                            self.made_changes = true;
+                        }
+                    }
+                }
+                self.remove_unread_label_assignments(&mut internal.instrs, next_reads_label);
+                Some(Block::Simple {
+                    internal,
+                    next: next.map(Box::new),
+                })
+            }
+            Block::Loop { id, inner, next } => {
+                let next = next.and_then(|next| {
+                    self.simplify_block(*next, after_reads_label, tail_exit.to_owned())
+                });
+                let break_reads_label = match &next {
+                    Some(next) => reads_label_on_entry(next),
+                    None => after_reads_label,
+                };
+                let continue_reads_label = reads_label_on_entry(&inner);
+                self.loop_break_reads_label
+                    .insert(id.to_owned(), break_reads_label);
+                self.loop_continue_reads_label
+                    .insert(id.to_owned(), continue_reads_label);
+                // the end of the loop body branches back to the start of the loop. Something
+                // always continues the loop, so there's always something left of its body
+                let inner = self
+                    .simplify_block(
+                        *inner,
+                        continue_reads_label,
+                        Some(TailExit::Continue(id.to_owned())),
+                    )
+                    .expect("a loop body always has a path back to the start of the loop");
+                Some(Block::Loop {
+                    id,
+                    inner: Box::new(inner),
+                    next: next.map(Box::new),
+                })
+            }
+            Block::Multiple {
+                id,
+                pre_handled_blocks_instrs,
+                handled_blocks,
+                next,
+            } => {
+                let next = next.and_then(|next| {
+                    self.simplify_block(*next, after_reads_label, tail_exit.to_owned())
+                });
+                let end_reads_label = match &next {
+                    Some(next) => reads_label_on_entry(next),
+                    None => after_reads_label,
+                };
+                self.multiple_end_reads_label
+                    .insert(id.to_owned(), end_reads_label);
+
+                let mut simplified_handled_blocks = Vec::new();
+                for handled_block in handled_blocks {
+                    let handled_block = self
+                        .simplify_block(
+                            handled_block,
+                            end_reads_label,
+                            Some(TailExit::EndHandledBlock(id.to_owned())),
+                        )
+                        .expect(
+                            "a handled block has a single entry, so it's never a multiple block",
+                        );
+                    // a handled block with nothing in it does the same as when none of the
+                    // handled blocks match the label
+                    if self.merge_blocks && is_empty_block(&handled_block) {
+                        self.made_changes = true;
+                        continue;
+                    }
+                    simplified_handled_blocks.push(handled_block);
+                }
+
+                if simplified_handled_blocks.is_empty() {
+                    // nothing is left to dispatch to, so go straight to the next block
+                    return next;
+                }
+                Some(Block::Multiple {
+                    id,
+                    pre_handled_blocks_instrs,
+                    handled_blocks: simplified_handled_blocks,
+                    next: next.map(Box::new),
+                })
+            }
+        }
+    }
+
+    /// Remove the assignments to the label variable that are overwritten or never read.
+    /// after_reads_label is whether the label variable is read after the instructions.
+    /// Returns whether the label variable is read after the start of the instructions.
+    fn remove_unread_label_assignments(
+        &mut self,
+        instrs: &mut Vec<Instruction>,
+        after_reads_label: bool,
+    ) -> bool {
+        // go backwards, tracking whether the current value of the label variable is read
+        let mut reads_label = after_reads_label;
+        let mut i = instrs.len();
+        while i > 0 {
+            i -= 1;
+            if matches!(&instrs[i], Instruction::SimpleAssignment(_, dest, Src::Constant(_))
+                if dest == self.label_variable)
+            {
+                if !reads_label {
+                    instrs.remove(i);
+                    self.made_changes = true;
+                }
+                reads_label = false;
+                continue;
+            }
+            match &mut instrs[i] {
+                Instruction::Break(_, loop_block_id) => {
+                    reads_label = self.loop_break_reads_label[loop_block_id];
+                }
+                Instruction::Continue(_, loop_block_id) => {
+                    reads_label = self.loop_continue_reads_label[loop_block_id];
+                }
+                Instruction::EndHandledBlock(_, multiple_block_id) => {
+                    reads_label = self.multiple_end_reads_label[multiple_block_id];
+                }
+                Instruction::Ret(..) | Instruction::TailCall(..) => {
+                    reads_label = false;
+                }
+                Instruction::IfEqElse(_, _, _, true_instrs, false_instrs)
+                | Instruction::IfNotEqElse(_, _, _, true_instrs, false_instrs) => {
+                    let true_reads_label =
+                        self.remove_unread_label_assignments(true_instrs, reads_label);
+                    let false_reads_label =
+                        self.remove_unread_label_assignments(false_instrs, reads_label);
+                    reads_label = true_reads_label || false_reads_label;
+                }
+                Instruction::BrTable(_, _, _, arms) => {
+                    // each arm falls through to after the jump table
+                    let mut any_arm_reads_label = false;
+                    for arm in arms {
+                        any_arm_reads_label |=
+                            self.remove_unread_label_assignments(arm, reads_label);
+                    }
+                    reads_label = any_arm_reads_label;
+                }
+                _ => {}
+            }
+        }
+        reads_label
+    }
+}
+
+/// Whether the label variable is read as soon as control flow enters the block, which is
+/// only the case if it dispatches to the handled blocks of a multiple block
+fn reads_label_on_entry(block: &Block) -> bool {
+    match block {
+        Block::Simple { .. } => false,
+        Block::Loop { inner, .. } => reads_label_on_entry(inner),
+        Block::Multiple { .. } => true,
+    }
+}
+
+fn is_tail_exit(instr: Option<&Instruction>, tail_exit: &TailExit) -> bool {
+    match (instr, tail_exit) {
+        (Some(Instruction::Continue(_, loop_block_id)), TailExit::Continue(tail_loop_block_id)) => {
+            loop_block_id == tail_loop_block_id
+        }
+        (
+            Some(Instruction::EndHandledBlock(_, multiple_block_id)),
+            TailExit::EndHandledBlock(tail_multiple_block_id),
+        ) => multiple_block_id == tail_multiple_block_id,
+        _ => false,
+    }
+}
+
+fn is_empty_block(block: &Block) -> bool {
+    match block {
+        Block::Simple { internal, next } => internal.instrs.is_empty() && next.is_none(),
+        _ => false,
+    }
+}
+
+/// Merge each simple block whose next block is also a simple block into one. The second
+/// block is only ever entered from the end of the first, so its label isn't needed.
+fn merge_simple_blocks(block: &mut Block) {
+    match block {
+        Block::Simple { internal, next } => {
+            while let Some(next_block) = next.take() {
+                match *next_block {
+                    Block::Simple {
+                        internal: next_internal,
+                        next: next_next,
+                    } => {
+                        internal.instrs.extend(next_internal.instrs);
+                        *next = next_next;
+                    }
+                    next_block => {
+                        *next = Some(Box::new(next_block));
+                        break;
+                    }
+                }
+            }
+            if let Some(next) = next {
+                merge_simple_blocks(next);
+            }
+        }
+        Block::Loop { inner, next, .. } => {
+            merge_simple_blocks(inner);
+            if let Some(next) = next {
+                merge_simple_blocks(next);
+            }
+        }
+        Block::Multiple {
+            handled_blocks,
+            next,
+            ..
+        } => {
+            for handled_block in handled_blocks {
+                merge_simple_blocks(handled_block);
+            }
+            if let Some(next) = next {
+                merge_simple_blocks(next);
+            }
+        }
+    }
+}
@@ -0,0 +1,198 @@
+#[cfg(test)]
+mod label_elimination_tests {
+    use super::super::eliminate_labels_in_block;
+    use crate::id::{Id, IdGenerator};
+    use crate::middle_end::ids::{InstructionId, LabelId, VarId};
+    use crate::middle_end::instructions::{Constant, Instruction, Src};
+    use crate::relooper::blocks::{Block, Label, MultipleBlockId};
+
+    struct Ids {
+        instrs: IdGenerator<InstructionId>,
+        labels: IdGenerator<LabelId>,
+        label_variable: VarId,
+        var: VarId,
+    }
+
+    impl Ids {
+        fn new() -> Self {
+            let mut var_id_generator = IdGenerator::<VarId>::new();
+            Ids {
+                instrs: IdGenerator::new(),
+                labels: IdGenerator::new(),
+                label_variable: var_id_generator.new_id(),
+                var: var_id_generator.new_id(),
+            }
+        }
+
+        fn set_label(&mut self, label: &LabelId) -> Instruction {
+            Instruction::SimpleAssignment(
+                self.instrs.new_id(),
+                self.label_variable.to_owned(),
+                Src::Constant(Constant::Int(label.as_u64() as i128)),
+            )
+        }
+
+        fn assign_var(&mut self, n: i128) -> Instruction {
+            Instruction::SimpleAssignment(
+                self.instrs.new_id(),
+                self.var.to_owned(),
+                Src::Constant(Constant::Int(n)),
+            )
+        }
+
+        fn ret(&mut self) -> Instruction {
+            Instruction::Ret(self.instrs.new_id(), None)
+        }
+    }
+
+    fn simple(label: LabelId, instrs: Vec<Instruction>, next: Option<Block>) -> Block {
+        Block::Simple {
+            internal: Label { label, instrs },
+            next: next.map(Box::new),
+        }
+    }
+
+    fn count_label_assignments(instrs: &[Instruction], label_variable: &VarId) -> usize {
+        let mut count = 0;
+        for instr in instrs {
+            match instr {
+                Instruction::SimpleAssignment(_, dest, _) if dest == label_variable => count += 1,
+                Instruction::IfEqElse(_, _, _, true_instrs, false_instrs) => {
+                    count += count_label_assignments(true_instrs, label_variable)
+                        + count_label_assignments(false_instrs, label_variable);
+                }
+                _ => {}
+            }
+        }
+        count
+    }
+
+    #[test]
+    fn removes_label_assignment_before_simple_block_and_merges() {
+        let mut ids = Ids::new();
+        let a = ids.labels.new_id();
+        let b = ids.labels.new_id();
+        let block = simple(
+            a,
+            vec![ids.assign_var(1), ids.set_label(&b)],
+            Some(simple(b, vec![ids.ret()], None)),
+        );
+
+        let block = eliminate_labels_in_block(block, &ids.label_variable.to_owned(), true);
+
+        match block {
+            Block::Simple { internal, next } => {
+                assert!(next.is_none());
+                assert_eq!(internal.instrs.len(), 2);
+                assert_eq!(
+                    count_label_assignments(&internal.instrs, &ids.label_variable),
+                    0
+                );
+            }
+            _ => panic!("expected a simple block"),
+        }
+    }
+
+    /// a: if (var == 0) { label = x } else { label = y }
+    /// multiple { x: var = 2; label = z; end handled, y: label = z; end handled }
+    /// z: return
+    fn if_without_else(ids: &mut Ids) -> Block {
+        let a = ids.labels.new_id();
+        let x = ids.labels.new_id();
+        let y = ids.labels.new_id();
+        let z = ids.labels.new_id();
+        let multiple_id = IdGenerator::<MultipleBlockId>::new().new_id();
+
+        let branch = Instruction::IfEqElse(
+            ids.instrs.new_id(),
+            Src::Var(ids.var.to_owned()),
+            Src::Constant(Constant::Int(0)),
+            vec![ids.set_label(&x)],
+            vec![ids.set_label(&y)],
+        );
+        let x_block = simple(
+            x,
+            vec![
+                ids.assign_var(2),
+                ids.set_label(&z),
+                Instruction::EndHandledBlock(ids.instrs.new_id(), multiple_id.to_owned()),
+            ],
+            None,
+        );
+        let y_block = simple(
+            y,
+            vec![
+                ids.set_label(&z),
+                Instruction::EndHandledBlock(ids.instrs.new_id(), multiple_id.to_owned()),
+            ],
+            None,
+        );
+        let multiple = Block::Multiple {
+            id: multiple_id,
+            pre_handled_blocks_instrs: Vec::new(),
+            handled_blocks: vec![x_block, y_block],
+            next: Some(Box::new(simple(z, vec![ids.ret()], None))),
+        };
+        simple(a, vec![branch], Some(multiple))
+    }
+
+    #[test]
+    fn keeps_label_assignments_read_by_multiple_block() {
+        let mut ids = Ids::new();
+        let block = if_without_else(&mut ids);
+
+        let block = eliminate_labels_in_block(block, &ids.label_variable.to_owned(), true);
+
+        let (internal, next) = match block {
+            Block::Simple { internal, next } => (internal, next.unwrap()),
+            _ => panic!("expected a simple block"),
+        };
+        // the multiple block dispatches on the label, so the branch still sets it
+        assert_eq!(
+            count_label_assignments(&internal.instrs, &ids.label_variable),
+            2
+        );
+        match *next {
+            Block::Multiple { handled_blocks, .. } => {
+                // the empty handled block is removed
+                assert_eq!(handled_blocks.len(), 1);
+                match &handled_blocks[0] {
+                    Block::Simple { internal, .. } => {
+                        // only the assignment to var is left
+                        assert_eq!(internal.instrs.len(), 1);
+                    }
+                    _ => panic!("expected a simple handled block"),
+                }
+            }
+            _ => panic!("expected a multiple block"),
+        }
+    }
+
+    #[test]
+    fn keeps_handled_blocks_and_labels_without_merging() {
+        let mut ids = Ids::new();
+        let block = if_without_else(&mut ids);
+
+        let block = eliminate_labels_in_block(block, &ids.label_variable.to_owned(), false);
+
+        let next = match block {
+            Block::Simple { next, .. } => next.unwrap(),
+            _ => panic!("expected a simple block"),
+        };
+        match *next {
+            Block::Multiple { handled_blocks, .. } => {
+                assert_eq!(handled_blocks.len(), 2);
+                for handled_block in &handled_blocks {
+                    match handled_block {
+                        Block::Simple { internal, .. } => assert_eq!(
+                            count_label_assignments(&internal.instrs, &ids.label_variable),
+                            0
+                        ),
+                        _ => panic!("expected a simple handled block"),
+                    }
+                }
+            }
+            _ => panic!("expected a multiple block"),
+        }
+    }
+}
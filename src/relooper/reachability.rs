@@ -0,0 +1,229 @@
+#[cfg(test)]
+#[path = "reachability_tests.rs"]
+mod reachability_tests;
+
+use std::collections::HashMap;
+
+use crate::data_structures::bit_set::BitSet;
+use crate::id::Id;
+use crate::middle_end::ids::LabelId;
+use crate::relooper::relooper::Labels;
+
+/// Which labels can be reached from each label, along any path of branches.
+///
+/// Labels are given dense indices, and the graph of branches is condensed into its strongly
+/// connected components. Every label in a component can reach the same labels, so the
+/// transitive closure is only stored once per component, as a bit set.
+pub struct Reachability {
+    label_indices: HashMap<LabelId, usize>,
+    label_ids: Vec<LabelId>,
+    /// The strongly connected component each label is in, indexed by label index
+    components: Vec<usize>,
+    /// The labels reachable from the labels in each component, by at least one branch
+    component_reachability: Vec<BitSet>,
+    /// Labels that have been removed since the reachability was calculated
+    removed_labels: BitSet,
+}
+
+impl Reachability {
+    pub fn new(labels: &Labels) -> Self {
+        let mut label_ids: Vec<LabelId> = labels.keys().cloned().collect();
+        // sort so that label indices don't depend on hashmap order
+        label_ids.sort_by_key(|label_id| label_id.as_u64());
+        let label_indices: HashMap<LabelId, usize> = label_ids
+            .iter()
+            .enumerate()
+            .map(|(i, label_id)| (label_id.to_owned(), i))
+            .collect();
+
+        // branches to labels that aren't in this set of labels are ignored, because those
+        // labels have already been put in an outer block
+        let successors: Vec<Vec<usize>> = label_ids
+            .iter()
+            .map(|label_id| {
+                labels
+                    .get(label_id)
+                    .unwrap()
+                    .possible_branch_targets()
+                    .iter()
+                    .filter_map(|target| label_indices.get(target).copied())
+                    .collect()
+            })
+            .collect();
+
+        let (components, component_count) = find_strongly_connected_components(&successors);
+
+        let mut component_members = vec![Vec::new(); component_count];
+        for (label_index, component) in components.iter().enumerate() {
+            component_members[*component].push(label_index);
+        }
+
+        // components are numbered so that every branch out of a component goes to a component
+        // with a lower number, so the closure of each component only depends on ones we've
+        // already calculated
+        let mut component_reachability: Vec<BitSet> = Vec::with_capacity(component_count);
+        for (component, members) in component_members.iter().enumerate() {
+            let mut reachable = BitSet::new(label_ids.len());
+            for member in members {
+                for successor in &successors[*member] {
+                    reachable.insert(*successor);
+                    let successor_component = components[*successor];
+                    if successor_component != component {
+                        reachable.union_with(&component_reachability[successor_component]);
+                    }
+                }
+            }
+            component_reachability.push(reachable);
+        }
+
+        let removed_labels = BitSet::new(label_ids.len());
+        Reachability {
+            label_indices,
+            label_ids,
+            components,
+            component_reachability,
+            removed_labels,
+        }
+    }
+
+    fn reachable_from(&self, label: &LabelId) -> &BitSet {
+        let label_index = self.label_indices.get(label).unwrap();
+        &self.component_reachability[self.components[*label_index]]
+    }
+
+    /// Whether there is a path of one or more branches from one label to another
+    pub fn can_reach(&self, from: &LabelId, to: &LabelId) -> bool {
+        match self.label_indices.get(to) {
+            None => false,
+            Some(to_index) => self.reachable_from(from).contains(*to_index),
+        }
+    }
+
+    /// Whether the label can be reached from at least one of the sources
+    pub fn is_reachable_from_any(&self, label: &LabelId, sources: &[LabelId]) -> bool {
+        sources.iter().any(|source| self.can_reach(source, label))
+    }
+
+    /// Whether at least one of the targets can be reached from the label
+    pub fn can_reach_any(&self, label: &LabelId, targets: &[LabelId]) -> bool {
+        targets.iter().any(|target| self.can_reach(label, target))
+    }
+
+    /// For each entry, find all the labels it reaches that can't be reached by any other entry.
+    /// An entry counts as reaching itself. Returns a map from each of these labels to the
+    /// entry that reaches it.
+    pub fn find_uniquely_reachable_labels(&self, entries: &[LabelId]) -> HashMap<LabelId, LabelId> {
+        let reachable_from_entries: Vec<BitSet> = entries
+            .iter()
+            .map(|entry| {
+                let mut reachable = self.reachable_from(entry).to_owned();
+                reachable.insert(*self.label_indices.get(entry).unwrap());
+                reachable
+            })
+            .collect();
+
+        let mut uniquely_reachable_labels = HashMap::new();
+        for (entry_i, entry) in entries.iter().enumerate() {
+            let mut uniquely_reachable = reachable_from_entries[entry_i].to_owned();
+            for (other_entry_i, other_entry) in entries.iter().enumerate() {
+                if other_entry != entry {
+                    uniquely_reachable.subtract(&reachable_from_entries[other_entry_i]);
+                }
+            }
+            uniquely_reachable.subtract(&self.removed_labels);
+            for label_index in uniquely_reachable.iter() {
+                uniquely_reachable_labels
+                    .insert(self.label_ids[label_index].to_owned(), entry.to_owned());
+            }
+        }
+        uniquely_reachable_labels
+    }
+
+    /// Remove a label from the graph without recalculating the reachability. This is only
+    /// possible if none of the remaining labels can reach it, because then no paths between
+    /// the remaining labels go through it. Returns false, without removing the label, if it
+    /// can be reached.
+    pub fn try_remove_unreachable_label(&mut self, label: &LabelId) -> bool {
+        let label_index = *self.label_indices.get(label).unwrap();
+        for other_index in 0..self.label_ids.len() {
+            if other_index == label_index || self.removed_labels.contains(other_index) {
+                continue;
+            }
+            if self.component_reachability[self.components[other_index]].contains(label_index) {
+                return false;
+            }
+        }
+        self.removed_labels.insert(label_index);
+        true
+    }
+}
+
+/// Tarjan's algorithm, using an explicit stack so that big functions don't overflow the call
+/// stack. Returns the component of each node, and the number of components. Components are
+/// numbered in the order they're completed, which is a reverse topological order.
+fn find_strongly_connected_components(successors: &[Vec<usize>]) -> (Vec<usize>, usize) {
+    let node_count = successors.len();
+    let mut visit_order: Vec<Option<usize>> = vec![None; node_count];
+    let mut low_link = vec![0; node_count];
+    let mut on_stack = vec![false; node_count];
+    let mut stack = Vec::new();
+    let mut components = vec![0; node_count];
+    let mut component_count = 0;
+    let mut next_visit = 0;
+
+    // each frame is a node, and the index of the next of its successors to visit
+    let mut call_stack: Vec<(usize, usize)> = Vec::new();
+
+    for root in 0..node_count {
+        if visit_order[root].is_some() {
+            continue;
+        }
+        visit_order[root] = Some(next_visit);
+        low_link[root] = next_visit;
+        next_visit += 1;
+        stack.push(root);
+        on_stack[root] = true;
+        call_stack.push((root, 0));
+
+        while let Some((node, next_successor)) = call_stack.last().copied() {
+            if let Some(successor) = successors[node].get(next_successor).copied() {
+                call_stack.last_mut().unwrap().1 += 1;
+                match visit_order[successor] {
+                    None => {
+                        visit_order[successor] = Some(next_visit);
+                        low_link[successor] = next_visit;
+                        next_visit += 1;
+                        stack.push(successor);
+                        on_stack[successor] = true;
+                        call_stack.push((successor, 0));
+                    }
+                    Some(successor_visit) if on_stack[successor] => {
+                        low_link[node] = low_link[node].min(successor_visit);
+                    }
+                    Some(_) => {}
+                }
+                continue;
+            }
+
+            // finished visiting all the node's successors
+            call_stack.pop();
+            if let Some((parent, _)) = call_stack.last() {
+                low_link[*parent] = low_link[*parent].min(low_link[node]);
+            }
+            if Some(low_link[node]) == visit_order[node] {
+                // node is the root of a component
+                loop {
+                    let member = stack.pop().unwrap();
+                    on_stack[member] = false;
+                    components[member] = component_count;
+                    if member == node {
+                        break;
+                    }
+                }
+                component_count += 1;
+            }
+        }
+    }
+
+    (components, component_count)
+}
@@ -0,0 +1,84 @@
+#[cfg(test)]
+mod reachability_tests {
+    use std::collections::HashMap;
+
+    use super::super::Reachability;
+    use crate::id::IdGenerator;
+    use crate::middle_end::ids::{InstructionId, LabelId};
+    use crate::middle_end::instructions::Instruction;
+    use crate::relooper::blocks::Label;
+    use crate::relooper::relooper::Labels;
+
+    /// Build labels from a list of branches between label numbers
+    fn make_labels(label_count: usize, branches: &[(usize, usize)]) -> (Labels, Vec<LabelId>) {
+        let mut label_id_generator = IdGenerator::<LabelId>::new();
+        let mut instr_id_generator = IdGenerator::<InstructionId>::new();
+        let label_ids: Vec<LabelId> = (0..label_count)
+            .map(|_| label_id_generator.new_id())
+            .collect();
+        let mut labels: Labels = HashMap::new();
+        for label_id in &label_ids {
+            labels.insert(label_id.to_owned(), Label::new(label_id.to_owned()));
+        }
+        for (from, to) in branches {
+            labels
+                .get_mut(&label_ids[*from])
+                .unwrap()
+                .instrs
+                .push(Instruction::Br(
+                    instr_id_generator.new_id(),
+                    label_ids[*to].to_owned(),
+                ));
+        }
+        (labels, label_ids)
+    }
+
+    #[test]
+    fn finds_transitive_reachability() {
+        // 0 -> 1 -> 2 -> 3, with a loop 1 -> 2 -> 1
+        let (labels, l) = make_labels(4, &[(0, 1), (1, 2), (2, 1), (2, 3)]);
+        let reachability = Reachability::new(&labels);
+
+        assert!(reachability.can_reach(&l[0], &l[3]));
+        assert!(reachability.can_reach(&l[1], &l[1]));
+        assert!(reachability.can_reach(&l[2], &l[2]));
+        assert!(!reachability.can_reach(&l[0], &l[0]));
+        assert!(!reachability.can_reach(&l[3], &l[1]));
+        assert!(reachability.is_reachable_from_any(&l[1], &[l[3].to_owned(), l[2].to_owned()]));
+        assert!(!reachability.can_reach_any(&l[3], &[l[0].to_owned(), l[1].to_owned()]));
+    }
+
+    #[test]
+    fn ignores_branches_to_labels_not_in_the_set() {
+        let (mut labels, l) = make_labels(3, &[(0, 1), (1, 2)]);
+        labels.remove(&l[1]);
+        let reachability = Reachability::new(&labels);
+
+        assert!(!reachability.can_reach(&l[0], &l[2]));
+        assert!(!reachability.can_reach(&l[0], &l[1]));
+    }
+
+    #[test]
+    fn finds_labels_reachable_from_only_one_entry() {
+        // entries 0 and 1 both reach 3, only 0 reaches 2
+        let (labels, l) = make_labels(4, &[(0, 2), (2, 3), (1, 3)]);
+        let reachability = Reachability::new(&labels);
+
+        let unique =
+            reachability.find_uniquely_reachable_labels(&[l[0].to_owned(), l[1].to_owned()]);
+        assert_eq!(unique.get(&l[0]), Some(&l[0]));
+        assert_eq!(unique.get(&l[2]), Some(&l[0]));
+        assert_eq!(unique.get(&l[1]), Some(&l[1]));
+        assert_eq!(unique.get(&l[3]), None);
+    }
+
+    #[test]
+    fn only_removes_labels_nothing_else_reaches() {
+        let (labels, l) = make_labels(3, &[(0, 1), (1, 2), (2, 1)]);
+        let mut reachability = Reachability::new(&labels);
+
+        assert!(!reachability.try_remove_unreachable_label(&l[1]));
+        assert!(reachability.try_remove_unreachable_label(&l[0]));
+        assert!(reachability.can_reach(&l[2], &l[1]));
+    }
+}
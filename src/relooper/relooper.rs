@@ -1,3 +1,4 @@
+use std::cmp::Reverse;
 use std::collections::{HashMap, HashSet};
 
 use log::{error, info};
@@ -8,11 +9,11 @@ use crate::middle_end::instructions::{Constant, Instruction, Src};
 use crate::middle_end::ir::{Program, ProgramMetadata};
 use crate::middle_end::ir_types::IrType;
 use crate::relooper::blocks::{Block, Label, LoopBlockId, MultipleBlockId};
+use crate::relooper::reachability::Reachability;
 use crate::relooper::soupify::soupify;
 
 pub type Labels = HashMap<LabelId, Label>;
 type Entries = Vec<LabelId>;
-type ReachabilityMap = HashMap<LabelId, Vec<LabelId>>;
 
 struct RelooperContext<'a> {
     loop_block_id_generator: &'a mut IdGenerator<LoopBlockId>,
@@ -68,6 +69,16 @@ pub fn reloop(mut prog: Program) -> ReloopedProgram {
 
     let mut loop_block_id_generator = IdGenerator::<LoopBlockId>::new();
     let mut multiple_block_id_generator = IdGenerator::<MultipleBlockId>::new();
+    // the profile identifies functions by name
+    let fun_names: HashMap<FunId, String> = match &prog.program_metadata.profile {
+        Some(_) => prog
+            .program_metadata
+            .get_function_names()
+            .into_iter()
+            .map(|(fun_id, name)| (fun_id.to_owned(), name.to_owned()))
+            .collect(),
+        None => HashMap::new(),
+    };
     for (fun_id, function) in prog.program_instructions.functions {
         // function with no body (ie. one that we'll link to in JS runtime)
         if !function.body_is_defined || function.instrs.is_empty() {
@@ -85,6 +96,13 @@ pub fn reloop(mut prog: Program) -> ReloopedProgram {
         }
         let label_var = init_label_variable(&mut prog.program_metadata);
         let (labels, entry) = soupify(function.instrs, &mut prog.program_metadata);
+        record_function_labels(
+            &fun_id,
+            fun_names.get(&fun_id),
+            &labels,
+            &entry,
+            &mut prog.program_metadata,
+        );
 
         let mut context = RelooperContext::new(
             &mut loop_block_id_generator,
@@ -152,6 +170,38 @@ pub fn reloop(mut prog: Program) -> ReloopedProgram {
     }
 }
 
+/// Record the range of ids that soupify numbered the function's labels with, starting with
+/// the entry, and look up how many times each label ran in the profile, if there is one
+fn record_function_labels(
+    fun_id: &FunId,
+    fun_name: Option<&String>,
+    labels: &Labels,
+    entry: &LabelId,
+    prog_metadata: &mut ProgramMetadata,
+) {
+    let first_label = entry.as_u64();
+    prog_metadata.function_label_ranges.insert(
+        fun_id.to_owned(),
+        first_label..first_label + labels.len() as u64,
+    );
+
+    let block_counts = match (&prog_metadata.profile, fun_name) {
+        (Some(profile), Some(fun_name)) => profile.block_counts(fun_name),
+        _ => None,
+    };
+    match block_counts {
+        // if the function has a different number of labels, it's changed since it was
+        // profiled, and the counts can't be matched up with its labels
+        Some(block_counts) if block_counts.len() == labels.len() => {
+            for label in labels.keys() {
+                let count = block_counts[(label.as_u64() - first_label) as usize];
+                prog_metadata.label_counts.insert(label.to_owned(), count);
+            }
+        }
+        _ => {}
+    }
+}
+
 fn init_label_variable(prog_metadata: &mut ProgramMetadata) -> VarId {
     let label_var = prog_metadata.new_var(ValueType::LValue);
     // make label variable an unsigned long
@@ -165,10 +215,16 @@ fn assert_no_branch_instrs_left(block: &Block) {
     match block {
         Block::Simple { internal, next } => {
             for instr in &internal.instrs {
-                let is_branch_instr = matches!(
-                    instr,
-                    Instruction::Br(..) | Instruction::BrIfEq(..) | Instruction::BrIfNotEq(..)
-                );
+                let is_branch_instr = match instr {
+                    Instruction::Br(..) | Instruction::BrIfEq(..) | Instruction::BrIfNotEq(..) => {
+                        true
+                    }
+                    Instruction::BrTable(_, _, _, arms) => arms
+                        .iter()
+                        .flatten()
+                        .any(|arm_instr| matches!(arm_instr, Instruction::Br(..))),
+                    _ => false,
+                };
                 assert!(
                     !is_branch_instr,
                     "No branch instructions should be left in output of relooper"
@@ -200,14 +256,33 @@ fn assert_no_branch_instrs_left(block: &Block) {
 }
 
 fn create_block_from_labels(
-    mut labels: Labels,
+    labels: Labels,
     entries: Entries,
     context: &mut RelooperContext,
     prog_metadata: &mut ProgramMetadata,
 ) -> Option<Block> {
-    let reachability = calculate_reachability(&labels);
-    let reachability_from_entries = combine_reachability_from_entries(&reachability, &entries);
+    if entries.is_empty() {
+        return None;
+    }
+    let reachability = Reachability::new(&labels);
+    create_block_from_labels_with_reachability(
+        labels,
+        entries,
+        reachability,
+        context,
+        prog_metadata,
+    )
+}
 
+/// Same as create_block_from_labels, but using reachability that's already been calculated
+/// for these labels
+fn create_block_from_labels_with_reachability(
+    mut labels: Labels,
+    entries: Entries,
+    mut reachability: Reachability,
+    context: &mut RelooperContext,
+    prog_metadata: &mut ProgramMetadata,
+) -> Option<Block> {
     if entries.is_empty() {
         return None;
     }
@@ -217,11 +292,23 @@ fn create_block_from_labels(
         let single_entry = entries.first().unwrap();
         // check that the single entry isn't contained in the set of possible
         // destination labels from this entry
-        if !reachability_from_entries.contains(single_entry) {
+        if !reachability.can_reach(single_entry, single_entry) {
             let next_entries: Entries = labels.get(single_entry).unwrap().possible_branch_targets();
             let mut this_label = labels.remove(single_entry).unwrap();
             replace_branch_instrs(&mut this_label, context, prog_metadata);
-            let next_block = create_block_from_labels(labels, next_entries, context, prog_metadata);
+            // only the removed label's branches have changed, so if none of the other labels
+            // can reach it, their reachability is still the same
+            let next_block = if reachability.try_remove_unreachable_label(single_entry) {
+                create_block_from_labels_with_reachability(
+                    labels,
+                    next_entries,
+                    reachability,
+                    context,
+                    prog_metadata,
+                )
+            } else {
+                create_block_from_labels(labels, next_entries, context, prog_metadata)
+            };
             return Some(Block::Simple {
                 internal: this_label,
                 next: next_block.map(Box::new),
@@ -230,19 +317,14 @@ fn create_block_from_labels(
     }
 
     // check if we can return to all of the entries, if so, create a loop block
-    let mut can_return_to_all_entries = true;
-    for entry in &entries {
-        let reachable = reachability_from_entries.contains(entry);
-        if !reachable {
-            can_return_to_all_entries = false;
-            break;
-        }
-    }
+    let can_return_to_all_entries = entries
+        .iter()
+        .all(|entry| reachability.is_reachable_from_any(entry, &entries));
     if can_return_to_all_entries {
         return Some(create_loop_block(
             labels,
             entries,
-            reachability,
+            &reachability,
             context,
             prog_metadata,
         ));
@@ -260,69 +342,12 @@ fn create_block_from_labels(
     Some(create_loop_block(
         labels,
         entries,
-        reachability,
+        &reachability,
         context,
         prog_metadata,
     ))
 }
 
-fn calculate_reachability(labels: &Labels) -> ReachabilityMap {
-    let mut possible_branch_targets = HashMap::new();
-    for label in labels.values() {
-        possible_branch_targets.insert(label.label.to_owned(), label.possible_branch_targets());
-    }
-
-    // compute the transitive closure of possible_branch_targets
-    let mut reachability: ReachabilityMap = possible_branch_targets.clone();
-    loop {
-        let mut made_changes = false;
-        for (_source_label, reachable_labels) in reachability.iter_mut() {
-            let mut i = 0;
-            loop {
-                if i >= reachable_labels.len() {
-                    break;
-                }
-                // for all the labels we currently know we can reach from _source_label,
-                // if any of their branch targets aren't in the set of reachable nodes,
-                // add them
-                let reachable_label = reachable_labels.get(i).unwrap();
-                for dest_label in possible_branch_targets
-                    .get(reachable_label)
-                    .unwrap_or(&Vec::<LabelId>::new())
-                {
-                    if !reachable_labels.contains(dest_label) {
-                        reachable_labels.push(dest_label.to_owned());
-                        made_changes = true;
-                    }
-                }
-                i += 1;
-            }
-        }
-        // keep looping until there's no more labels to add
-        if !made_changes {
-            break;
-        }
-    }
-    reachability
-}
-
-fn combine_reachability_from_entries(
-    reachability: &ReachabilityMap,
-    entries: &Vec<LabelId>,
-) -> Vec<LabelId> {
-    // use a hashset to combine the reachable labels, cos we don't want duplicates
-    let mut combined_reachability = HashSet::new();
-
-    for entry in entries {
-        // add the reachability for each entry
-        for label in reachability.get(entry).unwrap() {
-            combined_reachability.insert(label.to_owned());
-        }
-    }
-
-    Vec::from_iter(combined_reachability)
-}
-
 fn replace_branch_instrs(
     label: &mut Label,
     context: &RelooperContext,
@@ -337,6 +362,27 @@ fn replace_branch_instrs(
         return;
     }
 
+    // a jump table is always the last instruction in its label. Any of its arms that
+    // still branch just set the label variable, and fall through to the next block
+    if let Some(br_table_instr @ Instruction::BrTable(..)) = label.instrs.last() {
+        let new_instr = replace_branch_instrs_in_br_table(
+            br_table_instr,
+            prog_metadata,
+            |label_id, prog_metadata| {
+                Some(vec![Instruction::SimpleAssignment(
+                    prog_metadata.new_instr_id(),
+                    context.label_variable.to_owned(),
+                    Src::Constant(Constant::Int(label_id.as_u64() as i128)),
+                )])
+            },
+        );
+        if let Some(new_instr) = new_instr {
+            label.instrs.pop();
+            label.instrs.push(new_instr);
+        }
+        return;
+    }
+
     // we can safely unwrap, because a label must have instructions.
     let unconditional_branch_label_id = match label.instrs.last().unwrap() {
         Instruction::Br(_, label_id) => Some(label_id),
@@ -486,21 +532,18 @@ fn replace_branch_instrs(
 fn create_loop_block(
     labels: Labels,
     entries: Entries,
-    reachability: ReachabilityMap,
+    reachability: &Reachability,
     context: &mut RelooperContext,
     prog_metadata: &mut ProgramMetadata,
 ) -> Block {
     let mut inner_labels: Labels = HashMap::new();
     let mut next_labels: Labels = HashMap::new();
-    // find the labels that can return to one of the entries, and those that can't
+    // find the labels that can return to one of the entries, and those that can't.
+    // The entries are always inside the loop, even if they can't return to an entry
+    // themselves (they're only reachable from another entry)
     for (label_id, label) in labels {
-        let mut can_return = false;
-        for entry in &entries {
-            if reachability.get(&label_id).unwrap().contains(entry) {
-                can_return = true;
-                break;
-            }
-        }
+        let can_return =
+            entries.contains(&label_id) || reachability.can_reach_any(&label_id, &entries);
         if can_return {
             inner_labels.insert(label_id, label);
         } else {
@@ -678,6 +721,44 @@ fn replace_branch_instrs_inside_loop(
                         ));
                     }
                 }
+                br_table_instr @ Instruction::BrTable(..) => {
+                    let new_instr = replace_branch_instrs_in_br_table(
+                        br_table_instr,
+                        prog_metadata,
+                        |label_id, prog_metadata| {
+                            if loop_entries.contains(label_id) {
+                                Some(vec![
+                                    Instruction::SimpleAssignment(
+                                        prog_metadata.new_instr_id(),
+                                        context.label_variable.to_owned(),
+                                        Src::Constant(Constant::Int(label_id.as_u64() as i128)),
+                                    ),
+                                    Instruction::Continue(
+                                        prog_metadata.new_instr_id(),
+                                        loop_block_id.to_owned(),
+                                    ),
+                                ])
+                            } else if next_entries.contains(label_id) {
+                                Some(vec![
+                                    Instruction::SimpleAssignment(
+                                        prog_metadata.new_instr_id(),
+                                        context.label_variable.to_owned(),
+                                        Src::Constant(Constant::Int(label_id.as_u64() as i128)),
+                                    ),
+                                    Instruction::Break(
+                                        prog_metadata.new_instr_id(),
+                                        loop_block_id.to_owned(),
+                                    ),
+                                ])
+                            } else {
+                                None
+                            }
+                        },
+                    );
+                    if let Some(new_instr) = new_instr {
+                        new_instrs.push(new_instr);
+                    }
+                }
                 _ => {}
             }
             if !new_instrs.is_empty() {
@@ -693,40 +774,12 @@ fn replace_branch_instrs_inside_loop(
 fn try_create_multiple_block(
     labels: &Labels,
     entries: &Entries,
-    reachability: &ReachabilityMap,
+    reachability: &Reachability,
     context: &mut RelooperContext,
     prog_metadata: &mut ProgramMetadata,
 ) -> Option<Block> {
     // "for each entry, find all the labels it reaches that can't be reached by any other entry"
-    let mut uniquely_reachable_labels: HashMap<LabelId, Vec<LabelId>> = HashMap::new();
-    for entry in entries {
-        // let reachable_labels = labels.get(entry).unwrap().possible_branch_targets();
-        let mut reachable_labels = reachability.get(entry).unwrap().clone();
-        if !reachable_labels.contains(entry) {
-            reachable_labels.push(entry.to_owned());
-        }
-        // check which of the labels can't be reached by any other entry
-        for label in &reachable_labels {
-            let mut uniquely_reachable = true;
-            for other_entry in entries {
-                if other_entry == entry {
-                    continue;
-                }
-                if other_entry == label || reachability.get(other_entry).unwrap().contains(label) {
-                    uniquely_reachable = false;
-                    break;
-                }
-            }
-            if uniquely_reachable {
-                match uniquely_reachable_labels.get_mut(entry) {
-                    Some(labels) => labels.push(label.to_owned()),
-                    None => {
-                        uniquely_reachable_labels.insert(entry.to_owned(), vec![label.to_owned()]);
-                    }
-                }
-            }
-        }
-    }
+    let uniquely_reachable_labels = reachability.find_uniquely_reachable_labels(entries);
     if !uniquely_reachable_labels.is_empty() {
         // map of entry to labels for each handled block
         let mut handled_labels: HashMap<LabelId, Labels> = HashMap::new();
@@ -734,15 +787,7 @@ fn try_create_multiple_block(
         let mut next_labels: Labels = HashMap::new();
         // split labels into handled and next labels
         for (label_id, label) in labels {
-            let mut handled_by_entry: Option<&LabelId> = None;
-            for (entry, entry_unique_labels) in &uniquely_reachable_labels {
-                if entry_unique_labels.contains(label_id) {
-                    // handled_entries.insert(entry);
-                    handled_by_entry = Some(entry);
-                    break;
-                }
-            }
-            if let Some(entry) = handled_by_entry {
+            if let Some(entry) = uniquely_reachable_labels.get(label_id) {
                 match handled_labels.get_mut(entry) {
                     Some(labels) => {
                         labels.insert(label_id.to_owned(), label.to_owned());
@@ -764,6 +809,16 @@ fn try_create_multiple_block(
 
         let multiple_block_id = context.multiple_block_id_generator.new_id();
 
+        // the handled blocks are tested in order, so put the ones that ran most often in the
+        // profile first. Otherwise they're in order of their entry labels
+        let mut handled_labels: Vec<(LabelId, Labels)> = handled_labels.into_iter().collect();
+        handled_labels.sort_by_key(|(entry, _)| {
+            (
+                Reverse(prog_metadata.label_counts.get(entry).copied().unwrap_or(0)),
+                entry.as_u64(),
+            )
+        });
+
         let mut handled_blocks = Vec::new();
         for (handled_label_entry, mut handled_labels) in handled_labels {
             // add any new entries that are branched to from inside the handled blocks
@@ -884,6 +939,32 @@ fn replace_branch_instrs_inside_handled_block(
                         ));
                     }
                 }
+                br_table_instr @ Instruction::BrTable(..) => {
+                    let new_instr = replace_branch_instrs_in_br_table(
+                        br_table_instr,
+                        prog_metadata,
+                        |label_id, prog_metadata| {
+                            if next_entries.contains(label_id) {
+                                Some(vec![
+                                    Instruction::SimpleAssignment(
+                                        prog_metadata.new_instr_id(),
+                                        context.label_variable.to_owned(),
+                                        Src::Constant(Constant::Int(label_id.as_u64() as i128)),
+                                    ),
+                                    Instruction::EndHandledBlock(
+                                        prog_metadata.new_instr_id(),
+                                        multiple_block_id.to_owned(),
+                                    ),
+                                ])
+                            } else {
+                                None
+                            }
+                        },
+                    );
+                    if let Some(new_instr) = new_instr {
+                        new_instrs.push(new_instr);
+                    }
+                }
                 _ => {}
             }
             if !new_instrs.is_empty() {
@@ -895,3 +976,46 @@ fn replace_branch_instrs_inside_handled_block(
         }
     }
 }
+
+/// Replace the branches left in the arms of a jump table with the instructions returned by
+/// replace_br, or leave them if it returns None. Returns the new jump table instruction, or
+/// None if no branches were replaced.
+fn replace_branch_instrs_in_br_table(
+    br_table_instr: &Instruction,
+    prog_metadata: &mut ProgramMetadata,
+    replace_br: impl Fn(&LabelId, &mut ProgramMetadata) -> Option<Vec<Instruction>>,
+) -> Option<Instruction> {
+    let (id, src, table, arms) = match br_table_instr {
+        Instruction::BrTable(id, src, table, arms) => (id, src, table, arms),
+        _ => unreachable!(),
+    };
+
+    let mut made_changes = false;
+    let mut new_arms = Vec::new();
+    for arm in arms {
+        let mut new_arm = Vec::new();
+        for arm_instr in arm {
+            match arm_instr {
+                Instruction::Br(_, label_id) => match replace_br(label_id, prog_metadata) {
+                    Some(mut new_instrs) => {
+                        made_changes = true;
+                        new_arm.append(&mut new_instrs);
+                    }
+                    None => new_arm.push(arm_instr.to_owned()),
+                },
+                _ => new_arm.push(arm_instr.to_owned()),
+            }
+        }
+        new_arms.push(new_arm);
+    }
+
+    if !made_changes {
+        return None;
+    }
+    Some(Instruction::BrTable(
+        id.to_owned(),
+        src.to_owned(),
+        table.to_owned(),
+        new_arms,
+    ))
+}
@@ -21,6 +21,7 @@ pub fn soupify(
     add_block_gap_labels_after_conditionals(&mut instrs, prog_metadata);
     insert_entry_label_if_necessary(&mut instrs, prog_metadata);
     remove_consecutive_labels(&mut instrs);
+    renumber_labels(&mut instrs, prog_metadata);
     trace!("Processed instrs for soupifying:");
     for instr in &instrs {
         trace!("  {}", instr);
@@ -72,41 +73,7 @@ fn remove_consecutive_labels(instrs: &mut Vec<Instruction>) {
         }
     }
 
-    // remap the labels
-    for i in 0..instrs.len() {
-        let instr = instrs.get(i).unwrap();
-        match instr {
-            Instruction::Br(id, label_id) => match label_remappings.get(label_id) {
-                None => {}
-                Some(new_label_id) => {
-                    instrs[i] = Instruction::Br(id.to_owned(), new_label_id.to_owned().to_owned());
-                }
-            },
-            Instruction::BrIfEq(id, s1, s2, label_id) => match label_remappings.get(label_id) {
-                None => {}
-                Some(new_label_id) => {
-                    instrs[i] = Instruction::BrIfEq(
-                        id.to_owned(),
-                        s1.to_owned(),
-                        s2.to_owned(),
-                        new_label_id.to_owned().to_owned(),
-                    );
-                }
-            },
-            Instruction::BrIfNotEq(id, s1, s2, label_id) => match label_remappings.get(label_id) {
-                None => {}
-                Some(new_label_id) => {
-                    instrs[i] = Instruction::BrIfNotEq(
-                        id.to_owned(),
-                        s1.to_owned(),
-                        s2.to_owned(),
-                        new_label_id.to_owned().to_owned(),
-                    );
-                }
-            },
-            _ => {}
-        }
-    }
+    remap_branch_labels(instrs, &label_remappings);
 
     // remove all labels we've remapped
     // (remove all instructions for which the closure returns false)
@@ -120,6 +87,45 @@ fn remove_consecutive_labels(instrs: &mut Vec<Instruction>) {
     })
 }
 
+/// Give the labels new ids in the order they appear, so that the labels of a function have
+/// consecutive ids. The label variable is set to these ids, so they can be used to index a
+/// jump table when dispatching to the handled blocks of a multiple block.
+fn renumber_labels(instrs: &mut Vec<Instruction>, prog_metadata: &mut ProgramMetadata) {
+    let mut label_remappings = HashMap::new();
+    for instr in instrs.iter_mut() {
+        if let Instruction::Label(_, label_id) = instr {
+            let new_label_id = prog_metadata.label_id_generator.new_id();
+            label_remappings.insert(label_id.to_owned(), new_label_id.to_owned());
+            *label_id = new_label_id;
+        }
+    }
+    remap_branch_labels(instrs, &label_remappings);
+}
+
+/// Change the target of every branch to a label in label_remappings to the label it maps to
+fn remap_branch_labels(
+    instrs: &mut Vec<Instruction>,
+    label_remappings: &HashMap<LabelId, LabelId>,
+) {
+    for instr in instrs.iter_mut() {
+        match instr {
+            Instruction::Br(_, label_id)
+            | Instruction::BrIfEq(_, _, _, label_id)
+            | Instruction::BrIfNotEq(_, _, _, label_id) => {
+                if let Some(new_label_id) = label_remappings.get(label_id) {
+                    *label_id = new_label_id.to_owned();
+                }
+            }
+            Instruction::BrTable(_, _, _, arms) => {
+                for arm in arms {
+                    remap_branch_labels(arm, label_remappings);
+                }
+            }
+            _ => {}
+        }
+    }
+}
+
 /// Make sure that there is no fall-through from one block to the next, by adding
 /// branch instructions where fall-through exists. This adds a lot of redundant
 /// branch instructions, but this will allow us to split the instructions into a soup of blocks.
@@ -148,7 +154,10 @@ fn remove_label_fallthrough(instrs: &mut Vec<Instruction>, prog_metadata: &mut P
                     ));
                 }
             }
-            Instruction::Br(..) | Instruction::BrIfEq(..) | Instruction::BrIfNotEq(..) => {
+            Instruction::Br(..)
+            | Instruction::BrIfEq(..)
+            | Instruction::BrIfNotEq(..)
+            | Instruction::BrTable(..) => {
                 prev_instr_was_branch = true;
             }
             _ => {
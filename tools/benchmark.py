@@ -0,0 +1,223 @@
+#!/usr/bin/env python
+#
+# Times how long the test programs take to run when compiled to wasm, against the same
+# programs compiled natively with gcc, for each of a set of compiler flag configurations.
+#
+# usage: benchmark.py [filter] [--iterations N] [--configs CONFIG ...] [--json FILE]
+#
+# A config is "default", or compiler flags without their leading dashes joined with "+",
+# eg. "noopt-tailcall+noopt-stack-allocation".
+#
+import argparse
+import json
+import os
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+from testsuite import (COMPILE_OUTPUT_DIR, NODE_RUNTIME_PATH, TestSpec, build_project, compile_wasm,
+                       get_test_specs)
+
+EXIT_SUCCESS = 0
+EXIT_FAILED = 1
+
+DEFAULT_ITERATIONS = 20
+DEFAULT_CONFIGS = [
+    "default",
+    "noopt-tailcall",
+    "noopt-return-call",
+    "noopt-stack-allocation",
+    "noopt-local-promotion",
+    "noopt-global-stack-ptrs",
+    "noopt-native-calls",
+    "noopt-br-table",
+    "noopt-label-elimination",
+    "noopt-bulk-memory",
+    "noopt-simd",
+    "noopt-scalar",
+    "noopt-cfg-simplification",
+    "noopt-compile-time-eval",
+    "noopt-inline",
+    "noopt-loop",
+    "noopt-peephole",
+]
+GCC_OPT_LEVEL = "-O2"
+
+
+class BenchmarkFailedException(Exception):
+    """ Raised when a program can't be compiled or run. """
+
+    def __init__(self, message, *args):
+        self.message = message
+
+    def __str__(self):
+        return f"BenchmarkFailedException: {self.message}"
+
+
+def config_compiler_args(config: str) -> list[str]:
+    if config == "default":
+        return []
+    return [f"--{flag}" for flag in config.split("+")]
+
+
+def count_instructions(command: list) -> int or None:
+    """ The number of user-space instructions the command executes, if perf is available. """
+    if shutil.which("perf") is None:
+        return None
+    with tempfile.NamedTemporaryFile(mode="r", suffix=".perf") as perf_output:
+        subprocess.run(
+            ["perf", "stat", "-x", ",", "-e", "instructions:u", "-o", perf_output.name, "--", *command],
+            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL
+        )
+        for line in perf_output:
+            fields = line.split(",")
+            if len(fields) > 2 and fields[2].startswith("instructions"):
+                return int(fields[0]) if fields[0].isdigit() else None
+    return None
+
+
+def benchmark_native(test_spec: TestSpec, iterations: int) -> dict:
+    output_filepath = COMPILE_OUTPUT_DIR / f"{test_spec.name}.gcc{GCC_OPT_LEVEL}"
+    gcc_process_result = subprocess.run(
+        ["gcc", GCC_OPT_LEVEL, test_spec.source, "-o", output_filepath],
+        capture_output=True, universal_newlines=True
+    )
+    if gcc_process_result.returncode != 0:
+        raise BenchmarkFailedException(f"Failed to compile with GCC:\n{gcc_process_result.stderr}")
+
+    command = [output_filepath, *[str(a) for a in test_spec.args]]
+    run_times_ms = []
+    for _ in range(iterations):
+        start = time.perf_counter()
+        subprocess.run(command, stdout=subprocess.DEVNULL)
+        run_times_ms.append((time.perf_counter() - start) * 1000)
+
+    return {
+        "time_ms": statistics.median(run_times_ms),
+        "instructions": count_instructions(command),
+    }
+
+
+def benchmark_wasm(test_spec: TestSpec, config: str, iterations: int) -> dict:
+    name = f"{test_spec.name}.{config}"
+    compiler_stdout, compiler_exit_code = compile_wasm(test_spec.source, name, config_compiler_args(config))
+    if compiler_exit_code != 0:
+        raise BenchmarkFailedException(f"Failed to compile wasm:\n{compiler_stdout}")
+
+    wasm_filepath = COMPILE_OUTPUT_DIR / f"{name}.wasm"
+    program_args = [str(a) for a in test_spec.args]
+    with tempfile.NamedTemporaryFile(mode="r", suffix=".json") as timing_output:
+        # all the iterations run in one node process, so node's startup isn't timed
+        run_process_result = subprocess.run(
+            [NODE_RUNTIME_PATH, "--iterations", str(iterations), "--timing", timing_output.name, wasm_filepath,
+             *program_args],
+            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, universal_newlines=True
+        )
+        if run_process_result.returncode != 0 and os.path.getsize(timing_output.name) == 0:
+            raise BenchmarkFailedException(f"Failed to run wasm:\n{run_process_result.stderr}")
+        timing = json.load(timing_output)
+
+    runs = timing["runs"]
+    return {
+        "time_ms": statistics.median(run["main_ms"] for run in runs),
+        "module_ms": statistics.median(run["module_ms"] for run in runs),
+        "import_ms": statistics.median(run["import_ms"] for run in runs),
+        "import_calls": runs[0]["import_calls"],
+        "compile_ms": timing["compile_ms"],
+        # this includes starting node and compiling the module
+        "instructions": count_instructions([NODE_RUNTIME_PATH, wasm_filepath, *program_args]),
+        "module_bytes": wasm_filepath.stat().st_size,
+    }
+
+
+def format_instructions(instructions: int or None) -> str:
+    return "-" if instructions is None else f"{instructions / 1e6:.1f}M"
+
+
+def print_results(test_spec: TestSpec, native: dict, wasm_results: dict):
+    print(f"{test_spec.name}: native {native['time_ms']:.3f} ms, {format_instructions(native['instructions'])} "
+          f"instructions")
+    print(f"\t{'config':<40}{'time':>12}{'module':>12}{'imports':>12}{'vs gcc':>9}{'instrs':>10}{'bytes':>8}")
+    for config, wasm in wasm_results.items():
+        if wasm is None:
+            print(f"\t{config:<40}{'failed':>12}")
+            continue
+        print(f"\t{config:<40}{wasm['time_ms']:>9.3f} ms{wasm['module_ms']:>9.3f} ms{wasm['import_ms']:>9.3f} ms"
+              f"{wasm['time_ms'] / native['time_ms']:>8.2f}x{format_instructions(wasm['instructions']):>10}"
+              f"{wasm['module_bytes']:>8}")
+
+
+def print_summary(all_results: dict, configs: list[str]):
+    """ The geometric mean over all the programs of each config's run time, relative to the first config. """
+    baseline = configs[0]
+    print()
+    print(f"Geometric mean run time relative to {baseline}:")
+    for config in configs:
+        ratios = [
+            results["wasm"][config]["time_ms"] / results["wasm"][baseline]["time_ms"]
+            for results in all_results.values()
+            if results["wasm"].get(config) and results["wasm"].get(baseline) and results["wasm"][baseline]["time_ms"] > 0
+        ]
+        if ratios:
+            print(f"\t{config:<40}{statistics.geometric_mean(ratios):>8.3f}")
+
+
+def run_benchmarks(test_name_filter: str or None, iterations: int, configs: list[str]) -> dict or None:
+    # compile rust project
+    build_exit_code = build_project()
+    if build_exit_code != 0:
+        print("Error building project.")
+        return None
+
+    all_results = {}
+    for test_spec in sorted(get_test_specs(), key=lambda spec: spec.name):
+        if test_name_filter is not None and test_name_filter not in test_spec.name:
+            continue
+        print(f"Benchmarking {test_spec.name}")
+        try:
+            native = benchmark_native(test_spec, iterations)
+        except BenchmarkFailedException as e:
+            print(f"\t{e.message}")
+            continue
+
+        wasm_results = {}
+        for config in configs:
+            try:
+                wasm_results[config] = benchmark_wasm(test_spec, config, iterations)
+            except BenchmarkFailedException as e:
+                print(f"\t{config}: {e.message}")
+                wasm_results[config] = None
+
+        print_results(test_spec, native, wasm_results)
+        all_results[test_spec.name] = {"native": native, "wasm": wasm_results}
+
+    print_summary(all_results, configs)
+    return all_results
+
+
+if __name__ == "__main__":
+    # parse CLI args
+    parser = argparse.ArgumentParser()
+    parser.add_argument("filter", nargs="?", default=None)
+
+    parser.add_argument("--iterations", "-n", type=int, default=DEFAULT_ITERATIONS,
+                        help="the number of times to run each program")
+    parser.add_argument("--configs", nargs="+", default=DEFAULT_CONFIGS,
+                        help="the compiler flag configurations to compare, the first is the baseline")
+    parser.add_argument("--json", help="also write the results to this file as JSON")
+
+    args = parser.parse_args()
+
+    results = run_benchmarks(args.filter, args.iterations, args.configs)
+    if results is None:
+        sys.exit(EXIT_FAILED)
+
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump({"iterations": args.iterations, "gcc_opt_level": GCC_OPT_LEVEL, "results": results}, f,
+                      indent=2)
+    sys.exit(EXIT_SUCCESS)
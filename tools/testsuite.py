@@ -24,10 +24,11 @@ EXIT_TESTS_FAILED = 1
 
 
 class TestSpec:
-    def __init__(self, name: str, source: Path, args: list[str]):
+    def __init__(self, name: str, source: Path, args: list[str], compiler_args: list[str]):
         self.name = name
         self.source = source
         self.args = args
+        self.compiler_args = compiler_args
 
 
 class InvalidTestSpecFileException(Exception):
@@ -152,10 +153,15 @@ def read_test_file(filepath: Path) -> TestSpec:
         if "args" not in test_spec.keys() or test_spec["args"] is None:
             test_spec["args"] = []
 
+        # flags the test always needs, eg. --threads, passed to the wasm compiler before any others
+        if "compiler_args" not in test_spec.keys() or test_spec["compiler_args"] is None:
+            test_spec["compiler_args"] = []
+
         return TestSpec(
             test_spec["name"],
             test_spec["source"],
             test_spec["args"],
+            [str(a) for a in test_spec["compiler_args"]],
         )
 
 
@@ -172,7 +178,8 @@ def run_test(test_spec: TestSpec, wasm_compiler_args: list[str]):
     gcc_run_stdout, gcc_run_exit_code = run_gcc(test_spec.name, test_spec.args)
 
     # compile wasm
-    compiler_stdout, compiler_exit_code = compile_wasm(test_spec.source, test_spec.name, wasm_compiler_args)
+    compiler_stdout, compiler_exit_code = compile_wasm(test_spec.source, test_spec.name,
+                                                       [*test_spec.compiler_args, *wasm_compiler_args])
 
     if compiler_exit_code != 0:
         print("Wasm compiler stdout:")
@@ -243,7 +250,8 @@ def run_program(test_name_filter: str or None, program_args: list[str], wasm_com
         if test_name_filter is None or test_name_filter in test_spec.name:
             print(f"Running {test_spec.name}")
             # compile wasm
-            compiler_stdout, compiler_exit_code = compile_wasm(test_spec.source, test_spec.name, wasm_compiler_args)
+            compiler_stdout, compiler_exit_code = compile_wasm(test_spec.source, test_spec.name,
+                                                               [*test_spec.compiler_args, *wasm_compiler_args])
 
             if compiler_exit_code != 0:
                 print("Wasm compiler stdout:")